@@ -0,0 +1,193 @@
+//
+//  TKBenchmark.c
+//  ThemeEngine
+//
+//  Copyright (c) 2012 __MyCompanyName__. All rights reserved.
+//
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "TKBenchmark.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/resource.h>
+
+#include <unistd.h>
+
+#ifdef __APPLE__
+#include <mach/mach.h>
+#include <mach/mach_time.h>
+#endif
+
+double TKBenchmarkNow(void) {
+#ifdef __APPLE__
+    static mach_timebase_info_data_t timebase;
+    if (timebase.denom == 0)
+        mach_timebase_info(&timebase);
+
+    return (double)mach_absolute_time() * timebase.numer / timebase.denom / 1e9;
+#else
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+
+    return (double)time.tv_sec + (double)time.tv_nsec / 1e9;
+#endif
+}
+
+size_t TKBenchmarkPeakMemory(void) {
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return 0;
+
+    // Bytes on Darwin, kilobytes everywhere else
+#ifdef __APPLE__
+    return (size_t)usage.ru_maxrss;
+#else
+    return (size_t)usage.ru_maxrss * 1024;
+#endif
+}
+
+size_t TKBenchmarkResidentMemory(void) {
+#ifdef __APPLE__
+    struct task_basic_info info;
+    mach_msg_type_number_t count = TASK_BASIC_INFO_COUNT;
+    if (task_info(mach_task_self(), TASK_BASIC_INFO, (task_info_t)&info, &count) != KERN_SUCCESS)
+        return 0;
+
+    return info.resident_size;
+#else
+    // Total and resident pages
+    FILE *file = fopen("/proc/self/statm", "r");
+    if (!file)
+        return 0;
+
+    unsigned long pages = 0, resident = 0;
+    int read = fscanf(file, "%lu %lu", &pages, &resident);
+    fclose(file);
+
+    return read == 2 ? (size_t)resident * (size_t)sysconf(_SC_PAGESIZE) : 0;
+#endif
+}
+
+bool TKBenchmarkIsQuick(int argc, char **argv) {
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--quick") == 0)
+            return true;
+    }
+
+    return false;
+}
+
+int TKBenchmarkRuns(int runs, bool quick) {
+    return quick ? 2 : runs;
+}
+
+#pragma mark - Samples
+
+void TKBenchmarkSamplesInit(TKBenchmarkSamples *samples) {
+    samples->samples = NULL;
+    samples->count = 0;
+    samples->capacity = 0;
+}
+
+void TKBenchmarkSamplesAdd(TKBenchmarkSamples *samples, double seconds) {
+    if (samples->count == samples->capacity) {
+        size_t capacity = samples->capacity ? samples->capacity * 2 : 64;
+        double *grown = (double *)realloc(samples->samples, capacity * sizeof(double));
+        if (!grown)
+            return;
+
+        samples->samples = grown;
+        samples->capacity = capacity;
+    }
+
+    samples->samples[samples->count++] = seconds;
+}
+
+void TKBenchmarkSamplesFree(TKBenchmarkSamples *samples) {
+    free(samples->samples);
+    TKBenchmarkSamplesInit(samples);
+}
+
+static int TKBenchmarkCompare(const void *first, const void *second) {
+    double a = *(const double *)first;
+    double b = *(const double *)second;
+
+    return a < b ? -1 : (a > b ? 1 : 0);
+}
+
+double TKBenchmarkPercentile(TKBenchmarkSamples *samples, double percentile) {
+    if (samples->count == 0)
+        return 0.0;
+
+    qsort(samples->samples, samples->count, sizeof(double), TKBenchmarkCompare);
+
+    // Nearest rank
+    size_t rank = (size_t)(percentile / 100.0 * (double)samples->count + 0.5);
+    if (rank > 0)
+        rank--;
+    if (rank >= samples->count)
+        rank = samples->count - 1;
+
+    return samples->samples[rank];
+}
+
+#pragma mark - Reporting
+
+// Seconds in the most readable unit
+static void TKBenchmarkFormatTime(double seconds, char *string, size_t size) {
+    if (seconds < 1e-6)
+        snprintf(string, size, "%.1f ns", seconds * 1e9);
+    else if (seconds < 1e-3)
+        snprintf(string, size, "%.2f us", seconds * 1e6);
+    else if (seconds < 1.0)
+        snprintf(string, size, "%.2f ms", seconds * 1e3);
+    else
+        snprintf(string, size, "%.2f s", seconds);
+}
+
+void TKBenchmarkReport(const char *name, TKBenchmarkSamples *samples, double workPerRun, const char *unit) {
+    double median = TKBenchmarkPercentile(samples, 50.0);
+    double p90 = TKBenchmarkPercentile(samples, 90.0);
+    double p99 = TKBenchmarkPercentile(samples, 99.0);
+
+    char medianString[32], p90String[32], p99String[32];
+    TKBenchmarkFormatTime(median, medianString, sizeof(medianString));
+    TKBenchmarkFormatTime(p90, p90String, sizeof(p90String));
+    TKBenchmarkFormatTime(p99, p99String, sizeof(p99String));
+
+    double throughput = median > 0.0 ? workPerRun / median : 0.0;
+    const char *scale = "";
+    if (throughput >= 1e9) {
+        throughput /= 1e9;
+        scale = "G";
+    } else if (throughput >= 1e6) {
+        throughput /= 1e6;
+        scale = "M";
+    } else if (throughput >= 1e3) {
+        throughput /= 1e3;
+        scale = "k";
+    }
+
+    printf("%-44s p50 %10s  p90 %10s  p99 %10s  %9.2f %s%s/s  (%zu runs)\n", name, medianString, p90String, p99String,
+           throughput, scale, unit, samples->count);
+    fflush(stdout);
+}
+
+void TKBenchmarkMeasure(TKBenchmarkSamples *samples, int runs, void (*body)(int run, void *context), void *context) {
+    for (int run = 0; run < runs; run++) {
+        double start = TKBenchmarkNow();
+        body(run, context);
+        TKBenchmarkSamplesAdd(samples, TKBenchmarkNow() - start);
+    }
+}
+
+// Written, never read, the compiler can't tell
+const void *volatile TKBenchmarkSink;
+
+void TKBenchmarkUse(const void *result) {
+    TKBenchmarkSink = result;
+}
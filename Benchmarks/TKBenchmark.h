@@ -0,0 +1,66 @@
+//
+//  TKBenchmark.h
+//  ThemeEngine
+//
+//  Timing for the benchmarks of the plain C parts. A benchmark runs its work a number of times, keeps the
+//  time of every run and reports the throughput along with the latency percentiles, one line per case so
+//  that the output can be compared between runs (or collected by a build server)
+//
+//  Every benchmark takes --quick, which runs each case only a couple of times, to check that it still works
+//
+//  Copyright (c) 2012 __MyCompanyName__. All rights reserved.
+//
+
+#ifndef TKBenchmark_h
+#define TKBenchmark_h
+
+#include <stddef.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    double *samples;            // Seconds per run
+    size_t count;
+    size_t capacity;
+} TKBenchmarkSamples;
+
+// Monotonic time in seconds
+double TKBenchmarkNow(void);
+
+// Peak resident memory of the process so far, in bytes
+size_t TKBenchmarkPeakMemory(void);
+
+// Resident memory of the process right now, in bytes. Unlike the peak it goes down again as memory is freed
+size_t TKBenchmarkResidentMemory(void);
+
+// True if --quick was passed
+bool TKBenchmarkIsQuick(int argc, char **argv);
+
+// Number of runs, shortened to 2 for --quick
+int TKBenchmarkRuns(int runs, bool quick);
+
+void TKBenchmarkSamplesInit(TKBenchmarkSamples *samples);
+void TKBenchmarkSamplesAdd(TKBenchmarkSamples *samples, double seconds);
+void TKBenchmarkSamplesFree(TKBenchmarkSamples *samples);
+
+// Percentile (0 - 100) of the samples, sorts them
+double TKBenchmarkPercentile(TKBenchmarkSamples *samples, double percentile);
+
+// Prints the case - median and 90th/99th percentile latency, and the throughput of the median run given the
+// amount of work in one run (i.e segments per run with "segments" as the unit)
+void TKBenchmarkReport(const char *name, TKBenchmarkSamples *samples, double workPerRun, const char *unit);
+
+// Runs body the number of times, timing each run. The body is given the run index and the context
+void TKBenchmarkMeasure(TKBenchmarkSamples *samples, int runs, void (*body)(int run, void *context), void *context);
+
+// Keeps the compiler from optimizing away the results of the work being measured
+void TKBenchmarkUse(const void *result);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,142 @@
+//
+//  TKJSONReaderBenchmark.c
+//  ThemeEngine
+//
+//  Parse time and memory of TKJSONReader over bundles of synthetic themes (see TKThemeGenerator.h), read three
+//  ways - only the events, a full tree of every value like NSJSONSerialization builds, and the tree with the
+//  subviews of the themes kept as byte ranges, the way TKJSONBuilder reads them lazily. Along with the throughput,
+//  each case reports the bytes its result holds on to and the peak resident memory of the process after it (the
+//  cases run from the least to the most memory, so the growth of the peak is theirs)
+//
+//  The comparison with NSJSONSerialization itself is run on the device, see TKDBenchmarks.m in the demo project
+//
+//  Copyright (c) 2012 __MyCompanyName__. All rights reserved.
+//
+
+#include "TKBenchmark.h"
+#include "TKThemeGenerator.h"
+#include "TKJSONTree.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#pragma mark - Benchmark
+
+typedef enum { TKReadEvents, TKReadLazyTree, TKReadTree } TKReadMode;
+
+typedef struct {
+    const char *json;
+    size_t length;
+    TKReadMode mode;
+    TKJSONReader reader;
+    size_t events;
+    size_t held;                // Bytes held by the result of the last run
+} TKReadBenchmark;
+
+static TKJSONAction TKCountEvent(const TKJSONEvent *event, void *context) {
+    (void)event;
+    ((TKReadBenchmark *)context)->events++;
+    return TKJSONActionContinue;
+}
+
+static void TKReadBody(int run, void *info) {
+    (void)run;
+    TKReadBenchmark *benchmark = (TKReadBenchmark *)info;
+    bool success;
+
+    if (benchmark->mode == TKReadEvents) {
+        benchmark->events = 0;
+        success = TKJSONRead(&benchmark->reader, benchmark->json, benchmark->length, TKCountEvent, benchmark, NULL);
+        benchmark->held = benchmark->reader.scratchCapacity;
+    } else {
+        TKTreeValue root;
+        success = TKJSONTreeRead(&benchmark->reader, benchmark->json, benchmark->length, benchmark->mode == TKReadLazyTree,
+                                 &root, &benchmark->held);
+        if (success)
+            TKJSONTreeFree(&root);
+    }
+
+    if (!success) {
+        fprintf(stderr, "Synthetic bundle did not parse\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+// Themes of the bundle in one document, {"themes":[...]}
+static char *TKGenerateBundle(size_t themes, size_t views, size_t *length) {
+    size_t capacity = 64, used = 0;
+    char *bundle = (char *)malloc(capacity);
+    used += (size_t)sprintf(bundle, "{\"themes\":[");
+
+    for (size_t i = 0; i < themes; i++) {
+        TKThemeGeneratorOptions options = TKThemeGeneratorDefaultOptions();
+        options.nodes = views;
+        options.depth = 8;
+        options.seed += i;
+
+        size_t themeLength = 0;
+        char *theme = TKThemeGenerate(&options, &themeLength);
+        if (used + themeLength + 4 > capacity) {
+            capacity = (used + themeLength + 4) * 2;
+            bundle = (char *)realloc(bundle, capacity);
+        }
+
+        if (i > 0)
+            bundle[used++] = ',';
+        memcpy(bundle + used, theme, themeLength);
+        used += themeLength;
+        free(theme);
+    }
+
+    memcpy(bundle + used, "]}", 3);
+    *length = used + 2;
+    return bundle;
+}
+
+int main(int argc, char **argv) {
+    bool quick = TKBenchmarkIsQuick(argc, argv);
+
+    struct {
+        size_t themes;
+        int runs;
+    } bundles[] = { { 1, 50 }, { 8, 10 }, { 32, 5 } };
+
+    const struct {
+        const char *name;
+        TKReadMode mode;
+    } modes[] = {
+        { "events only", TKReadEvents },
+        { "lazy tree", TKReadLazyTree },
+        { "full tree", TKReadTree },
+    };
+
+    for (size_t m = 0; m < sizeof(modes) / sizeof(modes[0]); m++) {
+        for (size_t b = 0; b < sizeof(bundles) / sizeof(bundles[0]); b++) {
+            size_t length = 0;
+            char *json = TKGenerateBundle(bundles[b].themes, quick ? 100 : 2000, &length);
+
+            TKReadBenchmark benchmark;
+            memset(&benchmark, 0, sizeof(TKReadBenchmark));
+            benchmark.json = json;
+            benchmark.length = length;
+            benchmark.mode = modes[m].mode;
+            TKJSONReaderInit(&benchmark.reader);
+
+            TKBenchmarkSamples samples;
+            TKBenchmarkSamplesInit(&samples);
+            TKBenchmarkMeasure(&samples, TKBenchmarkRuns(bundles[b].runs, quick), TKReadBody, &benchmark);
+
+            char name[96];
+            snprintf(name, sizeof(name), "%s, %zu themes (%zu KB)", modes[m].name, bundles[b].themes, length / 1024);
+            TKBenchmarkReport(name, &samples, (double)length, "B");
+            printf("%-44s held %zu KB, peak memory %zu KB\n", "", benchmark.held / 1024, TKBenchmarkPeakMemory() / 1024);
+
+            TKBenchmarkSamplesFree(&samples);
+            TKJSONReaderFree(&benchmark.reader);
+            free(json);
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,149 @@
+//
+//  TKJSONTree.c
+//  ThemeEngine
+//
+//  Copyright (c) 2012 __MyCompanyName__. All rights reserved.
+//
+
+#include "TKJSONTree.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+    TKTreeValue *values;        // Finished values waiting for their containers to end
+    size_t count;
+    size_t capacity;
+
+    size_t starts[kJSONReaderMaximumDepth];
+    size_t depth;
+
+    bool lazy;                  // Objects in "subviews" arrays are kept as ranges
+    size_t subviewsDepth;       // Depth of the innermost "subviews" array, 0 outside of them
+    bool lastKeyIsSubviews;
+    bool skipping;              // The last value is a range waiting for its end
+
+    size_t bytes;               // Held by the finished tree
+} TKTreeBuilder;
+
+static void TKTreePush(TKTreeBuilder *builder, TKTreeValue value) {
+    if (builder->count == builder->capacity) {
+        builder->capacity = builder->capacity ? builder->capacity * 2 : 1024;
+        builder->values = (TKTreeValue *)realloc(builder->values, builder->capacity * sizeof(TKTreeValue));
+    }
+
+    builder->values[builder->count++] = value;
+}
+
+static TKTreeValue TKTreeCopyString(TKTreeBuilder *builder, const char *bytes, size_t length) {
+    TKTreeValue value;
+    value.type = TKTreeString;
+    value.count = length;
+    value.string = (char *)malloc(length + 1);
+    memcpy(value.string, bytes, length);
+    value.string[length] = '\0';
+    builder->bytes += length + 1;
+
+    return value;
+}
+
+static TKJSONAction TKTreeEvent(const TKJSONEvent *event, void *context) {
+    TKTreeBuilder *builder = (TKTreeBuilder *)context;
+    TKTreeValue value;
+    memset(&value, 0, sizeof(TKTreeValue));
+
+    switch (event->type) {
+        case TKJSONEventBeginObject:
+        case TKJSONEventBeginArray:
+            builder->starts[builder->depth++] = builder->count;
+            if (event->type == TKJSONEventBeginArray && builder->lastKeyIsSubviews && builder->subviewsDepth == 0)
+                builder->subviewsDepth = builder->depth;
+
+            if (builder->lazy && event->type == TKJSONEventBeginObject && builder->subviewsDepth == builder->depth - 1 &&
+                builder->subviewsDepth > 0) {
+                // The offset is kept for the range, the end completes it
+                value.type = TKTreeRange;
+                value.offset = event->offset;
+                TKTreePush(builder, value);
+                builder->skipping = true;
+                return TKJSONActionSkip;
+            }
+
+            builder->lastKeyIsSubviews = false;
+            return TKJSONActionContinue;
+        case TKJSONEventEndObject:
+        case TKJSONEventEndArray: {
+            size_t start = builder->starts[--builder->depth];
+            if (builder->subviewsDepth == builder->depth + 1)
+                builder->subviewsDepth = 0;
+
+            if (builder->skipping) {
+                builder->skipping = false;
+                builder->values[start].count = event->offset + 1 - builder->values[start].offset;
+                return TKJSONActionContinue;
+            }
+
+            value.type = event->type == TKJSONEventEndObject ? TKTreeObject : TKTreeArray;
+            value.count = builder->count - start;
+            value.values = (TKTreeValue *)malloc((value.count ? value.count : 1) * sizeof(TKTreeValue));
+            memcpy(value.values, builder->values + start, value.count * sizeof(TKTreeValue));
+            builder->bytes += value.count * sizeof(TKTreeValue);
+            builder->count = start;
+            break;
+        }
+        case TKJSONEventKey:
+            builder->lastKeyIsSubviews = event->length == 8 && memcmp(event->bytes, "subviews", 8) == 0;
+            value = TKTreeCopyString(builder, event->bytes, event->length);
+            break;
+        case TKJSONEventString:
+            value = TKTreeCopyString(builder, event->bytes, event->length);
+            break;
+        case TKJSONEventNumber:
+            value.type = TKTreeNumber;
+            value.number = event->number;
+            break;
+        case TKJSONEventTrue:
+            value.type = TKTreeTrue;
+            break;
+        case TKJSONEventFalse:
+            value.type = TKTreeFalse;
+            break;
+        case TKJSONEventNull:
+            value.type = TKTreeNull;
+            break;
+    }
+
+    TKTreePush(builder, value);
+    return TKJSONActionContinue;
+}
+
+void TKJSONTreeFree(TKTreeValue *value) {
+    if (value->type == TKTreeString) {
+        free(value->string);
+    } else if (value->type == TKTreeArray || value->type == TKTreeObject) {
+        for (size_t i = 0; i < value->count; i++) {
+            TKJSONTreeFree(&value->values[i]);
+        }
+        free(value->values);
+    }
+}
+
+bool TKJSONTreeRead(TKJSONReader *reader, const char *bytes, size_t length, bool lazy, TKTreeValue *root, size_t *held) {
+    TKTreeBuilder builder;
+    memset(&builder, 0, sizeof(TKTreeBuilder));
+    builder.lazy = lazy;
+
+    bool success = TKJSONRead(reader, bytes, length, TKTreeEvent, &builder, NULL) && builder.count == 1;
+    if (success) {
+        *root = builder.values[0];
+        if (held)
+            *held = builder.bytes;
+    } else {
+        for (size_t i = 0; i < builder.count; i++) {
+            TKJSONTreeFree(&builder.values[i]);
+        }
+    }
+
+    free(builder.values);
+    return success;
+}
@@ -0,0 +1,47 @@
+//
+//  TKJSONTree.h
+//  ThemeEngine
+//
+//  JSON read into a tree of every value, the way NSJSONSerialization builds one, for the benchmarks to compare
+//  the other ways of reading themes against. Lazily, the views in "subviews" are kept as byte ranges of the
+//  document, the way TKJSONBuilder reads them
+//
+//  Copyright (c) 2012 __MyCompanyName__. All rights reserved.
+//
+
+#ifndef TKJSONTree_h
+#define TKJSONTree_h
+
+#include "TKJSONReader.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum { TKTreeNull, TKTreeFalse, TKTreeTrue, TKTreeNumber, TKTreeString, TKTreeArray, TKTreeObject, TKTreeRange } TKTreeType;
+
+// Objects hold their keys and values in turns. Ranges are skipped subtrees, offset and length into the document
+typedef struct TKTreeValue {
+    TKTreeType type;
+    size_t count;
+    union {
+        double number;
+        char *string;
+        struct TKTreeValue *values;
+        size_t offset;
+    };
+} TKTreeValue;
+
+// Reads the document into root, held (if not NULL) is set to the bytes the tree allocated. False if it's not valid JSON
+bool TKJSONTreeRead(TKJSONReader *reader, const char *bytes, size_t length, bool lazy, TKTreeValue *root, size_t *held);
+
+void TKJSONTreeFree(TKTreeValue *value);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,144 @@
+//
+//  TKPathParserBenchmark.c
+//  ThemeEngine
+//
+//  Throughput of TKPathParser in segments per second, over generated icon paths of a few thousand segments
+//  written the way exporters write them - relative curves with a couple of decimals, implicit repeats,
+//  separators left out where the grammar allows it
+//
+//  Copyright (c) 2012 __MyCompanyName__. All rights reserved.
+//
+
+#include "TKBenchmark.h"
+#include "TKPathParser.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+    char *bytes;
+    size_t length;
+    size_t capacity;
+    size_t segments;
+} TKPathData;
+
+static void TKPathDataAppend(TKPathData *data, const char *format, double a, double b, double c, double d, double e, double f) {
+    if (data->length + 256 > data->capacity) {
+        data->capacity = data->capacity ? data->capacity * 2 : 4096;
+        data->bytes = (char *)realloc(data->bytes, data->capacity);
+    }
+
+    data->length += (size_t)snprintf(data->bytes + data->length, 256, format, a, b, c, d, e, f);
+    data->segments++;
+}
+
+static uint32_t TKPathRandom(uint64_t *state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+
+    return (uint32_t)(*state >> 16);
+}
+
+// Coordinate with up to three decimals, around 0 for relative commands
+static double TKPathCoordinate(uint64_t *state, double range) {
+    return (double)((int)(TKPathRandom(state) % (uint32_t)(range * 2000.0)) - (int)(range * 1000.0)) / 1000.0;
+}
+
+typedef enum { TKPathStyleIcon,         // Relative curves and lines, the bulk of exported icons
+               TKPathStyleLines,        // Absolute polylines, i.e charts
+               TKPathStyleArcs } TKPathStyle;
+
+static void TKGeneratePath(TKPathData *data, TKPathStyle style, size_t segments, uint64_t seed) {
+    uint64_t state = seed;
+    data->length = 0;
+    data->segments = 0;
+
+    TKPathDataAppend(data, "M%.3f %.3f", 12.5, 3.25, 0, 0, 0, 0);
+    while (data->segments < segments) {
+        uint32_t choice = TKPathRandom(&state) % 100;
+
+        if (style == TKPathStyleLines) {
+            TKPathDataAppend(data, choice < 50 ? "L%.2f,%.2f" : " %.2f,%.2f", 100.0 + TKPathCoordinate(&state, 100.0),
+                             100.0 + TKPathCoordinate(&state, 100.0), 0, 0, 0, 0);
+        } else if (style == TKPathStyleArcs) {
+            TKPathDataAppend(data, "a%.3f %.3f %.0f 0 1 %.3f %.3f", 2.0 + TKPathCoordinate(&state, 1.0), 2.0 + TKPathCoordinate(&state, 1.0),
+                             (double)(choice % 90), TKPathCoordinate(&state, 4.0), TKPathCoordinate(&state, 4.0), 0);
+        } else if (choice < 45) {
+            TKPathDataAppend(data, "c%.3f,%.3f %.3f,%.3f %.3f,%.3f", TKPathCoordinate(&state, 4.0), TKPathCoordinate(&state, 4.0),
+                             TKPathCoordinate(&state, 4.0), TKPathCoordinate(&state, 4.0), TKPathCoordinate(&state, 4.0), TKPathCoordinate(&state, 4.0));
+        } else if (choice < 60) {
+            TKPathDataAppend(data, "s%.3f,%.3f %.3f,%.3f", TKPathCoordinate(&state, 4.0), TKPathCoordinate(&state, 4.0),
+                             TKPathCoordinate(&state, 4.0), TKPathCoordinate(&state, 4.0), 0, 0);
+        } else if (choice < 80) {
+            TKPathDataAppend(data, "l%.3f%.3f", TKPathCoordinate(&state, 4.0), TKPathCoordinate(&state, 4.0), 0, 0, 0, 0);
+        } else if (choice < 88) {
+            TKPathDataAppend(data, choice & 1 ? "h%.3f" : "v%.3f", TKPathCoordinate(&state, 4.0), 0, 0, 0, 0, 0);
+        } else if (choice < 95) {
+            TKPathDataAppend(data, "q%.2f %.2f %.2f %.2f", TKPathCoordinate(&state, 4.0), TKPathCoordinate(&state, 4.0),
+                             TKPathCoordinate(&state, 4.0), TKPathCoordinate(&state, 4.0), 0, 0);
+        } else {
+            TKPathDataAppend(data, "zm%.3f %.3f", TKPathCoordinate(&state, 8.0), TKPathCoordinate(&state, 8.0), 0, 0, 0, 0);
+        }
+    }
+}
+
+typedef struct {
+    TKPathData *data;
+    TKPathBuffer *buffer;
+} TKParseContext;
+
+static void TKParseBody(int run, void *info) {
+    (void)run;
+    TKParseContext *context = (TKParseContext *)info;
+
+    TKPathBufferReset(context->buffer);
+    if (!TKPathParse(context->data->bytes, context->data->length, context->buffer, NULL)) {
+        fprintf(stderr, "Generated path did not parse\n");
+        exit(EXIT_FAILURE);
+    }
+
+    TKBenchmarkUse(context->buffer->coordinates);
+}
+
+int main(int argc, char **argv) {
+    bool quick = TKBenchmarkIsQuick(argc, argv);
+
+    struct {
+        const char *name;
+        TKPathStyle style;
+        size_t segments;
+    } cases[] = {
+        { "parse icon path, 500 segments", TKPathStyleIcon, 500 },
+        { "parse icon path, 5000 segments", TKPathStyleIcon, 5000 },
+        { "parse polyline, 20000 segments", TKPathStyleLines, 20000 },
+        { "parse arcs, 2000 segments", TKPathStyleArcs, 2000 },
+    };
+
+    TKPathData data = { NULL, 0, 0, 0 };
+    TKPathBuffer buffer;
+    TKPathBufferInit(&buffer);
+
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        TKGeneratePath(&data, cases[i].style, cases[i].segments, 0x2545F4914F6CDD1DULL + i);
+
+        TKParseContext context = { &data, &buffer };
+        TKBenchmarkSamples samples;
+        TKBenchmarkSamplesInit(&samples);
+
+        // Warm up the buffer, then measure
+        TKParseBody(0, &context);
+        TKBenchmarkMeasure(&samples, TKBenchmarkRuns(200, quick), TKParseBody, &context);
+
+        char name[96];
+        snprintf(name, sizeof(name), "%s (%zu KB)", cases[i].name, data.length / 1024);
+        TKBenchmarkReport(name, &samples, (double)data.segments, "segments");
+        TKBenchmarkSamplesFree(&samples);
+    }
+
+    TKPathBufferFree(&buffer);
+    free(data.bytes);
+
+    return EXIT_SUCCESS;
+}
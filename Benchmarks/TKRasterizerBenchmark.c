@@ -0,0 +1,152 @@
+//
+//  TKRasterizerBenchmark.c
+//  ThemeEngine
+//
+//  Throughput of TKRasterizer in megapixels per second, of the area being painted - solid and gradient fills,
+//  each of the blend modes, shadows and strokes, at the sizes themed views are drawn at. Built twice, with the
+//  SIMD kernels and with TK_RASTER_NO_SIMD, the kernels are named in the output so the two can be compared
+//
+//  Copyright (c) 2012 __MyCompanyName__. All rights reserved.
+//
+
+#include "TKBenchmark.h"
+#include "TKRasterizer.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+typedef enum { TKRasterCaseSolid,               // Opaque rect, the kernels alone
+               TKRasterCaseTranslucent,         // Translucent rounded rect, source over with coverage
+               TKRasterCaseGradient,
+               TKRasterCaseMultiply,
+               TKRasterCaseOverlay,
+               TKRasterCaseSoftLight,
+               TKRasterCaseShadow,              // Blurred drop shadow under a rounded rect
+               TKRasterCaseStroke } TKRasterCase;
+
+typedef struct {
+    TKRasterCase drawing;
+    TKRasterSurface surface;
+    TKRasterContext context;
+    TKPathBuffer path;
+    TKRasterGradient gradient;
+} TKRasterBenchmark;
+
+static void TKRasterBody(int run, void *info) {
+    (void)run;
+    TKRasterBenchmark *benchmark = (TKRasterBenchmark *)info;
+    TKRasterContext *context = &benchmark->context;
+    int width = benchmark->surface.width, height = benchmark->surface.height;
+
+    TKRasterColor color = { 0.2f, 0.4f, 0.8f, 1.0f };
+    TKRasterColor translucent = { 0.9f, 0.5f, 0.1f, 0.6f };
+
+    TKRasterContextSaveState(context);
+
+    switch (benchmark->drawing) {
+        case TKRasterCaseSolid:
+            TKRasterContextFillPath(context, &benchmark->path, TKRasterFillNonZero, color);
+            break;
+        case TKRasterCaseTranslucent:
+            TKRasterContextFillPath(context, &benchmark->path, TKRasterFillNonZero, translucent);
+            break;
+        case TKRasterCaseGradient:
+            TKRasterContextFillPathWithGradient(context, &benchmark->path, TKRasterFillNonZero, &benchmark->gradient, 0, 0, 0, height);
+            break;
+        case TKRasterCaseMultiply:
+        case TKRasterCaseOverlay:
+        case TKRasterCaseSoftLight: {
+            TKRasterBlendMode modes[3] = { TKRasterBlendMultiply, TKRasterBlendOverlay, TKRasterBlendSoftLight };
+            TKRasterContextSetBlendMode(context, modes[benchmark->drawing - TKRasterCaseMultiply]);
+            TKRasterContextFillPathWithGradient(context, &benchmark->path, TKRasterFillNonZero, &benchmark->gradient, 0, 0, width, height);
+            break;
+        }
+        case TKRasterCaseShadow: {
+            TKRasterColor shadow = { 0.0f, 0.0f, 0.0f, 0.5f };
+            TKRasterContextSetShadow(context, 0.0f, 2.0f, 6.0f, shadow);
+            TKRasterContextFillPath(context, &benchmark->path, TKRasterFillNonZero, color);
+            break;
+        }
+        case TKRasterCaseStroke:
+            TKRasterContextSetLineWidth(context, 2.0f);
+            TKRasterContextSetLineJoin(context, TKRasterLineJoinRound);
+            TKRasterContextStrokePath(context, &benchmark->path, color);
+            break;
+    }
+
+    TKRasterContextRestoreState(context);
+    TKBenchmarkUse(benchmark->surface.pixels);
+}
+
+int main(int argc, char **argv) {
+    bool quick = TKBenchmarkIsQuick(argc, argv);
+
+    struct {
+        const char *name;
+        TKRasterCase drawing;
+    } cases[] = {
+        { "solid fill", TKRasterCaseSolid },
+        { "translucent rounded fill", TKRasterCaseTranslucent },
+        { "linear gradient", TKRasterCaseGradient },
+        { "multiply gradient", TKRasterCaseMultiply },
+        { "overlay gradient", TKRasterCaseOverlay },
+        { "soft light gradient", TKRasterCaseSoftLight },
+        { "blurred shadow", TKRasterCaseShadow },
+        { "rounded stroke", TKRasterCaseStroke },
+    };
+
+    // A button, a cell and a full screen background at 2x
+    struct {
+        int width;
+        int height;
+    } sizes[] = { { 200, 88 }, { 640, 88 }, { 640, 960 } };
+
+    printf("kernels: %s\n", TKRasterKernelName());
+
+    TKRasterColor stops[3] = { { 0.45f, 0.62f, 0.95f, 1.0f }, { 0.13f, 0.33f, 0.78f, 1.0f }, { 0.05f, 0.15f, 0.4f, 0.8f } };
+
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+            TKRasterBenchmark benchmark;
+            benchmark.drawing = cases[i].drawing;
+
+            if (!TKRasterSurfaceInit(&benchmark.surface, sizes[s].width, sizes[s].height) ||
+                !TKRasterContextInit(&benchmark.context, &benchmark.surface)) {
+                fprintf(stderr, "Could not set up a surface of %dx%d\n", sizes[s].width, sizes[s].height);
+                return EXIT_FAILURE;
+            }
+
+            TKRasterColor backdrop = { 0.5f, 0.5f, 0.5f, 1.0f };
+            TKRasterSurfaceClear(&benchmark.surface, backdrop);
+            TKRasterGradientInit(&benchmark.gradient, stops, NULL, 3);
+
+            // Inset so that the shadow fits, the rect is the area being painted
+            double inset = 8.0, width = sizes[s].width - 2 * inset, height = sizes[s].height - 2 * inset;
+            TKPathBufferInit(&benchmark.path);
+            if (cases[i].drawing == TKRasterCaseSolid) {
+                TKRasterPathAddRect(&benchmark.path, inset, inset, width, height);
+            } else {
+                double radii[4] = { 12, 12, 12, 12 };
+                TKRasterPathAddRoundedRect(&benchmark.path, inset, inset, width, height, radii);
+            }
+
+            TKBenchmarkSamples samples;
+            TKBenchmarkSamplesInit(&samples);
+
+            // Warm up the scratch buffers, then measure
+            TKRasterBody(0, &benchmark);
+            TKBenchmarkMeasure(&samples, TKBenchmarkRuns(s == 2 ? 50 : 300, quick), TKRasterBody, &benchmark);
+
+            char name[96];
+            snprintf(name, sizeof(name), "%s, %dx%d (%s)", cases[i].name, sizes[s].width, sizes[s].height, TKRasterKernelName());
+            TKBenchmarkReport(name, &samples, width * height, "pixels");
+            TKBenchmarkSamplesFree(&samples);
+
+            TKPathBufferFree(&benchmark.path);
+            TKRasterContextFree(&benchmark.context);
+            TKRasterSurfaceFree(&benchmark.surface);
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
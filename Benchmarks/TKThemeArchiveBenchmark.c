@@ -0,0 +1,299 @@
+//
+//  TKThemeArchiveBenchmark.c
+//  ThemeEngine
+//
+//  Cold load of synthetic themes (see TKThemeGenerator.h), the JSON against the compiled archive (see
+//  TKThemeCompiler.h) - the time from the file to a theme that can be read, and the resident memory the loaded
+//  theme holds on to. The JSON is read into a tree of every value the way NSJSONSerialization does, and lazily
+//  the way TKJSONBuilder does. The archive is mapped, and read completely the way building every view does
+//
+//  Each run starts with the pages of the file dropped from the page cache where the system allows it (Linux),
+//  elsewhere the file is read from the cache. The resident memory is taken in a new process (the benchmark runs
+//  itself with --resident), where the pages freed by the earlier runs can't be reused. The comparison through the
+//  engine itself is run on the device, see TKDBenchmarks.m in the demo project
+//
+//  Copyright (c) 2012 __MyCompanyName__. All rights reserved.
+//
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "TKBenchmark.h"
+#include "TKThemeGenerator.h"
+#include "TKJSONTree.h"
+#include "TKThemeArchiveFormat.h"
+#include "TKThemeCompiler.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+typedef enum { TKLoadJSON, TKLoadJSONLazy, TKLoadArchive, TKLoadArchiveAll } TKLoadMode;
+
+// A loaded theme, held until it's unloaded
+typedef struct {
+    TKTreeValue root;
+    const uint8_t *mapping;
+    size_t length;
+    size_t strings;             // Bytes of the strings read from the archive
+} TKLoadedTheme;
+
+static void TKDropFromCache(const char *path) {
+#ifdef POSIX_FADV_DONTNEED
+    int file = open(path, O_RDONLY);
+    if (file >= 0) {
+        posix_fadvise(file, 0, 0, POSIX_FADV_DONTNEED);
+        close(file);
+    }
+#else
+    (void)path;
+#endif
+}
+
+static bool TKWriteFile(const char *path, const void *bytes, size_t length) {
+    FILE *file = fopen(path, "wb");
+    if (!file)
+        return false;
+
+    bool written = fwrite(bytes, 1, length, file) == length;
+    return fclose(file) == 0 && written;
+}
+
+#pragma mark - Loading
+
+// Every node and string below value, the way building every view reads them
+static void TKReadArchiveValue(TKLoadedTheme *theme, TKArchiveValue value) {
+    if (value.type == TKArchiveValueString) {
+        uint32_t length = 0;
+        const char *bytes = TKArchiveStringAtIndex(theme->mapping, value.payload, &length);
+        theme->strings += length ? (size_t)(unsigned char)bytes[0] + length : 0;
+        return;
+    }
+
+    if (value.type != TKArchiveValueArray && value.type != TKArchiveValueDictionary)
+        return;
+
+    bool isDictionary = value.type == TKArchiveValueDictionary;
+    uint32_t count = 0;
+    const uint8_t *node = TKArchiveNodeAtOffset(theme->mapping, value.payload, isDictionary ? sizeof(TKArchiveEntry) : sizeof(TKArchiveValue), &count);
+    if (!node)
+        return;
+
+    for (uint32_t i = 0; i < count; i++) {
+        if (isDictionary) {
+            const TKArchiveEntry *entry = (const TKArchiveEntry *)(node + kArchiveNodeHeaderSize) + i;
+            TKArchiveValue key = { TKArchiveValueString, entry->key };
+            TKReadArchiveValue(theme, key);
+            TKReadArchiveValue(theme, entry->value);
+        } else {
+            TKReadArchiveValue(theme, ((const TKArchiveValue *)(node + kArchiveNodeHeaderSize))[i]);
+        }
+    }
+}
+
+static bool TKLoad(TKLoadMode mode, const char *path, TKJSONReader *reader, TKLoadedTheme *theme) {
+    memset(theme, 0, sizeof(TKLoadedTheme));
+
+    int file = open(path, O_RDONLY);
+    struct stat info;
+    if (file < 0 || fstat(file, &info) != 0) {
+        if (file >= 0)
+            close(file);
+        return false;
+    }
+
+    theme->length = (size_t)info.st_size;
+    bool success;
+
+    if (mode == TKLoadJSON || mode == TKLoadJSONLazy) {
+        // The whole text in memory first, like -dataWithContentsOfFile:
+        char *bytes = (char *)malloc(theme->length);
+        success = bytes && read(file, bytes, theme->length) == (ssize_t)theme->length;
+        success = success && TKJSONTreeRead(reader, bytes, theme->length, mode == TKLoadJSONLazy, &theme->root, NULL);
+
+        // The lazy views keep the text they are read from later
+        if (mode == TKLoadJSONLazy && success)
+            theme->mapping = (const uint8_t *)bytes;
+        else
+            free(bytes);
+    } else {
+        void *mapping = mmap(NULL, theme->length, PROT_READ, MAP_PRIVATE, file, 0);
+        success = mapping != MAP_FAILED && TKArchiveIsValid((const uint8_t *)mapping, theme->length);
+        theme->mapping = mapping != MAP_FAILED ? (const uint8_t *)mapping : NULL;
+
+        if (success && mode == TKLoadArchiveAll)
+            TKReadArchiveValue(theme, ((const TKArchiveHeader *)mapping)->root);
+    }
+
+    close(file);
+    return success;
+}
+
+static void TKUnload(TKLoadMode mode, TKLoadedTheme *theme) {
+    if (mode == TKLoadJSON || mode == TKLoadJSONLazy) {
+        TKJSONTreeFree(&theme->root);
+        free((void *)theme->mapping);
+    } else if (theme->mapping) {
+        munmap((void *)theme->mapping, theme->length);
+    }
+}
+
+#pragma mark - Resident memory
+
+// In this process, started with --resident <mode> <path>: loads the theme once and prints the growth of the resident memory
+static int TKMeasureResident(TKLoadMode mode, const char *path) {
+    TKJSONReader reader;
+    TKJSONReaderInit(&reader);
+
+    TKLoadedTheme theme;
+    TKDropFromCache(path);
+    size_t before = TKBenchmarkResidentMemory();
+    bool success = TKLoad(mode, path, &reader, &theme);
+    size_t after = TKBenchmarkResidentMemory();
+
+    TKUnload(mode, &theme);
+    TKJSONReaderFree(&reader);
+
+    printf("%zu\n", after > before ? after - before : 0);
+    return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// Runs the benchmark itself (at executable) to take the resident memory of the loaded theme, 0 if that failed
+static size_t TKResidentMemoryOfLoad(const char *executable, TKLoadMode mode, const char *path) {
+    int output[2];
+    if (pipe(output) != 0)
+        return 0;
+
+    char modeArgument[16];
+    snprintf(modeArgument, sizeof(modeArgument), "%d", (int)mode);
+
+    pid_t child = fork();
+    if (child == 0) {
+        dup2(output[1], STDOUT_FILENO);
+        close(output[0]);
+        close(output[1]);
+
+        execl(executable, executable, "--resident", modeArgument, path, (char *)NULL);
+        _exit(EXIT_FAILURE);
+    }
+
+    close(output[1]);
+
+    char result[32] = { 0 };
+    ssize_t length = child > 0 ? read(output[0], result, sizeof(result) - 1) : -1;
+    close(output[0]);
+
+    int status = 0;
+    if (child < 0 || waitpid(child, &status, 0) != child || !WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS || length <= 0)
+        return 0;
+
+    return (size_t)strtoull(result, NULL, 10);
+}
+
+#pragma mark - Benchmark
+
+int main(int argc, char **argv) {
+    if (argc == 4 && strcmp(argv[1], "--resident") == 0)
+        return TKMeasureResident((TKLoadMode)atoi(argv[2]), argv[3]);
+
+    bool quick = TKBenchmarkIsQuick(argc, argv);
+
+    const char *directory = getenv("TMPDIR");
+    if (!directory)
+        directory = "/tmp";
+
+    struct {
+        size_t views;
+        int runs;
+    } themes[] = { { 200, 50 }, { 2000, 20 }, { 20000, 5 } };
+
+    const struct {
+        const char *name;
+        TKLoadMode mode;
+    } modes[] = {
+        { "JSON, tree", TKLoadJSON },
+        { "JSON, lazy tree", TKLoadJSONLazy },
+        { "archive, mapped", TKLoadArchive },
+        { "archive, read completely", TKLoadArchiveAll },
+    };
+
+    TKJSONReader reader;
+    TKJSONReaderInit(&reader);
+
+    for (size_t t = 0; t < sizeof(themes) / sizeof(themes[0]); t++) {
+        TKThemeGeneratorOptions options = TKThemeGeneratorDefaultOptions();
+        options.nodes = quick ? themes[t].views / 20 : themes[t].views;
+
+        size_t length = 0, archiveLength = 0;
+        char *JSON = TKThemeGenerate(&options, &length);
+
+        TKBenchmarkSamples samples;
+        TKBenchmarkSamplesInit(&samples);
+        int runs = TKBenchmarkRuns(themes[t].runs, quick);
+
+        uint8_t *archive = NULL;
+        for (int run = 0; run < runs; run++) {
+            free(archive);
+
+            double start = TKBenchmarkNow();
+            archive = TKThemeCompile(JSON, length, &archiveLength, NULL);
+            TKBenchmarkSamplesAdd(&samples, TKBenchmarkNow() - start);
+        }
+
+        char name[96];
+        snprintf(name, sizeof(name), "%zu views, compile", options.nodes);
+        TKBenchmarkReport(name, &samples, (double)length, "B");
+        TKBenchmarkSamplesFree(&samples);
+
+        char paths[2][256];
+        snprintf(paths[0], sizeof(paths[0]), "%s/TKThemeArchiveBenchmark-%d.json", directory, (int)getpid());
+        snprintf(paths[1], sizeof(paths[1]), "%s/TKThemeArchiveBenchmark-%d.tkb", directory, (int)getpid());
+
+        if (!archive || !TKWriteFile(paths[0], JSON, length) || !TKWriteFile(paths[1], archive, archiveLength)) {
+            fprintf(stderr, "Synthetic theme not compiled or written to %s\n", directory);
+            return EXIT_FAILURE;
+        }
+
+        printf("%-44s JSON %zu KB, archive %zu KB\n", "", length / 1024, archiveLength / 1024);
+
+        for (size_t m = 0; m < sizeof(modes) / sizeof(modes[0]); m++) {
+            const char *path = paths[modes[m].mode == TKLoadJSON || modes[m].mode == TKLoadJSONLazy ? 0 : 1];
+            TKBenchmarkSamplesInit(&samples);
+
+            for (int run = 0; run < runs; run++) {
+                TKDropFromCache(path);
+
+                TKLoadedTheme theme;
+                double start = TKBenchmarkNow();
+                bool success = TKLoad(modes[m].mode, path, &reader, &theme);
+                TKBenchmarkSamplesAdd(&samples, TKBenchmarkNow() - start);
+
+                TKBenchmarkUse(&theme);
+                TKUnload(modes[m].mode, &theme);
+
+                if (!success) {
+                    fprintf(stderr, "%s not loaded\n", path);
+                    return EXIT_FAILURE;
+                }
+            }
+
+            snprintf(name, sizeof(name), "%zu views, %s", options.nodes, modes[m].name);
+            TKBenchmarkReport(name, &samples, (double)options.nodes, "views");
+            TKBenchmarkSamplesFree(&samples);
+
+            printf("%-44s resident +%zu KB\n", "", TKResidentMemoryOfLoad(argv[0], modes[m].mode, path) / 1024);
+        }
+
+        remove(paths[0]);
+        remove(paths[1]);
+        free(archive);
+        free(JSON);
+    }
+
+    TKJSONReaderFree(&reader);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,641 @@
+//
+//  TKThemeBenchmark.c
+//  ThemeEngine
+//
+//  The render pipeline of ThemeKit without UIKit, over synthetic themes (see TKThemeGenerator.h) - the JSON read
+//  with TKJSONReader into a flat list of views, laid out (frames, paths parsed and fitted into them, the shapes
+//  flattened at the scale of the screen), and rasterized with TKRasterizer the way the display lists draw them.
+//  Each phase is timed on its own, with the throughput and latency percentiles, and then the three together
+//
+//  The views, UIKit and Core Graphics parts are measured on the device instead, by the demo project when it
+//  is launched with -TKRunBenchmarks YES
+//
+//  Copyright (c) 2012 __MyCompanyName__. All rights reserved.
+//
+
+#include "TKBenchmark.h"
+#include "TKThemeGenerator.h"
+#include "TKJSONReader.h"
+#include "TKRasterizer.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Points to pixels, a retina screen
+#define kThemeScale 2.0
+
+#pragma mark - Theme
+
+typedef enum { TKThemeTypeContainer,
+               TKThemeTypeRectangle,
+               TKThemeTypeEllipse,
+               TKThemeTypePath,
+               TKThemeTypeLabel } TKThemeType;
+
+typedef struct {
+    double x, y;
+    double blur;
+    TKRasterColor color;
+    TKRasterBlendMode blendMode;
+} TKThemeShadow;
+
+typedef struct {
+    TKThemeType type;
+    size_t parent;
+
+    double x, y, width, height;     // Origin in the parent and size, in points
+    double frameX, frameY;          // Origin on the screen, after the layout
+    double cornerRadius;
+    float alpha;
+    TKRasterColor color;
+
+    int gradientCount;
+    int gradientPositionCount;
+    TKRasterColor gradientColors[4];
+    float gradientPositions[4];
+
+    bool hasDropShadow, hasInnerShadow;
+    TKThemeShadow dropShadow, innerShadow;
+
+    double strokeWidth;
+    TKRasterColor strokeColor;
+
+    size_t descriptionOffset;       // Path data, in the descriptions of the theme
+    size_t descriptionLength;
+} TKThemeView;
+
+typedef struct {
+    TKThemeView *views;
+    size_t count;
+    size_t capacity;
+
+    char *descriptions;
+    size_t descriptionsLength;
+    size_t descriptionsCapacity;
+
+    // Shapes of the views after the layout, flattened and in pixels
+    TKPathBuffer *shapes;
+    size_t shapeCount;
+
+    TKPathBuffer inverse;           // Scratch for the inner shadows
+} TKTheme;
+
+static void TKThemeReset(TKTheme *theme) {
+    theme->count = 0;
+    theme->descriptionsLength = 0;
+}
+
+static void TKThemeFree(TKTheme *theme) {
+    for (size_t i = 0; i < theme->shapeCount; i++) {
+        TKPathBufferFree(&theme->shapes[i]);
+    }
+
+    TKPathBufferFree(&theme->inverse);
+    free(theme->shapes);
+    free(theme->views);
+    free(theme->descriptions);
+}
+
+#pragma mark - Reading
+
+typedef enum { TKThemeKeyOther,
+               TKThemeKeyType, TKThemeKeyOrigin, TKThemeKeySize, TKThemeKeyX, TKThemeKeyY, TKThemeKeyWidth, TKThemeKeyHeight,
+               TKThemeKeyColor, TKThemeKeyAlpha, TKThemeKeyCornerRadius, TKThemeKeyDescription, TKThemeKeyBlendMode,
+               TKThemeKeyGradientFill, TKThemeKeyGradientColors, TKThemeKeyGradientPositions,
+               TKThemeKeyDropShadow, TKThemeKeyInnerShadow, TKThemeKeyOffset, TKThemeKeyBlur,
+               TKThemeKeyOuterStroke, TKThemeKeySubviews } TKThemeKey;
+
+// What the object or array being read belongs to
+typedef enum { TKThemeFrameView,
+               TKThemeFrameOrigin,
+               TKThemeFrameSize,
+               TKThemeFrameGradient,
+               TKThemeFrameGradientColors,
+               TKThemeFrameGradientPositions,
+               TKThemeFrameShadow,
+               TKThemeFrameShadowOffset,
+               TKThemeFrameStroke,
+               TKThemeFrameSubviews,
+               TKThemeFrameIgnored } TKThemeFrameKind;
+
+typedef struct {
+    TKThemeFrameKind kind;
+    TKThemeKey key;             // Last key read in the object
+    TKThemeShadow *shadow;
+} TKThemeFrame;
+
+typedef struct {
+    TKTheme *theme;
+    TKThemeFrame frames[kJSONReaderMaximumDepth];
+    size_t depth;
+    size_t view;                // Index of the innermost view being read
+} TKThemeReader;
+
+static TKThemeKey TKThemeKeyForBytes(const char *bytes, size_t length) {
+    static const struct {
+        const char *name;
+        TKThemeKey key;
+    } keys[] = {
+        { "type", TKThemeKeyType }, { "origin", TKThemeKeyOrigin }, { "size", TKThemeKeySize }, { "x", TKThemeKeyX },
+        { "y", TKThemeKeyY }, { "width", TKThemeKeyWidth }, { "height", TKThemeKeyHeight }, { "color", TKThemeKeyColor },
+        { "alpha", TKThemeKeyAlpha }, { "corner-radius", TKThemeKeyCornerRadius }, { "description", TKThemeKeyDescription },
+        { "blend-mode", TKThemeKeyBlendMode }, { "gradient-fill", TKThemeKeyGradientFill },
+        { "gradient-colors", TKThemeKeyGradientColors }, { "gradient-positions", TKThemeKeyGradientPositions },
+        { "drop-shadow", TKThemeKeyDropShadow }, { "inner-shadow", TKThemeKeyInnerShadow }, { "offset", TKThemeKeyOffset },
+        { "blur", TKThemeKeyBlur }, { "outer-stroke", TKThemeKeyOuterStroke }, { "subviews", TKThemeKeySubviews },
+    };
+
+    for (size_t i = 0; i < sizeof(keys) / sizeof(keys[0]); i++) {
+        if (strlen(keys[i].name) == length && memcmp(keys[i].name, bytes, length) == 0)
+            return keys[i].key;
+    }
+
+    return TKThemeKeyOther;
+}
+
+static bool TKThemeEquals(const TKJSONEvent *event, const char *string) {
+    return strlen(string) == event->length && memcmp(event->bytes, string, event->length) == 0;
+}
+
+// "#RGB" or "#RRGGBB", the way TKHelpers reads them
+static TKRasterColor TKThemeColor(const char *bytes, size_t length) {
+    TKRasterColor color = { 0.0f, 0.0f, 0.0f, 1.0f };
+    if (length > 0 && bytes[0] == '#') {
+        bytes++;
+        length--;
+    }
+
+    unsigned int value = 0;
+    for (size_t i = 0; i < length; i++) {
+        char c = bytes[i];
+        unsigned int digit = c >= '0' && c <= '9' ? (unsigned int)(c - '0') : (unsigned int)((c | 0x20) - 'a' + 10);
+        value = (value << 4) | (digit & 0xf);
+    }
+
+    if (length == 3)
+        value = ((value & 0xf00) << 12 | (value & 0xf00) << 8) | ((value & 0xf0) << 8 | (value & 0xf0) << 4) | ((value & 0xf) << 4 | (value & 0xf));
+
+    color.red = ((value >> 16) & 0xff) / 255.0f;
+    color.green = ((value >> 8) & 0xff) / 255.0f;
+    color.blue = (value & 0xff) / 255.0f;
+
+    return color;
+}
+
+static TKThemeView *TKThemeAddView(TKTheme *theme, size_t parent) {
+    if (theme->count == theme->capacity) {
+        theme->capacity = theme->capacity ? theme->capacity * 2 : 256;
+        theme->views = (TKThemeView *)realloc(theme->views, theme->capacity * sizeof(TKThemeView));
+    }
+
+    TKThemeView *view = &theme->views[theme->count++];
+    memset(view, 0, sizeof(TKThemeView));
+    view->parent = parent;
+    view->alpha = 1.0f;
+    view->color.alpha = 1.0f;
+
+    return view;
+}
+
+static TKJSONAction TKThemeReaderEvent(const TKJSONEvent *event, void *info) {
+    TKThemeReader *reader = (TKThemeReader *)info;
+    TKTheme *theme = reader->theme;
+    TKThemeFrame *frame = reader->depth > 0 ? &reader->frames[reader->depth - 1] : NULL;
+    TKThemeView *view = theme->count > 0 ? &theme->views[reader->view] : NULL;
+    TKThemeKey key = frame ? frame->key : TKThemeKeyOther;
+
+    switch (event->type) {
+        case TKJSONEventBeginObject:
+        case TKJSONEventBeginArray: {
+            bool object = event->type == TKJSONEventBeginObject;
+            TKThemeFrame *next = &reader->frames[reader->depth++];
+            next->kind = TKThemeFrameIgnored;
+            next->key = TKThemeKeyOther;
+            next->shadow = NULL;
+
+            if (!frame || (object && frame->kind == TKThemeFrameSubviews)) {
+                TKThemeAddView(theme, frame ? reader->view : 0);
+                reader->view = theme->count - 1;
+                next->kind = TKThemeFrameView;
+            } else if (frame->kind == TKThemeFrameView) {
+                if (object && key == TKThemeKeyOrigin)
+                    next->kind = TKThemeFrameOrigin;
+                else if (object && key == TKThemeKeySize)
+                    next->kind = TKThemeFrameSize;
+                else if (object && key == TKThemeKeyGradientFill)
+                    next->kind = TKThemeFrameGradient;
+                else if (object && key == TKThemeKeyOuterStroke)
+                    next->kind = TKThemeFrameStroke;
+                else if (object && (key == TKThemeKeyDropShadow || key == TKThemeKeyInnerShadow)) {
+                    next->kind = TKThemeFrameShadow;
+                    next->shadow = key == TKThemeKeyDropShadow ? &view->dropShadow : &view->innerShadow;
+                    next->shadow->color.alpha = 1.0f;
+                    next->shadow->blendMode = TKRasterBlendNormal;
+                    if (key == TKThemeKeyDropShadow)
+                        view->hasDropShadow = true;
+                    else
+                        view->hasInnerShadow = true;
+                } else if (!object && key == TKThemeKeySubviews)
+                    next->kind = TKThemeFrameSubviews;
+            } else if (frame->kind == TKThemeFrameGradient && !object) {
+                if (key == TKThemeKeyGradientColors)
+                    next->kind = TKThemeFrameGradientColors;
+                else if (key == TKThemeKeyGradientPositions)
+                    next->kind = TKThemeFrameGradientPositions;
+            } else if (frame->kind == TKThemeFrameShadow && object && key == TKThemeKeyOffset) {
+                next->kind = TKThemeFrameShadowOffset;
+                next->shadow = frame->shadow;
+            }
+
+            // Anything else (i.e the components of a button) is checked, but not read
+            return next->kind == TKThemeFrameIgnored ? TKJSONActionSkip : TKJSONActionContinue;
+        }
+        case TKJSONEventEndObject:
+        case TKJSONEventEndArray:
+            if (frame->kind == TKThemeFrameView)
+                reader->view = view->parent;
+            reader->depth--;
+            break;
+        case TKJSONEventKey:
+            frame->key = TKThemeKeyForBytes(event->bytes, event->length);
+            break;
+        case TKJSONEventString:
+            if (frame->kind == TKThemeFrameView) {
+                if (key == TKThemeKeyType) {
+                    view->type = TKThemeEquals(event, "rectangle") ? TKThemeTypeRectangle : TKThemeEquals(event, "ellipse") ? TKThemeTypeEllipse :
+                                 TKThemeEquals(event, "path") ? TKThemeTypePath : TKThemeEquals(event, "label") ? TKThemeTypeLabel : TKThemeTypeContainer;
+                } else if (key == TKThemeKeyColor) {
+                    view->color = TKThemeColor(event->bytes, event->length);
+                } else if (key == TKThemeKeyDescription) {
+                    if (theme->descriptionsLength + event->length > theme->descriptionsCapacity) {
+                        theme->descriptionsCapacity = (theme->descriptionsLength + event->length) * 2;
+                        theme->descriptions = (char *)realloc(theme->descriptions, theme->descriptionsCapacity);
+                    }
+
+                    memcpy(theme->descriptions + theme->descriptionsLength, event->bytes, event->length);
+                    view->descriptionOffset = theme->descriptionsLength;
+                    view->descriptionLength = event->length;
+                    theme->descriptionsLength += event->length;
+                }
+            } else if (frame->kind == TKThemeFrameStroke && key == TKThemeKeyColor) {
+                view->strokeColor = TKThemeColor(event->bytes, event->length);
+            } else if (frame->kind == TKThemeFrameShadow && key == TKThemeKeyColor) {
+                float alpha = frame->shadow->color.alpha;
+                frame->shadow->color = TKThemeColor(event->bytes, event->length);
+                frame->shadow->color.alpha = alpha;
+            } else if (frame->kind == TKThemeFrameShadow && key == TKThemeKeyBlendMode) {
+                frame->shadow->blendMode = TKThemeEquals(event, "multiply") ? TKRasterBlendMultiply : TKThemeEquals(event, "overlay") ?
+                                           TKRasterBlendOverlay : TKThemeEquals(event, "softlight") ? TKRasterBlendSoftLight : TKRasterBlendNormal;
+            } else if (frame->kind == TKThemeFrameGradientColors && view->gradientCount < 4) {
+                view->gradientColors[view->gradientCount++] = TKThemeColor(event->bytes, event->length);
+            }
+            break;
+        case TKJSONEventNumber: {
+            double number = event->number;
+            switch (frame->kind) {
+                case TKThemeFrameView:
+                    if (key == TKThemeKeyAlpha)
+                        view->alpha = (float)number;
+                    else if (key == TKThemeKeyCornerRadius)
+                        view->cornerRadius = number;
+                    break;
+                case TKThemeFrameOrigin:
+                    if (key == TKThemeKeyX)
+                        view->x = number;
+                    else if (key == TKThemeKeyY)
+                        view->y = number;
+                    break;
+                case TKThemeFrameSize:
+                    if (key == TKThemeKeyWidth)
+                        view->width = number;
+                    else if (key == TKThemeKeyHeight)
+                        view->height = number;
+                    break;
+                case TKThemeFrameStroke:
+                    if (key == TKThemeKeyWidth)
+                        view->strokeWidth = number;
+                    break;
+                case TKThemeFrameShadow:
+                    if (key == TKThemeKeyBlur)
+                        frame->shadow->blur = number;
+                    else if (key == TKThemeKeyAlpha)
+                        frame->shadow->color.alpha = (float)number;
+                    break;
+                case TKThemeFrameShadowOffset:
+                    if (key == TKThemeKeyX)
+                        frame->shadow->x = number;
+                    else if (key == TKThemeKeyY)
+                        frame->shadow->y = number;
+                    break;
+                case TKThemeFrameGradientPositions:
+                    if (view->gradientPositionCount < 4)
+                        view->gradientPositions[view->gradientPositionCount++] = (float)number;
+                    break;
+                default:
+                    break;
+            }
+            break;
+        }
+        default:
+            break;
+    }
+
+    return TKJSONActionContinue;
+}
+
+static bool TKThemeRead(TKTheme *theme, TKJSONReader *jsonReader, const char *bytes, size_t length) {
+    TKThemeReset(theme);
+
+    TKThemeReader reader;
+    reader.theme = theme;
+    reader.depth = 0;
+    reader.view = 0;
+
+    return TKJSONRead(jsonReader, bytes, length, TKThemeReaderEvent, &reader, NULL) && theme->count > 0;
+}
+
+#pragma mark - Layout
+
+// Frames on the screen, and the shapes of the views fitted into them and flattened in pixels. Paths are
+// scaled down (never up) to fit their size, like TKPathGeometry does
+static bool TKThemeLayout(TKTheme *theme, TKPathBuffer *scratch) {
+    if (theme->shapeCount < theme->count) {
+        theme->shapes = (TKPathBuffer *)realloc(theme->shapes, theme->count * sizeof(TKPathBuffer));
+        for (size_t i = theme->shapeCount; i < theme->count; i++) {
+            TKPathBufferInit(&theme->shapes[i]);
+        }
+        theme->shapeCount = theme->count;
+    }
+
+    for (size_t i = 0; i < theme->count; i++) {
+        TKThemeView *view = &theme->views[i];
+        TKPathBuffer *shape = &theme->shapes[i];
+        TKPathBufferReset(shape);
+
+        // Parents always come first
+        view->frameX = view->x + (i > 0 ? theme->views[view->parent].frameX : 0.0);
+        view->frameY = view->y + (i > 0 ? theme->views[view->parent].frameY : 0.0);
+
+        double transform[6] = { kThemeScale, 0.0, 0.0, kThemeScale, view->frameX * kThemeScale, view->frameY * kThemeScale };
+        TKPathBufferReset(scratch);
+
+        switch (view->type) {
+            case TKThemeTypeRectangle: {
+                double radius = view->cornerRadius;
+                double limit = (view->width < view->height ? view->width : view->height) / 2.0;
+                radius = radius > limit ? limit : radius;
+
+                double radii[4] = { radius, radius, radius, radius };
+                TKRasterPathAddRoundedRect(scratch, 0.0, 0.0, view->width, view->height, radii);
+                break;
+            }
+            case TKThemeTypeEllipse:
+                TKRasterPathAddEllipse(scratch, 0.0, 0.0, view->width, view->height);
+                break;
+            case TKThemeTypePath: {
+                if (!TKPathParse(theme->descriptions + view->descriptionOffset, view->descriptionLength, scratch, NULL))
+                    return false;
+
+                double minX = 0.0, minY = 0.0, maxX = 0.0, maxY = 0.0;
+                for (size_t c = 0; c + 1 < scratch->coordinateCount; c += 2) {
+                    double x = scratch->coordinates[c], y = scratch->coordinates[c + 1];
+                    if (c == 0 || x < minX) minX = x;
+                    if (c == 0 || x > maxX) maxX = x;
+                    if (c == 0 || y < minY) minY = y;
+                    if (c == 0 || y > maxY) maxY = y;
+                }
+
+                double ratio = 1.0;
+                if (maxX > minX && maxY > minY) {
+                    double fit = view->width / (maxX - minX) < view->height / (maxY - minY) ? view->width / (maxX - minX) : view->height / (maxY - minY);
+                    ratio = fit < 1.0 ? fit : 1.0;
+                }
+
+                // The bounding box is moved to the origin of the view
+                transform[0] = transform[3] = kThemeScale * ratio;
+                transform[4] -= minX * ratio * kThemeScale;
+                transform[5] -= minY * ratio * kThemeScale;
+                break;
+            }
+            default:
+                continue;
+        }
+
+        if (!TKRasterPathFlatten(scratch, transform, 0.0, shape))
+            return false;
+    }
+
+    return true;
+}
+
+#pragma mark - Rasterizing
+
+static bool TKThemeDrawView(TKTheme *theme, size_t index, TKRasterContext *context) {
+    const TKThemeView *view = &theme->views[index];
+    const TKPathBuffer *shape = &theme->shapes[index];
+    bool success = true;
+
+    TKRasterContextSaveState(context);
+    TKRasterContextSetAlpha(context, view->alpha);
+
+    if (view->hasDropShadow) {
+        TKRasterContextSaveState(context);
+        const TKThemeShadow *shadow = &view->dropShadow;
+        TKRasterContextSetShadow(context, (float)(shadow->x * kThemeScale), (float)(shadow->y * kThemeScale), (float)(shadow->blur * kThemeScale), shadow->color);
+        success &= TKRasterContextFillPath(context, shape, TKRasterFillNonZero, view->color);
+        TKRasterContextRestoreState(context);
+    }
+
+    if (view->gradientCount > 1) {
+        TKRasterGradient gradient;
+        bool positions = view->gradientPositionCount == view->gradientCount;
+        TKRasterGradientInit(&gradient, view->gradientColors, positions ? view->gradientPositions : NULL, (size_t)view->gradientCount);
+
+        double top = view->frameY * kThemeScale, bottom = (view->frameY + view->height) * kThemeScale;
+        success &= TKRasterContextFillPathWithGradient(context, shape, TKRasterFillNonZero, &gradient, 0.0, top, 0.0, bottom);
+    } else if (!view->hasDropShadow) {
+        success &= TKRasterContextFillPath(context, shape, TKRasterFillNonZero, view->color);
+    }
+
+    // Outside of the shape filled with the shadow color, clipped to the shape, like TKContextDrawItemInnerShadow
+    if (view->hasInnerShadow) {
+        TKPathBuffer *inverse = &theme->inverse;
+        const TKThemeShadow *shadow = &view->innerShadow;
+        double margin = (shadow->blur + 4.0) * kThemeScale;
+
+        TKPathBufferReset(inverse);
+        TKRasterPathAddRect(inverse, view->frameX * kThemeScale - margin, view->frameY * kThemeScale - margin,
+                            view->width * kThemeScale + 2 * margin, view->height * kThemeScale + 2 * margin);
+        for (size_t i = 0, c = 0; i < shape->operationCount; c += TKPathOperationCoordinateCount[shape->operations[i]], i++) {
+            TKPathBufferAppend(inverse, (TKPathOperation)shape->operations[i], shape->coordinates + c);
+        }
+
+        TKRasterContextSaveState(context);
+        TKRasterContextClipToPath(context, shape, TKRasterFillNonZero);
+        TKRasterContextSetBlendMode(context, shadow->blendMode);
+        TKRasterContextSetShadow(context, (float)(shadow->x * kThemeScale), (float)(shadow->y * kThemeScale), (float)(shadow->blur * kThemeScale), shadow->color);
+        TKRasterColor opaque = { 0.0f, 0.0f, 0.0f, 1.0f };
+        success &= TKRasterContextFillPath(context, inverse, TKRasterFillEvenOdd, opaque);
+        TKRasterContextRestoreState(context);
+    }
+
+    if (view->strokeWidth > 0.0) {
+        TKRasterContextSetLineWidth(context, (float)(view->strokeWidth * kThemeScale));
+        success &= TKRasterContextStrokePath(context, shape, view->strokeColor);
+    }
+
+    TKRasterContextRestoreState(context);
+    return success;
+}
+
+// Everything drawn into the surface, in the order of the views (parents under their subviews). Labels need
+// UIKit for their text and are left out, containers draw nothing
+static bool TKThemeRasterize(TKTheme *theme, TKRasterSurface *surface, TKRasterContext *context) {
+    TKRasterColor clear = { 0.0f, 0.0f, 0.0f, 0.0f };
+    TKRasterSurfaceClear(surface, clear);
+
+    for (size_t i = 0; i < theme->count; i++) {
+        TKThemeType type = theme->views[i].type;
+        if ((type == TKThemeTypeRectangle || type == TKThemeTypeEllipse || type == TKThemeTypePath) && !TKThemeDrawView(theme, i, context))
+            return false;
+    }
+
+    return true;
+}
+
+#pragma mark - Benchmark
+
+typedef struct {
+    const char *json;
+    size_t length;
+    TKJSONReader reader;
+    TKTheme theme;
+    TKPathBuffer scratch;
+    TKRasterSurface surface;
+    TKRasterContext context;
+} TKThemeBenchmark;
+
+static void TKThemeFail(const char *phase) {
+    fprintf(stderr, "Synthetic theme failed to %s\n", phase);
+    exit(EXIT_FAILURE);
+}
+
+static void TKThemeParseBody(int run, void *info) {
+    (void)run;
+    TKThemeBenchmark *benchmark = (TKThemeBenchmark *)info;
+
+    if (!TKThemeRead(&benchmark->theme, &benchmark->reader, benchmark->json, benchmark->length))
+        TKThemeFail("parse");
+
+    TKBenchmarkUse(benchmark->theme.views);
+}
+
+static void TKThemeLayoutBody(int run, void *info) {
+    (void)run;
+    TKThemeBenchmark *benchmark = (TKThemeBenchmark *)info;
+
+    if (!TKThemeLayout(&benchmark->theme, &benchmark->scratch))
+        TKThemeFail("lay out");
+
+    TKBenchmarkUse(benchmark->theme.shapes);
+}
+
+static void TKThemeRasterizeBody(int run, void *info) {
+    (void)run;
+    TKThemeBenchmark *benchmark = (TKThemeBenchmark *)info;
+
+    if (!TKThemeRasterize(&benchmark->theme, &benchmark->surface, &benchmark->context))
+        TKThemeFail("rasterize");
+
+    TKBenchmarkUse(benchmark->surface.pixels);
+}
+
+static void TKThemePipelineBody(int run, void *info) {
+    TKThemeParseBody(run, info);
+    TKThemeLayoutBody(run, info);
+    TKThemeRasterizeBody(run, info);
+}
+
+static void TKThemeMeasure(const char *caseName, const char *phase, TKThemeBenchmark *benchmark, int runs,
+                           void (*body)(int, void *), double work, const char *unit) {
+    TKBenchmarkSamples samples;
+    TKBenchmarkSamplesInit(&samples);
+    TKBenchmarkMeasure(&samples, runs, body, benchmark);
+
+    char name[96];
+    snprintf(name, sizeof(name), "%s, %s", caseName, phase);
+    TKBenchmarkReport(name, &samples, work, unit);
+    TKBenchmarkSamplesFree(&samples);
+}
+
+int main(int argc, char **argv) {
+    bool quick = TKBenchmarkIsQuick(argc, argv);
+
+    struct {
+        const char *variant;
+        size_t nodes;
+        int depth;
+        double shadowDensity;
+        double gradientDensity;
+        int runs;
+    } cases[] = {
+        { "", 200, 5, 0.3, 0.5, 100 },
+        { "", 2000, 8, 0.3, 0.5, 20 },
+        { ", 24 deep", 2000, 24, 0.3, 0.5, 20 },
+        { ", all shadows", 2000, 8, 1.0, 0.5, 10 },
+        { ", all gradients", 2000, 8, 0.0, 1.0, 20 },
+        { "", 20000, 10, 0.3, 0.5, 5 },
+    };
+
+    printf("kernels: %s\n", TKRasterKernelName());
+
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        TKThemeGeneratorOptions options = TKThemeGeneratorDefaultOptions();
+        options.nodes = cases[i].nodes;
+        if (quick)
+            options.nodes /= 20;    // Only to check that it still works
+        options.depth = cases[i].depth;
+        options.shadowDensity = cases[i].shadowDensity;
+        options.gradientDensity = cases[i].gradientDensity;
+        options.seed += i;
+
+        TKThemeBenchmark benchmark;
+        memset(&benchmark, 0, sizeof(TKThemeBenchmark));
+
+        size_t length = 0;
+        char *json = TKThemeGenerate(&options, &length);
+        benchmark.json = json;
+        benchmark.length = length;
+
+        TKJSONReaderInit(&benchmark.reader);
+        TKPathBufferInit(&benchmark.scratch);
+        if (!TKRasterSurfaceInit(&benchmark.surface, (int)(320 * kThemeScale), (int)(480 * kThemeScale)) ||
+            !TKRasterContextInit(&benchmark.context, &benchmark.surface))
+            TKThemeFail("set up a surface");
+
+        // Warm up the buffers, then measure each phase and all of them together
+        TKThemePipelineBody(0, &benchmark);
+        double views = (double)benchmark.theme.count;
+        int runs = TKBenchmarkRuns(cases[i].runs, quick);
+
+        char caseName[64];
+        snprintf(caseName, sizeof(caseName), "%zu views%s (%zu KB)", benchmark.theme.count, cases[i].variant, length / 1024);
+
+        TKThemeMeasure(caseName, "parse", &benchmark, runs, TKThemeParseBody, (double)length, "B");
+        TKThemeMeasure(caseName, "layout", &benchmark, runs, TKThemeLayoutBody, views, "views");
+        TKThemeMeasure(caseName, "rasterize", &benchmark, runs, TKThemeRasterizeBody, views, "views");
+        TKThemeMeasure(caseName, "all", &benchmark, runs, TKThemePipelineBody, views, "views");
+
+        TKRasterContextFree(&benchmark.context);
+        TKRasterSurfaceFree(&benchmark.surface);
+        TKPathBufferFree(&benchmark.scratch);
+        TKThemeFree(&benchmark.theme);
+        TKJSONReaderFree(&benchmark.reader);
+        free(json);
+    }
+
+    printf("peak memory: %zu KB\n", TKBenchmarkPeakMemory() / 1024);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,246 @@
+//
+//  TKThemeGenerator.c
+//  ThemeEngine
+//
+//  Copyright (c) 2012 __MyCompanyName__. All rights reserved.
+//
+
+#include "TKThemeGenerator.h"
+
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+    char *bytes;
+    size_t length;
+    size_t capacity;
+} TKThemeString;
+
+typedef struct {
+    int depth;
+    size_t firstChild;
+    size_t childCount;
+} TKThemeNode;
+
+typedef struct {
+    const TKThemeGeneratorOptions *options;
+    uint64_t state;
+    TKThemeString output;
+    TKThemeNode *nodes;
+    size_t *children;           // Indices of the nodes, grouped by parent
+} TKThemeGenerator;
+
+static void TKThemeAppend(TKThemeGenerator *generator, const char *format, ...) {
+    TKThemeString *output = &generator->output;
+
+    for (;;) {
+        va_list arguments;
+        va_start(arguments, format);
+        int written = vsnprintf(output->bytes + output->length, output->capacity - output->length, format, arguments);
+        va_end(arguments);
+
+        if (written >= 0 && (size_t)written < output->capacity - output->length) {
+            output->length += (size_t)written;
+            return;
+        }
+
+        output->capacity = output->capacity * 2 + 4096;
+        output->bytes = (char *)realloc(output->bytes, output->capacity);
+    }
+}
+
+static uint32_t TKThemeRandom(TKThemeGenerator *generator) {
+    generator->state ^= generator->state << 13;
+    generator->state ^= generator->state >> 7;
+    generator->state ^= generator->state << 17;
+
+    return (uint32_t)(generator->state >> 16);
+}
+
+static double TKThemeUniform(TKThemeGenerator *generator) {
+    return (TKThemeRandom(generator) & 0xffffff) / (double)0x1000000;
+}
+
+static bool TKThemeChance(TKThemeGenerator *generator, double probability) {
+    return TKThemeUniform(generator) < probability;
+}
+
+static void TKThemeAppendColor(TKThemeGenerator *generator, const char *key) {
+    TKThemeAppend(generator, "\"%s\":\"#%06x\"", key, TKThemeRandom(generator) & 0xffffff);
+}
+
+// Bits of an icon, relative curves and lines around the middle of a 24 point box
+static void TKThemeAppendPath(TKThemeGenerator *generator) {
+    int segments = 12 + (int)(TKThemeRandom(generator) % 36);
+
+    TKThemeAppend(generator, "\"description\":\"M12 2");
+    for (int i = 0; i < segments; i++) {
+        double a = TKThemeUniform(generator) * 6.0 - 3.0, b = TKThemeUniform(generator) * 6.0 - 3.0;
+        double c = TKThemeUniform(generator) * 6.0 - 3.0, d = TKThemeUniform(generator) * 6.0 - 3.0;
+
+        if (i % 3 == 0)
+            TKThemeAppend(generator, "l%.2f %.2f", a, b);
+        else
+            TKThemeAppend(generator, "c%.2f %.2f %.2f %.2f %.2f %.2f", a, b, c, d, (a + c) / 2.0, (b + d) / 2.0);
+    }
+
+    TKThemeAppend(generator, "z\"");
+}
+
+static void TKThemeAppendNode(TKThemeGenerator *generator, size_t index, double width, double height) {
+    const TKThemeGeneratorOptions *options = generator->options;
+    const TKThemeNode *node = &generator->nodes[index];
+
+    const char *type = "rectangle";
+    if (node->childCount == 0 && index > 0) {
+        double choice = TKThemeUniform(generator);
+        if (choice < options->pathDensity)
+            type = "path";
+        else if (choice < options->pathDensity + options->labelDensity)
+            type = "label";
+        else if (choice < options->pathDensity + options->labelDensity + 0.2)
+            type = "ellipse";
+    }
+
+    // The root is the theme itself, only a frame for the views
+    if (index == 0)
+        TKThemeAppend(generator, "{\"title\":\"Synthetic-%zu\",", options->nodes);
+    else
+        TKThemeAppend(generator, "{\"type\":\"%s\",", type);
+
+    // Inside of the parent, the root is a screen
+    double x = 0.0, y = 0.0;
+    if (index > 0) {
+        double parentWidth = width, parentHeight = height;
+        width = parentWidth * (0.3 + 0.6 * TKThemeUniform(generator));
+        height = parentHeight * (0.3 + 0.6 * TKThemeUniform(generator));
+        x = (double)(int)((parentWidth - width) * TKThemeUniform(generator));
+        y = (double)(int)((parentHeight - height) * TKThemeUniform(generator));
+        width = width < 4.0 ? 4.0 : (double)(int)width;
+        height = height < 4.0 ? 4.0 : (double)(int)height;
+    }
+
+    TKThemeAppend(generator, "\"origin\":{\"x\":%g,\"y\":%g},\"size\":{\"width\":%g,\"height\":%g}", x, y, width, height);
+
+    if (index == 0) {
+        // Nothing drawn
+    } else if (strcmp(type, "label") == 0) {
+        TKThemeAppend(generator, ",");
+        TKThemeAppend(generator, "\"content-string\":\"Label %u\",\"font-size\":%u,", TKThemeRandom(generator) % 1000,
+                      11 + TKThemeRandom(generator) % 8);
+        TKThemeAppendColor(generator, "content-color");
+        TKThemeAppend(generator, ",\"content-align\":\"center\"");
+    } else {
+        TKThemeAppend(generator, ",");
+        if (strcmp(type, "path") == 0) {
+            TKThemeAppendPath(generator);
+            TKThemeAppend(generator, ",");
+        } else if (strcmp(type, "rectangle") == 0) {
+            TKThemeAppend(generator, "\"corner-radius\":%u,", TKThemeRandom(generator) % 12);
+        }
+
+        TKThemeAppendColor(generator, "color");
+
+        if (TKThemeChance(generator, options->gradientDensity)) {
+            TKThemeAppend(generator, ",\"gradient-fill\":{\"gradient-colors\":[\"#%06x\",\"#%06x\",\"#%06x\"],"
+                                     "\"gradient-positions\":[0.0,%.3f,1.0]}",
+                          TKThemeRandom(generator) & 0xffffff, TKThemeRandom(generator) & 0xffffff, TKThemeRandom(generator) & 0xffffff,
+                          0.2 + 0.6 * TKThemeUniform(generator));
+        }
+
+        if (TKThemeChance(generator, options->shadowDensity)) {
+            TKThemeAppend(generator, ",\"drop-shadow\":{\"offset\":{\"x\":0,\"y\":%u},\"alpha\":0.5,\"color\":\"#000\",\"blur\":%u}",
+                          TKThemeRandom(generator) % 3, 1 + TKThemeRandom(generator) % 8);
+        }
+
+        if (TKThemeChance(generator, options->shadowDensity)) {
+            TKThemeAppend(generator, ",\"inner-shadow\":{\"offset\":{\"x\":0,\"y\":1},\"blend-mode\":\"softlight\",\"alpha\":0.6,\"color\":\"#FFF\"}");
+        }
+
+        if (TKThemeChance(generator, 0.5)) {
+            TKThemeAppend(generator, ",\"outer-stroke\":{\"width\":%g,", 0.5 + (TKThemeRandom(generator) % 4) * 0.5);
+            TKThemeAppendColor(generator, "color");
+            TKThemeAppend(generator, "}");
+        }
+    }
+
+    if (node->childCount > 0) {
+        TKThemeAppend(generator, ",\"subviews\":[");
+        for (size_t i = 0; i < node->childCount; i++) {
+            if (i > 0)
+                TKThemeAppend(generator, ",");
+            TKThemeAppendNode(generator, generator->children[node->firstChild + i], width, height);
+        }
+        TKThemeAppend(generator, "]");
+    }
+
+    TKThemeAppend(generator, "}");
+}
+
+TKThemeGeneratorOptions TKThemeGeneratorDefaultOptions(void) {
+    TKThemeGeneratorOptions options;
+    options.nodes = 500;
+    options.depth = 6;
+    options.shadowDensity = 0.3;
+    options.gradientDensity = 0.5;
+    options.pathDensity = 0.2;
+    options.labelDensity = 0.15;
+    options.seed = 0x9E3779B97F4A7C15ULL;
+
+    return options;
+}
+
+char *TKThemeGenerate(const TKThemeGeneratorOptions *options, size_t *length) {
+    TKThemeGenerator generator;
+    memset(&generator, 0, sizeof(TKThemeGenerator));
+    generator.options = options;
+    generator.state = options->seed ? options->seed : 1;
+
+    size_t count = options->nodes > 0 ? options->nodes : 1;
+    int depth = options->depth > 0 ? options->depth : 1;
+
+    // Parents first - a chain down to the deepest level, then every other node under a random one that can
+    // still take children
+    size_t *parents = (size_t *)malloc(count * sizeof(size_t));
+    generator.nodes = (TKThemeNode *)calloc(count, sizeof(TKThemeNode));
+    generator.children = (size_t *)malloc(count * sizeof(size_t));
+
+    for (size_t i = 1; i < count; i++) {
+        size_t parent = i - 1;
+        if (i >= (size_t)depth) {
+            do {
+                parent = TKThemeRandom(&generator) % i;
+            } while (generator.nodes[parent].depth >= depth - 1);
+        }
+
+        parents[i] = parent;
+        generator.nodes[i].depth = generator.nodes[parent].depth + 1;
+        generator.nodes[parent].childCount++;
+    }
+
+    size_t next = 0;
+    for (size_t i = 0; i < count; i++) {
+        generator.nodes[i].firstChild = next;
+        next += generator.nodes[i].childCount;
+        generator.nodes[i].childCount = 0;
+    }
+
+    for (size_t i = 1; i < count; i++) {
+        TKThemeNode *parent = &generator.nodes[parents[i]];
+        generator.children[parent->firstChild + parent->childCount++] = i;
+    }
+
+    TKThemeAppendNode(&generator, 0, 320.0, 480.0);
+
+    free(parents);
+    free(generator.nodes);
+    free(generator.children);
+
+    if (length)
+        *length = generator.output.length;
+
+    return generator.output.bytes;
+}
@@ -0,0 +1,42 @@
+//
+//  TKThemeGenerator.h
+//  ThemeEngine
+//
+//  Synthetic themes for the benchmarks, JSON written the way example.json is - nested rectangles, ellipses,
+//  paths and labels with strokes, gradients and shadows. The same options and seed always give the same
+//  bytes, so that numbers from different runs (and from the device, see the demo project) can be compared
+//
+//  Copyright (c) 2012 __MyCompanyName__. All rights reserved.
+//
+
+#ifndef TKThemeGenerator_h
+#define TKThemeGenerator_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    size_t nodes;               // Views in the theme, the root included
+    int depth;                  // Deepest nesting of subviews, at least one view is that deep
+    double shadowDensity;       // Fraction of the views with a drop shadow, and again with an inner shadow (0 - 1)
+    double gradientDensity;     // Fraction of the views with a gradient fill (0 - 1)
+    double pathDensity;         // Fraction of the views that are paths, of a few dozen segments each (0 - 1)
+    double labelDensity;        // Fraction of the views that are labels (0 - 1)
+    uint64_t seed;
+} TKThemeGeneratorOptions;
+
+// A mid sized screen - 500 views, 6 deep, a third with shadows and half with gradients
+TKThemeGeneratorOptions TKThemeGeneratorDefaultOptions(void);
+
+// The theme as UTF-8 JSON, NUL terminated, freed by the caller. Length is set to the number of bytes
+char *TKThemeGenerate(const TKThemeGeneratorOptions *options, size_t *length);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
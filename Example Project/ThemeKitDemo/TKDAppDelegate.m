@@ -12,6 +12,9 @@
 
 #import "TKDDetailViewController.h"
 
+#import "TKDBenchmarks.h"
+#import "TKDTests.h"
+
 @implementation TKDAppDelegate
 
 @synthesize window = _window;
@@ -42,6 +45,13 @@
     self.splitViewController.viewControllers = [NSArray arrayWithObjects:masterNavigationController, detailNavigationController, nil];
     self.window.rootViewController = self.splitViewController;
     [self.window makeKeyAndVisible];
+
+    // Once the demo is on screen, so that the numbers are of a running app
+    if ([TKDTests isRequested])
+        [TKDTests performSelector: @selector(run) withObject: nil afterDelay: 0.0];
+    if ([TKDBenchmarks isRequested])
+        [TKDBenchmarks performSelector: @selector(run) withObject: nil afterDelay: 0.0];
+
     return YES;
 }
 
@@ -0,0 +1,22 @@
+//
+//  TKDBenchmarks.h
+//  ThemeKitDemo
+//
+//  Benchmarks of the engine on the device, over the synthetic themes of Benchmarks/TKThemeGenerator.h. Run instead
+//  of the demo when the app is launched with -TKRunBenchmarks YES (an argument of the scheme), the results are
+//  printed one line per case like the benchmarks of the plain C parts, followed by the instrumentation snapshot
+//
+//  Copyright (c) 2012 __MyCompanyName__. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+@interface TKDBenchmarks : NSObject
+
+// True if the app was launched with -TKRunBenchmarks YES
++ (BOOL)isRequested;
+
+// Runs everything on the main thread, takes a while
++ (void)run;
+
+@end
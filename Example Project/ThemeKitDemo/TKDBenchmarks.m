@@ -0,0 +1,597 @@
+//
+//  TKDBenchmarks.m
+//  ThemeKitDemo
+//
+//  Copyright (c) 2012 __MyCompanyName__. All rights reserved.
+//
+
+#import "TKDBenchmarks.h"
+#import "ThemeKit.h"
+#import "TKBenchmark.h"
+#import "TKThemeGenerator.h"
+#import "TKThemeArchive.h"
+#import "TKRenderer.h"
+#import "TKView.h"
+#import "TKResourcePool.h"
+
+#pragma mark - Helpers
+
+// Times body, setup is run before each run without being timed. Every run has its own autorelease pool
+static void TKDMeasure(NSString *name, int runs, double workPerRun, const char *unit, void (^setup)(int run), void (^body)(int run)) {
+    TKBenchmarkSamples samples;
+    TKBenchmarkSamplesInit(&samples);
+
+    for (int run = 0; run < runs; run++) {
+        NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+        if (setup)
+            setup(run);
+
+        double start = TKBenchmarkNow();
+        body(run);
+        TKBenchmarkSamplesAdd(&samples, TKBenchmarkNow() - start);
+
+        [pool drain];
+    }
+
+    TKBenchmarkReport([name UTF8String], &samples, workPerRun, unit);
+    TKBenchmarkSamplesFree(&samples);
+}
+
+static NSData *TKDSyntheticTheme(size_t views, double shadowDensity) {
+    TKThemeGeneratorOptions options = TKThemeGeneratorDefaultOptions();
+    options.nodes = views;
+    options.shadowDensity = shadowDensity;
+
+    size_t length = 0;
+    char *bytes = TKThemeGenerate(&options, &length);
+
+    return [NSData dataWithBytesNoCopy: bytes length: length freeWhenDone: YES];
+}
+
+// Every view description in the hierarchy that the workers can render without UIKit
+static void TKDCollectRenderableViews(NSDictionary *description, NSMutableArray *views) {
+    for (NSDictionary *subview in [description objectForKey: @"subviews"]) {
+        if ([TKRenderer canRenderDescription: subview])
+            [views addObject: subview];
+
+        TKDCollectRenderableViews(subview, views);
+    }
+}
+
+static NSUInteger TKDViewCount(UIView *view) {
+    NSUInteger count = 1;
+    for (UIView *subview in view.subviews) {
+        count += TKDViewCount(subview);
+    }
+
+    return count;
+}
+
+// Every TKView in the hierarchy that is at least size in both directions
+static void TKDCollectDrawingViews(UIView *view, CGSize size, NSMutableArray *views) {
+    if ([view isKindOfClass: [TKView class]] && view.bounds.size.width >= size.width && view.bounds.size.height >= size.height)
+        [views addObject: view];
+
+    for (UIView *subview in view.subviews) {
+        TKDCollectDrawingViews(subview, size, views);
+    }
+}
+
+// Draws every layer that needs it right away, the way the next commit of the transaction would
+static void TKDDisplay(UIView *view) {
+    [view.layer displayIfNeeded];
+    for (UIView *subview in view.subviews) {
+        TKDDisplay(subview);
+    }
+}
+
+static long long TKDCounter(TKInstrumentationCounter counter) {
+    NSDictionary *counters = [TKInstrumentationSnapshot() objectForKey: @"counters"];
+    return [[counters objectForKey: TKInstrumentationCounterName(counter)] longLongValue];
+}
+
+@implementation TKDBenchmarks
+
++ (BOOL)isRequested {
+    return [[NSUserDefaults standardUserDefaults] boolForKey: @"TKRunBenchmarks"];
+}
+
+#pragma mark - Parser
+
+// TKJSONObjectFromData, lazy and built completely, against NSJSONSerialization - parse time and the resident memory the result holds on to
++ (void)runParser {
+    const size_t sizes[2] = { 200, 2000 };
+
+    for (int i = 0; i < 2; i++) {
+        NSData *JSON = TKDSyntheticTheme(sizes[i], 0.3);
+        NSString *theme = [NSString stringWithFormat: @"%lu views (%lu KB)", (unsigned long)sizes[i], (unsigned long)[JSON length] / 1024];
+        int runs = i == 0 ? 50 : 10;
+
+        NSArray *names = [NSArray arrayWithObjects: @"NSJSONSerialization", @"TKJSONObjectFromData lazy", @"TKJSONObjectFromData full", nil];
+        id (^parsers[3])(void) = {
+            ^id { return [NSJSONSerialization JSONObjectWithData: JSON options: 0 error: NULL]; },
+            ^id { return TKJSONObjectFromData(JSON, kJSONLazyViewDepth); },
+            ^id { return TKJSONObjectFromData(JSON, NSUIntegerMax); },
+        };
+
+        for (int parser = 0; parser < 3; parser++) {
+            // Blocks can't capture the array itself
+            id (^parse)(void) = parsers[parser];
+            NSString *name = [NSString stringWithFormat: @"%@, %@", theme, [names objectAtIndex: parser]];
+            TKDMeasure(name, runs, [JSON length], "B", nil, ^(int run) {
+                TKBenchmarkUse(parse());
+            });
+
+            // Ten results held at once, so the growth stands out of the noise of the resident size
+            NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+            size_t before = TKBenchmarkResidentMemory();
+            NSMutableArray *results = [NSMutableArray arrayWithCapacity: 10];
+            for (int result = 0; result < 10; result++) {
+                [results addObject: parse()];
+            }
+
+            size_t after = TKBenchmarkResidentMemory();
+            printf("%-44s resident +%zu KB per result\n", "", (after > before ? after - before : 0) / 10 / 1024);
+            [pool drain];
+        }
+    }
+}
+
+#pragma mark - Archives
+
+// Cold load through the engine, of the JSON and of the archive compiled next to it (the engine prefers that one).
+// The resident memory is the growth of the process, pages freed by the runs before may be reused
++ (void)runArchive {
+    ThemeKit *engine = [ThemeKit defaultEngine];
+    NSString *path = [NSTemporaryDirectory() stringByAppendingPathComponent: @"TKDArchiveBenchmark.json"];
+    NSString *archivePath = [[path stringByDeletingPathExtension] stringByAppendingPathExtension: TKThemeArchivePathExtension];
+    const size_t sizes[2] = { 200, 2000 };
+
+    for (int i = 0; i < 2; i++) {
+        NSData *JSON = TKDSyntheticTheme(sizes[i], 0.3);
+        [JSON writeToFile: path atomically: YES];
+        int runs = i == 0 ? 50 : 10;
+
+        for (int compiled = 0; compiled < 2; compiled++) {
+            [[NSFileManager defaultManager] removeItemAtPath: archivePath error: NULL];
+            if (compiled && ![engine compileJSONAtPath: path toPath: archivePath])
+                continue;
+
+            NSString *name = [NSString stringWithFormat: @"%lu views, cold load from %@", (unsigned long)sizes[i], compiled ? @"archive" : @"JSON"];
+            TKDMeasure(name, runs, sizes[i], "views", ^(int run) {
+                [engine flushCache];
+            }, ^(int run) {
+                TKBenchmarkUse([engine viewHierarchyForJSONAtPath: path bindings: NULL]);
+            });
+
+            [engine flushCache];
+            NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+            size_t before = TKBenchmarkResidentMemory();
+            UIView *view = [engine viewHierarchyForJSONAtPath: path bindings: NULL];
+            size_t after = TKBenchmarkResidentMemory();
+            TKBenchmarkUse(view);
+            [pool drain];
+
+            printf("%-44s resident +%zu KB\n", "", (after > before ? after - before : 0) / 1024);
+        }
+    }
+
+    [[NSFileManager defaultManager] removeItemAtPath: path error: NULL];
+    [[NSFileManager defaultManager] removeItemAtPath: archivePath error: NULL];
+}
+
+#pragma mark - Workers
+
+// Images per second of the asynchronous rendering path with 1, 2, 4 and 8 workers, the caches are flushed before
+// every run so that every image is drawn. Waits for the completions on the main run loop, the way an app gets them
++ (void)runWorkers {
+    ThemeKit *engine = [ThemeKit defaultEngine];
+    NSInteger workers = engine.maxConcurrentRenders;
+
+    TKThemeGeneratorOptions options = TKThemeGeneratorDefaultOptions();
+    options.nodes = 400;
+    options.labelDensity = 0.0;
+
+    size_t length = 0;
+    char *bytes = TKThemeGenerate(&options, &length);
+    NSDictionary *theme = TKJSONObjectFromData([NSData dataWithBytesNoCopy: bytes length: length freeWhenDone: YES], NSUIntegerMax);
+
+    NSMutableArray *views = [NSMutableArray array];
+    TKDCollectRenderableViews(theme, views);
+
+    const NSInteger counts[4] = { 1, 2, 4, 8 };
+    for (int i = 0; i < 4; i++) {
+        engine.maxConcurrentRenders = counts[i];
+
+        NSString *name = [NSString stringWithFormat: @"%lu views, %ld workers", (unsigned long)[views count], (long)counts[i]];
+        TKDMeasure(name, 10, [views count], "images", ^(int run) {
+            [engine flushCache];
+        }, ^(int run) {
+            __block NSUInteger remaining = [views count];
+            for (NSDictionary *view in views) {
+                [engine compressedImageForDescription: view completion: ^(UIImage *image) {
+                    remaining--;
+                }];
+            }
+
+            while (remaining > 0) {
+                [[NSRunLoop currentRunLoop] runMode: NSDefaultRunLoopMode beforeDate: [NSDate dateWithTimeIntervalSinceNow: 0.001]];
+            }
+        });
+    }
+
+    engine.maxConcurrentRenders = workers;
+}
+
+#pragma mark - Redraw
+
+// Redraw of the large views of a theme after -setNeedsDisplay against -setNeedsDisplayInRect: with a small part of
+// them, the way a highlight or a blinking cursor invalidates them. The layers are displayed right away instead of
+// waiting for the next commit, the culled items are the ones the partial redraws skipped
++ (void)runRedraw {
+    ThemeKit *engine = [ThemeKit defaultEngine];
+    UIView *hierarchy = [engine viewHierarchyFromJSON: TKDSyntheticTheme(500, 0.3) bindings: NULL];
+
+    NSMutableArray *views = [NSMutableArray array];
+    TKDCollectDrawingViews(hierarchy, CGSizeMake(128.0, 128.0), views);
+
+    const CGFloat sides[3] = { 0.0, 64.0, 16.0 };
+    for (int i = 0; i < 3; i++) {
+        CGFloat side = sides[i];
+        NSString *name = side == 0.0 ? @"full" : [NSString stringWithFormat: @"%.0fx%.0f pt dirty", side, side];
+        name = [NSString stringWithFormat: @"%lu large views, redraw %@", (unsigned long)[views count], name];
+        long long culled = TKDCounter(TKInstrumentationCounterCulledItems);
+
+        TKDMeasure(name, 50, [views count], "views", nil, ^(int run) {
+            for (UIView *view in views) {
+                // In the middle, where the most items overlap
+                CGRect bounds = view.bounds;
+                if (side == 0.0)
+                    [view setNeedsDisplay];
+                else
+                    [view setNeedsDisplayInRect: CGRectMake(CGRectGetMidX(bounds) - side / 2, CGRectGetMidY(bounds) - side / 2, side, side)];
+
+                [view.layer displayIfNeeded];
+            }
+        });
+
+        printf("%-44s %lld items culled per run\n", "", (TKDCounter(TKInstrumentationCounterCulledItems) - culled) / 50);
+    }
+}
+
+#pragma mark - Patching
+
+// A change of a single colour in a 200 view theme, applied by patching the view built before against building the
+// whole hierarchy again. Both alternate between the two themes, and include drawing the views up to the screen
++ (void)runPatch {
+    ThemeKit *engine = [ThemeKit defaultEngine];
+    NSData *JSON = TKDSyntheticTheme(200, 0.3);
+
+    // The colour of the deepest view with one along the first subviews
+    NSMutableDictionary *theme = [NSJSONSerialization JSONObjectWithData: JSON options: NSJSONReadingMutableContainers error: NULL];
+    NSMutableDictionary *changed = nil;
+    for (NSMutableDictionary *node = theme; node; node = [[node objectForKey: @"subviews"] count] ? [[node objectForKey: @"subviews"] objectAtIndex: 0] : nil) {
+        if ([node objectForKey: @"color"])
+            changed = node;
+    }
+
+    [changed setObject: [[changed objectForKey: @"color"] isEqual: @"#123456"] ? @"#654321" : @"#123456" forKey: @"color"];
+    NSArray *themes = [NSArray arrayWithObjects: JSON, [NSJSONSerialization dataWithJSONObject: theme options: 0 error: NULL], nil];
+
+    TKDMeasure(@"200 views, one colour changed, rebuild", 50, 1, "changes", nil, ^(int run) {
+        UIView *view = [engine viewHierarchyFromJSON: [themes objectAtIndex: (run + 1) % 2] bindings: NULL];
+        TKDDisplay(view);
+    });
+
+    UIView *view = [engine viewHierarchyFromJSON: JSON bindings: NULL];
+    TKDDisplay(view);
+
+    __block NSUInteger changedViews = 0;
+    TKDMeasure(@"200 views, one colour changed, patch", 50, 1, "changes", nil, ^(int run) {
+        TKThemeDiff *diff = [engine updateViewHierarchy: view withJSON: [themes objectAtIndex: (run + 1) % 2] bindings: NULL];
+        TKDDisplay(view);
+        changedViews = [diff changedNodeCount];
+    });
+
+    printf("%-44s %lu of %lu views patched\n", "", (unsigned long)changedViews, (unsigned long)TKDViewCount(view));
+}
+
+#pragma mark - Shadows
+
+typedef enum { TKDShadowCoreGraphics, TKDShadowMask, TKDShadowCachedMask } TKDShadowMethod;
+
+// The shadow of the shape with the given method - set on the context the way Core Graphics draws it (inner shadows
+// as the inverse of the shape, filled with the shadow and clipped to the shape), from a mask rendered for it, or
+// from the mask cached in the resource pool
+static void TKDDrawShadow(CGContextRef context, TKDShadowMethod method, const TKShadowShape *shape, CGPathRef path, BOOL inner) {
+    const CGFloat blur = 8.0;
+    const CGSize offset = CGSizeMake(0.0, 3.0);
+    CGColorRef color = [[UIColor colorWithWhite: 0.0 alpha: 0.5] CGColor];
+
+    CGContextSaveGState(context);
+
+    if (inner) {
+        CGContextAddPath(context, path);
+        CGContextClip(context);
+    }
+
+    TKShadowLayout layout;
+    if (method != TKDShadowCoreGraphics && TKShadowLayoutMake(&layout, context, shape, blur, offset, inner)) {
+        CGImageRef mask = method == TKDShadowMask ? TKShadowMaskCreate(shape, &layout) : CGImageRetain([[TKResourcePool sharedPool] shadowMaskForShape: shape layout: &layout]);
+        TKContextDrawShadowMask(context, mask, &layout, shape, offset, color);
+        CGImageRelease(mask);
+    } else {
+        CGContextSetShadowWithColor(context, offset, blur, color);
+        CGContextAddPath(context, path);
+
+        if (inner) {
+            CGContextAddRect(context, CGRectInfinite);
+            CGContextEOFillPath(context);
+        } else {
+            CGContextFillPath(context);
+        }
+    }
+
+    CGContextRestoreGState(context);
+}
+
+// Drop and inner shadows of each shape, drawn by Core Graphics against the masks of TKShadow.h, rendered each time
+// and cached. The rectangle is large, where its 9-slice mask makes the most difference
++ (void)runShadows {
+    const CGRect rect = CGRectMake(20.0, 20.0, 280.0, 120.0);
+    const CGFloat radii[4] = { 10.0, 10.0, 10.0, 10.0 };
+    CGMutablePathRef star = CGPathCreateMutable();
+
+    for (int point = 0; point < 10; point++) {
+        CGFloat angle = M_PI * point / 5.0, radius = point % 2 ? 30.0 : 60.0;
+        CGPoint vertex = CGPointMake(CGRectGetMidX(rect) + radius * sin(angle), CGRectGetMidY(rect) - radius * cos(angle));
+        if (point == 0)
+            CGPathMoveToPoint(star, NULL, vertex.x, vertex.y);
+        else
+            CGPathAddLineToPoint(star, NULL, vertex.x, vertex.y);
+    }
+
+    CGPathCloseSubpath(star);
+
+    TKShadowShape shapes[3];
+    TKShadowShapeInitWithRect(&shapes[0], rect, radii);
+    TKShadowShapeInitWithEllipse(&shapes[1], rect);
+    TKShadowShapeInitWithPath(&shapes[2], star);
+
+    CGPathRef paths[3] = { [[TKResourcePool sharedPool] roundedPathInRect: rect radii: radii], [[TKResourcePool sharedPool] ellipsePathInRect: rect], star };
+    NSArray *shapeNames = [NSArray arrayWithObjects: @"rounded rectangle", @"ellipse", @"path", nil];
+    NSArray *methodNames = [NSArray arrayWithObjects: @"Core Graphics", @"mask", @"cached mask", nil];
+
+    UIGraphicsBeginImageContextWithOptions(CGSizeMake(320.0, 160.0), NO, 0.0);
+    CGContextRef context = UIGraphicsGetCurrentContext();
+
+    for (int shape = 0; shape < 3; shape++) {
+        for (int inner = 0; inner < 2; inner++) {
+            for (int method = TKDShadowCoreGraphics; method <= TKDShadowCachedMask; method++) {
+                NSString *name = [NSString stringWithFormat: @"%@, %@ shadow, %@", [shapeNames objectAtIndex: shape], inner ? @"inner" : @"drop",
+                                  [methodNames objectAtIndex: method]];
+
+                const TKShadowShape *shadowShape = &shapes[shape];
+                CGPathRef path = paths[shape];
+                TKDMeasure(name, 200, 1, "shadows", nil, ^(int run) {
+                    TKDDrawShadow(context, (TKDShadowMethod)method, shadowShape, path, inner);
+                });
+            }
+        }
+    }
+
+    UIGraphicsEndImageContext();
+    CGPathRelease(star);
+}
+
+#pragma mark - Memory pressure
+
+// Bytes held by the three caches of the engine
+static unsigned long long TKDCachedBytes(ThemeKit *engine) {
+    unsigned long long bytes = 0;
+    NSDictionary *statistics = [engine cacheStatistics];
+    for (NSString *name in statistics) {
+        if (![name isEqualToString: @"DiskImageCache"])
+            bytes += [[[statistics objectForKey: name] objectForKey: @"bytes"] unsignedLongLongValue];
+    }
+
+    return bytes;
+}
+
+// A working set of four themes, each built and rendered into an image, loaded again after every memory warning.
+// A full flush against each level of the graded trim - the time to get the working set back, and the memory that
+// stays resident right after the warning and once the working set is back
++ (void)runMemoryPressure {
+    ThemeKit *engine = [ThemeKit defaultEngine];
+    NSMutableArray *paths = [NSMutableArray array];
+
+    for (uint64_t seed = 1; seed <= 4; seed++) {
+        TKThemeGeneratorOptions options = TKThemeGeneratorDefaultOptions();
+        options.nodes = 200;
+        options.seed = seed;
+
+        size_t length = 0;
+        char *bytes = TKThemeGenerate(&options, &length);
+        NSString *path = [NSTemporaryDirectory() stringByAppendingPathComponent: [NSString stringWithFormat: @"TKDPressureBenchmark-%llu.json", (unsigned long long)seed]];
+        [[NSData dataWithBytesNoCopy: bytes length: length freeWhenDone: YES] writeToFile: path atomically: YES];
+        [paths addObject: path];
+    }
+
+    void (^load)(int) = ^(int run) {
+        for (NSString *path in paths) {
+            TKBenchmarkUse([engine viewHierarchyForJSONAtPath: path bindings: NULL]);
+            TKBenchmarkUse([engine compressedImageForJSONAtPath: path]);
+        }
+    };
+
+    NSArray *names = [NSArray arrayWithObjects: @"flush", @"moderate trim", @"high trim", @"critical trim", nil];
+    for (int signal = 0; signal < 4; signal++) {
+        [engine flushCache];
+        load(0);
+
+        __block size_t signalled = 0;
+        NSString *name = [NSString stringWithFormat: @"4 themes, reload after %@", [names objectAtIndex: signal]];
+        TKDMeasure(name, 20, [paths count], "themes", ^(int run) {
+            if (signal == 0)
+                [engine flushCache];
+            else
+                [engine trimCachesForMemoryPressure: (TKMemoryPressure)(signal - 1)];
+
+            signalled += TKBenchmarkResidentMemory();
+        }, load);
+
+        printf("%-44s resident %zu KB after the warning, %zu KB reloaded, %llu KB cached\n", "", signalled / 20 / 1024,
+               TKBenchmarkResidentMemory() / 1024, TKDCachedBytes(engine) / 1024);
+    }
+
+    for (NSString *path in paths) {
+        [[NSFileManager defaultManager] removeItemAtPath: path error: NULL];
+    }
+}
+
+#pragma mark - Text runs
+
+// A table cell with a title (custom font, gradient and shadow) and a detail label. Bound labels stay live UILabels,
+// the static ones are shown from the images of their text runs
+static NSData *TKDCell(BOOL live) {
+    NSString *title = live ? @",\"bind-to\":\"title\"" : @"";
+    NSString *detail = live ? @",\"bind-to\":\"detail\"" : @"";
+    NSString *JSON = [NSString stringWithFormat:
+        @"{\"title\":\"Cell\",\"origin\":{\"x\":0,\"y\":0},\"size\":{\"width\":320,\"height\":44},\"subviews\":["
+        "{\"type\":\"rectangle\",\"origin\":{\"x\":0,\"y\":0},\"size\":{\"width\":320,\"height\":44},\"color\":\"#F4F4F4\",\"subviews\":["
+        "{\"type\":\"label\",\"content-string\":\"Inbox\",\"font-name\":\"HelveticaNeue-Bold\",\"font-size\":17,\"content-color\":\"#333\","
+        "\"content-shadow\":{\"offset\":{\"x\":0,\"y\":1},\"color\":\"#FFF\"},"
+        "\"gradient-fill\":{\"gradient-colors\":[\"#555\",\"#111\"],\"gradient-positions\":[0.0,1.0]},"
+        "\"origin\":{\"x\":12,\"y\":10},\"size\":{\"width\":200,\"height\":24}%@},"
+        "{\"type\":\"label\",\"content-string\":\"Today\",\"font-name\":\"HelveticaNeue\",\"font-size\":13,\"content-color\":\"#8E8E93\","
+        "\"content-align\":\"right\",\"content-shadow\":{\"offset\":{\"x\":0,\"y\":1},\"color\":\"#FFF\"},"
+        "\"origin\":{\"x\":220,\"y\":12},\"size\":{\"width\":88,\"height\":20}%@}]}]}", title, detail];
+
+    return [JSON dataUsingEncoding: NSUTF8StringEncoding];
+}
+
+// Scrolling through a table of identical cells, a new cell comes in on every frame. Layout is building the cell,
+// draw is displaying its layers and compositing the ten visible cells - with live labels against text runs, and
+// the time the text runs save per frame
++ (void)runTextRuns {
+    ThemeKit *engine = [ThemeKit defaultEngine];
+    const int frames = 120, visible = 10;
+    double medians[2][2];
+
+    UIGraphicsBeginImageContextWithOptions(CGSizeMake(320.0, 44.0 * visible), YES, 0.0);
+    CGContextRef context = UIGraphicsGetCurrentContext();
+
+    for (int live = 1; live >= 0; live--) {
+        NSData *cell = TKDCell(live);
+        NSMutableArray *cells = [NSMutableArray arrayWithCapacity: visible];
+        [engine flushCache];
+
+        TKBenchmarkSamples layout, draw;
+        TKBenchmarkSamplesInit(&layout);
+        TKBenchmarkSamplesInit(&draw);
+
+        for (int frame = 0; frame < frames; frame++) {
+            NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+
+            double start = TKBenchmarkNow();
+            UIView *view = [engine viewHierarchyFromJSON: cell bindings: NULL];
+            [view layoutIfNeeded];
+            TKBenchmarkSamplesAdd(&layout, TKBenchmarkNow() - start);
+
+            if ([cells count] == visible)
+                [cells removeObjectAtIndex: 0];
+            [cells addObject: view];
+
+            start = TKBenchmarkNow();
+            TKDDisplay(view);
+            for (NSUInteger i = 0; i < [cells count]; i++) {
+                CGContextSaveGState(context);
+                CGContextTranslateCTM(context, 0.0, 44.0 * i);
+                [[[cells objectAtIndex: i] layer] renderInContext: context];
+                CGContextRestoreGState(context);
+            }
+
+            TKBenchmarkSamplesAdd(&draw, TKBenchmarkNow() - start);
+            [pool drain];
+        }
+
+        NSString *labels = live ? @"live labels" : @"text runs";
+        medians[live][0] = TKBenchmarkPercentile(&layout, 50.0);
+        medians[live][1] = TKBenchmarkPercentile(&draw, 50.0);
+
+        TKBenchmarkReport([[NSString stringWithFormat: @"scrolling cells, %@, layout", labels] UTF8String], &layout, 1, "frames");
+        TKBenchmarkReport([[NSString stringWithFormat: @"scrolling cells, %@, draw", labels] UTF8String], &draw, 1, "frames");
+        TKBenchmarkSamplesFree(&layout);
+        TKBenchmarkSamplesFree(&draw);
+    }
+
+    UIGraphicsEndImageContext();
+
+    printf("%-44s text runs save %.3f ms layout, %.3f ms draw per frame\n", "", (medians[1][0] - medians[0][0]) * 1000.0,
+           (medians[1][1] - medians[0][1]) * 1000.0);
+}
+
+#pragma mark - Pipeline
+
+// Parse, build and rasterize of whole themes - cold with the caches flushed before every run, warm without
++ (void)runPipeline {
+    ThemeKit *engine = [ThemeKit defaultEngine];
+    const size_t sizes[2] = { 200, 2000 };
+
+    for (int i = 0; i < 2; i++) {
+        NSData *JSON = TKDSyntheticTheme(sizes[i], 0.3);
+        NSString *theme = [NSString stringWithFormat: @"%lu views (%lu KB)", (unsigned long)sizes[i], (unsigned long)[JSON length] / 1024];
+        int runs = i == 0 ? 50 : 10;
+
+        TKDMeasure([theme stringByAppendingString: @", parse"], runs, [JSON length], "B", nil, ^(int run) {
+            TKBenchmarkUse(TKJSONObjectFromData(JSON, NSUIntegerMax));
+        });
+
+        void (^flush)(int) = ^(int run) {
+            [engine flushCache];
+        };
+
+        TKDMeasure([theme stringByAppendingString: @", build cold"], runs, sizes[i], "views", flush, ^(int run) {
+            TKBenchmarkUse([engine viewHierarchyFromJSON: JSON bindings: NULL]);
+        });
+
+        TKDMeasure([theme stringByAppendingString: @", build warm"], runs, sizes[i], "views", nil, ^(int run) {
+            TKBenchmarkUse([engine viewHierarchyFromJSON: JSON bindings: NULL]);
+        });
+
+        UIView *view = [engine viewHierarchyFromJSON: JSON bindings: NULL];
+        NSUInteger views = TKDViewCount(view);
+
+        TKDMeasure([theme stringByAppendingString: @", rasterize"], runs, views, "views", nil, ^(int run) {
+            TKBenchmarkUse([engine compressedImageForView: view]);
+        });
+    }
+}
+
+#pragma mark - Running
+
++ (void)run {
+    ThemeKit *engine = [ThemeKit defaultEngine];
+    engine.instrumentationEnabled = YES;
+    TKInstrumentationReset();
+
+    printf("ThemeKit benchmarks, scale %.0f\n", [[UIScreen mainScreen] scale]);
+
+    [self runParser];
+    [self runArchive];
+    [self runWorkers];
+    [self runRedraw];
+    [self runPatch];
+    [self runShadows];
+    [self runMemoryPressure];
+    [self runTextRuns];
+    [self runPipeline];
+
+    printf("%s\n", [[[engine instrumentationSnapshot] description] UTF8String]);
+    printf("peak memory: %zu KB\n", TKBenchmarkPeakMemory() / 1024);
+    fflush(stdout);
+
+    engine.instrumentationEnabled = NO;
+}
+
+@end
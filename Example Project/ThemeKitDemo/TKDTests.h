@@ -0,0 +1,22 @@
+//
+//  TKDTests.h
+//  ThemeKitDemo
+//
+//  Tests of the parts of the engine that need UIKit, run on the device (or the simulator) instead of the demo when
+//  the app is launched with -TKRunTests YES (an argument of the scheme). Checks and results are printed the way the
+//  tests of the plain C parts print them (see Tests/TKTest.h)
+//
+//  Copyright (c) 2012 __MyCompanyName__. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+@interface TKDTests : NSObject
+
+// True if the app was launched with -TKRunTests YES
++ (BOOL)isRequested;
+
+// Runs everything on the main thread, returns YES if all checks passed
++ (BOOL)run;
+
+@end
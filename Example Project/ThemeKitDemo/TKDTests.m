@@ -0,0 +1,559 @@
+//
+//  TKDTests.m
+//  ThemeKitDemo
+//
+//  Copyright (c) 2012 __MyCompanyName__. All rights reserved.
+//
+
+#import "TKDTests.h"
+#import "ThemeKit.h"
+#import "TKView.h"
+#import "TKShadow.h"
+#import "TKThemeArchive.h"
+#import "TKTest.h"
+
+@interface TKDiskImageCache (Private)
+
+- (NSString *)pathForHash: (TKStructuralHash)hash scale: (CGFloat)scale;
+
+@end
+
+#pragma mark - Helpers
+
+static NSString *TKDTestDirectory = nil;
+
+// A new empty directory for each test, removed again by the next one
+static NSString *TKDTemporaryDirectory(void) {
+    if (TKDTestDirectory)
+        [[NSFileManager defaultManager] removeItemAtPath: TKDTestDirectory error: NULL];
+
+    [TKDTestDirectory release];
+    NSString *name = [NSString stringWithFormat: @"TKDTests-%@", [[NSProcessInfo processInfo] globallyUniqueString]];
+    TKDTestDirectory = [[NSTemporaryDirectory() stringByAppendingPathComponent: name] retain];
+
+    return TKDTestDirectory;
+}
+
+static TKStructuralHash TKDHash(uint64_t value) {
+    TKStructuralHash hash = { value * 0x9e3779b97f4a7c15ULL, value ^ 0xc6a4a7935bd1e995ULL };
+    return hash;
+}
+
+// Translucent gradient with a pattern, so that the pixels of every row and column differ
+static UIImage *TKDTestImage(CGSize size, CGFloat scale, CGFloat hue) {
+    UIGraphicsBeginImageContextWithOptions(size, NO, scale);
+    CGContextRef context = UIGraphicsGetCurrentContext();
+
+    for (int x = 0; x < size.width; x++) {
+        [[UIColor colorWithHue: hue saturation: 0.8 brightness: (CGFloat)x / size.width alpha: 0.5 + 0.5 * (x % 2)] setFill];
+        CGContextFillRect(context, CGRectMake(x, 0, 1, size.height));
+    }
+
+    [[UIColor colorWithWhite: 0.0 alpha: 0.25] setFill];
+    CGContextFillEllipseInRect(context, CGRectMake(1, 1, size.width / 2, size.height / 2));
+
+    UIImage *image = UIGraphicsGetImageFromCurrentImageContext();
+    UIGraphicsEndImageContext();
+
+    return image;
+}
+
+// Pixels of the image drawn into premultiplied BGRA, the format the disk cache stores
+static NSData *TKDPixels(UIImage *image) {
+    CGImageRef imageRef = [image CGImage];
+    size_t width = CGImageGetWidth(imageRef), height = CGImageGetHeight(imageRef);
+    NSMutableData *pixels = [NSMutableData dataWithLength: width * height * 4];
+
+    CGColorSpaceRef colorSpace = CGColorSpaceCreateDeviceRGB();
+    CGContextRef context = CGBitmapContextCreate([pixels mutableBytes], width, height, 8, width * 4, colorSpace,
+                                                 kCGImageAlphaPremultipliedFirst | kCGBitmapByteOrder32Little);
+    CGColorSpaceRelease(colorSpace);
+
+    CGContextSetBlendMode(context, kCGBlendModeCopy);
+    CGContextDrawImage(context, CGRectMake(0, 0, width, height), imageRef);
+    CGContextRelease(context);
+
+    return pixels;
+}
+
+// The statistics are taken on the queue of the cache, so this waits for the writes and trims before it
+static NSDictionary *TKDWait(TKDiskImageCache *cache) {
+    return [cache statistics];
+}
+
+static long long TKDStatistic(TKDiskImageCache *cache, NSString *key) {
+    return [[TKDWait(cache) objectForKey: key] longLongValue];
+}
+
+static BOOL TKDFileExists(TKDiskImageCache *cache, TKStructuralHash hash, CGFloat scale) {
+    return [[NSFileManager defaultManager] fileExistsAtPath: [cache pathForHash: hash scale: scale]];
+}
+
+#pragma mark - Disk image cache
+
+static void TestRoundTrip(void) {
+    TKDiskImageCache *cache = [[TKDiskImageCache alloc] initWithDirectory: TKDTemporaryDirectory() byteLimit: 0];
+    UIImage *image = TKDTestImage(CGSizeMake(21, 10), 2.0, 0.6);
+
+    TKTestCheck([cache imageForHash: TKDHash(1) scale: 2.0] == nil, "image before it was stored");
+    [cache setImage: image forHash: TKDHash(1)];
+    TKTestCheck(TKDStatistic(cache, @"writes") == 1, "%lld writes", TKDStatistic(cache, @"writes"));
+
+    UIImage *stored = [cache imageForHash: TKDHash(1) scale: 2.0];
+    TKTestCheck(stored != nil, "stored image not found");
+    TKTestCheck(CGSizeEqualToSize([stored size], [image size]) && [stored scale] == 2.0, "size %@ at %gx",
+                NSStringFromCGSize([stored size]), (double)[stored scale]);
+    TKTestCheck([TKDPixels(stored) isEqualToData: TKDPixels(image)], "pixels differ");
+
+    // Another scale, or another hash with the same first lane (a collision), is a different image
+    TKStructuralHash collision = TKDHash(1);
+    collision.check++;
+    TKTestCheck([cache imageForHash: TKDHash(1) scale: 1.0] == nil, "image found at another scale");
+    TKTestCheck([cache imageForHash: collision scale: 2.0] == nil, "colliding hash returned the image");
+
+    TKTestCheck(TKDStatistic(cache, @"hits") == 1 && TKDStatistic(cache, @"misses") == 3, "%lld hits, %lld misses",
+                TKDStatistic(cache, @"hits"), TKDStatistic(cache, @"misses"));
+
+    long long bytes = TKDStatistic(cache, @"bytes");
+    TKTestCheck(bytes >= 42 * 20 * 4, "%lld bytes", bytes);
+
+    // Storing it again replaces the file, the bytes stay the same
+    [cache setImage: image forHash: TKDHash(1)];
+    TKTestCheck(TKDStatistic(cache, @"bytes") == bytes, "%lld bytes after storing again, %lld before", TKDStatistic(cache, @"bytes"), bytes);
+    [cache release];
+
+    // Still there for the next launch, which finds out how much is stored
+    cache = [[TKDiskImageCache alloc] initWithDirectory: TKDTestDirectory byteLimit: 0];
+    TKTestCheck(TKDStatistic(cache, @"bytes") == bytes, "%lld bytes after relaunch, %lld before", TKDStatistic(cache, @"bytes"), bytes);
+    TKTestCheck([TKDPixels([cache imageForHash: TKDHash(1) scale: 2.0]) isEqualToData: TKDPixels(image)], "pixels differ after relaunch");
+
+    [cache removeAllImages];
+    TKTestCheck(TKDStatistic(cache, @"bytes") == 0 && !TKDFileExists(cache, TKDHash(1), 2.0), "images left after removing all");
+    [cache release];
+}
+
+static void TestEviction(void) {
+    TKDiskImageCache *cache = [[TKDiskImageCache alloc] initWithDirectory: TKDTemporaryDirectory() byteLimit: 0];
+    NSFileManager *manager = [NSFileManager defaultManager];
+
+    for (uint64_t i = 0; i < 6; i++) {
+        [cache setImage: TKDTestImage(CGSizeMake(16, 16), 1.0, i / 6.0) forHash: TKDHash(i)];
+    }
+
+    long long bytes = TKDStatistic(cache, @"bytes");
+    long long bytesPerImage = bytes / 6;
+    TKTestCheck(bytes == bytesPerImage * 6 && TKDStatistic(cache, @"evictions") == 0, "%lld bytes without a limit", bytes);
+
+    // Used in the order they were written, an hour apart, except the first one which is used again now
+    for (uint64_t i = 0; i < 6; i++) {
+        NSDate *date = [NSDate dateWithTimeIntervalSinceNow: -3600.0 * (6 - i)];
+        [manager setAttributes: [NSDictionary dictionaryWithObject: date forKey: NSFileModificationDate]
+                  ofItemAtPath: [cache pathForHash: TKDHash(i) scale: 1.0] error: NULL];
+    }
+
+    TKTestCheck([cache imageForHash: TKDHash(0) scale: 1.0] != nil, "first image not found");
+    TKDWait(cache);
+
+    // Over the limit of 4, trimmed to 3/4 of it - the least recently used go first
+    cache.byteLimit = bytesPerImage * 4;
+    TKTestCheck(TKDStatistic(cache, @"evictions") == 3, "%lld evictions", TKDStatistic(cache, @"evictions"));
+    TKTestCheck(TKDStatistic(cache, @"bytes") == bytesPerImage * 3, "%lld bytes left", TKDStatistic(cache, @"bytes"));
+
+    const BOOL kept[6] = { YES, NO, NO, NO, YES, YES };
+    for (uint64_t i = 0; i < 6; i++) {
+        TKTestCheck(TKDFileExists(cache, TKDHash(i), 1.0) == kept[i], "image %d %s", (int)i, kept[i] ? "evicted" : "kept");
+    }
+
+    // Writes over the limit trim as they go
+    for (uint64_t i = 6; i < 12; i++) {
+        [cache setImage: TKDTestImage(CGSizeMake(16, 16), 1.0, i / 12.0) forHash: TKDHash(i)];
+    }
+
+    TKTestCheck(TKDStatistic(cache, @"bytes") <= bytesPerImage * 4, "%lld bytes over the limit", TKDStatistic(cache, @"bytes"));
+    [cache release];
+
+    // A limit that is already exceeded on launch is applied right away
+    cache = [[TKDiskImageCache alloc] initWithDirectory: TKDTestDirectory byteLimit: bytesPerImage];
+    TKTestCheck(TKDStatistic(cache, @"bytes") <= bytesPerImage, "%lld bytes after relaunch with a lower limit", TKDStatistic(cache, @"bytes"));
+    [cache release];
+}
+
+static void TestCorruptFiles(void) {
+    TKDiskImageCache *cache = [[TKDiskImageCache alloc] initWithDirectory: TKDTemporaryDirectory() byteLimit: 0];
+    UIImage *image = TKDTestImage(CGSizeMake(12, 12), 2.0, 0.3);
+    NSString *path = [cache pathForHash: TKDHash(7) scale: 2.0];
+
+    [cache setImage: image forHash: TKDHash(7)];
+    TKDWait(cache);
+    NSData *original = [NSData dataWithContentsOfFile: path];
+
+    // Each kind of damage is a miss, never a crash or garbage
+    NSMutableArray *damaged = [NSMutableArray array];
+    [damaged addObject: [NSData data]];
+    [damaged addObject: [original subdataWithRange: NSMakeRange(0, 10)]];
+    [damaged addObject: [original subdataWithRange: NSMakeRange(0, [original length] - 1)]];
+
+    NSMutableData *magic = [[original mutableCopy] autorelease];
+    ((char *)[magic mutableBytes])[0] = 'X';
+    [damaged addObject: magic];
+
+    NSMutableData *version = [[original mutableCopy] autorelease];
+    ((uint32_t *)[version mutableBytes])[1] += 1;
+    [damaged addObject: version];
+
+    // Rows longer than the file (bytesPerRow is the seventh uint32 of the header)
+    NSMutableData *rows = [[original mutableCopy] autorelease];
+    ((uint32_t *)[rows mutableBytes])[6] = 0xFFFFFFF0;
+    [damaged addObject: rows];
+
+    long long misses = TKDStatistic(cache, @"misses");
+    for (NSUInteger i = 0; i < [damaged count]; i++) {
+        [[damaged objectAtIndex: i] writeToFile: path atomically: YES];
+        TKTestCheck([cache imageForHash: TKDHash(7) scale: 2.0] == nil, "damaged file %d read as an image", (int)i);
+    }
+
+    TKTestCheck(TKDStatistic(cache, @"misses") == misses + (long long)[damaged count], "%lld misses", TKDStatistic(cache, @"misses"));
+
+    // Rendering it again replaces the damaged file
+    [cache setImage: image forHash: TKDHash(7)];
+    TKDWait(cache);
+    TKTestCheck([TKDPixels([cache imageForHash: TKDHash(7) scale: 2.0]) isEqualToData: TKDPixels(image)], "not recovered");
+
+    // Files that are not images are left alone
+    NSString *other = [TKDTestDirectory stringByAppendingPathComponent: @"other.txt"];
+    [@"text" writeToFile: other atomically: YES encoding: NSUTF8StringEncoding error: NULL];
+    [cache removeAllImages];
+    TKDWait(cache);
+    TKTestCheck([[NSFileManager defaultManager] fileExistsAtPath: other], "other file removed");
+
+    [cache release];
+}
+
+#pragma mark - Image atlas
+
+// Opaque images stay opaque up to their edges when scaled up with filtering, their gutter repeats the edge pixels
+static void TestAtlasGutter(void) {
+    TKImageAtlas *atlas = [[TKImageAtlas alloc] initWithPageSize: 64];
+    UIImage *images[3];
+
+    for (int i = 0; i < 3; i++) {
+        UIGraphicsBeginImageContextWithOptions(CGSizeMake(4 + i, 4), YES, 1.0);
+        [[UIColor colorWithHue: i / 3.0 saturation: 1.0 brightness: 1.0 alpha: 1.0] setFill];
+        UIRectFill(CGRectMake(0, 0, 4 + i, 4));
+        images[i] = [atlas imageByPackingImage: UIGraphicsGetImageFromCurrentImageContext()];
+        UIGraphicsEndImageContext();
+
+        TKTestCheck([atlas containsImage: images[i]], "image %d not packed", i);
+    }
+
+    for (int i = 0; i < 3; i++) {
+        UIGraphicsBeginImageContextWithOptions(CGSizeMake(40, 40), NO, 1.0);
+        CGContextSetInterpolationQuality(UIGraphicsGetCurrentContext(), kCGInterpolationHigh);
+        [images[i] drawInRect: CGRectMake(0, 0, 40, 40)];
+        UIImage *scaled = UIGraphicsGetImageFromCurrentImageContext();
+        UIGraphicsEndImageContext();
+
+        // Alpha is the last byte of each premultiplied BGRA pixel
+        NSData *pixels = TKDPixels(scaled);
+        const uint8_t *bytes = [pixels bytes];
+        int transparent = 0;
+        for (NSUInteger pixel = 0; pixel < [pixels length] / 4; pixel++) {
+            transparent += bytes[pixel * 4 + 3] < 250;
+        }
+
+        TKTestCheck(transparent == 0, "image %d has %d translucent pixels when scaled", i, transparent);
+    }
+
+    [atlas release];
+}
+
+#pragma mark - Shadows
+
+// Alpha of a black drop shadow of the shape without an offset, drawn from a mask or by Core Graphics. Nil if
+// the shadow can't be drawn from a mask
+static NSData *TKDShadowAlpha(const TKShadowShape *shape, CGPathRef path, CGFloat blur, BOOL mask) {
+    UIGraphicsBeginImageContextWithOptions(CGSizeMake(160, 160), NO, 1.0);
+    CGContextRef context = UIGraphicsGetCurrentContext();
+    CGColorRef color = [[UIColor blackColor] CGColor];
+
+    TKShadowLayout layout;
+    if (mask && TKShadowLayoutMake(&layout, context, shape, blur, CGSizeZero, NO)) {
+        CGImageRef image = TKShadowMaskCreate(shape, &layout);
+        TKContextDrawShadowMask(context, image, &layout, shape, CGSizeZero, color);
+        CGImageRelease(image);
+    } else if (mask) {
+        UIGraphicsEndImageContext();
+        return nil;
+    } else {
+        CGContextSetShadowWithColor(context, CGSizeZero, blur, color);
+        CGContextAddPath(context, path);
+        CGContextFillPath(context);
+    }
+
+    UIImage *image = UIGraphicsGetImageFromCurrentImageContext();
+    UIGraphicsEndImageContext();
+
+    NSData *pixels = TKDPixels(image);
+    NSMutableData *alpha = [NSMutableData dataWithLength: [pixels length] / 4];
+    for (NSUInteger pixel = 0; pixel < [alpha length]; pixel++)
+        ((uint8_t *)[alpha mutableBytes])[pixel] = ((const uint8_t *)[pixels bytes])[pixel * 4 + 3];
+
+    return alpha;
+}
+
+// Masks stay within 5 of 255 levels of the shadow Core Graphics draws, with the gaussian (blur below 8) and the
+// box blurs. Core Graphics fills the shape along with its shadow, so only the pixels clear of the shape compare
+static void TestShadowTolerance(void) {
+    const CGRect rect = CGRectMake(40, 40, 80, 60), outside = CGRectInset(rect, -2, -2);
+    const CGFloat blurs[] = { 3.0, 6.0, 12.0, 24.0 };
+    CGPathRef rectanglePath = CGPathCreateWithRect(rect, NULL), ellipsePath = CGPathCreateWithEllipseInRect(rect, NULL);
+
+    for (int shapeIndex = 0; shapeIndex < 2; shapeIndex++) {
+        TKShadowShape shape;
+        CGPathRef path = shapeIndex ? ellipsePath : rectanglePath;
+        if (shapeIndex)
+            TKShadowShapeInitWithEllipse(&shape, rect);
+        else
+            TKShadowShapeInitWithRect(&shape, rect, NULL);
+
+        for (size_t blurIndex = 0; blurIndex < sizeof(blurs) / sizeof(blurs[0]); blurIndex++) {
+            NSData *maskAlpha = TKDShadowAlpha(&shape, path, blurs[blurIndex], YES);
+            TKTestCheck(maskAlpha != nil, "no mask for blur %g", (double)blurs[blurIndex]);
+            if (!maskAlpha)
+                continue;
+
+            const uint8_t *mask = [maskAlpha bytes];
+            const uint8_t *exact = [TKDShadowAlpha(&shape, path, blurs[blurIndex], NO) bytes];
+
+            int worst = 0;
+            for (int y = 0; y < 160; y++) {
+                for (int x = 0; x < 160; x++) {
+                    if (CGRectContainsPoint(outside, CGPointMake(x + 0.5, y + 0.5)))
+                        continue;
+
+                    worst = MAX(worst, abs((int)mask[y * 160 + x] - (int)exact[y * 160 + x]));
+                }
+            }
+
+            TKTestCheck(worst <= 5, "%s with blur %g off by %d levels", shapeIndex ? "ellipse" : "rectangle", (double)blurs[blurIndex], worst);
+        }
+    }
+
+    CGPathRelease(rectanglePath);
+    CGPathRelease(ellipsePath);
+}
+
+#pragma mark - Rasterizer
+
+static void TKDCollectThemeViews(UIView *view, NSMutableArray *views) {
+    if ([view isKindOfClass: [TKView class]] && [(TKView *)view displayList])
+        [views addObject: view];
+
+    for (UIView *subview in view.subviews) {
+        TKDCollectThemeViews(subview, views);
+    }
+}
+
+// The display lists of the example themes replayed by Core Graphics and by the software rasterizer. Antialiasing
+// and blurs differ a little, shapes, colors, gradients and strokes have to be where Core Graphics draws them
+static void TestRasterReplay(void) {
+    ThemeKit *engine = [ThemeKit defaultEngine];
+    NSString *directory = [[[NSBundle mainBundle] resourcePath] stringByAppendingPathComponent: @"Examples"];
+    const CGFloat scale = 2.0;
+    int lists = 0;
+
+    for (NSString *name in [[NSFileManager defaultManager] contentsOfDirectoryAtPath: directory error: NULL]) {
+        if (![[name pathExtension] isEqualToString: @"json"])
+            continue;
+
+        NSMutableArray *views = [NSMutableArray array];
+        TKDCollectThemeViews([engine viewHierarchyForJSONAtPath: [directory stringByAppendingPathComponent: name] bindings: NULL], views);
+
+        for (TKView *view in views) {
+            CGRect rect = view.bounds;
+            int width = (int)ceil(rect.size.width * scale), height = (int)ceil(rect.size.height * scale);
+            if (width == 0 || height == 0)
+                continue;
+
+            // Flipped by hand, the same way the renderer draws
+            NSMutableData *expected = [NSMutableData dataWithLength: width * height * 4];
+            CGColorSpaceRef colorSpace = CGColorSpaceCreateDeviceRGB();
+            CGContextRef context = CGBitmapContextCreate([expected mutableBytes], width, height, 8, width * 4, colorSpace,
+                                                         kCGImageAlphaPremultipliedFirst | kCGBitmapByteOrder32Little);
+            CGColorSpaceRelease(colorSpace);
+            CGContextTranslateCTM(context, 0.0, height);
+            CGContextScaleCTM(context, scale, -scale);
+            [view.displayList drawInBitmapContext: context rect: rect scale: scale];
+            CGContextRelease(context);
+
+            TKRasterSurface surface;
+            TKRasterContext rasterContext;
+            TKRasterSurfaceInit(&surface, width, height);
+            TKRasterContextInit(&rasterContext, &surface);
+            TKTestCheck([view.displayList drawInRasterContext: &rasterContext rect: rect scale: scale], "%s not rasterized", [name UTF8String]);
+
+            // Channels of both in the same premultiplied ARGB
+            const uint32_t *pixels = [expected bytes];
+            long long difference = 0;
+            int far = 0;
+            for (int y = 0; y < height; y++) {
+                const uint32_t *row = (const uint32_t *)((const uint8_t *)surface.pixels + y * surface.bytesPerRow);
+
+                for (int x = 0; x < width; x++) {
+                    int largest = 0;
+                    for (int shift = 0; shift < 32; shift += 8) {
+                        int channel = abs((int)((pixels[y * width + x] >> shift) & 0xff) - (int)((row[x] >> shift) & 0xff));
+                        difference += channel;
+                        largest = MAX(largest, channel);
+                    }
+
+                    far += largest > 32;
+                }
+            }
+
+            double mean = (double)difference / (width * height * 4);
+            TKTestCheck(mean <= 3.0, "%s: mean difference of %.2f levels", [name UTF8String], mean);
+            TKTestCheck(far <= width * height / 50, "%s: %d of %d pixels off by more than 32 levels", [name UTF8String], far, width * height);
+
+            TKRasterContextFree(&rasterContext);
+            TKRasterSurfaceFree(&surface);
+            lists++;
+        }
+    }
+
+    TKTestCheck(lists > 0, "no display lists in the examples");
+}
+
+#pragma mark - Components
+
+// Two uses of a path component at different origins, with one display list compiled at the origin for both
+static NSData *TKDComponentTheme(CGPoint second) {
+    NSString *JSON = [NSString stringWithFormat:
+        @"{\"title\":\"Components\",\"size\":{\"width\":200,\"height\":100},"
+        "\"defs\":{\"arrow\":{\"type\":\"path\",\"description\":\"M5 5 L25 5 L15 25 Z\",\"color\":\"#C00\"}},"
+        "\"subviews\":[{\"use\":\"arrow\",\"origin\":{\"x\":10,\"y\":10}},{\"use\":\"arrow\",\"origin\":{\"x\":%g,\"y\":%g}}]}",
+        (double)second.x, (double)second.y];
+
+    return [JSON dataUsingEncoding: NSUTF8StringEncoding];
+}
+
+static void TestComponentOrigins(void) {
+    ThemeKit *engine = [ThemeKit defaultEngine];
+    [engine flushCache];
+
+    UIView *view = [engine viewHierarchyFromJSON: TKDComponentTheme(CGPointMake(100, 40)) bindings: NULL];
+    NSArray *subviews = view.subviews;
+    TKTestCheck([subviews count] == 2, "%d subviews", (int)[subviews count]);
+    if ([subviews count] != 2)
+        return;
+
+    TKView *first = [subviews objectAtIndex: 0], *second = [subviews objectAtIndex: 1];
+    TKTestCheck([first isKindOfClass: [TKView class]] && [second isKindOfClass: [TKView class]], "paths not drawn by TKViews");
+    TKTestCheck(first.displayList != nil && first.displayList == second.displayList, "display list not shared");
+
+    // Each at its own origin, the size of the path
+    TKTestCheck(CGRectEqualToRect(first.frame, CGRectMake(10, 10, 20, 20)), "first at %@", NSStringFromCGRect(first.frame));
+    TKTestCheck(CGRectEqualToRect(second.frame, CGRectMake(100, 40, 20, 20)), "second at %@", NSStringFromCGRect(second.frame));
+
+    // Moving one of them keeps the shared list, and leaves the other one where it is
+    TKThemeDiff *diff = [engine updateViewHierarchy: view withJSON: TKDComponentTheme(CGPointMake(50, 60)) bindings: NULL];
+    TKTestCheck(diff != nil && [view.subviews count] == 2, "not patched");
+    if (!diff || [view.subviews count] != 2)
+        return;
+
+    TKView *moved = [view.subviews objectAtIndex: 1];
+    TKTestCheck(CGRectEqualToRect(first.frame, CGRectMake(10, 10, 20, 20)), "first moved to %@", NSStringFromCGRect(first.frame));
+    TKTestCheck(CGRectEqualToRect(moved.frame, CGRectMake(50, 60, 20, 20)), "second patched to %@", NSStringFromCGRect(moved.frame));
+    TKTestCheck(moved.displayList == first.displayList, "display list not shared after the patch");
+}
+
+// Archives keep the components as written, they are expanded when the archive is loaded
+static void TestComponentArchive(void) {
+    ThemeKit *engine = [ThemeKit defaultEngine];
+    [engine flushCache];
+
+    NSString *directory = TKDTemporaryDirectory();
+    [[NSFileManager defaultManager] createDirectoryAtPath: directory withIntermediateDirectories: YES attributes: nil error: NULL];
+    NSString *path = [directory stringByAppendingPathComponent: @"components.json"];
+    [TKDComponentTheme(CGPointMake(100, 40)) writeToFile: path atomically: YES];
+    TKTestCheck([engine compileJSONAtPath: path toPath: [[path stringByDeletingPathExtension] stringByAppendingPathExtension: TKThemeArchivePathExtension]],
+                "not compiled");
+
+    UIView *view = [engine viewHierarchyForJSONAtPath: path bindings: NULL];
+    NSArray *subviews = view.subviews;
+    TKTestCheck([subviews count] == 2, "%d subviews from the archive", (int)[subviews count]);
+    if ([subviews count] != 2)
+        return;
+
+    TKView *first = [subviews objectAtIndex: 0], *second = [subviews objectAtIndex: 1];
+    TKTestCheck([first isKindOfClass: [TKView class]] && [second isKindOfClass: [TKView class]], "components of the archive not expanded");
+    TKTestCheck(first.displayList != nil && first.displayList == second.displayList, "display list not shared");
+    TKTestCheck(CGRectEqualToRect(second.frame, CGRectMake(100, 40, 20, 20)), "second at %@", NSStringFromCGRect(second.frame));
+}
+
+#pragma mark - Prewarming
+
+// A batch cancelled right after it was scheduled still finishes, with the themes that never started skipped
+static void TestPrewarmCancel(void) {
+    ThemeKit *engine = [ThemeKit defaultEngine];
+    NSString *directory = TKDTemporaryDirectory();
+    [[NSFileManager defaultManager] createDirectoryAtPath: directory withIntermediateDirectories: YES attributes: nil error: NULL];
+
+    NSMutableArray *paths = [NSMutableArray array];
+    for (int i = 0; i < 50; i++) {
+        NSString *JSON = [NSString stringWithFormat: @"{\"title\":\"Prewarm\",\"size\":{\"width\":100,\"height\":40},\"subviews\":["
+                          "{\"type\":\"rectangle\",\"size\":{\"width\":%d,\"height\":40},\"color\":\"#336\",\"corner-radius\":4}]}", 50 + i];
+        NSString *path = [directory stringByAppendingPathComponent: [NSString stringWithFormat: @"%d.json", i]];
+        [JSON writeToFile: path atomically: YES encoding: NSUTF8StringEncoding error: NULL];
+        [paths addObject: path];
+    }
+
+    __block BOOL completed = NO;
+    TKPrewarmTask *task = [engine prewarmThemesAtPaths: paths priority: TKPrewarmPriorityBackground];
+    task.completionHandler = ^(TKPrewarmTask *finishedTask) {
+        completed = YES;
+    };
+    [task cancel];
+
+    NSDate *timeout = [NSDate dateWithTimeIntervalSinceNow: 10.0];
+    while (!completed && [timeout timeIntervalSinceNow] > 0.0) {
+        [[NSRunLoop currentRunLoop] runMode: NSDefaultRunLoopMode beforeDate: [NSDate dateWithTimeIntervalSinceNow: 0.01]];
+    }
+
+    TKTestCheck(completed, "cancelled batch never completed");
+    TKTestCheck([task isFinished] && [task isCancelled], "finished %d, cancelled %d", [task isFinished], [task isCancelled]);
+    TKTestCheck([task completedCount] + [task skippedCount] == [paths count], "%lu completed, %lu skipped of %lu",
+                (unsigned long)[task completedCount], (unsigned long)[task skippedCount], (unsigned long)[paths count]);
+}
+
+@implementation TKDTests
+
++ (BOOL)isRequested {
+    return [[NSUserDefaults standardUserDefaults] boolForKey: @"TKRunTests"];
+}
+
++ (BOOL)run {
+    NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+
+    TKTestRun(TestRoundTrip);
+    TKTestRun(TestEviction);
+    TKTestRun(TestCorruptFiles);
+    TKTestRun(TestAtlasGutter);
+    TKTestRun(TestShadowTolerance);
+    TKTestRun(TestRasterReplay);
+    TKTestRun(TestComponentOrigins);
+    TKTestRun(TestComponentArchive);
+    TKTestRun(TestPrewarmCancel);
+
+    [[NSFileManager defaultManager] removeItemAtPath: TKDTestDirectory error: NULL];
+    [TKDTestDirectory release];
+    TKDTestDirectory = nil;
+
+    BOOL passed = TKTestResult() == EXIT_SUCCESS;
+    fflush(stdout);
+
+    [pool drain];
+    return passed;
+}
+
+@end
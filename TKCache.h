@@ -0,0 +1,77 @@
+//
+//  TKCache.h
+//  ThemeEngine
+//
+//  Cache keyed by the structural hash of the key (see TKHash.h), instead of the key itself.
+//  A lookup only costs the hash of the key, which for descriptions has been computed when
+//  they were loaded, instead of -hash and a deep -isEqual: of the NSDictionary
+//
+//  Objects are charged the bytes they hold (given when they are stored), the cache evicts the
+//  least recently used ones once the total goes over byteLimit. It can be used from any thread
+//
+//  Copyright (c) 2012 __MyCompanyName__. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+#import <pthread.h>
+#import "TKHash.h"
+
+typedef struct TKCacheEntry TKCacheEntry;
+
+@interface TKCache : NSObject {
+    NSString *_name;
+    pthread_mutex_t _lock;
+
+    // Keys point into the entries, which also form the LRU list (head is the most recent)
+    CFMutableDictionaryRef _entries;
+    TKCacheEntry *_head;
+    TKCacheEntry *_tail;
+
+    size_t _bytes;
+    size_t _byteLimit;
+
+    // Statistics
+    uint64_t _hits;
+    uint64_t _misses;
+    uint64_t _collisions;
+    uint64_t _evictions;
+}
+
+- (id)initWithName: (NSString *)name byteLimit: (size_t)byteLimit;
+- (id)initWithName: (NSString *)name;         // No limit
+
+@property (nonatomic, readonly) NSString *name;
+
+// Bytes charged for the objects in the cache, and the limit for it. Lowering the limit evicts right away
+@property (nonatomic, readonly) size_t bytes;
+@property (nonatomic) size_t byteLimit;
+
+// Counters since creation (or the last reset), a collision is a lookup which found an entry
+// with the same primary hash, but for a different key - it is counted as a miss as well. Evictions are
+// the objects let go of to stay under the limit, -removeAllObjects and -trimToBytes: are not counted
+@property (nonatomic, readonly) uint64_t hits;
+@property (nonatomic, readonly) uint64_t misses;
+@property (nonatomic, readonly) uint64_t collisions;
+@property (nonatomic, readonly) uint64_t evictions;
+
+// Keys can be any JSON object, they are hashed structurally. The cost is the number of bytes
+// held by the object, a small overhead for the entry itself is always added
+- (id)objectForKey: (id)key;
+- (void)setObject: (id)object forKey: (id)key;
+- (void)setObject: (id)object forKey: (id)key cost: (size_t)cost;
+
+// Same, but with an already computed hash
+- (id)objectForHash: (TKStructuralHash)hash;
+- (void)setObject: (id)object forHash: (TKStructuralHash)hash;
+- (void)setObject: (id)object forHash: (TKStructuralHash)hash cost: (size_t)cost;
+
+// Evicts the least recently used objects until the cache holds at most bytes, the limit stays the same
+- (void)trimToBytes: (size_t)bytes;
+- (void)removeAllObjects;
+
+// Counters of the cache as NSNumbers, keyed by hits, misses, collisions and evictions, along with the bytes
+// held and the limit for them
+- (NSDictionary *)statistics;
+- (void)resetStatistics;
+
+@end
@@ -0,0 +1,295 @@
+//
+//  TKCache.m
+//  ThemeEngine
+//
+//  Copyright (c) 2012 __MyCompanyName__. All rights reserved.
+//
+
+#import "TKCache.h"
+
+// Bookkeeping of an entry, charged on top of the cost of every object
+#define kCacheEntryCost 64
+
+// Stored object, along with the second lane of the hash for detecting collisions
+struct TKCacheEntry {
+    uint64_t value;
+    uint64_t check;
+    id object;
+    size_t cost;
+
+    TKCacheEntry *previous;
+    TKCacheEntry *next;
+};
+
+#pragma mark - Keys
+
+static CFHashCode TKCacheKeyHash(const void *value) {
+    return (CFHashCode)*(const uint64_t *)value;
+}
+
+static Boolean TKCacheKeyEqual(const void *first, const void *second) {
+    return *(const uint64_t *)first == *(const uint64_t *)second;
+}
+
+#pragma mark - Cache
+
+@interface TKCache (Private)
+
+- (void)removeEntry: (TKCacheEntry *)entry;
+- (void)evictToBytes: (size_t)bytes keeping: (TKCacheEntry *)kept;
+
+@end
+
+@implementation TKCache
+@synthesize name = _name;
+
+- (id)initWithName: (NSString *)name byteLimit: (size_t)byteLimit {
+    if ((self = [super init])) {
+        _name = [name copy];
+        _byteLimit = byteLimit;
+        pthread_mutex_init(&_lock, NULL);
+
+        // Keys and values are owned by the entries, the dictionary only points to them
+        CFDictionaryKeyCallBacks keyCallBacks = { 0, NULL, NULL, NULL, TKCacheKeyEqual, TKCacheKeyHash };
+        _entries = CFDictionaryCreateMutable(NULL, 0, &keyCallBacks, NULL);
+    }
+
+    return self;
+}
+
+- (id)initWithName: (NSString *)name {
+    return [self initWithName: name byteLimit: SIZE_MAX];
+}
+
+- (id)init {
+    return [self initWithName: nil];
+}
+
+- (size_t)bytes {
+    pthread_mutex_lock(&_lock);
+    size_t bytes = _bytes;
+    pthread_mutex_unlock(&_lock);
+
+    return bytes;
+}
+
+- (size_t)byteLimit {
+    pthread_mutex_lock(&_lock);
+    size_t limit = _byteLimit;
+    pthread_mutex_unlock(&_lock);
+
+    return limit;
+}
+
+- (void)setByteLimit: (size_t)byteLimit {
+    pthread_mutex_lock(&_lock);
+
+    _byteLimit = byteLimit;
+    [self evictToBytes: byteLimit keeping: NULL];
+
+    pthread_mutex_unlock(&_lock);
+}
+
+- (uint64_t)hits {
+    pthread_mutex_lock(&_lock);
+    uint64_t hits = _hits;
+    pthread_mutex_unlock(&_lock);
+
+    return hits;
+}
+
+- (uint64_t)misses {
+    pthread_mutex_lock(&_lock);
+    uint64_t misses = _misses;
+    pthread_mutex_unlock(&_lock);
+
+    return misses;
+}
+
+- (uint64_t)collisions {
+    pthread_mutex_lock(&_lock);
+    uint64_t collisions = _collisions;
+    pthread_mutex_unlock(&_lock);
+
+    return collisions;
+}
+
+- (uint64_t)evictions {
+    pthread_mutex_lock(&_lock);
+    uint64_t evictions = _evictions;
+    pthread_mutex_unlock(&_lock);
+
+    return evictions;
+}
+
+#pragma mark - Access
+
+- (id)objectForKey: (id)key {
+    return [self objectForHash: TKStructuralHashForObject(key)];
+}
+
+- (void)setObject: (id)object forKey: (id)key {
+    [self setObject: object forHash: TKStructuralHashForObject(key) cost: 0];
+}
+
+- (void)setObject: (id)object forKey: (id)key cost: (size_t)cost {
+    [self setObject: object forHash: TKStructuralHashForObject(key) cost: cost];
+}
+
+- (id)objectForHash: (TKStructuralHash)hash {
+    pthread_mutex_lock(&_lock);
+
+    TKCacheEntry *entry = (TKCacheEntry *)CFDictionaryGetValue(_entries, &hash.value);
+    if (!entry || entry->check != hash.check) {
+        if (entry)
+            _collisions++;
+
+        _misses++;
+        pthread_mutex_unlock(&_lock);
+        return nil;
+    }
+
+    _hits++;
+
+    // Move to the front of the LRU list
+    if (entry != _head) {
+        entry->previous->next = entry->next;
+        if (entry->next)
+            entry->next->previous = entry->previous;
+        else
+            _tail = entry->previous;
+
+        entry->previous = NULL;
+        entry->next = _head;
+        _head->previous = entry;
+        _head = entry;
+    }
+
+    // Retained under the lock, so that an eviction can't pull it away before the caller gets it
+    id object = [entry->object retain];
+    pthread_mutex_unlock(&_lock);
+
+    return [object autorelease];
+}
+
+- (void)setObject: (id)object forHash: (TKStructuralHash)hash {
+    [self setObject: object forHash: hash cost: 0];
+}
+
+- (void)setObject: (id)object forHash: (TKStructuralHash)hash cost: (size_t)cost {
+    if (!object)
+        return;
+
+    pthread_mutex_lock(&_lock);
+
+    // A colliding entry is simply replaced, as is the old object of the same key
+    TKCacheEntry *entry = (TKCacheEntry *)CFDictionaryGetValue(_entries, &hash.value);
+    if (entry)
+        [self removeEntry: entry];
+
+    entry = (TKCacheEntry *)calloc(1, sizeof(TKCacheEntry));
+    entry->value = hash.value;
+    entry->check = hash.check;
+    entry->object = [object retain];
+    entry->cost = cost + kCacheEntryCost;
+
+    CFDictionarySetValue(_entries, &entry->value, entry);
+    _bytes += entry->cost;
+
+    // Insert at the head, then evict from the tail until under the limit
+    entry->next = _head;
+    if (_head)
+        _head->previous = entry;
+    _head = entry;
+    if (!_tail)
+        _tail = entry;
+
+    [self evictToBytes: _byteLimit keeping: entry];
+
+    pthread_mutex_unlock(&_lock);
+}
+
+- (void)trimToBytes: (size_t)bytes {
+    pthread_mutex_lock(&_lock);
+
+    while (_tail && _bytes > bytes) {
+        [self removeEntry: _tail];
+    }
+
+    pthread_mutex_unlock(&_lock);
+}
+
+- (void)removeAllObjects {
+    pthread_mutex_lock(&_lock);
+
+    while (_head) {
+        [self removeEntry: _head];
+    }
+
+    pthread_mutex_unlock(&_lock);
+}
+
+- (void)evictToBytes: (size_t)bytes keeping: (TKCacheEntry *)kept {
+    // The newest object stays, even if it alone is over the limit
+    while (_tail && _tail != kept && _bytes > bytes) {
+        [self removeEntry: _tail];
+        _evictions++;
+    }
+}
+
+- (void)removeEntry: (TKCacheEntry *)entry {
+    if (entry->previous)
+        entry->previous->next = entry->next;
+    else
+        _head = entry->next;
+
+    if (entry->next)
+        entry->next->previous = entry->previous;
+    else
+        _tail = entry->previous;
+
+    CFDictionaryRemoveValue(_entries, &entry->value);
+    _bytes -= entry->cost;
+
+    [entry->object release];
+    free(entry);
+}
+
+#pragma mark - Statistics
+
+- (NSDictionary *)statistics {
+    pthread_mutex_lock(&_lock);
+    NSDictionary *statistics = [NSDictionary dictionaryWithObjectsAndKeys:
+                                [NSNumber numberWithUnsignedLongLong: _hits], @"hits",
+                                [NSNumber numberWithUnsignedLongLong: _misses], @"misses",
+                                [NSNumber numberWithUnsignedLongLong: _collisions], @"collisions",
+                                [NSNumber numberWithUnsignedLongLong: _evictions], @"evictions",
+                                [NSNumber numberWithUnsignedLong: _bytes], @"bytes",
+                                [NSNumber numberWithUnsignedLong: _byteLimit], @"byteLimit", nil];
+    pthread_mutex_unlock(&_lock);
+
+    return statistics;
+}
+
+- (void)resetStatistics {
+    pthread_mutex_lock(&_lock);
+
+    _hits = 0;
+    _misses = 0;
+    _collisions = 0;
+    _evictions = 0;
+
+    pthread_mutex_unlock(&_lock);
+}
+
+- (void)dealloc {
+    [self removeAllObjects];
+
+    CFRelease(_entries);
+    pthread_mutex_destroy(&_lock);
+    [_name release];
+
+    [super dealloc];
+}
+
+@end
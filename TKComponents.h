@@ -0,0 +1,22 @@
+//
+//  TKComponents.h
+//  ThemeEngine
+//
+//  Components of a theme - descriptions defined once under "defs" in the outermost view and used anywhere
+//  below it with {"use": "name"}. Every other key of the using description overrides the definition, nested
+//  dictionaries are merged key by key (so a button can change the title of a single state), everything else
+//  (arrays included) is replaced. An override of null removes the key. Definitions can use other definitions
+//
+//  Components are expanded once, when the theme is loaded, the rest of the engine only sees the expanded
+//  descriptions. The parts of a definition that an instance does not override are the same objects in every
+//  instance, so they are hashed once and share the compiled display lists and rendered images. Views that are
+//  not built yet (see TKJSONBuilder.h) stay that way unless their bytes use a component
+//
+//  Copyright (c) 2012 __MyCompanyName__. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+// The theme with every use of a component expanded and the definitions removed, the theme itself if it has no
+// definitions. Unknown and circular components are logged, what can't be expanded is left without the "use" key
+id TKResolveComponents(id theme);
@@ -0,0 +1,144 @@
+//
+//  TKComponents.m
+//  ThemeEngine
+//
+//  Copyright (c) 2012 __MyCompanyName__. All rights reserved.
+//
+
+#import "TKComponents.h"
+#import "TKConstants.h"
+#import "TKHash.h"
+#import "TKJSONBuilder.h"
+
+typedef struct {
+    NSDictionary *definitions;
+    NSMutableDictionary *expanded;      // Definitions expanded so far, by name
+    NSMutableSet *expanding;            // Names being expanded, a use of one of them is a cycle
+} TKComponentContext;
+
+static id TKComponentsExpandObject(id object, TKComponentContext *context);
+
+static NSDictionary *TKComponentsDefinition(id name, TKComponentContext *context) {
+    NSDictionary *definition = [context->expanded objectForKey: name];
+    if (definition)
+        return definition;
+
+    if ([context->expanding containsObject: name]) {
+        NSLog(@"Error! Component \"%@\" uses itself, it is left out", name);
+        return nil;
+    }
+
+    NSDictionary *source = [context->definitions objectForKey: name];
+    if (![source isKindOfClass: [NSDictionary class]]) {
+        NSLog(@"Error! No definition for the component \"%@\"", name);
+        return nil;
+    }
+
+    [context->expanding addObject: name];
+    definition = TKComponentsExpandObject(source, context);
+    [context->expanding removeObject: name];
+
+    [context->expanded setObject: definition forKey: name];
+    return definition;
+}
+
+// Nested dictionaries are merged, everything else is replaced and null removes the key
+static NSDictionary *TKComponentsMerge(NSDictionary *definition, NSDictionary *overrides) {
+    NSMutableDictionary *merged = [[definition mutableCopy] autorelease];
+
+    for (id key in overrides) {
+        id value = [overrides objectForKey: key];
+        id original = [definition objectForKey: key];
+
+        if (value == [NSNull null]) {
+            [merged removeObjectForKey: key];
+        } else if ([value isKindOfClass: [NSDictionary class]] && [original isKindOfClass: [NSDictionary class]]) {
+            [merged setObject: TKComponentsMerge(original, value) forKey: key];
+        } else {
+            [merged setObject: value forKey: key];
+        }
+    }
+
+    return TKImmutableDescription(merged);
+}
+
+// Returns the object itself when nothing inside of it uses a component, so those parts stay shared
+static id TKComponentsExpandObject(id object, TKComponentContext *context) {
+    if ([object isKindOfClass: [NSArray class]]) {
+        NSMutableArray *expanded = nil;
+        NSUInteger index = 0;
+
+        for (id element in object) {
+            id expandedElement = TKComponentsExpandObject(element, context);
+            if (expandedElement != element && !expanded)
+                expanded = [NSMutableArray arrayWithArray: [object subarrayWithRange: NSMakeRange(0, index)]];
+
+            [expanded addObject: expandedElement];
+            index++;
+        }
+
+        return expanded ? TKImmutableDescription(expanded) : object;
+    }
+
+    if (![object isKindOfClass: [NSDictionary class]])
+        return object;
+
+    // Views deep in the theme are only built once something inside of them is used, see TKJSONBuilder.h
+    if (!TKJSONObjectMayContainKey(object, UseParameterKey))
+        return object;
+
+    // The overrides can use components as well
+    NSMutableDictionary *expanded = nil;
+    for (id key in object) {
+        id value = [object objectForKey: key];
+        id expandedValue = TKComponentsExpandObject(value, context);
+
+        if (expandedValue != value) {
+            if (!expanded)
+                expanded = [[object mutableCopy] autorelease];
+
+            [expanded setObject: expandedValue forKey: key];
+        }
+    }
+
+    id name = [object objectForKey: UseParameterKey];
+    if (!name)
+        return expanded ? TKImmutableDescription(expanded) : object;
+
+    NSMutableDictionary *overrides = expanded ? expanded : [[object mutableCopy] autorelease];
+    [overrides removeObjectForKey: UseParameterKey];
+
+    NSDictionary *definition = TKComponentsDefinition(name, context);
+    if (!definition)
+        return TKImmutableDescription(overrides);
+
+    // Instances without overrides are the definition itself
+    if ([overrides count] == 0)
+        return definition;
+
+    return TKComponentsMerge(definition, overrides);
+}
+
+id TKResolveComponents(id theme) {
+    if (![theme isKindOfClass: [NSDictionary class]])
+        return theme;
+
+    NSDictionary *definitions = [theme objectForKey: DefinitionsSectionKey];
+    if (!definitions)
+        return theme;
+
+    if (![definitions isKindOfClass: [NSDictionary class]]) {
+        NSLog(@"Error! Components should be a dictionary of the descriptions by their names");
+        definitions = [NSDictionary dictionary];
+    }
+
+    TKComponentContext context;
+    context.definitions = definitions;
+    context.expanded = [NSMutableDictionary dictionaryWithCapacity: [definitions count]];
+    context.expanding = [NSMutableSet set];
+
+    NSMutableDictionary *body = [[theme mutableCopy] autorelease];
+    [body removeObjectForKey: DefinitionsSectionKey];
+
+    return TKComponentsExpandObject(TKImmutableDescription(body), &context);
+}
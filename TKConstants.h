@@ -12,6 +12,8 @@
 
 // Main parts of the JSON
 static NSString *const SubviewSectionKey = @"subviews";
+static NSString *const DefinitionsSectionKey = @"defs";     // Components, only in the outermost view (see TKComponents.h)
+static NSString *const UseParameterKey = @"use";            // Name of the component the description is an instance of
 
 // Type keys, distinction between primitive shapes
 static NSString *const TypeParameterKey = @"type";
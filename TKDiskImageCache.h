@@ -0,0 +1,69 @@
+//
+//  TKDiskImageCache.h
+//  ThemeEngine
+//
+//  Persistent tier under the in-memory image cache, survives memory warnings, -flushCache and
+//  relaunches. Images are stored as raw premultiplied bitmaps, which are mapped straight back into
+//  memory - there is no PNG to decode when loading
+//
+//  Files are named by the structural hash of the description, the scale and kRenderVersion. Since the
+//  hash covers the whole description (the size included), a changed description is simply a new file
+//
+//  Layout (little-endian):
+//
+//  Header          magic "TKIM", uint32 version (kRenderVersion), uint64 check (second lane of the hash),
+//                  uint32 width, uint32 height, uint32 bytes per row, uint32 bitmap info, float scale,
+//                  padded to 64 bytes
+//  Pixels          height * bytes per row, 32-bit BGRA premultiplied
+//
+//  Writes go into a temporary file which is then renamed, so a crash never leaves a partial image behind.
+//  Once the files take more than byteLimit, the least recently used ones are removed
+//
+//  Copyright (c) 2012 __MyCompanyName__. All rights reserved.
+//
+
+#import <UIKit/UIKit.h>
+#import "TKHash.h"
+
+// Bump whenever the drawing changes in a way that changes the images, all images on disk are then ignored
+#define kRenderVersion 1
+
+// File extension of the stored images
+static NSString *const TKDiskImagePathExtension = @"tkimage";
+
+@interface TKDiskImageCache : NSObject {
+    NSString *_directory;
+    unsigned long long _byteLimit;
+
+    // Writes, touches and trimming happen one after another, off the calling thread
+    dispatch_queue_t _queue;
+    unsigned long long _bytes;          // Only touched on the queue, valid once _measured is set
+    BOOL _measured;
+
+    volatile int64_t _hits;
+    volatile int64_t _misses;
+    volatile int64_t _writes;
+    volatile int64_t _evictions;
+}
+
+// Caches/ThemeKit in the sandbox of the app
++ (NSString *)defaultDirectory;
+
+// The directory is created if needed, a byteLimit of 0 means no limit
+- (id)initWithDirectory: (NSString *)directory byteLimit: (unsigned long long)byteLimit;
+
+@property (nonatomic, readonly) NSString *directory;
+@property (nonatomic) unsigned long long byteLimit;
+
+// Maps the stored image, nil if there is none (or it is from a different kRenderVersion). Thread-safe
+- (UIImage *)imageForHash: (TKStructuralHash)hash scale: (CGFloat)scale;
+
+// Stores the image asynchronously, converted into the stored format if needed. Thread-safe
+- (void)setImage: (UIImage *)image forHash: (TKStructuralHash)hash;
+
+- (void)removeAllImages;
+
+// Hits, misses, writes, evictions and the bytes on disk as NSNumbers
+- (NSDictionary *)statistics;
+
+@end
@@ -0,0 +1,283 @@
+//
+//  TKDiskImageCache.m
+//  ThemeEngine
+//
+//  Copyright (c) 2012 __MyCompanyName__. All rights reserved.
+//
+
+#import "TKDiskImageCache.h"
+#import "TKResourcePool.h"
+
+#import <libkern/OSAtomic.h>
+#import <sys/stat.h>
+#import <sys/time.h>
+
+#pragma mark - File format
+
+static const char TKDiskImageMagic[4] = { 'T', 'K', 'I', 'M' };
+
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    uint64_t check;
+    uint32_t width;
+    uint32_t height;
+    uint32_t bytesPerRow;
+    uint32_t bitmapInfo;
+    float scale;
+    uint8_t reserved[28];           // Keeps the pixels 64 byte aligned
+} TKDiskImageHeader;
+
+// Same format the renderer draws in, so its images can be copied without converting the pixels
+static const CGBitmapInfo TKDiskImageBitmapInfo = kCGImageAlphaPremultipliedFirst | kCGBitmapByteOrder32Little;
+
+static void TKDiskImageReleaseData(void *info, const void *data, size_t size) {
+    [(NSData *)info release];
+}
+
+@interface TKDiskImageCache (Private)
+
+- (NSString *)pathForHash: (TKStructuralHash)hash scale: (CGFloat)scale;
+- (void)measure;
+- (void)trimToByteLimit;
+
+@end
+
+@implementation TKDiskImageCache
+@synthesize directory = _directory;
+@synthesize byteLimit = _byteLimit;
+
++ (NSString *)defaultDirectory {
+    NSString *caches = [NSSearchPathForDirectoriesInDomains(NSCachesDirectory, NSUserDomainMask, YES) objectAtIndex: 0];
+    return [caches stringByAppendingPathComponent: @"ThemeKit"];
+}
+
+- (id)initWithDirectory: (NSString *)directory byteLimit: (unsigned long long)byteLimit {
+    if ((self = [super init])) {
+        _directory = [directory copy];
+        _byteLimit = byteLimit;
+        _queue = dispatch_queue_create("ThemeKit.DiskImageCache", NULL);
+
+        NSError *error = nil;
+        if (![[NSFileManager defaultManager] createDirectoryAtPath: _directory withIntermediateDirectories: YES attributes: nil error: &error])
+            NSLog(@"Failed to create the image cache directory %@: %@", _directory, [error description]);
+
+        // Find out how much is already there, off the calling thread
+        dispatch_async(_queue, ^{
+            [self measure];
+            [self trimToByteLimit];
+        });
+    }
+
+    return self;
+}
+
+- (void)setByteLimit: (unsigned long long)byteLimit {
+    dispatch_async(_queue, ^{
+        _byteLimit = byteLimit;
+        [self trimToByteLimit];
+    });
+}
+
+- (NSString *)pathForHash: (TKStructuralHash)hash scale: (CGFloat)scale {
+    NSString *name = [NSString stringWithFormat: @"%016llx@%gx-v%d", hash.value, (double)scale, kRenderVersion];
+    return [_directory stringByAppendingPathComponent: [name stringByAppendingPathExtension: TKDiskImagePathExtension]];
+}
+
+#pragma mark - Access
+
+- (UIImage *)imageForHash: (TKStructuralHash)hash scale: (CGFloat)scale {
+    NSString *path = [self pathForHash: hash scale: scale];
+
+    // Mapped, the pixels are only paged in once the image is drawn
+    NSData *data = [[NSData alloc] initWithContentsOfFile: path options: NSDataReadingMapped error: NULL];
+    if (!data) {
+        OSAtomicIncrement64Barrier(&_misses);
+        return nil;
+    }
+
+    const TKDiskImageHeader *header = (const TKDiskImageHeader *)[data bytes];
+    size_t length = [data length];
+
+    BOOL valid = length >= sizeof(TKDiskImageHeader) && memcmp(header->magic, TKDiskImageMagic, 4) == 0 &&
+                 header->version == kRenderVersion && header->check == hash.check && header->scale == (float)scale &&
+                 header->bytesPerRow >= header->width * 4 &&
+                 length - sizeof(TKDiskImageHeader) >= (size_t)header->height * header->bytesPerRow;
+
+    if (!valid) {
+        // A collision or a damaged file, either way it has to be rendered again
+        [data release];
+        OSAtomicIncrement64Barrier(&_misses);
+        return nil;
+    }
+
+    // The provider takes over the data, it is released along with the image
+    CGDataProviderRef provider = CGDataProviderCreateWithData(data, (const uint8_t *)[data bytes] + sizeof(TKDiskImageHeader),
+                                                              (size_t)header->height * header->bytesPerRow, TKDiskImageReleaseData);
+    CGImageRef imageRef = CGImageCreate(header->width, header->height, 8, 32, header->bytesPerRow, [[TKResourcePool sharedPool] colorSpace],
+                                        header->bitmapInfo, provider, NULL, false, kCGRenderingIntentDefault);
+    CGDataProviderRelease(provider);
+
+    if (!imageRef) {
+        OSAtomicIncrement64Barrier(&_misses);
+        return nil;
+    }
+
+    UIImage *image = [UIImage imageWithCGImage: imageRef scale: scale orientation: UIImageOrientationUp];
+    CGImageRelease(imageRef);
+
+    OSAtomicIncrement64Barrier(&_hits);
+
+    // The modification date doubles as the last access, for the LRU
+    dispatch_async(_queue, ^{
+        utimes([path fileSystemRepresentation], NULL);
+    });
+
+    return image;
+}
+
+- (void)setImage: (UIImage *)image forHash: (TKStructuralHash)hash {
+    if (![image CGImage])
+        return;
+
+    CGFloat scale = [image scale];
+    NSString *path = [self pathForHash: hash scale: scale];
+
+    // The image is retained by the block
+    dispatch_async(_queue, ^{
+        CGImageRef imageRef = [image CGImage];
+        size_t width = CGImageGetWidth(imageRef);
+        size_t height = CGImageGetHeight(imageRef);
+        size_t bytesPerRow = width * 4;
+
+        NSMutableData *data = [[NSMutableData alloc] initWithLength: sizeof(TKDiskImageHeader) + bytesPerRow * height];
+        TKDiskImageHeader *header = (TKDiskImageHeader *)[data mutableBytes];
+
+        memcpy(header->magic, TKDiskImageMagic, 4);
+        header->version = kRenderVersion;
+        header->check = hash.check;
+        header->width = (uint32_t)width;
+        header->height = (uint32_t)height;
+        header->bytesPerRow = (uint32_t)bytesPerRow;
+        header->bitmapInfo = TKDiskImageBitmapInfo;
+        header->scale = (float)scale;
+
+        // Draw into the stored format, whatever the format of the image
+        CGContextRef context = CGBitmapContextCreate((uint8_t *)[data mutableBytes] + sizeof(TKDiskImageHeader), width, height, 8, bytesPerRow,
+                                                     [[TKResourcePool sharedPool] colorSpace], TKDiskImageBitmapInfo);
+        if (!context) {
+            [data release];
+            return;
+        }
+
+        CGContextSetBlendMode(context, kCGBlendModeCopy);
+        CGContextDrawImage(context, CGRectMake(0.0, 0.0, width, height), imageRef);
+        CGContextRelease(context);
+
+        // Written into a temporary file and renamed over the final one, which no longer counts
+        struct stat previous;
+        unsigned long long replaced = stat([path fileSystemRepresentation], &previous) == 0 ? (unsigned long long)previous.st_size : 0;
+
+        NSError *error = nil;
+        if ([data writeToFile: path options: NSDataWritingAtomic error: &error]) {
+            OSAtomicIncrement64Barrier(&_writes);
+            _bytes = (_bytes > replaced ? _bytes - replaced : 0) + [data length];
+            [self trimToByteLimit];
+        } else {
+            NSLog(@"Failed to write the cached image %@: %@", path, [error description]);
+        }
+
+        [data release];
+    });
+}
+
+- (void)removeAllImages {
+    dispatch_async(_queue, ^{
+        NSFileManager *manager = [NSFileManager defaultManager];
+
+        for (NSString *file in [manager contentsOfDirectoryAtPath: _directory error: NULL]) {
+            if ([[file pathExtension] isEqualToString: TKDiskImagePathExtension])
+                [manager removeItemAtPath: [_directory stringByAppendingPathComponent: file] error: NULL];
+        }
+
+        _bytes = 0;
+    });
+}
+
+#pragma mark - Trimming
+
+- (void)measure {
+    NSFileManager *manager = [NSFileManager defaultManager];
+    unsigned long long bytes = 0;
+
+    for (NSString *file in [manager contentsOfDirectoryAtPath: _directory error: NULL]) {
+        if ([[file pathExtension] isEqualToString: TKDiskImagePathExtension])
+            bytes += [[manager attributesOfItemAtPath: [_directory stringByAppendingPathComponent: file] error: NULL] fileSize];
+    }
+
+    _bytes = bytes;
+    _measured = YES;
+}
+
+- (void)trimToByteLimit {
+    if (_byteLimit == 0 || !_measured || _bytes <= _byteLimit)
+        return;
+
+    NSFileManager *manager = [NSFileManager defaultManager];
+    NSMutableArray *files = [NSMutableArray array];
+
+    for (NSString *file in [manager contentsOfDirectoryAtPath: _directory error: NULL]) {
+        if (![[file pathExtension] isEqualToString: TKDiskImagePathExtension])
+            continue;
+
+        NSString *path = [_directory stringByAppendingPathComponent: file];
+        NSDictionary *attributes = [manager attributesOfItemAtPath: path error: NULL];
+        if (attributes)
+            [files addObject: [NSDictionary dictionaryWithObjectsAndKeys: path, @"path", attributes, @"attributes", nil]];
+    }
+
+    // Least recently used first
+    [files sortUsingComparator: ^NSComparisonResult(NSDictionary *first, NSDictionary *second) {
+        return [[[first objectForKey: @"attributes"] fileModificationDate] compare: [[second objectForKey: @"attributes"] fileModificationDate]];
+    }];
+
+    // Trim down to 3/4 of the limit, so that the next few writes do not start this all over again
+    unsigned long long target = _byteLimit / 4 * 3;
+    for (NSDictionary *file in files) {
+        if (_bytes <= target)
+            break;
+
+        if ([manager removeItemAtPath: [file objectForKey: @"path"] error: NULL]) {
+            unsigned long long size = [[file objectForKey: @"attributes"] fileSize];
+            _bytes = _bytes > size ? _bytes - size : 0;
+            OSAtomicIncrement64Barrier(&_evictions);
+        }
+    }
+}
+
+#pragma mark - Statistics
+
+- (NSDictionary *)statistics {
+    __block unsigned long long bytes = 0;
+    dispatch_sync(_queue, ^{
+        bytes = _bytes;
+    });
+
+    return [NSDictionary dictionaryWithObjectsAndKeys:
+            [NSNumber numberWithLongLong: _hits], @"hits",
+            [NSNumber numberWithLongLong: _misses], @"misses",
+            [NSNumber numberWithLongLong: _writes], @"writes",
+            [NSNumber numberWithLongLong: _evictions], @"evictions",
+            [NSNumber numberWithUnsignedLongLong: bytes], @"bytes", nil];
+}
+
+#pragma mark - Memory management
+
+- (void)dealloc {
+    dispatch_release(_queue);
+    [_directory release];
+
+    [super dealloc];
+}
+
+@end
@@ -0,0 +1,134 @@
+//
+//  TKDisplayList.h
+//  ThemeEngine
+//
+//  Compiled form of the primitive descriptions. Every option of a rectangle, ellipse or path
+//  is resolved once (numbers unboxed, colors and gradients created, blend modes looked up)
+//  and stored in a flat array of plain structs, which is then replayed in -drawRect:
+//  without touching the NSDictionary again
+//
+//  Copyright (c) 2012 __MyCompanyName__. All rights reserved.
+//
+
+#import <UIKit/UIKit.h>
+#import <QuartzCore/QuartzCore.h>
+#import "TKRasterizer.h"
+
+#pragma mark - Display items
+
+// Primitive shapes that can be replayed
+typedef enum { TKDisplayItemRectangle,
+               TKDisplayItemEllipse,
+               TKDisplayItemPath } TKDisplayItemType;
+
+// Which parts of an item are present, absent parts leave the context untouched
+// (mirroring how a missing key in the description was simply skipped)
+enum {
+    TKDisplayItemHasAlpha       = 1 << 0,
+    TKDisplayItemHasBlendMode   = 1 << 1,
+    TKDisplayItemIsRounded      = 1 << 2,
+    TKDisplayItemHasDropShadow  = 1 << 3,
+    TKDisplayItemHasInnerShadow = 1 << 4,
+    TKDisplayItemHasGradient    = 1 << 5,
+    TKDisplayItemHasOuterStroke = 1 << 6,
+    TKDisplayItemHasInnerStroke = 1 << 7
+};
+typedef uint16_t TKDisplayItemFlags;
+
+// Same for the sub-options (shadows, strokes and gradients)
+enum {
+    TKDisplayOptionHasAlpha     = 1 << 0,
+    TKDisplayOptionHasBlendMode = 1 << 1,
+    TKDisplayOptionHasColor     = 1 << 2
+};
+typedef uint8_t TKDisplayOptionFlags;
+
+typedef struct {
+    TKDisplayOptionFlags flags;
+    CGBlendMode blendMode;
+    CGSize offset;
+    CGFloat blur;
+    CGColorRef color;           // Final color, alpha of the shadow already applied
+} TKDisplayShadow;
+
+typedef struct {
+    TKDisplayOptionFlags flags;
+    CGBlendMode blendMode;
+    CGFloat alpha;
+    CGFloat width;
+    CGColorRef color;           // Defaults to black, except for the inner stroke of a path
+} TKDisplayStroke;
+
+typedef struct {
+    TKDisplayOptionFlags flags;
+    CGBlendMode blendMode;
+    CGFloat alpha;
+    CGGradientRef gradient;
+    NSArray *colors;            // Web colors and locations the gradient was created from, for the rasterizer
+    NSArray *locations;
+} TKDisplayGradient;
+
+typedef struct {
+    TKDisplayItemType type;
+    TKDisplayItemFlags flags;
+
+    // Geometry, canvasRect is the frame of the view drawing the item (shadows and strokes included)
+    // origin is where the shape itself starts within that canvas
+    CGRect canvasRect;
+    CGPoint origin;
+    CGSize sizeOffset;
+    CGRect bounds;              // Everything the item draws (shadows and strokes included) within the canvas
+    CGFloat radii[4];           // Unbalanced, the order is the same as in TKBalanceCornerRadiiIntoSize
+    CGPathRef path;             // Only for paths, already translated into the canvas
+    struct TKPathGeometryCache *geometry;       // Only for paths, the path fitted into the sizes it was drawn at (see TKPathGeometry.h)
+
+    // Main fill
+    CGFloat alpha;
+    CGBlendMode blendMode;
+    CGColorRef fillColor;
+
+    TKDisplayShadow dropShadow;
+    TKDisplayShadow innerShadow;
+    TKDisplayGradient gradient;
+    TKDisplayStroke outerStroke;
+    TKDisplayStroke innerStroke;
+} TKDisplayItem;
+
+#pragma mark - Display list
+
+@interface TKDisplayList : NSObject {
+    TKDisplayItem *_items;
+    NSUInteger _count;
+    NSUInteger _capacity;
+}
+
+@property (nonatomic, readonly) NSUInteger count;
+@property (nonatomic, readonly) const TKDisplayItem *items;
+
+// Union of the canvas rects of all items, for a single primitive this is the frame for its view
+@property (nonatomic, readonly) CGRect frame;
+
+// Frame of the view drawing the list compiled from description. Lists are compiled at the origin so that they can be
+// shared, this moves the frame to where the description places it - by its origin, for paths the canvas goes there
+- (CGRect)frameForDescription: (NSDictionary *)description;
+
+// Compilers, each lowers one primitive description into an item at the end of the list
+- (void)addRectangleInFrame: (CGRect)frame options: (NSDictionary *)options;
+- (void)addEllipseInFrame: (CGRect)frame options: (NSDictionary *)options;
+- (void)addPath: (CGPathRef)path options: (NSDictionary *)options;
+
+// Replay, rect is the rect the items are sized to (the bounds of the view)
+- (void)drawInContext: (CGContextRef)context rect: (CGRect)rect;
+
+// Same, but only for the items that reach into dirtyRect (the rect passed into -drawRect:), the rest are skipped
+- (void)drawInContext: (CGContextRef)context rect: (CGRect)rect dirtyRect: (CGRect)dirtyRect;
+
+// Replay into a bitmap context created with CGBitmapContextCreate, which was flipped and scaled
+// by hand to match UIKit. Shadows are not affected by the CTM, so they are converted here
+- (void)drawInBitmapContext: (CGContextRef)context rect: (CGRect)rect scale: (CGFloat)scale;
+
+// Replay into the software rasterizer (see TKRasterizer.h), scaled by scale with the y axis down like UIKit. The
+// same items and options, except that the rasterizer draws the shadows instead of the masks. NO if memory ran out
+- (BOOL)drawInRasterContext: (TKRasterContext *)context rect: (CGRect)rect scale: (CGFloat)scale;
+
+@end
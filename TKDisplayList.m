@@ -0,0 +1,1034 @@
+//
+//  TKDisplayList.m
+//  ThemeEngine
+//
+//  Copyright (c) 2012 __MyCompanyName__. All rights reserved.
+//
+
+#import "TKDisplayList.h"
+#import "TKHelpers.h"
+#import "TKConstants.h"
+#import "TKResourcePool.h"
+#import "TKShadow.h"
+#import "TKPathGeometry.h"
+#import "TKInstrumentation.h"
+
+#pragma mark - Compiling
+
+static void TKDisplayShadowCompile(TKDisplayShadow *shadow, NSDictionary *options, BOOL defaultAlpha) {
+    NSDictionary *offset = [options objectForKey: OffsetParameterKey];
+    shadow->offset = CGSizeMake([[offset objectForKey: XCoordinateParameterKey] floatValue], [[offset objectForKey: YCoordinateParameterKey] floatValue]);
+    shadow->blur = [[options objectForKey: BlurParameterKey] floatValue];
+
+    // Black, unless a color is given
+    CGFloat components[4] = { 0.0, 0.0, 0.0, 1.0 };
+    if ([options objectForKey: ColorParameterKey])
+        TKWebColorGetComponents([options objectForKey: ColorParameterKey], components);
+
+    // Drop shadows always force the alpha (defaulting to 1.0), inner shadows only when it is given
+    if ([options objectForKey: AlphaParameterKey])
+        components[3] = [[options objectForKey: AlphaParameterKey] floatValue];
+    else if (defaultAlpha)
+        components[3] = 1.0;
+
+    shadow->color = CGColorRetain([[TKResourcePool sharedPool] colorWithRed: components[0] green: components[1] blue: components[2] alpha: components[3]]);
+
+    if ([options objectForKey: BlendModeParameterKey]) {
+        shadow->flags |= TKDisplayOptionHasBlendMode;
+        shadow->blendMode = TKBlendModeForString([options objectForKey: BlendModeParameterKey]);
+    }
+}
+
+static void TKDisplayStrokeCompile(TKDisplayStroke *stroke, NSDictionary *options) {
+    stroke->width = [[options objectForKey: WidthParameterKey] floatValue];
+
+    if ([options objectForKey: AlphaParameterKey]) {
+        stroke->flags |= TKDisplayOptionHasAlpha;
+        stroke->alpha = [[options objectForKey: AlphaParameterKey] floatValue];
+    }
+
+    if ([options objectForKey: BlendModeParameterKey]) {
+        stroke->flags |= TKDisplayOptionHasBlendMode;
+        stroke->blendMode = TKBlendModeForString([options objectForKey: BlendModeParameterKey]);
+    }
+
+    TKResourcePool *pool = [TKResourcePool sharedPool];
+    if ([options objectForKey: ColorParameterKey]) {
+        stroke->flags |= TKDisplayOptionHasColor;
+        stroke->color = CGColorRetain([pool colorForWebColor: [options objectForKey: ColorParameterKey]]);
+    } else {
+        stroke->color = CGColorRetain([pool colorWithRed: 0.0 green: 0.0 blue: 0.0 alpha: 1.0]);
+    }
+}
+
+static void TKDisplayGradientCompile(TKDisplayGradient *gradient, NSDictionary *options) {
+    if ([options objectForKey: AlphaParameterKey]) {
+        gradient->flags |= TKDisplayOptionHasAlpha;
+        gradient->alpha = [[options objectForKey: AlphaParameterKey] floatValue];
+    }
+
+    if ([options objectForKey: BlendModeParameterKey]) {
+        gradient->flags |= TKDisplayOptionHasBlendMode;
+        gradient->blendMode = TKBlendModeForString([options objectForKey: BlendModeParameterKey]);
+    }
+
+    // Shared with every other gradient of the same colors and locations
+    gradient->colors = [[options objectForKey: GradientColorsParameterKey] retain];
+    gradient->locations = [[options objectForKey: GradientPositionsParameterKey] retain];
+    gradient->gradient = CGGradientRetain([[TKResourcePool sharedPool] gradientWithColors: [options objectForKey: GradientColorsParameterKey]
+                                                                                locations: [options objectForKey: GradientPositionsParameterKey]]);
+}
+
+static void TKDisplayItemCompileCommon(TKDisplayItem *item, NSDictionary *options) {
+    if ([options objectForKey: AlphaParameterKey]) {
+        item->flags |= TKDisplayItemHasAlpha;
+        item->alpha = [[options objectForKey: AlphaParameterKey] floatValue];
+    }
+
+    if ([options objectForKey: BlendModeParameterKey]) {
+        item->flags |= TKDisplayItemHasBlendMode;
+        item->blendMode = TKBlendModeForString([options objectForKey: BlendModeParameterKey]);
+    }
+
+    TKResourcePool *pool = [TKResourcePool sharedPool];
+    if ([options objectForKey: ColorParameterKey])
+        item->fillColor = CGColorRetain([pool colorForWebColor: [options objectForKey: ColorParameterKey]]);
+    else
+        item->fillColor = CGColorRetain([pool colorWithRed: 1.0 green: 1.0 blue: 1.0 alpha: 1.0]);
+
+    if ([options objectForKey: DropShadowOptionKey]) {
+        item->flags |= TKDisplayItemHasDropShadow;
+        TKDisplayShadowCompile(&item->dropShadow, [options objectForKey: DropShadowOptionKey], YES);
+    }
+
+    if ([options objectForKey: InnerShadowOptionKey]) {
+        item->flags |= TKDisplayItemHasInnerShadow;
+        TKDisplayShadowCompile(&item->innerShadow, [options objectForKey: InnerShadowOptionKey], NO);
+    }
+
+    if ([options objectForKey: GradientFillOptionKey]) {
+        item->flags |= TKDisplayItemHasGradient;
+        TKDisplayGradientCompile(&item->gradient, [options objectForKey: GradientFillOptionKey]);
+    }
+
+    if ([options objectForKey: OuterStrokeOptionKey]) {
+        item->flags |= TKDisplayItemHasOuterStroke;
+        TKDisplayStrokeCompile(&item->outerStroke, [options objectForKey: OuterStrokeOptionKey]);
+    }
+
+    if ([options objectForKey: InnerStrokeOptionKey]) {
+        item->flags |= TKDisplayItemHasInnerStroke;
+        TKDisplayStrokeCompile(&item->innerStroke, [options objectForKey: InnerStrokeOptionKey]);
+    }
+}
+
+// Canvas needed for the shape in the given frame, including the outer stroke and drop shadow
+static CGRect TKCanvasRectForFrameAndOptions(CGRect frame, NSDictionary *options) {
+    CGRect canvasRect = frame;
+
+    if ([options objectForKey: OuterStrokeOptionKey]) {
+        CGFloat strokeWidth = [[[options objectForKey: OuterStrokeOptionKey] objectForKey: WidthParameterKey] floatValue];
+        canvasRect = CGRectUnion(canvasRect, TKStrokeRectForRectAndWidth(frame, strokeWidth));
+    }
+
+    if ([options objectForKey: DropShadowOptionKey]) {
+        canvasRect = CGRectUnion(canvasRect, TKShadowRectForRectAndOptions(frame, [options objectForKey: DropShadowOptionKey]));
+    }
+
+    return canvasRect;
+}
+
+// Bounds of the item when drawn into rect, they grow and shrink along with the shape. Paths are only ever
+// scaled down, so the compiled bounds are kept as well, which makes this an upper bound for every shape
+static CGRect TKDisplayItemBoundsInRect(const TKDisplayItem *item, CGRect rect) {
+    CGRect bounds = item->bounds;
+    bounds.size.width = MAX(0.0, bounds.size.width + rect.size.width - item->canvasRect.size.width);
+    bounds.size.height = MAX(0.0, bounds.size.height + rect.size.height - item->canvasRect.size.height);
+
+    return CGRectUnion(bounds, item->bounds);
+}
+
+static void TKDisplayItemRelease(TKDisplayItem *item) {
+    CGPathRelease(item->path);
+    TKPathGeometryCacheFree(item->geometry);
+    CGColorRelease(item->fillColor);
+    CGColorRelease(item->dropShadow.color);
+    CGColorRelease(item->innerShadow.color);
+    CGGradientRelease(item->gradient.gradient);
+    [item->gradient.colors release];
+    [item->gradient.locations release];
+    CGColorRelease(item->outerStroke.color);
+    CGColorRelease(item->innerStroke.color);
+}
+
+#pragma mark - Replaying
+
+// Adds the outline of the shape to the context, shapePath is the outline of paths and rounded rectangles
+static void TKContextAddItemShape(CGContextRef context, const TKDisplayItem *item, CGRect shapeRect, CGPathRef shapePath) {
+    switch (item->type) {
+        case TKDisplayItemRectangle:
+            if (shapePath)
+                CGContextAddPath(context, shapePath);
+            else
+                CGContextAddRect(context, shapeRect);
+            break;
+        case TKDisplayItemEllipse:
+            CGContextAddPath(context, [[TKResourcePool sharedPool] ellipsePathInRect: shapeRect]);
+            break;
+        case TKDisplayItemPath:
+            CGContextAddPath(context, shapePath);
+            break;
+        default:
+            break;
+    }
+}
+
+static void TKContextStrokePathWithStroke(CGContextRef context, const TKDisplayStroke *stroke) {
+    if (stroke->flags & TKDisplayOptionHasBlendMode)
+        CGContextSetBlendMode(context, stroke->blendMode);
+
+    if (stroke->flags & TKDisplayOptionHasAlpha)
+        CGContextSetAlpha(context, stroke->alpha);
+
+    CGContextSetStrokeColorWithColor(context, stroke->color);
+    CGContextSetLineWidth(context, stroke->width);
+    CGContextStrokePath(context);
+}
+
+// Shadows ignore the CTM, shadowSpace converts their offset and blur from points into the base space
+// of the context - (1, 1) for UIKit contexts, (scale, -scale) for bitmaps flipped by hand
+static void TKContextSetShadow(CGContextRef context, const TKDisplayShadow *shadow, CGSize shadowSpace) {
+    CGSize offset = CGSizeMake(shadow->offset.width * shadowSpace.width, shadow->offset.height * shadowSpace.height);
+    CGContextSetShadowWithColor(context, offset, shadow->blur * fabs(shadowSpace.width), shadow->color);
+}
+
+static void TKContextDrawItemGradient(CGContextRef context, const TKDisplayItem *item, CGRect shapeRect, CGPathRef shapePath) {
+    CGContextSaveGState(context);
+
+    // Clip to the shape
+    if (item->type == TKDisplayItemRectangle && !shapePath) {
+        CGContextClipToRect(context, shapeRect);
+    } else {
+        TKContextAddItemShape(context, item, shapeRect, shapePath);
+        CGContextClip(context);
+    }
+
+    const TKDisplayGradient *gradient = &item->gradient;
+    if (gradient->flags & TKDisplayOptionHasBlendMode)
+        CGContextSetBlendMode(context, gradient->blendMode);
+
+    if (gradient->flags & TKDisplayOptionHasAlpha)
+        CGContextSetAlpha(context, gradient->alpha);
+
+    CGContextDrawLinearGradient(context, gradient->gradient, CGPointMake(item->origin.x, item->origin.y),
+                                CGPointMake(item->origin.x, item->origin.y + shapeRect.size.height), 0);
+
+    CGContextRestoreGState(context);
+}
+
+// Drop shadow of the shape from a cached mask, drawn before the fill. When the mask can't be used, the shadow is
+// set on the context instead and Core Graphics draws it along with the fill
+static void TKContextApplyItemDropShadow(CGContextRef context, const TKDisplayItem *item, const TKShadowShape *shape, CGSize shadowSpace) {
+    const TKDisplayShadow *shadow = &item->dropShadow;
+    TKShadowLayout layout;
+
+    if (!TKShadowLayoutMake(&layout, context, shape, shadow->blur, shadow->offset, NO)) {
+        TKContextSetShadow(context, shadow, shadowSpace);
+        return;
+    }
+
+    // Core Graphics casts the shadow from the alpha of the fill
+    CGColorRef color = shadow->color;
+    CGFloat fillAlpha = CGColorGetAlpha(item->fillColor);
+    if (fillAlpha < 1.0) {
+        const CGFloat *components = CGColorGetComponents(color);
+        color = [[TKResourcePool sharedPool] colorWithRed: components[0] green: components[1] blue: components[2] alpha: components[3] * fillAlpha];
+    }
+
+    CGImageRef mask = [[TKResourcePool sharedPool] shadowMaskForShape: shape layout: &layout];
+    TKContextDrawShadowMask(context, mask, &layout, shape, shadow->offset, color);
+}
+
+static void TKContextDrawItemInnerShadow(CGContextRef context, const TKDisplayItem *item, CGRect shapeRect, CGPathRef shapePath, const TKShadowShape *shape, CGSize shadowSpace) {
+    const TKDisplayShadow *shadow = &item->innerShadow;
+    TKShadowLayout layout;
+
+    // Cached mask of everything around the shape, clipped to the shape
+    if (TKShadowLayoutMake(&layout, context, shape, shadow->blur, shadow->offset, YES)) {
+        CGContextSaveGState(context);
+
+        TKContextAddItemShape(context, item, shapeRect, shapePath);
+        CGContextClip(context);
+
+        if (shadow->flags & TKDisplayOptionHasBlendMode)
+            CGContextSetBlendMode(context, shadow->blendMode);
+
+        CGImageRef mask = [[TKResourcePool sharedPool] shadowMaskForShape: shape layout: &layout];
+        TKContextDrawShadowMask(context, mask, &layout, shape, shadow->offset, shadow->color);
+
+        CGContextRestoreGState(context);
+        return;
+    }
+
+    CGContextSaveGState(context);
+
+    // Start by adding the main path into the context
+    TKContextAddItemShape(context, item, shapeRect, shapePath);
+
+    // Create the inverse path
+    CGPathRef currentPath = CGContextCopyPath(context);
+    CGMutablePathRef inversePath = CGPathCreateMutableCopy(currentPath);
+    CGPathAddRect(inversePath, NULL, CGRectInfinite);
+    CGPathRelease(currentPath);
+
+    // Clip to the main path
+    CGContextClip(context);
+
+    TKContextSetShadow(context, shadow, shadowSpace);
+
+    if (shadow->flags & TKDisplayOptionHasBlendMode)
+        CGContextSetBlendMode(context, shadow->blendMode);
+
+    // Fill the inverse path
+    CGContextAddPath(context, inversePath);
+    CGContextEOFillPath(context);
+    CGPathRelease(inversePath);
+
+    CGContextRestoreGState(context);
+}
+
+static void TKContextDrawRectangleItem(CGContextRef context, const TKDisplayItem *item, CGRect rect, CGSize shadowSpace) {
+    // Adjust the size of the object
+    CGSize size = CGSizeMake(rect.size.width - item->sizeOffset.width, rect.size.height - item->sizeOffset.height);
+    CGRect shapeRect = CGRectMake(item->origin.x, item->origin.y, size.width, size.height);
+
+    // Balance the corners into the current size
+    BOOL rounded = (item->flags & TKDisplayItemIsRounded) != 0;
+    CGFloat radii[4] = { item->radii[0], item->radii[1], item->radii[2], item->radii[3] };
+    CGPathRef roundedPath = NULL;
+    TKResourcePool *pool = [TKResourcePool sharedPool];
+
+    if (rounded) {
+        TKBalanceCornerRadiiIntoSize(radii, size);
+        roundedPath = [pool roundedPathInRect: shapeRect radii: radii];
+    }
+
+    TKShadowShape shadowShape;
+    if (item->flags & (TKDisplayItemHasDropShadow | TKDisplayItemHasInnerShadow))
+        TKShadowShapeInitWithRect(&shadowShape, shapeRect, rounded ? radii : NULL);
+
+    // Main fill
+    CGContextSaveGState(context);
+
+    if (item->flags & TKDisplayItemHasAlpha)
+        CGContextSetAlpha(context, item->alpha);
+
+    if (item->flags & TKDisplayItemHasBlendMode)
+        CGContextSetBlendMode(context, item->blendMode);
+
+    if (item->flags & TKDisplayItemHasDropShadow)
+        TKContextApplyItemDropShadow(context, item, &shadowShape, shadowSpace);
+
+    CGContextSetFillColorWithColor(context, item->fillColor);
+
+    if (rounded) {
+        CGContextAddPath(context, roundedPath);
+        CGContextFillPath(context);
+    } else {
+        CGContextFillRect(context, shapeRect);
+    }
+
+    CGContextRestoreGState(context);
+
+    if (item->flags & TKDisplayItemHasGradient)
+        TKContextDrawItemGradient(context, item, shapeRect, roundedPath);
+
+    if (item->flags & TKDisplayItemHasInnerShadow)
+        TKContextDrawItemInnerShadow(context, item, shapeRect, roundedPath, &shadowShape, shadowSpace);
+
+    // Strokes, both are centered on the edge of the shape adjusted by half the width
+    if (item->flags & TKDisplayItemHasOuterStroke) {
+        CGContextSaveGState(context);
+
+        CGFloat strokeWidth = item->outerStroke.width;
+        CGFloat halfStroke = strokeWidth / 2.0;
+        CGRect strokeRect = CGRectMake(shapeRect.origin.x - halfStroke, shapeRect.origin.y - halfStroke, size.width + strokeWidth, size.height + strokeWidth);
+
+        if (rounded) {
+            CGFloat strokeRadii[4] = { radii[0] + halfStroke, radii[1] + halfStroke, radii[2] + halfStroke, radii[3] + halfStroke };
+            CGContextAddPath(context, [pool roundedPathInRect: strokeRect radii: strokeRadii]);
+        } else {
+            CGContextAddRect(context, strokeRect);
+        }
+
+        TKContextStrokePathWithStroke(context, &item->outerStroke);
+
+        CGContextRestoreGState(context);
+    }
+
+    if (item->flags & TKDisplayItemHasInnerStroke) {
+        CGContextSaveGState(context);
+
+        CGFloat strokeWidth = item->innerStroke.width;
+        CGFloat halfStroke = strokeWidth / 2.0;
+        CGRect strokeRect = CGRectMake(shapeRect.origin.x + halfStroke, shapeRect.origin.y + halfStroke, size.width - strokeWidth, size.height - strokeWidth);
+
+        if (rounded) {
+            CGFloat strokeRadii[4] = { MAX(0.0, radii[0] - halfStroke), MAX(0.0, radii[1] - halfStroke), MAX(0.0, radii[2] - halfStroke), MAX(0.0, radii[3] - halfStroke) };
+            CGContextAddPath(context, [pool roundedPathInRect: strokeRect radii: strokeRadii]);
+        } else {
+            CGContextAddRect(context, strokeRect);
+        }
+
+        TKContextStrokePathWithStroke(context, &item->innerStroke);
+
+        CGContextRestoreGState(context);
+    }
+}
+
+static void TKContextDrawEllipseItem(CGContextRef context, const TKDisplayItem *item, CGRect rect, CGSize shadowSpace) {
+    // Adjust the size of the object
+    CGSize size = CGSizeMake(rect.size.width - item->sizeOffset.width, rect.size.height - item->sizeOffset.height);
+    CGRect shapeRect = CGRectMake(item->origin.x, item->origin.y, size.width, size.height);
+
+    // Unlike the other shapes, the alpha of an ellipse applies to every part of it
+    if (item->flags & TKDisplayItemHasAlpha)
+        CGContextSetAlpha(context, item->alpha);
+
+    TKShadowShape shadowShape;
+    if (item->flags & (TKDisplayItemHasDropShadow | TKDisplayItemHasInnerShadow))
+        TKShadowShapeInitWithEllipse(&shadowShape, shapeRect);
+
+    // Main fill
+    CGContextSaveGState(context);
+
+    if (item->flags & TKDisplayItemHasBlendMode)
+        CGContextSetBlendMode(context, item->blendMode);
+
+    if (item->flags & TKDisplayItemHasDropShadow)
+        TKContextApplyItemDropShadow(context, item, &shadowShape, shadowSpace);
+
+    CGContextSetFillColorWithColor(context, item->fillColor);
+    CGContextFillEllipseInRect(context, shapeRect);
+
+    CGContextRestoreGState(context);
+
+    if (item->flags & TKDisplayItemHasGradient)
+        TKContextDrawItemGradient(context, item, shapeRect, NULL);
+
+    if (item->flags & TKDisplayItemHasInnerShadow)
+        TKContextDrawItemInnerShadow(context, item, shapeRect, NULL, &shadowShape, shadowSpace);
+
+    if (item->flags & TKDisplayItemHasOuterStroke) {
+        CGContextSaveGState(context);
+
+        CGFloat strokeWidth = item->outerStroke.width;
+        CGContextAddEllipseInRect(context, CGRectMake(shapeRect.origin.x - strokeWidth / 2.0, shapeRect.origin.y - strokeWidth / 2.0, size.width + strokeWidth, size.height + strokeWidth));
+        TKContextStrokePathWithStroke(context, &item->outerStroke);
+
+        CGContextRestoreGState(context);
+    }
+
+    if (item->flags & TKDisplayItemHasInnerStroke) {
+        CGContextSaveGState(context);
+
+        CGFloat strokeWidth = item->innerStroke.width;
+        CGContextAddEllipseInRect(context, CGRectMake(shapeRect.origin.x + strokeWidth / 2.0, shapeRect.origin.y + strokeWidth / 2.0, size.width - strokeWidth, size.height - strokeWidth));
+        TKContextStrokePathWithStroke(context, &item->innerStroke);
+
+        CGContextRestoreGState(context);
+    }
+}
+
+static void TKContextDrawPathItem(CGContextRef context, const TKDisplayItem *item, CGRect rect, CGSize shadowSpace) {
+    // Adjust the size of the object
+    CGSize size = CGSizeMake(rect.size.width - item->sizeOffset.width, rect.size.height - item->sizeOffset.height);
+    CGRect shapeRect = CGRectMake(item->origin.x, item->origin.y, size.width, size.height);
+
+    // The path fitted into the rect, along with its stroke and shadow shape, computed once for every size
+    TKPathGeometry geometry;
+    TKPathGeometryCacheGetGeometry(item->geometry, rect.size, &geometry);
+    CGPathRef path = geometry.path;
+
+    // Main fill
+    CGContextSaveGState(context);
+
+    if (item->flags & TKDisplayItemHasAlpha)
+        CGContextSetAlpha(context, item->alpha);
+
+    if (item->flags & TKDisplayItemHasBlendMode)
+        CGContextSetBlendMode(context, item->blendMode);
+
+    // Added after the shadow, drawing its mask would use up the path
+    if (item->flags & TKDisplayItemHasDropShadow)
+        TKContextApplyItemDropShadow(context, item, &geometry.shadowShape, shadowSpace);
+
+    CGContextAddPath(context, path);
+    CGContextSetFillColorWithColor(context, item->fillColor);
+    CGContextFillPath(context);
+
+    CGContextRestoreGState(context);
+
+    if (item->flags & TKDisplayItemHasGradient)
+        TKContextDrawItemGradient(context, item, shapeRect, path);
+
+    if (item->flags & TKDisplayItemHasInnerShadow)
+        TKContextDrawItemInnerShadow(context, item, shapeRect, path, &geometry.shadowShape, shadowSpace);
+
+    // Outer stroke simply strokes the path
+    if (item->flags & TKDisplayItemHasOuterStroke) {
+        CGContextSaveGState(context);
+
+        CGContextAddPath(context, path);
+        TKContextStrokePathWithStroke(context, &item->outerStroke);
+
+        CGContextRestoreGState(context);
+    }
+
+    // Inner stroke is a doubled stroke clipped to the path (iOS 5+ only, there is no outline before that)
+    if ((item->flags & TKDisplayItemHasInnerStroke) && geometry.innerStrokePath) {
+        CGContextSaveGState(context);
+
+        CGContextAddPath(context, path);
+        CGContextClip(context);
+
+        CGContextAddPath(context, geometry.innerStrokePath);
+
+        if (item->innerStroke.flags & TKDisplayOptionHasColor)
+            CGContextSetFillColorWithColor(context, item->innerStroke.color);
+
+        if (item->innerStroke.flags & TKDisplayOptionHasAlpha)
+            CGContextSetAlpha(context, item->innerStroke.alpha);
+
+        CGContextFillPath(context);
+
+        CGContextRestoreGState(context);
+    }
+
+    TKPathGeometryRelease(&geometry);
+}
+
+#pragma mark - Replaying into the rasterizer
+
+static TKRasterColor TKRasterColorForColor(CGColorRef color) {
+    const CGFloat *components = CGColorGetComponents(color);
+
+    // Gray and alpha, or red, green, blue and alpha
+    if (CGColorGetNumberOfComponents(color) == 2) {
+        TKRasterColor gray = { components[0], components[0], components[0], components[1] };
+        return gray;
+    }
+
+    TKRasterColor rgb = { components[0], components[1], components[2], components[3] };
+    return rgb;
+}
+
+static TKRasterBlendMode TKRasterBlendModeForBlendMode(CGBlendMode mode) {
+    switch (mode) {
+        case kCGBlendModeMultiply:
+            return TKRasterBlendMultiply;
+        case kCGBlendModeOverlay:
+            return TKRasterBlendOverlay;
+        case kCGBlendModeSoftLight:
+            return TKRasterBlendSoftLight;
+        default:
+            return TKRasterBlendNormal;
+    }
+}
+
+static void TKRasterPathApplier(void *info, const CGPathElement *element) {
+    TKPathBuffer *buffer = (TKPathBuffer *)info;
+    const CGPoint *points = element->points;
+    double coordinates[6];
+
+    switch (element->type) {
+        case kCGPathElementMoveToPoint:
+        case kCGPathElementAddLineToPoint:
+            coordinates[0] = points[0].x;
+            coordinates[1] = points[0].y;
+            TKPathBufferAppend(buffer, element->type == kCGPathElementMoveToPoint ? TKPathOperationMoveTo : TKPathOperationLineTo, coordinates);
+            break;
+        case kCGPathElementAddQuadCurveToPoint:
+            coordinates[0] = points[0].x;
+            coordinates[1] = points[0].y;
+            coordinates[2] = points[1].x;
+            coordinates[3] = points[1].y;
+            TKPathBufferAppend(buffer, TKPathOperationQuadTo, coordinates);
+            break;
+        case kCGPathElementAddCurveToPoint:
+            for (int i = 0; i < 3; i++) {
+                coordinates[2 * i] = points[i].x;
+                coordinates[2 * i + 1] = points[i].y;
+            }
+            TKPathBufferAppend(buffer, TKPathOperationCubicTo, coordinates);
+            break;
+        case kCGPathElementCloseSubpath:
+            TKPathBufferAppend(buffer, TKPathOperationClose, NULL);
+            break;
+    }
+}
+
+static void TKRasterPathAddPath(TKPathBuffer *buffer, CGPathRef path) {
+    CGPathApply(path, buffer, TKRasterPathApplier);
+}
+
+// Shadows are in pixels of the surface, like the ones of Core Graphics are in the base space
+static void TKRasterSetShadow(TKRasterContext *context, const TKDisplayShadow *shadow, CGFloat scale) {
+    TKRasterContextSetShadow(context, shadow->offset.width * scale, shadow->offset.height * scale, shadow->blur * scale, TKRasterColorForColor(shadow->color));
+}
+
+static bool TKRasterStrokeWithStroke(TKRasterContext *context, const TKPathBuffer *path, const TKDisplayStroke *stroke) {
+    TKRasterContextSaveState(context);
+
+    if (stroke->flags & TKDisplayOptionHasBlendMode)
+        TKRasterContextSetBlendMode(context, TKRasterBlendModeForBlendMode(stroke->blendMode));
+
+    if (stroke->flags & TKDisplayOptionHasAlpha)
+        TKRasterContextSetAlpha(context, stroke->alpha);
+
+    TKRasterContextSetLineWidth(context, stroke->width);
+    bool drawn = TKRasterContextStrokePath(context, path, TKRasterColorForColor(stroke->color));
+
+    TKRasterContextRestoreState(context);
+    return drawn;
+}
+
+// Main fill of the shape, with its drop shadow
+static bool TKRasterFillItemShape(TKRasterContext *context, const TKDisplayItem *item, const TKPathBuffer *shape, CGFloat scale, BOOL itemAlpha) {
+    TKRasterContextSaveState(context);
+
+    if (itemAlpha && (item->flags & TKDisplayItemHasAlpha))
+        TKRasterContextSetAlpha(context, item->alpha);
+
+    if (item->flags & TKDisplayItemHasBlendMode)
+        TKRasterContextSetBlendMode(context, TKRasterBlendModeForBlendMode(item->blendMode));
+
+    if (item->flags & TKDisplayItemHasDropShadow)
+        TKRasterSetShadow(context, &item->dropShadow, scale);
+
+    bool drawn = TKRasterContextFillPath(context, shape, TKRasterFillNonZero, TKRasterColorForColor(item->fillColor));
+
+    TKRasterContextRestoreState(context);
+    return drawn;
+}
+
+static bool TKRasterDrawItemGradient(TKRasterContext *context, const TKDisplayItem *item, const TKPathBuffer *shape, CGRect shapeRect) {
+    const TKDisplayGradient *gradient = &item->gradient;
+
+    // Same colors and positions as -[TKResourcePool gradientWithColors:locations:], missing positions are 0
+    NSUInteger count = MAX([gradient->colors count], [gradient->locations count]);
+    TKRasterColor *colors = (TKRasterColor *)calloc(MAX(count, 1), sizeof(TKRasterColor));
+    float *locations = (float *)calloc(MAX(count, 1), sizeof(float));
+    for (NSUInteger i = 0; i < [gradient->colors count]; i++) {
+        CGFloat components[4];
+        TKWebColorGetComponents([gradient->colors objectAtIndex: i], components);
+        TKRasterColor color = { components[0], components[1], components[2], components[3] };
+        colors[i] = color;
+    }
+    for (NSUInteger i = 0; i < [gradient->locations count]; i++) {
+        locations[i] = [[gradient->locations objectAtIndex: i] floatValue];
+    }
+
+    TKRasterGradient table;
+    TKRasterGradientInit(&table, colors, locations, [gradient->colors count]);
+    free(colors);
+    free(locations);
+
+    TKRasterContextSaveState(context);
+
+    if (gradient->flags & TKDisplayOptionHasBlendMode)
+        TKRasterContextSetBlendMode(context, TKRasterBlendModeForBlendMode(gradient->blendMode));
+
+    if (gradient->flags & TKDisplayOptionHasAlpha)
+        TKRasterContextSetAlpha(context, gradient->alpha);
+
+    bool drawn = TKRasterContextFillPathWithGradient(context, shape, TKRasterFillNonZero, &table, item->origin.x, item->origin.y,
+                                                     item->origin.x, item->origin.y + shapeRect.size.height);
+
+    TKRasterContextRestoreState(context);
+    return drawn;
+}
+
+// Everything around the shape filled with the shadow set, clipped to the shape, like the fallback of Core Graphics
+static bool TKRasterDrawItemInnerShadow(TKRasterContext *context, const TKDisplayItem *item, const TKPathBuffer *shape, CGRect shapeRect, CGFloat scale) {
+    const TKDisplayShadow *shadow = &item->innerShadow;
+    CGFloat reach = MAX(fabs(shadow->offset.width), fabs(shadow->offset.height)) + 2.0 * shadow->blur + 1.0;
+    CGRect around = CGRectInset(shapeRect, -reach, -reach);
+
+    TKPathBuffer inverse;
+    TKPathBufferInit(&inverse);
+    TKRasterPathAddRect(&inverse, around.origin.x, around.origin.y, around.size.width, around.size.height);
+    for (size_t i = 0, coordinate = 0; i < shape->operationCount; coordinate += TKPathOperationCoordinateCount[shape->operations[i]], i++) {
+        TKPathBufferAppend(&inverse, (TKPathOperation)shape->operations[i], shape->coordinates + coordinate);
+    }
+
+    TKRasterContextSaveState(context);
+    bool drawn = TKRasterContextClipToPath(context, shape, TKRasterFillNonZero);
+    TKRasterSetShadow(context, shadow, scale);
+
+    if (shadow->flags & TKDisplayOptionHasBlendMode)
+        TKRasterContextSetBlendMode(context, TKRasterBlendModeForBlendMode(shadow->blendMode));
+
+    TKRasterColor black = { 0.0, 0.0, 0.0, 1.0 };
+    drawn = drawn && TKRasterContextFillPath(context, &inverse, TKRasterFillEvenOdd, black);
+
+    TKRasterContextRestoreState(context);
+    TKPathBufferFree(&inverse);
+    return drawn;
+}
+
+static bool TKRasterDrawRectangleItem(TKRasterContext *context, const TKDisplayItem *item, CGRect rect, CGFloat scale) {
+    CGSize size = CGSizeMake(rect.size.width - item->sizeOffset.width, rect.size.height - item->sizeOffset.height);
+    CGRect shapeRect = CGRectMake(item->origin.x, item->origin.y, size.width, size.height);
+
+    BOOL rounded = (item->flags & TKDisplayItemIsRounded) != 0;
+    CGFloat radii[4] = { item->radii[0], item->radii[1], item->radii[2], item->radii[3] };
+    if (rounded)
+        TKBalanceCornerRadiiIntoSize(radii, size);
+
+    TKPathBuffer shape;
+    TKPathBufferInit(&shape);
+    double shapeRadii[4] = { radii[0], radii[1], radii[2], radii[3] };
+    bool drawn = rounded ? TKRasterPathAddRoundedRect(&shape, shapeRect.origin.x, shapeRect.origin.y, size.width, size.height, shapeRadii) :
+                           TKRasterPathAddRect(&shape, shapeRect.origin.x, shapeRect.origin.y, size.width, size.height);
+
+    drawn = drawn && TKRasterFillItemShape(context, item, &shape, scale, YES);
+
+    if (drawn && (item->flags & TKDisplayItemHasGradient))
+        drawn = TKRasterDrawItemGradient(context, item, &shape, shapeRect);
+
+    if (drawn && (item->flags & TKDisplayItemHasInnerShadow))
+        drawn = TKRasterDrawItemInnerShadow(context, item, &shape, shapeRect, scale);
+
+    // Strokes, both are centered on the edge of the shape adjusted by half the width
+    const TKDisplayStroke *strokes[2] = { &item->outerStroke, &item->innerStroke };
+    const TKDisplayItemFlags strokeFlags[2] = { TKDisplayItemHasOuterStroke, TKDisplayItemHasInnerStroke };
+    for (int i = 0; i < 2 && drawn; i++) {
+        if (!(item->flags & strokeFlags[i]))
+            continue;
+
+        CGFloat halfStroke = (i == 0 ? 1.0 : -1.0) * strokes[i]->width / 2.0;
+        CGRect strokeRect = CGRectInset(shapeRect, -halfStroke, -halfStroke);
+        double strokeRadii[4] = { MAX(0.0, radii[0] + halfStroke), MAX(0.0, radii[1] + halfStroke), MAX(0.0, radii[2] + halfStroke), MAX(0.0, radii[3] + halfStroke) };
+
+        TKPathBufferReset(&shape);
+        drawn = rounded ? TKRasterPathAddRoundedRect(&shape, strokeRect.origin.x, strokeRect.origin.y, strokeRect.size.width, strokeRect.size.height, strokeRadii) :
+                          TKRasterPathAddRect(&shape, strokeRect.origin.x, strokeRect.origin.y, strokeRect.size.width, strokeRect.size.height);
+        drawn = drawn && TKRasterStrokeWithStroke(context, &shape, strokes[i]);
+    }
+
+    TKPathBufferFree(&shape);
+    return drawn;
+}
+
+static bool TKRasterDrawEllipseItem(TKRasterContext *context, const TKDisplayItem *item, CGRect rect, CGFloat scale) {
+    CGSize size = CGSizeMake(rect.size.width - item->sizeOffset.width, rect.size.height - item->sizeOffset.height);
+    CGRect shapeRect = CGRectMake(item->origin.x, item->origin.y, size.width, size.height);
+
+    // Unlike the other shapes, the alpha of an ellipse applies to every part of it
+    if (item->flags & TKDisplayItemHasAlpha)
+        TKRasterContextSetAlpha(context, item->alpha);
+
+    TKPathBuffer shape;
+    TKPathBufferInit(&shape);
+    bool drawn = TKRasterPathAddEllipse(&shape, shapeRect.origin.x, shapeRect.origin.y, size.width, size.height);
+
+    drawn = drawn && TKRasterFillItemShape(context, item, &shape, scale, NO);
+
+    if (drawn && (item->flags & TKDisplayItemHasGradient))
+        drawn = TKRasterDrawItemGradient(context, item, &shape, shapeRect);
+
+    if (drawn && (item->flags & TKDisplayItemHasInnerShadow))
+        drawn = TKRasterDrawItemInnerShadow(context, item, &shape, shapeRect, scale);
+
+    const TKDisplayStroke *strokes[2] = { &item->outerStroke, &item->innerStroke };
+    const TKDisplayItemFlags strokeFlags[2] = { TKDisplayItemHasOuterStroke, TKDisplayItemHasInnerStroke };
+    for (int i = 0; i < 2 && drawn; i++) {
+        if (!(item->flags & strokeFlags[i]))
+            continue;
+
+        CGFloat halfStroke = (i == 0 ? 1.0 : -1.0) * strokes[i]->width / 2.0;
+        CGRect strokeRect = CGRectInset(shapeRect, -halfStroke, -halfStroke);
+
+        TKPathBufferReset(&shape);
+        drawn = TKRasterPathAddEllipse(&shape, strokeRect.origin.x, strokeRect.origin.y, strokeRect.size.width, strokeRect.size.height);
+        drawn = drawn && TKRasterStrokeWithStroke(context, &shape, strokes[i]);
+    }
+
+    TKPathBufferFree(&shape);
+    return drawn;
+}
+
+static bool TKRasterDrawPathItem(TKRasterContext *context, const TKDisplayItem *item, CGRect rect, CGFloat scale) {
+    CGSize size = CGSizeMake(rect.size.width - item->sizeOffset.width, rect.size.height - item->sizeOffset.height);
+    CGRect shapeRect = CGRectMake(item->origin.x, item->origin.y, size.width, size.height);
+
+    // The same fitted path and inner stroke outline Core Graphics draws
+    TKPathGeometry geometry;
+    TKPathGeometryCacheGetGeometry(item->geometry, rect.size, &geometry);
+
+    TKPathBuffer shape;
+    TKPathBufferInit(&shape);
+    TKRasterPathAddPath(&shape, geometry.path);
+
+    bool drawn = TKRasterFillItemShape(context, item, &shape, scale, YES);
+
+    if (drawn && (item->flags & TKDisplayItemHasGradient))
+        drawn = TKRasterDrawItemGradient(context, item, &shape, shapeRect);
+
+    if (drawn && (item->flags & TKDisplayItemHasInnerShadow))
+        drawn = TKRasterDrawItemInnerShadow(context, item, &shape, shapeRect, scale);
+
+    if (drawn && (item->flags & TKDisplayItemHasOuterStroke))
+        drawn = TKRasterStrokeWithStroke(context, &shape, &item->outerStroke);
+
+    // Inner stroke is the outline of the doubled stroke, filled and clipped to the path
+    if (drawn && (item->flags & TKDisplayItemHasInnerStroke) && geometry.innerStrokePath) {
+        TKPathBuffer outline;
+        TKPathBufferInit(&outline);
+        TKRasterPathAddPath(&outline, geometry.innerStrokePath);
+
+        TKRasterContextSaveState(context);
+        drawn = TKRasterContextClipToPath(context, &shape, TKRasterFillNonZero);
+
+        if (item->innerStroke.flags & TKDisplayOptionHasAlpha)
+            TKRasterContextSetAlpha(context, item->innerStroke.alpha);
+
+        drawn = drawn && TKRasterContextFillPath(context, &outline, TKRasterFillNonZero, TKRasterColorForColor(item->innerStroke.color));
+
+        TKRasterContextRestoreState(context);
+        TKPathBufferFree(&outline);
+    }
+
+    TKPathBufferFree(&shape);
+    TKPathGeometryRelease(&geometry);
+    return drawn;
+}
+
+#pragma mark - Display list
+
+@interface TKDisplayList (Private)
+
+- (TKDisplayItem *)newItemOfType: (TKDisplayItemType)type;
+- (void)drawInContext: (CGContextRef)context rect: (CGRect)rect dirtyRect: (CGRect)dirtyRect shadowSpace: (CGSize)shadowSpace;
+
+@end
+
+@implementation TKDisplayList
+@synthesize count = _count;
+
+- (const TKDisplayItem *)items {
+    return _items;
+}
+
+- (CGRect)frame {
+    if (_count == 0)
+        return CGRectZero;
+
+    CGRect frame = _items[0].canvasRect;
+    for (NSUInteger i = 1; i < _count; i++) {
+        frame = CGRectUnion(frame, _items[i].canvasRect);
+    }
+
+    return frame;
+}
+
+- (CGRect)frameForDescription: (NSDictionary *)description {
+    CGRect frame = [self frame];
+    NSDictionary *origin = [description objectForKey: OriginParameterKey];
+
+    // Paths are where their points are, unless the description has an origin
+    if ([[description objectForKey: TypeParameterKey] isEqualToString: PathTypeKey]) {
+        if (origin)
+            frame.origin = CGPointMake([[origin objectForKey: XCoordinateParameterKey] floatValue], [[origin objectForKey: YCoordinateParameterKey] floatValue]);
+
+        return frame;
+    }
+
+    CGRect descriptionFrame = TKFrameForDescription(description);
+    return CGRectOffset(frame, descriptionFrame.origin.x, descriptionFrame.origin.y);
+}
+
+- (TKDisplayItem *)newItemOfType: (TKDisplayItemType)type {
+    // Grow the storage if needed, items are kept contiguous
+    if (_count == _capacity) {
+        _capacity = MAX(_capacity * 2, 1);
+        _items = (TKDisplayItem *)realloc(_items, sizeof(TKDisplayItem) * _capacity);
+    }
+
+    TKDisplayItem *item = &_items[_count++];
+    memset(item, 0, sizeof(TKDisplayItem));
+    item->type = type;
+
+    return item;
+}
+
+#pragma mark - Compiling
+
+- (void)addRectangleInFrame: (CGRect)frame options: (NSDictionary *)options {
+    TKDisplayItem *item = [self newItemOfType: TKDisplayItemRectangle];
+    TKDisplayItemCompileCommon(item, options);
+
+    CGRect canvasRect = TKCanvasRectForFrameAndOptions(frame, options);
+    item->canvasRect = canvasRect;
+    item->origin = CGPointMake(frame.origin.x - canvasRect.origin.x, frame.origin.y - canvasRect.origin.y);
+    item->sizeOffset = CGSizeMake(canvasRect.size.width - frame.size.width, canvasRect.size.height - frame.size.height);
+    item->bounds = TKCanvasRectForFrameAndOptions(CGRectMake(item->origin.x, item->origin.y, frame.size.width, frame.size.height), options);
+
+    // Corner radii, either a single value or an array of 1-4 values, which is repeated to fill all 4
+    NSObject *corners = [options objectForKey: CornerRadiusParameterKey];
+    if (corners) {
+        item->flags |= TKDisplayItemIsRounded;
+
+        if ([corners isKindOfClass: [NSArray class]]) {
+            NSArray *values = (NSArray *)corners;
+            NSUInteger count = [values count];
+
+            for (NSUInteger i = 0; i < 4 && count > 0; i++) {
+                item->radii[i] = [[values objectAtIndex: i % count] floatValue];
+            }
+        } else {
+            CGFloat radius = [(NSNumber *)corners floatValue];
+            item->radii[0] = radius;
+            item->radii[1] = radius;
+            item->radii[2] = radius;
+            item->radii[3] = radius;
+        }
+    }
+}
+
+- (void)addEllipseInFrame: (CGRect)frame options: (NSDictionary *)options {
+    TKDisplayItem *item = [self newItemOfType: TKDisplayItemEllipse];
+    TKDisplayItemCompileCommon(item, options);
+
+    CGRect canvasRect = TKCanvasRectForFrameAndOptions(frame, options);
+    item->canvasRect = canvasRect;
+    item->origin = CGPointMake(frame.origin.x - canvasRect.origin.x, frame.origin.y - canvasRect.origin.y);
+    item->sizeOffset = CGSizeMake(canvasRect.size.width - frame.size.width, canvasRect.size.height - frame.size.height);
+    item->bounds = TKCanvasRectForFrameAndOptions(CGRectMake(item->origin.x, item->origin.y, frame.size.width, frame.size.height), options);
+}
+
+- (void)addPath: (CGPathRef)path options: (NSDictionary *)options {
+    TKDisplayItem *item = [self newItemOfType: TKDisplayItemPath];
+    TKDisplayItemCompileCommon(item, options);
+
+    // The size of a path is determined by the path itself
+    CGRect bounding = CGPathGetBoundingBox(path);
+    CGRect canvasRect = TKCanvasRectForFrameAndOptions(bounding, options);
+
+    item->origin = CGPointMake(bounding.origin.x - canvasRect.origin.x, bounding.origin.y - canvasRect.origin.y);
+    item->sizeOffset = CGSizeMake(canvasRect.size.width - bounding.size.width, canvasRect.size.height - bounding.size.height);
+    item->bounds = TKCanvasRectForFrameAndOptions(CGRectMake(item->origin.x, item->origin.y, bounding.size.width, bounding.size.height), options);
+
+    // The list is shared by every origin, the view is placed at the origin of the description by -frameForDescription:
+    item->canvasRect = canvasRect;
+
+    // Move the path into the canvas
+    CGAffineTransform transform = CGAffineTransformMakeTranslation(item->origin.x - bounding.origin.x, item->origin.y - bounding.origin.y);
+    CGMutablePathRef temp = CGPathCreateMutable();
+    CGPathAddPath(temp, &transform, path);
+    item->path = CGPathCreateCopy(temp);
+    CGPathRelease(temp);
+
+    CGFloat innerStrokeWidth = (item->flags & TKDisplayItemHasInnerStroke) ? item->innerStroke.width : 0.0;
+    item->geometry = TKPathGeometryCacheCreate(item->path, innerStrokeWidth, (item->flags & (TKDisplayItemHasDropShadow | TKDisplayItemHasInnerShadow)) != 0);
+}
+
+#pragma mark - Replaying
+
+- (void)drawInContext: (CGContextRef)context rect: (CGRect)rect {
+    [self drawInContext: context rect: rect dirtyRect: CGRectNull shadowSpace: CGSizeMake(1.0, 1.0)];
+}
+
+- (void)drawInContext: (CGContextRef)context rect: (CGRect)rect dirtyRect: (CGRect)dirtyRect {
+    [self drawInContext: context rect: rect dirtyRect: dirtyRect shadowSpace: CGSizeMake(1.0, 1.0)];
+}
+
+- (void)drawInBitmapContext: (CGContextRef)context rect: (CGRect)rect scale: (CGFloat)scale {
+    [self drawInContext: context rect: rect dirtyRect: CGRectNull shadowSpace: CGSizeMake(scale, -scale)];
+}
+
+- (void)drawInContext: (CGContextRef)context rect: (CGRect)rect dirtyRect: (CGRect)dirtyRect shadowSpace: (CGSize)shadowSpace {
+    TKInstrumentBegin(timer);
+
+    for (NSUInteger i = 0; i < _count; i++) {
+        const TKDisplayItem *item = &_items[i];
+
+        // Nothing of the item would end up in the part being redrawn
+        if (!CGRectIsNull(dirtyRect) && !CGRectIntersectsRect(TKDisplayItemBoundsInRect(item, rect), dirtyRect)) {
+            TKInstrumentCount(TKInstrumentationCounterCulledItems, 1);
+            continue;
+        }
+
+        // Each item starts with a clean state, so nothing leaks into the next one
+        CGContextSaveGState(context);
+
+        switch (item->type) {
+            case TKDisplayItemRectangle:
+                TKContextDrawRectangleItem(context, item, rect, shadowSpace);
+                TKInstrumentCount(TKInstrumentationCounterRectangles, 1);
+                break;
+            case TKDisplayItemEllipse:
+                TKContextDrawEllipseItem(context, item, rect, shadowSpace);
+                TKInstrumentCount(TKInstrumentationCounterEllipses, 1);
+                break;
+            case TKDisplayItemPath:
+                TKContextDrawPathItem(context, item, rect, shadowSpace);
+                TKInstrumentCount(TKInstrumentationCounterPaths, 1);
+                break;
+            default:
+                break;
+        }
+
+        CGContextRestoreGState(context);
+    }
+
+    TKInstrumentEnd(TKInstrumentationPhaseDraw, timer);
+}
+
+- (BOOL)drawInRasterContext: (TKRasterContext *)context rect: (CGRect)rect scale: (CGFloat)scale {
+    bool drawn = true;
+
+    TKRasterContextSaveState(context);
+    TKRasterContextScale(context, scale, scale);
+
+    for (NSUInteger i = 0; i < _count && drawn; i++) {
+        const TKDisplayItem *item = &_items[i];
+
+        // Each item starts with a clean state, so nothing leaks into the next one
+        TKRasterContextSaveState(context);
+
+        switch (item->type) {
+            case TKDisplayItemRectangle:
+                drawn = TKRasterDrawRectangleItem(context, item, rect, scale);
+                break;
+            case TKDisplayItemEllipse:
+                drawn = TKRasterDrawEllipseItem(context, item, rect, scale);
+                break;
+            case TKDisplayItemPath:
+                drawn = TKRasterDrawPathItem(context, item, rect, scale);
+                break;
+            default:
+                break;
+        }
+
+        TKRasterContextRestoreState(context);
+    }
+
+    TKRasterContextRestoreState(context);
+    return drawn;
+}
+
+#pragma mark - Memory management
+
+- (void)dealloc {
+    for (NSUInteger i = 0; i < _count; i++) {
+        TKDisplayItemRelease(&_items[i]);
+    }
+
+    free(_items);
+
+    [super dealloc];
+}
+
+@end
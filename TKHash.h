@@ -0,0 +1,64 @@
+//
+//  TKHash.h
+//  ThemeEngine
+//
+//  Canonical structural hash of the descriptions, used as the key in the caches.
+//  Two descriptions that mean the same have the same hash - the order of keys in
+//  dictionaries does not matter and numbers are compared by value (1, 1.0 and 1e0 are equal)
+//
+//  Hashes of the immutable containers below (and of the ones read from archives) are computed
+//  once and remembered. Any other dictionary or array may be mutable - an NSDictionary can be a
+//  mutable CFDictionary, there is no telling them apart - so its hash is computed again on every
+//  call. Compiled themes store the hashes of their nodes, changing the function (TKHashFunction.h)
+//  means bumping kThemeArchiveVersion
+//
+//  Copyright (c) 2012 __MyCompanyName__. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+#import "TKHashFunction.h"
+
+// Hash of any JSON object (dictionaries, arrays, strings, numbers, nulls), nil is hashed as null
+TKStructuralHash TKStructuralHashForObject(id object);
+
+// Hash the dictionary would have without the key, computed from the hashes of the other entries (not remembered)
+TKStructuralHash TKStructuralHashExcludingKey(NSDictionary *dictionary, id key);
+
+// Computes the hash of a dictionary or array from the (remembered) hashes of its children,
+// without looking up or storing the result for the object itself
+TKStructuralHash TKComputeStructuralHash(id object);
+
+// The description with every dictionary and array in it replaced by the immutable containers below, strings are copied.
+// Parts that are immutable already are used as they are, so converting a built theme again costs nothing
+id TKImmutableDescription(id description);
+
+@interface NSObject (TKStructuralHash)
+
+- (TKStructuralHash)structuralHash;
+
+// YES if the object can't change, so that its hash can be remembered - numbers, nulls and the containers below
+- (BOOL)isImmutableDescription;
+
+@end
+
+// Dictionaries and arrays the engine builds the descriptions out of (see TKJSONBuilder.h and TKComponents.h),
+// they remember their hash once it has been computed. Created with the primitive initializers of NSDictionary
+// (-initWithObjects:forKeys:count:) and NSArray (-initWithObjects:count:)
+@interface TKImmutableDictionary : NSDictionary {
+    NSDictionary *_dictionary;
+
+    TKStructuralHash _hash;
+    volatile BOOL _hasHash;
+}
+
+@end
+
+@interface TKImmutableArray : NSArray {
+    id *_objects;
+    NSUInteger _count;
+
+    TKStructuralHash _hash;
+    volatile BOOL _hasHash;
+}
+
+@end
@@ -0,0 +1,311 @@
+//
+//  TKHash.m
+//  ThemeEngine
+//
+//  Copyright (c) 2012 __MyCompanyName__. All rights reserved.
+//
+
+#import "TKHash.h"
+
+#import <libkern/OSAtomic.h>
+
+#pragma mark - Leaves
+
+static TKStructuralHash TKHashString(NSString *string) {
+    uint64_t lanes[2] = { TKHashSeed[0], TKHashSeed[1] };
+
+    // Walk the characters in chunks, without creating a C string
+    unichar characters[64];
+    NSUInteger length = [string length];
+    for (NSUInteger location = 0; location < length; location += 64) {
+        NSUInteger count = MIN(64, length - location);
+        [string getCharacters: characters range: NSMakeRange(location, count)];
+
+        for (NSUInteger i = 0; i < count; i++) {
+            TKHashAddCharacter(lanes, characters[i]);
+        }
+    }
+
+    return TKHashFinishString(lanes, length);
+}
+
+#pragma mark - Containers
+
+static TKStructuralHash TKHashArray(NSArray *array) {
+    uint64_t lanes[2] = { TKHashSeed[0], TKHashSeed[1] };
+
+    // Order matters, fold the elements in one after another
+    for (id object in array) {
+        TKHashAddElement(lanes, TKStructuralHashForObject(object));
+    }
+
+    return TKHashFinishContainer(lanes, [array count], NO);
+}
+
+static TKStructuralHash TKHashDictionaryExcludingKey(NSDictionary *dictionary, id excludedKey) {
+    uint64_t lanes[2] = { 0, 0 };
+    NSUInteger count = [dictionary count];
+
+    // Order does not matter, each entry is hashed on its own and the results are added up
+    for (id key in dictionary) {
+        if (excludedKey && [key isEqual: excludedKey]) {
+            count--;
+            continue;
+        }
+
+        TKHashAddEntry(lanes, TKStructuralHashForObject(key), TKStructuralHashForObject([dictionary objectForKey: key]));
+    }
+
+    return TKHashFinishContainer(lanes, count, YES);
+}
+
+static TKStructuralHash TKHashDictionary(NSDictionary *dictionary) {
+    return TKHashDictionaryExcludingKey(dictionary, nil);
+}
+
+#pragma mark - Public
+
+TKStructuralHash TKStructuralHashForObject(id object) {
+    if (!object)
+        return TKHashNull();
+
+    return [object structuralHash];
+}
+
+TKStructuralHash TKStructuralHashExcludingKey(NSDictionary *dictionary, id key) {
+    if (![dictionary objectForKey: key])
+        return TKStructuralHashForObject(dictionary);
+
+    return TKHashDictionaryExcludingKey(dictionary, key);
+}
+
+TKStructuralHash TKComputeStructuralHash(id object) {
+    if ([object isKindOfClass: [NSDictionary class]])
+        return TKHashDictionary(object);
+    else if ([object isKindOfClass: [NSArray class]])
+        return TKHashArray(object);
+
+    return TKStructuralHashForObject(object);
+}
+
+id TKImmutableDescription(id description) {
+    if ([description isImmutableDescription])
+        return description;
+
+    if ([description isKindOfClass: [NSString class]])
+        return [[description copy] autorelease];
+
+    if ([description isKindOfClass: [NSDictionary class]]) {
+        NSUInteger count = [description count];
+        id *keys = (id *)malloc(MAX(count, 1) * sizeof(id));
+        id *objects = (id *)malloc(MAX(count, 1) * sizeof(id));
+
+        NSUInteger index = 0;
+        for (id key in description) {
+            keys[index] = key;
+            objects[index] = TKImmutableDescription([description objectForKey: key]);
+            index++;
+        }
+
+        TKImmutableDictionary *dictionary = [[TKImmutableDictionary alloc] initWithObjects: objects forKeys: keys count: index];
+        free(keys);
+        free(objects);
+
+        return [dictionary autorelease];
+    }
+
+    if ([description isKindOfClass: [NSArray class]]) {
+        NSUInteger count = [description count];
+        id *objects = (id *)malloc(MAX(count, 1) * sizeof(id));
+
+        NSUInteger index = 0;
+        for (id object in description) {
+            objects[index++] = TKImmutableDescription(object);
+        }
+
+        TKImmutableArray *array = [[TKImmutableArray alloc] initWithObjects: objects count: index];
+        free(objects);
+
+        return [array autorelease];
+    }
+
+    return description;
+}
+
+#pragma mark - Immutable containers
+
+@implementation TKImmutableDictionary
+
+- (id)initWithObjects: (const id [])objects forKeys: (const id<NSCopying> [])keys count: (NSUInteger)count {
+    if ((self = [super init])) {
+        _dictionary = [[NSDictionary alloc] initWithObjects: objects forKeys: keys count: count];
+    }
+
+    return self;
+}
+
+- (NSUInteger)count {
+    return [_dictionary count];
+}
+
+- (id)objectForKey: (id)key {
+    return [_dictionary objectForKey: key];
+}
+
+- (NSEnumerator *)keyEnumerator {
+    return [_dictionary keyEnumerator];
+}
+
+- (NSUInteger)countByEnumeratingWithState: (NSFastEnumerationState *)state objects: (id *)buffer count: (NSUInteger)length {
+    return [_dictionary countByEnumeratingWithState: state objects: buffer count: length];
+}
+
+- (id)copyWithZone: (NSZone *)zone {
+    return [self retain];
+}
+
+- (BOOL)isImmutableDescription {
+    return YES;
+}
+
+// Several threads may compute it at the same time, they all end up with the same value
+- (TKStructuralHash)structuralHash {
+    if (!_hasHash) {
+        _hash = TKHashDictionary(self);
+        OSMemoryBarrier();
+        _hasHash = YES;
+    }
+
+    return _hash;
+}
+
+- (void)dealloc {
+    [_dictionary release];
+
+    [super dealloc];
+}
+
+@end
+
+@implementation TKImmutableArray
+
+- (id)initWithObjects: (const id [])objects count: (NSUInteger)count {
+    if ((self = [super init])) {
+        _objects = (id *)malloc(MAX(count, 1) * sizeof(id));
+        _count = count;
+
+        for (NSUInteger i = 0; i < count; i++) {
+            _objects[i] = [objects[i] retain];
+        }
+    }
+
+    return self;
+}
+
+- (NSUInteger)count {
+    return _count;
+}
+
+- (id)objectAtIndex: (NSUInteger)index {
+    if (index >= _count) {
+        [NSException raise: NSRangeException format: @"Index %u beyond bounds [0 .. %u]", (unsigned)index, (unsigned)_count];
+    }
+
+    return _objects[index];
+}
+
+- (id)copyWithZone: (NSZone *)zone {
+    return [self retain];
+}
+
+- (BOOL)isImmutableDescription {
+    return YES;
+}
+
+- (TKStructuralHash)structuralHash {
+    if (!_hasHash) {
+        _hash = TKHashArray(self);
+        OSMemoryBarrier();
+        _hasHash = YES;
+    }
+
+    return _hash;
+}
+
+- (void)dealloc {
+    for (NSUInteger i = 0; i < _count; i++) {
+        [_objects[i] release];
+    }
+
+    free(_objects);
+
+    [super dealloc];
+}
+
+@end
+
+#pragma mark - Categories
+
+@implementation NSObject (TKStructuralHash)
+
+- (TKStructuralHash)structuralHash {
+    // Anything outside of JSON, fall back to -hash
+    uint64_t hash = (uint64_t)[self hash];
+    return TKHashFinish(hash + TKHashSeed[0], TKHashRotate(hash, 29) + TKHashSeed[1], TKHashTagObject);
+}
+
+- (BOOL)isImmutableDescription {
+    return NO;
+}
+
+@end
+
+@implementation NSNull (TKStructuralHash)
+
+- (TKStructuralHash)structuralHash {
+    return TKStructuralHashForObject(nil);
+}
+
+- (BOOL)isImmutableDescription {
+    return YES;
+}
+
+@end
+
+@implementation NSNumber (TKStructuralHash)
+
+- (TKStructuralHash)structuralHash {
+    // Booleans included, they are read as numbers throughout the engine
+    return TKHashNumber([self doubleValue]);
+}
+
+- (BOOL)isImmutableDescription {
+    return YES;
+}
+
+@end
+
+@implementation NSString (TKStructuralHash)
+
+- (TKStructuralHash)structuralHash {
+    return TKHashString(self);
+}
+
+@end
+
+// May be mutable, computed from the children every time (the immutable ones among them remember theirs)
+@implementation NSArray (TKStructuralHash)
+
+- (TKStructuralHash)structuralHash {
+    return TKHashArray(self);
+}
+
+@end
+
+@implementation NSDictionary (TKStructuralHash)
+
+- (TKStructuralHash)structuralHash {
+    return TKHashDictionary(self);
+}
+
+@end
@@ -0,0 +1,152 @@
+//
+//  TKHashFunction.c
+//  ThemeEngine
+//
+//  Copyright (c) 2012 __MyCompanyName__. All rights reserved.
+//
+
+#include "TKHashFunction.h"
+#include "TKJSONReader.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#pragma mark - Leaves
+
+TKStructuralHash TKHashNumber(double number) {
+    // Both zeroes are the same number
+    if (number == 0.0)
+        number = 0.0;
+
+    uint64_t bits;
+    memcpy(&bits, &number, sizeof(bits));
+
+    return TKHashFinish(bits + TKHashSeed[0], TKHashRotate(bits, 29) + TKHashSeed[1], TKHashTagNumber);
+}
+
+TKStructuralHash TKHashUTF8String(const char *bytes, size_t length) {
+    uint64_t lanes[2] = { TKHashSeed[0], TKHashSeed[1] };
+    const uint8_t *characters = (const uint8_t *)bytes;
+    size_t units = 0;
+
+    // The reader has checked the encoding already
+    for (size_t i = 0; i < length; ) {
+        uint32_t codePoint;
+        if (characters[i] < 0x80) {
+            codePoint = characters[i];
+            i += 1;
+        } else if (characters[i] < 0xE0) {
+            codePoint = ((characters[i] & 0x1F) << 6) | (characters[i + 1] & 0x3F);
+            i += 2;
+        } else if (characters[i] < 0xF0) {
+            codePoint = ((characters[i] & 0x0F) << 12) | ((characters[i + 1] & 0x3F) << 6) | (characters[i + 2] & 0x3F);
+            i += 3;
+        } else {
+            codePoint = ((uint32_t)(characters[i] & 0x07) << 18) | ((characters[i + 1] & 0x3F) << 12) |
+                        ((characters[i + 2] & 0x3F) << 6) | (characters[i + 3] & 0x3F);
+            i += 4;
+        }
+
+        if (codePoint >= 0x10000) {
+            codePoint -= 0x10000;
+            TKHashAddCharacter(lanes, (uint16_t)(0xD800 + (codePoint >> 10)));
+            TKHashAddCharacter(lanes, (uint16_t)(0xDC00 + (codePoint & 0x3FF)));
+            units += 2;
+        } else {
+            TKHashAddCharacter(lanes, (uint16_t)codePoint);
+            units++;
+        }
+    }
+
+    return TKHashFinishString(lanes, units);
+}
+
+#pragma mark - JSON bytes
+
+// Open container while hashing JSON bytes, along with the key waiting for its value
+typedef struct {
+    bool isDictionary;
+    uint64_t lanes[2];
+    size_t count;
+    TKStructuralHash key;
+} TKHashFrame;
+
+typedef struct {
+    TKHashFrame *frames;
+    size_t depth;
+    TKStructuralHash result;
+} TKHashReadContext;
+
+static void TKHashReadValue(TKHashReadContext *context, TKStructuralHash value) {
+    if (context->depth == 0) {
+        context->result = value;
+        return;
+    }
+
+    TKHashFrame *frame = &context->frames[context->depth - 1];
+    if (frame->isDictionary)
+        TKHashAddEntry(frame->lanes, frame->key, value);
+    else
+        TKHashAddElement(frame->lanes, value);
+
+    frame->count++;
+}
+
+static TKJSONAction TKHashReadEvent(const TKJSONEvent *event, void *info) {
+    TKHashReadContext *context = (TKHashReadContext *)info;
+
+    switch (event->type) {
+        case TKJSONEventBeginObject:
+        case TKJSONEventBeginArray: {
+            TKHashFrame *frame = &context->frames[context->depth++];
+            frame->isDictionary = (event->type == TKJSONEventBeginObject);
+            frame->lanes[0] = frame->isDictionary ? 0 : TKHashSeed[0];
+            frame->lanes[1] = frame->isDictionary ? 0 : TKHashSeed[1];
+            frame->count = 0;
+            break;
+        }
+        case TKJSONEventEndObject:
+        case TKJSONEventEndArray: {
+            TKHashFrame *frame = &context->frames[--context->depth];
+            TKHashReadValue(context, TKHashFinishContainer(frame->lanes, frame->count, frame->isDictionary));
+            break;
+        }
+        case TKJSONEventKey:
+            context->frames[context->depth - 1].key = TKHashUTF8String(event->bytes, event->length);
+            break;
+        case TKJSONEventString:
+            TKHashReadValue(context, TKHashUTF8String(event->bytes, event->length));
+            break;
+        case TKJSONEventNumber:
+            TKHashReadValue(context, TKHashNumber(event->number));
+            break;
+        case TKJSONEventTrue:
+            TKHashReadValue(context, TKHashNumber(1.0));
+            break;
+        case TKJSONEventFalse:
+            TKHashReadValue(context, TKHashNumber(0.0));
+            break;
+        case TKJSONEventNull:
+            TKHashReadValue(context, TKHashNull());
+            break;
+    }
+
+    return TKJSONActionContinue;
+}
+
+TKStructuralHash TKStructuralHashForJSONBytes(const char *bytes, size_t length) {
+    TKHashReadContext context;
+    context.frames = (TKHashFrame *)malloc(kJSONReaderMaximumDepth * sizeof(TKHashFrame));
+    context.depth = 0;
+    context.result = TKHashNull();
+
+    TKJSONReader reader;
+    TKJSONReaderInit(&reader);
+    if (!context.frames || !TKJSONRead(&reader, bytes, length, TKHashReadEvent, &context, NULL))
+        context.result = TKHashNull();
+
+    TKJSONReaderFree(&reader);
+    free(context.frames);
+
+    return context.result;
+}
@@ -0,0 +1,119 @@
+//
+//  TKHashFunction.h
+//  ThemeEngine
+//
+//  The structural hash function itself, in plain C so that the theme compiler (see TKThemeCompiler.h)
+//  stores the same hashes in the archives as the engine computes for the objects (see TKHash.h).
+//  Strings are hashed by their UTF-16 units, the way NSString sees them
+//
+//  Copyright (c) 2012 __MyCompanyName__. All rights reserved.
+//
+
+#ifndef TKHashFunction_h
+#define TKHashFunction_h
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Two independent 64-bit lanes, value is used as the key, check is there to detect collisions
+typedef struct {
+    uint64_t value;
+    uint64_t check;
+} TKStructuralHash;
+
+static inline bool TKStructuralHashEqual(TKStructuralHash first, TKStructuralHash second) {
+    return first.value == second.value && first.check == second.check;
+}
+
+// Type tags, so that for example an empty array and an empty dictionary differ
+enum {
+    TKHashTagNull = 1,
+    TKHashTagNumber,
+    TKHashTagString,
+    TKHashTagArray,
+    TKHashTagDictionary,
+    TKHashTagObject
+};
+
+// Multipliers and seeds of the two lanes
+static const uint64_t TKHashPrime[2] = { 0x100000001b3ULL, 0xc6a4a7935bd1e995ULL };
+static const uint64_t TKHashSeed[2] = { 0xcbf29ce484222325ULL, 0x9e3779b97f4a7c15ULL };
+
+static inline uint64_t TKHashMix(uint64_t k) {
+    k ^= k >> 33;
+    k *= 0xff51afd7ed558ccdULL;
+    k ^= k >> 33;
+    k *= 0xc4ceb9fe1a85ec53ULL;
+    k ^= k >> 33;
+
+    return k;
+}
+
+static inline uint64_t TKHashRotate(uint64_t k, int bits) {
+    return (k << bits) | (k >> (64 - bits));
+}
+
+static inline TKStructuralHash TKHashFinish(uint64_t first, uint64_t second, uint64_t tag) {
+    TKStructuralHash hash;
+    hash.value = TKHashMix(first ^ (tag * TKHashPrime[0]));
+    hash.check = TKHashMix(second ^ (tag * TKHashPrime[1]));
+
+    return hash;
+}
+
+#pragma mark - Leaves
+
+static inline TKStructuralHash TKHashNull(void) {
+    return TKHashFinish(TKHashSeed[0], TKHashSeed[1], TKHashTagNull);
+}
+
+// Booleans are hashed as the numbers 1 and 0, they are read as numbers throughout the engine
+TKStructuralHash TKHashNumber(double number);
+
+// Strings are hashed a character (UTF-16 unit) at a time, starting from lanes of TKHashSeed, and finished with their length
+static inline void TKHashAddCharacter(uint64_t *lanes, uint16_t character) {
+    lanes[0] = (lanes[0] ^ character) * TKHashPrime[0];
+    lanes[1] = (lanes[1] ^ character) * TKHashPrime[1];
+}
+
+static inline TKStructuralHash TKHashFinishString(const uint64_t *lanes, size_t length) {
+    return TKHashFinish(lanes[0] ^ length, lanes[1] ^ length, TKHashTagString);
+}
+
+// Same as hashing the UTF-16 units of the string, from valid UTF-8
+TKStructuralHash TKHashUTF8String(const char *bytes, size_t length);
+
+#pragma mark - Containers
+
+// Arrays fold their elements in order, starting from lanes of TKHashSeed
+static inline void TKHashAddElement(uint64_t *lanes, TKStructuralHash element) {
+    lanes[0] = TKHashRotate((lanes[0] ^ element.value) * TKHashPrime[0], 31);
+    lanes[1] = TKHashRotate((lanes[1] ^ element.check) * TKHashPrime[1], 27);
+}
+
+// Dictionaries add up their entries in any order, starting from zero lanes
+static inline void TKHashAddEntry(uint64_t *lanes, TKStructuralHash key, TKStructuralHash value) {
+    lanes[0] += TKHashMix(key.value * TKHashPrime[0] + TKHashRotate(value.value, 17));
+    lanes[1] += TKHashMix(key.check * TKHashPrime[1] + TKHashRotate(value.check, 23));
+}
+
+static inline TKStructuralHash TKHashFinishContainer(const uint64_t *lanes, size_t count, bool isDictionary) {
+    return TKHashFinish(lanes[0] ^ count, lanes[1] ^ count, isDictionary ? TKHashTagDictionary : TKHashTagArray);
+}
+
+#pragma mark - JSON
+
+// Hash of the JSON value in bytes (UTF-8), the same as the hash of the objects it would be parsed into,
+// without creating them. Invalid JSON is hashed as null
+TKStructuralHash TKStructuralHashForJSONBytes(const char *bytes, size_t length);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -15,16 +15,22 @@
 #define ThemeEngine_DrawingHelpers_h
 
 #pragma mark - C helpers
+CGBlendMode TKBlendModeForString(NSString *string);
 void TKContextSetBlendModeForString(CGContextRef context, NSString *string);
 void TKContextAddShadowWithOptions(CGContextRef context, NSDictionary *options);
 void TKContextStrokePathWithOptions(CGContextRef context, NSDictionary *options);
 void TKContextDrawGradientForOptions(CGContextRef context, NSDictionary *options, CGPoint startPoint, CGPoint endPoint);
 
+// Frame given by the origin and size of a description, paths have no size (it comes from the path itself)
+CGRect TKFrameForDescription(NSDictionary *description);
 CGRect TKShadowRectForRectAndOptions(CGRect rect, NSDictionary *options);
 CGRect TKStrokeRectForRectAndWidth(CGRect rect, CGFloat width);
 void TKBalanceCornerRadiiIntoSize(CGFloat *radii, CGSize size);
 CGMutablePathRef TKRoundedPathInRectForRadii(CGFloat *radii, CGRect rect);
 
+// Parser behind +colorForWebColor:, fills in red, green, blue and alpha without creating any objects
+void TKWebColorGetComponents(NSString *colorCode, CGFloat *components);
+
 #endif
 
 #pragma mark - UIColor extension
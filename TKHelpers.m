@@ -8,22 +8,23 @@
 
 #import "TKHelpers.h"
 #import "TKConstants.h"
+#import "TKResourcePool.h"
 
 #pragma mark - C helpers
 
-void TKContextSetBlendModeForString(CGContextRef context, NSString *string) {
-    CGBlendMode blendMode;
+CGBlendMode TKBlendModeForString(NSString *string) {
     if ([string isEqualToString: @"overlay"]) {
-        blendMode = kCGBlendModeOverlay;
+        return kCGBlendModeOverlay;
     } else if ([string isEqualToString: @"multiply"]) {
-        blendMode = kCGBlendModeMultiply;
+        return kCGBlendModeMultiply;
     } else if ([string isEqualToString: @"softlight"]) {
-        blendMode = kCGBlendModeSoftLight;
-    } else {
-        blendMode = kCGBlendModeNormal;
+        return kCGBlendModeSoftLight;
     }
     
-    CGContextSetBlendMode(context, blendMode);
+    return kCGBlendModeNormal;
+}
+void TKContextSetBlendModeForString(CGContextRef context, NSString *string) {
+    CGContextSetBlendMode(context, TKBlendModeForString(string));
 }
 void TKContextAddShadowWithOptions(CGContextRef context, NSDictionary *options) {
     NSDictionary *offsetOptions = [options objectForKey: OffsetParameterKey];
@@ -41,10 +42,11 @@ void TKContextAddShadowWithOptions(CGContextRef context, NSDictionary *options)
     if ([options objectForKey: AlphaParameterKey])
         alpha = [[options objectForKey: AlphaParameterKey] floatValue];
     
+    TKResourcePool *pool = [TKResourcePool sharedPool];
     if ([options objectForKey: ColorParameterKey])
-        CGContextSetShadowWithColor(context, offset, blur, [[UIColor colorForWebColor: [options objectForKey: ColorParameterKey]] colorWithAlphaComponent: alpha].CGColor);
+        CGContextSetShadowWithColor(context, offset, blur, [pool colorForWebColor: [options objectForKey: ColorParameterKey] alpha: alpha]);
     else
-        CGContextSetShadowWithColor(context, offset, blur, [[UIColor blackColor] colorWithAlphaComponent: alpha].CGColor);
+        CGContextSetShadowWithColor(context, offset, blur, [pool colorWithRed: 0.0 green: 0.0 blue: 0.0 alpha: alpha]);
 }
 void TKContextStrokePathWithOptions(CGContextRef context, NSDictionary *options) {
     // Check if blend mode is present
@@ -56,10 +58,11 @@ void TKContextStrokePathWithOptions(CGContextRef context, NSDictionary *options)
     if ([options objectForKey: AlphaParameterKey])
         CGContextSetAlpha(context, [[options objectForKey: AlphaParameterKey] floatValue]);
     
+    TKResourcePool *pool = [TKResourcePool sharedPool];
     if ([options objectForKey: ColorParameterKey])
-        CGContextSetStrokeColorWithColor(context, [UIColor colorForWebColor: [options objectForKey: ColorParameterKey]].CGColor);
+        CGContextSetStrokeColorWithColor(context, [pool colorForWebColor: [options objectForKey: ColorParameterKey]]);
     else
-        CGContextSetStrokeColorWithColor(context, [UIColor blackColor].CGColor);
+        CGContextSetStrokeColorWithColor(context, [pool colorWithRed: 0.0 green: 0.0 blue: 0.0 alpha: 1.0]);
     
     // Set the width
     CGContextSetLineWidth(context, [[options objectForKey: WidthParameterKey] floatValue]);
@@ -78,30 +81,12 @@ void TKContextDrawGradientForOptions(CGContextRef context, NSDictionary *options
         CGContextSetAlpha(context, [[options objectForKey: AlphaParameterKey] floatValue]); 
     }
     
-    // Create the gradient
-    NSArray *colors = [options objectForKey: GradientColorsParameterKey];
-    NSMutableArray *CGColors = [NSMutableArray arrayWithCapacity: [colors count]];
-    for (NSString *color in colors) {
-        [CGColors insertObject: (id)[UIColor colorForWebColor: color].CGColor atIndex: [colors indexOfObject: color]];
-    }
-    
-    // And then the locations
-    colors = [options objectForKey: GradientPositionsParameterKey];
-    CGFloat *positions = (CGFloat *)calloc(sizeof(CGFloat), [colors count]);
-    for (NSNumber *number in colors) {
-        positions[[colors indexOfObject: number]] = [number floatValue];
-    }
-    
-    CGColorSpaceRef rgbSpace = CGColorSpaceCreateDeviceRGB();
-	CGGradientRef gradient = CGGradientCreateWithColors(rgbSpace, (CFArrayRef)CGColors, positions);
-    CGColorSpaceRelease(rgbSpace);
-    free(positions);
+    // Fetch the gradient, equal colors and locations share one
+    CGGradientRef gradient = [[TKResourcePool sharedPool] gradientWithColors: [options objectForKey: GradientColorsParameterKey] 
+                                                                   locations: [options objectForKey: GradientPositionsParameterKey]];
     
     //Draw the gradient
     CGContextDrawLinearGradient(context, gradient, startPoint, endPoint, 0);
-    
-    // Release the gradient
-    CGGradientRelease(gradient);
 }
 
 CGRect TKShadowRectForRectAndOptions(CGRect rect, NSDictionary *options) {
@@ -125,6 +110,22 @@ CGRect TKShadowRectForRectAndOptions(CGRect rect, NSDictionary *options) {
     // Return the resulting rect
     return shadowRect;
 }
+
+CGRect TKFrameForDescription(NSDictionary *description) {
+    CGPoint origin = CGPointZero;
+    if ([description objectForKey: OriginParameterKey]) {
+        origin.x = [[[description objectForKey: OriginParameterKey] objectForKey: XCoordinateParameterKey] floatValue];
+        origin.y = [[[description objectForKey: OriginParameterKey] objectForKey: YCoordinateParameterKey] floatValue];
+    }
+    
+    if ([[description objectForKey: TypeParameterKey] isEqualToString: PathTypeKey])
+        return CGRectZero;
+    
+    return CGRectMake(origin.x, origin.y,
+                      [[[description objectForKey: SizeParameterKey] objectForKey: WidthParameterKey] floatValue],
+                      [[[description objectForKey: SizeParameterKey] objectForKey: HeightParameterKey] floatValue]);
+}
+
 CGRect TKStrokeRectForRectAndWidth(CGRect rect, CGFloat width) {
     // Create a stroke rect
     CGRect strokeRect = rect;
@@ -190,6 +191,74 @@ CGMutablePathRef TKRoundedPathInRectForRadii(CGFloat *radii, CGRect rect) {
     return roundedPath;
 }
 
+// Longest color code looked at, anything longer is not a valid color anyway
+#define kMaxWebColorLength 32
+
+static inline int TKHexDigitValue(unichar character) {
+    if (character >= '0' && character <= '9')
+        return character - '0';
+    if (character >= 'a' && character <= 'f')
+        return character - 'a' + 10;
+    if (character >= 'A' && character <= 'F')
+        return character - 'A' + 10;
+    
+    return -1;
+}
+
+void TKWebColorGetComponents(NSString *colorCode, CGFloat *components) {
+    // Copy the characters, leaving out all #
+    unichar characters[kMaxWebColorLength];
+    NSUInteger length = MIN([colorCode length], kMaxWebColorLength);
+    [colorCode getCharacters: characters range: NSMakeRange(0, length)];
+    
+    unichar code[kMaxWebColorLength];
+    NSUInteger codeLength = 0;
+    for (NSUInteger i = 0; i < length; i++) {
+        if (characters[i] != '#')
+            code[codeLength++] = characters[i];
+    }
+    
+    // Check if clear color needed
+    static const unichar clear[5] = { 'c', 'l', 'e', 'a', 'r' };
+    if (codeLength == 5 && memcmp(code, clear, sizeof(clear)) == 0) {
+        components[0] = components[1] = components[2] = components[3] = 0.0;
+        return;
+    }
+    
+    // Less than six characters are used as a pattern - "FFA" becomes "FFAFFA" and "FFFA" becomes "FFFAFF"
+    // Eight characters means alpha is present as well
+    BOOL alpha = (codeLength == 8);
+    if (codeLength > 0 && codeLength < 6) {
+        for (NSUInteger i = codeLength; i < 6; i++) {
+            code[i] = code[i % codeLength];
+        }
+        
+        codeLength = 6;
+    }
+    
+    // Scan in the hex value the same way NSScanner does, skip whitespace and an optional 0x,
+    // stop at the first non-hex character and clamp on overflow
+    NSUInteger index = 0;
+    while (index < codeLength && (code[index] == ' ' || code[index] == '\t' || code[index] == '\n' || code[index] == '\r'))
+        index++;
+    
+    if (index + 1 < codeLength && code[index] == '0' && (code[index + 1] == 'x' || code[index + 1] == 'X'))
+        index += 2;
+    
+    uint64_t color = 0;
+    for (; index < codeLength && TKHexDigitValue(code[index]) >= 0; index++) {
+        color = (color << 4) | (uint64_t)TKHexDigitValue(code[index]);
+        
+        if (color > UINT32_MAX)
+            color = UINT32_MAX;
+    }
+    
+    components[0] = (CGFloat)(((color >> 16) & 0xFF) / 255.0);
+    components[1] = (CGFloat)(((color >> 8) & 0xFF) / 255.0);
+    components[2] = (CGFloat)((color & 0xFF) / 255.0);
+    components[3] = alpha ? (CGFloat)(((color >> 24) & 0xFF) / 255.0) : 1.0;
+}
+
 
 #pragma mark - UIColor Extension
 
@@ -197,68 +266,15 @@ CGMutablePathRef TKRoundedPathInRectForRadii(CGFloat *radii, CGRect rect) {
 
 // Converting web colors into UIColor objects
 + (UIColor *)colorForWebColor: (NSString *)colorCode {
-    // Start by mutating the string
-    NSMutableString *string = [NSMutableString stringWithString: colorCode];
-    
-    // Remove all #
-    [string replaceOccurrencesOfString: @"#" withString: @"" options: 0 range: NSMakeRange(0, [string length])];
-    
     // Check if clear color needed
-    if ([string isEqualToString: @"clear"]) {
+    if ([colorCode isEqualToString: @"clear"]) {
         return [UIColor clearColor];
     }
     
-    // By default no alpha value is in the string
-    BOOL alpha = NO;
-    
-    // Check if size is enough
-    switch ([string length]) {
-        case 1:
-            // The pattern is easy to form
-            [string appendFormat: @"%@%@%@%@%@", string, string, string, string, string];
-            break;
-        case 2:
-            // Once again, repeat the pattern
-            [string appendFormat: @"%@%@", string, string];
-            break;
-        case 3:
-            // And again, repeat the pattern
-            [string appendFormat: @"%@", string];
-            break;
-        case 4:
-            // Now it's a bit more difficult, repeat, but then cut the end off
-            [string appendString: [string substringToIndex: 2]];
-            break;
-        case 5:
-            // Same as with four, but add one less
-            [string appendString: [string substringToIndex: 1]];
-            break;
-        case 8:
-            // We have alpha as well
-            alpha = YES;
-            break;
-        default:
-            break;
-    }
-    
-    // Storage for all the values
-    unsigned int color;
-    
-    // Now we can proceed to calculate the values, start by creating a range of the string to look at
-    [[NSScanner scannerWithString: string] scanHexInt: &color]; // Grabs color value
-    
-    // Return appropriate UIColor
-    if (alpha) {
-        return [UIColor colorWithRed: (float)(((color >> 16) & 0xFF) / 255.0)
-                               green: (float)(((color >> 8) & 0xFF) / 255.0)
-                                blue: (float)((color & 0xFF) / 255.0)
-                               alpha: (float)(((color >> 24) & 0xFF) / 255.0)];
-    }
+    CGFloat components[4];
+    TKWebColorGetComponents(colorCode, components);
     
-    return [UIColor colorWithRed: (float)(((color >> 16) & 0xFF) / 255.0)
-                           green: (float)(((color >> 8) & 0xFF) / 255.0)
-                            blue: (float)((color & 0xFF) / 255.0)
-                           alpha: 1.0];
+    return [UIColor colorWithRed: components[0] green: components[1] blue: components[2] alpha: components[3]];
 }
 
 - (NSString *)hexValue {
@@ -0,0 +1,46 @@
+//
+//  TKImageAtlas.h
+//  ThemeEngine
+//
+//  Packs small images (the states of buttons, the patterns of gradient text) into a few shared bitmaps,
+//  instead of a separate allocation for each of them. Images are placed with a skyline packer into square
+//  pages, one set of pages for each scale, and handed out as sub-images of their page - regular UIImages
+//  which can be made stretchable, drawn and set on buttons as before
+//
+//  A page is only written where images are placed, and the pixels of a placed image are never touched again,
+//  so the images handed out stay valid for as long as they are around (they keep the memory of their page)
+//
+//  Copyright (c) 2012 __MyCompanyName__. All rights reserved.
+//
+
+#import <UIKit/UIKit.h>
+#import <pthread.h>
+
+@interface TKImageAtlas : NSObject {
+    pthread_mutex_t _lock;
+    size_t _pageSize;
+
+    // Pages still taking images, the ones given up on are only kept alive by their images
+    NSMutableArray *_pages;
+
+    NSUInteger _pageCount;
+    NSUInteger _imageCount;
+    uint64_t _packedPixels;
+    uint64_t _unpackedBytes;
+}
+
+// Pages are pageSize x pageSize pixels, images larger than half of that are not packed. Defaults to 512
+- (id)initWithPageSize: (size_t)pageSize;
+
+// Copy of the image placed in a page, or the image itself if it does not fit (or is already packed)
+- (UIImage *)imageByPackingImage: (UIImage *)image;
+- (BOOL)containsImage: (UIImage *)image;
+
+// New images go into new pages, the old ones are released once the images packed into them are
+- (void)removeAllPages;
+
+// Pages, images, packing efficiency (pixels used by images in the pages), the bytes saved compared to
+// separate images, and the number of bitmaps saved (images - pages), as NSNumbers
+- (NSDictionary *)statistics;
+
+@end
@@ -0,0 +1,356 @@
+//
+//  TKImageAtlas.m
+//  ThemeEngine
+//
+//  Copyright (c) 2012 __MyCompanyName__. All rights reserved.
+//
+
+#import "TKImageAtlas.h"
+#import "TKResourcePool.h"
+#import <objc/runtime.h>
+
+#define kImageAtlasDefaultPageSize 512
+
+// Pixels left on every side of an image, filled with its edge pixels, so filtering a stretched or scaled
+// image picks up the image itself instead of its neighbours or the transparent page
+#define kImageAtlasGutter 1
+
+#define kImageAtlasBytesPerPixel 4
+#define kImageAtlasVMPageSize 4096
+
+static char TKImageAtlasPackedKey;
+
+// Estimate of the memory taken by a bitmap of its own, rows aligned like Core Graphics does and the
+// whole of it rounded up to the pages of memory it ends up in
+static inline uint64_t TKImageAtlasBitmapBytes(size_t width, size_t height) {
+    uint64_t bytesPerRow = (width * kImageAtlasBytesPerPixel + 15) & ~(uint64_t)15;
+    return (bytesPerRow * height + kImageAtlasVMPageSize - 1) & ~(uint64_t)(kImageAtlasVMPageSize - 1);
+}
+
+static void TKImageAtlasReleaseBuffer(void *info, const void *data, size_t size) {
+    free((void *)data);
+}
+
+#pragma mark - Pages
+
+// Top of the free space over a run of columns, the skyline is the list of them from left to right
+typedef struct {
+    size_t x;
+    size_t y;
+    size_t width;
+} TKSkylineSegment;
+
+@interface TKImageAtlasPage : NSObject {
+    CGFloat _scale;
+    size_t _size;
+    size_t _bytesPerRow;
+
+    // The buffer is owned by the provider, so it is around for as long as any image of the page is
+    CGDataProviderRef _provider;
+    CGContextRef _context;
+
+    TKSkylineSegment *_skyline;
+    size_t _segmentCount;
+
+    size_t _bottom;
+}
+
+@property (nonatomic, readonly) CGFloat scale;
+@property (nonatomic, readonly) size_t bottom;          // Rows written to so far
+
+- (id)initWithSize: (size_t)size scale: (CGFloat)scale;
+
+// Sub-image of the page holding a copy of the image, NULL if there is no room left for it
+- (CGImageRef)createImageByPlacingImage: (CGImageRef)image;
+
+@end
+
+@implementation TKImageAtlasPage
+@synthesize scale = _scale;
+@synthesize bottom = _bottom;
+
+- (id)initWithSize: (size_t)size scale: (CGFloat)scale {
+    if ((self = [super init])) {
+        _scale = scale;
+        _size = size;
+        _bytesPerRow = size * kImageAtlasBytesPerPixel;
+
+        // calloc leaves the untouched rows unmapped, a page only costs the rows images were placed in
+        void *buffer = calloc(size, _bytesPerRow);
+        if (!buffer) {
+            NSLog(@"Failed to allocate a %zux%zu atlas page", size, size);
+            [self release];
+            return nil;
+        }
+
+        _provider = CGDataProviderCreateWithData(NULL, buffer, size * _bytesPerRow, TKImageAtlasReleaseBuffer);
+        _context = CGBitmapContextCreate(buffer, size, size, 8, _bytesPerRow, [TKResourcePool sharedPool].colorSpace,
+                                         kCGImageAlphaPremultipliedFirst | kCGBitmapByteOrder32Little);
+        CGContextSetBlendMode(_context, kCGBlendModeCopy);
+        CGContextSetInterpolationQuality(_context, kCGInterpolationNone);
+
+        _skyline = malloc(sizeof(TKSkylineSegment));
+        _skyline[0] = (TKSkylineSegment){ 0, 0, size };
+        _segmentCount = 1;
+    }
+
+    return self;
+}
+
+// Lowest top for a rectangle starting at a segment, or SIZE_MAX if it sticks out of the page
+- (size_t)topForWidth: (size_t)width height: (size_t)height atSegment: (size_t)index {
+    size_t x = _skyline[index].x;
+    if (x + width > _size)
+        return SIZE_MAX;
+
+    size_t top = 0;
+    size_t remaining = width;
+    for (size_t i = index; remaining > 0; i++) {
+        top = MAX(top, _skyline[i].y);
+        remaining -= MIN(remaining, _skyline[i].width);
+    }
+
+    return top + height <= _size ? top : SIZE_MAX;
+}
+
+- (void)addSkylineSegment: (TKSkylineSegment)segment atIndex: (size_t)index {
+    _skyline = realloc(_skyline, (_segmentCount + 1) * sizeof(TKSkylineSegment));
+    memmove(&_skyline[index + 1], &_skyline[index], (_segmentCount - index) * sizeof(TKSkylineSegment));
+    _skyline[index] = segment;
+    _segmentCount++;
+
+    // The new segment covers the start of the ones after it
+    size_t end = segment.x + segment.width;
+    while (index + 1 < _segmentCount && _skyline[index + 1].x < end) {
+        TKSkylineSegment *next = &_skyline[index + 1];
+        size_t covered = MIN(end - next->x, next->width);
+
+        if (covered == next->width) {
+            memmove(next, next + 1, (_segmentCount - index - 2) * sizeof(TKSkylineSegment));
+            _segmentCount--;
+        } else {
+            next->x += covered;
+            next->width -= covered;
+        }
+    }
+
+    // Neighbours at the same height are one segment
+    for (size_t i = 0; i + 1 < _segmentCount; ) {
+        if (_skyline[i].y == _skyline[i + 1].y) {
+            _skyline[i].width += _skyline[i + 1].width;
+            memmove(&_skyline[i + 1], &_skyline[i + 2], (_segmentCount - i - 2) * sizeof(TKSkylineSegment));
+            _segmentCount--;
+        } else
+            i++;
+    }
+}
+
+// Copies the edge pixels of the image at rect (rows from the top of the page) into the gutter around it
+- (void)extrudeEdgesOfRect: (CGRect)rect {
+    uint8_t *pixels = CGBitmapContextGetData(_context);
+    size_t x = (size_t)rect.origin.x, y = (size_t)rect.origin.y;
+    size_t width = (size_t)rect.size.width, height = (size_t)rect.size.height;
+
+    // Left and right first, so that the rows copied up and down include the corners
+    for (size_t row = y; row < y + height; row++) {
+        uint32_t *line = (uint32_t *)(pixels + row * _bytesPerRow);
+        for (size_t i = 1; i <= kImageAtlasGutter; i++) {
+            line[x - i] = line[x];
+            line[x + width - 1 + i] = line[x + width - 1];
+        }
+    }
+
+    size_t start = (x - kImageAtlasGutter) * kImageAtlasBytesPerPixel;
+    size_t length = (width + 2 * kImageAtlasGutter) * kImageAtlasBytesPerPixel;
+    for (size_t i = 1; i <= kImageAtlasGutter; i++) {
+        memcpy(pixels + (y - i) * _bytesPerRow + start, pixels + y * _bytesPerRow + start, length);
+        memcpy(pixels + (y + height - 1 + i) * _bytesPerRow + start, pixels + (y + height - 1) * _bytesPerRow + start, length);
+    }
+}
+
+- (CGImageRef)createImageByPlacingImage: (CGImageRef)image {
+    size_t width = CGImageGetWidth(image);
+    size_t height = CGImageGetHeight(image);
+    size_t paddedWidth = width + 2 * kImageAtlasGutter;
+    size_t paddedHeight = height + 2 * kImageAtlasGutter;
+
+    // Bottom-left: the position with the lowest top, the narrowest segment for ties so wide ones stay free
+    size_t bestIndex = SIZE_MAX;
+    size_t bestTop = SIZE_MAX;
+    size_t bestWidth = SIZE_MAX;
+    for (size_t i = 0; i < _segmentCount; i++) {
+        size_t top = [self topForWidth: paddedWidth height: paddedHeight atSegment: i];
+        if (top < bestTop || (top == bestTop && top != SIZE_MAX && _skyline[i].width < bestWidth)) {
+            bestIndex = i;
+            bestTop = top;
+            bestWidth = _skyline[i].width;
+        }
+    }
+
+    if (bestIndex == SIZE_MAX)
+        return NULL;
+
+    size_t x = _skyline[bestIndex].x;
+    [self addSkylineSegment: (TKSkylineSegment){ x, bestTop + paddedHeight, paddedWidth } atIndex: bestIndex];
+    _bottom = MAX(_bottom, bestTop + paddedHeight);
+
+    // The context has its origin at the bottom of the page, images are placed from the top
+    CGRect rect = CGRectMake(x + kImageAtlasGutter, bestTop + kImageAtlasGutter, width, height);
+    CGContextDrawImage(_context, CGRectMake(rect.origin.x, _size - CGRectGetMaxY(rect), width, height), image);
+    CGContextFlush(_context);
+    [self extrudeEdgesOfRect: rect];
+
+    // A fresh image of the page every time, so nothing cached for an earlier state of the page is used
+    CGImageRef page = CGImageCreate(_size, _size, 8, 32, _bytesPerRow, [TKResourcePool sharedPool].colorSpace,
+                                    kCGImageAlphaPremultipliedFirst | kCGBitmapByteOrder32Little,
+                                    _provider, NULL, false, kCGRenderingIntentDefault);
+    CGImageRef placed = CGImageCreateWithImageInRect(page, rect);
+    CGImageRelease(page);
+
+    return placed;
+}
+
+- (void)dealloc {
+    free(_skyline);
+    CGContextRelease(_context);
+    CGDataProviderRelease(_provider);
+
+    [super dealloc];
+}
+
+@end
+
+#pragma mark - Atlas
+
+@implementation TKImageAtlas
+
+- (id)init {
+    return [self initWithPageSize: kImageAtlasDefaultPageSize];
+}
+
+- (id)initWithPageSize: (size_t)pageSize {
+    if ((self = [super init])) {
+        pthread_mutex_init(&_lock, NULL);
+
+        _pageSize = pageSize;
+        _pages = [[NSMutableArray alloc] init];
+    }
+
+    return self;
+}
+
+- (BOOL)containsImage: (UIImage *)image {
+    return objc_getAssociatedObject(image, &TKImageAtlasPackedKey) != nil;
+}
+
+- (UIImage *)imageByPackingImage: (UIImage *)image {
+    CGImageRef source = image.CGImage;
+    if (!source || [self containsImage: image])
+        return image;
+
+    // Large images would leave most of a page empty around them
+    size_t width = CGImageGetWidth(source);
+    size_t height = CGImageGetHeight(source);
+    if (width == 0 || height == 0 || width > _pageSize / 2 || height > _pageSize / 2)
+        return image;
+
+    pthread_mutex_lock(&_lock);
+
+    CGImageRef placed = NULL;
+    TKImageAtlasPage *target = nil;
+    for (TKImageAtlasPage *page in _pages) {
+        if (page.scale != image.scale)
+            continue;
+
+        if ((placed = [page createImageByPlacingImage: source])) {
+            target = page;
+            break;
+        }
+    }
+
+    if (!placed) {
+        TKImageAtlasPage *page = [[TKImageAtlasPage alloc] initWithSize: _pageSize scale: image.scale];
+        if (page) {
+            [_pages addObject: page];
+            _pageCount++;
+
+            placed = [page createImageByPlacingImage: source];
+            target = page;
+            [page release];
+        }
+    }
+
+    if (!placed) {
+        pthread_mutex_unlock(&_lock);
+        return image;
+    }
+
+    size_t bottom = target.bottom;
+    _imageCount++;
+    _packedPixels += width * height;
+    _unpackedBytes += TKImageAtlasBitmapBytes(width, height);
+
+    // Pages with hardly any room left only slow down the search
+    if (_pageSize - bottom < _pageSize / 16)
+        [_pages removeObjectIdenticalTo: target];
+
+    pthread_mutex_unlock(&_lock);
+
+    UIImage *packed = [UIImage imageWithCGImage: placed scale: image.scale orientation: image.imageOrientation];
+    CGImageRelease(placed);
+
+    objc_setAssociatedObject(packed, &TKImageAtlasPackedKey, (id)kCFBooleanTrue, OBJC_ASSOCIATION_ASSIGN);
+
+    return packed;
+}
+
+- (void)removeAllPages {
+    pthread_mutex_lock(&_lock);
+
+    [_pages removeAllObjects];
+    _pageCount = 0;
+    _imageCount = 0;
+    _packedPixels = 0;
+    _unpackedBytes = 0;
+
+    pthread_mutex_unlock(&_lock);
+}
+
+- (NSDictionary *)statistics {
+    pthread_mutex_lock(&_lock);
+
+    // Pages only take memory down to their lowest image, the full pages are not around to ask any more
+    uint64_t pageBytes = 0;
+    uint64_t openPixels = 0;
+    for (TKImageAtlasPage *page in _pages) {
+        pageBytes += TKImageAtlasBitmapBytes(_pageSize, page.bottom);
+        openPixels += (uint64_t)_pageSize * (_pageSize - page.bottom);
+    }
+
+    NSUInteger fullPages = _pageCount - [_pages count];
+    pageBytes += fullPages * TKImageAtlasBitmapBytes(_pageSize, _pageSize);
+
+    uint64_t totalPixels = (uint64_t)_pageCount * _pageSize * _pageSize - openPixels;
+    double efficiency = totalPixels > 0 ? (double)_packedPixels / totalPixels : 0;
+
+    NSDictionary *statistics = [NSDictionary dictionaryWithObjectsAndKeys:
+                                [NSNumber numberWithUnsignedInteger: _pageCount], @"pages",
+                                [NSNumber numberWithUnsignedInteger: _imageCount], @"images",
+                                [NSNumber numberWithDouble: efficiency], @"efficiency",
+                                [NSNumber numberWithUnsignedLongLong: pageBytes], @"bytes",
+                                [NSNumber numberWithLongLong: (long long)_unpackedBytes - (long long)pageBytes], @"bytesSaved",
+                                [NSNumber numberWithInteger: (NSInteger)_imageCount - (NSInteger)_pageCount], @"bitmapsSaved", nil];
+
+    pthread_mutex_unlock(&_lock);
+
+    return statistics;
+}
+
+- (void)dealloc {
+    [_pages release];
+    pthread_mutex_destroy(&_lock);
+
+    [super dealloc];
+}
+
+@end
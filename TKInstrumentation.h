@@ -0,0 +1,69 @@
+//
+//  TKInstrumentation.h
+//  ThemeEngine
+//
+//  Timers for the phases of the engine (parsing, building views, compiling and replaying display lists,
+//  rasterizing images) and counters of what was drawn. Everything is recorded with atomic operations into
+//  fixed tables, so it can be used from the render workers as well, and costs a function call and a check
+//  of a flag while it is disabled. Set kInstrumentationEnabled to 0 to compile all of it out
+//
+//  Durations are kept in histograms with four buckets for every power of two nanoseconds, the percentiles
+//  in the snapshots are accurate to about 10%
+//
+//  Copyright (c) 2012 __MyCompanyName__. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+// Macro that will compile the instrumentation in, set to 0 to leave it out completely
+#define kInstrumentationEnabled 1
+
+typedef enum { TKInstrumentationPhaseParse,         // JSON data into descriptions
+               TKInstrumentationPhaseArchive,       // Loading compiled themes
+               TKInstrumentationPhaseBuild,         // Descriptions into view hierarchies
+               TKInstrumentationPhaseCompile,       // Descriptions into display lists
+               TKInstrumentationPhaseDraw,          // Replaying display lists
+               TKInstrumentationPhaseRasterize,     // Images of views and descriptions
+               TKInstrumentationPhaseCount } TKInstrumentationPhase;
+
+typedef enum { TKInstrumentationCounterRectangles,      // Items drawn, by type
+               TKInstrumentationCounterEllipses,
+               TKInstrumentationCounterPaths,
+               TKInstrumentationCounterCulledItems,     // Items outside of the dirty rect
+               TKInstrumentationCounterShadowMasks,     // Blurred masks rendered for shadows
+               TKInstrumentationCounterTextRunsDrawn,   // Static labels drawn into images (see TKTextRun.h)
+               TKInstrumentationCounterTextRunsReused,  // Static labels shown from an image drawn before
+               TKInstrumentationCounterCount } TKInstrumentationCounter;
+
+// Called on the thread that finished the phase, times in nanoseconds since an arbitrary point
+typedef void (^TKInstrumentationTraceHandler)(TKInstrumentationPhase phase, uint64_t start, uint64_t duration);
+
+// Off by default, nothing is recorded until it is enabled
+void TKInstrumentationSetEnabled(BOOL enabled);
+BOOL TKInstrumentationIsEnabled(void);
+
+// Optional, every finished phase is also passed to the handler while the instrumentation is enabled
+void TKInstrumentationSetTraceHandler(TKInstrumentationTraceHandler handler);
+
+NSString *TKInstrumentationPhaseName(TKInstrumentationPhase phase);
+NSString *TKInstrumentationCounterName(TKInstrumentationCounter counter);
+
+// Phases (count, total, mean, max and the 50th, 90th and 99th percentiles in seconds) and counters,
+// keyed by their names, under "phases" and "counters"
+NSDictionary *TKInstrumentationSnapshot(void);
+void TKInstrumentationReset(void);
+
+// Recording, meant to be used through the macros below. Begin returns 0 while disabled
+uint64_t TKInstrumentationBegin(void);
+void TKInstrumentationEnd(TKInstrumentationPhase phase, uint64_t start);
+void TKInstrumentationCount(TKInstrumentationCounter counter, int64_t amount);
+
+#if kInstrumentationEnabled
+#define TKInstrumentBegin(timer) uint64_t timer = TKInstrumentationBegin()
+#define TKInstrumentEnd(phase, timer) TKInstrumentationEnd(phase, timer)
+#define TKInstrumentCount(counter, amount) TKInstrumentationCount(counter, amount)
+#else
+#define TKInstrumentBegin(timer)
+#define TKInstrumentEnd(phase, timer)
+#define TKInstrumentCount(counter, amount)
+#endif
@@ -0,0 +1,221 @@
+//
+//  TKInstrumentation.m
+//  ThemeEngine
+//
+//  Copyright (c) 2012 __MyCompanyName__. All rights reserved.
+//
+
+#import "TKInstrumentation.h"
+#import <libkern/OSAtomic.h>
+#import <mach/mach_time.h>
+
+// Four buckets for every power of two, enough for any 64 bit duration
+#define kInstrumentationBucketCount 256
+
+typedef struct {
+    volatile int64_t count;
+    volatile int64_t total;
+    volatile int64_t max;
+    volatile int64_t buckets[kInstrumentationBucketCount];
+} TKInstrumentationTimer;
+
+static volatile int32_t TKInstrumentationEnabledFlag = 0;
+static TKInstrumentationTimer TKInstrumentationTimers[TKInstrumentationPhaseCount];
+static volatile int64_t TKInstrumentationCounters[TKInstrumentationCounterCount];
+
+static OSSpinLock TKInstrumentationTraceLock = OS_SPINLOCK_INIT;
+static TKInstrumentationTraceHandler TKInstrumentationTrace = nil;
+
+#pragma mark - Time
+
+static uint64_t TKInstrumentationNanoseconds(uint64_t ticks) {
+    static mach_timebase_info_data_t timebase;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        mach_timebase_info(&timebase);
+    });
+
+    return ticks * timebase.numer / timebase.denom;
+}
+
+static NSUInteger TKInstrumentationBucketForDuration(uint64_t duration) {
+    if (duration < 4)
+        return (NSUInteger)duration;
+
+    // The power of two, followed by the two bits after the leading one
+    NSUInteger exponent = 63 - __builtin_clzll(duration);
+    NSUInteger fraction = (duration >> (exponent - 2)) & 3;
+
+    return 4 * (exponent - 1) + fraction;
+}
+
+// Middle of the durations that end up in the bucket
+static double TKInstrumentationDurationForBucket(NSUInteger bucket) {
+    if (bucket < 4)
+        return bucket;
+
+    NSUInteger exponent = bucket / 4 + 1;
+    double width = (double)(1ULL << (exponent - 2));
+
+    return (4 + bucket % 4) * width + width / 2.0;
+}
+
+#pragma mark - Recording
+
+void TKInstrumentationSetEnabled(BOOL enabled) {
+    TKInstrumentationEnabledFlag = enabled ? 1 : 0;
+    OSMemoryBarrier();
+}
+
+BOOL TKInstrumentationIsEnabled(void) {
+    return TKInstrumentationEnabledFlag != 0;
+}
+
+void TKInstrumentationSetTraceHandler(TKInstrumentationTraceHandler handler) {
+    handler = [handler copy];
+
+    OSSpinLockLock(&TKInstrumentationTraceLock);
+    TKInstrumentationTraceHandler previous = TKInstrumentationTrace;
+    TKInstrumentationTrace = handler;
+    OSSpinLockUnlock(&TKInstrumentationTraceLock);
+
+    [previous release];
+}
+
+uint64_t TKInstrumentationBegin(void) {
+    if (!TKInstrumentationEnabledFlag)
+        return 0;
+
+    return mach_absolute_time();
+}
+
+void TKInstrumentationEnd(TKInstrumentationPhase phase, uint64_t start) {
+    // Phases that started while the instrumentation was disabled are not recorded
+    if (start == 0 || !TKInstrumentationEnabledFlag)
+        return;
+
+    uint64_t end = mach_absolute_time();
+    int64_t duration = (int64_t)TKInstrumentationNanoseconds(end - start);
+
+    TKInstrumentationTimer *timer = &TKInstrumentationTimers[phase];
+    OSAtomicIncrement64(&timer->count);
+    OSAtomicAdd64(duration, &timer->total);
+    OSAtomicIncrement64(&timer->buckets[TKInstrumentationBucketForDuration(duration)]);
+
+    int64_t max;
+    do {
+        max = timer->max;
+    } while (duration > max && !OSAtomicCompareAndSwap64(max, duration, &timer->max));
+
+    if (!TKInstrumentationTrace)
+        return;
+
+    OSSpinLockLock(&TKInstrumentationTraceLock);
+    TKInstrumentationTraceHandler handler = [TKInstrumentationTrace retain];
+    OSSpinLockUnlock(&TKInstrumentationTraceLock);
+
+    if (handler)
+        handler(phase, TKInstrumentationNanoseconds(start), (uint64_t)duration);
+
+    [handler release];
+}
+
+void TKInstrumentationCount(TKInstrumentationCounter counter, int64_t amount) {
+    if (TKInstrumentationEnabledFlag)
+        OSAtomicAdd64(amount, &TKInstrumentationCounters[counter]);
+}
+
+#pragma mark - Snapshots
+
+NSString *TKInstrumentationPhaseName(TKInstrumentationPhase phase) {
+    switch (phase) {
+        case TKInstrumentationPhaseParse:
+            return @"parse";
+        case TKInstrumentationPhaseArchive:
+            return @"archive";
+        case TKInstrumentationPhaseBuild:
+            return @"build";
+        case TKInstrumentationPhaseCompile:
+            return @"compile";
+        case TKInstrumentationPhaseDraw:
+            return @"draw";
+        case TKInstrumentationPhaseRasterize:
+            return @"rasterize";
+        default:
+            return nil;
+    }
+}
+
+NSString *TKInstrumentationCounterName(TKInstrumentationCounter counter) {
+    switch (counter) {
+        case TKInstrumentationCounterRectangles:
+            return @"rectangles";
+        case TKInstrumentationCounterEllipses:
+            return @"ellipses";
+        case TKInstrumentationCounterPaths:
+            return @"paths";
+        case TKInstrumentationCounterCulledItems:
+            return @"culledItems";
+        case TKInstrumentationCounterShadowMasks:
+            return @"shadowMasks";
+        case TKInstrumentationCounterTextRunsDrawn:
+            return @"textRunsDrawn";
+        case TKInstrumentationCounterTextRunsReused:
+            return @"textRunsReused";
+        default:
+            return nil;
+    }
+}
+
+static NSNumber *TKInstrumentationPercentile(const int64_t *buckets, int64_t count, double percentile) {
+    int64_t target = (int64_t)ceil(percentile * count);
+    int64_t seen = 0;
+
+    for (NSUInteger i = 0; i < kInstrumentationBucketCount; i++) {
+        seen += buckets[i];
+        if (seen >= target && seen > 0)
+            return [NSNumber numberWithDouble: TKInstrumentationDurationForBucket(i) / NSEC_PER_SEC];
+    }
+
+    return [NSNumber numberWithDouble: 0.0];
+}
+
+NSDictionary *TKInstrumentationSnapshot(void) {
+    NSMutableDictionary *phases = [NSMutableDictionary dictionaryWithCapacity: TKInstrumentationPhaseCount];
+
+    for (NSUInteger phase = 0; phase < TKInstrumentationPhaseCount; phase++) {
+        // Copied first, so the percentiles come from a single state of the histogram
+        TKInstrumentationTimer timer;
+        memcpy(&timer, (const void *)&TKInstrumentationTimers[phase], sizeof(TKInstrumentationTimer));
+
+        int64_t count = 0;
+        for (NSUInteger i = 0; i < kInstrumentationBucketCount; i++) {
+            count += timer.buckets[i];
+        }
+
+        double total = (double)timer.total / NSEC_PER_SEC;
+        NSDictionary *statistics = [NSDictionary dictionaryWithObjectsAndKeys:
+                                    [NSNumber numberWithLongLong: count], @"count",
+                                    [NSNumber numberWithDouble: total], @"total",
+                                    [NSNumber numberWithDouble: count > 0 ? total / count : 0.0], @"mean",
+                                    [NSNumber numberWithDouble: (double)timer.max / NSEC_PER_SEC], @"max",
+                                    TKInstrumentationPercentile((const int64_t *)timer.buckets, count, 0.5), @"p50",
+                                    TKInstrumentationPercentile((const int64_t *)timer.buckets, count, 0.9), @"p90",
+                                    TKInstrumentationPercentile((const int64_t *)timer.buckets, count, 0.99), @"p99", nil];
+
+        [phases setObject: statistics forKey: TKInstrumentationPhaseName(phase)];
+    }
+
+    NSMutableDictionary *counters = [NSMutableDictionary dictionaryWithCapacity: TKInstrumentationCounterCount];
+    for (NSUInteger counter = 0; counter < TKInstrumentationCounterCount; counter++) {
+        [counters setObject: [NSNumber numberWithLongLong: TKInstrumentationCounters[counter]] forKey: TKInstrumentationCounterName(counter)];
+    }
+
+    return [NSDictionary dictionaryWithObjectsAndKeys: phases, @"phases", counters, @"counters", nil];
+}
+
+void TKInstrumentationReset(void) {
+    // Not atomic as a whole, anything recorded at the same time may be partly kept
+    memset((void *)TKInstrumentationTimers, 0, sizeof(TKInstrumentationTimers));
+    memset((void *)TKInstrumentationCounters, 0, sizeof(TKInstrumentationCounters));
+}
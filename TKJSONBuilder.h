@@ -0,0 +1,28 @@
+//
+//  TKJSONBuilder.h
+//  ThemeEngine
+//
+//  Builds the descriptions straight from the events of TKJSONReader, there is no intermediate graph of
+//  mutable containers to walk and copy again. Keys and short strings are interned, every distinct one is
+//  created once per document, as they repeat all over a theme ("type", "size", "#FFF", ...)
+//
+//  Views deep in the hierarchy are not built while reading. They become dictionaries over their byte range
+//  of the data, which build the whole subtree the first time anything inside of them is asked for. Their
+//  structural hash is computed from the bytes, so hashing the theme does not build them either
+//
+//  Copyright (c) 2012 __MyCompanyName__. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+// Views nested at least this many levels below the outermost view are built when first accessed
+#define kJSONLazyViewDepth 2
+
+// Immutable dictionaries and arrays (see TKHash.h) of the JSON data, nil (logged) if it is not valid. Views (the dictionaries in "subviews")
+// nested lazyViewDepth or more levels below the outermost one keep the data and are built on first access, NSUIntegerMax
+// builds everything right away
+id TKJSONObjectFromData(NSData *data, NSUInteger lazyViewDepth);
+
+// NO only for views that are not built yet and whose bytes do not have the key anywhere, so walks over the theme that
+// look for a key can leave them unbuilt. A string value equal to the key counts as the key, an escaped spelling doesn't
+BOOL TKJSONObjectMayContainKey(id object, NSString *key);
@@ -0,0 +1,393 @@
+//
+//  TKJSONBuilder.m
+//  ThemeEngine
+//
+//  Copyright (c) 2012 __MyCompanyName__. All rights reserved.
+//
+
+#import "TKJSONBuilder.h"
+#import "TKJSONReader.h"
+#import "TKConstants.h"
+#import "TKHash.h"
+
+#import <libkern/OSAtomic.h>
+
+// Longest string that is interned, longer ones are hardly ever repeated
+#define kJSONInternedStringLength 32
+
+static id TKJSONObjectFromRange(NSData *data, NSRange range, NSUInteger lazyViewDepth);
+
+#pragma mark - Lazy views
+
+@interface TKLazyJSONDictionary : NSDictionary {
+    NSData *_data;
+    NSRange _range;
+
+    NSDictionary *_dictionary;
+
+    TKStructuralHash _hash;
+    volatile BOOL _hasHash;
+}
+
+- (id)initWithData: (NSData *)data range: (NSRange)range;
+- (BOOL)bytesContainKey: (NSString *)key;
+
+@end
+
+@implementation TKLazyJSONDictionary
+
+- (id)initWithData: (NSData *)data range: (NSRange)range {
+    if ((self = [super init])) {
+        _data = [data retain];
+        _range = range;
+    }
+
+    return self;
+}
+
+// Built once, the bytes have already been checked while reading the document
+- (NSDictionary *)builtDictionary {
+    NSDictionary *dictionary = _dictionary;
+    if (dictionary)
+        return dictionary;
+
+    dictionary = [TKJSONObjectFromRange(_data, _range, NSUIntegerMax) retain];
+    if (![dictionary isKindOfClass: [NSDictionary class]]) {
+        [dictionary release];
+        dictionary = [[TKImmutableDictionary alloc] initWithObjects: NULL forKeys: NULL count: 0];
+    }
+
+    // Another thread may have been faster, keep theirs in that case
+    if (!OSAtomicCompareAndSwapPtrBarrier(nil, dictionary, (void * volatile *)&_dictionary)) {
+        [dictionary release];
+        dictionary = _dictionary;
+    }
+
+    return dictionary;
+}
+
+- (NSUInteger)count {
+    return [[self builtDictionary] count];
+}
+
+- (id)objectForKey: (id)key {
+    return [[self builtDictionary] objectForKey: key];
+}
+
+- (NSEnumerator *)keyEnumerator {
+    return [[self builtDictionary] keyEnumerator];
+}
+
+- (BOOL)isImmutableDescription {
+    return YES;
+}
+
+// The key in quotes anywhere in the bytes
+- (BOOL)bytesContainKey: (NSString *)key {
+    const char *string = [key UTF8String];
+    size_t length = strlen(string);
+    char *quoted = (char *)malloc(length + 2);
+    quoted[0] = quoted[length + 1] = '"';
+    memcpy(quoted + 1, string, length);
+
+    BOOL found = memmem((const char *)[_data bytes] + _range.location, _range.length, quoted, length + 2) != NULL;
+    free(quoted);
+
+    return found;
+}
+
+// From the bytes, the dictionary does not need to be built for it
+- (TKStructuralHash)structuralHash {
+    if (!_hasHash) {
+        _hash = TKStructuralHashForJSONBytes((const char *)[_data bytes] + _range.location, _range.length);
+        OSMemoryBarrier();
+        _hasHash = YES;
+    }
+
+    return _hash;
+}
+
+- (void)dealloc {
+    [_dictionary release];
+    [_data release];
+
+    [super dealloc];
+}
+
+@end
+
+BOOL TKJSONObjectMayContainKey(id object, NSString *key) {
+    if (![object isKindOfClass: [TKLazyJSONDictionary class]])
+        return YES;
+
+    return [object bytesContainKey: key];
+}
+
+#pragma mark - Interned strings
+
+typedef struct {
+    uint32_t hash;
+    uint32_t length;
+    char *bytes;
+    NSString *string;
+} TKJSONInternedString;
+
+typedef struct {
+    TKJSONInternedString *entries;
+    NSUInteger capacity;
+    NSUInteger count;
+} TKJSONStringTable;
+
+static uint32_t TKJSONStringHash(const char *bytes, size_t length) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < length; i++) {
+        hash = (hash ^ (uint8_t)bytes[i]) * 16777619u;
+    }
+
+    return hash;
+}
+
+static void TKJSONStringTableFree(TKJSONStringTable *table) {
+    for (NSUInteger i = 0; i < table->capacity; i++) {
+        free(table->entries[i].bytes);
+        [table->entries[i].string release];
+    }
+
+    free(table->entries);
+}
+
+// Open addressing, grows at half load
+static TKJSONInternedString *TKJSONStringTableSlot(TKJSONInternedString *entries, NSUInteger capacity, uint32_t hash,
+                                                   const char *bytes, size_t length) {
+    NSUInteger index = hash & (capacity - 1);
+    while (entries[index].string) {
+        TKJSONInternedString *entry = &entries[index];
+        if (entry->hash == hash && entry->length == length && memcmp(entry->bytes, bytes, length) == 0)
+            return entry;
+
+        index = (index + 1) & (capacity - 1);
+    }
+
+    return &entries[index];
+}
+
+// Returns a new reference
+static NSString *TKJSONCreateString(TKJSONStringTable *table, const char *bytes, size_t length) {
+    if (length > kJSONInternedStringLength)
+        return [[NSString alloc] initWithBytes: bytes length: length encoding: NSUTF8StringEncoding];
+
+    if ((table->count + 1) * 2 > table->capacity) {
+        NSUInteger capacity = table->capacity ? table->capacity * 2 : 256;
+        TKJSONInternedString *entries = (TKJSONInternedString *)calloc(capacity, sizeof(TKJSONInternedString));
+
+        for (NSUInteger i = 0; i < table->capacity; i++) {
+            TKJSONInternedString *entry = &table->entries[i];
+            if (entry->string)
+                *TKJSONStringTableSlot(entries, capacity, entry->hash, entry->bytes, entry->length) = *entry;
+        }
+
+        free(table->entries);
+        table->entries = entries;
+        table->capacity = capacity;
+    }
+
+    uint32_t hash = TKJSONStringHash(bytes, length);
+    TKJSONInternedString *entry = TKJSONStringTableSlot(table->entries, table->capacity, hash, bytes, length);
+
+    if (!entry->string) {
+        entry->string = [[NSString alloc] initWithBytes: bytes length: length encoding: NSUTF8StringEncoding];
+        if (!entry->string)
+            return nil;
+
+        entry->hash = hash;
+        entry->length = (uint32_t)length;
+        entry->bytes = (char *)malloc(MAX(length, 1));
+        memcpy(entry->bytes, bytes, length);
+        table->count++;
+    }
+
+    return [entry->string retain];
+}
+
+#pragma mark - Building
+
+typedef struct {
+    BOOL isDictionary;
+    BOOL isLazy;
+    BOOL isSubviews;            // Array of the "subviews" key
+    size_t offset;              // Of the opening bracket
+    NSUInteger valueStart;
+    NSUInteger keyStart;
+} TKJSONBuilderFrame;
+
+typedef struct {
+    NSData *data;
+    NSUInteger dataOffset;
+    NSUInteger lazyViewDepth;
+
+    TKJSONBuilderFrame *frames;
+    NSUInteger depth;
+    NSUInteger subviewsDepth;   // Open "subviews" arrays
+
+    // Finished values (and keys) waiting for their containers to end, retained
+    id *values;
+    NSUInteger valueCount;
+    NSUInteger valueCapacity;
+
+    id *keys;
+    NSUInteger keyCount;
+    NSUInteger keyCapacity;
+
+    TKJSONStringTable strings;
+} TKJSONBuilder;
+
+static BOOL TKJSONBuilderPush(id **stack, NSUInteger *count, NSUInteger *capacity, id object) {
+    if (!object)
+        return NO;
+
+    if (*count == *capacity) {
+        *capacity = *capacity ? *capacity * 2 : 64;
+        *stack = (id *)realloc(*stack, *capacity * sizeof(id));
+    }
+
+    (*stack)[(*count)++] = object;
+    return YES;
+}
+
+static BOOL TKJSONBuilderPushValue(TKJSONBuilder *builder, id value) {
+    return TKJSONBuilderPush(&builder->values, &builder->valueCount, &builder->valueCapacity, value);
+}
+
+static TKJSONAction TKJSONBuilderEvent(const TKJSONEvent *event, void *info) {
+    TKJSONBuilder *builder = (TKJSONBuilder *)info;
+    TKJSONBuilderFrame *parent = builder->depth > 0 ? &builder->frames[builder->depth - 1] : NULL;
+    id value = nil;
+
+    switch (event->type) {
+        case TKJSONEventBeginObject:
+        case TKJSONEventBeginArray: {
+            TKJSONBuilderFrame *frame = &builder->frames[builder->depth++];
+            frame->isDictionary = (event->type == TKJSONEventBeginObject);
+            frame->isLazy = NO;
+            frame->isSubviews = NO;
+            frame->offset = event->offset;
+            frame->valueStart = builder->valueCount;
+            frame->keyStart = builder->keyCount;
+
+            if (!frame->isDictionary) {
+                // The key of the array is the last one of the dictionary it is in
+                if (parent && parent->isDictionary && builder->keyCount > parent->keyStart &&
+                    [builder->keys[builder->keyCount - 1] isEqualToString: SubviewSectionKey]) {
+                    frame->isSubviews = YES;
+                    builder->subviewsDepth++;
+                }
+            } else if (parent && parent->isSubviews && builder->subviewsDepth >= builder->lazyViewDepth) {
+                frame->isLazy = YES;
+                return TKJSONActionSkip;
+            }
+
+            return TKJSONActionContinue;
+        }
+        case TKJSONEventEndObject:
+        case TKJSONEventEndArray: {
+            TKJSONBuilderFrame *frame = &builder->frames[--builder->depth];
+            NSUInteger count = builder->valueCount - frame->valueStart;
+
+            if (frame->isLazy) {
+                NSRange range = NSMakeRange(builder->dataOffset + frame->offset, event->offset + 1 - frame->offset);
+                value = [[TKLazyJSONDictionary alloc] initWithData: builder->data range: range];
+            } else if (frame->isDictionary) {
+                value = [[TKImmutableDictionary alloc] initWithObjects: builder->values + frame->valueStart
+                                                              forKeys: builder->keys + frame->keyStart count: count];
+            } else {
+                value = [[TKImmutableArray alloc] initWithObjects: builder->values + frame->valueStart count: count];
+            }
+
+            if (frame->isSubviews)
+                builder->subviewsDepth--;
+
+            // The container holds on to them now
+            for (NSUInteger i = frame->valueStart; i < builder->valueCount; i++) {
+                [builder->values[i] release];
+            }
+            for (NSUInteger i = frame->keyStart; i < builder->keyCount; i++) {
+                [builder->keys[i] release];
+            }
+
+            builder->valueCount = frame->valueStart;
+            builder->keyCount = frame->keyStart;
+            break;
+        }
+        case TKJSONEventKey: {
+            NSString *key = TKJSONCreateString(&builder->strings, event->bytes, event->length);
+            return TKJSONBuilderPush(&builder->keys, &builder->keyCount, &builder->keyCapacity, key) ? TKJSONActionContinue : TKJSONActionStop;
+        }
+        case TKJSONEventString:
+            value = TKJSONCreateString(&builder->strings, event->bytes, event->length);
+            break;
+        case TKJSONEventNumber:
+            if (event->isInteger)
+                value = [[NSNumber alloc] initWithLongLong: event->integer];
+            else
+                value = [[NSNumber alloc] initWithDouble: event->number];
+            break;
+        case TKJSONEventTrue:
+            value = (id)CFRetain(kCFBooleanTrue);
+            break;
+        case TKJSONEventFalse:
+            value = (id)CFRetain(kCFBooleanFalse);
+            break;
+        case TKJSONEventNull:
+            value = [[NSNull null] retain];
+            break;
+    }
+
+    return TKJSONBuilderPushValue(builder, value) ? TKJSONActionContinue : TKJSONActionStop;
+}
+
+static id TKJSONObjectFromRange(NSData *data, NSRange range, NSUInteger lazyViewDepth) {
+    TKJSONBuilder builder;
+    memset(&builder, 0, sizeof(TKJSONBuilder));
+    builder.data = data;
+    builder.dataOffset = range.location;
+    builder.lazyViewDepth = MAX(lazyViewDepth, 1);
+    builder.frames = (TKJSONBuilderFrame *)malloc(kJSONReaderMaximumDepth * sizeof(TKJSONBuilderFrame));
+
+    TKJSONReader reader;
+    TKJSONReaderInit(&reader);
+
+    size_t errorOffset = 0;
+    BOOL valid = TKJSONRead(&reader, (const char *)[data bytes] + range.location, range.length, TKJSONBuilderEvent, &builder, &errorOffset);
+
+    // The single value left is the document
+    id object = nil;
+    if (valid && builder.valueCount == 1)
+        object = [builder.values[0] autorelease];
+    else
+        NSLog(@"Error! JSON is not valid at byte %lu", (unsigned long)(range.location + errorOffset));
+
+    if (!object) {
+        for (NSUInteger i = 0; i < builder.valueCount; i++) {
+            [builder.values[i] release];
+        }
+    }
+
+    for (NSUInteger i = 0; i < builder.keyCount; i++) {
+        [builder.keys[i] release];
+    }
+
+    TKJSONReaderFree(&reader);
+    TKJSONStringTableFree(&builder.strings);
+    free(builder.frames);
+    free(builder.values);
+    free(builder.keys);
+
+    return object;
+}
+
+id TKJSONObjectFromData(NSData *data, NSUInteger lazyViewDepth) {
+    if (!data)
+        return nil;
+
+    return TKJSONObjectFromRange(data, NSMakeRange(0, [data length]), lazyViewDepth);
+}
@@ -0,0 +1,527 @@
+//
+//  TKJSONReader.c
+//  ThemeEngine
+//
+//  Copyright (c) 2012 __MyCompanyName__. All rights reserved.
+//
+
+#include "TKJSONReader.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// What the reader expects next
+typedef enum { TKJSONExpectValue,
+               TKJSONExpectFirstValue,          // Right after [, either a value or ]
+               TKJSONExpectFirstKey,            // Right after {, either a key or }
+               TKJSONExpectKey,
+               TKJSONExpectColon,
+               TKJSONExpectSeparator } TKJSONExpectation;
+
+#pragma mark - Reader
+
+void TKJSONReaderInit(TKJSONReader *reader) {
+    reader->scratch = NULL;
+    reader->scratchCapacity = 0;
+}
+
+void TKJSONReaderFree(TKJSONReader *reader) {
+    free(reader->scratch);
+    TKJSONReaderInit(reader);
+}
+
+static bool TKJSONReaderReserve(TKJSONReader *reader, size_t capacity) {
+    if (capacity <= reader->scratchCapacity)
+        return true;
+
+    size_t newCapacity = reader->scratchCapacity ? reader->scratchCapacity : 256;
+    while (newCapacity < capacity) {
+        newCapacity *= 2;
+    }
+
+    char *scratch = (char *)realloc(reader->scratch, newCapacity);
+    if (!scratch)
+        return false;
+
+    reader->scratch = scratch;
+    reader->scratchCapacity = newCapacity;
+    return true;
+}
+
+#pragma mark - Tokens
+
+static inline size_t TKJSONSkipWhitespace(const char *bytes, size_t length, size_t position) {
+    while (position < length) {
+        char character = bytes[position];
+        if (character != ' ' && character != '\t' && character != '\n' && character != '\r')
+            break;
+
+        position++;
+    }
+
+    return position;
+}
+
+static inline int TKJSONHexValue(char character) {
+    if (character >= '0' && character <= '9')
+        return character - '0';
+    if (character >= 'a' && character <= 'f')
+        return character - 'a' + 10;
+    if (character >= 'A' && character <= 'F')
+        return character - 'A' + 10;
+
+    return -1;
+}
+
+static bool TKJSONReadHex(const char *bytes, size_t length, size_t position, uint32_t *value) {
+    if (position + 4 > length)
+        return false;
+
+    *value = 0;
+    for (size_t i = 0; i < 4; i++) {
+        int digit = TKJSONHexValue(bytes[position + i]);
+        if (digit < 0)
+            return false;
+
+        *value = (*value << 4) | (uint32_t)digit;
+    }
+
+    return true;
+}
+
+static size_t TKJSONEncodeUTF8(uint32_t codePoint, char *destination) {
+    if (codePoint < 0x80) {
+        destination[0] = (char)codePoint;
+        return 1;
+    } else if (codePoint < 0x800) {
+        destination[0] = (char)(0xC0 | (codePoint >> 6));
+        destination[1] = (char)(0x80 | (codePoint & 0x3F));
+        return 2;
+    } else if (codePoint < 0x10000) {
+        destination[0] = (char)(0xE0 | (codePoint >> 12));
+        destination[1] = (char)(0x80 | ((codePoint >> 6) & 0x3F));
+        destination[2] = (char)(0x80 | (codePoint & 0x3F));
+        return 3;
+    }
+
+    destination[0] = (char)(0xF0 | (codePoint >> 18));
+    destination[1] = (char)(0x80 | ((codePoint >> 12) & 0x3F));
+    destination[2] = (char)(0x80 | ((codePoint >> 6) & 0x3F));
+    destination[3] = (char)(0x80 | (codePoint & 0x3F));
+    return 4;
+}
+
+// Length of the UTF-8 sequence at position, 0 if it is not valid (overlong forms and surrogates included)
+static size_t TKJSONUTF8SequenceLength(const uint8_t *bytes, size_t length, size_t position) {
+    uint8_t lead = bytes[position];
+    size_t count;
+    uint32_t codePoint;
+
+    if (lead >= 0xC2 && lead <= 0xDF) {
+        count = 2;
+        codePoint = lead & 0x1F;
+    } else if (lead >= 0xE0 && lead <= 0xEF) {
+        count = 3;
+        codePoint = lead & 0x0F;
+    } else if (lead >= 0xF0 && lead <= 0xF4) {
+        count = 4;
+        codePoint = lead & 0x07;
+    } else {
+        return 0;
+    }
+
+    if (position + count > length)
+        return 0;
+
+    for (size_t i = 1; i < count; i++) {
+        if ((bytes[position + i] & 0xC0) != 0x80)
+            return 0;
+
+        codePoint = (codePoint << 6) | (bytes[position + i] & 0x3F);
+    }
+
+    if ((count == 3 && codePoint < 0x800) || (count == 4 && (codePoint < 0x10000 || codePoint > 0x10FFFF)) ||
+        (codePoint >= 0xD800 && codePoint <= 0xDFFF))
+        return 0;
+
+    return count;
+}
+
+// Reads the string starting with the quote at *position, leaves *position after the closing quote (at the
+// offending byte on errors). Strings with escapes are decoded into the scratch buffer, unless decode is false
+static bool TKJSONReadString(TKJSONReader *reader, const char *bytes, size_t length, size_t *position, bool decode,
+                             const char **result, size_t *resultLength) {
+    size_t start = *position + 1;
+    size_t current = start;
+    bool escaped = false;
+
+    // Find the end first, checking everything but the escapes on the way
+    while (true) {
+        if (current >= length) {
+            *position = length;
+            return false;
+        }
+
+        uint8_t character = (uint8_t)bytes[current];
+        if (character == '"') {
+            break;
+        } else if (character == '\\') {
+            escaped = true;
+            current += 2;
+        } else if (character < 0x80) {
+            if (character < 0x20) {
+                *position = current;
+                return false;
+            }
+
+            current++;
+        } else {
+            size_t sequence = TKJSONUTF8SequenceLength((const uint8_t *)bytes, length, current);
+            if (sequence == 0) {
+                *position = current;
+                return false;
+            }
+
+            current += sequence;
+        }
+    }
+
+    *result = bytes + start;
+    *resultLength = current - start;
+
+    if (escaped) {
+        // Decoded strings are never longer than the escaped ones
+        if (decode && !TKJSONReaderReserve(reader, current - start)) {
+            *position = start;
+            return false;
+        }
+
+        char *destination = decode ? reader->scratch : NULL;
+        size_t written = 0;
+
+        for (size_t index = start; index < current; index++) {
+            char character = bytes[index];
+            if (character != '\\') {
+                if (decode)
+                    destination[written++] = character;
+                continue;
+            }
+
+            size_t escape = index++;
+            uint32_t codePoint = 0;
+            switch (bytes[index]) {
+                case '"':
+                case '\\':
+                case '/':
+                    codePoint = (uint32_t)bytes[index];
+                    break;
+                case 'b':
+                    codePoint = '\b';
+                    break;
+                case 'f':
+                    codePoint = '\f';
+                    break;
+                case 'n':
+                    codePoint = '\n';
+                    break;
+                case 'r':
+                    codePoint = '\r';
+                    break;
+                case 't':
+                    codePoint = '\t';
+                    break;
+                case 'u': {
+                    if (!TKJSONReadHex(bytes, current, index + 1, &codePoint) || (codePoint >= 0xDC00 && codePoint <= 0xDFFF)) {
+                        *position = escape;
+                        return false;
+                    }
+                    index += 4;
+
+                    // Surrogates have to come in pairs
+                    if (codePoint >= 0xD800 && codePoint <= 0xDBFF) {
+                        uint32_t low = 0;
+                        if (index + 2 >= current || bytes[index + 1] != '\\' || bytes[index + 2] != 'u' ||
+                            !TKJSONReadHex(bytes, current, index + 3, &low) || low < 0xDC00 || low > 0xDFFF) {
+                            *position = escape;
+                            return false;
+                        }
+
+                        codePoint = 0x10000 + ((codePoint - 0xD800) << 10) + (low - 0xDC00);
+                        index += 6;
+                    }
+                    break;
+                }
+                default:
+                    *position = escape;
+                    return false;
+            }
+
+            if (decode)
+                written += TKJSONEncodeUTF8(codePoint, destination + written);
+        }
+
+        if (decode) {
+            *result = destination;
+            *resultLength = written;
+        }
+    }
+
+    *position = current + 1;
+    return true;
+}
+
+// Reads the number starting at *position into the event, leaves *position after it
+static bool TKJSONReadNumber(TKJSONReader *reader, const char *bytes, size_t length, size_t *position, bool decode, TKJSONEvent *event) {
+    size_t start = *position;
+    size_t current = start;
+    bool negative = false;
+    bool isInteger = true;
+    uint64_t integer = 0;
+    size_t digits = 0;
+
+    if (current < length && bytes[current] == '-') {
+        negative = true;
+        current++;
+    }
+
+    // Integer part, no leading zeroes
+    if (current >= length || bytes[current] < '0' || bytes[current] > '9') {
+        *position = current;
+        return false;
+    }
+
+    if (bytes[current] == '0') {
+        current++;
+    } else {
+        while (current < length && bytes[current] >= '0' && bytes[current] <= '9') {
+            integer = integer * 10 + (uint64_t)(bytes[current] - '0');
+            digits++;
+            current++;
+        }
+    }
+
+    if (current < length && bytes[current] == '.') {
+        isInteger = false;
+        current++;
+
+        if (current >= length || bytes[current] < '0' || bytes[current] > '9') {
+            *position = current;
+            return false;
+        }
+
+        while (current < length && bytes[current] >= '0' && bytes[current] <= '9') {
+            current++;
+        }
+    }
+
+    if (current < length && (bytes[current] == 'e' || bytes[current] == 'E')) {
+        isInteger = false;
+        current++;
+
+        if (current < length && (bytes[current] == '+' || bytes[current] == '-'))
+            current++;
+
+        if (current >= length || bytes[current] < '0' || bytes[current] > '9') {
+            *position = current;
+            return false;
+        }
+
+        while (current < length && bytes[current] >= '0' && bytes[current] <= '9') {
+            current++;
+        }
+    }
+
+    *position = current;
+    if (!decode)
+        return true;
+
+    // Up to 19 digits can not overflow the accumulator, those that fit into 64 bits are exact. Longer integers
+    // go through strtod as well
+    uint64_t limit = negative ? (uint64_t)INT64_MAX + 1 : (uint64_t)INT64_MAX;
+    if (isInteger && digits <= 19 && integer <= limit) {
+        event->isInteger = true;
+        event->integer = negative ? (integer == limit ? INT64_MIN : -(int64_t)integer) : (int64_t)integer;
+        event->number = (double)event->integer;
+        return true;
+    }
+
+    // strtod needs the number terminated
+    size_t numberLength = current - start;
+    if (!TKJSONReaderReserve(reader, numberLength + 1))
+        return false;
+
+    memcpy(reader->scratch, bytes + start, numberLength);
+    reader->scratch[numberLength] = '\0';
+
+    event->isInteger = false;
+    event->number = strtod(reader->scratch, NULL);
+    return true;
+}
+
+static bool TKJSONReadLiteral(const char *bytes, size_t length, size_t *position, const char *literal, size_t literalLength) {
+    if (*position + literalLength > length || memcmp(bytes + *position, literal, literalLength) != 0)
+        return false;
+
+    *position += literalLength;
+    return true;
+}
+
+#pragma mark - Reading
+
+bool TKJSONRead(TKJSONReader *reader, const char *bytes, size_t length, TKJSONHandler handler, void *context, size_t *errorOffset) {
+    // Kind of every open container, { or [
+    char containers[kJSONReaderMaximumDepth];
+    size_t depth = 0;
+
+    // Depth of the container being skipped, 0 while events are passed to the handler
+    size_t skipDepth = 0;
+
+    TKJSONExpectation expectation = TKJSONExpectValue;
+    size_t position = TKJSONSkipWhitespace(bytes, length, 0);
+
+    while (true) {
+        if (position >= length)
+            goto fail;
+
+        TKJSONEvent event;
+        memset(&event, 0, sizeof(TKJSONEvent));
+        event.offset = position;
+
+        char character = bytes[position];
+        bool passes = (skipDepth == 0);
+
+        // End of the current container, after a value or right after it began
+        if ((character == '}' && (expectation == TKJSONExpectFirstKey || expectation == TKJSONExpectSeparator)) ||
+            (character == ']' && (expectation == TKJSONExpectFirstValue || expectation == TKJSONExpectSeparator))) {
+            if (character != (containers[depth - 1] == '{' ? '}' : ']'))
+                goto fail;
+
+            // The end of a skipped container is passed again
+            if (skipDepth == depth) {
+                skipDepth = 0;
+                passes = true;
+            }
+
+            depth--;
+            position++;
+
+            event.type = (character == '}') ? TKJSONEventEndObject : TKJSONEventEndArray;
+            if (passes && handler(&event, context) == TKJSONActionStop) {
+                position = event.offset;
+                goto fail;
+            }
+
+            if (depth == 0)
+                break;
+
+            expectation = TKJSONExpectSeparator;
+            position = TKJSONSkipWhitespace(bytes, length, position);
+            continue;
+        }
+
+        switch (expectation) {
+            case TKJSONExpectColon:
+                if (character != ':')
+                    goto fail;
+
+                position++;
+                expectation = TKJSONExpectValue;
+                break;
+
+            case TKJSONExpectSeparator:
+                if (character != ',')
+                    goto fail;
+
+                position++;
+                expectation = (containers[depth - 1] == '{') ? TKJSONExpectKey : TKJSONExpectValue;
+                break;
+
+            case TKJSONExpectFirstKey:
+            case TKJSONExpectKey:
+                if (character != '"')
+                    goto fail;
+
+                if (!TKJSONReadString(reader, bytes, length, &position, passes, &event.bytes, &event.length))
+                    goto fail;
+
+                event.type = TKJSONEventKey;
+                if (passes && handler(&event, context) == TKJSONActionStop) {
+                    position = event.offset;
+                    goto fail;
+                }
+
+                expectation = TKJSONExpectColon;
+                break;
+
+            case TKJSONExpectFirstValue:
+            case TKJSONExpectValue:
+                if (character == '{' || character == '[') {
+                    if (depth == kJSONReaderMaximumDepth)
+                        goto fail;
+
+                    containers[depth++] = character;
+                    position++;
+
+                    event.type = (character == '{') ? TKJSONEventBeginObject : TKJSONEventBeginArray;
+                    if (passes) {
+                        TKJSONAction action = handler(&event, context);
+                        if (action == TKJSONActionStop) {
+                            position = event.offset;
+                            goto fail;
+                        }
+                        else if (action == TKJSONActionSkip)
+                            skipDepth = depth;
+                    }
+
+                    expectation = (character == '{') ? TKJSONExpectFirstKey : TKJSONExpectFirstValue;
+                    break;
+                }
+
+                if (character == '"') {
+                    if (!TKJSONReadString(reader, bytes, length, &position, passes, &event.bytes, &event.length))
+                        goto fail;
+
+                    event.type = TKJSONEventString;
+                } else if (character == '-' || (character >= '0' && character <= '9')) {
+                    if (!TKJSONReadNumber(reader, bytes, length, &position, passes, &event))
+                        goto fail;
+
+                    event.type = TKJSONEventNumber;
+                } else if (TKJSONReadLiteral(bytes, length, &position, "true", 4)) {
+                    event.type = TKJSONEventTrue;
+                } else if (TKJSONReadLiteral(bytes, length, &position, "false", 5)) {
+                    event.type = TKJSONEventFalse;
+                } else if (TKJSONReadLiteral(bytes, length, &position, "null", 4)) {
+                    event.type = TKJSONEventNull;
+                } else {
+                    goto fail;
+                }
+
+                if (passes && handler(&event, context) == TKJSONActionStop) {
+                    position = event.offset;
+                    goto fail;
+                }
+
+                expectation = TKJSONExpectSeparator;
+                break;
+        }
+
+        // A single value at the top is the whole document
+        if (depth == 0 && expectation == TKJSONExpectSeparator)
+            break;
+
+        position = TKJSONSkipWhitespace(bytes, length, position);
+    }
+
+    // Nothing but whitespace may follow
+    position = TKJSONSkipWhitespace(bytes, length, position);
+    if (position != length)
+        goto fail;
+
+    return true;
+
+fail:
+    if (errorOffset)
+        *errorOffset = position < length ? position : length;
+    return false;
+}
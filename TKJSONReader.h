@@ -0,0 +1,81 @@
+//
+//  TKJSONReader.h
+//  ThemeEngine
+//
+//  Streaming JSON reader, plain C so that it can be shared with tools outside of UIKit. The bytes are
+//  walked once and every value is passed to a handler as soon as it has been read (SAX style), nothing
+//  is built by the reader itself. Strings without escapes point straight into the input, escaped ones
+//  are decoded into a scratch buffer of the reader, which is reused for any number of documents
+//
+//  The handler can skip a whole object or array when it begins, the reader then still checks its syntax,
+//  but passes nothing inside of it, only the end with the offset of the closing bracket. Along with the
+//  offset of the opening bracket that is the byte range of the subtree, which can be read on its own later
+//
+//  Copyright (c) 2012 __MyCompanyName__. All rights reserved.
+//
+
+#ifndef TKJSONReader_h
+#define TKJSONReader_h
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Deepest nesting of objects and arrays accepted
+#define kJSONReaderMaximumDepth 512
+
+typedef enum { TKJSONEventBeginObject,
+               TKJSONEventEndObject,
+               TKJSONEventBeginArray,
+               TKJSONEventEndArray,
+               TKJSONEventKey,              // bytes and length, UTF-8
+               TKJSONEventString,           // bytes and length, UTF-8
+               TKJSONEventNumber,           // number, and integer if isInteger
+               TKJSONEventTrue,
+               TKJSONEventFalse,
+               TKJSONEventNull } TKJSONEventType;
+
+typedef struct {
+    TKJSONEventType type;
+
+    // Offset of the first byte of the value, of the closing bracket for the ends
+    size_t offset;
+
+    // Only valid during the call, the bytes may be in the scratch buffer
+    const char *bytes;
+    size_t length;
+
+    double number;
+    int64_t integer;
+    bool isInteger;             // No fraction or exponent, and fits into 64 bits
+} TKJSONEvent;
+
+typedef enum { TKJSONActionContinue,
+               TKJSONActionSkip,            // Only from the beginnings, nothing inside is passed
+               TKJSONActionStop } TKJSONAction;
+
+typedef TKJSONAction (*TKJSONHandler)(const TKJSONEvent *event, void *context);
+
+typedef struct {
+    char *scratch;
+    size_t scratchCapacity;
+} TKJSONReader;
+
+void TKJSONReaderInit(TKJSONReader *reader);
+void TKJSONReaderFree(TKJSONReader *reader);
+
+// Reads the single value in bytes (UTF-8, not NUL terminated), surrounded by nothing but whitespace.
+// On a syntax error, or when the handler stops, false is returned and errorOffset (if not NULL) is set
+// to the offending byte (the first byte of the value the handler stopped at). Everything before it has
+// been passed to the handler by then
+bool TKJSONRead(TKJSONReader *reader, const char *bytes, size_t length, TKJSONHandler handler, void *context, size_t *errorOffset);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
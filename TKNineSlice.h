@@ -0,0 +1,28 @@
+//
+//  TKNineSlice.h
+//  ThemeEngine
+//
+//  Finds descriptions that look the same stretched as they would drawn at a larger size - plain rectangles
+//  (rounded or not) with fills, strokes and shadows. Those are drawn once at the smallest size that still has
+//  every corner, stroke and the blurred edges of the shadows, and stretched along a one point wide band in
+//  the middle. Descriptions that only differ in their size (and origin) share the same minimal description,
+//  and so the same image
+//
+//  Gradients are vertical, so a rectangle with a gradient is only stretched horizontally
+//
+//  Copyright (c) 2012 __MyCompanyName__. All rights reserved.
+//
+
+#import <UIKit/UIKit.h>
+
+typedef struct {
+    CGSize size;                // Size of the rectangle in the minimal description
+    NSInteger leftCapWidth;     // Caps of the minimal image (which includes the outer stroke and the drop shadow),
+    NSInteger topCapHeight;     // as in -stretchableImageWithLeftCapWidth:topCapHeight:, 0 for an axis that is not stretched
+} TKNineSlice;
+
+// False if the description can't be stretched, or is already as small as it could be
+BOOL TKNineSliceMake(TKNineSlice *slice, NSDictionary *description);
+
+// The parts of the description that are drawn, at the minimal size
+NSDictionary *TKNineSliceDescription(NSDictionary *description, const TKNineSlice *slice);
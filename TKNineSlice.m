@@ -0,0 +1,127 @@
+//
+//  TKNineSlice.m
+//  ThemeEngine
+//
+//  Copyright (c) 2012 __MyCompanyName__. All rights reserved.
+//
+
+#import "TKNineSlice.h"
+#import "TKHelpers.h"
+#import "TKConstants.h"
+#import "TKHash.h"
+
+// Blurs are twice the standard deviation, three of those cover everything visible
+#define kNineSliceBlurReach 1.5
+
+// Keys that change what a rectangle looks like, everything else is left out of the minimal description
+static NSArray *TKNineSliceDrawingKeys(void) {
+    static NSArray *keys = nil;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        keys = [[NSArray alloc] initWithObjects: TypeParameterKey, ColorParameterKey, AlphaParameterKey, BlendModeParameterKey,
+                GradientFillOptionKey, InnerStrokeOptionKey, OuterStrokeOptionKey, DropShadowOptionKey, InnerShadowOptionKey, nil];
+    });
+
+    return keys;
+}
+
+static void TKNineSliceGetRadii(NSDictionary *description, CGSize size, CGFloat *radii) {
+    radii[0] = radii[1] = radii[2] = radii[3] = 0.0;
+
+    // Same as the display lists, a single value or an array of 1-4 values repeated to fill all 4
+    NSObject *corners = [description objectForKey: CornerRadiusParameterKey];
+    if ([corners isKindOfClass: [NSArray class]]) {
+        NSArray *values = (NSArray *)corners;
+        NSUInteger count = [values count];
+
+        for (NSUInteger i = 0; i < 4 && count > 0; i++) {
+            radii[i] = [[values objectAtIndex: i % count] floatValue];
+        }
+    } else if (corners) {
+        radii[0] = radii[1] = radii[2] = radii[3] = [(NSNumber *)corners floatValue];
+    }
+
+    TKBalanceCornerRadiiIntoSize(radii, size);
+}
+
+// Distance a shadow changes the pixels next to an edge of the shape, along one axis
+static CGFloat TKNineSliceShadowReach(NSDictionary *shadow, BOOL horizontal) {
+    if (!shadow)
+        return 0.0;
+
+    NSDictionary *offset = [shadow objectForKey: OffsetParameterKey];
+    CGFloat distance = [[offset objectForKey: horizontal ? XCoordinateParameterKey : YCoordinateParameterKey] floatValue];
+
+    return kNineSliceBlurReach * [[shadow objectForKey: BlurParameterKey] floatValue] + fabs(distance);
+}
+
+BOOL TKNineSliceMake(TKNineSlice *slice, NSDictionary *description) {
+    if (![[description objectForKey: TypeParameterKey] isEqualToString: RectangleTypeKey] ||
+        [[description objectForKey: ContainerParameterKey] boolValue] ||
+        [[description objectForKey: SubviewSectionKey] count] > 0)
+        return NO;
+
+    CGRect frame = TKFrameForDescription(description);
+    frame.origin = CGPointZero;
+    if (CGRectIsEmpty(frame))
+        return NO;
+
+    CGFloat radii[4];
+    TKNineSliceGetRadii(description, frame.size, radii);
+    CGFloat radius = MAX(MAX(radii[0], radii[1]), MAX(radii[2], radii[3]));
+
+    NSDictionary *dropShadow = [description objectForKey: DropShadowOptionKey];
+    NSDictionary *innerShadow = [description objectForKey: InnerShadowOptionKey];
+    CGFloat innerStroke = [[[description objectForKey: InnerStrokeOptionKey] objectForKey: WidthParameterKey] floatValue];
+
+    // Everything but a band in the middle of each side has to be drawn as is, the same on both ends so the
+    // balanced corners stay the same. The band is two points, the caps are rounded to whole points in it
+    CGFloat horizontalInset = ceil(radius + innerStroke + MAX(TKNineSliceShadowReach(dropShadow, YES), TKNineSliceShadowReach(innerShadow, YES)));
+    CGFloat verticalInset = ceil(radius + innerStroke + MAX(TKNineSliceShadowReach(dropShadow, NO), TKNineSliceShadowReach(innerShadow, NO)));
+
+    CGFloat width = 2.0 * horizontalInset + 2.0;
+    CGFloat height = 2.0 * verticalInset + 2.0;
+
+    BOOL horizontal = width < frame.size.width;
+    BOOL vertical = height < frame.size.height && ![description objectForKey: GradientFillOptionKey];
+    if (!horizontal && !vertical)
+        return NO;
+
+    // The image starts at the outer stroke or the drop shadow, if either of those reach past the shape
+    CGRect canvas = frame;
+    if ([description objectForKey: OuterStrokeOptionKey])
+        canvas = CGRectUnion(canvas, TKStrokeRectForRectAndWidth(frame, [[[description objectForKey: OuterStrokeOptionKey] objectForKey: WidthParameterKey] floatValue]));
+
+    if (dropShadow)
+        canvas = CGRectUnion(canvas, TKShadowRectForRectAndOptions(frame, dropShadow));
+
+    slice->size = CGSizeMake(horizontal ? width : frame.size.width, vertical ? height : frame.size.height);
+    slice->leftCapWidth = horizontal ? (NSInteger)ceil(horizontalInset - canvas.origin.x) : 0;
+    slice->topCapHeight = vertical ? (NSInteger)ceil(verticalInset - canvas.origin.y) : 0;
+
+    return YES;
+}
+
+NSDictionary *TKNineSliceDescription(NSDictionary *description, const TKNineSlice *slice) {
+    NSMutableDictionary *minimal = [NSMutableDictionary dictionaryWithCapacity: 10];
+
+    for (NSString *key in TKNineSliceDrawingKeys()) {
+        id value = [description objectForKey: key];
+        if (value)
+            [minimal setObject: value forKey: key];
+    }
+
+    [minimal setObject: [NSDictionary dictionaryWithObjectsAndKeys: [NSNumber numberWithFloat: slice->size.width], WidthParameterKey,
+                         [NSNumber numberWithFloat: slice->size.height], HeightParameterKey, nil] forKey: SizeParameterKey];
+
+    // Corners balanced into the full size, the minimal one could otherwise balance them differently
+    if ([description objectForKey: CornerRadiusParameterKey]) {
+        CGFloat radii[4];
+        TKNineSliceGetRadii(description, TKFrameForDescription(description).size, radii);
+
+        [minimal setObject: [NSArray arrayWithObjects: [NSNumber numberWithFloat: radii[0]], [NSNumber numberWithFloat: radii[1]],
+                             [NSNumber numberWithFloat: radii[2]], [NSNumber numberWithFloat: radii[3]], nil] forKey: CornerRadiusParameterKey];
+    }
+
+    return TKImmutableDescription(minimal);
+}
@@ -0,0 +1,36 @@
+//
+//  TKPathGeometry.h
+//  ThemeEngine
+//
+//  Geometry of a path item at one size of its view - the path fitted into the rect, its bounding box, the
+//  outline of the inner stroke and the shape of its shadows. Drawing a path needs all of these, without the
+//  cache they would be derived (and allocated) again on every draw. Each item keeps the geometry for the
+//  last few sizes it was drawn at, so a replay at a known size only reads it
+//
+//  Copyright (c) 2012 __MyCompanyName__. All rights reserved.
+//
+
+#import <UIKit/UIKit.h>
+#import "TKShadow.h"
+
+// Sizes remembered for every path
+#define kPathGeometryCacheSize 4
+
+typedef struct {
+    CGSize size;                    // Of the rect the path was fitted into
+    CGPathRef path;                 // Scaled down to fit the rect, the original path if it already fits
+    CGRect boundingBox;
+    CGPathRef innerStrokePath;      // Outline of the doubled inner stroke, NULL without one
+    TKShadowShape shadowShape;      // Only set up for paths with shadows
+} TKPathGeometry;
+
+typedef struct TKPathGeometryCache TKPathGeometryCache;
+
+// The path is retained, innerStrokeWidth is 0 for paths without an inner stroke
+TKPathGeometryCache *TKPathGeometryCacheCreate(CGPathRef path, CGFloat innerStrokeWidth, BOOL hasShadows);
+void TKPathGeometryCacheFree(TKPathGeometryCache *cache);
+
+// Geometry for a rect of size, computed on the first use of the size. Can be called from any thread, the paths
+// are retained for the caller, who releases them with TKPathGeometryRelease once done drawing
+void TKPathGeometryCacheGetGeometry(TKPathGeometryCache *cache, CGSize size, TKPathGeometry *geometry);
+void TKPathGeometryRelease(TKPathGeometry *geometry);
@@ -0,0 +1,115 @@
+//
+//  TKPathGeometry.m
+//  ThemeEngine
+//
+//  Copyright (c) 2012 __MyCompanyName__. All rights reserved.
+//
+
+#import "TKPathGeometry.h"
+#import <pthread.h>
+
+struct TKPathGeometryCache {
+    pthread_mutex_t lock;
+
+    CGPathRef path;
+    CGRect boundingBox;
+    CGFloat innerStrokeWidth;
+    BOOL hasShadows;
+
+    // Filled in order, then replaced round robin
+    TKPathGeometry entries[kPathGeometryCacheSize];
+    NSUInteger count;
+    NSUInteger next;
+};
+
+static void TKPathGeometryCompute(TKPathGeometryCache *cache, CGSize size, TKPathGeometry *geometry) {
+    memset(geometry, 0, sizeof(TKPathGeometry));
+    geometry->size = size;
+
+    // Scaled down (never up) to fit the rect, keeping the aspect ratio
+    CGFloat ratio = MIN(size.width / CGRectGetWidth(cache->boundingBox), size.height / CGRectGetHeight(cache->boundingBox));
+    if (ratio < 1.0) {
+        CGAffineTransform transform = CGAffineTransformMakeScale(ratio, ratio);
+
+        CGMutablePathRef scaledPath = CGPathCreateMutable();
+        CGPathAddPath(scaledPath, &transform, cache->path);
+        geometry->path = CGPathCreateCopy(scaledPath);
+        CGPathRelease(scaledPath);
+    } else {
+        geometry->path = CGPathRetain(cache->path);
+    }
+
+    geometry->boundingBox = CGPathGetBoundingBox(geometry->path);
+
+    // iOS 5+ only, the inner stroke is left out before that
+    if (cache->innerStrokeWidth > 0.0 && CGPathCreateCopyByStrokingPath != NULL)
+        geometry->innerStrokePath = CGPathCreateCopyByStrokingPath(geometry->path, NULL, 2 * cache->innerStrokeWidth, kCGLineCapButt, kCGLineJoinRound, 4.0);
+
+    if (cache->hasShadows)
+        TKShadowShapeInitWithPath(&geometry->shadowShape, geometry->path);
+}
+
+#pragma mark - Cache
+
+TKPathGeometryCache *TKPathGeometryCacheCreate(CGPathRef path, CGFloat innerStrokeWidth, BOOL hasShadows) {
+    TKPathGeometryCache *cache = (TKPathGeometryCache *)calloc(1, sizeof(TKPathGeometryCache));
+    pthread_mutex_init(&cache->lock, NULL);
+
+    cache->path = CGPathRetain(path);
+    cache->boundingBox = CGPathGetBoundingBox(path);
+    cache->innerStrokeWidth = innerStrokeWidth;
+    cache->hasShadows = hasShadows;
+
+    return cache;
+}
+
+void TKPathGeometryCacheFree(TKPathGeometryCache *cache) {
+    if (!cache)
+        return;
+
+    for (NSUInteger i = 0; i < cache->count; i++) {
+        TKPathGeometryRelease(&cache->entries[i]);
+    }
+
+    CGPathRelease(cache->path);
+    pthread_mutex_destroy(&cache->lock);
+    free(cache);
+}
+
+void TKPathGeometryCacheGetGeometry(TKPathGeometryCache *cache, CGSize size, TKPathGeometry *geometry) {
+    pthread_mutex_lock(&cache->lock);
+
+    TKPathGeometry *entry = NULL;
+    for (NSUInteger i = 0; i < cache->count; i++) {
+        if (CGSizeEqualToSize(cache->entries[i].size, size)) {
+            entry = &cache->entries[i];
+            break;
+        }
+    }
+
+    if (!entry) {
+        entry = &cache->entries[cache->next];
+        if (cache->count < kPathGeometryCacheSize)
+            cache->count++;
+        else
+            TKPathGeometryRelease(entry);
+
+        cache->next = (cache->next + 1) % kPathGeometryCacheSize;
+        TKPathGeometryCompute(cache, size, entry);
+    }
+
+    // The caller keeps the paths even if the entry is replaced while it is drawing
+    *geometry = *entry;
+    CGPathRetain(geometry->path);
+    CGPathRetain(geometry->innerStrokePath);
+
+    pthread_mutex_unlock(&cache->lock);
+}
+
+void TKPathGeometryRelease(TKPathGeometry *geometry) {
+    CGPathRelease(geometry->path);
+    CGPathRelease(geometry->innerStrokePath);
+
+    geometry->path = NULL;
+    geometry->innerStrokePath = NULL;
+}
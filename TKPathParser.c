@@ -0,0 +1,494 @@
+//
+//  TKPathParser.c
+//  ThemeEngine
+//
+//  Copyright (c) 2012 __MyCompanyName__. All rights reserved.
+//
+
+#include "TKPathParser.h"
+
+#include <stdlib.h>
+#include <math.h>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+const uint8_t TKPathOperationCoordinateCount[5] = { 2, 2, 6, 4, 0 };
+
+#pragma mark - Buffer
+
+void TKPathBufferInit(TKPathBuffer *buffer) {
+    buffer->operations = NULL;
+    buffer->operationCount = 0;
+    buffer->operationCapacity = 0;
+    buffer->coordinates = NULL;
+    buffer->coordinateCount = 0;
+    buffer->coordinateCapacity = 0;
+}
+
+void TKPathBufferReset(TKPathBuffer *buffer) {
+    buffer->operationCount = 0;
+    buffer->coordinateCount = 0;
+}
+
+void TKPathBufferFree(TKPathBuffer *buffer) {
+    free(buffer->operations);
+    free(buffer->coordinates);
+    TKPathBufferInit(buffer);
+}
+
+// Makes sure the next operation (with up to six coordinates) fits, grows geometrically
+static bool TKPathBufferReserve(TKPathBuffer *buffer) {
+    if (buffer->operationCount + 1 > buffer->operationCapacity) {
+        size_t capacity = buffer->operationCapacity ? buffer->operationCapacity * 2 : 32;
+        uint8_t *operations = (uint8_t *)realloc(buffer->operations, capacity);
+        if (!operations)
+            return false;
+
+        buffer->operations = operations;
+        buffer->operationCapacity = capacity;
+    }
+
+    if (buffer->coordinateCount + 6 > buffer->coordinateCapacity) {
+        size_t capacity = buffer->coordinateCapacity ? buffer->coordinateCapacity * 2 : 128;
+        double *coordinates = (double *)realloc(buffer->coordinates, capacity * sizeof(double));
+        if (!coordinates)
+            return false;
+
+        buffer->coordinates = coordinates;
+        buffer->coordinateCapacity = capacity;
+    }
+
+    return true;
+}
+
+static inline bool TKPathAppend(TKPathBuffer *buffer, TKPathOperation operation, const double *coordinates) {
+    if (!TKPathBufferReserve(buffer))
+        return false;
+
+    buffer->operations[buffer->operationCount++] = (uint8_t)operation;
+
+    double *destination = buffer->coordinates + buffer->coordinateCount;
+    for (uint8_t i = 0; i < TKPathOperationCoordinateCount[operation]; i++) {
+        destination[i] = coordinates[i];
+    }
+    buffer->coordinateCount += TKPathOperationCoordinateCount[operation];
+
+    return true;
+}
+
+bool TKPathBufferAppend(TKPathBuffer *buffer, TKPathOperation operation, const double *coordinates) {
+    return TKPathAppend(buffer, operation, coordinates);
+}
+
+#pragma mark - Scanning
+
+static inline bool TKPathIsDigit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+// Whitespace and commas are treated the same, as separators
+static inline const char *TKPathSkipSeparators(const char *cursor, const char *end) {
+    while (cursor < end && (*cursor == ' ' || *cursor == ',' || *cursor == '\n' || *cursor == '\r' || *cursor == '\t' || *cursor == '\f'))
+        cursor++;
+
+    return cursor;
+}
+
+// Exactly representable powers of ten, scaling by these keeps the result correctly rounded
+// for mantissas that fit into a double, which is every coordinate seen in practice
+static const double TKPathPowersOfTen[23] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+// Number as in the SVG grammar, sign, integer and/or fraction part, optional exponent
+static bool TKPathScanNumber(const char **cursor, const char *end, double *result) {
+    const char *c = TKPathSkipSeparators(*cursor, end);
+
+    bool negative = false;
+    if (c < end && (*c == '+' || *c == '-')) {
+        negative = (*c == '-');
+        c++;
+    }
+
+    uint64_t mantissa = 0;
+    int digits = 0;
+    int exponent = 0;
+    bool valid = false;
+
+    // Integer part, digits past what fits in the mantissa only move the exponent
+    for (; c < end && TKPathIsDigit(*c); c++) {
+        valid = true;
+        if (digits < 19) {
+            mantissa = mantissa * 10 + (uint64_t)(*c - '0');
+            if (mantissa)
+                digits++;
+        } else {
+            exponent++;
+        }
+    }
+
+    // Fraction, another '.' terminates the number ("0.5.5" is two numbers)
+    if (c < end && *c == '.') {
+        c++;
+        for (; c < end && TKPathIsDigit(*c); c++) {
+            valid = true;
+            if (digits < 19) {
+                mantissa = mantissa * 10 + (uint64_t)(*c - '0');
+                if (mantissa)
+                    digits++;
+                exponent--;
+            }
+        }
+    }
+
+    if (!valid)
+        return false;
+
+    // Exponent, only if it is followed by digits, otherwise the 'e' is left alone
+    if (c < end && (*c == 'e' || *c == 'E')) {
+        const char *e = c + 1;
+        bool negativeExponent = false;
+        if (e < end && (*e == '+' || *e == '-')) {
+            negativeExponent = (*e == '-');
+            e++;
+        }
+
+        if (e < end && TKPathIsDigit(*e)) {
+            int value = 0;
+            for (; e < end && TKPathIsDigit(*e); e++) {
+                if (value < 10000)
+                    value = value * 10 + (*e - '0');
+            }
+
+            exponent += negativeExponent ? -value : value;
+            c = e;
+        }
+    }
+
+    double number = (double)mantissa;
+    if (mantissa && exponent) {
+        if (exponent > 0 && exponent <= 22)
+            number *= TKPathPowersOfTen[exponent];
+        else if (exponent < 0 && exponent >= -22)
+            number /= TKPathPowersOfTen[-exponent];
+        else
+            number *= pow(10.0, exponent);
+    }
+
+    *result = negative ? -number : number;
+    *cursor = c;
+
+    return true;
+}
+
+// Arc flags are single characters and may be written without separators ("a1 1 0 00 1 1")
+static bool TKPathScanFlag(const char **cursor, const char *end, bool *result) {
+    const char *c = TKPathSkipSeparators(*cursor, end);
+    if (c >= end || (*c != '0' && *c != '1'))
+        return false;
+
+    *result = (*c == '1');
+    *cursor = c + 1;
+
+    return true;
+}
+
+static inline bool TKPathScanNumbers(const char **cursor, const char *end, double *result, int count) {
+    for (int i = 0; i < count; i++) {
+        if (!TKPathScanNumber(cursor, end, &result[i]))
+            return false;
+    }
+
+    return true;
+}
+
+#pragma mark - Arcs
+
+// Endpoint to center parameterization (SVG 1.1, F.6.5), then split into at most quarter turns,
+// each of which is approximated by one cubic curve
+static bool TKPathAppendArc(TKPathBuffer *buffer, double x1, double y1, double rx, double ry, double angle, bool largeArc, bool sweep, double x2, double y2) {
+    // Identical endpoints mean the arc is omitted
+    if (x1 == x2 && y1 == y2)
+        return true;
+
+    // Zero radius degrades into a straight line
+    rx = fabs(rx);
+    ry = fabs(ry);
+    if (rx == 0.0 || ry == 0.0) {
+        double point[2] = { x2, y2 };
+        return TKPathAppend(buffer, TKPathOperationLineTo, point);
+    }
+
+    double phi = fmod(angle, 360.0) * M_PI / 180.0;
+    double cosPhi = cos(phi);
+    double sinPhi = sin(phi);
+
+    double dx = (x1 - x2) / 2.0;
+    double dy = (y1 - y2) / 2.0;
+    double x1p = cosPhi * dx + sinPhi * dy;
+    double y1p = -sinPhi * dx + cosPhi * dy;
+
+    // Scale the radii up if they are too small to reach the endpoint
+    double lambda = (x1p * x1p) / (rx * rx) + (y1p * y1p) / (ry * ry);
+    if (lambda > 1.0) {
+        double scale = sqrt(lambda);
+        rx *= scale;
+        ry *= scale;
+    }
+
+    double rx2 = rx * rx;
+    double ry2 = ry * ry;
+    double numerator = rx2 * ry2 - rx2 * y1p * y1p - ry2 * x1p * x1p;
+    double denominator = rx2 * y1p * y1p + ry2 * x1p * x1p;
+    double coefficient = (numerator <= 0.0 || denominator == 0.0) ? 0.0 : sqrt(numerator / denominator);
+    if (largeArc == sweep)
+        coefficient = -coefficient;
+
+    double cxp = coefficient * rx * y1p / ry;
+    double cyp = -coefficient * ry * x1p / rx;
+    double cx = cosPhi * cxp - sinPhi * cyp + (x1 + x2) / 2.0;
+    double cy = sinPhi * cxp + cosPhi * cyp + (y1 + y2) / 2.0;
+
+    double ux = (x1p - cxp) / rx;
+    double uy = (y1p - cyp) / ry;
+    double vx = (-x1p - cxp) / rx;
+    double vy = (-y1p - cyp) / ry;
+
+    double theta = atan2(uy, ux);
+    double delta = atan2(ux * vy - uy * vx, ux * vx + uy * vy);
+    if (!sweep && delta > 0.0)
+        delta -= 2.0 * M_PI;
+    else if (sweep && delta < 0.0)
+        delta += 2.0 * M_PI;
+
+    int segments = (int)ceil(fabs(delta) / (M_PI / 2.0) - 1e-7);
+    if (segments < 1)
+        segments = 1;
+
+    double step = delta / segments;
+    double handle = 4.0 / 3.0 * tan(step / 4.0);
+
+    double startCos = cos(theta);
+    double startSin = sin(theta);
+    for (int i = 0; i < segments; i++) {
+        double endAngle = theta + (i + 1) * step;
+        double endCos = cos(endAngle);
+        double endSin = sin(endAngle);
+
+        // Control points on the unit circle, mapped onto the ellipse
+        double unit[6] = { startCos - handle * startSin, startSin + handle * startCos,
+                           endCos + handle * endSin, endSin - handle * endCos,
+                           endCos, endSin };
+
+        double curve[6];
+        for (int j = 0; j < 6; j += 2) {
+            curve[j] = cx + rx * cosPhi * unit[j] - ry * sinPhi * unit[j + 1];
+            curve[j + 1] = cy + rx * sinPhi * unit[j] + ry * cosPhi * unit[j + 1];
+        }
+
+        // Land exactly on the endpoint, so that following relative commands don't drift
+        if (i == segments - 1) {
+            curve[4] = x2;
+            curve[5] = y2;
+        }
+
+        if (!TKPathAppend(buffer, TKPathOperationCubicTo, curve))
+            return false;
+
+        startCos = endCos;
+        startSin = endSin;
+    }
+
+    return true;
+}
+
+#pragma mark - Parser
+
+bool TKPathParse(const char *bytes, size_t length, TKPathBuffer *buffer, size_t *errorOffset) {
+    const char *cursor = bytes;
+    const char *end = bytes + length;
+
+    // Current point, start of the current subpath and the control point available for reflection
+    double x = 0.0, y = 0.0;
+    double startX = 0.0, startY = 0.0;
+    double controlX = 0.0, controlY = 0.0;
+
+    char command = 0;       // Active command, as written
+    char previous = 0;      // Uppercase form of the last command that was executed
+
+    const char *segmentStart = cursor;
+    while (true) {
+        cursor = TKPathSkipSeparators(cursor, end);
+        if (cursor >= end)
+            return true;
+
+        segmentStart = cursor;
+        char c = *cursor;
+
+        if ((c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z')) {
+            command = c;
+            cursor++;
+        } else if (command == 0 || command == 'Z' || command == 'z') {
+            // Numbers without a command to repeat
+            goto error;
+        } else if (command == 'M' || command == 'm') {
+            // Coordinates following a moveto are implicit linetos
+            command = (command == 'M') ? 'L' : 'l';
+        }
+
+        // The path has to start with a moveto
+        if (previous == 0 && command != 'M' && command != 'm')
+            goto error;
+
+        bool relative = (command >= 'a');
+        double baseX = relative ? x : 0.0;
+        double baseY = relative ? y : 0.0;
+        double values[7];
+        char upper = relative ? (char)(command - 32) : command;
+
+        switch (upper) {
+            case 'M': {
+                if (!TKPathScanNumbers(&cursor, end, values, 2))
+                    goto error;
+
+                x = startX = baseX + values[0];
+                y = startY = baseY + values[1];
+                double point[2] = { x, y };
+                if (!TKPathAppend(buffer, TKPathOperationMoveTo, point))
+                    goto error;
+                break;
+            }
+            case 'Z': {
+                if (!TKPathAppend(buffer, TKPathOperationClose, NULL))
+                    goto error;
+
+                x = startX;
+                y = startY;
+                break;
+            }
+            case 'L':
+            case 'H':
+            case 'V': {
+                if (upper == 'L') {
+                    if (!TKPathScanNumbers(&cursor, end, values, 2))
+                        goto error;
+
+                    x = baseX + values[0];
+                    y = baseY + values[1];
+                } else {
+                    if (!TKPathScanNumber(&cursor, end, values))
+                        goto error;
+
+                    if (upper == 'H')
+                        x = baseX + values[0];
+                    else
+                        y = baseY + values[0];
+                }
+
+                double point[2] = { x, y };
+                if (!TKPathAppend(buffer, TKPathOperationLineTo, point))
+                    goto error;
+                break;
+            }
+            case 'C':
+            case 'S': {
+                double curve[6];
+                if (upper == 'C') {
+                    if (!TKPathScanNumbers(&cursor, end, values, 6))
+                        goto error;
+
+                    curve[0] = baseX + values[0];
+                    curve[1] = baseY + values[1];
+                    curve[2] = baseX + values[2];
+                    curve[3] = baseY + values[3];
+                    curve[4] = baseX + values[4];
+                    curve[5] = baseY + values[5];
+                } else {
+                    if (!TKPathScanNumbers(&cursor, end, values, 4))
+                        goto error;
+
+                    // Reflect the second control point of a preceding cubic, otherwise use the current point
+                    bool reflect = (previous == 'C' || previous == 'S');
+                    curve[0] = reflect ? 2.0 * x - controlX : x;
+                    curve[1] = reflect ? 2.0 * y - controlY : y;
+                    curve[2] = baseX + values[0];
+                    curve[3] = baseY + values[1];
+                    curve[4] = baseX + values[2];
+                    curve[5] = baseY + values[3];
+                }
+
+                if (!TKPathAppend(buffer, TKPathOperationCubicTo, curve))
+                    goto error;
+
+                controlX = curve[2];
+                controlY = curve[3];
+                x = curve[4];
+                y = curve[5];
+                break;
+            }
+            case 'Q':
+            case 'T': {
+                double curve[4];
+                if (upper == 'Q') {
+                    if (!TKPathScanNumbers(&cursor, end, values, 4))
+                        goto error;
+
+                    curve[0] = baseX + values[0];
+                    curve[1] = baseY + values[1];
+                    curve[2] = baseX + values[2];
+                    curve[3] = baseY + values[3];
+                } else {
+                    if (!TKPathScanNumbers(&cursor, end, values, 2))
+                        goto error;
+
+                    // Same as above, but with the control point of a preceding quadratic curve
+                    bool reflect = (previous == 'Q' || previous == 'T');
+                    curve[0] = reflect ? 2.0 * x - controlX : x;
+                    curve[1] = reflect ? 2.0 * y - controlY : y;
+                    curve[2] = baseX + values[0];
+                    curve[3] = baseY + values[1];
+                }
+
+                if (!TKPathAppend(buffer, TKPathOperationQuadTo, curve))
+                    goto error;
+
+                controlX = curve[0];
+                controlY = curve[1];
+                x = curve[2];
+                y = curve[3];
+                break;
+            }
+            case 'A': {
+                bool largeArc, sweep;
+                if (!TKPathScanNumbers(&cursor, end, values, 3) ||
+                    !TKPathScanFlag(&cursor, end, &largeArc) ||
+                    !TKPathScanFlag(&cursor, end, &sweep) ||
+                    !TKPathScanNumbers(&cursor, end, values + 3, 2))
+                    goto error;
+
+                double endX = baseX + values[3];
+                double endY = baseY + values[4];
+                if (!TKPathAppendArc(buffer, x, y, values[0], values[1], values[2], largeArc, sweep, endX, endY))
+                    goto error;
+
+                x = endX;
+                y = endY;
+                break;
+            }
+            default:
+                // Unknown command
+                goto error;
+        }
+
+        previous = upper;
+    }
+
+error:
+    if (errorOffset)
+        *errorOffset = (size_t)(segmentStart - bytes);
+
+    return false;
+}
@@ -0,0 +1,64 @@
+//
+//  TKPathParser.h
+//  ThemeEngine
+//
+//  SVG path data parser, plain C so that it can be shared with tools outside of UIKit.
+//  The description is walked once, byte by byte, and the result is written into a packed
+//  buffer of operations and absolute coordinates. Apart from growing the buffer, nothing
+//  is allocated, so a buffer can be reused for any number of paths
+//
+//  The whole path grammar is supported (M, L, H, V, C, S, Q, T, A, Z and their relative forms,
+//  implicit repeats, exponents), H/V are lowered into lines, S/T into full curves and arcs into
+//  cubic curves, which leaves only five operations for the consumer
+//
+//  Copyright (c) 2012 __MyCompanyName__. All rights reserved.
+//
+
+#ifndef TKPathParser_h
+#define TKPathParser_h
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Operations in the buffer, the number of coordinates following each one is in the comment
+typedef enum { TKPathOperationMoveTo,           // x, y
+               TKPathOperationLineTo,           // x, y
+               TKPathOperationCubicTo,          // x1, y1, x2, y2, x, y
+               TKPathOperationQuadTo,           // x1, y1, x, y
+               TKPathOperationClose } TKPathOperation;
+
+typedef struct {
+    uint8_t *operations;
+    size_t operationCount;
+    size_t operationCapacity;
+
+    double *coordinates;
+    size_t coordinateCount;
+    size_t coordinateCapacity;
+} TKPathBuffer;
+
+// Number of coordinates an operation uses
+extern const uint8_t TKPathOperationCoordinateCount[5];
+
+void TKPathBufferInit(TKPathBuffer *buffer);
+void TKPathBufferReset(TKPathBuffer *buffer);       // Keeps the storage
+void TKPathBufferFree(TKPathBuffer *buffer);
+
+// Appends a single operation along with its coordinates, for building paths by hand
+bool TKPathBufferAppend(TKPathBuffer *buffer, TKPathOperation operation, const double *coordinates);
+
+// Appends the path in bytes (UTF-8, not NUL terminated) into buffer. On a syntax error,
+// false is returned and errorOffset (if not NULL) is set to the offending byte. Like SVG
+// renderers, the buffer then contains everything up to the error
+bool TKPathParse(const char *bytes, size_t length, TKPathBuffer *buffer, size_t *errorOffset);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
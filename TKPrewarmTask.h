@@ -0,0 +1,88 @@
+//
+//  TKPrewarmTask.h
+//  ThemeEngine
+//
+//  Handle of a batch of themes being prewarmed (see -[ThemeKit prewarmThemesInDirectory:priority:]),
+//  keeps track of the progress and how long the batch took to warm up
+//
+//  Copyright (c) 2012 __MyCompanyName__. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+// Order in which the prewarming is scheduled, background work also runs at a lower thread priority
+// so that it yields to the main thread and the background renders requested by the UI
+typedef enum {
+    TKPrewarmPriorityBackground,
+    TKPrewarmPriorityNormal,
+    TKPrewarmPriorityVisible        // Themes about to appear on screen, jump ahead of everything else
+} TKPrewarmPriority;
+
+@class TKPrewarmTask;
+
+typedef void (^TKPrewarmHandler)(TKPrewarmTask *task);
+
+@interface TKPrewarmTask : NSObject {
+    NSArray *_paths;
+    NSArray *_operations;
+
+    volatile int32_t _completedCount;
+    volatile int32_t _failedCount;
+    volatile int32_t _skippedCount;
+    volatile int32_t _endedCount;     // Completed and skipped, only the last one to end sees it reach the count
+    BOOL _cancelled;
+
+    CFAbsoluteTime _startTime;
+    CFAbsoluteTime _endTime;
+    volatile int64_t _busyTime;       // Sum of the time spent on each theme, in microseconds
+
+    TKPrewarmHandler _progressHandler;
+    TKPrewarmHandler _completionHandler;
+}
+
+// Paths of the themes in the batch
+@property (nonatomic, readonly) NSArray *paths;
+
+@property (nonatomic, readonly) NSUInteger themeCount;
+@property (nonatomic, readonly) NSUInteger completedCount;      // Failed ones included
+@property (nonatomic, readonly) NSUInteger failedCount;
+
+@property (nonatomic, readonly) NSUInteger skippedCount;        // Never started because of -cancel
+
+// 0.0 - 1.0
+@property (nonatomic, readonly) float progress;
+
+// Every theme is either done or skipped, isCancelled tells which of the two it was
+@property (nonatomic, readonly, getter = isFinished) BOOL finished;
+@property (nonatomic, readonly, getter = isCancelled) BOOL cancelled;
+
+// Wall clock time since the batch was scheduled, stops once everything is warm
+@property (nonatomic, readonly) NSTimeInterval timeToWarm;
+
+// Average time spent on a single theme (on one core)
+@property (nonatomic, readonly) NSTimeInterval averageTimePerTheme;
+
+// Both are called on the main thread, the progress one after every theme. Set them right after
+// scheduling the batch (in the same pass of the run loop) to not miss any of the calls
+@property (nonatomic, copy) TKPrewarmHandler progressHandler;
+@property (nonatomic, copy) TKPrewarmHandler completionHandler;
+
+- (id)initWithPaths: (NSArray *)paths;
+
+// Operations doing the work, set by the engine while scheduling the batch
+@property (nonatomic, copy) NSArray *operations;
+
+// Called by the workers once a theme is done, along with the time it took
+- (void)themeDidFinishWithSuccess: (BOOL)success duration: (NSTimeInterval)duration;
+
+// Called for the themes whose operations were cancelled before they started
+- (void)themeWasSkipped;
+
+// Skips the themes that have not been started yet. The batch finishes (and calls the completion handler) once
+// the themes already being prewarmed are done. Main thread only
+- (void)cancel;
+
+// Counters and timings as NSNumbers
+- (NSDictionary *)statistics;
+
+@end
@@ -0,0 +1,152 @@
+//
+//  TKPrewarmTask.m
+//  ThemeEngine
+//
+//  Copyright (c) 2012 __MyCompanyName__. All rights reserved.
+//
+
+#import "TKPrewarmTask.h"
+
+#import <libkern/OSAtomic.h>
+
+@interface TKPrewarmTask (Private)
+
+// Progress is only reported for the themes that were prewarmed, the completion for the last one either way
+- (void)themeDidEndWithProgress: (BOOL)progress;
+
+@end
+
+@implementation TKPrewarmTask
+@synthesize paths = _paths;
+@synthesize operations = _operations;
+@synthesize progressHandler = _progressHandler;
+@synthesize completionHandler = _completionHandler;
+
+- (id)initWithPaths: (NSArray *)paths {
+    if ((self = [super init])) {
+        _paths = [paths copy];
+        _startTime = CFAbsoluteTimeGetCurrent();
+    }
+
+    return self;
+}
+
+#pragma mark - Progress
+
+- (NSUInteger)themeCount {
+    return [_paths count];
+}
+
+- (NSUInteger)completedCount {
+    return (NSUInteger)_completedCount;
+}
+
+- (NSUInteger)failedCount {
+    return (NSUInteger)_failedCount;
+}
+
+- (NSUInteger)skippedCount {
+    return (NSUInteger)_skippedCount;
+}
+
+- (BOOL)isCancelled {
+    return _cancelled;
+}
+
+- (float)progress {
+    if ([_paths count] == 0)
+        return 1.0;
+
+    return (float)_completedCount / (float)[_paths count];
+}
+
+- (BOOL)isFinished {
+    return (NSUInteger)(_completedCount + _skippedCount) >= [_paths count];
+}
+
+- (NSTimeInterval)timeToWarm {
+    if ([self isFinished] && _endTime > 0.0)
+        return _endTime - _startTime;
+
+    return CFAbsoluteTimeGetCurrent() - _startTime;
+}
+
+- (NSTimeInterval)averageTimePerTheme {
+    if (_completedCount == 0)
+        return 0.0;
+
+    return ((NSTimeInterval)_busyTime / 1000000.0) / _completedCount;
+}
+
+- (void)themeDidFinishWithSuccess: (BOOL)success duration: (NSTimeInterval)duration {
+    if (!success)
+        OSAtomicIncrement32Barrier(&_failedCount);
+
+    OSAtomicAdd64Barrier((int64_t)(duration * 1000000.0), &_busyTime);
+    OSAtomicIncrement32Barrier(&_completedCount);
+
+    [self themeDidEndWithProgress: YES];
+}
+
+- (void)themeWasSkipped {
+    OSAtomicIncrement32Barrier(&_skippedCount);
+
+    [self themeDidEndWithProgress: NO];
+}
+
+- (void)themeDidEndWithProgress: (BOOL)progress {
+    // The last theme stops the clock
+    BOOL finished = (NSUInteger)OSAtomicIncrement32Barrier(&_endedCount) == [_paths count];
+    if (finished)
+        _endTime = CFAbsoluteTimeGetCurrent();
+
+    if (!progress && !finished)
+        return;
+
+    dispatch_async(dispatch_get_main_queue(), ^{
+        if (progress && _progressHandler)
+            _progressHandler(self);
+
+        if (finished) {
+            if (_completionHandler)
+                _completionHandler(self);
+
+            // Nothing left to cancel
+            [_operations release];
+            _operations = nil;
+        }
+    });
+}
+
+- (void)cancel {
+    // Only read and released on the main thread, so the batch has to be cancelled from there as well
+    _cancelled = YES;
+    [_operations makeObjectsPerformSelector: @selector(cancel)];
+
+    // The operations hold on to the task, break the cycle
+    [_operations release];
+    _operations = nil;
+}
+
+- (NSDictionary *)statistics {
+    return [NSDictionary dictionaryWithObjectsAndKeys:
+            [NSNumber numberWithUnsignedInteger: [self themeCount]], @"themes",
+            [NSNumber numberWithUnsignedInteger: [self completedCount]], @"completed",
+            [NSNumber numberWithUnsignedInteger: [self failedCount]], @"failed",
+            [NSNumber numberWithUnsignedInteger: [self skippedCount]], @"skipped",
+            [NSNumber numberWithDouble: [self timeToWarm]], @"timeToWarm",
+            [NSNumber numberWithDouble: [self averageTimePerTheme]], @"averageTimePerTheme", nil];
+}
+
+#pragma mark - Memory management
+
+- (void)dealloc {
+    [_paths release];
+    [_operations release];
+    [_progressHandler release];
+    [_completionHandler release];
+
+    [super dealloc];
+}
+
+@end
@@ -0,0 +1,1560 @@
+//
+//  TKRasterizer.c
+//  ThemeEngine
+//
+//  Copyright (c) 2012 __MyCompanyName__. All rights reserved.
+//
+
+#include "TKRasterizer.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#if !defined(TK_RASTER_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64))
+#include <emmintrin.h>
+#define TK_RASTER_SSE2 1
+#elif !defined(TK_RASTER_NO_SIMD) && (defined(__ARM_NEON__) || defined(__ARM_NEON)) && \
+      (!defined(__BYTE_ORDER__) || __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+#include <arm_neon.h>
+#define TK_RASTER_NEON 1
+#endif
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+// Sub-scanlines per row of pixels
+#define TKRasterSamples 8
+
+// Largest distance between a curve (or circle) and the lines it is flattened into, in pixels
+#define TKRasterTolerance 0.2
+
+// Control point distance of a cubic curve approximating a quarter of a circle
+#define TKRasterKappa 0.5522847498
+
+#pragma mark - Scratch
+
+typedef struct {
+    float x0, y0, x1, y1;
+    float dxdy;
+    int direction;
+} TKRasterEdge;
+
+typedef struct {
+    float x;
+    int direction;
+} TKRasterCrossing;
+
+typedef struct {
+    size_t first;
+    size_t count;
+    bool closed;
+} TKRasterContour;
+
+struct TKRasterScratch {
+    TKRasterEdge *edges;
+    size_t edgeCount, edgeCapacity;
+    float minX, minY, maxX, maxY;
+
+    double *points;
+    size_t pointCount, pointCapacity;
+    TKRasterContour *contours;
+    size_t contourCount, contourCapacity;
+
+    size_t *active;
+    size_t activeCapacity;
+    TKRasterCrossing *crossings;
+    size_t crossingCapacity;
+
+    float *accumulation;
+    size_t accumulationCapacity;
+
+    uint8_t *mask;
+    size_t maskCapacity;
+    uint8_t *shadow;
+    size_t shadowCapacity;
+    uint16_t *blur;
+    size_t blurCapacity;
+
+    uint8_t *cover;
+    size_t coverCapacity;
+    uint32_t *span;
+    size_t spanCapacity;
+};
+
+struct TKRasterClip {
+    int referenceCount;
+    uint8_t coverage[];             // One byte per pixel of the surface
+};
+
+typedef struct {
+    int x, y, width, height;
+    uint8_t *coverage;
+} TKRasterMask;
+
+// Solid color, or a gradient with t = t0 + tx * x + ty * y at the center of each pixel
+typedef struct {
+    uint32_t color;
+    const TKRasterGradient *gradient;
+    double t0, tx, ty;
+} TKRasterPaint;
+
+// Grows the buffer to fit count elements
+static bool TKRasterReserve(void **buffer, size_t *capacity, size_t count, size_t size) {
+    if (count <= *capacity)
+        return true;
+
+    size_t newCapacity = *capacity ? *capacity : 64;
+    while (newCapacity < count) {
+        newCapacity *= 2;
+    }
+
+    void *newBuffer = realloc(*buffer, newCapacity * size);
+    if (!newBuffer)
+        return false;
+
+    *buffer = newBuffer;
+    *capacity = newCapacity;
+
+    return true;
+}
+
+#define TKRasterReserveArray(array, capacity, count) TKRasterReserve((void **)&(array), &(capacity), (count), sizeof(*(array)))
+
+static void TKRasterClipRelease(TKRasterClip *clip) {
+    if (clip && --clip->referenceCount == 0)
+        free(clip);
+}
+
+#pragma mark - Pixels
+
+static inline uint32_t TKRasterMultiply255(uint32_t a, uint32_t b) {
+    uint32_t t = a * b + 128;
+    return (t + (t >> 8)) >> 8;
+}
+
+// All four channels multiplied by scale / 255, two at a time
+static inline uint32_t TKRasterScalePixel(uint32_t pixel, uint32_t scale) {
+    uint32_t rb = (pixel & 0x00ff00ff) * scale + 0x00800080;
+    rb = ((rb + ((rb >> 8) & 0x00ff00ff)) >> 8) & 0x00ff00ff;
+
+    uint32_t ag = ((pixel >> 8) & 0x00ff00ff) * scale + 0x00800080;
+    ag = (ag + ((ag >> 8) & 0x00ff00ff)) & 0xff00ff00;
+
+    return rb | ag;
+}
+
+static inline uint32_t TKRasterSourceOver(uint32_t source, uint32_t destination) {
+    return source + TKRasterScalePixel(destination, 255 - (source >> 24));
+}
+
+static inline uint8_t TKRasterUnitToByte(float value) {
+    if (value <= 0.0f)
+        return 0;
+    if (value >= 1.0f)
+        return 255;
+
+    return (uint8_t)(value * 255.0f + 0.5f);
+}
+
+static uint32_t TKRasterPremultipliedPixel(TKRasterColor color) {
+    float alpha = color.alpha < 0.0f ? 0.0f : (color.alpha > 1.0f ? 1.0f : color.alpha);
+
+    return ((uint32_t)TKRasterUnitToByte(alpha) << 24) | ((uint32_t)TKRasterUnitToByte(color.red * alpha) << 16) |
+           ((uint32_t)TKRasterUnitToByte(color.green * alpha) << 8) | (uint32_t)TKRasterUnitToByte(color.blue * alpha);
+}
+
+#pragma mark - Kernels
+
+// Source over with a single color and a coverage per pixel, this is what most fills end up as
+static void TKRasterBlendSolidScalar(uint32_t *destination, uint32_t color, const uint8_t *cover, int count) {
+    for (int i = 0; i < count; i++) {
+        uint32_t coverage = cover[i];
+        if (coverage == 0)
+            continue;
+
+        uint32_t source = coverage == 255 ? color : TKRasterScalePixel(color, coverage);
+        destination[i] = (source >> 24) == 255 ? source : TKRasterSourceOver(source, destination[i]);
+    }
+}
+
+// Same, with a color per pixel
+static void TKRasterBlendSpanScalar(uint32_t *destination, const uint32_t *source, const uint8_t *cover, int count) {
+    for (int i = 0; i < count; i++) {
+        uint32_t coverage = cover[i];
+        if (coverage == 0)
+            continue;
+
+        uint32_t pixel = coverage == 255 ? source[i] : TKRasterScalePixel(source[i], coverage);
+        destination[i] = (pixel >> 24) == 255 ? pixel : TKRasterSourceOver(pixel, destination[i]);
+    }
+}
+
+#if TK_RASTER_SSE2
+
+// Exact x / 255 for x up to 255 * 255, in each 16-bit lane
+static inline __m128i TKRasterDivide255SSE2(__m128i x) {
+    x = _mm_add_epi16(x, _mm_set1_epi16(128));
+    return _mm_srli_epi16(_mm_add_epi16(x, _mm_srli_epi16(x, 8)), 8);
+}
+
+// Source over for two pixels unpacked into 16-bit lanes, coverage is already applied to the source
+static inline __m128i TKRasterSourceOverSSE2(__m128i source, __m128i destination) {
+    __m128i alpha = _mm_shufflehi_epi16(_mm_shufflelo_epi16(source, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+    __m128i inverse = _mm_sub_epi16(_mm_set1_epi16(255), alpha);
+
+    return _mm_add_epi16(source, TKRasterDivide255SSE2(_mm_mullo_epi16(destination, inverse)));
+}
+
+// Coverage of four pixels, spread over the channels of two pixels each
+static inline void TKRasterLoadCoverSSE2(const uint8_t *cover, __m128i *low, __m128i *high) {
+    uint32_t coverage;
+    memcpy(&coverage, cover, sizeof(coverage));
+
+    __m128i c = _mm_unpacklo_epi8(_mm_cvtsi32_si128((int)coverage), _mm_setzero_si128());
+    c = _mm_unpacklo_epi16(c, c);
+
+    *low = _mm_unpacklo_epi32(c, c);
+    *high = _mm_unpackhi_epi32(c, c);
+}
+
+static void TKRasterBlendSolid(uint32_t *destination, uint32_t color, const uint8_t *cover, int count) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i color16 = _mm_unpacklo_epi8(_mm_set1_epi32((int)color), zero);
+
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        uint32_t coverage;
+        memcpy(&coverage, cover + i, sizeof(coverage));
+        if (coverage == 0)
+            continue;
+
+        __m128i coverLow, coverHigh;
+        TKRasterLoadCoverSSE2(cover + i, &coverLow, &coverHigh);
+
+        __m128i pixels = _mm_loadu_si128((const __m128i *)(destination + i));
+        __m128i low = TKRasterSourceOverSSE2(TKRasterDivide255SSE2(_mm_mullo_epi16(color16, coverLow)), _mm_unpacklo_epi8(pixels, zero));
+        __m128i high = TKRasterSourceOverSSE2(TKRasterDivide255SSE2(_mm_mullo_epi16(color16, coverHigh)), _mm_unpackhi_epi8(pixels, zero));
+
+        _mm_storeu_si128((__m128i *)(destination + i), _mm_packus_epi16(low, high));
+    }
+
+    TKRasterBlendSolidScalar(destination + i, color, cover + i, count - i);
+}
+
+static void TKRasterBlendSpan(uint32_t *destination, const uint32_t *source, const uint8_t *cover, int count) {
+    const __m128i zero = _mm_setzero_si128();
+
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        uint32_t coverage;
+        memcpy(&coverage, cover + i, sizeof(coverage));
+        if (coverage == 0)
+            continue;
+
+        __m128i coverLow, coverHigh;
+        TKRasterLoadCoverSSE2(cover + i, &coverLow, &coverHigh);
+
+        __m128i colors = _mm_loadu_si128((const __m128i *)(source + i));
+        __m128i pixels = _mm_loadu_si128((const __m128i *)(destination + i));
+        __m128i low = TKRasterDivide255SSE2(_mm_mullo_epi16(_mm_unpacklo_epi8(colors, zero), coverLow));
+        __m128i high = TKRasterDivide255SSE2(_mm_mullo_epi16(_mm_unpackhi_epi8(colors, zero), coverHigh));
+
+        low = TKRasterSourceOverSSE2(low, _mm_unpacklo_epi8(pixels, zero));
+        high = TKRasterSourceOverSSE2(high, _mm_unpackhi_epi8(pixels, zero));
+
+        _mm_storeu_si128((__m128i *)(destination + i), _mm_packus_epi16(low, high));
+    }
+
+    TKRasterBlendSpanScalar(destination + i, source + i, cover + i, count - i);
+}
+
+#elif TK_RASTER_NEON
+
+// Exact x / 255 for x up to 255 * 255, narrowed back into bytes
+static inline uint8x8_t TKRasterDivide255NEON(uint16x8_t x) {
+    return vrshrn_n_u16(vrsraq_n_u16(x, x, 8), 8);
+}
+
+// Eight pixels at a time, deinterleaved into planes of blue, green, red and alpha
+static inline uint8x8x4_t TKRasterSourceOverNEON(uint8x8x4_t source, uint8x8x4_t destination) {
+    uint8x8_t inverse = vmvn_u8(source.val[3]);
+
+    for (int channel = 0; channel < 4; channel++) {
+        destination.val[channel] = vadd_u8(source.val[channel], TKRasterDivide255NEON(vmull_u8(destination.val[channel], inverse)));
+    }
+
+    return destination;
+}
+
+static void TKRasterBlendSolid(uint32_t *destination, uint32_t color, const uint8_t *cover, int count) {
+    uint8x8_t channels[4] = { vdup_n_u8(color & 0xff), vdup_n_u8((color >> 8) & 0xff), vdup_n_u8((color >> 16) & 0xff), vdup_n_u8(color >> 24) };
+
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        uint8x8_t coverage = vld1_u8(cover + i);
+        if (vget_lane_u64(vreinterpret_u64_u8(coverage), 0) == 0)
+            continue;
+
+        uint8x8x4_t source;
+        for (int channel = 0; channel < 4; channel++) {
+            source.val[channel] = TKRasterDivide255NEON(vmull_u8(channels[channel], coverage));
+        }
+
+        uint8x8x4_t pixels = vld4_u8((const uint8_t *)(destination + i));
+        vst4_u8((uint8_t *)(destination + i), TKRasterSourceOverNEON(source, pixels));
+    }
+
+    TKRasterBlendSolidScalar(destination + i, color, cover + i, count - i);
+}
+
+static void TKRasterBlendSpan(uint32_t *destination, const uint32_t *source, const uint8_t *cover, int count) {
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        uint8x8_t coverage = vld1_u8(cover + i);
+        if (vget_lane_u64(vreinterpret_u64_u8(coverage), 0) == 0)
+            continue;
+
+        uint8x8x4_t colors = vld4_u8((const uint8_t *)(source + i));
+        for (int channel = 0; channel < 4; channel++) {
+            colors.val[channel] = TKRasterDivide255NEON(vmull_u8(colors.val[channel], coverage));
+        }
+
+        uint8x8x4_t pixels = vld4_u8((const uint8_t *)(destination + i));
+        vst4_u8((uint8_t *)(destination + i), TKRasterSourceOverNEON(colors, pixels));
+    }
+
+    TKRasterBlendSpanScalar(destination + i, source + i, cover + i, count - i);
+}
+
+#else
+
+static void TKRasterBlendSolid(uint32_t *destination, uint32_t color, const uint8_t *cover, int count) {
+    TKRasterBlendSolidScalar(destination, color, cover, count);
+}
+
+static void TKRasterBlendSpan(uint32_t *destination, const uint32_t *source, const uint8_t *cover, int count) {
+    TKRasterBlendSpanScalar(destination, source, cover, count);
+}
+
+#endif
+
+const char *TKRasterKernelName(void) {
+#if TK_RASTER_SSE2
+    return "sse2";
+#elif TK_RASTER_NEON
+    return "neon";
+#else
+    return "scalar";
+#endif
+}
+
+// Colors of the gradient for count pixels, t advancing by step from pixel to pixel
+static void TKRasterGradientSpan(uint32_t *span, const TKRasterGradient *gradient, double t, double step, int count) {
+    int i = 0;
+
+#if TK_RASTER_SSE2
+    // Indices into the table four at a time, the lookups themselves stay scalar
+    const __m128 scale = _mm_set1_ps(255.0f);
+    const __m128 half = _mm_set1_ps(0.5f);
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 advance = _mm_set1_ps((float)(step * 4.0));
+    __m128 position = _mm_set_ps((float)(t + 3.0 * step), (float)(t + 2.0 * step), (float)(t + step), (float)t);
+
+    for (; i + 4 <= count; i += 4) {
+        __m128 clamped = _mm_min_ps(_mm_max_ps(position, zero), one);
+        int32_t indices[4];
+        _mm_storeu_si128((__m128i *)indices, _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(clamped, scale), half)));
+
+        span[i] = gradient->table[indices[0]];
+        span[i + 1] = gradient->table[indices[1]];
+        span[i + 2] = gradient->table[indices[2]];
+        span[i + 3] = gradient->table[indices[3]];
+
+        position = _mm_add_ps(position, advance);
+    }
+#endif
+
+    for (; i < count; i++) {
+        double position = t + step * i;
+        position = position < 0.0 ? 0.0 : (position > 1.0 ? 1.0 : position);
+        span[i] = gradient->table[(int)(position * 255.0 + 0.5)];
+    }
+}
+
+#pragma mark - Blend modes
+
+// Separable blend modes of the PDF specification, on colors that are not premultiplied
+static inline float TKRasterBlendComponent(TKRasterBlendMode mode, float source, float backdrop) {
+    switch (mode) {
+        case TKRasterBlendMultiply:
+            return source * backdrop;
+        case TKRasterBlendOverlay:
+            if (backdrop <= 0.5f)
+                return 2.0f * source * backdrop;
+
+            return 1.0f - 2.0f * (1.0f - source) * (1.0f - backdrop);
+        case TKRasterBlendSoftLight:
+            if (source <= 0.5f)
+                return backdrop - (1.0f - 2.0f * source) * backdrop * (1.0f - backdrop);
+            else {
+                float d = backdrop <= 0.25f ? ((16.0f * backdrop - 12.0f) * backdrop + 4.0f) * backdrop : sqrtf(backdrop);
+                return backdrop + (2.0f * source - 1.0f) * (d - backdrop);
+            }
+        default:
+            return source;
+    }
+}
+
+// Anything but source over, in floating point. The result is blended with the destination by the coverage
+static void TKRasterBlendSpanWithMode(uint32_t *destination, const uint32_t *source, const uint8_t *cover, int count, TKRasterBlendMode mode) {
+    for (int i = 0; i < count; i++) {
+        if (cover[i] == 0)
+            continue;
+
+        uint32_t s = source[i], d = destination[i];
+        float sa = (s >> 24) / 255.0f, da = (d >> 24) / 255.0f;
+        float coverage = cover[i] / 255.0f;
+
+        uint32_t result = 0;
+        for (int shift = 0; shift < 24; shift += 8) {
+            float sc = ((s >> shift) & 0xff) / 255.0f, dc = ((d >> shift) & 0xff) / 255.0f;
+            float blended = TKRasterBlendComponent(mode, sa > 0.0f ? sc / sa : 0.0f, da > 0.0f ? dc / da : 0.0f);
+            float value = sc * (1.0f - da) + dc * (1.0f - sa) + sa * da * blended;
+
+            result |= (uint32_t)TKRasterUnitToByte(dc + (value - dc) * coverage) << shift;
+        }
+
+        float alpha = sa + da - sa * da;
+        result |= (uint32_t)TKRasterUnitToByte(da + (alpha - da) * coverage) << 24;
+
+        destination[i] = result;
+    }
+}
+
+#pragma mark - Surface
+
+bool TKRasterSurfaceInit(TKRasterSurface *surface, int width, int height) {
+    surface->width = width > 0 ? width : 0;
+    surface->height = height > 0 ? height : 0;
+    surface->bytesPerRow = (size_t)surface->width * 4;
+    surface->ownsPixels = true;
+    surface->pixels = (uint32_t *)calloc((size_t)surface->width * surface->height + 1, sizeof(uint32_t));
+
+    return surface->pixels != NULL;
+}
+
+void TKRasterSurfaceInitWithPixels(TKRasterSurface *surface, uint32_t *pixels, int width, int height, size_t bytesPerRow) {
+    surface->pixels = pixels;
+    surface->width = width;
+    surface->height = height;
+    surface->bytesPerRow = bytesPerRow;
+    surface->ownsPixels = false;
+}
+
+void TKRasterSurfaceFree(TKRasterSurface *surface) {
+    if (surface->ownsPixels)
+        free(surface->pixels);
+
+    surface->pixels = NULL;
+    surface->width = surface->height = 0;
+}
+
+static inline uint32_t *TKRasterSurfaceRow(const TKRasterSurface *surface, int y) {
+    return (uint32_t *)((uint8_t *)surface->pixels + surface->bytesPerRow * (size_t)y);
+}
+
+void TKRasterSurfaceClear(TKRasterSurface *surface, TKRasterColor color) {
+    uint32_t pixel = TKRasterPremultipliedPixel(color);
+
+    for (int y = 0; y < surface->height; y++) {
+        uint32_t *row = TKRasterSurfaceRow(surface, y);
+        for (int x = 0; x < surface->width; x++) {
+            row[x] = pixel;
+        }
+    }
+}
+
+#pragma mark - Gradient
+
+void TKRasterGradientInit(TKRasterGradient *gradient, const TKRasterColor *colors, const float *locations, size_t count) {
+    if (count == 0) {
+        memset(gradient->table, 0, sizeof(gradient->table));
+        return;
+    }
+
+    size_t stop = 0;
+    for (int i = 0; i < 256; i++) {
+        float t = i / 255.0f;
+
+        // Find the stops around t, colors are interpolated before they are premultiplied
+        while (stop + 1 < count && (locations ? locations[stop + 1] : (float)(stop + 1) / (count - 1)) < t) {
+            stop++;
+        }
+
+        TKRasterColor color = colors[stop];
+        if (stop + 1 < count) {
+            float start = locations ? locations[stop] : (float)stop / (count - 1);
+            float end = locations ? locations[stop + 1] : (float)(stop + 1) / (count - 1);
+            float fraction = end > start ? (t - start) / (end - start) : 1.0f;
+            fraction = fraction < 0.0f ? 0.0f : (fraction > 1.0f ? 1.0f : fraction);
+
+            const TKRasterColor *next = &colors[stop + 1];
+            color.red += (next->red - color.red) * fraction;
+            color.green += (next->green - color.green) * fraction;
+            color.blue += (next->blue - color.blue) * fraction;
+            color.alpha += (next->alpha - color.alpha) * fraction;
+        }
+
+        gradient->table[i] = TKRasterPremultipliedPixel(color);
+    }
+}
+
+#pragma mark - Geometry
+
+static inline void TKRasterTransformPoint(const double *m, double x, double y, double *outX, double *outY) {
+    *outX = m[0] * x + m[2] * y + m[4];
+    *outY = m[1] * x + m[3] * y + m[5];
+}
+
+// How much the transform scales lengths, on average
+static inline double TKRasterTransformScale(const double *m) {
+    return sqrt(fabs(m[0] * m[3] - m[1] * m[2]));
+}
+
+static bool TKRasterAddEdge(TKRasterScratch *scratch, double x0, double y0, double x1, double y1, bool reversed) {
+    if (y0 == y1 || isnan(x0) || isnan(x1))
+        return true;
+
+    if (!TKRasterReserveArray(scratch->edges, scratch->edgeCapacity, scratch->edgeCount + 1))
+        return false;
+
+    TKRasterEdge *edge = &scratch->edges[scratch->edgeCount++];
+    edge->direction = y0 < y1 ? 1 : -1;
+    if (reversed)
+        edge->direction = -edge->direction;
+
+    if (y0 > y1) {
+        double x = x0, y = y0;
+        x0 = x1, y0 = y1;
+        x1 = x, y1 = y;
+    }
+
+    edge->x0 = (float)x0;
+    edge->y0 = (float)y0;
+    edge->x1 = (float)x1;
+    edge->y1 = (float)y1;
+    edge->dxdy = (float)((x1 - x0) / (y1 - y0));
+
+    scratch->minX = fminf(scratch->minX, (float)fmin(x0, x1));
+    scratch->maxX = fmaxf(scratch->maxX, (float)fmax(x0, x1));
+    scratch->minY = fminf(scratch->minY, (float)y0);
+    scratch->maxY = fmaxf(scratch->maxY, (float)y1);
+
+    return true;
+}
+
+static void TKRasterResetEdges(TKRasterScratch *scratch) {
+    scratch->edgeCount = 0;
+    scratch->minX = scratch->minY = INFINITY;
+    scratch->maxX = scratch->maxY = -INFINITY;
+}
+
+static bool TKRasterAddPoint(TKRasterScratch *scratch, double x, double y) {
+    TKRasterContour *contour = &scratch->contours[scratch->contourCount - 1];
+
+    // Repeated points would only make for empty segments
+    if (contour->count > 0) {
+        const double *last = scratch->points + 2 * (scratch->pointCount - 1);
+        if (last[0] == x && last[1] == y)
+            return true;
+    }
+
+    if (!TKRasterReserveArray(scratch->points, scratch->pointCapacity, 2 * (scratch->pointCount + 1)))
+        return false;
+
+    scratch->points[2 * scratch->pointCount] = x;
+    scratch->points[2 * scratch->pointCount + 1] = y;
+    scratch->pointCount++;
+    contour->count++;
+
+    return true;
+}
+
+static bool TKRasterBeginContour(TKRasterScratch *scratch, double x, double y) {
+    // An unused contour (two move operations in a row) is reused
+    if (scratch->contourCount == 0 || scratch->contours[scratch->contourCount - 1].count > 1 || scratch->contours[scratch->contourCount - 1].closed) {
+        if (!TKRasterReserveArray(scratch->contours, scratch->contourCapacity, scratch->contourCount + 1))
+            return false;
+
+        scratch->contourCount++;
+    } else {
+        scratch->pointCount = scratch->contours[scratch->contourCount - 1].first;
+    }
+
+    TKRasterContour *contour = &scratch->contours[scratch->contourCount - 1];
+    contour->first = scratch->pointCount;
+    contour->count = 0;
+    contour->closed = false;
+
+    return TKRasterAddPoint(scratch, x, y);
+}
+
+// Flattens the curves of the path into contours of points, transformed by m. The tolerance is in the
+// coordinates of the result
+static bool TKRasterFlattenPath(TKRasterScratch *scratch, const TKPathBuffer *path, const double *m, double tolerance) {
+    scratch->pointCount = 0;
+    scratch->contourCount = 0;
+
+    const double *coordinates = path->coordinates;
+    double startX = 0.0, startY = 0.0, currentX = 0.0, currentY = 0.0;
+    bool open = false;
+
+    for (size_t i = 0; i < path->operationCount; i++) {
+        TKPathOperation operation = (TKPathOperation)path->operations[i];
+
+        // Drawing on after a close (or without a move) starts a new contour at the current point
+        if (operation != TKPathOperationMoveTo && operation != TKPathOperationClose && !open) {
+            double x, y;
+            TKRasterTransformPoint(m, currentX, currentY, &x, &y);
+            if (!TKRasterBeginContour(scratch, x, y))
+                return false;
+
+            open = true;
+        }
+
+        switch (operation) {
+            case TKPathOperationMoveTo: {
+                currentX = startX = coordinates[0];
+                currentY = startY = coordinates[1];
+
+                double x, y;
+                TKRasterTransformPoint(m, currentX, currentY, &x, &y);
+                if (!TKRasterBeginContour(scratch, x, y))
+                    return false;
+
+                open = true;
+                break;
+            }
+            case TKPathOperationLineTo: {
+                currentX = coordinates[0];
+                currentY = coordinates[1];
+
+                double x, y;
+                TKRasterTransformPoint(m, currentX, currentY, &x, &y);
+                if (!TKRasterAddPoint(scratch, x, y))
+                    return false;
+                break;
+            }
+            case TKPathOperationQuadTo:
+            case TKPathOperationCubicTo: {
+                bool cubic = operation == TKPathOperationCubicTo;
+                double p[8] = { 0 };
+                TKRasterTransformPoint(m, currentX, currentY, &p[0], &p[1]);
+                TKRasterTransformPoint(m, coordinates[0], coordinates[1], &p[2], &p[3]);
+                TKRasterTransformPoint(m, coordinates[2], coordinates[3], &p[4], &p[5]);
+                if (cubic)
+                    TKRasterTransformPoint(m, coordinates[4], coordinates[5], &p[6], &p[7]);
+
+                // Number of lines from how far the curve bends away from its chord
+                double bend;
+                if (cubic) {
+                    bend = fmax(hypot(p[0] - 2.0 * p[2] + p[4], p[1] - 2.0 * p[3] + p[5]),
+                                hypot(p[2] - 2.0 * p[4] + p[6], p[3] - 2.0 * p[5] + p[7])) * 0.75;
+                } else {
+                    bend = hypot(p[0] - 2.0 * p[2] + p[4], p[1] - 2.0 * p[3] + p[5]) * 0.25;
+                }
+
+                int segments = (int)ceil(sqrt(bend / tolerance));
+                segments = segments < 1 ? 1 : (segments > 256 ? 256 : segments);
+
+                for (int segment = 1; segment <= segments; segment++) {
+                    double t = (double)segment / segments, u = 1.0 - t;
+                    double x, y;
+
+                    if (cubic) {
+                        x = u * u * u * p[0] + 3.0 * u * u * t * p[2] + 3.0 * u * t * t * p[4] + t * t * t * p[6];
+                        y = u * u * u * p[1] + 3.0 * u * u * t * p[3] + 3.0 * u * t * t * p[5] + t * t * t * p[7];
+                    } else {
+                        x = u * u * p[0] + 2.0 * u * t * p[2] + t * t * p[4];
+                        y = u * u * p[1] + 2.0 * u * t * p[3] + t * t * p[5];
+                    }
+
+                    if (!TKRasterAddPoint(scratch, x, y))
+                        return false;
+                }
+
+                currentX = coordinates[cubic ? 4 : 2];
+                currentY = coordinates[cubic ? 5 : 3];
+                break;
+            }
+            case TKPathOperationClose:
+                if (open) {
+                    TKRasterContour *contour = &scratch->contours[scratch->contourCount - 1];
+                    contour->closed = true;
+
+                    // The closing segment is implied, drop the last point if it repeats the first
+                    const double *first = scratch->points + 2 * contour->first;
+                    const double *last = scratch->points + 2 * (scratch->pointCount - 1);
+                    if (contour->count > 1 && first[0] == last[0] && first[1] == last[1]) {
+                        scratch->pointCount--;
+                        contour->count--;
+                    }
+                }
+
+                currentX = startX;
+                currentY = startY;
+                open = false;
+                break;
+        }
+
+        coordinates += TKPathOperationCoordinateCount[operation];
+    }
+
+    return true;
+}
+
+// Edges of the flattened path for a fill, every contour is closed
+static bool TKRasterAddContourEdges(TKRasterScratch *scratch) {
+    for (size_t c = 0; c < scratch->contourCount; c++) {
+        const TKRasterContour *contour = &scratch->contours[c];
+        const double *points = scratch->points + 2 * contour->first;
+
+        for (size_t i = 0; i < contour->count; i++) {
+            size_t next = (i + 1) % contour->count;
+            if (!TKRasterAddEdge(scratch, points[2 * i], points[2 * i + 1], points[2 * next], points[2 * next + 1], false))
+                return false;
+        }
+    }
+
+    return true;
+}
+
+#pragma mark - Strokes
+
+// Strokes are a union of polygons (a quad per segment, joins and caps), which nonzero filling merges as
+// long as all of them wind the same way. The polygons are built untransformed and transformed afterwards
+static bool TKRasterAddPolygon(TKRasterScratch *scratch, const double *points, int count, const double *m) {
+    double area = 0.0;
+    for (int i = 0; i < count; i++) {
+        int next = (i + 1) % count;
+        area += points[2 * i] * points[2 * next + 1] - points[2 * next] * points[2 * i + 1];
+    }
+
+    if (area == 0.0)
+        return true;
+
+    for (int i = 0; i < count; i++) {
+        int next = (i + 1) % count;
+        double x0, y0, x1, y1;
+        TKRasterTransformPoint(m, points[2 * i], points[2 * i + 1], &x0, &y0);
+        TKRasterTransformPoint(m, points[2 * next], points[2 * next + 1], &x1, &y1);
+
+        if (!TKRasterAddEdge(scratch, x0, y0, x1, y1, area < 0.0))
+            return false;
+    }
+
+    return true;
+}
+
+static bool TKRasterAddCircle(TKRasterScratch *scratch, double x, double y, double radius, const double *m) {
+    double deviceRadius = radius * TKRasterTransformScale(m);
+    int segments = 8;
+    if (deviceRadius > TKRasterTolerance)
+        segments = (int)ceil(M_PI / acos(1.0 - TKRasterTolerance / deviceRadius));
+
+    segments = segments < 8 ? 8 : (segments > 256 ? 256 : segments);
+
+    double points[2 * 256];
+    for (int i = 0; i < segments; i++) {
+        double angle = 2.0 * M_PI * i / segments;
+        points[2 * i] = x + cos(angle) * radius;
+        points[2 * i + 1] = y + sin(angle) * radius;
+    }
+
+    return TKRasterAddPolygon(scratch, points, segments, m);
+}
+
+static bool TKRasterAddJoin(TKRasterScratch *scratch, const TKRasterState *state, const double *point, const double *incoming, const double *outgoing, double halfWidth, const double *m) {
+    if (state->lineJoin == TKRasterLineJoinRound)
+        return TKRasterAddCircle(scratch, point[0], point[1], halfWidth, m);
+
+    // The outer side of the turn, the inner one is covered by the segments already
+    double cross = incoming[0] * outgoing[1] - incoming[1] * outgoing[0];
+    double side = cross > 0.0 ? -1.0 : 1.0;
+
+    double a[2] = { point[0] - incoming[1] * halfWidth * side, point[1] + incoming[0] * halfWidth * side };
+    double b[2] = { point[0] - outgoing[1] * halfWidth * side, point[1] + outgoing[0] * halfWidth * side };
+
+    double cosine = incoming[0] * outgoing[0] + incoming[1] * outgoing[1];
+    if (state->lineJoin == TKRasterLineJoinMiter && cosine > -1.0 + 1e-9) {
+        // Length of the miter relative to the line width, 1 / sin(half of the angle between the segments)
+        double ratio = 1.0 / sqrt((1.0 + cosine) / 2.0);
+        if (ratio <= state->miterLimit) {
+            double miter[2] = { point[0] + ((a[0] - point[0]) + (b[0] - point[0])) / (1.0 + cosine),
+                                point[1] + ((a[1] - point[1]) + (b[1] - point[1])) / (1.0 + cosine) };
+
+            double polygon[8] = { point[0], point[1], a[0], a[1], miter[0], miter[1], b[0], b[1] };
+            return TKRasterAddPolygon(scratch, polygon, 4, m);
+        }
+    }
+
+    double polygon[6] = { point[0], point[1], a[0], a[1], b[0], b[1] };
+    return TKRasterAddPolygon(scratch, polygon, 3, m);
+}
+
+static bool TKRasterAddStrokeEdges(TKRasterScratch *scratch, const TKRasterState *state, const double *m) {
+    double halfWidth = state->lineWidth / 2.0;
+    if (halfWidth <= 0.0)
+        return true;
+
+    for (size_t c = 0; c < scratch->contourCount; c++) {
+        const TKRasterContour *contour = &scratch->contours[c];
+        const double *points = scratch->points + 2 * contour->first;
+        size_t count = contour->count;
+
+        // A lone point only shows with round or square caps
+        if (count == 1) {
+            if (state->lineCap == TKRasterLineCapRound && !TKRasterAddCircle(scratch, points[0], points[1], halfWidth, m))
+                return false;
+
+            if (state->lineCap == TKRasterLineCapSquare) {
+                double square[8] = { points[0] - halfWidth, points[1] - halfWidth, points[0] + halfWidth, points[1] - halfWidth,
+                                     points[0] + halfWidth, points[1] + halfWidth, points[0] - halfWidth, points[1] + halfWidth };
+                if (!TKRasterAddPolygon(scratch, square, 4, m))
+                    return false;
+            }
+
+            continue;
+        }
+
+        size_t segments = contour->closed ? count : count - 1;
+        double firstDirection[2] = { 0.0, 0.0 }, previousDirection[2] = { 0.0, 0.0 };
+
+        for (size_t i = 0; i < segments; i++) {
+            const double *start = points + 2 * i;
+            const double *end = points + 2 * ((i + 1) % count);
+
+            double length = hypot(end[0] - start[0], end[1] - start[1]);
+            double direction[2] = { (end[0] - start[0]) / length, (end[1] - start[1]) / length };
+            double normal[2] = { -direction[1] * halfWidth, direction[0] * halfWidth };
+
+            // Square caps extend the first and the last segment of an open contour
+            double startExtension = 0.0, endExtension = 0.0;
+            if (!contour->closed && state->lineCap == TKRasterLineCapSquare) {
+                if (i == 0)
+                    startExtension = halfWidth;
+                if (i == segments - 1)
+                    endExtension = halfWidth;
+            }
+
+            double from[2] = { start[0] - direction[0] * startExtension, start[1] - direction[1] * startExtension };
+            double to[2] = { end[0] + direction[0] * endExtension, end[1] + direction[1] * endExtension };
+            double quad[8] = { from[0] + normal[0], from[1] + normal[1], to[0] + normal[0], to[1] + normal[1],
+                               to[0] - normal[0], to[1] - normal[1], from[0] - normal[0], from[1] - normal[1] };
+
+            if (!TKRasterAddPolygon(scratch, quad, 4, m))
+                return false;
+
+            if (i == 0) {
+                firstDirection[0] = direction[0];
+                firstDirection[1] = direction[1];
+            } else if (!TKRasterAddJoin(scratch, state, start, previousDirection, direction, halfWidth, m)) {
+                return false;
+            }
+
+            previousDirection[0] = direction[0];
+            previousDirection[1] = direction[1];
+        }
+
+        if (contour->closed) {
+            if (!TKRasterAddJoin(scratch, state, points, previousDirection, firstDirection, halfWidth, m))
+                return false;
+        } else if (state->lineCap == TKRasterLineCapRound) {
+            const double *last = points + 2 * (count - 1);
+            if (!TKRasterAddCircle(scratch, points[0], points[1], halfWidth, m) || !TKRasterAddCircle(scratch, last[0], last[1], halfWidth, m))
+                return false;
+        }
+    }
+
+    return true;
+}
+
+#pragma mark - Scan conversion
+
+static int TKRasterCompareEdges(const void *first, const void *second) {
+    float a = ((const TKRasterEdge *)first)->y0, b = ((const TKRasterEdge *)second)->y0;
+    return a < b ? -1 : (a > b ? 1 : 0);
+}
+
+// Coverage of the edges in scratch within the limits, the mask is empty if nothing is covered
+static bool TKRasterRenderMask(TKRasterScratch *scratch, TKRasterFillRule rule, int left, int top, int right, int bottom, TKRasterMask *mask) {
+    mask->width = mask->height = 0;
+    mask->coverage = NULL;
+
+    if (scratch->edgeCount == 0)
+        return true;
+
+    int x0 = (int)floorf(scratch->minX), x1 = (int)ceilf(scratch->maxX) + 1;
+    int y0 = (int)floorf(scratch->minY), y1 = (int)ceilf(scratch->maxY);
+    x0 = x0 < left ? left : x0;
+    y0 = y0 < top ? top : y0;
+    x1 = x1 > right ? right : x1;
+    y1 = y1 > bottom ? bottom : y1;
+
+    if (x1 <= x0 || y1 <= y0)
+        return true;
+
+    int width = x1 - x0, height = y1 - y0;
+    if (!TKRasterReserveArray(scratch->mask, scratch->maskCapacity, (size_t)width * height) ||
+        !TKRasterReserveArray(scratch->accumulation, scratch->accumulationCapacity, 2 * (size_t)(width + 2)) ||
+        !TKRasterReserveArray(scratch->active, scratch->activeCapacity, scratch->edgeCount) ||
+        !TKRasterReserveArray(scratch->crossings, scratch->crossingCapacity, scratch->edgeCount))
+        return false;
+
+    qsort(scratch->edges, scratch->edgeCount, sizeof(TKRasterEdge), TKRasterCompareEdges);
+
+    float *area = scratch->accumulation;
+    float *delta = scratch->accumulation + width + 2;
+    const float weight = 1.0f / TKRasterSamples;
+    size_t nextEdge = 0, activeCount = 0;
+
+    for (int y = y0; y < y1; y++) {
+        memset(scratch->accumulation, 0, 2 * (size_t)(width + 2) * sizeof(float));
+
+        for (int sample = 0; sample < TKRasterSamples; sample++) {
+            float sampleY = y + (sample + 0.5f) / TKRasterSamples;
+
+            // Edges starting above the sample join the active ones, the ones that ended leave
+            while (nextEdge < scratch->edgeCount && scratch->edges[nextEdge].y0 <= sampleY) {
+                scratch->active[activeCount++] = nextEdge++;
+            }
+
+            size_t crossingCount = 0;
+            for (size_t i = 0; i < activeCount; i++) {
+                const TKRasterEdge *edge = &scratch->edges[scratch->active[i]];
+                if (edge->y1 <= sampleY) {
+                    scratch->active[i--] = scratch->active[--activeCount];
+                    continue;
+                }
+
+                // Insertion sort, there are only a few crossings on a line
+                float x = edge->x0 + (sampleY - edge->y0) * edge->dxdy;
+                size_t position = crossingCount++;
+                while (position > 0 && scratch->crossings[position - 1].x > x) {
+                    scratch->crossings[position] = scratch->crossings[position - 1];
+                    position--;
+                }
+
+                scratch->crossings[position].x = x;
+                scratch->crossings[position].direction = edge->direction;
+            }
+
+            int winding = 0;
+            for (size_t i = 0; i + 1 < crossingCount; i++) {
+                winding += scratch->crossings[i].direction;
+
+                bool inside = rule == TKRasterFillEvenOdd ? (winding & 1) != 0 : winding != 0;
+                if (!inside)
+                    continue;
+
+                float a = scratch->crossings[i].x - x0, b = scratch->crossings[i + 1].x - x0;
+                a = a < 0.0f ? 0.0f : (a > width ? width : a);
+                b = b < 0.0f ? 0.0f : (b > width ? width : b);
+                if (b <= a)
+                    continue;
+
+                // Partial pixels at both ends, whole ones in between go into the running sum
+                int first = (int)a, last = (int)b;
+                if (first == last) {
+                    area[first] += (b - a) * weight;
+                } else {
+                    area[first] += (first + 1 - a) * weight;
+                    delta[first + 1] += weight;
+                    delta[last] -= weight;
+                    area[last] += (b - last) * weight;
+                }
+            }
+        }
+
+        uint8_t *row = scratch->mask + (size_t)(y - y0) * width;
+        float running = 0.0f;
+        for (int x = 0; x < width; x++) {
+            running += delta[x];
+            row[x] = TKRasterUnitToByte(running + area[x]);
+        }
+    }
+
+    mask->x = x0;
+    mask->y = y0;
+    mask->width = width;
+    mask->height = height;
+    mask->coverage = scratch->mask;
+
+    return true;
+}
+
+#pragma mark - Compositing
+
+static void TKRasterPaintSpan(const TKRasterPaint *paint, uint32_t *span, int x, int y, int count) {
+    if (paint->gradient) {
+        double t = paint->t0 + paint->tx * (x + 0.5) + paint->ty * (y + 0.5);
+        TKRasterGradientSpan(span, paint->gradient, t, paint->tx, count);
+    } else {
+        for (int i = 0; i < count; i++) {
+            span[i] = paint->color;
+        }
+    }
+}
+
+// Draws the paint through the coverage of the mask (offset by dx, dy), within the clip and with the alpha of the state
+static bool TKRasterComposite(TKRasterContext *context, const TKRasterMask *mask, int dx, int dy, const TKRasterPaint *paint) {
+    const TKRasterState *state = &context->state;
+    TKRasterScratch *scratch = context->scratch;
+
+    int left = mask->x + dx, top = mask->y + dy;
+    int x0 = left > state->clipLeft ? left : state->clipLeft;
+    int y0 = top > state->clipTop ? top : state->clipTop;
+    int x1 = left + mask->width < state->clipRight ? left + mask->width : state->clipRight;
+    int y1 = top + mask->height < state->clipBottom ? top + mask->height : state->clipBottom;
+
+    if (x1 <= x0 || y1 <= y0)
+        return true;
+
+    int count = x1 - x0;
+    if (!TKRasterReserveArray(scratch->cover, scratch->coverCapacity, (size_t)count) ||
+        !TKRasterReserveArray(scratch->span, scratch->spanCapacity, (size_t)count))
+        return false;
+
+    uint32_t alpha = TKRasterUnitToByte(state->alpha);
+    bool solid = !paint->gradient && state->blendMode == TKRasterBlendNormal;
+
+    for (int y = y0; y < y1; y++) {
+        const uint8_t *coverage = mask->coverage + (size_t)(y - top) * mask->width + (x0 - left);
+        const uint8_t *clip = state->clipMask ? state->clipMask->coverage + (size_t)y * context->surface->width + x0 : NULL;
+
+        bool empty = true;
+        for (int i = 0; i < count; i++) {
+            uint32_t value = coverage[i];
+            if (alpha != 255)
+                value = TKRasterMultiply255(value, alpha);
+            if (clip)
+                value = TKRasterMultiply255(value, clip[i]);
+
+            scratch->cover[i] = (uint8_t)value;
+            empty = empty && value == 0;
+        }
+
+        if (empty)
+            continue;
+
+        uint32_t *destination = TKRasterSurfaceRow(context->surface, y) + x0;
+        if (solid) {
+            TKRasterBlendSolid(destination, paint->color, scratch->cover, count);
+            continue;
+        }
+
+        TKRasterPaintSpan(paint, scratch->span, x0, y, count);
+
+        if (state->blendMode == TKRasterBlendNormal)
+            TKRasterBlendSpan(destination, scratch->span, scratch->cover, count);
+        else
+            TKRasterBlendSpanWithMode(destination, scratch->span, scratch->cover, count, state->blendMode);
+    }
+
+    return true;
+}
+
+// Three passes of a box blur along one axis, close enough to a gaussian. Pixels outside are transparent
+static void TKRasterBoxBlur(uint8_t *pixels, int count, int stride, int radius, uint16_t *line) {
+    int size = 2 * radius + 1;
+
+    for (int pass = 0; pass < 3; pass++) {
+        for (int i = 0; i < count; i++) {
+            line[i] = pixels[i * stride];
+        }
+
+        uint32_t sum = 0;
+        for (int i = 0; i < radius && i < count; i++) {
+            sum += line[i];
+        }
+
+        for (int i = 0; i < count; i++) {
+            if (i + radius < count)
+                sum += line[i + radius];
+            if (i - radius - 1 >= 0)
+                sum -= line[i - radius - 1];
+
+            pixels[i * stride] = (uint8_t)((sum + size / 2) / size);
+        }
+    }
+}
+
+// Drop shadow of the mask, from the alpha the paint leaves behind
+static bool TKRasterDrawShadow(TKRasterContext *context, const TKRasterMask *mask, const TKRasterPaint *paint) {
+    const TKRasterState *state = &context->state;
+    TKRasterScratch *scratch = context->scratch;
+
+    // Core Graphics uses the blur as twice the standard deviation
+    double sigma = state->shadowBlur / 2.0;
+    int radius = sigma > 0.0 ? (int)floor((sqrt(4.0 * sigma * sigma + 1.0) - 1.0) / 2.0 + 0.5) : 0;
+    int padding = 3 * radius;
+
+    TKRasterMask shadow;
+    shadow.x = mask->x - padding;
+    shadow.y = mask->y - padding;
+    shadow.width = mask->width + 2 * padding;
+    shadow.height = mask->height + 2 * padding;
+
+    size_t longest = (size_t)(shadow.width > shadow.height ? shadow.width : shadow.height);
+    if (!TKRasterReserveArray(scratch->shadow, scratch->shadowCapacity, (size_t)shadow.width * shadow.height) ||
+        !TKRasterReserveArray(scratch->blur, scratch->blurCapacity, longest) ||
+        !TKRasterReserveArray(scratch->span, scratch->spanCapacity, (size_t)mask->width))
+        return false;
+
+    shadow.coverage = scratch->shadow;
+    memset(shadow.coverage, 0, (size_t)shadow.width * shadow.height);
+
+    for (int y = 0; y < mask->height; y++) {
+        const uint8_t *coverage = mask->coverage + (size_t)y * mask->width;
+        uint8_t *row = shadow.coverage + (size_t)(y + padding) * shadow.width + padding;
+
+        if (paint->gradient) {
+            TKRasterPaintSpan(paint, scratch->span, mask->x, mask->y + y, mask->width);
+            for (int x = 0; x < mask->width; x++) {
+                row[x] = (uint8_t)TKRasterMultiply255(coverage[x], scratch->span[x] >> 24);
+            }
+        } else {
+            for (int x = 0; x < mask->width; x++) {
+                row[x] = (uint8_t)TKRasterMultiply255(coverage[x], paint->color >> 24);
+            }
+        }
+    }
+
+    if (radius > 0) {
+        for (int y = 0; y < shadow.height; y++) {
+            TKRasterBoxBlur(shadow.coverage + (size_t)y * shadow.width, shadow.width, 1, radius, scratch->blur);
+        }
+
+        for (int x = 0; x < shadow.width; x++) {
+            TKRasterBoxBlur(shadow.coverage + x, shadow.height, shadow.width, radius, scratch->blur);
+        }
+    }
+
+    TKRasterPaint shadowPaint = { TKRasterPremultipliedPixel(state->shadowColor), NULL, 0.0, 0.0, 0.0 };
+    return TKRasterComposite(context, &shadow, (int)lround(state->shadowOffsetX), (int)lround(state->shadowOffsetY), &shadowPaint);
+}
+
+// Fills the edges in scratch with the paint, along with the shadow
+static bool TKRasterFillEdges(TKRasterContext *context, TKRasterFillRule rule, const TKRasterPaint *paint) {
+    const TKRasterState *state = &context->state;
+
+    // Shapes outside of the clip can still cast a shadow into it
+    int left = state->clipLeft, top = state->clipTop, right = state->clipRight, bottom = state->clipBottom;
+    bool shadow = state->hasShadow;
+    if (shadow) {
+        int reach = (int)ceil(state->shadowBlur * 2.0) + 1;
+        int dx = (int)lround(state->shadowOffsetX), dy = (int)lround(state->shadowOffsetY);
+
+        left = (dx > 0 ? left - dx : left) - reach;
+        top = (dy > 0 ? top - dy : top) - reach;
+        right = (dx < 0 ? right - dx : right) + reach;
+        bottom = (dy < 0 ? bottom - dy : bottom) + reach;
+    }
+
+    TKRasterMask mask;
+    if (!TKRasterRenderMask(context->scratch, rule, left, top, right, bottom, &mask))
+        return false;
+
+    if (mask.width == 0)
+        return true;
+
+    if (shadow && !TKRasterDrawShadow(context, &mask, paint))
+        return false;
+
+    return TKRasterComposite(context, &mask, 0, 0, paint);
+}
+
+#pragma mark - Context
+
+static void TKRasterStateInit(TKRasterState *state, const TKRasterSurface *surface) {
+    memset(state, 0, sizeof(TKRasterState));
+
+    state->transform[0] = state->transform[3] = 1.0;
+    state->alpha = 1.0f;
+    state->blendMode = TKRasterBlendNormal;
+    state->lineWidth = 1.0f;
+    state->lineCap = TKRasterLineCapButt;
+    state->lineJoin = TKRasterLineJoinMiter;
+    state->miterLimit = 10.0f;
+    state->clipRight = surface->width;
+    state->clipBottom = surface->height;
+}
+
+bool TKRasterContextInit(TKRasterContext *context, TKRasterSurface *surface) {
+    context->surface = surface;
+    context->stackDepth = 0;
+    TKRasterStateInit(&context->state, surface);
+
+    context->scratch = (TKRasterScratch *)calloc(1, sizeof(TKRasterScratch));
+    return context->scratch != NULL;
+}
+
+void TKRasterContextFree(TKRasterContext *context) {
+    while (context->stackDepth > 0) {
+        TKRasterContextRestoreState(context);
+    }
+
+    TKRasterClipRelease(context->state.clipMask);
+    context->state.clipMask = NULL;
+
+    TKRasterScratch *scratch = context->scratch;
+    if (scratch) {
+        free(scratch->edges);
+        free(scratch->points);
+        free(scratch->contours);
+        free(scratch->active);
+        free(scratch->crossings);
+        free(scratch->accumulation);
+        free(scratch->mask);
+        free(scratch->shadow);
+        free(scratch->blur);
+        free(scratch->cover);
+        free(scratch->span);
+        free(scratch);
+    }
+
+    context->scratch = NULL;
+}
+
+bool TKRasterContextSaveState(TKRasterContext *context) {
+    if (context->stackDepth >= TKRasterStateStackDepth)
+        return false;
+
+    // The clip mask is shared until one of the states clips further
+    if (context->state.clipMask)
+        context->state.clipMask->referenceCount++;
+
+    context->stack[context->stackDepth++] = context->state;
+    return true;
+}
+
+void TKRasterContextRestoreState(TKRasterContext *context) {
+    if (context->stackDepth == 0)
+        return;
+
+    TKRasterClipRelease(context->state.clipMask);
+    context->state = context->stack[--context->stackDepth];
+}
+
+void TKRasterContextConcatTransform(TKRasterContext *context, const double *t) {
+    double *m = context->state.transform;
+    double result[6] = {
+        t[0] * m[0] + t[1] * m[2],
+        t[0] * m[1] + t[1] * m[3],
+        t[2] * m[0] + t[3] * m[2],
+        t[2] * m[1] + t[3] * m[3],
+        t[4] * m[0] + t[5] * m[2] + m[4],
+        t[4] * m[1] + t[5] * m[3] + m[5]
+    };
+
+    memcpy(m, result, sizeof(result));
+}
+
+void TKRasterContextTranslate(TKRasterContext *context, double tx, double ty) {
+    double transform[6] = { 1.0, 0.0, 0.0, 1.0, tx, ty };
+    TKRasterContextConcatTransform(context, transform);
+}
+
+void TKRasterContextScale(TKRasterContext *context, double sx, double sy) {
+    double transform[6] = { sx, 0.0, 0.0, sy, 0.0, 0.0 };
+    TKRasterContextConcatTransform(context, transform);
+}
+
+void TKRasterContextSetAlpha(TKRasterContext *context, float alpha) {
+    context->state.alpha = alpha < 0.0f ? 0.0f : (alpha > 1.0f ? 1.0f : alpha);
+}
+
+void TKRasterContextSetBlendMode(TKRasterContext *context, TKRasterBlendMode mode) {
+    context->state.blendMode = mode;
+}
+
+void TKRasterContextSetLineWidth(TKRasterContext *context, float width) {
+    context->state.lineWidth = width;
+}
+
+void TKRasterContextSetLineCap(TKRasterContext *context, TKRasterLineCap cap) {
+    context->state.lineCap = cap;
+}
+
+void TKRasterContextSetLineJoin(TKRasterContext *context, TKRasterLineJoin join) {
+    context->state.lineJoin = join;
+}
+
+void TKRasterContextSetMiterLimit(TKRasterContext *context, float limit) {
+    context->state.miterLimit = limit;
+}
+
+void TKRasterContextSetShadow(TKRasterContext *context, float offsetX, float offsetY, float blur, TKRasterColor color) {
+    TKRasterState *state = &context->state;
+    state->hasShadow = color.alpha > 0.0f;
+    state->shadowOffsetX = offsetX;
+    state->shadowOffsetY = offsetY;
+    state->shadowBlur = blur > 0.0f ? blur : 0.0f;
+    state->shadowColor = color;
+}
+
+#pragma mark - Clipping
+
+bool TKRasterContextClipToPath(TKRasterContext *context, const TKPathBuffer *path, TKRasterFillRule rule) {
+    TKRasterState *state = &context->state;
+    TKRasterScratch *scratch = context->scratch;
+
+    TKRasterResetEdges(scratch);
+    if (!TKRasterFlattenPath(scratch, path, state->transform, TKRasterTolerance) || !TKRasterAddContourEdges(scratch))
+        return false;
+
+    TKRasterMask mask;
+    if (!TKRasterRenderMask(scratch, rule, state->clipLeft, state->clipTop, state->clipRight, state->clipBottom, &mask))
+        return false;
+
+    // Nothing left to draw into
+    if (mask.width == 0) {
+        state->clipRight = state->clipLeft;
+        state->clipBottom = state->clipTop;
+        return true;
+    }
+
+    int width = context->surface->width;
+    TKRasterClip *clip = (TKRasterClip *)calloc(1, sizeof(TKRasterClip) + (size_t)width * context->surface->height);
+    if (!clip)
+        return false;
+
+    clip->referenceCount = 1;
+    for (int y = 0; y < mask.height; y++) {
+        const uint8_t *coverage = mask.coverage + (size_t)y * mask.width;
+        uint8_t *row = clip->coverage + (size_t)(mask.y + y) * width + mask.x;
+        const uint8_t *previous = state->clipMask ? state->clipMask->coverage + (size_t)(mask.y + y) * width + mask.x : NULL;
+
+        for (int x = 0; x < mask.width; x++) {
+            row[x] = previous ? (uint8_t)TKRasterMultiply255(coverage[x], previous[x]) : coverage[x];
+        }
+    }
+
+    TKRasterClipRelease(state->clipMask);
+    state->clipMask = clip;
+    state->clipLeft = mask.x;
+    state->clipTop = mask.y;
+    state->clipRight = mask.x + mask.width;
+    state->clipBottom = mask.y + mask.height;
+
+    return true;
+}
+
+bool TKRasterContextClipToRect(TKRasterContext *context, double x, double y, double width, double height) {
+    TKRasterState *state = &context->state;
+    const double *m = state->transform;
+
+    // Rects that land on whole pixels only move the clip rect, everything else is clipped as a path
+    if (m[1] == 0.0 && m[2] == 0.0) {
+        double left, top, right, bottom;
+        TKRasterTransformPoint(m, x, y, &left, &top);
+        TKRasterTransformPoint(m, x + width, y + height, &right, &bottom);
+
+        if (left > right) {
+            double swap = left;
+            left = right, right = swap;
+        }
+
+        if (top > bottom) {
+            double swap = top;
+            top = bottom, bottom = swap;
+        }
+
+        if (left == floor(left) && top == floor(top) && right == floor(right) && bottom == floor(bottom)) {
+            state->clipLeft = (int)fmax(state->clipLeft, left);
+            state->clipTop = (int)fmax(state->clipTop, top);
+            state->clipRight = (int)fmin(state->clipRight, right);
+            state->clipBottom = (int)fmin(state->clipBottom, bottom);
+
+            if (state->clipRight < state->clipLeft)
+                state->clipRight = state->clipLeft;
+            if (state->clipBottom < state->clipTop)
+                state->clipBottom = state->clipTop;
+
+            return true;
+        }
+    }
+
+    TKPathBuffer path;
+    TKPathBufferInit(&path);
+
+    bool result = TKRasterPathAddRect(&path, x, y, width, height) && TKRasterContextClipToPath(context, &path, TKRasterFillNonZero);
+    TKPathBufferFree(&path);
+
+    return result;
+}
+
+#pragma mark - Drawing
+
+bool TKRasterContextFillPath(TKRasterContext *context, const TKPathBuffer *path, TKRasterFillRule rule, TKRasterColor color) {
+    TKRasterScratch *scratch = context->scratch;
+
+    TKRasterResetEdges(scratch);
+    if (!TKRasterFlattenPath(scratch, path, context->state.transform, TKRasterTolerance) || !TKRasterAddContourEdges(scratch))
+        return false;
+
+    TKRasterPaint paint = { TKRasterPremultipliedPixel(color), NULL, 0.0, 0.0, 0.0 };
+    return TKRasterFillEdges(context, rule, &paint);
+}
+
+bool TKRasterContextStrokePath(TKRasterContext *context, const TKPathBuffer *path, TKRasterColor color) {
+    TKRasterScratch *scratch = context->scratch;
+    const double *m = context->state.transform;
+
+    // Flattened without the transform, so that the width is in the same units as the path
+    double identity[6] = { 1.0, 0.0, 0.0, 1.0, 0.0, 0.0 };
+    double scale = TKRasterTransformScale(m);
+
+    TKRasterResetEdges(scratch);
+    if (!TKRasterFlattenPath(scratch, path, identity, scale > 0.0 ? TKRasterTolerance / scale : TKRasterTolerance) ||
+        !TKRasterAddStrokeEdges(scratch, &context->state, m))
+        return false;
+
+    TKRasterPaint paint = { TKRasterPremultipliedPixel(color), NULL, 0.0, 0.0, 0.0 };
+    return TKRasterFillEdges(context, TKRasterFillNonZero, &paint);
+}
+
+bool TKRasterContextFillPathWithGradient(TKRasterContext *context, const TKPathBuffer *path, TKRasterFillRule rule, const TKRasterGradient *gradient,
+                                         double startX, double startY, double endX, double endY) {
+    TKRasterScratch *scratch = context->scratch;
+    const double *m = context->state.transform;
+
+    TKRasterResetEdges(scratch);
+    if (!TKRasterFlattenPath(scratch, path, m, TKRasterTolerance) || !TKRasterAddContourEdges(scratch))
+        return false;
+
+    // Position along the gradient of a pixel, through the inverse of the transform
+    TKRasterPaint paint = { 0, gradient, 0.0, 0.0, 0.0 };
+    double dx = endX - startX, dy = endY - startY;
+    double length = dx * dx + dy * dy;
+    double determinant = m[0] * m[3] - m[1] * m[2];
+
+    if (length > 0.0 && determinant != 0.0) {
+        double inverse[6] = {
+            m[3] / determinant, -m[1] / determinant,
+            -m[2] / determinant, m[0] / determinant,
+            (m[2] * m[5] - m[3] * m[4]) / determinant, (m[1] * m[4] - m[0] * m[5]) / determinant
+        };
+
+        paint.tx = (inverse[0] * dx + inverse[1] * dy) / length;
+        paint.ty = (inverse[2] * dx + inverse[3] * dy) / length;
+        paint.t0 = ((inverse[4] - startX) * dx + (inverse[5] - startY) * dy) / length;
+    }
+
+    return TKRasterFillEdges(context, rule, &paint);
+}
+
+#pragma mark - Path helpers
+
+bool TKRasterPathFlatten(const TKPathBuffer *path, const double *transform, double tolerance, TKPathBuffer *polyline) {
+    static const double identity[6] = { 1.0, 0.0, 0.0, 1.0, 0.0, 0.0 };
+
+    // Only the contours of the scratch are used
+    TKRasterScratch scratch;
+    memset(&scratch, 0, sizeof(TKRasterScratch));
+
+    bool success = TKRasterFlattenPath(&scratch, path, transform ? transform : identity, tolerance > 0.0 ? tolerance : TKRasterTolerance);
+
+    for (size_t i = 0; success && i < scratch.contourCount; i++) {
+        const TKRasterContour *contour = &scratch.contours[i];
+        const double *points = scratch.points + 2 * contour->first;
+
+        for (size_t point = 0; success && point < contour->count; point++) {
+            success = TKPathBufferAppend(polyline, point == 0 ? TKPathOperationMoveTo : TKPathOperationLineTo, points + 2 * point);
+        }
+
+        if (success && contour->closed)
+            success = TKPathBufferAppend(polyline, TKPathOperationClose, NULL);
+    }
+
+    free(scratch.points);
+    free(scratch.contours);
+
+    return success;
+}
+
+bool TKRasterPathAddRect(TKPathBuffer *path, double x, double y, double width, double height) {
+    double points[8] = { x, y, x + width, y, x + width, y + height, x, y + height };
+
+    return TKPathBufferAppend(path, TKPathOperationMoveTo, points) && TKPathBufferAppend(path, TKPathOperationLineTo, points + 2) &&
+           TKPathBufferAppend(path, TKPathOperationLineTo, points + 4) && TKPathBufferAppend(path, TKPathOperationLineTo, points + 6) &&
+           TKPathBufferAppend(path, TKPathOperationClose, NULL);
+}
+
+// Quarter of an ellipse around the center, from the angle (in quarters, clockwise with y down) to the next one
+static bool TKRasterPathAddQuarter(TKPathBuffer *path, double cx, double cy, double rx, double ry, int quarter) {
+    static const double directions[5][2] = { { 1.0, 0.0 }, { 0.0, 1.0 }, { -1.0, 0.0 }, { 0.0, -1.0 }, { 1.0, 0.0 } };
+    const double *from = directions[quarter], *to = directions[quarter + 1];
+
+    double coordinates[6] = {
+        cx + (from[0] + to[0] * TKRasterKappa) * rx, cy + (from[1] + to[1] * TKRasterKappa) * ry,
+        cx + (to[0] + from[0] * TKRasterKappa) * rx, cy + (to[1] + from[1] * TKRasterKappa) * ry,
+        cx + to[0] * rx, cy + to[1] * ry
+    };
+
+    return TKPathBufferAppend(path, TKPathOperationCubicTo, coordinates);
+}
+
+bool TKRasterPathAddEllipse(TKPathBuffer *path, double x, double y, double width, double height) {
+    double rx = width / 2.0, ry = height / 2.0, cx = x + rx, cy = y + ry;
+    double start[2] = { cx + rx, cy };
+
+    if (!TKPathBufferAppend(path, TKPathOperationMoveTo, start))
+        return false;
+
+    for (int quarter = 0; quarter < 4; quarter++) {
+        if (!TKRasterPathAddQuarter(path, cx, cy, rx, ry, quarter))
+            return false;
+    }
+
+    return TKPathBufferAppend(path, TKPathOperationClose, NULL);
+}
+
+bool TKRasterPathAddRoundedRect(TKPathBuffer *path, double x, double y, double width, double height, const double *radii) {
+    double topRight = radii[0], bottomRight = radii[1], bottomLeft = radii[2], topLeft = radii[3];
+    double point[2];
+
+    // Clockwise from the top left corner, a corner with no radius is simply skipped
+    point[0] = x + topLeft, point[1] = y;
+    if (!TKPathBufferAppend(path, TKPathOperationMoveTo, point))
+        return false;
+
+    point[0] = x + width - topRight;
+    if (!TKPathBufferAppend(path, TKPathOperationLineTo, point))
+        return false;
+    if (topRight > 0.0 && !TKRasterPathAddQuarter(path, x + width - topRight, y + topRight, topRight, topRight, 3))
+        return false;
+
+    point[0] = x + width, point[1] = y + height - bottomRight;
+    if (!TKPathBufferAppend(path, TKPathOperationLineTo, point))
+        return false;
+    if (bottomRight > 0.0 && !TKRasterPathAddQuarter(path, x + width - bottomRight, y + height - bottomRight, bottomRight, bottomRight, 0))
+        return false;
+
+    point[0] = x + bottomLeft, point[1] = y + height;
+    if (!TKPathBufferAppend(path, TKPathOperationLineTo, point))
+        return false;
+    if (bottomLeft > 0.0 && !TKRasterPathAddQuarter(path, x + bottomLeft, y + height - bottomLeft, bottomLeft, bottomLeft, 1))
+        return false;
+
+    point[0] = x, point[1] = y + topLeft;
+    if (!TKPathBufferAppend(path, TKPathOperationLineTo, point))
+        return false;
+    if (topLeft > 0.0 && !TKRasterPathAddQuarter(path, x + topLeft, y + topLeft, topLeft, topLeft, 2))
+        return false;
+
+    return TKPathBufferAppend(path, TKPathOperationClose, NULL);
+}
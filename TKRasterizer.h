@@ -0,0 +1,188 @@
+//
+//  TKRasterizer.h
+//  ThemeEngine
+//
+//  Software rasterizer, plain C without dependencies outside of libc, so that themes can be drawn
+//  where there is no Core Graphics - pre-rendering atlases on a build server, or comparing renders
+//  against golden images. It mirrors the part of CGContext the display lists use: a stack of graphics
+//  states with an affine transform, alpha, blend modes (the ones of TKBlendModeForString), shadows
+//  and clipping, path fills with the nonzero and even-odd rules, strokes and linear gradients. Display
+//  lists replay into it with -[TKDisplayList drawInRasterContext:rect:scale:]
+//
+//  Paths are TKPathBuffers (see TKPathParser.h), either parsed from SVG path data or built with the
+//  helpers below. Shapes are sampled with 8 sub-scanlines per row and exact horizontal coverage
+//
+//  Pixels are 32-bit premultiplied ARGB in native byte order (BGRA in memory on little-endian), the
+//  same layout as a CGBitmapContext with kCGImageAlphaPremultipliedFirst | kCGBitmapByteOrder32Little,
+//  the y axis points down. Spans are blended with SSE2 on x86 and NEON on ARM, define TK_RASTER_NO_SIMD
+//  to use the scalar fallback everywhere
+//
+//  Copyright (c) 2012 __MyCompanyName__. All rights reserved.
+//
+
+#ifndef TKRasterizer_h
+#define TKRasterizer_h
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "TKPathParser.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#pragma mark - Types
+
+// Components from 0.0 to 1.0, not premultiplied
+typedef struct {
+    float red;
+    float green;
+    float blue;
+    float alpha;
+} TKRasterColor;
+
+typedef enum { TKRasterFillNonZero,
+               TKRasterFillEvenOdd } TKRasterFillRule;
+
+typedef enum { TKRasterBlendNormal,
+               TKRasterBlendMultiply,
+               TKRasterBlendOverlay,
+               TKRasterBlendSoftLight } TKRasterBlendMode;
+
+typedef enum { TKRasterLineCapButt,
+               TKRasterLineCapRound,
+               TKRasterLineCapSquare } TKRasterLineCap;
+
+typedef enum { TKRasterLineJoinMiter,
+               TKRasterLineJoinRound,
+               TKRasterLineJoinBevel } TKRasterLineJoin;
+
+#pragma mark - Surface
+
+typedef struct {
+    uint32_t *pixels;
+    int width;
+    int height;
+    size_t bytesPerRow;
+    bool ownsPixels;
+} TKRasterSurface;
+
+// Allocates the pixels, cleared to transparent
+bool TKRasterSurfaceInit(TKRasterSurface *surface, int width, int height);
+
+// Draws into pixels owned by someone else, i.e the data of a CGBitmapContext
+void TKRasterSurfaceInitWithPixels(TKRasterSurface *surface, uint32_t *pixels, int width, int height, size_t bytesPerRow);
+
+void TKRasterSurfaceFree(TKRasterSurface *surface);
+void TKRasterSurfaceClear(TKRasterSurface *surface, TKRasterColor color);
+
+#pragma mark - Gradient
+
+// Colors resolved into a lookup table once, the gradient can then be used by any number of fills
+typedef struct {
+    uint32_t table[256];
+} TKRasterGradient;
+
+// Same as CGGradientCreateWithColorComponents, locations can be NULL for evenly spaced colors
+void TKRasterGradientInit(TKRasterGradient *gradient, const TKRasterColor *colors, const float *locations, size_t count);
+
+#pragma mark - Context
+
+typedef struct TKRasterClip TKRasterClip;
+typedef struct TKRasterScratch TKRasterScratch;
+
+typedef struct {
+    double transform[6];            // a, b, c, d, tx, ty - same as CGAffineTransform
+    float alpha;
+    TKRasterBlendMode blendMode;
+
+    float lineWidth;
+    TKRasterLineCap lineCap;
+    TKRasterLineJoin lineJoin;
+    float miterLimit;
+
+    // Like in Core Graphics, the shadow is not affected by the transform, it is in pixels of the surface
+    bool hasShadow;
+    float shadowOffsetX;
+    float shadowOffsetY;
+    float shadowBlur;
+    TKRasterColor shadowColor;
+
+    // Clip in pixels of the surface, along with the coverage of the clipping paths (NULL for just the rect)
+    int clipLeft;
+    int clipTop;
+    int clipRight;
+    int clipBottom;
+    TKRasterClip *clipMask;
+} TKRasterState;
+
+#define TKRasterStateStackDepth 16
+
+typedef struct {
+    TKRasterSurface *surface;
+    TKRasterState state;
+
+    TKRasterState stack[TKRasterStateStackDepth];
+    int stackDepth;
+
+    TKRasterScratch *scratch;       // Buffers reused between the calls
+} TKRasterContext;
+
+// Defaults are the ones of a new CGContext - identity transform, black butt lines 1.0 wide, miter joins
+bool TKRasterContextInit(TKRasterContext *context, TKRasterSurface *surface);
+void TKRasterContextFree(TKRasterContext *context);
+
+// False once the stack is full (the state is then not saved)
+bool TKRasterContextSaveState(TKRasterContext *context);
+void TKRasterContextRestoreState(TKRasterContext *context);
+
+void TKRasterContextTranslate(TKRasterContext *context, double tx, double ty);
+void TKRasterContextScale(TKRasterContext *context, double sx, double sy);
+void TKRasterContextConcatTransform(TKRasterContext *context, const double *transform);
+
+void TKRasterContextSetAlpha(TKRasterContext *context, float alpha);
+void TKRasterContextSetBlendMode(TKRasterContext *context, TKRasterBlendMode mode);
+void TKRasterContextSetLineWidth(TKRasterContext *context, float width);
+void TKRasterContextSetLineCap(TKRasterContext *context, TKRasterLineCap cap);
+void TKRasterContextSetLineJoin(TKRasterContext *context, TKRasterLineJoin join);
+void TKRasterContextSetMiterLimit(TKRasterContext *context, float limit);
+
+// Offset and blur in pixels of the surface, a positive y offset moves the shadow down. A color with
+// an alpha of 0 turns the shadow off
+void TKRasterContextSetShadow(TKRasterContext *context, float offsetX, float offsetY, float blur, TKRasterColor color);
+
+// Both intersect with the current clip, unaligned rects (and paths) are clipped with antialiasing
+bool TKRasterContextClipToRect(TKRasterContext *context, double x, double y, double width, double height);
+bool TKRasterContextClipToPath(TKRasterContext *context, const TKPathBuffer *path, TKRasterFillRule rule);
+
+// Drawing, false if memory ran out
+bool TKRasterContextFillPath(TKRasterContext *context, const TKPathBuffer *path, TKRasterFillRule rule, TKRasterColor color);
+bool TKRasterContextStrokePath(TKRasterContext *context, const TKPathBuffer *path, TKRasterColor color);
+
+// The gradient runs from start to end (in the coordinates of the transform) and is extended past both of them
+bool TKRasterContextFillPathWithGradient(TKRasterContext *context, const TKPathBuffer *path, TKRasterFillRule rule, const TKRasterGradient *gradient,
+                                         double startX, double startY, double endX, double endY);
+
+#pragma mark - Path helpers
+
+// Appends the path with its curves flattened into lines (to within tolerance, 0 for the tolerance of the fills) and
+// transformed (NULL for none) to polyline. Fills and strokes of the result skip the flattening, a path drawn many times
+// at the same scale can be flattened once with the scale as the transform, and then drawn without it
+bool TKRasterPathFlatten(const TKPathBuffer *path, const double *transform, double tolerance, TKPathBuffer *polyline);
+
+bool TKRasterPathAddRect(TKPathBuffer *path, double x, double y, double width, double height);
+bool TKRasterPathAddEllipse(TKPathBuffer *path, double x, double y, double width, double height);
+
+// Radii are in the order of TKBalanceCornerRadiiIntoSize - top right, bottom right, bottom left, top left
+bool TKRasterPathAddRoundedRect(TKPathBuffer *path, double x, double y, double width, double height, const double *radii);
+
+// Kernels the blending was compiled with - "sse2", "neon" or "scalar"
+const char *TKRasterKernelName(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,134 @@
+//
+//  TKRenderer.h
+//  ThemeEngine
+//
+//  Renders descriptions into images off the main thread. Instead of building a view hierarchy and
+//  using -renderInContext: (which has to happen on the main thread), the display lists of the
+//  descriptions are replayed straight into a private CGBitmapContext on a bounded pool of workers
+//
+//  Only rectangles, ellipses, paths and containers of those can be rendered this way, descriptions
+//  with labels or buttons need UIKit and are left to the main thread (see +canRenderDescription:)
+//
+//  Requests for the same description and scale that are in flight at the same time are coalesced,
+//  the description is drawn once and every request is completed with the same image
+//
+//  Copyright (c) 2012 __MyCompanyName__. All rights reserved.
+//
+
+#import <UIKit/UIKit.h>
+#import <pthread.h>
+
+#import "TKDisplayList.h"
+
+@class TKRenderer, TKRenderOperation;
+
+typedef void (^TKRenderCompletion)(UIImage *image);
+
+#pragma mark - Render tree
+
+// Layout of a description, mirrors the views built by ThemeKit - the frame of a primitive is the frame
+// of its display list, containers grow to fit their children and the children are drawn on top
+@interface TKRenderNode : NSObject {
+    CGRect _frame;
+    TKDisplayList *_displayList;
+    CGColorRef _backgroundColor;        // Only for the outermost view of a theme
+    NSMutableArray *_children;
+}
+
+// Frame in the coordinates of the parent, as the view would have it
+@property (nonatomic) CGRect frame;
+@property (nonatomic, retain) TKDisplayList *displayList;
+@property (nonatomic) CGColorRef backgroundColor;
+@property (nonatomic, readonly) NSMutableArray *children;
+
+// Draws the node and its children at the origin of the context, in -drawRect: or a UIKit image context
+- (void)drawInContext: (CGContextRef)context;
+
+// Only draws the parts of the subtree that reach into dirtyRect (in the coordinates of the node)
+- (void)drawInContext: (CGContextRef)context dirtyRect: (CGRect)dirtyRect;
+
+// Same, for a bitmap context which was flipped and scaled by hand (see TKDisplayList.h)
+- (void)drawInBitmapContext: (CGContextRef)context scale: (CGFloat)scale;
+
+// Union of everything the subtree draws, in the coordinates of the node, CGRectNull if it draws nothing.
+// Unlike the frame, this includes children that reach outside of their parent
+- (CGRect)drawingBounds;
+
+// Number of views the subtree would otherwise be made of, and the size of their backing stores
+- (NSUInteger)nodeCount;
+- (size_t)backingStoreBytesForScale: (CGFloat)scale;
+
+@end
+
+#pragma mark - Data source
+
+@protocol TKRendererDataSource <NSObject>
+
+// Compiled rectangle, ellipse or path, called from the workers so it has to be thread-safe
+- (TKDisplayList *)displayListForDescription: (NSDictionary *)description frame: (CGRect)frame;
+
+@optional
+// Called on the worker once per rendered image, no matter how many requests were coalesced
+- (void)renderer: (TKRenderer *)renderer didRenderImage: (UIImage *)image forDescription: (NSDictionary *)description;
+
+@end
+
+#pragma mark - Request
+
+// Handle of an asynchronous render, the completion is called on the main thread unless cancelled
+@interface TKRenderRequest : NSObject {
+    TKRenderer *_renderer;
+    TKRenderOperation *_operation;      // Not retained, cleared once the operation finishes
+    TKRenderCompletion _completion;
+    volatile int32_t _cancelled;
+}
+
+@property (nonatomic, readonly, getter = isCancelled) BOOL cancelled;
+
+- (id)initWithCompletion: (TKRenderCompletion)completion;
+
+// Calls the completion on the main queue, unless the request has been cancelled by then
+- (void)completeWithImage: (UIImage *)image;
+
+// Safe to call from any thread, the drawing itself is only cancelled once no requests for it remain
+- (void)cancel;
+
+@end
+
+#pragma mark - Renderer
+
+@interface TKRenderer : NSObject {
+    id <TKRendererDataSource> _dataSource;      // Not retained
+    NSOperationQueue *_queue;
+
+    // Operations in flight, keyed by the structural hash of the description and the scale
+    NSMutableDictionary *_operations;
+    pthread_mutex_t _lock;
+}
+
+- (id)initWithDataSource: (id <TKRendererDataSource>)dataSource;
+
+// Size of the worker pool, defaults to the number of active processors
+@property (nonatomic) NSInteger maxConcurrentRenders;
+
+// Whether the description (and all of its subviews) can be drawn without UIKit, the outermost
+// dictionary of a theme (no type, optional background color) can be rendered as well
++ (BOOL)canRenderDescription: (NSDictionary *)description;
+
+// Lays out the description, which has to be one +canRenderDescription: accepts. Thread-safe
+- (TKRenderNode *)nodeForDescription: (NSDictionary *)description;
+
+// Synchronous, on the calling thread - which can be any thread
+- (UIImage *)imageForDescription: (NSDictionary *)description scale: (CGFloat)scale;
+
+// Asynchronous, on the worker pool
+- (TKRenderRequest *)renderDescription: (NSDictionary *)description scale: (CGFloat)scale completion: (TKRenderCompletion)completion;
+
+// Renders all of the descriptions in parallel on the worker pool and waits for them to finish, the images are
+// handed to the data source. Descriptions already being drawn for an asynchronous request are waited for instead
+// of drawn again. Should not be called from a worker
+- (void)renderDescriptionsAndWait: (NSArray *)descriptions scale: (CGFloat)scale;
+
+- (void)cancelAllRenders;
+
+@end
@@ -0,0 +1,543 @@
+//
+//  TKRenderer.m
+//  ThemeEngine
+//
+//  Copyright (c) 2012 __MyCompanyName__. All rights reserved.
+//
+
+#import "TKRenderer.h"
+#import "TKConstants.h"
+#import "TKHelpers.h"
+#import "TKHash.h"
+#import "TKResourcePool.h"
+#import "TKInstrumentation.h"
+
+#import <libkern/OSAtomic.h>
+
+#pragma mark - Render tree
+
+@interface TKRenderNode (Private)
+
+// A bitmapScale of 0 means a UIKit context, a null dirtyRect draws everything
+- (void)drawInContext: (CGContextRef)context dirtyRect: (CGRect)dirtyRect bitmapScale: (CGFloat)scale;
+
+@end
+
+@implementation TKRenderNode
+@synthesize frame = _frame;
+@synthesize displayList = _displayList;
+@synthesize children = _children;
+
+- (id)init {
+    if ((self = [super init])) {
+        _children = [[NSMutableArray alloc] init];
+    }
+
+    return self;
+}
+
+- (CGColorRef)backgroundColor {
+    return _backgroundColor;
+}
+
+- (void)setBackgroundColor: (CGColorRef)backgroundColor {
+    CGColorRetain(backgroundColor);
+    CGColorRelease(_backgroundColor);
+    _backgroundColor = backgroundColor;
+}
+
+- (void)drawInContext: (CGContextRef)context {
+    [self drawInContext: context dirtyRect: CGRectNull bitmapScale: 0.0];
+}
+
+- (void)drawInContext: (CGContextRef)context dirtyRect: (CGRect)dirtyRect {
+    [self drawInContext: context dirtyRect: dirtyRect bitmapScale: 0.0];
+}
+
+- (void)drawInBitmapContext: (CGContextRef)context scale: (CGFloat)scale {
+    [self drawInContext: context dirtyRect: CGRectNull bitmapScale: scale];
+}
+
+- (void)drawInContext: (CGContextRef)context dirtyRect: (CGRect)dirtyRect bitmapScale: (CGFloat)scale {
+    if (_backgroundColor) {
+        CGContextSetFillColorWithColor(context, _backgroundColor);
+        CGContextFillRect(context, CGRectMake(0.0, 0.0, _frame.size.width, _frame.size.height));
+    }
+
+    // Same rect the view would get in -drawRect:, its bounds after growing to fit the children
+    CGRect bounds = CGRectMake(0.0, 0.0, _frame.size.width, _frame.size.height);
+    if (scale > 0.0)
+        [_displayList drawInBitmapContext: context rect: bounds scale: scale];
+    else
+        [_displayList drawInContext: context rect: bounds dirtyRect: dirtyRect];
+
+    // Children are placed relative to us and are not clipped
+    for (TKRenderNode *child in _children) {
+        CGRect childDirtyRect = CGRectNull;
+        if (!CGRectIsNull(dirtyRect)) {
+            // Skip the subtrees that do not reach into the dirty rect at all
+            CGRect childBounds = [child drawingBounds];
+            if (CGRectIsNull(childBounds) || !CGRectIntersectsRect(CGRectOffset(childBounds, child.frame.origin.x, child.frame.origin.y), dirtyRect))
+                continue;
+
+            childDirtyRect = CGRectOffset(dirtyRect, -child.frame.origin.x, -child.frame.origin.y);
+        }
+
+        CGContextSaveGState(context);
+        CGContextTranslateCTM(context, child.frame.origin.x, child.frame.origin.y);
+        [child drawInContext: context dirtyRect: childDirtyRect bitmapScale: scale];
+        CGContextRestoreGState(context);
+    }
+}
+
+#pragma mark - Measuring
+
+- (CGRect)drawingBounds {
+    // Containers draw nothing themselves
+    CGRect bounds = CGRectNull;
+    if (_displayList || _backgroundColor)
+        bounds = CGRectMake(0.0, 0.0, _frame.size.width, _frame.size.height);
+
+    for (TKRenderNode *child in _children) {
+        CGRect childBounds = [child drawingBounds];
+        if (!CGRectIsNull(childBounds))
+            bounds = CGRectUnion(bounds, CGRectOffset(childBounds, child.frame.origin.x, child.frame.origin.y));
+    }
+
+    return bounds;
+}
+
+- (NSUInteger)nodeCount {
+    NSUInteger count = 1;
+    for (TKRenderNode *child in _children) {
+        count += [child nodeCount];
+    }
+
+    return count;
+}
+
+- (size_t)backingStoreBytesForScale: (CGFloat)scale {
+    // Plain containers have no backing store, everything else is a view drawing its whole frame
+    size_t bytes = 0;
+    if (_displayList || _backgroundColor)
+        bytes = (size_t)ceil(_frame.size.width * scale) * (size_t)ceil(_frame.size.height * scale) * 4;
+
+    for (TKRenderNode *child in _children) {
+        bytes += [child backingStoreBytesForScale: scale];
+    }
+
+    return bytes;
+}
+
+#pragma mark - Memory management
+
+- (void)dealloc {
+    [_displayList release];
+    CGColorRelease(_backgroundColor);
+    [_children release];
+
+    [super dealloc];
+}
+
+@end
+
+#pragma mark - Operation
+
+@interface TKRenderOperation : NSOperation {
+    TKRenderer *_renderer;
+    NSDictionary *_description;
+    CGFloat _scale;
+
+    // Only touched while holding the lock of the renderer
+    NSString *_key;
+    NSMutableArray *_requests;
+}
+
+@property (nonatomic, readonly) NSDictionary *viewDescription;
+@property (nonatomic, copy) NSString *key;
+@property (nonatomic, readonly) NSMutableArray *requests;
+
+- (id)initWithRenderer: (TKRenderer *)renderer description: (NSDictionary *)description scale: (CGFloat)scale;
+
+@end
+
+@interface TKRenderRequest (Private)
+
+- (BOOL)markCancelled;
+- (TKRenderOperation *)operation;
+- (void)setOperation: (TKRenderOperation *)operation;
+- (void)setRenderer: (TKRenderer *)renderer;
+
+@end
+
+@interface TKRenderer (Private)
+
+- (TKRenderOperation *)addRequest: (TKRenderRequest *)request forDescription: (NSDictionary *)description scale: (CGFloat)scale scheduled: (BOOL *)schedule;
+- (void)operation: (TKRenderOperation *)operation didRenderImage: (UIImage *)image;
+- (void)requestWasCancelled: (TKRenderRequest *)request;
+
+@end
+
+@implementation TKRenderOperation
+@synthesize viewDescription = _description;
+@synthesize key = _key;
+@synthesize requests = _requests;
+
+- (id)initWithRenderer: (TKRenderer *)renderer description: (NSDictionary *)description scale: (CGFloat)scale {
+    if ((self = [super init])) {
+        _renderer = [renderer retain];
+        _description = [description retain];
+        _scale = scale;
+        _requests = [[NSMutableArray alloc] init];
+    }
+
+    return self;
+}
+
+- (void)main {
+    if ([self isCancelled])
+        return;
+
+    NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+
+    UIImage *image = [_renderer imageForDescription: _description scale: _scale];
+    [_renderer operation: self didRenderImage: image];
+
+    [pool drain];
+}
+
+- (void)dealloc {
+    [_renderer release];
+    [_description release];
+    [_key release];
+    [_requests release];
+
+    [super dealloc];
+}
+
+@end
+
+#pragma mark - Request
+
+@implementation TKRenderRequest
+
+- (id)initWithCompletion: (TKRenderCompletion)completion {
+    if ((self = [super init])) {
+        _completion = [completion copy];
+    }
+
+    return self;
+}
+
+- (BOOL)isCancelled {
+    return _cancelled != 0;
+}
+
+- (BOOL)markCancelled {
+    return OSAtomicCompareAndSwap32Barrier(0, 1, &_cancelled);
+}
+
+- (TKRenderOperation *)operation {
+    return _operation;
+}
+
+- (void)setOperation: (TKRenderOperation *)operation {
+    _operation = operation;
+}
+
+- (void)setRenderer: (TKRenderer *)renderer {
+    if (renderer != _renderer) {
+        [_renderer release];
+        _renderer = [renderer retain];
+    }
+}
+
+- (void)completeWithImage: (UIImage *)image {
+    // Requests of -renderDescriptionsAndWait:scale: only wait
+    if (!_completion)
+        return;
+
+    dispatch_async(dispatch_get_main_queue(), ^{
+        // Check again, the request may have been cancelled while waiting for the main queue
+        if (![self isCancelled] && _completion)
+            _completion(image);
+    });
+}
+
+- (void)cancel {
+    if (![self markCancelled])
+        return;
+
+    [_renderer requestWasCancelled: self];
+}
+
+- (void)dealloc {
+    [_renderer release];
+    [_completion release];
+
+    [super dealloc];
+}
+
+@end
+
+#pragma mark - Renderer
+
+@implementation TKRenderer
+
+- (id)initWithDataSource: (id <TKRendererDataSource>)dataSource {
+    if ((self = [super init])) {
+        _dataSource = dataSource;
+        _operations = [[NSMutableDictionary alloc] init];
+        pthread_mutex_init(&_lock, NULL);
+
+        _queue = [[NSOperationQueue alloc] init];
+        [_queue setName: @"ThemeKit.Render"];
+        [_queue setMaxConcurrentOperationCount: [[NSProcessInfo processInfo] activeProcessorCount]];
+    }
+
+    return self;
+}
+
+- (NSInteger)maxConcurrentRenders {
+    return [_queue maxConcurrentOperationCount];
+}
+
+- (void)setMaxConcurrentRenders: (NSInteger)count {
+    [_queue setMaxConcurrentOperationCount: MAX(count, 1)];
+}
+
+#pragma mark - Drawing
+
+// The outermost view of a theme has no type, it is a container with an optional background color
+static BOOL TKRendererCanRenderDescription(NSDictionary *description, BOOL outermost) {
+    if (![description isKindOfClass: [NSDictionary class]])
+        return NO;
+
+    NSString *type = [description objectForKey: TypeParameterKey];
+    if (!(outermost && !type) && ![type isEqualToString: RectangleTypeKey] && ![type isEqualToString: EllipseTypeKey] && ![type isEqualToString: PathTypeKey])
+        return NO;
+
+    for (NSDictionary *subview in [description objectForKey: SubviewSectionKey]) {
+        if (!TKRendererCanRenderDescription(subview, NO))
+            return NO;
+    }
+
+    return YES;
+}
+
++ (BOOL)canRenderDescription: (NSDictionary *)description {
+    return TKRendererCanRenderDescription(description, YES);
+}
+
+- (TKRenderNode *)nodeForDescription: (NSDictionary *)description {
+    TKRenderNode *node = [[[TKRenderNode alloc] init] autorelease];
+    CGRect frame = TKFrameForDescription(description);
+
+    // Containers are plain (transparent) views, everything else is drawn from a display list
+    NSString *type = [description objectForKey: TypeParameterKey];
+    if (!type) {
+        if ([description objectForKey: ColorParameterKey])
+            node.backgroundColor = [[TKResourcePool sharedPool] colorForWebColor: [description objectForKey: ColorParameterKey]];
+    } else if (!([type isEqualToString: RectangleTypeKey] && [[description objectForKey: ContainerParameterKey] boolValue])) {
+        // Lists are compiled at the origin (see -displayListForDescription:frame:)
+        node.displayList = [_dataSource displayListForDescription: description frame: frame];
+        frame = [node.displayList frameForDescription: description];
+    }
+
+    // Grow to fit the children, only the size changes (same as with the views)
+    for (NSDictionary *subview in [description objectForKey: SubviewSectionKey]) {
+        TKRenderNode *child = [self nodeForDescription: subview];
+        [node.children addObject: child];
+
+        frame.size.width = MAX(frame.size.width, CGRectGetWidth(child.frame));
+        frame.size.height = MAX(frame.size.height, CGRectGetHeight(child.frame));
+    }
+
+    node.frame = frame;
+    return node;
+}
+
+- (UIImage *)imageForDescription: (NSDictionary *)description scale: (CGFloat)scale {
+    TKRenderNode *root = [self nodeForDescription: description];
+
+    size_t width = (size_t)ceil(CGRectGetWidth(root.frame) * scale);
+    size_t height = (size_t)ceil(CGRectGetHeight(root.frame) * scale);
+    if (width == 0 || height == 0)
+        return nil;
+
+    TKInstrumentBegin(timer);
+
+    // Premultiplied BGRA, the native format of the device
+    CGContextRef context = CGBitmapContextCreate(NULL, width, height, 8, width * 4, [[TKResourcePool sharedPool] colorSpace],
+                                                 kCGImageAlphaPremultipliedFirst | kCGBitmapByteOrder32Little);
+    if (!context) {
+        NSLog(@"Failed to create a %zux%zu bitmap context for rendering", width, height);
+        return nil;
+    }
+
+    // Match UIKit, origin in the top left corner and units in points
+    CGContextTranslateCTM(context, 0.0, height);
+    CGContextScaleCTM(context, scale, -scale);
+
+    // The root is drawn at its own origin, as -renderInContext: does
+    [root drawInBitmapContext: context scale: scale];
+
+    CGImageRef imageRef = CGBitmapContextCreateImage(context);
+    CGContextRelease(context);
+
+    UIImage *image = [UIImage imageWithCGImage: imageRef scale: scale orientation: UIImageOrientationUp];
+    CGImageRelease(imageRef);
+
+    TKInstrumentEnd(TKInstrumentationPhaseRasterize, timer);
+    return image;
+}
+
+#pragma mark - Scheduling
+
+// Joins the operation already drawing the same description, if there is one, and starts a new one otherwise.
+// In that case schedule is set, and the operation has to be added to the queue
+- (TKRenderOperation *)addRequest: (TKRenderRequest *)request forDescription: (NSDictionary *)description scale: (CGFloat)scale scheduled: (BOOL *)schedule {
+    TKStructuralHash hash = TKStructuralHashForObject(description);
+    NSString *key = [NSString stringWithFormat: @"%016llx%016llx@%g", hash.value, hash.check, (double)scale];
+    [request setRenderer: self];
+
+    pthread_mutex_lock(&_lock);
+
+    TKRenderOperation *operation = [_operations objectForKey: key];
+    *schedule = operation == nil;
+
+    if (!operation) {
+        operation = [[[TKRenderOperation alloc] initWithRenderer: self description: description scale: scale] autorelease];
+        [operation setKey: key];
+        [_operations setObject: operation forKey: key];
+    }
+
+    [[operation requests] addObject: request];
+    [request setOperation: operation];
+
+    pthread_mutex_unlock(&_lock);
+
+    return operation;
+}
+
+- (TKRenderRequest *)renderDescription: (NSDictionary *)description scale: (CGFloat)scale completion: (TKRenderCompletion)completion {
+    TKRenderRequest *request = [[[TKRenderRequest alloc] initWithCompletion: completion] autorelease];
+
+    BOOL schedule = NO;
+    TKRenderOperation *operation = [self addRequest: request forDescription: description scale: scale scheduled: &schedule];
+
+    if (schedule)
+        [_queue addOperation: operation];
+
+    return request;
+}
+
+- (void)renderDescriptionsAndWait: (NSArray *)descriptions scale: (CGFloat)scale {
+    NSMutableArray *operations = [NSMutableArray arrayWithCapacity: [descriptions count]];
+    NSMutableArray *scheduled = [NSMutableArray arrayWithCapacity: [descriptions count]];
+
+    // Coalesced with the asynchronous requests, both ways. The requests without a completion are never cancelled,
+    // so the operations they joined are drawn even if everyone else gives up on them
+    for (NSDictionary *description in descriptions) {
+        TKRenderRequest *request = [[[TKRenderRequest alloc] initWithCompletion: nil] autorelease];
+
+        BOOL schedule = NO;
+        TKRenderOperation *operation = [self addRequest: request forDescription: description scale: scale scheduled: &schedule];
+
+        [operations addObject: operation];
+        if (schedule)
+            [scheduled addObject: operation];
+    }
+
+    [_queue addOperations: scheduled waitUntilFinished: NO];
+
+    for (TKRenderOperation *operation in operations) {
+        [operation waitUntilFinished];
+    }
+}
+
+- (void)operation: (TKRenderOperation *)operation didRenderImage: (UIImage *)image {
+    if (image && [_dataSource respondsToSelector: @selector(renderer:didRenderImage:forDescription:)])
+        [_dataSource renderer: self didRenderImage: image forDescription: [operation viewDescription]];
+
+    // Take the waiting requests, from here on new requests start a new operation
+    pthread_mutex_lock(&_lock);
+
+    if ([operation key] && [_operations objectForKey: [operation key]] == operation)
+        [_operations removeObjectForKey: [operation key]];
+
+    NSArray *requests = [NSArray arrayWithArray: [operation requests]];
+    [[operation requests] removeAllObjects];
+
+    for (TKRenderRequest *request in requests) {
+        [request setOperation: nil];
+    }
+
+    pthread_mutex_unlock(&_lock);
+
+    for (TKRenderRequest *request in requests) {
+        [request completeWithImage: image];
+    }
+}
+
+- (void)requestWasCancelled: (TKRenderRequest *)request {
+    pthread_mutex_lock(&_lock);
+
+    TKRenderOperation *operation = [request operation];
+    BOOL abandoned = operation != nil;
+
+    for (TKRenderRequest *other in [operation requests]) {
+        if (![other isCancelled]) {
+            abandoned = NO;
+            break;
+        }
+    }
+
+    // Nobody is waiting for the image anymore, stop the drawing if it has not started yet
+    if (abandoned) {
+        [operation cancel];
+
+        if ([_operations objectForKey: [operation key]] == operation)
+            [_operations removeObjectForKey: [operation key]];
+
+        for (TKRenderRequest *other in [operation requests]) {
+            [other setOperation: nil];
+        }
+
+        [[operation requests] removeAllObjects];
+    }
+
+    pthread_mutex_unlock(&_lock);
+}
+
+- (void)cancelAllRenders {
+    pthread_mutex_lock(&_lock);
+
+    for (TKRenderOperation *operation in [_operations allValues]) {
+        for (TKRenderRequest *request in [operation requests]) {
+            [request markCancelled];
+            [request setOperation: nil];
+        }
+
+        [[operation requests] removeAllObjects];
+    }
+
+    [_operations removeAllObjects];
+
+    pthread_mutex_unlock(&_lock);
+
+    [_queue cancelAllOperations];
+}
+
+#pragma mark - Memory management
+
+- (void)dealloc {
+    // Operations retain the renderer, so by now none are left
+    [_queue release];
+    [_operations release];
+    pthread_mutex_destroy(&_lock);
+
+    [super dealloc];
+}
+
+@end
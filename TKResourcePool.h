@@ -0,0 +1,80 @@
+//
+//  TKResourcePool.h
+//  ThemeEngine
+//
+//  Shared pool of the Core Graphics objects used while drawing - colors, gradients, the RGB
+//  color space, the outlines of rounded rectangles and ellipses and the blurred masks of shadows.
+//  Everything is interned by value, so equal colors and shapes share one object instead of being
+//  created on every draw
+//
+//  The pool keeps an estimate of the memory held by its objects and evicts the least recently
+//  used ones once that goes over byteLimit. It can be used from any thread
+//
+//  Copyright (c) 2012 __MyCompanyName__. All rights reserved.
+//
+
+#import <UIKit/UIKit.h>
+#import <QuartzCore/QuartzCore.h>
+#import <pthread.h>
+
+#import "TKShadow.h"
+
+// Key the objects are interned by
+typedef struct {
+    uint32_t kind;
+    uint32_t count;             // Number of values in use
+    uint64_t values[12];
+} TKResourceKey;
+
+typedef struct TKResourceEntry TKResourceEntry;
+
+@interface TKResourcePool : NSObject {
+    pthread_mutex_t _lock;
+
+    // Keys point into the entries, which also form the LRU list (head is the most recent)
+    CFMutableDictionaryRef _entries;
+    TKResourceEntry *_head;
+    TKResourceEntry *_tail;
+
+    size_t _bytes;
+    size_t _byteLimit;
+
+    uint64_t _hits;
+    uint64_t _misses;
+    uint64_t _evictions;
+
+    CGColorSpaceRef _colorSpace;
+}
+
+// Pool shared by the whole engine
++ (TKResourcePool *)sharedPool;
+
+// Estimated size of the pooled objects and the limit for it, defaults to 4MB
+@property (nonatomic, readonly) size_t bytes;
+@property (nonatomic) size_t byteLimit;
+
+// Device RGB, lives as long as the pool
+@property (nonatomic, readonly) CGColorSpaceRef colorSpace;
+
+// All of the returned objects are autoreleased, retain them to keep them past the current pool
+// Colors, in the same format as +[UIColor colorForWebColor:]
+- (CGColorRef)colorForWebColor: (NSString *)colorCode;
+- (CGColorRef)colorForWebColor: (NSString *)colorCode alpha: (CGFloat)alpha;     // Replaces the alpha of the color
+- (CGColorRef)colorWithRed: (CGFloat)red green: (CGFloat)green blue: (CGFloat)blue alpha: (CGFloat)alpha;
+
+// Linear gradient for the web colors and their locations, as in the gradient option of the descriptions
+- (CGGradientRef)gradientWithColors: (NSArray *)colors locations: (NSArray *)locations;
+
+// Outlines, see TKRoundedPathInRectForRadii for the order of the radii
+- (CGPathRef)roundedPathInRect: (CGRect)rect radii: (const CGFloat *)radii;
+- (CGPathRef)ellipsePathInRect: (CGRect)rect;
+
+// Blurred mask for a shadow of the shape, rendered with TKShadowMaskCreate when it is not in the pool yet
+- (CGImageRef)shadowMaskForShape: (const TKShadowShape *)shape layout: (const TKShadowLayout *)layout;
+
+- (void)removeAllResources;
+
+// Hits, misses, evictions and the estimated bytes as NSNumbers
+- (NSDictionary *)statistics;
+
+@end
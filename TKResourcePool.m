@@ -0,0 +1,416 @@
+//
+//  TKResourcePool.m
+//  ThemeEngine
+//
+//  Copyright (c) 2012 __MyCompanyName__. All rights reserved.
+//
+
+#import "TKResourcePool.h"
+#import "TKHelpers.h"
+#import "TKHash.h"
+
+// Shadow masks are the largest objects in the pool, a few of them fit along with everything else
+#define kResourcePoolDefaultByteLimit (4 * 1024 * 1024)
+
+enum {
+    TKResourceColor = 1,
+    TKResourceGradient,
+    TKResourceRoundedPath,
+    TKResourceEllipsePath,
+    TKResourceShadowMask
+};
+
+struct TKResourceEntry {
+    TKResourceKey key;
+    CFTypeRef object;
+    size_t cost;
+
+    TKResourceEntry *previous;
+    TKResourceEntry *next;
+};
+
+#pragma mark - Keys
+
+static inline void TKResourceKeyInit(TKResourceKey *key, uint32_t kind) {
+    memset(key, 0, sizeof(TKResourceKey));
+    key->kind = kind;
+}
+
+static inline void TKResourceKeyAddFloat(TKResourceKey *key, CGFloat value) {
+    double number = value;
+    memcpy(&key->values[key->count++], &number, sizeof(double));
+}
+
+static inline void TKResourceKeyAddBits(TKResourceKey *key, uint64_t value) {
+    key->values[key->count++] = value;
+}
+
+static CFHashCode TKResourceKeyHash(const void *value) {
+    const TKResourceKey *key = (const TKResourceKey *)value;
+
+    uint64_t hash = 0xcbf29ce484222325ULL ^ key->kind;
+    for (uint32_t i = 0; i < key->count; i++) {
+        hash = (hash ^ key->values[i]) * 0x100000001b3ULL;
+        hash ^= hash >> 29;
+    }
+
+    return (CFHashCode)hash;
+}
+
+static Boolean TKResourceKeyEqual(const void *first, const void *second) {
+    const TKResourceKey *a = (const TKResourceKey *)first;
+    const TKResourceKey *b = (const TKResourceKey *)second;
+
+    return a->kind == b->kind && a->count == b->count && memcmp(a->values, b->values, a->count * sizeof(uint64_t)) == 0;
+}
+
+#pragma mark - Costs
+
+// Rough sizes of the Core Graphics objects, they are not exposed so these are estimates
+static void TKPathCountElement(void *info, const CGPathElement *element) {
+    (*(size_t *)info)++;
+}
+
+static size_t TKPathCost(CGPathRef path) {
+    size_t elements = 0;
+    CGPathApply(path, &elements, TKPathCountElement);
+
+    return 64 + elements * (sizeof(CGPathElement) + 3 * sizeof(CGPoint));
+}
+
+#define kColorCost 64
+#define kGradientBaseCost 1024
+
+#pragma mark - Pool
+
+@interface TKResourcePool (Private)
+
+- (CFTypeRef)objectForKey: (const TKResourceKey *)key create: (CFTypeRef (^)(size_t *cost))create;
+- (void)removeEntry: (TKResourceEntry *)entry;
+
+@end
+
+@implementation TKResourcePool
+@synthesize colorSpace = _colorSpace;
+
++ (TKResourcePool *)sharedPool {
+    static TKResourcePool *shared = nil;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        shared = [[TKResourcePool alloc] init];
+    });
+
+    return shared;
+}
+
+- (id)init {
+    if ((self = [super init])) {
+        pthread_mutex_init(&_lock, NULL);
+
+        // Keys and values are owned by the entries, the dictionary only points to them
+        CFDictionaryKeyCallBacks keyCallBacks = { 0, NULL, NULL, NULL, TKResourceKeyEqual, TKResourceKeyHash };
+        _entries = CFDictionaryCreateMutable(NULL, 0, &keyCallBacks, NULL);
+
+        _byteLimit = kResourcePoolDefaultByteLimit;
+        _colorSpace = CGColorSpaceCreateDeviceRGB();
+    }
+
+    return self;
+}
+
+- (size_t)bytes {
+    pthread_mutex_lock(&_lock);
+    size_t bytes = _bytes;
+    pthread_mutex_unlock(&_lock);
+
+    return bytes;
+}
+
+- (size_t)byteLimit {
+    pthread_mutex_lock(&_lock);
+    size_t limit = _byteLimit;
+    pthread_mutex_unlock(&_lock);
+
+    return limit;
+}
+
+- (void)setByteLimit: (size_t)byteLimit {
+    pthread_mutex_lock(&_lock);
+
+    _byteLimit = byteLimit;
+    while (_tail && _bytes > _byteLimit) {
+        [self removeEntry: _tail];
+        _evictions++;
+    }
+
+    pthread_mutex_unlock(&_lock);
+}
+
+#pragma mark - Interning
+
+- (CFTypeRef)objectForKey: (const TKResourceKey *)key create: (CFTypeRef (^)(size_t *cost))create {
+    pthread_mutex_lock(&_lock);
+
+    TKResourceEntry *entry = (TKResourceEntry *)CFDictionaryGetValue(_entries, key);
+    if (entry) {
+        _hits++;
+    } else {
+        _misses++;
+
+        // Create the object without holding the lock, creating it may need the pool again (gradients)
+        pthread_mutex_unlock(&_lock);
+        size_t cost = 0;
+        CFTypeRef object = create(&cost);
+        pthread_mutex_lock(&_lock);
+
+        if (!object) {
+            pthread_mutex_unlock(&_lock);
+            return NULL;
+        }
+
+        // Another thread may have been faster
+        entry = (TKResourceEntry *)CFDictionaryGetValue(_entries, key);
+        if (entry) {
+            CFRelease(object);
+        } else {
+            entry = (TKResourceEntry *)calloc(1, sizeof(TKResourceEntry));
+            entry->key = *key;
+            entry->object = object;
+            entry->cost = cost;
+
+            CFDictionarySetValue(_entries, &entry->key, entry);
+            _bytes += cost;
+
+            // Insert at the head, then evict from the tail until under the limit
+            entry->next = _head;
+            if (_head)
+                _head->previous = entry;
+            _head = entry;
+            if (!_tail)
+                _tail = entry;
+
+            while (_tail != entry && _bytes > _byteLimit) {
+                [self removeEntry: _tail];
+                _evictions++;
+            }
+        }
+    }
+
+    // Move to the front of the LRU list
+    if (entry != _head) {
+        entry->previous->next = entry->next;
+        if (entry->next)
+            entry->next->previous = entry->previous;
+        else
+            _tail = entry->previous;
+
+        entry->previous = NULL;
+        entry->next = _head;
+        _head->previous = entry;
+        _head = entry;
+    }
+
+    // Retained under the lock, so that an eviction can't pull it away before the caller gets it
+    CFTypeRef object = CFRetain(entry->object);
+    pthread_mutex_unlock(&_lock);
+
+    return (CFTypeRef)[(id)object autorelease];
+}
+
+- (void)removeEntry: (TKResourceEntry *)entry {
+    if (entry->previous)
+        entry->previous->next = entry->next;
+    else
+        _head = entry->next;
+
+    if (entry->next)
+        entry->next->previous = entry->previous;
+    else
+        _tail = entry->previous;
+
+    CFDictionaryRemoveValue(_entries, &entry->key);
+    _bytes -= entry->cost;
+
+    CFRelease(entry->object);
+    free(entry);
+}
+
+- (void)removeAllResources {
+    pthread_mutex_lock(&_lock);
+
+    while (_head) {
+        [self removeEntry: _head];
+    }
+
+    pthread_mutex_unlock(&_lock);
+}
+
+#pragma mark - Colors
+
+- (CGColorRef)colorWithRed: (CGFloat)red green: (CGFloat)green blue: (CGFloat)blue alpha: (CGFloat)alpha {
+    TKResourceKey key;
+    TKResourceKeyInit(&key, TKResourceColor);
+    TKResourceKeyAddFloat(&key, red);
+    TKResourceKeyAddFloat(&key, green);
+    TKResourceKeyAddFloat(&key, blue);
+    TKResourceKeyAddFloat(&key, alpha);
+
+    CGColorSpaceRef colorSpace = _colorSpace;
+    return (CGColorRef)[self objectForKey: &key create: ^CFTypeRef(size_t *cost) {
+        CGFloat components[4] = { red, green, blue, alpha };
+        *cost = kColorCost;
+
+        return CGColorCreate(colorSpace, components);
+    }];
+}
+
+- (CGColorRef)colorForWebColor: (NSString *)colorCode {
+    CGFloat components[4];
+    TKWebColorGetComponents(colorCode, components);
+
+    return [self colorWithRed: components[0] green: components[1] blue: components[2] alpha: components[3]];
+}
+
+- (CGColorRef)colorForWebColor: (NSString *)colorCode alpha: (CGFloat)alpha {
+    CGFloat components[4];
+    TKWebColorGetComponents(colorCode, components);
+
+    return [self colorWithRed: components[0] green: components[1] blue: components[2] alpha: alpha];
+}
+
+#pragma mark - Gradients
+
+- (CGGradientRef)gradientWithColors: (NSArray *)colors locations: (NSArray *)locations {
+    // The arrays come from the descriptions, their structural hashes are already known
+    TKStructuralHash colorsHash = TKStructuralHashForObject(colors);
+    TKStructuralHash locationsHash = TKStructuralHashForObject(locations);
+
+    TKResourceKey key;
+    TKResourceKeyInit(&key, TKResourceGradient);
+    TKResourceKeyAddBits(&key, colorsHash.value);
+    TKResourceKeyAddBits(&key, colorsHash.check);
+    TKResourceKeyAddBits(&key, locationsHash.value);
+    TKResourceKeyAddBits(&key, locationsHash.check);
+
+    return (CGGradientRef)[self objectForKey: &key create: ^CFTypeRef(size_t *cost) {
+        // Colors and locations, in the order they were given
+        NSMutableArray *CGColors = [NSMutableArray arrayWithCapacity: [colors count]];
+        for (NSString *color in colors) {
+            [CGColors addObject: (id)[self colorForWebColor: color]];
+        }
+
+        NSUInteger count = MAX([colors count], [locations count]);
+        CGFloat *positions = (CGFloat *)calloc(sizeof(CGFloat), MAX(count, 1));
+        for (NSUInteger i = 0; i < [locations count]; i++) {
+            positions[i] = [[locations objectAtIndex: i] floatValue];
+        }
+
+        CGGradientRef gradient = CGGradientCreateWithColors(_colorSpace, (CFArrayRef)CGColors, positions);
+        free(positions);
+
+        *cost = kGradientBaseCost + count * (kColorCost + sizeof(CGFloat));
+        return gradient;
+    }];
+}
+
+#pragma mark - Paths
+
+- (CGPathRef)roundedPathInRect: (CGRect)rect radii: (const CGFloat *)radii {
+    TKResourceKey key;
+    TKResourceKeyInit(&key, TKResourceRoundedPath);
+    TKResourceKeyAddFloat(&key, rect.origin.x);
+    TKResourceKeyAddFloat(&key, rect.origin.y);
+    TKResourceKeyAddFloat(&key, rect.size.width);
+    TKResourceKeyAddFloat(&key, rect.size.height);
+    for (NSUInteger i = 0; i < 4; i++) {
+        TKResourceKeyAddFloat(&key, radii[i]);
+    }
+
+    return (CGPathRef)[self objectForKey: &key create: ^CFTypeRef(size_t *cost) {
+        CGFloat pathRadii[4] = { radii[0], radii[1], radii[2], radii[3] };
+        CGPathRef path = CGPathCreateCopy(TKRoundedPathInRectForRadii(pathRadii, rect));
+
+        *cost = TKPathCost(path);
+        return path;
+    }];
+}
+
+- (CGPathRef)ellipsePathInRect: (CGRect)rect {
+    TKResourceKey key;
+    TKResourceKeyInit(&key, TKResourceEllipsePath);
+    TKResourceKeyAddFloat(&key, rect.origin.x);
+    TKResourceKeyAddFloat(&key, rect.origin.y);
+    TKResourceKeyAddFloat(&key, rect.size.width);
+    TKResourceKeyAddFloat(&key, rect.size.height);
+
+    return (CGPathRef)[self objectForKey: &key create: ^CFTypeRef(size_t *cost) {
+        CGMutablePathRef temp = CGPathCreateMutable();
+        CGPathAddEllipseInRect(temp, NULL, rect);
+        CGPathRef path = CGPathCreateCopy(temp);
+        CGPathRelease(temp);
+
+        *cost = TKPathCost(path);
+        return path;
+    }];
+}
+
+#pragma mark - Shadows
+
+- (CGImageRef)shadowMaskForShape: (const TKShadowShape *)shape layout: (const TKShadowLayout *)layout {
+    TKResourceKey key;
+    TKResourceKeyInit(&key, TKResourceShadowMask);
+    TKResourceKeyAddBits(&key, ((uint64_t)layout->padding << 16) | ((uint64_t)layout->inner << 8) | shape->type);
+    TKResourceKeyAddFloat(&key, layout->blur);
+    TKResourceKeyAddFloat(&key, layout->scale);
+    TKResourceKeyAddFloat(&key, layout->size.width);
+    TKResourceKeyAddFloat(&key, layout->size.height);
+
+    switch (shape->type) {
+        case TKShadowShapeRectangle:
+            for (NSUInteger i = 0; i < 4; i++) {
+                TKResourceKeyAddFloat(&key, shape->radii[i]);
+            }
+            break;
+        case TKShadowShapePath:
+            TKResourceKeyAddBits(&key, shape->pathHash[0]);
+            TKResourceKeyAddBits(&key, shape->pathHash[1]);
+            break;
+        default:
+            break;
+    }
+
+    // Copies for the block, the shape and layout belong to the caller
+    TKShadowShape maskShape = *shape;
+    TKShadowLayout maskLayout = *layout;
+
+    return (CGImageRef)[self objectForKey: &key create: ^CFTypeRef(size_t *cost) {
+        *cost = 64 + maskLayout.height * ((maskLayout.width + 15) & ~(size_t)15);
+        return TKShadowMaskCreate(&maskShape, &maskLayout);
+    }];
+}
+
+#pragma mark - Statistics
+
+- (NSDictionary *)statistics {
+    pthread_mutex_lock(&_lock);
+    NSDictionary *statistics = [NSDictionary dictionaryWithObjectsAndKeys:
+                                [NSNumber numberWithUnsignedLongLong: _hits], @"hits",
+                                [NSNumber numberWithUnsignedLongLong: _misses], @"misses",
+                                [NSNumber numberWithUnsignedLongLong: _evictions], @"evictions",
+                                [NSNumber numberWithUnsignedLong: _bytes], @"bytes", nil];
+    pthread_mutex_unlock(&_lock);
+
+    return statistics;
+}
+
+- (void)dealloc {
+    [self removeAllResources];
+
+    CFRelease(_entries);
+    CGColorSpaceRelease(_colorSpace);
+    pthread_mutex_destroy(&_lock);
+
+    [super dealloc];
+}
+
+@end
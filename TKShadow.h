@@ -0,0 +1,63 @@
+//
+//  TKShadow.h
+//  ThemeEngine
+//
+//  Drop and inner shadows drawn from blurred masks instead of a shadow set on the context. The
+//  coverage of the shape is rendered into an alpha-only bitmap, blurred once (separable passes, a
+//  gaussian for small blurs and three box blurs approximating it for the rest) and the result is
+//  kept in the resource pool, so redrawing a shadow is only drawing an image
+//
+//  Masks are keyed by the outline of the shape, the blur and the scale of the context. Offsets and
+//  colors are applied while drawing, so every shadow of a shape shares one mask. Rectangles (rounded
+//  or not) are rendered as a 9-slice at the smallest size that still has all of the corners, and
+//  stretched to the size of the shape, so a shadow of any size costs the same
+//
+//  Like CGContextSetShadow, the blur is twice the standard deviation of the gaussian. The masks stay
+//  within 2% (5 of 255 levels of alpha) of an exact gaussian blur of the shape
+//
+//  Copyright (c) 2012 __MyCompanyName__. All rights reserved.
+//
+
+#import <UIKit/UIKit.h>
+#import <QuartzCore/QuartzCore.h>
+
+typedef enum { TKShadowShapeRectangle,
+               TKShadowShapeEllipse,
+               TKShadowShapePath } TKShadowShapeType;
+
+// Outline the shadow is cast by
+typedef struct {
+    TKShadowShapeType type;
+    CGRect rect;                // Where the shape is drawn, the bounding box of paths
+    CGFloat radii[4];           // Rectangles only, balanced into the size (all 0 for square corners)
+    CGPathRef path;             // Paths only, not retained
+    uint64_t pathHash[2];       // Outline of the path relative to its bounding box
+} TKShadowShape;
+
+void TKShadowShapeInitWithRect(TKShadowShape *shape, CGRect rect, const CGFloat *radii);     // radii can be NULL
+void TKShadowShapeInitWithEllipse(TKShadowShape *shape, CGRect rect);
+void TKShadowShapeInitWithPath(TKShadowShape *shape, CGPathRef path);
+
+// Mask for a shadow of a shape, everything but the shape itself is part of the key of the mask
+typedef struct {
+    BOOL inner;                 // Inner shadows use the inverse of the blurred shape
+    CGFloat scale;              // Pixels per point of the context
+    CGFloat blur;
+    CGSize size;                // Size of the shape the mask is rendered for, smaller than the shape for a 9-slice
+    size_t padding;             // Pixels around the shape, enough for the blur (and for the offset of inner shadows)
+    size_t width;               // Pixels of the mask
+    size_t height;
+    size_t stretchColumn;       // Column and row stretched to the size of the shape, 0 if the mask is not stretched
+    size_t stretchRow;
+} TKShadowLayout;
+
+// False if the shadow can't be drawn from a mask - there is no blur, the context is rotated or the
+// mask would be too large. Core Graphics has to draw the shadow then
+BOOL TKShadowLayoutMake(TKShadowLayout *layout, CGContextRef context, const TKShadowShape *shape, CGFloat blur, CGSize offset, BOOL inner);
+
+// Renders and blurs the mask, this is what the resource pool caches (see -shadowMaskForShape:layout:)
+CGImageRef TKShadowMaskCreate(const TKShadowShape *shape, const TKShadowLayout *layout);
+
+// Fills the mask with the color, moved by the offset (in points, positive y is down). Drop shadows go
+// below the fill of the shape, inner shadows above it with the shape as the clip
+void TKContextDrawShadowMask(CGContextRef context, CGImageRef mask, const TKShadowLayout *layout, const TKShadowShape *shape, CGSize offset, CGColorRef color);
@@ -0,0 +1,448 @@
+//
+//  TKShadow.m
+//  ThemeEngine
+//
+//  Copyright (c) 2012 __MyCompanyName__. All rights reserved.
+//
+
+#import "TKShadow.h"
+#import "TKHelpers.h"
+#import "TKInstrumentation.h"
+
+// Standard deviation (in pixels) under which the gaussian itself is used, three box blurs drift too far from it there
+#define kShadowGaussianLimit 4.0
+
+// Larger masks are left to Core Graphics, the memory would outweigh the time saved
+#define kShadowMaxPixels (1024 * 1024)
+
+#pragma mark - Shapes
+
+typedef struct {
+    uint64_t value;
+    uint64_t check;
+    CGPoint origin;
+} TKShadowPathHasher;
+
+static inline void TKShadowHashAdd(TKShadowPathHasher *hasher, uint64_t bits) {
+    hasher->value = (hasher->value ^ bits) * 0x100000001b3ULL;
+    hasher->check = (hasher->check + bits) * 0x9e3779b97f4a7c15ULL;
+    hasher->check ^= hasher->check >> 31;
+}
+
+static void TKShadowHashPathElement(void *info, const CGPathElement *element) {
+    TKShadowPathHasher *hasher = (TKShadowPathHasher *)info;
+    TKShadowHashAdd(hasher, element->type);
+
+    NSUInteger count = 0;
+    switch (element->type) {
+        case kCGPathElementMoveToPoint:
+        case kCGPathElementAddLineToPoint:
+            count = 1;
+            break;
+        case kCGPathElementAddQuadCurveToPoint:
+            count = 2;
+            break;
+        case kCGPathElementAddCurveToPoint:
+            count = 3;
+            break;
+        default:
+            break;
+    }
+
+    for (NSUInteger i = 0; i < count; i++) {
+        double x = element->points[i].x - hasher->origin.x, y = element->points[i].y - hasher->origin.y;
+        uint64_t bits;
+
+        memcpy(&bits, &x, sizeof(bits));
+        TKShadowHashAdd(hasher, bits);
+        memcpy(&bits, &y, sizeof(bits));
+        TKShadowHashAdd(hasher, bits);
+    }
+}
+
+void TKShadowShapeInitWithRect(TKShadowShape *shape, CGRect rect, const CGFloat *radii) {
+    memset(shape, 0, sizeof(TKShadowShape));
+    shape->type = TKShadowShapeRectangle;
+    shape->rect = rect;
+
+    if (radii)
+        memcpy(shape->radii, radii, sizeof(shape->radii));
+}
+
+void TKShadowShapeInitWithEllipse(TKShadowShape *shape, CGRect rect) {
+    memset(shape, 0, sizeof(TKShadowShape));
+    shape->type = TKShadowShapeEllipse;
+    shape->rect = rect;
+}
+
+void TKShadowShapeInitWithPath(TKShadowShape *shape, CGPathRef path) {
+    memset(shape, 0, sizeof(TKShadowShape));
+    shape->type = TKShadowShapePath;
+    shape->rect = CGPathGetBoundingBox(path);
+    shape->path = path;
+
+    // Paths that only differ by where they are share the masks
+    TKShadowPathHasher hasher = { 0xcbf29ce484222325ULL, 0x84222325cbf29ce4ULL, shape->rect.origin };
+    CGPathApply(path, &hasher, TKShadowHashPathElement);
+
+    shape->pathHash[0] = hasher.value;
+    shape->pathHash[1] = hasher.check;
+}
+
+#pragma mark - Blurring
+
+// Three box blurs with the same variance as the gaussian, lower and upper widths mixed to match it closely
+static void TKShadowBoxWidths(CGFloat sigma, size_t *widths) {
+    NSInteger lower = (NSInteger)floor(sqrt(4.0 * sigma * sigma + 1.0));
+    if (lower % 2 == 0)
+        lower--;
+
+    NSInteger lowerCount = (NSInteger)round((12.0 * sigma * sigma - 3.0 * lower * lower - 12.0 * lower - 9.0) / (-4.0 * lower - 4.0));
+    for (NSInteger i = 0; i < 3; i++) {
+        widths[i] = (size_t)(i < lowerCount ? lower : lower + 2);
+    }
+}
+
+// How far the blur spreads the coverage, in pixels
+static size_t TKShadowBlurReach(CGFloat sigma) {
+    if (sigma < kShadowGaussianLimit)
+        return (size_t)ceil(3.0 * sigma);
+
+    size_t widths[3];
+    TKShadowBoxWidths(sigma, widths);
+
+    return (widths[0] + widths[1] + widths[2] - 3) / 2;
+}
+
+static void TKShadowBoxBlurRows(uint8_t *pixels, size_t width, size_t height, size_t bytesPerRow, size_t radius, uint8_t *line) {
+    uint32_t size = (uint32_t)(2 * radius + 1);
+
+    for (size_t y = 0; y < height; y++) {
+        uint8_t *row = pixels + y * bytesPerRow;
+        memcpy(line, row, width);
+
+        uint32_t sum = 0;
+        for (size_t x = 0; x < radius && x < width; x++) {
+            sum += line[x];
+        }
+
+        for (size_t x = 0; x < width; x++) {
+            if (x + radius < width)
+                sum += line[x + radius];
+            if (x > radius)
+                sum -= line[x - radius - 1];
+
+            row[x] = (uint8_t)((sum + size / 2) / size);
+        }
+    }
+}
+
+// Vertical pass a row at a time, with a running sum for each column
+static void TKShadowBoxBlurColumns(uint8_t *pixels, size_t width, size_t height, size_t bytesPerRow, size_t radius, uint8_t *copy, uint32_t *sums) {
+    uint32_t size = (uint32_t)(2 * radius + 1);
+    memcpy(copy, pixels, bytesPerRow * height);
+    memset(sums, 0, width * sizeof(uint32_t));
+
+    for (size_t y = 0; y < radius && y < height; y++) {
+        const uint8_t *row = copy + y * bytesPerRow;
+        for (size_t x = 0; x < width; x++) {
+            sums[x] += row[x];
+        }
+    }
+
+    for (size_t y = 0; y < height; y++) {
+        if (y + radius < height) {
+            const uint8_t *entering = copy + (y + radius) * bytesPerRow;
+            for (size_t x = 0; x < width; x++) {
+                sums[x] += entering[x];
+            }
+        }
+
+        if (y > radius) {
+            const uint8_t *leaving = copy + (y - radius - 1) * bytesPerRow;
+            for (size_t x = 0; x < width; x++) {
+                sums[x] -= leaving[x];
+            }
+        }
+
+        uint8_t *row = pixels + y * bytesPerRow;
+        for (size_t x = 0; x < width; x++) {
+            row[x] = (uint8_t)((sums[x] + size / 2) / size);
+        }
+    }
+}
+
+// Small blurs use the gaussian itself, weights (in 16.16 fixed point) are its area over each pixel
+static void TKShadowGaussianBlur(uint8_t *pixels, size_t width, size_t height, size_t bytesPerRow, CGFloat sigma, uint8_t *copy, uint32_t *sums) {
+    NSInteger radius = (NSInteger)ceil(3.0 * sigma);
+    uint32_t weights[2 * (NSInteger)(3.0 * kShadowGaussianLimit + 1) + 1];
+
+    double values[sizeof(weights) / sizeof(weights[0])];
+    double total = 0.0;
+    for (NSInteger k = -radius; k <= radius; k++) {
+        values[k + radius] = erf((k + 0.5) / (sigma * M_SQRT2)) - erf((k - 0.5) / (sigma * M_SQRT2));
+        total += values[k + radius];
+    }
+
+    // Rounding leftovers go into the center, so that a solid area stays solid
+    uint32_t sum = 0;
+    for (NSInteger k = 0; k <= 2 * radius; k++) {
+        weights[k] = (uint32_t)round(values[k] / total * 65536.0);
+        sum += weights[k];
+    }
+
+    weights[radius] += 65536 - sum;
+
+    // Horizontal, a row at a time
+    for (size_t y = 0; y < height; y++) {
+        uint8_t *row = pixels + y * bytesPerRow;
+        memcpy(copy, row, width);
+
+        for (NSInteger x = 0; x < (NSInteger)width; x++) {
+            uint32_t value = 0;
+            for (NSInteger k = MAX(-radius, -x); k <= radius && x + k < (NSInteger)width; k++) {
+                value += weights[k + radius] * copy[x + k];
+            }
+
+            row[x] = (uint8_t)((value + 32768) >> 16);
+        }
+    }
+
+    // Vertical, weighted rows summed up into each row
+    memcpy(copy, pixels, bytesPerRow * height);
+
+    for (NSInteger y = 0; y < (NSInteger)height; y++) {
+        memset(sums, 0, width * sizeof(uint32_t));
+
+        for (NSInteger k = MAX(-radius, -y); k <= radius && y + k < (NSInteger)height; k++) {
+            const uint8_t *source = copy + (y + k) * bytesPerRow;
+            uint32_t weight = weights[k + radius];
+
+            for (size_t x = 0; x < width; x++) {
+                sums[x] += weight * source[x];
+            }
+        }
+
+        uint8_t *row = pixels + y * bytesPerRow;
+        for (size_t x = 0; x < width; x++) {
+            row[x] = (uint8_t)((sums[x] + 32768) >> 16);
+        }
+    }
+}
+
+static void TKShadowBlur(uint8_t *pixels, size_t width, size_t height, size_t bytesPerRow, CGFloat sigma) {
+    uint8_t *copy = (uint8_t *)malloc(bytesPerRow * height);
+    uint32_t *sums = (uint32_t *)malloc(width * sizeof(uint32_t));
+
+    if (sigma < kShadowGaussianLimit) {
+        TKShadowGaussianBlur(pixels, width, height, bytesPerRow, sigma, copy, sums);
+    } else {
+        size_t widths[3];
+        TKShadowBoxWidths(sigma, widths);
+
+        for (NSUInteger pass = 0; pass < 3; pass++) {
+            TKShadowBoxBlurRows(pixels, width, height, bytesPerRow, (widths[pass] - 1) / 2, copy);
+        }
+
+        for (NSUInteger pass = 0; pass < 3; pass++) {
+            TKShadowBoxBlurColumns(pixels, width, height, bytesPerRow, (widths[pass] - 1) / 2, copy, sums);
+        }
+    }
+
+    free(copy);
+    free(sums);
+}
+
+#pragma mark - Masks
+
+// Length of the shape a mask is rendered for along one axis. The middle of a long enough rectangle only repeats
+// the same pixels, so the mask is rendered just long enough for the corners (and the blur around them) and
+// the pixel in the middle is stretched instead. The ones next to it are out of reach of the corners as well
+static CGFloat TKShadowStretchAxis(CGFloat length, CGFloat startCap, CGFloat endCap, size_t padding, CGFloat scale, size_t *stretch) {
+    size_t start = (size_t)ceil(startCap * scale);
+    size_t end = (size_t)ceil(endCap * scale);
+    size_t minimum = start + end + 2 * padding + 3;
+
+    if (length * scale <= minimum) {
+        *stretch = 0;
+        return length;
+    }
+
+    *stretch = padding + start + padding + 1;
+    return minimum / scale;
+}
+
+BOOL TKShadowLayoutMake(TKShadowLayout *layout, CGContextRef context, const TKShadowShape *shape, CGFloat blur, CGSize offset, BOOL inner) {
+    if (blur <= 0.0 || shape->rect.size.width <= 0.0 || shape->rect.size.height <= 0.0)
+        return NO;
+
+    // Masks are rendered in pixels, which only line up with the context without rotation
+    CGAffineTransform transform = CGContextGetUserSpaceToDeviceSpaceTransform(context);
+    if (transform.b != 0.0 || transform.c != 0.0 || fabs(transform.a) != fabs(transform.d) || transform.a == 0.0)
+        return NO;
+
+    memset(layout, 0, sizeof(TKShadowLayout));
+    layout->inner = inner;
+    layout->scale = fabs(transform.a);
+    layout->blur = blur;
+
+    CGFloat scale = layout->scale;
+    size_t padding = TKShadowBlurReach(blur * scale / 2.0) + 1;
+
+    // The inverse of the shape has to cover the shape after it has been moved
+    if (inner)
+        padding += (size_t)ceil(MAX(fabs(offset.width), fabs(offset.height)) * scale);
+
+    layout->padding = padding;
+
+    CGSize size = shape->rect.size;
+    if (shape->type == TKShadowShapeRectangle) {
+        const CGFloat *radii = shape->radii;
+        size.width = TKShadowStretchAxis(size.width, MAX(radii[3], radii[2]), MAX(radii[0], radii[1]), padding, scale, &layout->stretchColumn);
+        size.height = TKShadowStretchAxis(size.height, MAX(radii[3], radii[0]), MAX(radii[1], radii[2]), padding, scale, &layout->stretchRow);
+    }
+
+    layout->size = size;
+    layout->width = (size_t)ceil(size.width * scale) + 2 * padding;
+    layout->height = (size_t)ceil(size.height * scale) + 2 * padding;
+
+    return layout->width * layout->height <= kShadowMaxPixels;
+}
+
+static void TKShadowReleaseMaskData(void *info, const void *data, size_t size) {
+    free((void *)data);
+}
+
+CGImageRef TKShadowMaskCreate(const TKShadowShape *shape, const TKShadowLayout *layout) {
+    TKInstrumentCount(TKInstrumentationCounterShadowMasks, 1);
+
+    size_t width = layout->width, height = layout->height;
+    size_t bytesPerRow = (width + 15) & ~(size_t)15;
+
+    uint8_t *pixels = (uint8_t *)calloc(bytesPerRow * height, 1);
+    CGContextRef context = CGBitmapContextCreate(pixels, width, height, 8, bytesPerRow, NULL, kCGImageAlphaOnly);
+    if (!context) {
+        free(pixels);
+        return NULL;
+    }
+
+    // Flipped like UIKit, the shape starts at the padding
+    CGFloat scale = layout->scale;
+    CGContextTranslateCTM(context, 0.0, height);
+    CGContextScaleCTM(context, scale, -scale);
+    CGContextTranslateCTM(context, layout->padding / scale, layout->padding / scale);
+
+    CGRect rect = CGRectMake(0.0, 0.0, layout->size.width, layout->size.height);
+    switch (shape->type) {
+        case TKShadowShapeRectangle:
+            if (shape->radii[0] > 0.0 || shape->radii[1] > 0.0 || shape->radii[2] > 0.0 || shape->radii[3] > 0.0) {
+                CGFloat radii[4] = { shape->radii[0], shape->radii[1], shape->radii[2], shape->radii[3] };
+                CGContextAddPath(context, TKRoundedPathInRectForRadii(radii, rect));
+            } else {
+                CGContextAddRect(context, rect);
+            }
+            break;
+        case TKShadowShapeEllipse:
+            CGContextAddEllipseInRect(context, rect);
+            break;
+        case TKShadowShapePath:
+            CGContextTranslateCTM(context, -shape->rect.origin.x, -shape->rect.origin.y);
+            CGContextAddPath(context, shape->path);
+            break;
+        default:
+            break;
+    }
+
+    CGContextFillPath(context);
+    CGContextRelease(context);
+
+    TKShadowBlur(pixels, width, height, bytesPerRow, layout->blur * scale / 2.0);
+
+    // Inner shadows are cast by everything around the shape
+    if (layout->inner) {
+        for (size_t y = 0; y < height; y++) {
+            uint8_t *row = pixels + y * bytesPerRow;
+            for (size_t x = 0; x < width; x++) {
+                row[x] = 255 - row[x];
+            }
+        }
+    }
+
+    // Image masks block the paint where the samples are 1, the decode array turns them into coverage
+    CGDataProviderRef provider = CGDataProviderCreateWithData(NULL, pixels, bytesPerRow * height, TKShadowReleaseMaskData);
+    CGFloat decode[2] = { 1.0, 0.0 };
+    CGImageRef mask = CGImageMaskCreate(width, height, 8, 8, bytesPerRow, provider, decode, false);
+    CGDataProviderRelease(provider);
+
+    return mask;
+}
+
+#pragma mark - Drawing
+
+// Cells of the mask along one axis - the whole mask, or the part before the stretched pixel, the pixel and the part after it
+static NSUInteger TKShadowAxisCells(CGFloat origin, CGFloat length, size_t maskLength, size_t stretch, CGFloat scale, CGFloat *edges, CGFloat *sourceEdges) {
+    edges[0] = origin;
+    sourceEdges[0] = 0.0;
+
+    if (!stretch) {
+        edges[1] = origin + maskLength / scale;
+        sourceEdges[1] = maskLength;
+
+        return 1;
+    }
+
+    edges[1] = origin + stretch / scale;
+    edges[2] = origin + length - (maskLength - stretch - 1) / scale;
+    edges[3] = origin + length;
+
+    sourceEdges[1] = stretch;
+    sourceEdges[2] = stretch + 1;
+    sourceEdges[3] = maskLength;
+
+    return 3;
+}
+
+// Draws the source rect of the mask (in pixels) into the destination, by drawing all of it clipped to the destination
+static void TKContextDrawMaskCell(CGContextRef context, CGImageRef mask, CGRect source, CGRect destination) {
+    CGFloat xScale = destination.size.width / source.size.width;
+    CGFloat yScale = destination.size.height / source.size.height;
+    CGRect imageRect = CGRectMake(destination.origin.x - source.origin.x * xScale, destination.origin.y - source.origin.y * yScale,
+                                  CGImageGetWidth(mask) * xScale, CGImageGetHeight(mask) * yScale);
+
+    CGContextSaveGState(context);
+    CGContextClipToRect(context, destination);
+
+    // Images are drawn bottom up, flip them so that the first row ends up at the top
+    CGContextTranslateCTM(context, 0.0, CGRectGetMinY(imageRect) + CGRectGetMaxY(imageRect));
+    CGContextScaleCTM(context, 1.0, -1.0);
+    CGContextDrawImage(context, imageRect, mask);
+
+    CGContextRestoreGState(context);
+}
+
+void TKContextDrawShadowMask(CGContextRef context, CGImageRef mask, const TKShadowLayout *layout, const TKShadowShape *shape, CGSize offset, CGColorRef color) {
+    if (!mask)
+        return;
+
+    CGFloat scale = layout->scale;
+    CGFloat padding = layout->padding / scale;
+    CGRect rect = shape->rect;
+
+    CGFloat x[4], y[4], sourceX[4], sourceY[4];
+    NSUInteger columns = TKShadowAxisCells(rect.origin.x + offset.width - padding, rect.size.width + 2.0 * padding, layout->width, layout->stretchColumn, scale, x, sourceX);
+    NSUInteger rows = TKShadowAxisCells(rect.origin.y + offset.height - padding, rect.size.height + 2.0 * padding, layout->height, layout->stretchRow, scale, y, sourceY);
+
+    CGContextSaveGState(context);
+    CGContextSetFillColorWithColor(context, color);
+
+    for (NSUInteger row = 0; row < rows; row++) {
+        for (NSUInteger column = 0; column < columns; column++) {
+            CGRect source = CGRectMake(sourceX[column], sourceY[row], sourceX[column + 1] - sourceX[column], sourceY[row + 1] - sourceY[row]);
+            CGRect destination = CGRectMake(x[column], y[row], x[column + 1] - x[column], y[row + 1] - y[row]);
+
+            TKContextDrawMaskCell(context, mask, source, destination);
+        }
+    }
+
+    CGContextRestoreGState(context);
+}
@@ -0,0 +1,23 @@
+//
+//  TKTextRun.h
+//  ThemeEngine
+//
+//  Static labels (ones without a binding) drawn once into a bitmap, instead of a live UILabel for every
+//  instance laying out and compositing its text, gradient and shadow again. Labels that draw the same
+//  (string, font, size, colors, gradient, shadow) share the description of their text run, and with it
+//  the image in the caches of ThemeKit, so identical titles across cells are drawn only once per scale
+//
+//  Copyright (c) 2012 __MyCompanyName__. All rights reserved.
+//
+
+#import <UIKit/UIKit.h>
+
+// The parts of a label description that end up in its pixels, without where it is or what is inside of it.
+// The alpha is left out as well, it is applied by the view showing the image
+NSDictionary *TKTextRunDescription(NSDictionary *description);
+
+// The label as it would be drawn on screen, background included, at scale
+UIImage *TKTextRunImageForLabel(UILabel *label, CGFloat scale);
+
+// View showing the image of a static label, read by VoiceOver as the text of the label
+UIView *TKTextRunViewWithImage(UIImage *image, CGRect frame, NSString *text);
@@ -0,0 +1,65 @@
+//
+//  TKTextRun.m
+//  ThemeEngine
+//
+//  Copyright (c) 2012 __MyCompanyName__. All rights reserved.
+//
+
+#import "TKTextRun.h"
+#import "TKConstants.h"
+#import "TKHash.h"
+
+static NSArray *TKTextRunDrawingKeys(void) {
+    static NSArray *keys = nil;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        keys = [[NSArray alloc] initWithObjects: TypeParameterKey, SizeParameterKey, ColorParameterKey, GradientFillOptionKey,
+                DropShadowOptionKey, ContentStringParameterKey, ContentColorParameterKey, ContentShadowParameterKey,
+                ContentAlignmentParameterKey, ContentFontSizeParameterKey, ContentFontNameParameterKey, ContentFontWeightParameterKey, nil];
+    });
+
+    return keys;
+}
+
+NSDictionary *TKTextRunDescription(NSDictionary *description) {
+    NSMutableDictionary *run = [NSMutableDictionary dictionaryWithCapacity: 12];
+
+    for (NSString *key in TKTextRunDrawingKeys()) {
+        id value = [description objectForKey: key];
+        if (value)
+            [run setObject: value forKey: key];
+    }
+
+    // Immutable, so that its hash is remembered
+    return TKImmutableDescription(run);
+}
+
+UIImage *TKTextRunImageForLabel(UILabel *label, CGFloat scale) {
+    CGSize size = label.bounds.size;
+    if (size.width <= 0.0 || size.height <= 0.0)
+        return nil;
+
+    // Drawn fully opaque, the alpha of the label belongs to the view
+    CGFloat alpha = label.alpha;
+    label.alpha = 1.0;
+
+    UIGraphicsBeginImageContextWithOptions(size, NO, scale);
+    [label.layer renderInContext: UIGraphicsGetCurrentContext()];
+    UIImage *image = UIGraphicsGetImageFromCurrentImageContext();
+    UIGraphicsEndImageContext();
+
+    label.alpha = alpha;
+
+    return image;
+}
+
+UIView *TKTextRunViewWithImage(UIImage *image, CGRect frame, NSString *text) {
+    UIImageView *view = [[[UIImageView alloc] initWithFrame: frame] autorelease];
+    view.image = image;
+
+    view.isAccessibilityElement = YES;
+    view.accessibilityLabel = text;
+    view.accessibilityTraits = UIAccessibilityTraitStaticText;
+
+    return view;
+}
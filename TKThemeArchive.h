@@ -0,0 +1,50 @@
+//
+//  TKThemeArchive.h
+//  ThemeEngine
+//
+//  Precompiled binary form of the JSON descriptions (.tkb). The archive is mapped into memory
+//  and read in place, dictionaries and arrays returned from it are thin wrappers around the
+//  mapped bytes, which only create the objects that are actually asked for
+//
+//  Layout in TKThemeArchiveFormat.h, archives are written by TKThemeCompiler.h (and the tkc tool built from it)
+//
+//  Copyright (c) 2012 __MyCompanyName__. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+#import "TKThemeArchiveFormat.h"
+
+// File extension of the compiled themes, ThemeKit prefers these over the .json files next to them
+static NSString *const TKThemeArchivePathExtension = @"tkb";
+
+@interface TKThemeArchive : NSObject {
+    // The mapping
+    const uint8_t *_bytes;
+    size_t _length;
+
+    // Tables inside the mapping
+    const uint32_t *_strings;
+    uint32_t _stringCount;
+    const double *_numbers;
+    uint32_t _numberCount;
+
+    // Strings are interned, each one is created only once (lazily)
+    id *_stringObjects;
+
+    TKArchiveValue _root;
+}
+
+// Maps the file at path, returns nil if the file is not a valid archive
++ (TKThemeArchive *)archiveWithContentsOfFile: (NSString *)path;
+
+// Compiler, writes the JSON object (dictionaries, arrays, strings, numbers and nulls) as an archive
++ (NSData *)archiveDataForJSONObject: (id)object;
++ (BOOL)writeArchiveForJSONObject: (id)object toFile: (NSString *)path;
+
+// Quick check of the header, without mapping the whole file
++ (BOOL)isArchiveAtPath: (NSString *)path;
+
+// Root object of the archive, NSDictionary or NSArray backed by the mapping
+@property (nonatomic, readonly) id rootObject;
+
+@end
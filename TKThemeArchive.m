@@ -0,0 +1,524 @@
+//
+//  TKThemeArchive.m
+//  ThemeEngine
+//
+//  Copyright (c) 2012 __MyCompanyName__. All rights reserved.
+//
+
+#import "TKThemeArchive.h"
+#import "TKHash.h"
+
+#import <libkern/OSAtomic.h>
+#import <sys/mman.h>
+#import <sys/stat.h>
+#import <fcntl.h>
+#import <unistd.h>
+
+#pragma mark - Archive internals
+
+@interface TKThemeArchive (Private)
+
+- (id)initWithBytes: (const uint8_t *)bytes length: (size_t)length;
+
+- (id)objectForValue: (TKArchiveValue)value;
+- (NSString *)stringAtIndex: (uint32_t)index;
+- (const char *)bytesOfStringAtIndex: (uint32_t)index length: (uint32_t *)length;
+- (const uint8_t *)nodeAtOffset: (uint32_t)offset entrySize: (size_t)size count: (uint32_t *)count;
+
+@end
+
+#pragma mark - Mapped containers
+
+// Children are created on first access and kept, so repeated lookups return the same objects
+static id TKArchiveCachedChild(id *slot, TKThemeArchive *archive, TKArchiveValue value) {
+    id child = *slot;
+    if (child)
+        return child;
+
+    child = [[archive objectForValue: value] retain];
+
+    // Another thread may have been faster, keep theirs in that case
+    if (!OSAtomicCompareAndSwapPtrBarrier(nil, child, (void * volatile *)slot)) {
+        [child release];
+        child = *slot;
+    }
+
+    return child;
+}
+
+@interface TKArchivedDictionary : NSDictionary {
+    TKThemeArchive *_archive;
+    const TKArchiveEntry *_entries;
+    NSUInteger _count;
+    id *_values;
+    TKStructuralHash _hash;
+}
+
+- (id)initWithArchive: (TKThemeArchive *)archive offset: (uint32_t)offset;
+
+@end
+
+@implementation TKArchivedDictionary
+
+- (id)initWithArchive: (TKThemeArchive *)archive offset: (uint32_t)offset {
+    if ((self = [super init])) {
+        uint32_t count = 0;
+        const uint8_t *node = [archive nodeAtOffset: offset entrySize: sizeof(TKArchiveEntry) count: &count];
+
+        if (!node) {
+            NSLog(@"Theme archive node at offset %u is out of bounds", offset);
+            [self release];
+            return nil;
+        }
+
+        _archive = [archive retain];
+        memcpy(&_hash, node, sizeof(TKStructuralHash));
+        _entries = (const TKArchiveEntry *)(node + kArchiveNodeHeaderSize);
+        _count = count;
+        _values = (id *)calloc(MAX(count, 1), sizeof(id));
+    }
+
+    return self;
+}
+
+- (NSUInteger)count {
+    return _count;
+}
+
+// Stored in the archive, the children don't need to be created for it
+- (TKStructuralHash)structuralHash {
+    return _hash;
+}
+
+- (BOOL)isImmutableDescription {
+    return YES;
+}
+
+- (id)objectForKey: (id)key {
+    if (![key isKindOfClass: [NSString class]])
+        return nil;
+
+    // Entries are sorted by the key bytes, compare straight against the mapping
+    const char *query = [key UTF8String];
+    size_t queryLength = strlen(query);
+
+    NSInteger low = 0;
+    NSInteger high = (NSInteger)_count - 1;
+    while (low <= high) {
+        NSInteger middle = (low + high) / 2;
+
+        uint32_t length = 0;
+        const char *bytes = [_archive bytesOfStringAtIndex: _entries[middle].key length: &length];
+
+        int result = memcmp(bytes, query, MIN(length, queryLength));
+        if (result == 0)
+            result = (length < queryLength) ? -1 : (length > queryLength ? 1 : 0);
+
+        if (result == 0)
+            return TKArchiveCachedChild(&_values[middle], _archive, _entries[middle].value);
+        else if (result < 0)
+            low = middle + 1;
+        else
+            high = middle - 1;
+    }
+
+    return nil;
+}
+
+- (NSEnumerator *)keyEnumerator {
+    NSMutableArray *keys = [NSMutableArray arrayWithCapacity: _count];
+    for (NSUInteger i = 0; i < _count; i++) {
+        [keys addObject: [_archive stringAtIndex: _entries[i].key]];
+    }
+
+    return [keys objectEnumerator];
+}
+
+- (void)dealloc {
+    for (NSUInteger i = 0; i < _count; i++) {
+        [_values[i] release];
+    }
+
+    free(_values);
+    [_archive release];
+
+    [super dealloc];
+}
+
+@end
+
+@interface TKArchivedArray : NSArray {
+    TKThemeArchive *_archive;
+    const TKArchiveValue *_elements;
+    NSUInteger _count;
+    id *_objects;
+    TKStructuralHash _hash;
+}
+
+- (id)initWithArchive: (TKThemeArchive *)archive offset: (uint32_t)offset;
+
+@end
+
+@implementation TKArchivedArray
+
+- (id)initWithArchive: (TKThemeArchive *)archive offset: (uint32_t)offset {
+    if ((self = [super init])) {
+        uint32_t count = 0;
+        const uint8_t *node = [archive nodeAtOffset: offset entrySize: sizeof(TKArchiveValue) count: &count];
+
+        if (!node) {
+            NSLog(@"Theme archive node at offset %u is out of bounds", offset);
+            [self release];
+            return nil;
+        }
+
+        _archive = [archive retain];
+        memcpy(&_hash, node, sizeof(TKStructuralHash));
+        _elements = (const TKArchiveValue *)(node + kArchiveNodeHeaderSize);
+        _count = count;
+        _objects = (id *)calloc(MAX(count, 1), sizeof(id));
+    }
+
+    return self;
+}
+
+- (NSUInteger)count {
+    return _count;
+}
+
+// Stored in the archive, the children don't need to be created for it
+- (TKStructuralHash)structuralHash {
+    return _hash;
+}
+
+- (BOOL)isImmutableDescription {
+    return YES;
+}
+
+- (id)objectAtIndex: (NSUInteger)index {
+    if (index >= _count) {
+        [NSException raise: NSRangeException format: @"Index %u beyond bounds [0 .. %u]", (unsigned)index, (unsigned)_count];
+    }
+
+    return TKArchiveCachedChild(&_objects[index], _archive, _elements[index]);
+}
+
+- (void)dealloc {
+    for (NSUInteger i = 0; i < _count; i++) {
+        [_objects[i] release];
+    }
+
+    free(_objects);
+    [_archive release];
+
+    [super dealloc];
+}
+
+@end
+
+#pragma mark - Writer
+
+@interface TKThemeArchiveWriter : NSObject {
+    NSMutableDictionary *_stringIndexes;
+    NSMutableArray *_strings;
+    NSMutableDictionary *_numberIndexes;
+    NSMutableData *_numbers;
+    NSMutableData *_nodes;
+}
+
+- (TKArchiveValue)valueForObject: (id)object;
+- (NSData *)dataWithRootValue: (TKArchiveValue)root;
+
+@end
+
+@implementation TKThemeArchiveWriter
+
+- (id)init {
+    if ((self = [super init])) {
+        _stringIndexes = [[NSMutableDictionary alloc] init];
+        _strings = [[NSMutableArray alloc] init];
+        _numberIndexes = [[NSMutableDictionary alloc] init];
+        _numbers = [[NSMutableData alloc] init];
+        _nodes = [[NSMutableData alloc] init];
+    }
+
+    return self;
+}
+
+- (uint32_t)indexOfString: (NSString *)string {
+    NSNumber *index = [_stringIndexes objectForKey: string];
+    if (!index) {
+        index = [NSNumber numberWithUnsignedInt: (uint32_t)[_strings count]];
+        [_stringIndexes setObject: index forKey: string];
+        [_strings addObject: string];
+    }
+
+    return [index unsignedIntValue];
+}
+
+- (uint32_t)indexOfNumber: (NSNumber *)number {
+    NSNumber *index = [_numberIndexes objectForKey: number];
+    if (!index) {
+        double value = [number doubleValue];
+        index = [NSNumber numberWithUnsignedInt: (uint32_t)([_numbers length] / sizeof(double))];
+        [_numberIndexes setObject: index forKey: number];
+        [_numbers appendBytes: &value length: sizeof(double)];
+    }
+
+    return [index unsignedIntValue];
+}
+
+- (uint32_t)appendNodeForObject: (id)object count: (NSUInteger)count entries: (const void *)entries size: (size_t)size {
+    uint32_t offset = (uint32_t)[_nodes length];
+    uint32_t count32 = (uint32_t)count;
+    TKStructuralHash hash = TKStructuralHashForObject(object);
+
+    [_nodes appendBytes: &hash length: sizeof(TKStructuralHash)];
+    [_nodes appendBytes: &count32 length: sizeof(uint32_t)];
+    [_nodes appendBytes: entries length: size];
+
+    // Keep the next node aligned
+    [_nodes setLength: ([_nodes length] + 7) & ~(NSUInteger)7];
+
+    return offset;
+}
+
+- (TKArchiveValue)valueForObject: (id)object {
+    TKArchiveValue value = { TKArchiveValueNull, 0 };
+
+    if ([object isKindOfClass: [NSDictionary class]]) {
+        // Sort the keys by their bytes, this allows binary search when reading
+        NSArray *keys = [[object allKeys] sortedArrayUsingComparator: ^NSComparisonResult(id first, id second) {
+            int result = strcmp([first UTF8String], [second UTF8String]);
+            return result < 0 ? NSOrderedAscending : (result > 0 ? NSOrderedDescending : NSOrderedSame);
+        }];
+
+        // Children first, so that the node can be written in one go
+        NSUInteger count = [keys count];
+        TKArchiveEntry *entries = (TKArchiveEntry *)calloc(MAX(count, 1), sizeof(TKArchiveEntry));
+        for (NSUInteger i = 0; i < count; i++) {
+            NSString *key = [keys objectAtIndex: i];
+            entries[i].key = [self indexOfString: key];
+            entries[i].value = [self valueForObject: [object objectForKey: key]];
+        }
+
+        value.type = TKArchiveValueDictionary;
+        value.payload = [self appendNodeForObject: object count: count entries: entries size: sizeof(TKArchiveEntry) * count];
+        free(entries);
+    } else if ([object isKindOfClass: [NSArray class]]) {
+        NSUInteger count = [object count];
+        TKArchiveValue *elements = (TKArchiveValue *)calloc(MAX(count, 1), sizeof(TKArchiveValue));
+        for (NSUInteger i = 0; i < count; i++) {
+            elements[i] = [self valueForObject: [object objectAtIndex: i]];
+        }
+
+        value.type = TKArchiveValueArray;
+        value.payload = [self appendNodeForObject: object count: count entries: elements size: sizeof(TKArchiveValue) * count];
+        free(elements);
+    } else if ([object isKindOfClass: [NSString class]]) {
+        value.type = TKArchiveValueString;
+        value.payload = [self indexOfString: object];
+    } else if ([object isKindOfClass: [NSNumber class]]) {
+        if (CFGetTypeID((CFTypeRef)object) == CFBooleanGetTypeID()) {
+            value.type = [object boolValue] ? TKArchiveValueTrue : TKArchiveValueFalse;
+        } else {
+            value.type = TKArchiveValueNumber;
+            value.payload = [self indexOfNumber: object];
+        }
+    } else if (object && ![object isKindOfClass: [NSNull class]]) {
+        NSLog(@"Unsupported object of class %@ in theme, stored as null", NSStringFromClass([object class]));
+    }
+
+    return value;
+}
+
+- (NSData *)dataWithRootValue: (TKArchiveValue)root {
+    NSMutableData *data = [NSMutableData data];
+    [data setLength: sizeof(TKArchiveHeader)];
+
+    TKArchiveHeader header;
+    memset(&header, 0, sizeof(TKArchiveHeader));
+    memcpy(header.magic, TKArchiveMagic, 4);
+    header.version = kThemeArchiveVersion;
+    header.root = root;
+
+    // String table, followed by the bytes of all strings
+    header.stringCount = (uint32_t)[_strings count];
+    header.stringTableOffset = (uint32_t)[data length];
+
+    NSMutableData *stringBytes = [NSMutableData data];
+    uint32_t stringBytesOffset = header.stringTableOffset + header.stringCount * 2 * sizeof(uint32_t);
+    for (NSString *string in _strings) {
+        const char *bytes = [string UTF8String];
+        uint32_t entry[2] = { stringBytesOffset + (uint32_t)[stringBytes length], (uint32_t)strlen(bytes) };
+
+        [data appendBytes: entry length: sizeof(entry)];
+        [stringBytes appendBytes: bytes length: entry[1]];
+    }
+    [data appendData: stringBytes];
+
+    // Numbers need to be aligned for reading them in place
+    [data setLength: ([data length] + 7) & ~(NSUInteger)7];
+    header.numberCount = (uint32_t)([_numbers length] / sizeof(double));
+    header.numberTableOffset = (uint32_t)[data length];
+    [data appendData: _numbers];
+
+    header.nodeOffset = (uint32_t)[data length];
+    header.nodeLength = (uint32_t)[_nodes length];
+    [data appendData: _nodes];
+
+    [data replaceBytesInRange: NSMakeRange(0, sizeof(TKArchiveHeader)) withBytes: &header];
+
+    return data;
+}
+
+- (void)dealloc {
+    [_stringIndexes release];
+    [_strings release];
+    [_numberIndexes release];
+    [_numbers release];
+    [_nodes release];
+
+    [super dealloc];
+}
+
+@end
+
+#pragma mark - Archive
+
+@implementation TKThemeArchive
+
++ (TKThemeArchive *)archiveWithContentsOfFile: (NSString *)path {
+    int file = open([path fileSystemRepresentation], O_RDONLY);
+    if (file < 0)
+        return nil;
+
+    struct stat info;
+    if (fstat(file, &info) != 0 || info.st_size < (off_t)sizeof(TKArchiveHeader)) {
+        close(file);
+        return nil;
+    }
+
+    // Map the whole file, the pages are only read in when the nodes are accessed
+    void *bytes = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+    close(file);
+
+    if (bytes == MAP_FAILED)
+        return nil;
+
+    return [[[TKThemeArchive alloc] initWithBytes: (const uint8_t *)bytes length: (size_t)info.st_size] autorelease];
+}
+
++ (NSData *)archiveDataForJSONObject: (id)object {
+    TKThemeArchiveWriter *writer = [[TKThemeArchiveWriter alloc] init];
+    TKArchiveValue root = [writer valueForObject: object];
+    NSData *data = [writer dataWithRootValue: root];
+    [writer release];
+
+    return data;
+}
+
++ (BOOL)writeArchiveForJSONObject: (id)object toFile: (NSString *)path {
+    return [[self archiveDataForJSONObject: object] writeToFile: path atomically: YES];
+}
+
++ (BOOL)isArchiveAtPath: (NSString *)path {
+    NSFileHandle *handle = [NSFileHandle fileHandleForReadingAtPath: path];
+    NSData *magic = [handle readDataOfLength: 4];
+    [handle closeFile];
+
+    return [magic length] == 4 && memcmp([magic bytes], TKArchiveMagic, 4) == 0;
+}
+
+- (id)initWithBytes: (const uint8_t *)bytes length: (size_t)length {
+    if ((self = [super init])) {
+        _bytes = bytes;
+        _length = length;
+
+        // Validate the header and the tables, nodes are validated when accessed
+        const TKArchiveHeader *header = (const TKArchiveHeader *)bytes;
+        BOOL valid = TKArchiveIsValid(bytes, length);
+
+        if (!valid) {
+            NSLog(@"Invalid or unsupported theme archive");
+            [self release];
+            return nil;
+        }
+
+        _strings = (const uint32_t *)(bytes + header->stringTableOffset);
+        _stringCount = header->stringCount;
+        _numbers = (const double *)(bytes + header->numberTableOffset);
+        _numberCount = header->numberCount;
+        _stringObjects = (id *)calloc(MAX(_stringCount, 1), sizeof(id));
+        _root = header->root;
+    }
+
+    return self;
+}
+
+- (id)rootObject {
+    return [self objectForValue: _root];
+}
+
+- (id)objectForValue: (TKArchiveValue)value {
+    switch (value.type) {
+        case TKArchiveValueFalse:
+            return [NSNumber numberWithBool: NO];
+        case TKArchiveValueTrue:
+            return [NSNumber numberWithBool: YES];
+        case TKArchiveValueNumber:
+            return value.payload < _numberCount ? [NSNumber numberWithDouble: _numbers[value.payload]] : nil;
+        case TKArchiveValueString:
+            return [self stringAtIndex: value.payload];
+        case TKArchiveValueArray:
+            return [[[TKArchivedArray alloc] initWithArchive: self offset: value.payload] autorelease];
+        case TKArchiveValueDictionary:
+            return [[[TKArchivedDictionary alloc] initWithArchive: self offset: value.payload] autorelease];
+        default:
+            break;
+    }
+
+    return [NSNull null];
+}
+
+- (NSString *)stringAtIndex: (uint32_t)index {
+    if (index >= _stringCount)
+        return nil;
+
+    NSString *string = _stringObjects[index];
+    if (string)
+        return string;
+
+    // Strings are copied out of the mapping, as they may well outlive the archive (label texts etc.)
+    uint32_t length = 0;
+    const char *bytes = [self bytesOfStringAtIndex: index length: &length];
+    string = [[NSString alloc] initWithBytes: bytes length: length encoding: NSUTF8StringEncoding];
+
+    if (!OSAtomicCompareAndSwapPtrBarrier(nil, string, (void * volatile *)&_stringObjects[index])) {
+        [string release];
+        string = _stringObjects[index];
+    }
+
+    return string;
+}
+
+- (const char *)bytesOfStringAtIndex: (uint32_t)index length: (uint32_t *)length {
+    return TKArchiveStringAtIndex(_bytes, index, length);
+}
+
+- (const uint8_t *)nodeAtOffset: (uint32_t)offset entrySize: (size_t)size count: (uint32_t *)count {
+    return TKArchiveNodeAtOffset(_bytes, offset, size, count);
+}
+
+- (void)dealloc {
+    for (uint32_t i = 0; i < _stringCount; i++) {
+        [_stringObjects[i] release];
+    }
+
+    free(_stringObjects);
+    munmap((void *)_bytes, _length);
+
+    [super dealloc];
+}
+
+@end
@@ -0,0 +1,127 @@
+//
+//  TKThemeArchiveFormat.h
+//  ThemeEngine
+//
+//  Precompiled binary form of the JSON descriptions (.tkb), shared by the compiler (TKThemeCompiler.h)
+//  and the loader (TKThemeArchive.h). Plain C, the compiler also runs on the build machine
+//
+//  Layout (version 2, little-endian, all offsets are from the start of the file):
+//
+//  Header          magic "TKTB", uint16 version, uint16 flags,
+//                  uint32 string count, uint32 string table offset,
+//                  uint32 number count, uint32 number table offset,
+//                  uint32 node section offset, uint32 node section length,
+//                  TKArchiveValue root
+//  String table    { uint32 offset, uint32 length } per string, UTF-8 bytes, every string is stored once
+//  Number table    double per number, already parsed
+//  Node section    every node starts with its TKStructuralHash (two uint64) and is padded to 8 bytes
+//                  arrays:       hash, uint32 count, TKArchiveValue[count]
+//                  dictionaries: hash, uint32 count, { uint32 key string, TKArchiveValue value }[count], sorted by key bytes
+//
+//  Copyright (c) 2012 __MyCompanyName__. All rights reserved.
+//
+
+#ifndef TKThemeArchiveFormat_h
+#define TKThemeArchiveFormat_h
+
+#include "TKHashFunction.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// Hashes are stored, so the version has to change along with the hash function in TKHashFunction.h
+#define kThemeArchiveVersion 2
+
+static const char TKArchiveMagic[4] = { 'T', 'K', 'T', 'B' };
+
+typedef enum { TKArchiveValueNull,
+               TKArchiveValueFalse,
+               TKArchiveValueTrue,
+               TKArchiveValueNumber,        // Payload is the index in the number table
+               TKArchiveValueString,        // Payload is the index in the string table
+               TKArchiveValueArray,         // Payload is the offset of the node
+               TKArchiveValueDictionary } TKArchiveValueType;
+
+typedef struct {
+    uint32_t type;
+    uint32_t payload;
+} TKArchiveValue;
+
+typedef struct {
+    char magic[4];
+    uint16_t version;
+    uint16_t flags;
+    uint32_t stringCount;
+    uint32_t stringTableOffset;
+    uint32_t numberCount;
+    uint32_t numberTableOffset;
+    uint32_t nodeOffset;
+    uint32_t nodeLength;
+    TKArchiveValue root;
+} TKArchiveHeader;
+
+typedef struct {
+    uint32_t key;
+    TKArchiveValue value;
+} TKArchiveEntry;
+
+// Hash and count in front of every node
+#define kArchiveNodeHeaderSize (sizeof(TKStructuralHash) + sizeof(uint32_t))
+
+#pragma mark - Reading
+
+// Checks the header and the tables, nodes are checked when they are read (TKArchiveNodeAtOffset)
+static inline bool TKArchiveIsValid(const uint8_t *bytes, size_t length) {
+    if (length < sizeof(TKArchiveHeader))
+        return false;
+
+    const TKArchiveHeader *header = (const TKArchiveHeader *)bytes;
+    bool valid = memcmp(header->magic, TKArchiveMagic, 4) == 0 && header->version == kThemeArchiveVersion;
+    valid = valid && (header->stringTableOffset % sizeof(uint32_t)) == 0;
+    valid = valid && (uint64_t)header->stringTableOffset + (uint64_t)header->stringCount * 2 * sizeof(uint32_t) <= length;
+    valid = valid && (header->numberTableOffset % sizeof(double)) == 0;
+    valid = valid && (uint64_t)header->numberTableOffset + (uint64_t)header->numberCount * sizeof(double) <= length;
+    valid = valid && (header->nodeOffset % 8) == 0;
+    valid = valid && (uint64_t)header->nodeOffset + header->nodeLength <= length;
+
+    for (uint32_t i = 0; valid && i < header->stringCount; i++) {
+        const uint32_t *entry = (const uint32_t *)(bytes + header->stringTableOffset) + 2 * i;
+        valid = (uint64_t)entry[0] + entry[1] <= length;
+    }
+
+    return valid;
+}
+
+// Bytes of the string at index (not terminated), an empty string if the index is out of bounds
+static inline const char *TKArchiveStringAtIndex(const uint8_t *bytes, uint32_t index, uint32_t *length) {
+    const TKArchiveHeader *header = (const TKArchiveHeader *)bytes;
+    if (index >= header->stringCount) {
+        *length = 0;
+        return "";
+    }
+
+    const uint32_t *entry = (const uint32_t *)(bytes + header->stringTableOffset) + 2 * index;
+    *length = entry[1];
+    return (const char *)(bytes + entry[0]);
+}
+
+// Start of the node at offset (its hash), NULL if it does not fit into the node section. The entries follow
+// the header, each of entrySize bytes (sizeof(TKArchiveValue) for arrays, sizeof(TKArchiveEntry) for dictionaries)
+static inline const uint8_t *TKArchiveNodeAtOffset(const uint8_t *bytes, uint32_t offset, size_t entrySize, uint32_t *count) {
+    const TKArchiveHeader *header = (const TKArchiveHeader *)bytes;
+
+    if ((uint64_t)offset + kArchiveNodeHeaderSize > header->nodeLength)
+        return NULL;
+
+    const uint8_t *node = bytes + header->nodeOffset + offset;
+    memcpy(count, node + sizeof(TKStructuralHash), sizeof(uint32_t));
+
+    if ((uint64_t)offset + kArchiveNodeHeaderSize + (uint64_t)*count * entrySize > header->nodeLength)
+        return NULL;
+
+    return node;
+}
+
+#endif
@@ -0,0 +1,491 @@
+//
+//  TKThemeCompiler.c
+//  ThemeEngine
+//
+//  Copyright (c) 2012 __MyCompanyName__. All rights reserved.
+//
+
+#include "TKThemeCompiler.h"
+#include "TKThemeArchiveFormat.h"
+#include "TKJSONReader.h"
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#pragma mark - Buffers
+
+typedef struct {
+    uint8_t *bytes;
+    size_t length;
+    size_t capacity;
+} TKCompilerBuffer;
+
+static bool TKCompilerBufferReserve(TKCompilerBuffer *buffer, size_t length) {
+    if (buffer->length + length <= buffer->capacity)
+        return true;
+
+    size_t capacity = buffer->capacity ? buffer->capacity : 4096;
+    while (capacity < buffer->length + length) {
+        capacity *= 2;
+    }
+
+    uint8_t *bytes = (uint8_t *)realloc(buffer->bytes, capacity);
+    if (!bytes)
+        return false;
+
+    buffer->bytes = bytes;
+    buffer->capacity = capacity;
+    return true;
+}
+
+static bool TKCompilerBufferAppend(TKCompilerBuffer *buffer, const void *bytes, size_t length) {
+    if (length == 0)
+        return true;
+    if (!TKCompilerBufferReserve(buffer, length))
+        return false;
+
+    memcpy(buffer->bytes + buffer->length, bytes, length);
+    buffer->length += length;
+    return true;
+}
+
+// Zeroes up to the next multiple of 8
+static bool TKCompilerBufferAlign(TKCompilerBuffer *buffer) {
+    size_t padding = ((buffer->length + 7) & ~(size_t)7) - buffer->length;
+    if (!TKCompilerBufferReserve(buffer, padding))
+        return false;
+
+    memset(buffer->bytes + buffer->length, 0, padding);
+    buffer->length += padding;
+    return true;
+}
+
+#pragma mark - Tables
+
+// Open addressing over the indexes of the strings or numbers (plus one, zero is empty), keyed by their buckets
+typedef struct {
+    uint32_t *slots;
+    size_t capacity;
+} TKCompilerTable;
+
+// Both start with the bucket in the tables
+typedef struct {
+    uint64_t bucket;
+    TKStructuralHash hash;
+    uint32_t offset;            // In the string bytes
+    uint32_t length;
+} TKCompilerString;
+
+typedef struct {
+    uint64_t bucket;
+    double number;
+} TKCompilerNumber;
+
+// A finished value, waiting for its container to end
+typedef struct {
+    TKArchiveValue value;
+    TKStructuralHash hash;
+    uint32_t key;               // String index of its key, in dictionaries
+    uint32_t order;             // Position in the dictionary, the last of duplicate keys wins
+
+    // Bytes of the key while the dictionary is sorted
+    const uint8_t *keyBytes;
+    uint32_t keyLength;
+} TKCompilerItem;
+
+typedef struct {
+    size_t start;               // First item of the container
+    bool isDictionary;
+    uint32_t key;               // Waiting for its value
+} TKCompilerFrame;
+
+typedef struct {
+    TKCompilerBuffer stringBytes;
+    TKCompilerString *strings;
+    uint32_t stringCount;
+    size_t stringCapacity;
+    TKCompilerTable stringTable;
+
+    TKCompilerNumber *numbers;
+    uint32_t numberCount;
+    size_t numberCapacity;
+    TKCompilerTable numberTable;
+
+    TKCompilerBuffer nodes;
+
+    TKCompilerItem *items;
+    size_t itemCount;
+    size_t itemCapacity;
+
+    TKCompilerFrame frames[kJSONReaderMaximumDepth];
+    size_t depth;
+
+    bool failed;                // Out of memory, or beyond the 32-bit offsets of the format
+} TKCompiler;
+
+// Slot of the entry equal to the one being looked for, or the empty slot it goes into
+typedef bool (*TKCompilerTableEqual)(const TKCompiler *compiler, uint32_t index, const void *key);
+
+static uint32_t *TKCompilerTableSlot(const TKCompiler *compiler, const TKCompilerTable *table, uint64_t bucket,
+                                     TKCompilerTableEqual equal, const void *key) {
+    size_t mask = table->capacity - 1;
+    for (size_t i = (size_t)bucket & mask; ; i = (i + 1) & mask) {
+        uint32_t *slot = &table->slots[i];
+        if (*slot == 0 || equal(compiler, *slot - 1, key))
+            return slot;
+    }
+}
+
+// Keeps the table at most half full, the buckets are the first field of the entries (count of them, stride bytes apart)
+static bool TKCompilerTableGrow(TKCompilerTable *table, uint32_t count, const void *entries, size_t stride) {
+    if ((count + 1) * 2 <= table->capacity)
+        return true;
+
+    size_t capacity = table->capacity ? table->capacity * 2 : 1024;
+    uint32_t *slots = (uint32_t *)calloc(capacity, sizeof(uint32_t));
+    if (!slots)
+        return false;
+
+    // Entries are distinct, they only need a free slot
+    for (uint32_t index = 0; index < count; index++) {
+        uint64_t bucket;
+        memcpy(&bucket, (const uint8_t *)entries + index * stride, sizeof(uint64_t));
+        size_t slot = (size_t)bucket & (capacity - 1);
+        while (slots[slot]) {
+            slot = (slot + 1) & (capacity - 1);
+        }
+
+        slots[slot] = index + 1;
+    }
+
+    free(table->slots);
+    table->slots = slots;
+    table->capacity = capacity;
+    return true;
+}
+
+typedef struct {
+    const char *bytes;
+    size_t length;
+} TKCompilerStringKey;
+
+static bool TKCompilerStringEqual(const TKCompiler *compiler, uint32_t index, const void *key) {
+    const TKCompilerStringKey *string = (const TKCompilerStringKey *)key;
+    const TKCompilerString *entry = &compiler->strings[index];
+
+    return entry->length == string->length && memcmp(compiler->stringBytes.bytes + entry->offset, string->bytes, string->length) == 0;
+}
+
+static bool TKCompilerNumberEqual(const TKCompiler *compiler, uint32_t index, const void *key) {
+    // Bitwise, so that each number is stored exactly as it was read
+    return memcmp(&compiler->numbers[index].number, key, sizeof(double)) == 0;
+}
+
+static uint32_t TKCompilerInternString(TKCompiler *compiler, const char *bytes, size_t length, TKStructuralHash *hash) {
+    *hash = TKHashUTF8String(bytes, length);
+
+    if (!TKCompilerTableGrow(&compiler->stringTable, compiler->stringCount, compiler->strings, sizeof(TKCompilerString)) ||
+        length > UINT32_MAX || compiler->stringBytes.length + length > UINT32_MAX) {
+        compiler->failed = true;
+        return 0;
+    }
+
+    TKCompilerStringKey key = { bytes, length };
+    uint32_t *slot = TKCompilerTableSlot(compiler, &compiler->stringTable, hash->value, TKCompilerStringEqual, &key);
+    if (*slot)
+        return *slot - 1;
+
+    if (compiler->stringCount == compiler->stringCapacity) {
+        size_t capacity = compiler->stringCapacity ? compiler->stringCapacity * 2 : 256;
+        TKCompilerString *strings = (TKCompilerString *)realloc(compiler->strings, capacity * sizeof(TKCompilerString));
+        if (!strings) {
+            compiler->failed = true;
+            return 0;
+        }
+
+        compiler->strings = strings;
+        compiler->stringCapacity = capacity;
+    }
+
+    TKCompilerString *string = &compiler->strings[compiler->stringCount];
+    string->bucket = hash->value;
+    string->offset = (uint32_t)compiler->stringBytes.length;
+    string->length = (uint32_t)length;
+    string->hash = *hash;
+
+    if (!TKCompilerBufferAppend(&compiler->stringBytes, bytes, length)) {
+        compiler->failed = true;
+        return 0;
+    }
+
+    *slot = ++compiler->stringCount;
+    return compiler->stringCount - 1;
+}
+
+static uint32_t TKCompilerInternNumber(TKCompiler *compiler, double number, TKStructuralHash *hash) {
+    *hash = TKHashNumber(number);
+
+    if (!TKCompilerTableGrow(&compiler->numberTable, compiler->numberCount, compiler->numbers, sizeof(TKCompilerNumber))) {
+        compiler->failed = true;
+        return 0;
+    }
+
+    // The structural hash is the same for both zeroes, the bits are not
+    uint64_t bits;
+    memcpy(&bits, &number, sizeof(bits));
+
+    uint32_t *slot = TKCompilerTableSlot(compiler, &compiler->numberTable, bits ^ hash->value, TKCompilerNumberEqual, &number);
+    if (*slot)
+        return *slot - 1;
+
+    if (compiler->numberCount == compiler->numberCapacity) {
+        size_t capacity = compiler->numberCapacity ? compiler->numberCapacity * 2 : 256;
+        TKCompilerNumber *numbers = (TKCompilerNumber *)realloc(compiler->numbers, capacity * sizeof(TKCompilerNumber));
+        if (!numbers) {
+            compiler->failed = true;
+            return 0;
+        }
+
+        compiler->numbers = numbers;
+        compiler->numberCapacity = capacity;
+    }
+
+    compiler->numbers[compiler->numberCount].bucket = bits ^ hash->value;
+    compiler->numbers[compiler->numberCount].number = number;
+    *slot = ++compiler->numberCount;
+    return compiler->numberCount - 1;
+}
+
+#pragma mark - Nodes
+
+static void TKCompilerPush(TKCompiler *compiler, TKArchiveValue value, TKStructuralHash hash) {
+    if (compiler->itemCount == compiler->itemCapacity) {
+        size_t capacity = compiler->itemCapacity ? compiler->itemCapacity * 2 : 256;
+        TKCompilerItem *items = (TKCompilerItem *)realloc(compiler->items, capacity * sizeof(TKCompilerItem));
+        if (!items) {
+            compiler->failed = true;
+            return;
+        }
+
+        compiler->items = items;
+        compiler->itemCapacity = capacity;
+    }
+
+    TKCompilerItem *item = &compiler->items[compiler->itemCount];
+    item->value = value;
+    item->hash = hash;
+
+    if (compiler->depth > 0 && compiler->frames[compiler->depth - 1].isDictionary) {
+        TKCompilerFrame *frame = &compiler->frames[compiler->depth - 1];
+        item->key = frame->key;
+        item->order = (uint32_t)(compiler->itemCount - frame->start);
+    }
+
+    compiler->itemCount++;
+}
+
+// By the key bytes (the order the loader searches in), then by position
+static int TKCompilerCompareEntries(const void *first, const void *second) {
+    const TKCompilerItem *a = (const TKCompilerItem *)first;
+    const TKCompilerItem *b = (const TKCompilerItem *)second;
+
+    if (a->key != b->key) {
+        int result = memcmp(a->keyBytes, b->keyBytes, a->keyLength < b->keyLength ? a->keyLength : b->keyLength);
+        if (result != 0)
+            return result;
+        if (a->keyLength != b->keyLength)
+            return a->keyLength < b->keyLength ? -1 : 1;
+    }
+
+    return a->order < b->order ? -1 : (a->order > b->order ? 1 : 0);
+}
+
+// Replaces the items of the container with the container itself, its node written after all of its children
+static void TKCompilerEndContainer(TKCompiler *compiler) {
+    TKCompilerFrame *frame = &compiler->frames[--compiler->depth];
+    TKCompilerItem *items = compiler->items + frame->start;
+    size_t count = compiler->itemCount - frame->start;
+    uint64_t lanes[2] = { TKHashSeed[0], TKHashSeed[1] };
+
+    if (frame->isDictionary) {
+        lanes[0] = lanes[1] = 0;
+
+        for (size_t i = 0; i < count; i++) {
+            items[i].keyBytes = compiler->stringBytes.bytes + compiler->strings[items[i].key].offset;
+            items[i].keyLength = compiler->strings[items[i].key].length;
+        }
+
+        if (count > 1)
+            qsort(items, count, sizeof(TKCompilerItem), TKCompilerCompareEntries);
+
+        // Of duplicate keys only the last one stays
+        size_t unique = 0;
+        for (size_t i = 0; i < count; i++) {
+            if (i + 1 < count && items[i + 1].key == items[i].key)
+                continue;
+
+            items[unique++] = items[i];
+        }
+        count = unique;
+    }
+
+    uint32_t offset = (uint32_t)compiler->nodes.length;
+    uint32_t count32 = (uint32_t)count;
+    size_t entrySize = frame->isDictionary ? sizeof(TKArchiveEntry) : sizeof(TKArchiveValue);
+    if (compiler->nodes.length + kArchiveNodeHeaderSize + count * entrySize + 8 > UINT32_MAX ||
+        !TKCompilerBufferReserve(&compiler->nodes, kArchiveNodeHeaderSize + count * entrySize + 8)) {
+        compiler->failed = true;
+        return;
+    }
+
+    // The hash goes in front, it is written once the children are in
+    compiler->nodes.length += sizeof(TKStructuralHash);
+    TKCompilerBufferAppend(&compiler->nodes, &count32, sizeof(uint32_t));
+
+    for (size_t i = 0; i < count; i++) {
+        if (frame->isDictionary) {
+            TKArchiveEntry entry = { items[i].key, items[i].value };
+            TKCompilerBufferAppend(&compiler->nodes, &entry, sizeof(TKArchiveEntry));
+            TKHashAddEntry(lanes, compiler->strings[items[i].key].hash, items[i].hash);
+        } else {
+            TKCompilerBufferAppend(&compiler->nodes, &items[i].value, sizeof(TKArchiveValue));
+            TKHashAddElement(lanes, items[i].hash);
+        }
+    }
+
+    TKStructuralHash hash = TKHashFinishContainer(lanes, count, frame->isDictionary);
+    memcpy(compiler->nodes.bytes + offset, &hash, sizeof(TKStructuralHash));
+    TKCompilerBufferAlign(&compiler->nodes);
+
+    TKArchiveValue value = { frame->isDictionary ? TKArchiveValueDictionary : TKArchiveValueArray, offset };
+    compiler->itemCount = frame->start;
+    TKCompilerPush(compiler, value, hash);
+}
+
+static TKJSONAction TKCompilerEvent(const TKJSONEvent *event, void *context) {
+    TKCompiler *compiler = (TKCompiler *)context;
+    TKArchiveValue value = { TKArchiveValueNull, 0 };
+    TKStructuralHash hash;
+
+    switch (event->type) {
+        case TKJSONEventBeginObject:
+        case TKJSONEventBeginArray: {
+            TKCompilerFrame *frame = &compiler->frames[compiler->depth++];
+            frame->start = compiler->itemCount;
+            frame->isDictionary = (event->type == TKJSONEventBeginObject);
+            return TKJSONActionContinue;
+        }
+        case TKJSONEventEndObject:
+        case TKJSONEventEndArray:
+            TKCompilerEndContainer(compiler);
+            return compiler->failed ? TKJSONActionStop : TKJSONActionContinue;
+        case TKJSONEventKey:
+            compiler->frames[compiler->depth - 1].key = TKCompilerInternString(compiler, event->bytes, event->length, &hash);
+            return compiler->failed ? TKJSONActionStop : TKJSONActionContinue;
+        case TKJSONEventString:
+            value.type = TKArchiveValueString;
+            value.payload = TKCompilerInternString(compiler, event->bytes, event->length, &hash);
+            break;
+        case TKJSONEventNumber:
+            value.type = TKArchiveValueNumber;
+            value.payload = TKCompilerInternNumber(compiler, event->number, &hash);
+            break;
+        case TKJSONEventTrue:
+            value.type = TKArchiveValueTrue;
+            hash = TKHashNumber(1.0);
+            break;
+        case TKJSONEventFalse:
+            value.type = TKArchiveValueFalse;
+            hash = TKHashNumber(0.0);
+            break;
+        case TKJSONEventNull:
+            hash = TKHashNull();
+            break;
+    }
+
+    TKCompilerPush(compiler, value, hash);
+    return compiler->failed ? TKJSONActionStop : TKJSONActionContinue;
+}
+
+#pragma mark - Archive
+
+// Header, string table and bytes, numbers and nodes, in the order of TKThemeArchiveFormat.h
+static uint8_t *TKCompilerWriteArchive(TKCompiler *compiler, size_t *archiveLength) {
+    TKCompilerBuffer archive = { NULL, 0, 0 };
+
+    TKArchiveHeader header;
+    memset(&header, 0, sizeof(TKArchiveHeader));
+    memcpy(header.magic, TKArchiveMagic, 4);
+    header.version = kThemeArchiveVersion;
+    header.root = compiler->items[0].value;
+
+    header.stringCount = compiler->stringCount;
+    header.stringTableOffset = sizeof(TKArchiveHeader);
+    size_t stringBytesOffset = header.stringTableOffset + (size_t)compiler->stringCount * 2 * sizeof(uint32_t);
+    size_t numberTableOffset = (stringBytesOffset + compiler->stringBytes.length + 7) & ~(size_t)7;
+    size_t nodeOffset = numberTableOffset + (size_t)compiler->numberCount * sizeof(double);
+    size_t length = nodeOffset + compiler->nodes.length;
+
+    if (length > UINT32_MAX || !TKCompilerBufferReserve(&archive, length))
+        return NULL;
+
+    header.numberCount = compiler->numberCount;
+    header.numberTableOffset = (uint32_t)numberTableOffset;
+    header.nodeOffset = (uint32_t)nodeOffset;
+    header.nodeLength = (uint32_t)compiler->nodes.length;
+    TKCompilerBufferAppend(&archive, &header, sizeof(TKArchiveHeader));
+
+    for (uint32_t i = 0; i < compiler->stringCount; i++) {
+        uint32_t entry[2] = { (uint32_t)stringBytesOffset + compiler->strings[i].offset, compiler->strings[i].length };
+        TKCompilerBufferAppend(&archive, entry, sizeof(entry));
+    }
+
+    TKCompilerBufferAppend(&archive, compiler->stringBytes.bytes, compiler->stringBytes.length);
+    TKCompilerBufferAlign(&archive);
+
+    for (uint32_t i = 0; i < compiler->numberCount; i++) {
+        TKCompilerBufferAppend(&archive, &compiler->numbers[i].number, sizeof(double));
+    }
+
+    TKCompilerBufferAppend(&archive, compiler->nodes.bytes, compiler->nodes.length);
+
+    *archiveLength = archive.length;
+    return archive.bytes;
+}
+
+uint8_t *TKThemeCompile(const char *bytes, size_t length, size_t *archiveLength, size_t *errorOffset) {
+    TKCompiler *compiler = (TKCompiler *)calloc(1, sizeof(TKCompiler));
+    if (!compiler) {
+        if (errorOffset)
+            *errorOffset = length;
+        return NULL;
+    }
+
+    TKJSONReader reader;
+    TKJSONReaderInit(&reader);
+
+    size_t offset = 0;
+    uint8_t *archive = NULL;
+    if (TKJSONRead(&reader, bytes, length, TKCompilerEvent, compiler, &offset)) {
+        archive = TKCompilerWriteArchive(compiler, archiveLength);
+        offset = length;
+    } else if (compiler->failed) {
+        offset = length;
+    }
+
+    if (!archive && errorOffset)
+        *errorOffset = offset;
+
+    TKJSONReaderFree(&reader);
+    free(compiler->stringBytes.bytes);
+    free(compiler->strings);
+    free(compiler->stringTable.slots);
+    free(compiler->numbers);
+    free(compiler->numberTable.slots);
+    free(compiler->nodes.bytes);
+    free(compiler->items);
+    free(compiler);
+
+    return archive;
+}
@@ -0,0 +1,34 @@
+//
+//  TKThemeCompiler.h
+//  ThemeEngine
+//
+//  Compiles the JSON descriptions into archives (see TKThemeArchiveFormat.h) straight from the events of
+//  TKJSONReader, without creating any objects. Plain C, it builds into the tkc tool (Tools/tkc.c) that
+//  compiles the themes on the build machine, the same archives as -[ThemeKit compileJSONAtPath:toPath:]
+//
+//  Strings (keys, colours, path data, ...) and numbers are stored once each. Dictionaries keep the last of
+//  duplicate keys, like NSJSONSerialization does. Components (see TKComponents.h) are stored as they are
+//  written, the definitions once, and expanded when the archive is loaded
+//
+//  Copyright (c) 2012 __MyCompanyName__. All rights reserved.
+//
+
+#ifndef TKThemeCompiler_h
+#define TKThemeCompiler_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Archive of the JSON document in bytes (UTF-8, not NUL terminated), allocated with malloc. NULL if the JSON is
+// not valid, errorOffset (if not NULL) is then set to the offending byte, or to length if it ran out of memory
+uint8_t *TKThemeCompile(const char *bytes, size_t length, size_t *archiveLength, size_t *errorOffset);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
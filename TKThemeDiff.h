@@ -0,0 +1,56 @@
+//
+//  TKThemeDiff.h
+//  ThemeEngine
+//
+//  Structural diff between two descriptions of a theme, used to patch a view hierarchy that has
+//  already been built instead of building it again (see -[ThemeKit updateViewHierarchy:withJSON:bindings:])
+//
+//  The diff mirrors the new description, a node per view. Subviews are matched by their structural
+//  hash first (so unchanged and moved views are kept), the rest is paired up by position and type.
+//  Since hashes are remembered, unchanged subtrees are skipped without looking inside them
+//
+//  Copyright (c) 2012 __MyCompanyName__. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+typedef enum {
+    TKThemeDiffNone,            // Same description, the view is kept as it is
+    TKThemeDiffChildren,        // Only the subviews changed, see children and removedIndexes
+    TKThemeDiffUpdate,          // Own properties changed, the view can be redrawn in place (and the subviews patched)
+    TKThemeDiffReplace,         // The view has to be built again, along with its subviews
+    TKThemeDiffInsert           // New view, there is nothing to patch
+} TKThemeDiffType;
+
+@interface TKThemeDiff : NSObject {
+    TKThemeDiffType _type;
+    NSDictionary *_fromDescription;
+    NSDictionary *_toDescription;
+    NSUInteger _fromIndex;
+    NSArray *_children;
+    NSIndexSet *_removedIndexes;
+}
+
+// Diff of the outermost dictionaries of two themes
++ (TKThemeDiff *)diffFromDescription: (NSDictionary *)fromDescription toDescription: (NSDictionary *)toDescription;
+
+@property (nonatomic, readonly) TKThemeDiffType type;
+@property (nonatomic, readonly) NSDictionary *fromDescription;      // nil for inserts
+@property (nonatomic, readonly) NSDictionary *toDescription;
+
+// Index of the view among the subviews of the old parent, NSNotFound for inserts and the outermost view
+@property (nonatomic, readonly) NSUInteger fromIndex;
+
+// Diffs of the subviews, in the order of the new description. Only for TKThemeDiffChildren and TKThemeDiffUpdate
+@property (nonatomic, readonly) NSArray *children;
+
+// Subviews of the old description which are gone
+@property (nonatomic, readonly) NSIndexSet *removedIndexes;
+
+// Whether there is anything to patch at all
+- (BOOL)isEmpty;
+
+// Views that would be redrawn, rebuilt, inserted or removed by the patch (subviews of rebuilt views not included)
+- (NSUInteger)changedNodeCount;
+
+@end
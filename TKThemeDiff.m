@@ -0,0 +1,207 @@
+//
+//  TKThemeDiff.m
+//  ThemeEngine
+//
+//  Copyright (c) 2012 __MyCompanyName__. All rights reserved.
+//
+
+#import "TKThemeDiff.h"
+#import "TKConstants.h"
+#import "TKHash.h"
+
+@interface TKThemeDiff (Private)
+
+- (id)initWithType: (TKThemeDiffType)type fromDescription: (NSDictionary *)fromDescription toDescription: (NSDictionary *)toDescription fromIndex: (NSUInteger)index;
+- (void)diffSubviews;
+
+@end
+
+#pragma mark - Helpers
+
+// Hash of the description without its subviews, the properties of the view itself
+static TKStructuralHash TKThemeDiffOwnHash(NSDictionary *description) {
+    if (![description objectForKey: SubviewSectionKey])
+        return TKStructuralHashForObject(description);
+
+    NSMutableDictionary *properties = [description mutableCopy];
+    [properties removeObjectForKey: SubviewSectionKey];
+
+    // Not remembered, the copy is thrown away
+    TKStructuralHash hash = TKComputeStructuralHash(properties);
+    [properties release];
+
+    return hash;
+}
+
+// Labels and buttons are made of several views and images, those are always built again
+static BOOL TKThemeDiffCanUpdate(NSDictionary *fromDescription, NSDictionary *toDescription) {
+    NSString *type = [toDescription objectForKey: TypeParameterKey];
+    NSString *previousType = [fromDescription objectForKey: TypeParameterKey];
+
+    if (type != previousType && ![type isEqual: previousType])
+        return NO;
+
+    if ([type isEqualToString: LabelTypeKey] || [type isEqualToString: ButtonTypeKey])
+        return NO;
+
+    // A rectangle and a container are different views
+    return [[fromDescription objectForKey: ContainerParameterKey] boolValue] == [[toDescription objectForKey: ContainerParameterKey] boolValue];
+}
+
+static TKThemeDiffType TKThemeDiffTypeForDescriptions(NSDictionary *fromDescription, NSDictionary *toDescription) {
+    if (!fromDescription)
+        return TKThemeDiffInsert;
+
+    if (TKStructuralHashEqual(TKStructuralHashForObject(fromDescription), TKStructuralHashForObject(toDescription)))
+        return TKThemeDiffNone;
+
+    if (!TKThemeDiffCanUpdate(fromDescription, toDescription))
+        return TKThemeDiffReplace;
+
+    if (TKStructuralHashEqual(TKThemeDiffOwnHash(fromDescription), TKThemeDiffOwnHash(toDescription)))
+        return TKThemeDiffChildren;
+
+    return TKThemeDiffUpdate;
+}
+
+@implementation TKThemeDiff
+@synthesize type = _type;
+@synthesize fromDescription = _fromDescription;
+@synthesize toDescription = _toDescription;
+@synthesize fromIndex = _fromIndex;
+@synthesize children = _children;
+@synthesize removedIndexes = _removedIndexes;
+
++ (TKThemeDiff *)diffFromDescription: (NSDictionary *)fromDescription toDescription: (NSDictionary *)toDescription {
+    TKThemeDiffType type = TKThemeDiffTypeForDescriptions(fromDescription, toDescription);
+    return [[[TKThemeDiff alloc] initWithType: type fromDescription: fromDescription toDescription: toDescription fromIndex: NSNotFound] autorelease];
+}
+
+- (id)initWithType: (TKThemeDiffType)type fromDescription: (NSDictionary *)fromDescription toDescription: (NSDictionary *)toDescription fromIndex: (NSUInteger)index {
+    if ((self = [super init])) {
+        _type = type;
+        _fromDescription = [fromDescription retain];
+        _toDescription = [toDescription retain];
+        _fromIndex = index;
+
+        if (_type == TKThemeDiffChildren || _type == TKThemeDiffUpdate)
+            [self diffSubviews];
+    }
+
+    return self;
+}
+
+- (void)diffSubviews {
+    NSArray *fromSubviews = [_fromDescription objectForKey: SubviewSectionKey];
+    NSArray *toSubviews = [_toDescription objectForKey: SubviewSectionKey];
+    NSUInteger fromCount = [fromSubviews count];
+    NSUInteger toCount = [toSubviews count];
+
+    NSUInteger *matches = malloc(sizeof(NSUInteger) * MAX(toCount, 1));
+    BOOL *used = calloc(MAX(fromCount, 1), sizeof(BOOL));
+
+    // Old subviews by their hash, for the ones that moved
+    NSMutableDictionary *indexesByHash = [[NSMutableDictionary alloc] initWithCapacity: fromCount];
+    for (NSUInteger i = 0; i < fromCount; i++) {
+        NSNumber *key = [NSNumber numberWithUnsignedLongLong: TKStructuralHashForObject([fromSubviews objectAtIndex: i]).value];
+        NSMutableArray *indexes = [indexesByHash objectForKey: key];
+        if (!indexes) {
+            indexes = [NSMutableArray array];
+            [indexesByHash setObject: indexes forKey: key];
+        }
+
+        [indexes addObject: [NSNumber numberWithUnsignedInteger: i]];
+    }
+
+    // Unchanged subviews, at the same position first, then anywhere else
+    for (NSUInteger j = 0; j < toCount; j++) {
+        matches[j] = NSNotFound;
+
+        TKStructuralHash hash = TKStructuralHashForObject([toSubviews objectAtIndex: j]);
+        if (j < fromCount && TKStructuralHashEqual(hash, TKStructuralHashForObject([fromSubviews objectAtIndex: j]))) {
+            matches[j] = j;
+            used[j] = YES;
+        }
+    }
+
+    for (NSUInteger j = 0; j < toCount; j++) {
+        if (matches[j] != NSNotFound)
+            continue;
+
+        TKStructuralHash hash = TKStructuralHashForObject([toSubviews objectAtIndex: j]);
+        for (NSNumber *index in [indexesByHash objectForKey: [NSNumber numberWithUnsignedLongLong: hash.value]]) {
+            NSUInteger i = [index unsignedIntegerValue];
+            if (!used[i] && TKStructuralHashEqual(hash, TKStructuralHashForObject([fromSubviews objectAtIndex: i]))) {
+                matches[j] = i;
+                used[i] = YES;
+                break;
+            }
+        }
+    }
+
+    [indexesByHash release];
+
+    // What is left is either a changed subview in the same position, or a new one
+    NSMutableArray *children = [[NSMutableArray alloc] initWithCapacity: toCount];
+    for (NSUInteger j = 0; j < toCount; j++) {
+        NSDictionary *toSubview = [toSubviews objectAtIndex: j];
+        TKThemeDiff *child;
+
+        if (matches[j] != NSNotFound) {
+            child = [[TKThemeDiff alloc] initWithType: TKThemeDiffNone fromDescription: [fromSubviews objectAtIndex: matches[j]] toDescription: toSubview fromIndex: matches[j]];
+        } else if (j < fromCount && !used[j]) {
+            used[j] = YES;
+
+            NSDictionary *fromSubview = [fromSubviews objectAtIndex: j];
+            child = [[TKThemeDiff alloc] initWithType: TKThemeDiffTypeForDescriptions(fromSubview, toSubview) fromDescription: fromSubview toDescription: toSubview fromIndex: j];
+        } else {
+            child = [[TKThemeDiff alloc] initWithType: TKThemeDiffInsert fromDescription: nil toDescription: toSubview fromIndex: NSNotFound];
+        }
+
+        [children addObject: child];
+        [child release];
+    }
+
+    NSMutableIndexSet *removedIndexes = [[NSMutableIndexSet alloc] init];
+    for (NSUInteger i = 0; i < fromCount; i++) {
+        if (!used[i])
+            [removedIndexes addIndex: i];
+    }
+
+    _children = children;
+    _removedIndexes = removedIndexes;
+
+    free(matches);
+    free(used);
+}
+
+#pragma mark - Summary
+
+- (BOOL)isEmpty {
+    return _type == TKThemeDiffNone;
+}
+
+- (NSUInteger)changedNodeCount {
+    NSUInteger count = [_removedIndexes count];
+    if (_type == TKThemeDiffUpdate || _type == TKThemeDiffReplace || _type == TKThemeDiffInsert)
+        count++;
+
+    for (TKThemeDiff *child in _children) {
+        count += [child changedNodeCount];
+    }
+
+    return count;
+}
+
+#pragma mark - Memory management
+
+- (void)dealloc {
+    [_fromDescription release];
+    [_toDescription release];
+    [_children release];
+    [_removedIndexes release];
+
+    [super dealloc];
+}
+
+@end
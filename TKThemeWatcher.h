@@ -0,0 +1,38 @@
+//
+//  TKThemeWatcher.h
+//  ThemeEngine
+//
+//  Watches a theme file for changes (a kqueue vnode source), meant for tweaking themes while the app is
+//  running (i.e in the simulator, with the JSON in the project directory). Editors that save by writing
+//  a new file and renaming it over the old one are followed as well
+//
+//  Bursts of changes (a save is often several writes) are coalesced into a single call of the handler
+//
+//  Copyright (c) 2012 __MyCompanyName__. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+@class TKThemeWatcher;
+
+typedef void (^TKThemeWatcherHandler)(TKThemeWatcher *watcher);
+
+@interface TKThemeWatcher : NSObject {
+    NSString *_path;
+    TKThemeWatcherHandler _handler;
+
+    // Main queue only
+    dispatch_source_t _source;
+    BOOL _pending;
+    BOOL _stopped;
+}
+
+// Starts watching right away, the handler is called on the main thread after the file has changed
+- (id)initWithPath: (NSString *)path handler: (TKThemeWatcherHandler)handler;
+
+@property (nonatomic, readonly) NSString *path;
+
+// The handler is not called after this, the watcher also stops once it is released. Main thread only
+- (void)stop;
+
+@end
@@ -0,0 +1,115 @@
+//
+//  TKThemeWatcher.m
+//  ThemeEngine
+//
+//  Copyright (c) 2012 __MyCompanyName__. All rights reserved.
+//
+
+#import "TKThemeWatcher.h"
+
+#import <fcntl.h>
+
+// How long to wait for more changes before calling the handler, and before looking for a file that is gone
+static const NSTimeInterval TKThemeWatcherLatency = 0.1;
+static const NSTimeInterval TKThemeWatcherRetryInterval = 0.5;
+
+@interface TKThemeWatcher (Private)
+
+- (void)startSource;
+- (void)cancelSource;
+- (void)fileDidChange;
+
+@end
+
+@implementation TKThemeWatcher
+@synthesize path = _path;
+
+- (id)initWithPath: (NSString *)path handler: (TKThemeWatcherHandler)handler {
+    if ((self = [super init])) {
+        _path = [path copy];
+        _handler = [handler copy];
+
+        [self startSource];
+    }
+
+    return self;
+}
+
+- (void)startSource {
+    if (_stopped || _source)
+        return;
+
+    int descriptor = open([_path fileSystemRepresentation], O_EVTONLY);
+    if (descriptor < 0) {
+        // Most likely in the middle of a save, look again in a moment (retains the watcher until then)
+        dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(TKThemeWatcherRetryInterval * NSEC_PER_SEC)), dispatch_get_main_queue(), ^{
+            [self startSource];
+        });
+
+        return;
+    }
+
+    _source = dispatch_source_create(DISPATCH_SOURCE_TYPE_VNODE, descriptor,
+                                     DISPATCH_VNODE_WRITE | DISPATCH_VNODE_EXTEND | DISPATCH_VNODE_DELETE | DISPATCH_VNODE_RENAME,
+                                     dispatch_get_main_queue());
+
+    // Not retained by the handlers, the source is cancelled before the watcher goes away
+    __block TKThemeWatcher *watcher = self;
+
+    dispatch_source_set_event_handler(_source, ^{
+        unsigned long flags = dispatch_source_get_data(watcher->_source);
+
+        // The file was replaced, the descriptor still points to the old one
+        if (flags & (DISPATCH_VNODE_DELETE | DISPATCH_VNODE_RENAME)) {
+            [watcher cancelSource];
+            [watcher startSource];
+        }
+
+        [watcher fileDidChange];
+    });
+
+    dispatch_source_set_cancel_handler(_source, ^{
+        close(descriptor);
+    });
+
+    dispatch_resume(_source);
+}
+
+- (void)cancelSource {
+    if (!_source)
+        return;
+
+    dispatch_source_cancel(_source);
+    dispatch_release(_source);
+    _source = NULL;
+}
+
+- (void)fileDidChange {
+    if (_pending || _stopped)
+        return;
+
+    _pending = YES;
+    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(TKThemeWatcherLatency * NSEC_PER_SEC)), dispatch_get_main_queue(), ^{
+        _pending = NO;
+
+        if (!_stopped && _handler)
+            _handler(self);
+    });
+}
+
+- (void)stop {
+    _stopped = YES;
+    [self cancelSource];
+}
+
+#pragma mark - Memory management
+
+- (void)dealloc {
+    [self cancelSource];
+    [_path release];
+    [_handler release];
+
+    [super dealloc];
+}
+
+@end
@@ -8,16 +8,24 @@
 
 #import <UIKit/UIKit.h>
 #import "ThemeKit.h"
+#import "TKDisplayList.h"
 
 #pragma mark - Drawing block typedef
+// Called with the bounds of the view, the context is clipped to the dirty rect which can be read
+// back with CGContextGetClipBoundingBox() to skip the parts that do not need to be drawn
 typedef void (^TKDrawingBlock)(CGContextRef context, CGRect rect);
 
 @interface TKView : UIView {
     TKDrawingBlock drawBlock;
+    TKDisplayList *displayList;
 }
 
 @property (nonatomic, copy) TKDrawingBlock drawBlock;
 
+// Compiled drawing, if present, it is replayed instead of the drawing block
+@property (nonatomic, retain) TKDisplayList *displayList;
+
 + (TKView *)viewWithFrame: (CGRect)frame andDrawingBlock: (TKDrawingBlock)block;
++ (TKView *)viewWithFrame: (CGRect)frame andDisplayList: (TKDisplayList *)list;
 
 @end
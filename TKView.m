@@ -10,6 +10,7 @@
 
 @implementation TKView
 @synthesize drawBlock;
+@synthesize displayList;
 
 + (TKView *)viewWithFrame: (CGRect)frame andDrawingBlock: (TKDrawingBlock)block {
     TKView *view = [[TKView alloc] initWithFrame: frame];
@@ -18,6 +19,13 @@
     return [view autorelease];
 }
 
++ (TKView *)viewWithFrame: (CGRect)frame andDisplayList: (TKDisplayList *)list {
+    TKView *view = [[TKView alloc] initWithFrame: frame];
+    view.displayList = list;
+    
+    return [view autorelease];
+}
+
 #pragma mark - Drawing
 
 - (id)initWithFrame:(CGRect)frame {
@@ -36,10 +44,27 @@
     [self setNeedsDisplay];
 }
 
+- (void)setDisplayList: (TKDisplayList *)newDisplayList {
+    [newDisplayList retain];
+    [displayList release];
+    displayList = newDisplayList;
+    
+    // Redraw the view
+    [self setNeedsDisplay];
+}
+
 - (void)drawRect: (CGRect)rect {
-    // Check if drawing block is present, if so, use it
-    if (drawBlock) {
-        drawBlock(UIGraphicsGetCurrentContext(), rect);
+    CGContextRef context = UIGraphicsGetCurrentContext();
+
+    // Only the dirty part is redrawn, keep everything else as it is
+    CGContextClipToRect(context, rect);
+
+    // Prefer the compiled display list, then fall back to the drawing block. Both are laid out in the
+    // bounds, rect can be just a part of them after -setNeedsDisplayInRect:
+    if (displayList) {
+        [displayList drawInContext: context rect: self.bounds dirtyRect: rect];
+    } else if (drawBlock) {
+        drawBlock(context, self.bounds);
     }
 }
 
@@ -47,6 +72,7 @@
 
 - (void)dealloc {
     Block_release(drawBlock);
+    [displayList release];
     
     [super dealloc];
 }
@@ -0,0 +1,574 @@
+//
+//  TKJSONReaderTests.c
+//  ThemeEngine
+//
+//  Conformance of TKJSONReader against RFC 8259 - escapes, surrogate pairs, UTF-8 validation, nesting up to
+//  the limit, truncated input and the edge cases of numbers - and a fuzz run over mutated documents, which
+//  checks that the reader never reads past the input and that whatever it accepts reads back the same
+//
+//  Copyright (c) 2012 __MyCompanyName__. All rights reserved.
+//
+
+#include "TKTest.h"
+#include "TKJSONReader.h"
+
+#include <stdbool.h>
+
+#pragma mark - Traces
+
+// Events written out as text, i.e [ i1 s3:abc { k1:a t } ], bytes outside of printable ASCII as \xHH
+typedef struct {
+    char *bytes;
+    size_t length;
+    size_t capacity;
+
+    size_t stopAfter;           // Events, then TKJSONActionStop, 0 to never stop
+    size_t skipDepth;           // Containers this deep are skipped, 0 to never skip
+    size_t depth;
+    size_t events;
+} TKTrace;
+
+static void TKTraceAppend(TKTrace *trace, const char *format, ...) __attribute__((format(printf, 2, 3)));
+
+#include <stdarg.h>
+
+static void TKTraceAppend(TKTrace *trace, const char *format, ...) {
+    for (;;) {
+        va_list arguments;
+        va_start(arguments, format);
+        int written = vsnprintf(trace->bytes + trace->length, trace->capacity - trace->length, format, arguments);
+        va_end(arguments);
+
+        if (written >= 0 && (size_t)written < trace->capacity - trace->length) {
+            trace->length += (size_t)written;
+            return;
+        }
+
+        trace->capacity = trace->capacity * 2 + 256;
+        trace->bytes = (char *)realloc(trace->bytes, trace->capacity);
+    }
+}
+
+static void TKTraceAppendBytes(TKTrace *trace, const char *bytes, size_t length) {
+    TKTraceAppend(trace, "%zu:", length);
+    for (size_t i = 0; i < length; i++) {
+        uint8_t byte = (uint8_t)bytes[i];
+        if (byte >= 0x20 && byte < 0x7f && byte != '\\')
+            TKTraceAppend(trace, "%c", byte);
+        else
+            TKTraceAppend(trace, "\\x%02x", byte);
+    }
+}
+
+static TKJSONAction TKTraceEvent(const TKJSONEvent *event, void *context) {
+    TKTrace *trace = (TKTrace *)context;
+    if (trace->length > 0)
+        TKTraceAppend(trace, " ");
+
+    TKJSONAction action = TKJSONActionContinue;
+
+    switch (event->type) {
+        case TKJSONEventBeginObject:
+        case TKJSONEventBeginArray:
+            TKTraceAppend(trace, event->type == TKJSONEventBeginObject ? "{" : "[");
+            if (++trace->depth == trace->skipDepth) {
+                TKTraceAppend(trace, "skip");
+                action = TKJSONActionSkip;
+            }
+            break;
+        case TKJSONEventEndObject:
+        case TKJSONEventEndArray:
+            TKTraceAppend(trace, event->type == TKJSONEventEndObject ? "}" : "]");
+            trace->depth--;
+            break;
+        case TKJSONEventKey:
+            TKTraceAppend(trace, "k");
+            TKTraceAppendBytes(trace, event->bytes, event->length);
+            break;
+        case TKJSONEventString:
+            TKTraceAppend(trace, "s");
+            TKTraceAppendBytes(trace, event->bytes, event->length);
+            break;
+        case TKJSONEventNumber:
+            if (event->isInteger)
+                TKTraceAppend(trace, "i%lld", (long long)event->integer);
+            else
+                TKTraceAppend(trace, "d%.17g", event->number);
+            break;
+        case TKJSONEventTrue:
+            TKTraceAppend(trace, "t");
+            break;
+        case TKJSONEventFalse:
+            TKTraceAppend(trace, "f");
+            break;
+        case TKJSONEventNull:
+            TKTraceAppend(trace, "n");
+            break;
+    }
+
+    if (++trace->events == trace->stopAfter)
+        return TKJSONActionStop;
+
+    return action;
+}
+
+static void TKTraceInit(TKTrace *trace) {
+    memset(trace, 0, sizeof(TKTrace));
+    trace->capacity = 256;
+    trace->bytes = (char *)malloc(trace->capacity);
+    trace->bytes[0] = '\0';
+}
+
+// Reads the bytes, which are copied first so that reading past them is caught by the sanitizers
+static bool TKTraceRead(TKTrace *trace, TKJSONReader *reader, const char *bytes, size_t length, size_t *errorOffset) {
+    char *copy = (char *)malloc(length ? length : 1);
+    memcpy(copy, bytes, length);
+
+    bool result = TKJSONRead(reader, copy, length, TKTraceEvent, trace, errorOffset);
+    free(copy);
+
+    return result;
+}
+
+#pragma mark - Checks
+
+static void TKCheckJSON(const char *json, size_t length, bool expectedResult, size_t expectedErrorOffset, const char *expectedTrace, int line) {
+    TKJSONReader reader;
+    TKJSONReaderInit(&reader);
+    TKTrace trace;
+    TKTraceInit(&trace);
+
+    size_t errorOffset = (size_t)-1;
+    bool result = TKTraceRead(&trace, &reader, json, length, &errorOffset);
+
+    TKTestCheck(result == expectedResult, "line %d: %s %s", line, json, result ? "parsed" : "failed");
+    if (!result && !expectedResult)
+        TKTestCheck(errorOffset == expectedErrorOffset, "line %d: %s failed at %zu, expected %zu", line, json, errorOffset, expectedErrorOffset);
+    if (expectedTrace)
+        TKTestCheck(strcmp(trace.bytes, expectedTrace) == 0, "line %d: %s read as \"%s\", expected \"%s\"", line, json, trace.bytes, expectedTrace);
+
+    free(trace.bytes);
+    TKJSONReaderFree(&reader);
+}
+
+#define TKCheckReads(json, trace) TKCheckJSON(json, strlen(json), true, 0, trace, __LINE__)
+#define TKCheckFails(json, offset) TKCheckJSON(json, strlen(json), false, offset, NULL, __LINE__)
+
+// Number read from a document of just the number
+static TKJSONEvent TKReadNumber(const char *json) {
+    TKJSONEvent result;
+    memset(&result, 0, sizeof(TKJSONEvent));
+
+    TKJSONReader reader;
+    TKJSONReaderInit(&reader);
+    TKTrace trace;
+    TKTraceInit(&trace);
+
+    TKTestCheck(TKTraceRead(&trace, &reader, json, strlen(json), NULL), "%s did not parse", json);
+    if (trace.bytes[0] == 'i') {
+        result.isInteger = true;
+        result.integer = strtoll(trace.bytes + 1, NULL, 10);
+        result.number = (double)result.integer;
+    } else if (trace.bytes[0] == 'd') {
+        result.number = strtod(trace.bytes + 1, NULL);
+    }
+
+    free(trace.bytes);
+    TKJSONReaderFree(&reader);
+    return result;
+}
+
+#define TKCheckInteger(json, expected) do {                                                             \
+    TKJSONEvent event = TKReadNumber(json);                                                             \
+    TKTestCheck(event.isInteger && event.integer == (expected), "%s read as %s %.17g", json,            \
+                event.isInteger ? "integer" : "double", event.number);                                  \
+} while (0)
+
+#define TKCheckDouble(json, expected) do {                                                              \
+    TKJSONEvent event = TKReadNumber(json);                                                             \
+    TKTestCheck(!event.isInteger && (event.number == (expected) || (isnan(event.number) && isnan(expected))), \
+                "%s read as %s %.17g, expected %.17g", json, event.isInteger ? "integer" : "double", event.number, (double)(expected)); \
+} while (0)
+
+#pragma mark - Structure
+
+static void TestStructure(void) {
+    TKCheckReads("[]", "[ ]");
+    TKCheckReads("{}", "{ }");
+    TKCheckReads(" \t\r\n[ 1 , true,false ,null ] \n", "[ i1 t f n ]");
+    TKCheckReads("{\"a\":{\"b\":[{}]},\"c\":\"d\"}", "{ k1:a { k1:b [ { } ] } k1:c s1:d }");
+
+    // Any value at the top
+    TKCheckReads("1", "i1");
+    TKCheckReads("\"x\"", "s1:x");
+    TKCheckReads("true", "t");
+    TKCheckReads(" null ", "n");
+
+    // Duplicate keys are passed on as they are
+    TKCheckReads("{\"a\":1,\"a\":2}", "{ k1:a i1 k1:a i2 }");
+
+    TKCheckFails("", 0);
+    TKCheckFails("   ", 3);
+    TKCheckFails("[1,]", 3);
+    TKCheckFails("[,1]", 1);
+    TKCheckFails("{\"a\":1,}", 7);
+    TKCheckFails("{\"a\" 1}", 5);
+    TKCheckFails("{\"a\":}", 5);
+    TKCheckFails("{1:2}", 1);
+    TKCheckFails("{'a':1}", 1);
+    TKCheckFails("[1 2]", 3);
+    TKCheckFails("[}", 1);
+    TKCheckFails("{]", 1);
+    TKCheckFails("[]]", 2);
+    TKCheckFails("[] []", 3);
+    TKCheckFails("tru", 0);
+    TKCheckFails("True", 0);
+    TKCheckFails("nul", 0);
+    TKCheckFails("[truex]", 5);
+    TKCheckFails("\xef\xbb\xbf[]", 0);          // No byte order mark
+    TKCheckJSON("[1]\0", 4, false, 3, NULL, __LINE__);
+}
+
+#pragma mark - Strings
+
+static void TestEscapes(void) {
+    TKCheckReads("\"\\\"\\\\\\/\\b\\f\\n\\r\\t\"", "s8:\"\\x5c/\\x08\\x0c\\x0a\\x0d\\x09");
+    TKCheckReads("\"\\u0041\\u00e9\\u20AC\"", "s6:A\\xc3\\xa9\\xe2\\x82\\xac");
+    TKCheckReads("\"a\\u0000b\"", "s3:a\\x00b");
+    TKCheckReads("{\"\\u006b\":\"\\\\u0041\"}", "{ k1:k s6:\\x5cu0041 }");
+    TKCheckReads("\"\"", "s0:");
+
+    // Without escapes the bytes are the input itself
+    TKCheckReads("\"plain text\"", "s10:plain text");
+
+    TKCheckFails("\"\\x\"", 1);
+    TKCheckFails("\"\\U0041\"", 1);
+    TKCheckFails("\"\\u12G4\"", 1);
+    TKCheckFails("\"\\u12\"", 1);
+    TKCheckFails("\"ab\\", 4);
+    TKCheckFails("\"ab\\\"", 5);
+    TKCheckFails("\"a\tb\"", 2);                 // Control characters have to be escaped
+    TKCheckFails("\"a\nb\"", 2);
+    TKCheckFails("\"a\x01\"", 2);
+    TKCheckFails("[\"a\\ \"]", 3);
+}
+
+static void TestSurrogates(void) {
+    TKCheckReads("\"\\ud83d\\ude00\"", "s4:\\xf0\\x9f\\x98\\x80");
+    TKCheckReads("\"\\uD834\\uDD1E\"", "s4:\\xf0\\x9d\\x84\\x9e");
+    TKCheckReads("\"\\udbff\\udfff\"", "s4:\\xf4\\x8f\\xbf\\xbf");
+    TKCheckReads("\"\\ud800\\udc00x\"", "s5:\\xf0\\x90\\x80\\x80x");
+
+    // Lone or broken pairs
+    TKCheckFails("\"\\ud83d\"", 1);
+    TKCheckFails("\"\\ude00\"", 1);
+    TKCheckFails("\"\\ud83dx\"", 1);
+    TKCheckFails("\"\\ud83d\\u0041\"", 1);
+    TKCheckFails("\"\\ud83d\\ud83d\"", 1);
+    TKCheckFails("\"\\ud83d\\n\"", 1);
+    TKCheckFails("\"x\\ud83d\\ude0\"", 2);
+
+    // Raw UTF-8 is passed as it is, as long as it is valid
+    TKCheckReads("\"\xc3\xa9\xe2\x82\xac\xf0\x9f\x98\x80\"", "s9:\\xc3\\xa9\\xe2\\x82\\xac\\xf0\\x9f\\x98\\x80");
+    TKCheckFails("\"\xc0\x80\"", 1);             // Overlong
+    TKCheckFails("\"\xe0\x80\x80\"", 1);
+    TKCheckFails("\"\xf0\x80\x80\x80\"", 1);
+    TKCheckFails("\"\xed\xa0\x80\"", 1);         // Encoded surrogate
+    TKCheckFails("\"\xf4\x90\x80\x80\"", 1);     // Past U+10FFFF
+    TKCheckFails("\"\xf5\x80\x80\x80\"", 1);
+    TKCheckFails("\"a\x80\"", 2);                // Stray continuation
+    TKCheckFails("\"a\xc3\"", 2);                // Cut short
+    TKCheckFails("\"a\xe2\x82", 2);
+}
+
+#pragma mark - Nesting
+
+static void TestNesting(void) {
+    size_t limit = kJSONReaderMaximumDepth;
+    char *json = (char *)malloc(6 * limit + 3);
+
+    // Exactly at the limit
+    memset(json, '[', limit);
+    memset(json + limit, ']', limit);
+    TKCheckJSON(json, 2 * limit, true, 0, NULL, __LINE__);
+
+    // One past it fails at the opening bracket that is too deep
+    memset(json, '[', limit + 1);
+    memset(json + limit + 1, ']', limit + 1);
+    TKCheckJSON(json, 2 * limit + 2, false, limit, NULL, __LINE__);
+
+    // Objects and arrays mixed, at the limit
+    size_t length = 0;
+    for (size_t i = 0; i < limit; i++) {
+        length += (size_t)sprintf(json + length, i % 2 ? "[" : "{\"\":");
+    }
+    for (size_t i = limit; i > 0; i--) {
+        json[length++] = (i - 1) % 2 ? ']' : '}';
+    }
+    TKCheckJSON(json, length, true, 0, NULL, __LINE__);
+
+    // Unbalanced deep inside
+    json[length - limit / 2] = json[length - limit / 2] == ']' ? '}' : ']';
+    TKCheckJSON(json, length, false, length - limit / 2, NULL, __LINE__);
+
+    free(json);
+}
+
+static void TestSkipAndStop(void) {
+    TKJSONReader reader;
+    TKJSONReaderInit(&reader);
+
+    // Only the begin and end of a skipped container, but it is still checked
+    TKTrace trace;
+    TKTraceInit(&trace);
+    trace.skipDepth = 2;
+    const char *json = "[1,{\"a\":[1,2,{\"b\":\"\\u00e9\"}]},[3],4]";
+    TKTestCheck(TKTraceRead(&trace, &reader, json, strlen(json), NULL), "skipped document did not parse");
+    TKTestCheck(strcmp(trace.bytes, "[ i1 {skip } [skip ] i4 ]") == 0, "skipped read as \"%s\"", trace.bytes);
+    free(trace.bytes);
+
+    TKTraceInit(&trace);
+    trace.skipDepth = 2;
+    size_t errorOffset = 0;
+    json = "[{\"a\":[1,2,\"\\ud800\"]}]";
+    TKTestCheck(!TKTraceRead(&trace, &reader, json, strlen(json), &errorOffset) && errorOffset == 12,
+                "broken skipped container failed at %zu", errorOffset);
+    free(trace.bytes);
+
+    // Stopping fails at the event
+    TKTraceInit(&trace);
+    trace.stopAfter = 3;
+    json = "[1, 22, 333]";
+    TKTestCheck(!TKTraceRead(&trace, &reader, json, strlen(json), &errorOffset) && errorOffset == 4, "stop failed at %zu", errorOffset);
+    TKTestCheck(strcmp(trace.bytes, "[ i1 i22") == 0, "stopped read as \"%s\"", trace.bytes);
+    free(trace.bytes);
+
+    TKJSONReaderFree(&reader);
+}
+
+#pragma mark - Truncation
+
+static void TestTruncated(void) {
+    const char *json = "{\"title\" : \"Theme-1\", \"size\" : {\"width\" : 165, \"height\" : 32.5e-1},\n"
+                       "\"subviews\" : [{\"type\" : \"rectangle\", \"color\" : \"#168fdd\", \"is-container\" : true,\n"
+                       "\"content-string\" : \"\\u00e9t\\u00e9 \\ud83d\\ude00 \xe2\x82\xac\", \"alpha\" : -0.60, \"x\" : null, \"y\" : false}]}";
+    size_t length = strlen(json);
+
+    TKCheckJSON(json, length, true, 0, NULL, __LINE__);
+
+    // No prefix is a document, each one fails at or before its end
+    TKJSONReader reader;
+    TKJSONReaderInit(&reader);
+    for (size_t prefix = 0; prefix < length; prefix++) {
+        TKTrace trace;
+        TKTraceInit(&trace);
+
+        size_t errorOffset = (size_t)-1;
+        bool result = TKTraceRead(&trace, &reader, json, prefix, &errorOffset);
+        TKTestCheck(!result && errorOffset <= prefix, "prefix of %zu bytes %s at %zu", prefix, result ? "parsed" : "failed", errorOffset);
+
+        free(trace.bytes);
+    }
+
+    TKJSONReaderFree(&reader);
+}
+
+#pragma mark - Numbers
+
+static void TestNumbers(void) {
+    TKCheckInteger("0", 0);
+    TKCheckInteger("-0", 0);
+    TKCheckInteger("7", 7);
+    TKCheckInteger("-12", -12);
+    TKCheckInteger("123456789012345678", 123456789012345678LL);
+    TKCheckInteger("9223372036854775807", INT64_MAX);
+    TKCheckInteger("-9223372036854775808", INT64_MIN);
+    TKCheckInteger("1000000000000000000", 1000000000000000000LL);
+
+    // Past 64 bits, or with a fraction or exponent, they are doubles
+    TKCheckDouble("9223372036854775808", 9223372036854775808.0);
+    TKCheckDouble("-9223372036854775809", -9223372036854775809.0);
+    TKCheckDouble("12345678901234567890", 12345678901234567890.0);
+    TKCheckDouble("123456789012345678901234567890", 1.2345678901234568e29);
+    TKCheckDouble("1.0", 1.0);
+    TKCheckDouble("1.5", 1.5);
+    TKCheckDouble("-0.25", -0.25);
+    TKCheckDouble("0.1", 0.1);
+    TKCheckDouble("1e3", 1000.0);
+    TKCheckDouble("1E+2", 100.0);
+    TKCheckDouble("1e-2", 0.01);
+    TKCheckDouble("-2.5E-3", -0.0025);
+    TKCheckDouble("0e0", 0.0);
+    TKCheckDouble("1.7976931348623157e308", 1.7976931348623157e308);
+    TKCheckDouble("4.9406564584124654e-324", 4.9406564584124654e-324);
+    TKCheckDouble("1e400", HUGE_VAL);
+    TKCheckDouble("-1e400", -HUGE_VAL);
+    TKCheckDouble("1e-400", 0.0);
+
+    TKCheckReads("[-0.0,1e1,0.5]", "[ d-0 d10 d0.5 ]");
+
+    TKCheckFails("01", 1);
+    TKCheckFails("[01]", 2);
+    TKCheckFails("-01", 2);
+    TKCheckFails("-", 1);
+    TKCheckFails("-a", 1);
+    TKCheckFails("[-]", 2);
+    TKCheckFails("1.", 2);
+    TKCheckFails("1.e3", 2);
+    TKCheckFails(".5", 0);
+    TKCheckFails("+1", 0);
+    TKCheckFails("1e", 2);
+    TKCheckFails("1e+", 3);
+    TKCheckFails("1E-x", 3);
+    TKCheckFails("0x10", 1);
+    TKCheckFails("Infinity", 0);
+    TKCheckFails("-Infinity", 1);
+    TKCheckFails("NaN", 0);
+    TKCheckFails("1 2", 2);
+}
+
+#pragma mark - Fuzz
+
+// Writes the events back as JSON, which has to read back into the same events
+static TKJSONAction TKWriteEvent(const TKJSONEvent *event, void *context) {
+    TKTrace *output = (TKTrace *)context;
+    char last = output->length ? output->bytes[output->length - 1] : '\0';
+    bool separator = last != '\0' && last != '[' && last != '{' && last != ':';
+
+    if (event->type == TKJSONEventEndObject || event->type == TKJSONEventEndArray) {
+        TKTraceAppend(output, event->type == TKJSONEventEndObject ? "}" : "]");
+        return TKJSONActionContinue;
+    }
+
+    if (separator)
+        TKTraceAppend(output, ",");
+
+    switch (event->type) {
+        case TKJSONEventBeginObject:
+            TKTraceAppend(output, "{");
+            break;
+        case TKJSONEventBeginArray:
+            TKTraceAppend(output, "[");
+            break;
+        case TKJSONEventKey:
+        case TKJSONEventString:
+            TKTraceAppend(output, "\"");
+            for (size_t i = 0; i < event->length; i++) {
+                uint8_t byte = (uint8_t)event->bytes[i];
+                if (byte < 0x20 || byte == '"' || byte == '\\')
+                    TKTraceAppend(output, "\\u%04x", byte);
+                else
+                    TKTraceAppend(output, "%c", byte);
+            }
+            TKTraceAppend(output, event->type == TKJSONEventKey ? "\":" : "\"");
+            break;
+        case TKJSONEventNumber:
+            if (event->isInteger)
+                TKTraceAppend(output, "%lld", (long long)event->integer);
+            else if (isinf(event->number))
+                TKTraceAppend(output, "%s", event->number > 0 ? "1e999" : "-1e999");
+            else
+                TKTraceAppend(output, "%.17e", event->number);
+            break;
+        case TKJSONEventTrue:
+            TKTraceAppend(output, "true");
+            break;
+        case TKJSONEventFalse:
+            TKTraceAppend(output, "false");
+            break;
+        case TKJSONEventNull:
+            TKTraceAppend(output, "null");
+            break;
+        default:
+            break;
+    }
+
+    return TKJSONActionContinue;
+}
+
+static void TestFuzz(void) {
+    static const char *seeds[] = {
+        "{\"a\":[1,-2.5e3,\"x\\u00e9\\ud83d\\ude00\",true,false,null,{\"b\":{}}],\"c\":\"\\\"\\\\\\n\"}",
+        "[[[[[]]]],{\"\":0},\"\xe2\x82\xac\",12345678901234567890,-0.0]",
+        "{\"title\":\"Theme\",\"size\":{\"width\":165,\"height\":32},\"subviews\":[{\"type\":\"ellipse\",\"alpha\":0.53}]}",
+    };
+    static const char alphabet[] = "{}[]\":,\\u0123456789abcdefABCDEF-+.eEtrufalsn \t\n\x80\xc3\xa9\xed\xf0";
+
+    TKJSONReader reader;
+    TKJSONReaderInit(&reader);
+    uint64_t state = 0x853c49e6748fea9bULL;
+    int accepted = 0;
+
+    for (int iteration = 0; iteration < 100000; iteration++) {
+        const char *seed = seeds[iteration % 3];
+        size_t length = strlen(seed);
+        char json[256];
+        memcpy(json, seed, length);
+
+        // A few bytes replaced, inserted or removed
+        int mutations = 1 + (int)(TKTestRandom(&state) % 4);
+        for (int m = 0; m < mutations && length > 0; m++) {
+            size_t at = TKTestRandom(&state) % length;
+            char byte = alphabet[TKTestRandom(&state) % (sizeof(alphabet) - 1)];
+            switch (TKTestRandom(&state) % 3) {
+                case 0:
+                    json[at] = byte;
+                    break;
+                case 1:
+                    if (length < sizeof(json)) {
+                        memmove(json + at + 1, json + at, length - at);
+                        json[at] = byte;
+                        length++;
+                    }
+                    break;
+                default:
+                    memmove(json + at, json + at + 1, length - at - 1);
+                    length--;
+                    break;
+            }
+        }
+
+        TKTrace trace;
+        TKTraceInit(&trace);
+        size_t errorOffset = (size_t)-1;
+        bool result = TKTraceRead(&trace, &reader, json, length, &errorOffset);
+
+        if (!result) {
+            TKTestCheck(errorOffset <= length, "error at %zu past %zu bytes", errorOffset, length);
+        } else {
+            accepted++;
+
+            // Read back what was written from the events
+            TKTrace output;
+            TKTraceInit(&output);
+            TKTestCheck(TKJSONRead(&reader, json, length, TKWriteEvent, &output, NULL), "second read failed");
+
+            TKTrace again;
+            TKTraceInit(&again);
+            TKTestCheck(TKTraceRead(&again, &reader, output.bytes, output.length, NULL), "written back \"%s\" did not parse", output.bytes);
+            TKTestCheck(strcmp(trace.bytes, again.bytes) == 0, "written back \"%s\" reads as \"%s\", expected \"%s\"", output.bytes, again.bytes, trace.bytes);
+
+            free(output.bytes);
+            free(again.bytes);
+        }
+
+        free(trace.bytes);
+    }
+
+    // Most mutations break the document, but not all of them
+    TKTestCheck(accepted > 1000, "only %d mutated documents parsed", accepted);
+    TKJSONReaderFree(&reader);
+}
+
+int main(void) {
+    TKTestRun(TestStructure);
+    TKTestRun(TestEscapes);
+    TKTestRun(TestSurrogates);
+    TKTestRun(TestNesting);
+    TKTestRun(TestSkipAndStop);
+    TKTestRun(TestTruncated);
+    TKTestRun(TestNumbers);
+    TKTestRun(TestFuzz);
+
+    return TKTestResult();
+}
@@ -0,0 +1,433 @@
+//
+//  TKPathParserTests.c
+//  ThemeEngine
+//
+//  Conformance of TKPathParser against the SVG path grammar, and a fuzz run over random and mutated
+//  path data, which checks that the parser never reads past the data and stops exactly at the errors
+//
+//  Copyright (c) 2012 __MyCompanyName__. All rights reserved.
+//
+
+#include "TKTest.h"
+#include "TKPathParser.h"
+
+#define M TKPathOperationMoveTo
+#define L TKPathOperationLineTo
+#define C TKPathOperationCubicTo
+#define Q TKPathOperationQuadTo
+#define Z TKPathOperationClose
+
+// Parses string, checks the result, the error offset (if it fails) and the operations. Coordinates are checked
+// only if expectedCoordinates is not NULL
+static void TKCheckPath(const char *string, bool expectedResult, size_t expectedErrorOffset, const uint8_t *expectedOperations,
+                        size_t operationCount, const double *expectedCoordinates, int line) {
+    TKPathBuffer buffer;
+    TKPathBufferInit(&buffer);
+
+    size_t errorOffset = (size_t)-1;
+    bool result = TKPathParse(string, strlen(string), &buffer, &errorOffset);
+
+    TKTestCheck(result == expectedResult, "line %d: \"%s\" %s", line, string, result ? "parsed" : "failed");
+    if (!result && !expectedResult)
+        TKTestCheck(errorOffset == expectedErrorOffset, "line %d: \"%s\" failed at %zu, expected %zu", line, string, errorOffset, expectedErrorOffset);
+
+    TKTestCheck(buffer.operationCount == operationCount, "line %d: \"%s\" has %zu operations, expected %zu", line, string, buffer.operationCount, operationCount);
+
+    size_t coordinate = 0;
+    for (size_t i = 0; i < buffer.operationCount && i < operationCount; i++) {
+        TKTestCheck(buffer.operations[i] == expectedOperations[i], "line %d: \"%s\" operation %zu is %d, expected %d", line, string, i,
+                    buffer.operations[i], expectedOperations[i]);
+
+        for (uint8_t j = 0; expectedCoordinates && j < TKPathOperationCoordinateCount[expectedOperations[i]]; j++, coordinate++) {
+            TKTestCheck(coordinate < buffer.coordinateCount &&
+                        fabs(buffer.coordinates[coordinate] - expectedCoordinates[coordinate]) <= 1e-9 * fmax(1.0, fabs(expectedCoordinates[coordinate])),
+                        "line %d: \"%s\" coordinate %zu is %.17g, expected %.17g", line, string, coordinate,
+                        coordinate < buffer.coordinateCount ? buffer.coordinates[coordinate] : NAN, expectedCoordinates[coordinate]);
+        }
+    }
+
+    TKPathBufferFree(&buffer);
+}
+
+#define TKCheckParses(string, operations, coordinates) \
+    TKCheckPath(string, true, 0, operations, sizeof(operations), coordinates, __LINE__)
+
+#define TKCheckFails(string, offset, operations, coordinates) \
+    TKCheckPath(string, false, offset, operations, sizeof(operations), coordinates, __LINE__)
+
+#define TKCheckParsesNothing(string) \
+    TKCheckPath(string, true, 0, NULL, 0, NULL, __LINE__)
+
+#define TKCheckFailsWithNothing(string, offset) \
+    TKCheckPath(string, false, offset, NULL, 0, NULL, __LINE__)
+
+// Both have to parse into exactly the same buffer
+static void TKCheckSamePath(const char *string, const char *otherString, int line) {
+    TKPathBuffer buffer, otherBuffer;
+    TKPathBufferInit(&buffer);
+    TKPathBufferInit(&otherBuffer);
+
+    bool result = TKPathParse(string, strlen(string), &buffer, NULL);
+    bool otherResult = TKPathParse(otherString, strlen(otherString), &otherBuffer, NULL);
+
+    TKTestCheck(result && otherResult, "line %d: \"%s\" or \"%s\" did not parse", line, string, otherString);
+    TKTestCheck(buffer.operationCount == otherBuffer.operationCount && buffer.coordinateCount == otherBuffer.coordinateCount &&
+                memcmp(buffer.operations, otherBuffer.operations, buffer.operationCount) == 0,
+                "line %d: \"%s\" and \"%s\" have different operations", line, string, otherString);
+
+    for (size_t i = 0; i < buffer.coordinateCount && i < otherBuffer.coordinateCount; i++) {
+        TKTestCheck(fabs(buffer.coordinates[i] - otherBuffer.coordinates[i]) < 1e-9, "line %d: \"%s\" and \"%s\" differ at coordinate %zu",
+                    line, string, otherString, i);
+    }
+
+    TKPathBufferFree(&buffer);
+    TKPathBufferFree(&otherBuffer);
+}
+
+#define TKCheckSame(string, otherString) \
+    TKCheckSamePath(string, otherString, __LINE__)
+
+#pragma mark - Grammar
+
+static void TestCommands(void) {
+    TKCheckParses("M10 20 L30 40 Z", ((uint8_t[]){ M, L, Z }), ((double[]){ 10, 20, 30, 40 }));
+    TKCheckParses("m10 20 l5 5 z", ((uint8_t[]){ M, L, Z }), ((double[]){ 10, 20, 15, 25 }));
+    TKCheckParses("M1 2 H5 V7 h-1 v-1", ((uint8_t[]){ M, L, L, L, L }), ((double[]){ 1, 2, 5, 2, 5, 7, 4, 7, 4, 6 }));
+    TKCheckParses("M0 0 C1 2 3 4 5 6 c1 1 2 2 3 3", ((uint8_t[]){ M, C, C }),
+                  ((double[]){ 0, 0, 1, 2, 3, 4, 5, 6, 6, 7, 7, 8, 8, 9 }));
+    TKCheckParses("M0 0 Q1 2 3 4 q1 1 2 2", ((uint8_t[]){ M, Q, Q }), ((double[]){ 0, 0, 1, 2, 3, 4, 4, 5, 5, 6 }));
+
+    // Close moves back to the start of the subpath, relative commands continue from there
+    TKCheckParses("M10 10 l10 0 z l0 10", ((uint8_t[]){ M, L, Z, L }), ((double[]){ 10, 10, 20, 10, 10, 20 }));
+    TKCheckParses("M1 1 Z M5 5 z m1 1", ((uint8_t[]){ M, Z, M, Z, M }), ((double[]){ 1, 1, 5, 5, 6, 6 }));
+
+    // Empty data is an empty path
+    TKCheckParsesNothing("");
+    TKCheckParsesNothing(" \t\r\n,");
+
+    // Separators are optional wherever the grammar allows it
+    TKCheckSame("M 10 , 20 L 30 , 40 C 1 , 2 , 3 , 4 , 5 , 6 Z", "M10,20L30,40C1,2,3,4,5,6Z");
+    TKCheckSame("M10 20L30 40", "M10,20\nL30\t40");
+}
+
+static void TestImplicitCommands(void) {
+    // Pairs after a moveto are linetos, relative ones after a relative moveto
+    TKCheckParses("M0 0 10 0 10 10", ((uint8_t[]){ M, L, L }), ((double[]){ 0, 0, 10, 0, 10, 10 }));
+    TKCheckParses("m1 1 2 2 3 3", ((uint8_t[]){ M, L, L }), ((double[]){ 1, 1, 3, 3, 6, 6 }));
+
+    // Any other command repeats itself
+    TKCheckParses("M0 0 L1 1 2 2 3 3", ((uint8_t[]){ M, L, L, L }), ((double[]){ 0, 0, 1, 1, 2, 2, 3, 3 }));
+    TKCheckParses("M0 0 h1 1 1", ((uint8_t[]){ M, L, L, L }), ((double[]){ 0, 0, 1, 0, 2, 0, 3, 0 }));
+    TKCheckParses("M0 0 c0 0 1 1 2 2 0 0 1 1 2 2", ((uint8_t[]){ M, C, C }),
+                  ((double[]){ 0, 0, 0, 0, 1, 1, 2, 2, 2, 2, 3, 3, 4, 4 }));
+    TKCheckParses("M0 0 a1 1 0 0 1 2 0 1 1 0 0 1 2 0", ((uint8_t[]){ M, C, C, C, C }), NULL);
+}
+
+static void TestReflection(void) {
+    // The first control point of S is the reflection of the second one of the preceding cubic
+    TKCheckParses("M0 0 C10 0 20 10 20 20 S30 40 40 40", ((uint8_t[]){ M, C, C }),
+                  ((double[]){ 0, 0, 10, 0, 20, 10, 20, 20, 20, 30, 30, 40, 40, 40 }));
+    TKCheckParses("M0 0 C10 0 20 10 20 20 s10 20 20 20", ((uint8_t[]){ M, C, C }),
+                  ((double[]){ 0, 0, 10, 0, 20, 10, 20, 20, 20, 30, 30, 40, 40, 40 }));
+
+    // Repeated S reflect each other
+    TKCheckParses("M0 0 S10 10 20 0 30 -10 40 0", ((uint8_t[]){ M, C, C }),
+                  ((double[]){ 0, 0, 0, 0, 10, 10, 20, 0, 30, -10, 30, -10, 40, 0 }));
+
+    // Without a preceding cubic it is the current point, a quadratic does not count
+    TKCheckParses("M5 5 S10 10 20 0", ((uint8_t[]){ M, C }), ((double[]){ 5, 5, 5, 5, 10, 10, 20, 0 }));
+    TKCheckParses("M0 0 Q10 10 20 0 S30 10 40 0", ((uint8_t[]){ M, Q, C }),
+                  ((double[]){ 0, 0, 10, 10, 20, 0, 20, 0, 30, 10, 40, 0 }));
+
+    // Same for T and quadratic curves, T after T keeps reflecting
+    TKCheckParses("M0 0 Q10 10 20 0 T40 0 T60 0", ((uint8_t[]){ M, Q, Q, Q }),
+                  ((double[]){ 0, 0, 10, 10, 20, 0, 30, -10, 40, 0, 50, 10, 60, 0 }));
+    TKCheckParses("M0 0 q10 10 20 0 t20 0", ((uint8_t[]){ M, Q, Q }), ((double[]){ 0, 0, 10, 10, 20, 0, 30, -10, 40, 0 }));
+    TKCheckParses("M5 5 T20 0", ((uint8_t[]){ M, Q }), ((double[]){ 5, 5, 5, 5, 20, 0 }));
+    TKCheckParses("M0 0 C0 0 10 10 20 0 T40 0", ((uint8_t[]){ M, C, Q }), ((double[]){ 0, 0, 0, 0, 10, 10, 20, 0, 20, 0, 40, 0 }));
+}
+
+static void TestNumbers(void) {
+    // Signs and dots separate numbers, commas and any whitespace are the same
+    TKCheckParses("M-.5-.5L.5.5", ((uint8_t[]){ M, L }), ((double[]){ -0.5, -0.5, 0.5, 0.5 }));
+    TKCheckParses("M+1,+2\tL\n3\r4", ((uint8_t[]){ M, L }), ((double[]){ 1, 2, 3, 4 }));
+    TKCheckParses("M10-20", ((uint8_t[]){ M }), ((double[]){ 10, -20 }));
+    TKCheckParses("M0.1 0.2", ((uint8_t[]){ M }), ((double[]){ 0.1, 0.2 }));
+    TKCheckParses("M1. 2.", ((uint8_t[]){ M }), ((double[]){ 1, 2 }));
+
+    // Exponents in both cases and with signs, an 'e' without digits is not part of the number
+    TKCheckParses("M1e2 -1.5E-1", ((uint8_t[]){ M }), ((double[]){ 100, -0.15 }));
+    TKCheckParses("M1e+2 2.5e1", ((uint8_t[]){ M }), ((double[]){ 100, 25 }));
+    TKCheckParses("M0 0 L1e-3-1e-3", ((uint8_t[]){ M, L }), ((double[]){ 0, 0, 0.001, -0.001 }));
+    TKCheckFails("M0 0 L1e 2", 5, ((uint8_t[]){ M }), ((double[]){ 0, 0 }));
+
+    // Correctly rounded, also with more digits than fit into the mantissa
+    TKCheckParses("M123.456 0.000001", ((uint8_t[]){ M }), ((double[]){ 123.456, 0.000001 }));
+    TKCheckParses("M12345678901234567890 0.1234567890123456789012", ((uint8_t[]){ M }), ((double[]){ 12345678901234567890.0, 0.1234567890123456789 }));
+    TKCheckParses("M1e-30 1e30", ((uint8_t[]){ M }), ((double[]){ 1e-30, 1e30 }));
+}
+
+#pragma mark - Arcs
+
+// Distance of the point from the ellipse (unit circle after undoing the center, rotation and radii)
+static double TKEllipseError(double x, double y, double cx, double cy, double rx, double ry, double degrees) {
+    double phi = degrees * 3.14159265358979323846 / 180.0;
+    double dx = x - cx, dy = y - cy;
+    double ux = (cos(phi) * dx + sin(phi) * dy) / rx;
+    double uy = (-sin(phi) * dx + cos(phi) * dy) / ry;
+
+    return fabs(sqrt(ux * ux + uy * uy) - 1.0);
+}
+
+// Checks that every curve of the arc starts, ends and passes through its middle on the ellipse
+static void TKCheckArc(const char *string, size_t expectedCurves, double endX, double endY, double cx, double cy, double rx, double ry, double degrees, int line) {
+    TKPathBuffer buffer;
+    TKPathBufferInit(&buffer);
+
+    bool result = TKPathParse(string, strlen(string), &buffer, NULL);
+    TKTestCheck(result, "line %d: \"%s\" did not parse", line, string);
+    TKTestCheck(buffer.operationCount == expectedCurves + 1, "line %d: \"%s\" has %zu curves, expected %zu", line, string,
+                buffer.operationCount - 1, expectedCurves);
+
+    double x = buffer.coordinates[0], y = buffer.coordinates[1];
+    const double *curve = buffer.coordinates + 2;
+    for (size_t i = 1; i < buffer.operationCount; i++, curve += 6) {
+        TKTestCheck(buffer.operations[i] == C, "line %d: \"%s\" operation %zu is not a curve", line, string, i);
+
+        // Point at t = 0.5
+        double mx = 0.125 * x + 0.375 * curve[0] + 0.375 * curve[2] + 0.125 * curve[4];
+        double my = 0.125 * y + 0.375 * curve[1] + 0.375 * curve[3] + 0.125 * curve[5];
+
+        TKTestCheck(TKEllipseError(curve[4], curve[5], cx, cy, rx, ry, degrees) < 1e-9, "line %d: \"%s\" curve %zu ends off the ellipse", line, string, i);
+        TKTestCheck(TKEllipseError(mx, my, cx, cy, rx, ry, degrees) < 1e-3, "line %d: \"%s\" curve %zu strays from the ellipse", line, string, i);
+
+        x = curve[4];
+        y = curve[5];
+    }
+
+    TKTestCheck(x == endX && y == endY, "line %d: \"%s\" ends at %g %g", line, string, x, y);
+    TKPathBufferFree(&buffer);
+}
+
+#define TKCheckArcs(string, curves, endX, endY, cx, cy, rx, ry, degrees) \
+    TKCheckArc(string, curves, endX, endY, cx, cy, rx, ry, degrees, __LINE__)
+
+static void TestArcs(void) {
+    // Half circles, sweep picks the side, the large arc flag does not matter for exactly half
+    TKCheckArcs("M0 0 A10 10 0 0 1 20 0", 2, 20, 0, 10, 0, 10, 10, 0);
+    TKCheckArcs("M0 0 A10 10 0 1 0 20 0", 2, 20, 0, 10, 0, 10, 10, 0);
+
+    // Relative arcs end relative to the current point, and give the same curves as the absolute ones
+    TKCheckArcs("M5 5 a10 10 0 0 1 20 0", 2, 25, 5, 15, 5, 10, 10, 0);
+    TKCheckSame("M5 5 a10 10 0 0 1 20 0", "M5 5 A10 10 0 0 1 25 5");
+    TKCheckSame("M5 5 l5 5 a10 20 30 1 0 15 -5", "M5 5 L10 10 A10 20 30 1 0 25 5");
+
+    // Quarter circle, small and large arc around the two possible centers
+    TKCheckArcs("M10 0 A10 10 0 0 1 0 10", 1, 0, 10, 0, 0, 10, 10, 0);
+    TKCheckArcs("M10 0 A10 10 0 1 1 0 10", 3, 0, 10, 10, 10, 10, 10, 0);
+    TKCheckArcs("M10 0 a10 10 0 1 1 -10 10", 3, 0, 10, 10, 10, 10, 10, 0);
+
+    // Rotated ellipse, radii too small to reach the endpoint are scaled up
+    TKCheckArcs("M0 0 A20 10 90 0 1 0 40", 2, 0, 40, 0, 20, 20, 10, 90);
+    TKCheckArcs("M0 0 A1 1 0 0 1 20 0", 2, 20, 0, 10, 0, 10, 10, 0);
+    TKCheckArcs("M0 0 A1 2 0 0 1 20 0", 2, 20, 0, 10, 0, 10, 20, 0);
+
+    // Flags don't need separators, negative radii are used as positive ones
+    TKCheckArcs("M0 0 A10 10 0 0120 0", 2, 20, 0, 10, 0, 10, 10, 0);
+    TKCheckArcs("M0 0 a-10-10 0 0 1 20 0", 2, 20, 0, 10, 0, 10, 10, 0);
+
+    // Zero radius is a line, same endpoints leave the arc out
+    TKCheckParses("M0 0 A0 10 0 0 1 20 0", ((uint8_t[]){ M, L }), ((double[]){ 0, 0, 20, 0 }));
+    TKCheckParses("M5 5 A10 10 0 0 1 5 5", ((uint8_t[]){ M }), ((double[]){ 5, 5 }));
+    TKCheckParses("M5 5 a10 10 0 0 1 0 0 l1 0", ((uint8_t[]){ M, L }), ((double[]){ 5, 5, 6, 5 }));
+
+    // Flags are a single 0 or 1
+    TKCheckFails("M0 0 A10 10 0 2 1 20 0", 5, ((uint8_t[]){ M }), ((double[]){ 0, 0 }));
+    TKCheckFails("M0 0 A10 10 0 0 1 20", 5, ((uint8_t[]){ M }), ((double[]){ 0, 0 }));
+}
+
+#pragma mark - Errors
+
+static void TestMalformed(void) {
+    // The path has to start with a moveto
+    TKCheckFailsWithNothing("L10 10", 0);
+    TKCheckFailsWithNothing("10 10", 0);
+    TKCheckFailsWithNothing("Z", 0);
+
+    // Missing coordinates, the error is at the start of the segment and everything before it is kept
+    TKCheckFailsWithNothing("M10", 0);
+    TKCheckFails("M0 0 L10", 5, ((uint8_t[]){ M }), ((double[]){ 0, 0 }));
+    TKCheckFails("M0 0 L1 1 2", 10, ((uint8_t[]){ M, L }), ((double[]){ 0, 0, 1, 1 }));
+    TKCheckFails("M0 0 C1 1 2 2 3", 5, ((uint8_t[]){ M }), ((double[]){ 0, 0 }));
+    TKCheckFailsWithNothing("M.", 0);
+    TKCheckFails("M0 0 L- 1", 5, ((uint8_t[]){ M }), ((double[]){ 0, 0 }));
+
+    // Unknown commands, numbers after a close and stray characters
+    TKCheckFails("M0 0 X1 1", 5, ((uint8_t[]){ M }), ((double[]){ 0, 0 }));
+    TKCheckFails("M0 0 Z 1 1", 7, ((uint8_t[]){ M, Z }), ((double[]){ 0, 0 }));
+    TKCheckFails("M0 0 L1 1 #", 10, ((uint8_t[]){ M, L }), ((double[]){ 0, 0, 1, 1 }));
+    TKCheckFails("M0 0 L1 1 \xC3\xA9", 10, ((uint8_t[]){ M, L }), ((double[]){ 0, 0, 1, 1 }));
+}
+
+static void TestNotNulTerminated(void) {
+    // Only length bytes are read, the numbers end where the data ends
+    const char data[] = "M1 2 L3 45678";
+
+    TKPathBuffer buffer;
+    TKPathBufferInit(&buffer);
+
+    TKTestCheck(TKPathParse(data, 9, &buffer, NULL), "prefix did not parse");
+    TKTestCheck(buffer.operationCount == 2 && buffer.coordinates[3] == 4, "last coordinate %g", buffer.coordinates[3]);
+
+    TKPathBufferFree(&buffer);
+}
+
+static void TestBufferReuse(void) {
+    TKPathBuffer buffer;
+    TKPathBufferInit(&buffer);
+
+    // Growing past the initial capacities, then reset keeps the storage
+    char data[16384];
+    size_t length = (size_t)sprintf(data, "M0 0");
+    for (int i = 0; i < 1000; i++) {
+        length += (size_t)sprintf(data + length, " l%d %d", i % 7, i % 5);
+    }
+
+    TKTestCheck(TKPathParse(data, length, &buffer, NULL), "long path did not parse");
+    TKTestCheck(buffer.operationCount == 1001 && buffer.coordinateCount == 2002, "%zu operations", buffer.operationCount);
+
+    double *coordinates = buffer.coordinates;
+    TKPathBufferReset(&buffer);
+    TKTestCheck(TKPathParse("M1 1", 4, &buffer, NULL) && buffer.operationCount == 1, "reset buffer");
+    TKTestCheck(buffer.coordinates == coordinates, "storage was not kept");
+
+    // Appending by hand
+    double point[2] = { 7, 8 };
+    TKTestCheck(TKPathBufferAppend(&buffer, TKPathOperationLineTo, point) && buffer.operationCount == 2 && buffer.coordinates[3] == 8, "append");
+
+    TKPathBufferFree(&buffer);
+}
+
+#pragma mark - Fuzzing
+
+static const char TKFuzzAlphabet[] = "MmLlHhVvCcSsQqTtAaZz0123456789012345678901234567890123456789..--+eE  ,,\t";
+
+// Operations and coordinates have to add up, on errors the data up to the error has to parse into the same buffer
+static void TKCheckFuzzedPath(const char *data, size_t length, TKPathBuffer *buffer, TKPathBuffer *prefixBuffer) {
+    TKPathBufferReset(buffer);
+
+    size_t errorOffset = (size_t)-1;
+    bool result = TKPathParse(data, length, buffer, &errorOffset);
+
+    size_t coordinates = 0;
+    for (size_t i = 0; i < buffer->operationCount; i++) {
+        TKTestCheck(buffer->operations[i] <= TKPathOperationClose, "operation %d", buffer->operations[i]);
+        coordinates += TKPathOperationCoordinateCount[buffer->operations[i] <= TKPathOperationClose ? buffer->operations[i] : 0];
+    }
+    TKTestCheck(coordinates == buffer->coordinateCount, "%zu coordinates for the operations, %zu in the buffer", coordinates, buffer->coordinateCount);
+    TKTestCheck(buffer->operationCount == 0 || buffer->operations[0] == TKPathOperationMoveTo, "path does not start with a moveto");
+
+    if (result)
+        return;
+
+    TKTestCheck(errorOffset < length, "error at %zu of %zu", errorOffset, length);
+    if (errorOffset >= length)
+        return;
+
+    TKPathBufferReset(prefixBuffer);
+    bool prefixResult = TKPathParse(data, errorOffset, prefixBuffer, NULL);
+
+    TKTestCheck(prefixResult, "data up to the error at %zu did not parse: \"%.*s\"", errorOffset, (int)length, data);
+    TKTestCheck(prefixBuffer->operationCount == buffer->operationCount && prefixBuffer->coordinateCount == buffer->coordinateCount &&
+                memcmp(prefixBuffer->operations, buffer->operations, buffer->operationCount) == 0 &&
+                memcmp(prefixBuffer->coordinates, buffer->coordinates, buffer->coordinateCount * sizeof(double)) == 0,
+                "data up to the error at %zu parsed differently: \"%.*s\"", errorOffset, (int)length, data);
+}
+
+static void TestFuzz(void) {
+    static const char *const seeds[] = {
+        "M10 20 L30 40 Z",
+        "M0 0 C10 0 20 10 20 20 S30 40 40 40 s10 10 20 0",
+        "m1 1 2 2 3 3 h4 v5 H6 V7 z",
+        "M0 0 Q10 10 20 0 T40 0 t20 0 q1 1 2 2",
+        "M0 0 A10 10 0 0 1 20 0 a5 5 30 1 0 10 10 A1 1 0 0120 0",
+        "M-.5-.5L.5.5l1e2-1E-2,3.25e+1 4",
+    };
+
+    TKPathBuffer buffer, prefixBuffer;
+    TKPathBufferInit(&buffer);
+    TKPathBufferInit(&prefixBuffer);
+
+    uint64_t state = 0x9e3779b97f4a7c15ULL;
+    char data[256];
+    int failures = TKTestFailures;
+
+    for (int iteration = 0; iteration < 200000 && TKTestFailures - failures < 10; iteration++) {
+        size_t length;
+        uint32_t kind = TKTestRandom(&state) % 3;
+
+        if (kind == 0) {
+            // Random characters of the grammar
+            length = TKTestRandom(&state) % 64;
+            for (size_t i = 0; i < length; i++) {
+                data[i] = TKFuzzAlphabet[TKTestRandom(&state) % (sizeof(TKFuzzAlphabet) - 1)];
+            }
+        } else if (kind == 1) {
+            // Random bytes behind a valid start
+            length = 4 + TKTestRandom(&state) % 32;
+            memcpy(data, "M0 0", 4);
+            for (size_t i = 4; i < length; i++) {
+                data[i] = (char)(TKTestRandom(&state) & 0xFF);
+            }
+        } else {
+            // A valid path with a few characters replaced, inserted or removed
+            const char *seed = seeds[TKTestRandom(&state) % (sizeof(seeds) / sizeof(seeds[0]))];
+            length = strlen(seed);
+            memcpy(data, seed, length);
+
+            int mutations = 1 + (int)(TKTestRandom(&state) % 4);
+            for (int i = 0; i < mutations && length > 0 && length < sizeof(data) - 1; i++) {
+                size_t position = TKTestRandom(&state) % length;
+                char character = TKFuzzAlphabet[TKTestRandom(&state) % (sizeof(TKFuzzAlphabet) - 1)];
+
+                switch (TKTestRandom(&state) % 3) {
+                    case 0:
+                        data[position] = character;
+                        break;
+                    case 1:
+                        memmove(data + position + 1, data + position, length - position);
+                        data[position] = character;
+                        length++;
+                        break;
+                    default:
+                        memmove(data + position, data + position + 1, length - position - 1);
+                        length--;
+                        break;
+                }
+            }
+        }
+
+        // Exactly length bytes, so that reading past the end shows up under a memory checker
+        char *copy = (char *)malloc(length ? length : 1);
+        memcpy(copy, data, length);
+        TKCheckFuzzedPath(copy, length, &buffer, &prefixBuffer);
+        free(copy);
+    }
+
+    TKPathBufferFree(&buffer);
+    TKPathBufferFree(&prefixBuffer);
+}
+
+int main(void) {
+    TKTestRun(TestCommands);
+    TKTestRun(TestImplicitCommands);
+    TKTestRun(TestReflection);
+    TKTestRun(TestNumbers);
+    TKTestRun(TestArcs);
+    TKTestRun(TestMalformed);
+    TKTestRun(TestNotNulTerminated);
+    TKTestRun(TestBufferReuse);
+    TKTestRun(TestFuzz);
+
+    return TKTestResult();
+}
@@ -0,0 +1,608 @@
+//
+//  TKRasterizerTests.c
+//  ThemeEngine
+//
+//  Checks of TKRasterizer - coverage, fill rules, blend modes, alpha, gradients, shadows and clipping against
+//  values worked out by hand, and whole scenes against the golden images in Golden/. Built twice, with the
+//  SIMD kernels and with TK_RASTER_NO_SIMD, both builds have to match the same goldens
+//
+//      TKRasterizerTests <golden directory> [--update]
+//
+//  --update writes the goldens instead of comparing with them, look at the images before committing them.
+//  They are PAM files (RGB_ALPHA), with the premultiplied pixels of the surface
+//
+//  Copyright (c) 2012 __MyCompanyName__. All rights reserved.
+//
+
+#include "TKTest.h"
+#include "TKRasterizer.h"
+
+// Largest difference of a channel from the golden, covers the rounding differences between the kernels
+#define kGoldenTolerance 2
+
+static const TKRasterColor TKRed = { 1.0f, 0.0f, 0.0f, 1.0f };
+static const TKRasterColor TKGreen = { 0.0f, 1.0f, 0.0f, 1.0f };
+static const TKRasterColor TKBlue = { 0.0f, 0.0f, 1.0f, 1.0f };
+static const TKRasterColor TKWhite = { 1.0f, 1.0f, 1.0f, 1.0f };
+static const TKRasterColor TKBlack = { 0.0f, 0.0f, 0.0f, 1.0f };
+
+#pragma mark - Helpers
+
+static inline int TKAlpha(uint32_t pixel) { return (int)(pixel >> 24); }
+static inline int TKRedOf(uint32_t pixel) { return (int)((pixel >> 16) & 0xff); }
+static inline int TKGreenOf(uint32_t pixel) { return (int)((pixel >> 8) & 0xff); }
+static inline int TKBlueOf(uint32_t pixel) { return (int)(pixel & 0xff); }
+
+static uint32_t TKPixel(const TKRasterSurface *surface, int x, int y) {
+    return *(const uint32_t *)((const uint8_t *)surface->pixels + surface->bytesPerRow * (size_t)y + (size_t)x * 4);
+}
+
+#define TKCheckPixel(surface, x, y, a, r, g, b, tolerance) do {                                                             \
+    uint32_t pixel = TKPixel(surface, x, y);                                                                                \
+    TKTestCheck(abs(TKAlpha(pixel) - (a)) <= (tolerance) && abs(TKRedOf(pixel) - (r)) <= (tolerance) &&                     \
+                abs(TKGreenOf(pixel) - (g)) <= (tolerance) && abs(TKBlueOf(pixel) - (b)) <= (tolerance),                    \
+                "pixel %d,%d is %d %d %d %d, expected %d %d %d %d", x, y, TKAlpha(pixel), TKRedOf(pixel), TKGreenOf(pixel), \
+                TKBlueOf(pixel), a, r, g, b);                                                                               \
+} while (0)
+
+typedef struct {
+    TKRasterSurface surface;
+    TKRasterContext context;
+    TKPathBuffer path;
+} TKCanvas;
+
+static void TKCanvasInit(TKCanvas *canvas, int width, int height) {
+    TKRasterSurfaceInit(&canvas->surface, width, height);
+    TKRasterContextInit(&canvas->context, &canvas->surface);
+    TKPathBufferInit(&canvas->path);
+}
+
+static void TKCanvasFree(TKCanvas *canvas) {
+    TKPathBufferFree(&canvas->path);
+    TKRasterContextFree(&canvas->context);
+    TKRasterSurfaceFree(&canvas->surface);
+}
+
+// Replaces the path of the canvas with the SVG path data
+static const TKPathBuffer *TKCanvasPath(TKCanvas *canvas, const char *data) {
+    TKPathBufferReset(&canvas->path);
+    if (!TKPathParse(data, strlen(data), &canvas->path, NULL))
+        fprintf(stderr, "Path \"%s\" did not parse\n", data);
+
+    return &canvas->path;
+}
+
+static const TKPathBuffer *TKCanvasRect(TKCanvas *canvas, double x, double y, double width, double height) {
+    TKPathBufferReset(&canvas->path);
+    TKRasterPathAddRect(&canvas->path, x, y, width, height);
+
+    return &canvas->path;
+}
+
+static double TKCoverageSum(const TKRasterSurface *surface) {
+    double sum = 0.0;
+    for (int y = 0; y < surface->height; y++) {
+        for (int x = 0; x < surface->width; x++) {
+            sum += TKAlpha(TKPixel(surface, x, y)) / 255.0;
+        }
+    }
+
+    return sum;
+}
+
+#pragma mark - Coverage
+
+static void TestAlignedRect(void) {
+    TKCanvas canvas;
+    TKCanvasInit(&canvas, 16, 16);
+
+    TKRasterContextFillPath(&canvas.context, TKCanvasRect(&canvas, 4, 4, 8, 8), TKRasterFillNonZero, TKRed);
+
+    // Whole pixels only, nothing bleeds out
+    TKCheckPixel(&canvas.surface, 4, 4, 255, 255, 0, 0, 0);
+    TKCheckPixel(&canvas.surface, 11, 11, 255, 255, 0, 0, 0);
+    TKCheckPixel(&canvas.surface, 3, 4, 0, 0, 0, 0, 0);
+    TKCheckPixel(&canvas.surface, 12, 11, 0, 0, 0, 0, 0);
+    TKCheckPixel(&canvas.surface, 4, 12, 0, 0, 0, 0, 0);
+    TKTestCheckClose(TKCoverageSum(&canvas.surface), 64.0, 1e-9);
+
+    TKCanvasFree(&canvas);
+}
+
+static void TestPartialCoverage(void) {
+    TKCanvas canvas;
+    TKCanvasInit(&canvas, 16, 16);
+
+    // Half pixels on the left and top, a quarter in the corner
+    TKRasterContextFillPath(&canvas.context, TKCanvasRect(&canvas, 2.5, 2.5, 4.5, 4.5), TKRasterFillNonZero, TKWhite);
+
+    TKCheckPixel(&canvas.surface, 2, 4, 128, 128, 128, 128, 1);
+    TKCheckPixel(&canvas.surface, 4, 2, 128, 128, 128, 128, 1);
+    TKCheckPixel(&canvas.surface, 2, 2, 64, 64, 64, 64, 1);
+    TKCheckPixel(&canvas.surface, 4, 4, 255, 255, 255, 255, 0);
+    TKTestCheckClose(TKCoverageSum(&canvas.surface), 4.5 * 4.5, 0.1);
+
+    TKCanvasFree(&canvas);
+}
+
+static void TestCircleArea(void) {
+    TKCanvas canvas;
+    TKCanvasInit(&canvas, 64, 64);
+
+    TKPathBufferReset(&canvas.path);
+    TKRasterPathAddEllipse(&canvas.path, 7.3, 5.1, 48, 48);
+    TKRasterContextFillPath(&canvas.context, &canvas.path, TKRasterFillNonZero, TKBlue);
+
+    // Flattened to within a fifth of a pixel, the polygon is inside of the circle and a little smaller
+    double area = 3.14159265358979 * 24.0 * 24.0;
+    TKTestCheck(fabs(TKCoverageSum(&canvas.surface) - area) / area < 0.015, "coverage %g, area %g", TKCoverageSum(&canvas.surface), area);
+    TKCheckPixel(&canvas.surface, 31, 29, 255, 0, 0, 255, 0);
+    TKCheckPixel(&canvas.surface, 8, 6, 0, 0, 0, 0, 0);
+
+    TKCanvasFree(&canvas);
+}
+
+static void TestFillRules(void) {
+    // Two squares in the same direction, the inner one is a hole only with even-odd
+    const char *squares = "M2 2 H30 V30 H2 Z M10 10 H22 V22 H10 Z";
+
+    TKCanvas canvas;
+    TKCanvasInit(&canvas, 32, 32);
+    TKRasterContextFillPath(&canvas.context, TKCanvasPath(&canvas, squares), TKRasterFillNonZero, TKGreen);
+    TKCheckPixel(&canvas.surface, 16, 16, 255, 0, 255, 0, 0);
+    TKCheckPixel(&canvas.surface, 5, 16, 255, 0, 255, 0, 0);
+    TKCanvasFree(&canvas);
+
+    TKCanvasInit(&canvas, 32, 32);
+    TKRasterContextFillPath(&canvas.context, TKCanvasPath(&canvas, squares), TKRasterFillEvenOdd, TKGreen);
+    TKCheckPixel(&canvas.surface, 16, 16, 0, 0, 0, 0, 0);
+    TKCheckPixel(&canvas.surface, 5, 16, 255, 0, 255, 0, 0);
+    TKCanvasFree(&canvas);
+
+    // The inner square the other way around is a hole with both rules
+    TKCanvasInit(&canvas, 32, 32);
+    TKRasterContextFillPath(&canvas.context, TKCanvasPath(&canvas, "M2 2 H30 V30 H2 Z M10 10 V22 H22 V10 Z"), TKRasterFillNonZero, TKGreen);
+    TKCheckPixel(&canvas.surface, 16, 16, 0, 0, 0, 0, 0);
+    TKCanvasFree(&canvas);
+}
+
+static void TestStroke(void) {
+    TKCanvas canvas;
+    TKCanvasInit(&canvas, 32, 32);
+
+    // 4 wide, centered on y = 10, butt caps end at the points
+    TKRasterContextSetLineWidth(&canvas.context, 4.0f);
+    TKRasterContextStrokePath(&canvas.context, TKCanvasPath(&canvas, "M4 10 H28"), TKBlack);
+
+    TKCheckPixel(&canvas.surface, 16, 8, 255, 0, 0, 0, 0);
+    TKCheckPixel(&canvas.surface, 16, 11, 255, 0, 0, 0, 0);
+    TKCheckPixel(&canvas.surface, 16, 7, 0, 0, 0, 0, 0);
+    TKCheckPixel(&canvas.surface, 16, 12, 0, 0, 0, 0, 0);
+    TKCheckPixel(&canvas.surface, 3, 10, 0, 0, 0, 0, 0);
+    TKTestCheckClose(TKCoverageSum(&canvas.surface), 24.0 * 4.0, 0.1);
+
+    // Square caps extend by half the width
+    TKRasterContextSetLineCap(&canvas.context, TKRasterLineCapSquare);
+    TKRasterContextStrokePath(&canvas.context, TKCanvasPath(&canvas, "M4 20 H28"), TKBlack);
+    TKCheckPixel(&canvas.surface, 2, 20, 255, 0, 0, 0, 0);
+    TKCheckPixel(&canvas.surface, 29, 20, 255, 0, 0, 0, 0);
+
+    TKCanvasFree(&canvas);
+}
+
+#pragma mark - Compositing
+
+static void TestAlpha(void) {
+    TKCanvas canvas;
+    TKCanvasInit(&canvas, 8, 8);
+
+    // Context alpha and color alpha multiply
+    TKRasterContextSetAlpha(&canvas.context, 0.5f);
+    TKRasterColor color = { 1.0f, 1.0f, 1.0f, 0.5f };
+    TKRasterContextFillPath(&canvas.context, TKCanvasRect(&canvas, 0, 0, 8, 8), TKRasterFillNonZero, color);
+    TKCheckPixel(&canvas.surface, 3, 3, 64, 64, 64, 64, 1);
+
+    // Source over onto it
+    TKRasterContextSetAlpha(&canvas.context, 1.0f);
+    TKRasterColor red = { 1.0f, 0.0f, 0.0f, 0.5f };
+    TKRasterContextFillPath(&canvas.context, TKCanvasRect(&canvas, 0, 0, 8, 8), TKRasterFillNonZero, red);
+    TKCheckPixel(&canvas.surface, 3, 3, 128 + 32, 128 + 32, 32, 32, 1);
+
+    TKCanvasFree(&canvas);
+}
+
+// Blends source over an opaque gray backdrop with mode, returns the center pixel
+static uint32_t TKBlendOverGray(TKRasterBlendMode mode, float gray, TKRasterColor source) {
+    TKCanvas canvas;
+    TKCanvasInit(&canvas, 8, 8);
+
+    TKRasterColor backdrop = { gray, gray, gray, 1.0f };
+    TKRasterSurfaceClear(&canvas.surface, backdrop);
+
+    TKRasterContextSetBlendMode(&canvas.context, mode);
+    TKRasterContextFillPath(&canvas.context, TKCanvasRect(&canvas, 0, 0, 8, 8), TKRasterFillNonZero, source);
+
+    uint32_t pixel = TKPixel(&canvas.surface, 4, 4);
+    TKCanvasFree(&canvas);
+
+    return pixel;
+}
+
+static void TestBlendModes(void) {
+    TKRasterColor source = { 0.5f, 1.0f, 0.0f, 1.0f };
+
+    // Multiply, source * backdrop
+    uint32_t pixel = TKBlendOverGray(TKRasterBlendMultiply, 0.5f, source);
+    TKTestCheck(TKAlpha(pixel) == 255 && abs(TKRedOf(pixel) - 64) <= 1 && abs(TKGreenOf(pixel) - 128) <= 1 && TKBlueOf(pixel) == 0,
+                "multiply %08x", pixel);
+
+    // Overlay with a dark backdrop, 2 * source * backdrop
+    pixel = TKBlendOverGray(TKRasterBlendOverlay, 0.25f, source);
+    TKTestCheck(abs(TKRedOf(pixel) - 64) <= 1 && abs(TKGreenOf(pixel) - 128) <= 1 && TKBlueOf(pixel) == 0, "overlay dark %08x", pixel);
+
+    // Overlay with a light backdrop, 1 - 2 * (1 - source) * (1 - backdrop)
+    pixel = TKBlendOverGray(TKRasterBlendOverlay, 0.75f, source);
+    TKTestCheck(abs(TKRedOf(pixel) - 191) <= 1 && TKGreenOf(pixel) == 255 && abs(TKBlueOf(pixel) - 128) <= 1, "overlay light %08x", pixel);
+
+    // Soft light, a mid gray source leaves the backdrop alone, white lightens to its square root, black darkens to its square
+    pixel = TKBlendOverGray(TKRasterBlendSoftLight, 0.5f, source);
+    TKTestCheck(abs(TKRedOf(pixel) - 128) <= 1, "soft light gray %08x", pixel);
+    TKTestCheck(abs(TKGreenOf(pixel) - 181) <= 1, "soft light white %08x", pixel);
+    TKTestCheck(abs(TKBlueOf(pixel) - 64) <= 1, "soft light black %08x", pixel);
+
+    // Normal is source over
+    pixel = TKBlendOverGray(TKRasterBlendNormal, 0.25f, source);
+    TKTestCheck(TKRedOf(pixel) == 128 && TKGreenOf(pixel) == 255 && TKBlueOf(pixel) == 0, "normal %08x", pixel);
+}
+
+static void TestGradient(void) {
+    TKCanvas canvas;
+    TKCanvasInit(&canvas, 256, 4);
+
+    TKRasterColor colors[2] = { TKRed, TKBlue };
+    TKRasterGradient gradient;
+    TKRasterGradientInit(&gradient, colors, NULL, 2);
+
+    // Extended past both ends
+    TKRasterContextFillPathWithGradient(&canvas.context, TKCanvasRect(&canvas, 0, 0, 256, 4), TKRasterFillNonZero, &gradient, 64, 0, 192, 0);
+
+    TKCheckPixel(&canvas.surface, 0, 1, 255, 255, 0, 0, 0);
+    TKCheckPixel(&canvas.surface, 60, 1, 255, 255, 0, 0, 0);
+    TKCheckPixel(&canvas.surface, 128, 1, 255, 128, 0, 128, 2);
+    TKCheckPixel(&canvas.surface, 196, 1, 255, 0, 0, 255, 0);
+    TKCheckPixel(&canvas.surface, 255, 1, 255, 0, 0, 255, 0);
+
+    // Monotonic in between
+    for (int x = 65; x < 192; x++) {
+        TKTestCheck(TKRedOf(TKPixel(&canvas.surface, x, 2)) <= TKRedOf(TKPixel(&canvas.surface, x - 1, 2)), "red rises at %d", x);
+    }
+
+    TKCanvasFree(&canvas);
+}
+
+#pragma mark - State
+
+static void TestShadow(void) {
+    TKCanvas canvas;
+    TKCanvasInit(&canvas, 32, 32);
+
+    // Sharp shadow, offset down and right, in pixels of the surface regardless of the transform
+    TKRasterContextScale(&canvas.context, 2.0, 2.0);
+    TKRasterContextSetShadow(&canvas.context, 4.0f, 4.0f, 0.0f, TKBlack);
+    TKRasterContextFillPath(&canvas.context, TKCanvasRect(&canvas, 2, 2, 8, 8), TKRasterFillNonZero, TKWhite);
+
+    TKCheckPixel(&canvas.surface, 10, 10, 255, 255, 255, 255, 0);
+    TKCheckPixel(&canvas.surface, 21, 21, 255, 0, 0, 0, 0);
+    TKCheckPixel(&canvas.surface, 23, 23, 255, 0, 0, 0, 0);
+    TKCheckPixel(&canvas.surface, 24, 24, 0, 0, 0, 0, 0);
+    TKCheckPixel(&canvas.surface, 3, 3, 0, 0, 0, 0, 0);
+    TKCanvasFree(&canvas);
+
+    // Blurred and moved clear of the shape, the shadow is spread out rather than lost. A clear fill casts none
+    TKCanvasInit(&canvas, 96, 48);
+    TKRasterContextSetShadow(&canvas.context, 48.0f, 0.0f, 8.0f, TKBlack);
+    TKRasterContextFillPath(&canvas.context, TKCanvasRect(&canvas, 8, 16, 16, 16), TKRasterFillNonZero, TKWhite);
+
+    double shadowCoverage = TKCoverageSum(&canvas.surface) - 256.0;
+    TKTestCheck(fabs(shadowCoverage - 256.0) / 256.0 < 0.02, "blurred shadow coverage %g", shadowCoverage);
+    TKTestCheck(TKAlpha(TKPixel(&canvas.surface, 64, 24)) > TKAlpha(TKPixel(&canvas.surface, 55, 24)), "shadow does not fade out");
+    TKTestCheck(TKAlpha(TKPixel(&canvas.surface, 55, 24)) > 0, "shadow is not blurred");
+    TKTestCheck(TKAlpha(TKPixel(&canvas.surface, 64, 2)) == 0, "shadow spreads too far");
+
+    TKRasterColor clear = { 1.0f, 1.0f, 1.0f, 0.0f };
+    TKRasterSurfaceClear(&canvas.surface, clear);
+    TKRasterContextFillPath(&canvas.context, TKCanvasRect(&canvas, 8, 16, 16, 16), TKRasterFillNonZero, clear);
+    TKTestCheckClose(TKCoverageSum(&canvas.surface), 0.0, 1e-9);
+    TKCanvasFree(&canvas);
+}
+
+static void TestClip(void) {
+    TKCanvas canvas;
+    TKCanvasInit(&canvas, 32, 32);
+
+    TKRasterContextSaveState(&canvas.context);
+    TKRasterContextClipToRect(&canvas.context, 8, 8, 16, 16);
+    TKRasterContextFillPath(&canvas.context, TKCanvasRect(&canvas, 0, 0, 32, 32), TKRasterFillNonZero, TKRed);
+    TKRasterContextRestoreState(&canvas.context);
+
+    TKCheckPixel(&canvas.surface, 8, 8, 255, 255, 0, 0, 0);
+    TKCheckPixel(&canvas.surface, 7, 8, 0, 0, 0, 0, 0);
+    TKCheckPixel(&canvas.surface, 24, 23, 0, 0, 0, 0, 0);
+
+    // Path clip with even-odd leaves a hole, restoring removes the clip
+    TKRasterContextSaveState(&canvas.context);
+    TKRasterContextClipToPath(&canvas.context, TKCanvasPath(&canvas, "M0 0 H32 V32 H0 Z M12 12 H20 V20 H12 Z"), TKRasterFillEvenOdd);
+    TKRasterContextFillPath(&canvas.context, TKCanvasRect(&canvas, 0, 0, 32, 32), TKRasterFillNonZero, TKBlue);
+    TKRasterContextRestoreState(&canvas.context);
+
+    TKCheckPixel(&canvas.surface, 16, 16, 255, 255, 0, 0, 0);
+    TKCheckPixel(&canvas.surface, 2, 2, 255, 0, 0, 255, 0);
+
+    TKRasterContextFillPath(&canvas.context, TKCanvasRect(&canvas, 15, 15, 2, 2), TKRasterFillNonZero, TKGreen);
+    TKCheckPixel(&canvas.surface, 16, 16, 255, 0, 255, 0, 0);
+
+    TKCanvasFree(&canvas);
+}
+
+#pragma mark - Golden scenes
+
+typedef struct {
+    const char *name;
+    int width;
+    int height;
+    void (*draw)(TKCanvas *canvas);
+} TKScene;
+
+// A themed button the way the display lists draw one - drop shadow, gradient fill, inner shadow and stroke
+static void TKDrawButton(TKCanvas *canvas) {
+    TKRasterContext *context = &canvas->context;
+    double radii[4] = { 8, 8, 8, 8 };
+
+    TKPathBuffer button;
+    TKPathBufferInit(&button);
+    TKRasterPathAddRoundedRect(&button, 8, 6, 104, 36, radii);
+
+    TKRasterContextSaveState(context);
+    TKRasterColor shadow = { 0.0f, 0.0f, 0.0f, 0.6f };
+    TKRasterContextSetShadow(context, 0.0f, 2.0f, 4.0f, shadow);
+    TKRasterColor base = { 0.16f, 0.16f, 0.16f, 1.0f };
+    TKRasterContextFillPath(context, &button, TKRasterFillNonZero, base);
+    TKRasterContextRestoreState(context);
+
+    TKRasterColor colors[2] = { { 0.45f, 0.62f, 0.95f, 1.0f }, { 0.13f, 0.33f, 0.78f, 1.0f } };
+    TKRasterGradient gradient;
+    TKRasterGradientInit(&gradient, colors, NULL, 2);
+    TKRasterContextFillPathWithGradient(context, &button, TKRasterFillNonZero, &gradient, 0, 6, 0, 42);
+
+    // Inner shadow, the outside of the shape filled with a shadow, clipped to the shape
+    TKRasterContextSaveState(context);
+    TKRasterContextClipToPath(context, &button, TKRasterFillNonZero);
+    TKPathBuffer inverse;
+    TKPathBufferInit(&inverse);
+    TKRasterPathAddRect(&inverse, -20, -20, 160, 88);
+    TKRasterPathAddRoundedRect(&inverse, 8, 6, 104, 36, radii);
+    TKRasterColor inner = { 1.0f, 1.0f, 1.0f, 0.5f };
+    TKRasterContextSetShadow(context, 0.0f, 1.5f, 1.0f, inner);
+    TKRasterContextFillPath(context, &inverse, TKRasterFillEvenOdd, TKBlack);
+    TKRasterContextRestoreState(context);
+
+    TKRasterContextSetLineWidth(context, 1.0f);
+    TKRasterColor stroke = { 0.05f, 0.15f, 0.4f, 1.0f };
+    TKRasterContextStrokePath(context, &button, stroke);
+
+    TKPathBufferFree(&inverse);
+    TKPathBufferFree(&button);
+}
+
+static void TKDrawFillRules(TKCanvas *canvas) {
+    const char *star = "M40 4 L61 68 L6 28 H74 L19 68 Z";
+    TKRasterContextFillPath(&canvas->context, TKCanvasPath(canvas, star), TKRasterFillNonZero, TKRed);
+
+    TKRasterContextTranslate(&canvas->context, 80, 0);
+    TKRasterContextFillPath(&canvas->context, TKCanvasPath(canvas, star), TKRasterFillEvenOdd, TKBlue);
+}
+
+static void TKDrawStrokes(TKCanvas *canvas) {
+    TKRasterContext *context = &canvas->context;
+    const TKRasterLineJoin joins[3] = { TKRasterLineJoinMiter, TKRasterLineJoinRound, TKRasterLineJoinBevel };
+    const TKRasterLineCap caps[3] = { TKRasterLineCapButt, TKRasterLineCapRound, TKRasterLineCapSquare };
+
+    TKRasterContextSetLineWidth(context, 7.0f);
+    for (int i = 0; i < 3; i++) {
+        TKRasterContextSetLineJoin(context, joins[i]);
+        TKRasterContextSetLineCap(context, caps[i]);
+        TKRasterContextStrokePath(context, TKCanvasPath(canvas, "M10 50 L25 12 L40 50 Q50 20 30 60"), TKBlack);
+        TKRasterContextTranslate(context, 48, 0);
+    }
+
+    // Closed, thin and curved
+    TKRasterContextTranslate(context, -144, 0);
+    TKRasterContextSetLineWidth(context, 1.5f);
+    TKRasterContextStrokePath(context, TKCanvasPath(canvas, "M8 66 C40 56 100 76 136 66 A6 6 0 0 1 136 74 Z"), TKRed);
+}
+
+static void TKDrawBlendModes(TKCanvas *canvas) {
+    TKRasterContext *context = &canvas->context;
+
+    TKRasterColor colors[3] = { { 0.9f, 0.2f, 0.1f, 1.0f }, { 0.2f, 0.8f, 0.3f, 1.0f }, { 0.1f, 0.2f, 0.9f, 1.0f } };
+    float locations[3] = { 0.0f, 0.3f, 1.0f };
+    TKRasterGradient backdrop;
+    TKRasterGradientInit(&backdrop, colors, locations, 3);
+    TKRasterContextFillPathWithGradient(context, TKCanvasRect(canvas, 0, 0, 160, 64), TKRasterFillNonZero, &backdrop, 0, 0, 160, 64);
+
+    // A gradient from black to white in each mode, at 80% alpha
+    TKRasterColor grays[2] = { TKBlack, TKWhite };
+    TKRasterGradient gray;
+    TKRasterGradientInit(&gray, grays, NULL, 2);
+
+    const TKRasterBlendMode modes[4] = { TKRasterBlendNormal, TKRasterBlendMultiply, TKRasterBlendOverlay, TKRasterBlendSoftLight };
+    TKRasterContextSetAlpha(context, 0.8f);
+    for (int i = 0; i < 4; i++) {
+        TKRasterContextSetBlendMode(context, modes[i]);
+        TKPathBufferReset(&canvas->path);
+        TKRasterPathAddEllipse(&canvas->path, 4 + 40 * i, 12, 32, 40);
+        TKRasterContextFillPathWithGradient(context, &canvas->path, TKRasterFillNonZero, &gray, 0, 12, 0, 52);
+    }
+}
+
+static void TKDrawClippedPaths(TKCanvas *canvas) {
+    TKRasterContext *context = &canvas->context;
+
+    // Icon path with curves and arcs, clipped to a circle, scaled and rotated
+    TKPathBufferReset(&canvas->path);
+    TKRasterPathAddEllipse(&canvas->path, 4, 4, 88, 88);
+    TKRasterContextClipToPath(context, &canvas->path, TKRasterFillNonZero);
+
+    TKRasterColor background = { 0.95f, 0.9f, 0.7f, 1.0f };
+    TKRasterContextFillPath(context, TKCanvasRect(canvas, 0, 0, 96, 96), TKRasterFillNonZero, background);
+
+    double rotation[6] = { 0.866, 0.5, -0.5, 0.866, 48, 48 };
+    TKRasterContextConcatTransform(context, rotation);
+    TKRasterContextScale(context, 1.5, 1.5);
+
+    TKRasterColor fill = { 0.2f, 0.5f, 0.3f, 0.9f };
+    const char *leaf = "M0 -28 C18 -18 22 4 0 26 C-22 4 -18 -18 0 -28 Z m0 6 v44 a3 3 0 0 1 -3 3 h-2";
+    TKRasterContextFillPath(context, TKCanvasPath(canvas, leaf), TKRasterFillNonZero, fill);
+
+    TKRasterContextSetLineWidth(context, 1.0f);
+    TKRasterContextStrokePath(context, &canvas->path, TKBlack);
+}
+
+static const TKScene TKScenes[] = {
+    { "button", 120, 48, TKDrawButton },
+    { "fill-rules", 160, 72, TKDrawFillRules },
+    { "strokes", 160, 80, TKDrawStrokes },
+    { "blend-modes", 160, 64, TKDrawBlendModes },
+    { "clipped-paths", 96, 96, TKDrawClippedPaths },
+};
+
+#pragma mark - Golden files
+
+// Pixels of the surface as RGBA bytes, still premultiplied
+static bool TKWriteGolden(const char *path, const TKRasterSurface *surface) {
+    FILE *file = fopen(path, "wb");
+    if (!file)
+        return false;
+
+    fprintf(file, "P7\nWIDTH %d\nHEIGHT %d\nDEPTH 4\nMAXVAL 255\nTUPLTYPE RGB_ALPHA\nENDHDR\n", surface->width, surface->height);
+    for (int y = 0; y < surface->height; y++) {
+        for (int x = 0; x < surface->width; x++) {
+            uint32_t pixel = TKPixel(surface, x, y);
+            uint8_t rgba[4] = { (uint8_t)TKRedOf(pixel), (uint8_t)TKGreenOf(pixel), (uint8_t)TKBlueOf(pixel), (uint8_t)TKAlpha(pixel) };
+            fwrite(rgba, 1, 4, file);
+        }
+    }
+
+    return fclose(file) == 0;
+}
+
+// RGBA bytes of the golden, NULL if it can't be read or has another size
+static uint8_t *TKReadGolden(const char *path, int width, int height) {
+    FILE *file = fopen(path, "rb");
+    if (!file)
+        return NULL;
+
+    int goldenWidth = 0, goldenHeight = 0;
+    uint8_t *bytes = NULL;
+
+    if (fscanf(file, "P7\nWIDTH %d\nHEIGHT %d\nDEPTH 4\nMAXVAL 255\nTUPLTYPE RGB_ALPHA\nENDHDR", &goldenWidth, &goldenHeight) == 2 &&
+        fgetc(file) == '\n' && goldenWidth == width && goldenHeight == height) {
+        size_t length = (size_t)width * height * 4;
+        bytes = (uint8_t *)malloc(length);
+        if (fread(bytes, 1, length, file) != length) {
+            free(bytes);
+            bytes = NULL;
+        }
+    }
+
+    fclose(file);
+    return bytes;
+}
+
+static void TestGoldenScenes(const char *directory, bool update) {
+    for (size_t i = 0; i < sizeof(TKScenes) / sizeof(TKScenes[0]); i++) {
+        const TKScene *scene = &TKScenes[i];
+
+        TKCanvas canvas;
+        TKCanvasInit(&canvas, scene->width, scene->height);
+        scene->draw(&canvas);
+
+        char path[1024];
+        snprintf(path, sizeof(path), "%s/%s.pam", directory, scene->name);
+
+        if (update) {
+            TKTestCheck(TKWriteGolden(path, &canvas.surface), "could not write %s", path);
+            printf("wrote %s\n", path);
+            TKCanvasFree(&canvas);
+            continue;
+        }
+
+        uint8_t *golden = TKReadGolden(path, scene->width, scene->height);
+        TKTestCheck(golden != NULL, "no golden at %s (of %dx%d)", path, scene->width, scene->height);
+
+        int worst = 0, worstX = 0, worstY = 0, differing = 0;
+        for (int y = 0; golden && y < scene->height; y++) {
+            for (int x = 0; x < scene->width; x++) {
+                uint32_t pixel = TKPixel(&canvas.surface, x, y);
+                const uint8_t *expected = golden + ((size_t)y * scene->width + x) * 4;
+                int channels[4] = { TKRedOf(pixel), TKGreenOf(pixel), TKBlueOf(pixel), TKAlpha(pixel) };
+
+                int difference = 0;
+                for (int c = 0; c < 4; c++) {
+                    int d = abs(channels[c] - expected[c]);
+                    difference = d > difference ? d : difference;
+                }
+
+                if (difference > 0)
+                    differing++;
+
+                if (difference > worst) {
+                    worst = difference;
+                    worstX = x;
+                    worstY = y;
+                }
+            }
+        }
+
+        TKTestCheck(worst <= kGoldenTolerance, "%s differs from the golden by up to %d at %d,%d (%d pixels differ)", scene->name, worst,
+                    worstX, worstY, differing);
+
+        // Written next to the build for a look, when it fails
+        if (worst > kGoldenTolerance) {
+            snprintf(path, sizeof(path), "%s-%s.pam", scene->name, TKRasterKernelName());
+            TKWriteGolden(path, &canvas.surface);
+        }
+
+        free(golden);
+        TKCanvasFree(&canvas);
+    }
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s <golden directory> [--update]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    const char *directory = argv[1];
+    bool update = argc > 2 && strcmp(argv[2], "--update") == 0;
+
+    printf("kernels: %s\n", TKRasterKernelName());
+
+    TKTestRun(TestAlignedRect);
+    TKTestRun(TestPartialCoverage);
+    TKTestRun(TestCircleArea);
+    TKTestRun(TestFillRules);
+    TKTestRun(TestStroke);
+    TKTestRun(TestAlpha);
+    TKTestRun(TestBlendModes);
+    TKTestRun(TestGradient);
+    TKTestRun(TestShadow);
+    TKTestRun(TestClip);
+
+    int failures = TKTestFailures;
+    TestGoldenScenes(directory, update);
+    printf("%-48s %s\n", "TestGoldenScenes", failures == TKTestFailures ? "ok" : "FAILED");
+
+    return TKTestResult();
+}
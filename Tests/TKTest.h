@@ -0,0 +1,59 @@
+//
+//  TKTest.h
+//  ThemeEngine
+//
+//  Checks for the tests of the plain C parts, each test is a single file with its own main. A failed check
+//  is printed with its location and counted, the test goes on, main returns TKTestResult() at the end
+//
+//  Copyright (c) 2012 __MyCompanyName__. All rights reserved.
+//
+
+#ifndef TKTest_h
+#define TKTest_h
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <stdint.h>
+
+static int TKTestChecks = 0;
+static int TKTestFailures = 0;
+
+#define TKTestCheck(condition, ...) do {                                            \
+    TKTestChecks++;                                                                 \
+    if (!(condition)) {                                                             \
+        TKTestFailures++;                                                           \
+        fprintf(stderr, "%s:%d: check failed: %s - ", __FILE__, __LINE__, #condition); \
+        fprintf(stderr, __VA_ARGS__);                                               \
+        fprintf(stderr, "\n");                                                      \
+    }                                                                               \
+} while (0)
+
+#define TKTestCheckClose(value, expected, tolerance) \
+    TKTestCheck(fabs((double)(value) - (double)(expected)) <= (tolerance), "%.17g, expected %.17g", (double)(value), (double)(expected))
+
+// Runs one of the static test functions of the file
+#define TKTestRun(test) do {                                                        \
+    int failures = TKTestFailures;                                                  \
+    test();                                                                         \
+    printf("%-48s %s\n", #test, failures == TKTestFailures ? "ok" : "FAILED");      \
+} while (0)
+
+static inline int TKTestResult(void) {
+    printf("%d checks, %d failed\n", TKTestChecks, TKTestFailures);
+    return TKTestFailures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+// Deterministic random numbers (xorshift), the same sequence on every platform
+static inline uint32_t TKTestRandom(uint64_t *state) {
+    uint64_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    *state = x;
+
+    return (uint32_t)(x >> 16);
+}
+
+#endif
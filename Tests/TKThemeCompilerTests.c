@@ -0,0 +1,476 @@
+//
+//  TKThemeCompilerTests.c
+//  ThemeEngine
+//
+//  Archives written by TKThemeCompiler, read back with the accessors of TKThemeArchiveFormat.h the way the
+//  loader reads them - the values, the interning of strings and numbers, the order of the keys, and the stored
+//  hashes, which have to be the ones the engine computes for the same JSON (TKStructuralHashForJSONBytes)
+//
+//  Themes with components are stored as they are written, the engine expands them when it loads the archive. The
+//  archive tkc wrote for components.json has to be the one compiled here
+//
+//      TKThemeCompilerTests <example.json> <components.json> <components.tkb>
+//
+//  Copyright (c) 2012 __MyCompanyName__. All rights reserved.
+//
+
+#include "TKTest.h"
+#include "TKThemeCompiler.h"
+#include "TKThemeArchiveFormat.h"
+
+#include <stdbool.h>
+
+#pragma mark - Reading archives
+
+typedef struct {
+    uint8_t *bytes;
+    size_t length;
+    size_t nodes;
+} TKArchive;
+
+static bool TKCompile(TKArchive *archive, const char *JSON, size_t length) {
+    archive->nodes = 0;
+    archive->bytes = TKThemeCompile(JSON, length, &archive->length, NULL);
+    if (!archive->bytes)
+        return false;
+
+    TKTestCheck(TKArchiveIsValid(archive->bytes, archive->length), "archive of %.40s is not valid", JSON);
+    return TKArchiveIsValid(archive->bytes, archive->length);
+}
+
+static TKArchiveValue TKArchiveRoot(const TKArchive *archive) {
+    return ((const TKArchiveHeader *)archive->bytes)->root;
+}
+
+static bool TKArchiveStringEqual(const TKArchive *archive, uint32_t index, const char *string) {
+    uint32_t length = 0;
+    const char *bytes = TKArchiveStringAtIndex(archive->bytes, index, &length);
+
+    return length == strlen(string) && memcmp(bytes, string, length) == 0;
+}
+
+static double TKArchiveNumber(const TKArchive *archive, TKArchiveValue value) {
+    const TKArchiveHeader *header = (const TKArchiveHeader *)archive->bytes;
+    if (value.type != TKArchiveValueNumber || value.payload >= header->numberCount)
+        return NAN;
+
+    double number;
+    memcpy(&number, archive->bytes + header->numberTableOffset + value.payload * sizeof(double), sizeof(double));
+    return number;
+}
+
+// Value of key in the dictionary, found with a binary search like the loader does, a null value if it's not there
+static TKArchiveValue TKArchiveLookup(const TKArchive *archive, TKArchiveValue dictionary, const char *key) {
+    TKArchiveValue missing = { TKArchiveValueNull, UINT32_MAX };
+    uint32_t count = 0;
+    const uint8_t *node = TKArchiveNodeAtOffset(archive->bytes, dictionary.payload, sizeof(TKArchiveEntry), &count);
+    if (dictionary.type != TKArchiveValueDictionary || !node)
+        return missing;
+
+    const TKArchiveEntry *entries = (const TKArchiveEntry *)(node + kArchiveNodeHeaderSize);
+    size_t keyLength = strlen(key);
+    size_t low = 0, high = count;
+    while (low < high) {
+        size_t middle = (low + high) / 2;
+        uint32_t length = 0;
+        const char *bytes = TKArchiveStringAtIndex(archive->bytes, entries[middle].key, &length);
+
+        int result = memcmp(bytes, key, length < keyLength ? length : keyLength);
+        if (result == 0)
+            result = length < keyLength ? -1 : (length > keyLength ? 1 : 0);
+
+        if (result == 0)
+            return entries[middle].value;
+        else if (result < 0)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+
+    return missing;
+}
+
+static TKArchiveValue TKArchiveElement(const TKArchive *archive, TKArchiveValue array, uint32_t index) {
+    TKArchiveValue missing = { TKArchiveValueNull, UINT32_MAX };
+    uint32_t count = 0;
+    const uint8_t *node = TKArchiveNodeAtOffset(archive->bytes, array.payload, sizeof(TKArchiveValue), &count);
+    if (array.type != TKArchiveValueArray || !node || index >= count)
+        return missing;
+
+    return ((const TKArchiveValue *)(node + kArchiveNodeHeaderSize))[index];
+}
+
+// Hash of the value computed from its contents, checks every node on the way: in bounds, keys strictly
+// ascending (sorted, no duplicates) and the stored hash the same as the computed one
+static TKStructuralHash TKCheckValue(TKArchive *archive, TKArchiveValue value) {
+    const TKArchiveHeader *header = (const TKArchiveHeader *)archive->bytes;
+
+    switch (value.type) {
+        case TKArchiveValueNull:
+            return TKHashNull();
+        case TKArchiveValueFalse:
+            return TKHashNumber(0.0);
+        case TKArchiveValueTrue:
+            return TKHashNumber(1.0);
+        case TKArchiveValueNumber:
+            TKTestCheck(value.payload < header->numberCount, "number %u of %u", value.payload, header->numberCount);
+            return TKHashNumber(TKArchiveNumber(archive, value));
+        case TKArchiveValueString: {
+            TKTestCheck(value.payload < header->stringCount, "string %u of %u", value.payload, header->stringCount);
+            uint32_t length = 0;
+            const char *bytes = TKArchiveStringAtIndex(archive->bytes, value.payload, &length);
+            return TKHashUTF8String(bytes, length);
+        }
+        case TKArchiveValueArray:
+        case TKArchiveValueDictionary: {
+            bool isDictionary = value.type == TKArchiveValueDictionary;
+            uint32_t count = 0;
+            const uint8_t *node = TKArchiveNodeAtOffset(archive->bytes, value.payload,
+                                                        isDictionary ? sizeof(TKArchiveEntry) : sizeof(TKArchiveValue), &count);
+            TKTestCheck(node != NULL, "node at %u out of bounds", value.payload);
+            TKTestCheck(value.payload % 8 == 0, "node at %u not aligned", value.payload);
+            if (!node)
+                return TKHashNull();
+
+            archive->nodes++;
+            uint64_t lanes[2] = { isDictionary ? 0 : TKHashSeed[0], isDictionary ? 0 : TKHashSeed[1] };
+
+            for (uint32_t i = 0; i < count; i++) {
+                if (isDictionary) {
+                    const TKArchiveEntry *entries = (const TKArchiveEntry *)(node + kArchiveNodeHeaderSize);
+                    uint32_t length = 0, previousLength = 0;
+                    const char *key = TKArchiveStringAtIndex(archive->bytes, entries[i].key, &length);
+
+                    if (i > 0) {
+                        const char *previous = TKArchiveStringAtIndex(archive->bytes, entries[i - 1].key, &previousLength);
+                        int order = memcmp(previous, key, previousLength < length ? previousLength : length);
+                        TKTestCheck(order < 0 || (order == 0 && previousLength < length), "keys %.*s, %.*s out of order",
+                                    (int)previousLength, previous, (int)length, key);
+                    }
+
+                    TKHashAddEntry(lanes, TKHashUTF8String(key, length), TKCheckValue(archive, entries[i].value));
+                } else {
+                    TKHashAddElement(lanes, TKCheckValue(archive, ((const TKArchiveValue *)(node + kArchiveNodeHeaderSize))[i]));
+                }
+            }
+
+            TKStructuralHash hash = TKHashFinishContainer(lanes, count, isDictionary);
+            TKStructuralHash stored;
+            memcpy(&stored, node, sizeof(TKStructuralHash));
+            TKTestCheck(TKStructuralHashEqual(hash, stored), "stored hash of node %u differs", value.payload);
+
+            return hash;
+        }
+    }
+
+    TKTestCheck(false, "unknown value type %u", value.type);
+    return TKHashNull();
+}
+
+// Whole archive - the hash of the root is the one of the JSON, every string and number is stored once
+static void TKCheckArchive(TKArchive *archive, const char *JSON, size_t length) {
+    const TKArchiveHeader *header = (const TKArchiveHeader *)archive->bytes;
+
+    TKStructuralHash hash = TKCheckValue(archive, TKArchiveRoot(archive));
+    TKTestCheck(TKStructuralHashEqual(hash, TKStructuralHashForJSONBytes(JSON, length)), "root hash differs from the JSON, %.40s", JSON);
+
+    for (uint32_t i = 1; i < header->stringCount; i++) {
+        uint32_t length = 0, previousLength = 0;
+        const char *string = TKArchiveStringAtIndex(archive->bytes, i, &length);
+
+        // Quadratic, the documents here are small
+        for (uint32_t j = 0; j < i && header->stringCount < 4096; j++) {
+            const char *previous = TKArchiveStringAtIndex(archive->bytes, j, &previousLength);
+            TKTestCheck(previousLength != length || memcmp(previous, string, length) != 0, "string %u stored again as %u", j, i);
+        }
+    }
+
+    const double *numbers = (const double *)(archive->bytes + header->numberTableOffset);
+    for (uint32_t i = 1; i < header->numberCount && header->numberCount < 4096; i++) {
+        for (uint32_t j = 0; j < i; j++) {
+            TKTestCheck(memcmp(&numbers[i], &numbers[j], sizeof(double)) != 0, "number %g stored again", numbers[i]);
+        }
+    }
+}
+
+static void TKCheckCompiles(const char *JSON) {
+    TKArchive archive;
+    TKTestCheck(TKCompile(&archive, JSON, strlen(JSON)), "%s did not compile", JSON);
+    if (archive.bytes)
+        TKCheckArchive(&archive, JSON, strlen(JSON));
+
+    free(archive.bytes);
+}
+
+// Whole file into bytes, 0 if it can't be read
+static size_t TKReadTestFile(const char *path, char *bytes, size_t capacity) {
+    FILE *file = fopen(path, "rb");
+    TKTestCheck(file != NULL, "can't open %s", path);
+    if (!file)
+        return 0;
+
+    size_t length = fread(bytes, 1, capacity, file);
+    fclose(file);
+
+    return length;
+}
+
+#pragma mark - Tests
+
+static const char *TKExamplePath;
+static const char *TKComponentsPath;
+static const char *TKComponentsArchivePath;
+
+static void TestExample(void) {
+    char JSON[65536];
+    size_t length = TKReadTestFile(TKExamplePath, JSON, sizeof(JSON));
+    if (!length)
+        return;
+
+    TKArchive archive;
+    TKTestCheck(TKCompile(&archive, JSON, length), "example did not compile");
+    if (!archive.bytes)
+        return;
+
+    TKCheckArchive(&archive, JSON, length);
+    TKTestCheck(archive.nodes > 20, "%zu nodes", archive.nodes);
+
+    TKArchiveValue root = TKArchiveRoot(&archive);
+    TKArchiveValue title = TKArchiveLookup(&archive, root, "title");
+    TKTestCheck(title.type == TKArchiveValueString && TKArchiveStringEqual(&archive, title.payload, "Theme-1"), "title");
+    TKTestCheckClose(TKArchiveNumber(&archive, TKArchiveLookup(&archive, TKArchiveLookup(&archive, root, "size"), "width")), 165, 0);
+    TKTestCheckClose(TKArchiveNumber(&archive, TKArchiveLookup(&archive, TKArchiveLookup(&archive, root, "origin"), "y")), 50, 0);
+    TKTestCheck(TKArchiveLookup(&archive, root, "missing").payload == UINT32_MAX, "missing key found");
+
+    TKArchiveValue rectangle = TKArchiveElement(&archive, TKArchiveLookup(&archive, root, "subviews"), 0);
+    TKArchiveValue color = TKArchiveLookup(&archive, rectangle, "color");
+    TKTestCheck(color.type == TKArchiveValueString && TKArchiveStringEqual(&archive, color.payload, "#168fdd"), "color");
+    TKTestCheckClose(TKArchiveNumber(&archive, TKArchiveLookup(&archive, rectangle, "corner-radius")), 4, 0);
+
+    // Same input, same bytes
+    size_t secondLength = 0;
+    uint8_t *second = TKThemeCompile(JSON, length, &secondLength, NULL);
+    TKTestCheck(second && secondLength == archive.length && memcmp(second, archive.bytes, secondLength) == 0, "not deterministic");
+    free(second);
+
+    // Any damage to the header or the tables is caught before anything is read
+    TKTestCheck(!TKArchiveIsValid(archive.bytes, sizeof(TKArchiveHeader) - 1), "short header accepted");
+    for (size_t prefix = sizeof(TKArchiveHeader); prefix < archive.length; prefix += 7) {
+        TKTestCheck(!TKArchiveIsValid(archive.bytes, prefix), "prefix of %zu bytes accepted", prefix);
+    }
+
+    ((TKArchiveHeader *)archive.bytes)->version++;
+    TKTestCheck(!TKArchiveIsValid(archive.bytes, archive.length), "other version accepted");
+
+    free(archive.bytes);
+}
+
+static void TestValues(void) {
+    const char *documents[] = {
+        "0", "-1.5e300", "\"\"", "\"text\"", "true", "false", "null", "[]", "{}",
+        "[1, 1.0, 1e0, -0.0, 0, 2]", "[\"a\", \"a\", \"b\", \"a\"]",
+        "{\"b\": 1, \"a\": 2, \"ab\": 3, \"\": 4, \"A\": 5}",
+        "{\"x\": {\"x\": {\"x\": [{\"x\": null}]}}}",
+        "[[], {}, [[]], [{}], {\"\": []}]",
+        "{\"color\": \"#FFF\", \"shadow\": {\"color\": \"#FFF\", \"blur\": 2}, \"inner-shadow\": {\"color\": \"#000\", \"blur\": 2}}",
+    };
+
+    for (size_t i = 0; i < sizeof(documents) / sizeof(documents[0]); i++) {
+        TKCheckCompiles(documents[i]);
+    }
+
+    // Every string once, keys and values alike, and the numbers by their bits (-0 and 0 both kept)
+    TKArchive archive;
+    const char *JSON = "{\"a\": \"a\", \"b\": [\"a\", \"b\", 1, 1.0, 0, -0.0]}";
+    TKCompile(&archive, JSON, strlen(JSON));
+    const TKArchiveHeader *header = (const TKArchiveHeader *)archive.bytes;
+    TKTestCheck(header->stringCount == 2, "%u strings", header->stringCount);
+    TKTestCheck(header->numberCount == 3, "%u numbers", header->numberCount);
+    free(archive.bytes);
+}
+
+static void TestUnicode(void) {
+    TKCheckCompiles("\"\\u00e9t\\u00e9\"");
+    TKCheckCompiles("{\"\\ud83d\\ude00\": \"\\ud83d\\ude00\", \"z\": \"\xc3\xa9\", \"\xc3\xa9\": \"\\u0000\"}");
+    TKCheckCompiles("[\"\xe2\x82\xac\", \"\xf0\x9f\x98\x80\", \"\\u20ac\"]");
+
+    // Keys in byte order, multi-byte characters after ASCII
+    TKArchive archive;
+    const char *JSON = "{\"\xc3\xa9\": 1, \"z\": 2, \"\\u0000\": 3}";
+    TKCompile(&archive, JSON, strlen(JSON));
+    TKArchiveValue root = TKArchiveRoot(&archive);
+    TKTestCheckClose(TKArchiveNumber(&archive, TKArchiveLookup(&archive, root, "\xc3\xa9")), 1, 0);
+    TKTestCheckClose(TKArchiveNumber(&archive, TKArchiveLookup(&archive, root, "z")), 2, 0);
+    free(archive.bytes);
+}
+
+static void TestDuplicateKeys(void) {
+    // The last one wins, like in NSJSONSerialization, and the hash is the one of the dictionary without the others
+    TKArchive archive;
+    const char *JSON = "{\"a\": 1, \"b\": 2, \"a\": 3, \"a\": {\"c\": 4}}";
+    TKTestCheck(TKCompile(&archive, JSON, strlen(JSON)), "did not compile");
+
+    TKArchiveValue root = TKArchiveRoot(&archive);
+    uint32_t count = 0;
+    TKArchiveNodeAtOffset(archive.bytes, root.payload, sizeof(TKArchiveEntry), &count);
+    TKTestCheck(count == 2, "%u entries", count);
+    TKTestCheckClose(TKArchiveNumber(&archive, TKArchiveLookup(&archive, TKArchiveLookup(&archive, root, "a"), "c")), 4, 0);
+
+    const char *deduplicated = "{\"b\": 2, \"a\": {\"c\": 4}}";
+    TKTestCheck(TKStructuralHashEqual(TKCheckValue(&archive, root), TKStructuralHashForJSONBytes(deduplicated, strlen(deduplicated))),
+                "hash is not the one of the deduplicated dictionary");
+    free(archive.bytes);
+}
+
+static void TestInvalid(void) {
+    const struct {
+        const char *JSON;
+        size_t offset;
+    } cases[] = {
+        { "", 0 },
+        { "{\"a\": }", 6 },
+        { "[1, 2", 5 },
+        { "{\"a\": 1} x", 9 },
+        { "[tru]", 1 },
+    };
+
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        size_t archiveLength = 0, offset = SIZE_MAX;
+        uint8_t *archive = TKThemeCompile(cases[i].JSON, strlen(cases[i].JSON), &archiveLength, &offset);
+        TKTestCheck(archive == NULL, "%s compiled", cases[i].JSON);
+        TKTestCheck(offset == cases[i].offset, "%s failed at %zu, expected %zu", cases[i].JSON, offset, cases[i].offset);
+        free(archive);
+    }
+}
+
+// Random themes - nested views with shuffled keys, values from a small pool so that they repeat
+static void TKAppendRandomValue(char **cursor, uint64_t *state, int depth) {
+    static const char *strings[] = { "\"#FFF\"", "\"#168fdd\"", "\"rectangle\"", "\"M0 0 L10 10 Z\"", "\"\\u00e9\"", "\"\"" };
+    static const char *keys[] = { "type", "size", "origin", "color", "shadow", "subviews", "corner-radius", "alpha", "text" };
+    uint32_t kind = TKTestRandom(state) % (depth > 4 ? 4 : 7);
+
+    switch (kind) {
+        case 0:
+            *cursor += sprintf(*cursor, "%s", strings[TKTestRandom(state) % 6]);
+            break;
+        case 1:
+            *cursor += sprintf(*cursor, "%d", (int)(TKTestRandom(state) % 20) - 5);
+            break;
+        case 2:
+            *cursor += sprintf(*cursor, "%.3f", (double)(TKTestRandom(state) % 1000) / 8.0);
+            break;
+        case 3:
+            *cursor += sprintf(*cursor, "%s", TKTestRandom(state) % 3 == 0 ? "null" : (TKTestRandom(state) % 2 ? "true" : "false"));
+            break;
+        case 4:
+        case 5: {
+            // Each key once, in a random order
+            uint32_t used = 0, count = TKTestRandom(state) % 6;
+            *(*cursor)++ = '{';
+            for (uint32_t i = 0; i < count; i++) {
+                uint32_t key = TKTestRandom(state) % 9;
+                if (used & (1u << key))
+                    continue;
+
+                used |= 1u << key;
+                *cursor += sprintf(*cursor, "%s\"%s\": ", i > 0 && *(*cursor - 1) != '{' ? ", " : "", keys[key]);
+                TKAppendRandomValue(cursor, state, depth + 1);
+            }
+            *(*cursor)++ = '}';
+            break;
+        }
+        default: {
+            uint32_t count = TKTestRandom(state) % 5;
+            *(*cursor)++ = '[';
+            for (uint32_t i = 0; i < count; i++) {
+                if (i > 0)
+                    *cursor += sprintf(*cursor, ", ");
+                TKAppendRandomValue(cursor, state, depth + 1);
+            }
+            *(*cursor)++ = ']';
+            break;
+        }
+    }
+
+    **cursor = '\0';
+}
+
+static void TestComponents(void) {
+    char JSON[65536];
+    size_t length = TKReadTestFile(TKComponentsPath, JSON, sizeof(JSON));
+    if (!length)
+        return;
+
+    TKArchive archive;
+    TKTestCheck(TKCompile(&archive, JSON, length), "components did not compile");
+    if (!archive.bytes)
+        return;
+
+    TKCheckArchive(&archive, JSON, length);
+
+    // The definitions are kept, each one once, a definition using another one as well
+    TKArchiveValue root = TKArchiveRoot(&archive);
+    TKArchiveValue definitions = TKArchiveLookup(&archive, root, "defs");
+    TKArchiveValue button = TKArchiveLookup(&archive, definitions, "button");
+    TKTestCheck(button.type == TKArchiveValueDictionary, "button definition");
+    TKTestCheckClose(TKArchiveNumber(&archive, TKArchiveLookup(&archive, button, "corner-radius")), 4, 0);
+
+    TKArchiveValue danger = TKArchiveLookup(&archive, definitions, "danger");
+    TKArchiveValue use = TKArchiveLookup(&archive, danger, "use");
+    TKTestCheck(use.type == TKArchiveValueString && TKArchiveStringEqual(&archive, use.payload, "button"), "danger uses button");
+
+    // The uses with their overrides, null removing a key included
+    TKArchiveValue subviews = TKArchiveLookup(&archive, root, "subviews");
+    const char *names[] = { "button", "button", "danger" };
+    for (uint32_t i = 0; i < 3; i++) {
+        TKArchiveValue instance = TKArchiveElement(&archive, subviews, i);
+        use = TKArchiveLookup(&archive, instance, "use");
+        TKTestCheck(use.type == TKArchiveValueString && TKArchiveStringEqual(&archive, use.payload, names[i]), "subview %u uses %s", i, names[i]);
+        TKTestCheck(TKArchiveLookup(&archive, instance, "origin").type == TKArchiveValueDictionary, "subview %u origin", i);
+    }
+
+    TKArchiveValue removed = TKArchiveLookup(&archive, TKArchiveElement(&archive, subviews, 2), "corner-radius");
+    TKTestCheck(removed.type == TKArchiveValueNull && removed.payload != UINT32_MAX, "null override not kept");
+
+    // The archive of the tkc tool is the same
+    static uint8_t compiled[65536];
+    size_t compiledLength = TKReadTestFile(TKComponentsArchivePath, (char *)compiled, sizeof(compiled));
+    TKTestCheck(compiledLength == archive.length && memcmp(compiled, archive.bytes, compiledLength) == 0,
+                "tkc wrote %zu bytes, expected %zu", compiledLength, archive.length);
+
+    free(archive.bytes);
+}
+
+static void TestRandom(void) {
+    uint64_t state = 0x5eed5eed;
+    char *JSON = (char *)malloc(1 << 20);
+
+    for (int i = 0; i < 2000; i++) {
+        char *cursor = JSON;
+        TKAppendRandomValue(&cursor, &state, 0);
+        TKCheckCompiles(JSON);
+    }
+
+    free(JSON);
+}
+
+int main(int argc, char **argv) {
+    if (argc < 4) {
+        fprintf(stderr, "usage: %s <example.json> <components.json> <components.tkb>\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    TKExamplePath = argv[1];
+    TKComponentsPath = argv[2];
+    TKComponentsArchivePath = argv[3];
+
+    TKTestRun(TestExample);
+    TKTestRun(TestValues);
+    TKTestRun(TestUnicode);
+    TKTestRun(TestDuplicateKeys);
+    TKTestRun(TestInvalid);
+    TKTestRun(TestComponents);
+    TKTestRun(TestRandom);
+
+    return TKTestResult();
+}
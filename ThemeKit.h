@@ -12,45 +12,186 @@
 #import "TKHelpers.h"
 #import "TKConstants.h"
 
-// JSONKit, needed for < iOS 5, after that NSJSONSerialization is preferred
-#import "JSONKit.h"
+// Streaming JSON reader, builds the descriptions directly
+#import "TKJSONBuilder.h"
+
+// Caches keyed by the structural hash of the descriptions
+#import "TKCache.h"
+
+// Persistent tier under the image cache
+#import "TKDiskImageCache.h"
+
+// Shared bitmaps for the images of buttons and patterns
+#import "TKImageAtlas.h"
+
+// Background rendering of images
+#import "TKRenderer.h"
+
+// Prewarming of whole theme bundles
+#import "TKPrewarmTask.h"
+
+// Minimal images of stretchable descriptions
+#import "TKNineSlice.h"
+
+// Timers and counters of the engine
+#import "TKInstrumentation.h"
+
+// Static labels drawn once into shared images
+#import "TKTextRun.h"
+
+// Components defined once and used with overrides
+#import "TKComponents.h"
+
+// Incremental updates of built hierarchies
+#import "TKThemeDiff.h"
+#import "TKThemeWatcher.h"
 
 // Macro that will enable caching, set to 0 to disable caching
 #define kCachingEnabled 1
 
+// Called after a watched theme has been reloaded, with the applied diff (nil if the hierarchy could not be patched)
+// and the bindings of the patched hierarchy
+typedef void (^TKThemeUpdateHandler)(TKThemeDiff *diff, NSDictionary *bindings);
+
+// How much of the caches to give up, see -trimCachesForMemoryPressure:
+typedef enum { TKMemoryPressureModerate,
+               TKMemoryPressureHigh,
+               TKMemoryPressureCritical } TKMemoryPressure;
+
 #pragma mark - ThemeView Header
 
 @interface ThemeKit : NSObject {    
     // Image cache, works wonders for images that are repeatedly
     // compressed - i.e custom button graphics etc.
-    NSCache *_imageCache;
+    TKCache *_imageCache;
     
-    // Contains cached drawingblocks for TKViews, 
+    // Contains compiled display lists for TKViews, keyed by the description,
     // this is to make sure each caching returns a new view not one already in use
-    NSCache *_cache;
+    TKCache *_cache;
     
     // Secondary cache used to avoid deserializing files at paths
     // will cache the resulting JSON dictionary, which in turn will produce cached blocks (if possible)
-    NSCache *_JSONCache;
+    TKCache *_JSONCache;
+    
+    // Optional, rendered images are also kept on disk across launches
+    TKDiskImageCache *_diskImageCache;
+    
+    // Memory warnings, the pressure goes up when they follow each other quickly
+    CFAbsoluteTime _lastMemoryWarning;
+    TKMemoryPressure _memoryPressure;
+    
+    // Button and pattern images are packed into it when -packsImagesIntoAtlas is enabled
+    TKImageAtlas *_imageAtlas;
+    BOOL _packsImagesIntoAtlas;
+    
+    // Draws images on a pool of background workers, see TKRenderer.h
+    TKRenderer *_renderer;
+    
+    // Prewarming, the pending operations are kept by path so they can be moved up in the queue
+    NSOperationQueue *_prewarmQueue;
+    NSMutableDictionary *_prewarmOperations;
+    
+    // Flattening of static subtrees, along with what it has saved so far
+    BOOL _flattensStaticSubtrees;
+    NSUInteger _flattenedSubtrees;
+    NSUInteger _flattenedViews;
+    long long _flattenedBytes;
 }
 
 // Main initializer, used as a singleton
 + (ThemeKit *)defaultEngine;
 
-// Force a flush of cache, although NSCache takes care of memory warnings automatically, 
+// Force a flush of cache, memory warnings only trim the caches (see below),
 // there may be situations in which flushing the cache is a good idea
 - (void)flushCache;
 
+// Memory budgets of the caches, the least recently used objects are evicted once a cache goes over its budget.
+// Images are charged the bytes of their bitmaps, display lists and descriptions an estimate. Default to 8MB for
+// images, 1MB for display lists and 2MB for descriptions
+@property (nonatomic) size_t imageCacheByteLimit;
+@property (nonatomic) size_t displayListCacheByteLimit;
+@property (nonatomic) size_t JSONCacheByteLimit;
+
+// Graded alternative to -flushCache, called on memory warnings. Moderate pressure drops the descriptions and trims the
+// images and display lists to half of their budgets, high pressure trims them to a quarter and empties the resource pool
+// and the image atlas, critical pressure flushes everything. Every warning within 30 seconds of the last one goes a level up
+- (void)trimCachesForMemoryPressure: (TKMemoryPressure)pressure;
+
+// Opt-in disk tier for the images, i.e [[TKDiskImageCache alloc] initWithDirectory: [TKDiskImageCache defaultDirectory] byteLimit: ...]
+// Set it up before any images are requested, it is not cleared by -flushCache (see -[TKDiskImageCache removeAllImages])
+@property (nonatomic, retain) TKDiskImageCache *diskImageCache;
+
+// Hits, misses, collisions and evictions of each cache (see TKCache.h), keyed by the name of the cache,
+// along with the statistics of the disk image cache, the image atlas (see TKImageAtlas.h) and the shared resource pool (see TKResourcePool.h)
+- (NSDictionary *)cacheStatistics;
+
+// When enabled, the images of button states, button contents and gradient patterns are packed into a few shared
+// bitmaps instead of one for each image (see TKImageAtlas.h). Off by default, the images look and stretch the same either way
+@property (nonatomic) BOOL packsImagesIntoAtlas;
+
+// When enabled, subtrees made only of rectangles, ellipses and paths (and containers of those) without bindings
+// are drawn by a single view, instead of a view per description. Off by default, the views are then identical
+// to the ones built without flattening, except that the flattened parts can not be reached as subviews
+@property (nonatomic) BOOL flattensStaticSubtrees;
+
+// Number of subtrees flattened, views saved by it and the estimated backing store bytes saved, as NSNumbers
+- (NSDictionary *)flatteningStatistics;
+
+// Turns the phase timers and draw counters on (see TKInstrumentation.h), off by default
+@property (nonatomic) BOOL instrumentationEnabled;
+
+// Everything measured so far in one dictionary - the phases and counters of the instrumentation under "phases" and
+// "counters", the statistics of the caches (see -cacheStatistics) under "caches" and of the flattening under "flattening"
+- (NSDictionary *)instrumentationSnapshot;
+
 // Main generator, uses caching on the solution, not the data
 - (UIView *)viewHierarchyFromJSON: (NSData *)JSONData bindings: (NSDictionary **)bindings;
 
 // Secondary generator, just as a convienience
+// If a compiled theme (.tkb) exists next to the JSON file, it is used instead
 - (UIView *)viewHierarchyForJSONAtPath: (NSString *)path bindings: (NSDictionary **)bindings;
 
+// Incremental updates of a hierarchy built by the generators above, the new description is diffed against the one
+// the view was built from and only the views that changed are redrawn or built again, the rest (along with anything
+// added to them since) is left alone. Returns the applied diff, or nil if the view could not be patched, in which
+// case it should be built from scratch. Assumes -flattensStaticSubtrees has not changed since the view was built
+- (TKThemeDiff *)updateViewHierarchy: (UIView *)view withJSON: (NSData *)JSONData bindings: (NSDictionary **)bindings;
+- (TKThemeDiff *)updateViewHierarchy: (UIView *)view withJSONAtPath: (NSString *)path bindings: (NSDictionary **)bindings;
+
+// Reloads the JSON at path whenever it changes and patches the view with it (see TKThemeWatcher.h), meant for
+// development. The view is retained by the watcher, which keeps watching until it is stopped or released
+- (TKThemeWatcher *)watchJSONAtPath: (NSString *)path forViewHierarchy: (UIView *)view handler: (TKThemeUpdateHandler)handler;
+
+// Converts the JSON at path into the binary theme format (see TKThemeArchive.h), the same as the tkc tool does on the build machine
+- (BOOL)compileJSONAtPath: (NSString *)path toPath: (NSString *)archivePath;
+
 // Preffered way of creating images, will cache the results
 - (UIImage *)compressedImageForJSONAtPath: (NSString *)path;
 
 // A helper, will not cache the result, but can be useful nevertheless
 - (UIImage *)compressedImageForView: (UIView *)view;
 
+// Rectangles that can be stretched are drawn once at their smallest size (see TKNineSlice.h), the image is stretchable
+// and looks the same as the full one when stretched to the size of the description. Every size of the same rectangle
+// shares one cached image. Returns nil for descriptions that can't be stretched, buttons use this for their states
+- (UIImage *)stretchableImageForDescription: (NSDictionary *)description;
+
+// Asynchronous versions of the image methods, the completion is called on the main thread with the (cached) image,
+// unless the returned request is cancelled before that. Descriptions that contain labels or buttons need UIKit,
+// those are rendered on the main thread instead of the background workers
+- (TKRenderRequest *)compressedImageForDescription: (NSDictionary *)description completion: (TKRenderCompletion)completion;
+- (TKRenderRequest *)compressedImageForJSONAtPath: (NSString *)path completion: (TKRenderCompletion)completion;
+
+// Number of images rendered at the same time in the background, defaults to the number of cores
+@property (nonatomic) NSInteger maxConcurrentRenders;
+
+// Loads, compiles and renders the themes (.json and .tkb files) ahead of time on the background, so that
+// the calls above are cache hits later on. The caches are keyed by the path, so pass the directory the
+// same way the themes will be loaded later (i.e from -[NSBundle resourcePath])
+- (TKPrewarmTask *)prewarmThemesInDirectory: (NSString *)directory priority: (TKPrewarmPriority)priority;
+- (TKPrewarmTask *)prewarmThemesAtPaths: (NSArray *)paths priority: (TKPrewarmPriority)priority;
+
+// Moves the theme to the front of the queue, if it is still waiting to be prewarmed
+- (void)prioritizeThemeAtPath: (NSString *)path;
+
 @end
\ No newline at end of file
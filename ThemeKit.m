@@ -8,19 +8,54 @@
 
 #import "ThemeKit.h"
 #import "TKPathCommand.h"
+#import "TKPathParser.h"
 #import "TKView.h"
+#import "TKThemeArchive.h"
+#import "TKThemeCompiler.h"
+#import "TKResourcePool.h"
+
+#import <objc/runtime.h>
 
 #pragma mark - Drawing Extension
 
-@interface ThemeKit (DrawingExtensions)
+@interface ThemeKit (DrawingExtensions) <TKRendererDataSource>
 
 - (UIView *)viewHierarchyForJSONDictionary: (NSDictionary *)JSON bindings: (NSDictionary **)bindings;
 
+#pragma mark - Loading
+
+// Deserializes the JSON, returns nil on error
+- (NSDictionary *)JSONDictionaryFromData: (NSData *)JSONData;
+
+// Prefers the compiled archive (.tkb) next to the file at path, if it's up to date
+- (NSDictionary *)JSONDictionaryAtPath: (NSString *)path;
+
+// Same, but goes through the JSON cache
+- (NSDictionary *)cachedJSONDictionaryAtPath: (NSString *)path;
+
 #pragma mark - Factory methods
 
 - (UIView *)addSubviewsWithDescriptions: (NSArray *)descriptions toView: (UIView *)view bindings: (NSMutableDictionary *)bindings;
 - (UIView *)viewForDescription: (NSDictionary *)description bindings: (NSMutableDictionary *)bindings;
 
+// Subview as added by the method above, flattened if possible, layoutSize is the size its parent grows to fit
+- (UIView *)subviewForDescription: (NSDictionary *)description layoutSize: (CGSize *)layoutSize bindings: (NSMutableDictionary *)bindings;
+
+// Flattening, a static subtree has more than one node, no bindings and can be drawn without UIKit
+- (BOOL)canFlattenDescription: (NSDictionary *)description;
+- (UIView *)flattenedViewForNode: (TKRenderNode *)node;
+
+#pragma mark - Patching
+// Fails for views not built by ThemeKit, or when the outermost view would have to be built again
+- (TKThemeDiff *)updateViewHierarchy: (UIView *)view withJSONDictionary: (NSDictionary *)JSON bindings: (NSDictionary **)bindings;
+
+// Applies the diff to the view built from its old description, returns the view to use instead (the same one,
+// unless it had to be built again)
+- (UIView *)patchView: (UIView *)view withDiff: (TKThemeDiff *)diff;
+- (void)patchSubviewsOfView: (UIView *)view withDiff: (TKThemeDiff *)diff;
+- (CGRect)baseFrameOfView: (UIView *)view forDescription: (NSDictionary *)description;
+- (void)collectBindingsOfView: (UIView *)view intoDictionary: (NSMutableDictionary *)bindings;
+
 #pragma mark - Quick images
 
 - (UIImage *)patternGradientForGradientProperties: (NSDictionary *)properties height: (NSInteger)height;
@@ -28,28 +63,132 @@
 // Preferred compression method, is capable of using caching of the image
 - (UIImage *)compressedImageForDescription: (NSDictionary *)description;
 
+// Same as above, packed into the image atlas when that is enabled
+- (UIImage *)atlasImageForDescription: (NSDictionary *)description;
+
+// Background of a button state, the minimal image if it can be stretched (see TKNineSlice.h) and the whole
+// image otherwise, made stretchable if the state asks for it
+- (UIImage *)backgroundImageForButtonState: (NSDictionary *)state;
+
+// Image tiers, memory first and then the disk (if enabled), storing writes into both
+- (UIImage *)cachedImageForDescription: (NSDictionary *)description;
+- (void)cacheImage: (UIImage *)image forDescription: (NSDictionary *)description;
+
+// Renders the images of the descriptions in parallel into the image cache, for callers that need several at once
+- (void)prerenderDescriptions: (NSArray *)descriptions;
+
+// Scale used for all of the images
+- (CGFloat)screenScale;
+
+#pragma mark - Prewarming
+
+// Loads the theme into the JSON cache, compiles all of its primitives and renders the images it needs
+- (BOOL)prewarmThemeAtPath: (NSString *)path scale: (CGFloat)scale;
+- (void)prewarmDescriptions: (NSArray *)descriptions scale: (CGFloat)scale;
+- (void)prewarmImageForDescription: (NSDictionary *)description scale: (CGFloat)scale;
+
 #pragma mark - Primitives
+- (TKDisplayList *)displayListForDescription: (NSDictionary *)description frame: (CGRect)frame;     // Compiled, cached, see below
 - (TKView *)rectangleInFrame: (CGRect)frame options: (NSDictionary *)options;      // Rectangle
 - (TKView *)circleInFrame: (CGRect)frame options: (NSDictionary *)options;         // Circle
 - (TKView *)pathForOptions: (NSDictionary *)options;      // Path
 - (UILabel *)labelInFrame: (CGRect)frame forOptions: (NSDictionary *)options;
+- (UIView *)staticLabelInFrame: (CGRect)frame forOptions: (NSDictionary *)options;        // Image of the text run, see TKTextRun.h
 - (UIButton *)buttonInFrame: (CGRect)frame forOptions: (NSDictionary *)options;
 
+// Descriptions of all of the images of a button - the backgrounds of its states and their content images
+- (NSArray *)imageDescriptionsForButton: (NSDictionary *)description;
+
 // Path, following SVG standard syntax
 - (CGMutablePathRef)pathForSVGSyntax: (NSString *)description;
 
+// SVG Paths, parses the description into buffer (see TKPathParser.h), logs syntax errors
+- (BOOL)parseSVGDescription: (NSString *)description intoBuffer: (TKPathBuffer *)buffer;
+
 // SVG Paths, returns an array of TKPathCommand objects, 
 // containing instructions on how to draw the description
 - (NSArray *)arrayOfPathCommandsFromSVGDescription: (NSString *)description;
-- (CGPoint)pointFromScanner: (NSScanner *)scanner relativeToPoint: (CGPoint)currentPoint;
 
 @end
 
+#pragma mark - View descriptions
+
+// Views remember the description they were built from, so that they can be patched later on
+static char TKViewDescriptionKey;
+static char TKViewLayoutSizeKey;
+
+static void TKViewSetDescription(UIView *view, NSDictionary *description) {
+    objc_setAssociatedObject(view, &TKViewDescriptionKey, description, OBJC_ASSOCIATION_RETAIN_NONATOMIC);
+}
+
+static NSDictionary *TKViewGetDescription(UIView *view) {
+    return objc_getAssociatedObject(view, &TKViewDescriptionKey);
+}
+
+// Flattened views are larger than the size their parent makes room for (see -addSubviewsWithDescriptions:toView:bindings:)
+static void TKViewSetFlattenedLayoutSize(UIView *view, CGSize size) {
+    objc_setAssociatedObject(view, &TKViewLayoutSizeKey, [NSValue valueWithCGSize: size], OBJC_ASSOCIATION_RETAIN_NONATOMIC);
+}
+
+static BOOL TKViewIsFlattened(UIView *view) {
+    return objc_getAssociatedObject(view, &TKViewLayoutSizeKey) != nil;
+}
+
+static CGSize TKViewLayoutSize(UIView *view) {
+    NSValue *size = objc_getAssociatedObject(view, &TKViewLayoutSizeKey);
+    if (size)
+        return [size CGSizeValue];
+
+    return view.frame.size;
+}
+
+#pragma mark - Cache costs
+
+// Budgets of the caches, images are by far the largest objects
+#define kImageCacheDefaultByteLimit (8 * 1024 * 1024)
+#define kDisplayListCacheDefaultByteLimit (1024 * 1024)
+#define kJSONCacheDefaultByteLimit (2 * 1024 * 1024)
+
+// Memory warnings that follow each other within this many seconds raise the pressure a level
+#define kMemoryWarningInterval 30.0
+
+// Parsed JSON takes a few times the size of the text, the objects read from archives only exist once they are used
+#define kJSONCostPerByte 4
+
+static size_t TKImageCost(UIImage *image) {
+    CGImageRef imageRef = image.CGImage;
+    if (!imageRef)
+        return 0;
+    
+    // Width and height are in pixels, so this is size * scale^2 * 4 for the usual BGRA images
+    return CGImageGetBytesPerRow(imageRef) * CGImageGetHeight(imageRef);
+}
+
+static size_t TKDisplayListCost(TKDisplayList *displayList) {
+    size_t cost = 64 + [displayList count] * sizeof(TKDisplayItem);
+    
+    // Path outlines are the only part that isn't shared through the resource pool
+    const TKDisplayItem *items = [displayList items];
+    for (NSUInteger i = 0; i < [displayList count]; i++) {
+        if (items[i].path)
+            cost += 256;
+    }
+    
+    return cost;
+}
+
+static size_t TKJSONCostForPath(NSString *path) {
+    NSDictionary *attributes = [[NSFileManager defaultManager] attributesOfItemAtPath: path error: NULL];
+    return (size_t)[attributes fileSize] * kJSONCostPerByte;
+}
+
 #pragma mark - Drawing Implementation
 
 @implementation ThemeKit (DrawingExtensions)
 
 - (UIView *)viewHierarchyForJSONDictionary: (NSDictionary *)JSON bindings: (NSDictionary **)bindings {
+    TKInstrumentBegin(timer);
+    
     // Create a dictionary into the bindings
     NSMutableDictionary *bindDictionary = nil;
     if (bindings != NULL) {
@@ -98,14 +237,99 @@
         [bindDictionary setObject: view forKey: [JSON objectForKey: BindingVariableName]];
     }
     
+    // For patching the hierarchy later on
+    TKViewSetDescription(view, JSON);
+    
     // IF there is a binding, move the temporary dictionary to the final one
     if (bindings != NULL && [bindDictionary count] > 0) {
         *bindings = [NSDictionary dictionaryWithDictionary: bindDictionary];
     }
     
+    TKInstrumentEnd(TKInstrumentationPhaseBuild, timer);
     return view;
 }
 
+#pragma mark - Loading
+
+- (NSDictionary *)JSONDictionaryFromData: (NSData *)JSONData {
+    if (!JSONData)
+        return nil;
+    
+    TKInstrumentBegin(timer);
+    
+    // Built straight from the bytes, deeper views only when they are first needed (see TKJSONBuilder.h)
+    NSDictionary *JSONDictionary = TKJSONObjectFromData(JSONData, kJSONLazyViewDepth);
+    if (!JSONDictionary) {
+        // Failed parses take time as well
+        TKInstrumentEnd(TKInstrumentationPhaseParse, timer);
+        return nil;
+    }
+    
+    // Expand the components before anything is hashed, the parts they share are then hashed only once
+    JSONDictionary = TKResolveComponents(JSONDictionary);
+    
+    // Hash the whole tree now, so that cache lookups later on only read the remembered hashes
+    TKStructuralHashForObject(JSONDictionary);
+    
+    TKInstrumentEnd(TKInstrumentationPhaseParse, timer);
+    return JSONDictionary;
+}
+
+- (NSDictionary *)JSONDictionaryAtPath: (NSString *)path {
+    // Find the compiled version of the file, the path itself may point to one
+    NSString *archivePath = path;
+    if (![[path pathExtension] isEqualToString: TKThemeArchivePathExtension])
+        archivePath = [[path stringByDeletingPathExtension] stringByAppendingPathExtension: TKThemeArchivePathExtension];
+    
+    NSFileManager *manager = [NSFileManager defaultManager];
+    if ([manager fileExistsAtPath: archivePath]) {
+        // Only use it if the JSON has not been edited since compiling
+        NSDate *archiveDate = [[manager attributesOfItemAtPath: archivePath error: NULL] fileModificationDate];
+        NSDate *JSONDate = nil;
+        if (archivePath != path)
+            JSONDate = [[manager attributesOfItemAtPath: path error: NULL] fileModificationDate];
+        
+        if (!JSONDate || [JSONDate compare: archiveDate] != NSOrderedDescending) {
+            TKInstrumentBegin(timer);
+            id root = [[TKThemeArchive archiveWithContentsOfFile: archivePath] rootObject];
+            
+            // Archives keep the components as they were written, they are expanded like the ones of the JSON. Archives
+            // carry the hashes of their nodes, only the expanded descriptions need theirs computed
+            id resolved = TKResolveComponents(root);
+            if (resolved != root)
+                TKStructuralHashForObject(resolved);
+            TKInstrumentEnd(TKInstrumentationPhaseArchive, timer);
+            
+            if ([resolved isKindOfClass: [NSDictionary class]])
+                return resolved;
+        }
+    }
+    
+    return [self JSONDictionaryFromData: [NSData dataWithContentsOfFile: path]];
+}
+
+- (NSDictionary *)cachedJSONDictionaryAtPath: (NSString *)path {
+    NSDictionary *JSONDictionary = nil;
+    
+#if kCachingEnabled
+    // Check the cache first for JSON
+    JSONDictionary = [_JSONCache objectForKey: path];
+    if (JSONDictionary)
+        return JSONDictionary;
+#endif
+    
+    // Load the description, either from the compiled archive or the JSON itself
+    JSONDictionary = [self JSONDictionaryAtPath: path];
+    
+#if kCachingEnabled
+    // Cache the JSON
+    if (JSONDictionary)
+        [_JSONCache setObject: JSONDictionary forKey: path cost: TKJSONCostForPath(path)];
+#endif
+    
+    return JSONDictionary;
+}
+
 #pragma mark - Factory methods
 
 - (UIView *)addSubviewsWithDescriptions: (NSArray *)descriptions toView: (UIView *)view bindings: (NSMutableDictionary *)bindings {    
@@ -116,7 +340,8 @@
     // Iterate over the descriptions and add the views as subviews
     for (NSDictionary *viewDesc in descriptions) {
         // Add the subview
-        UIView *subview = [self viewForDescription: viewDesc bindings: bindings];
+        CGSize subviewSize;
+        UIView *subview = [self subviewForDescription: viewDesc layoutSize: &subviewSize bindings: bindings];
         
         if ([view isKindOfClass: [UIButton class]]) {
             [subview setExclusiveTouch: NO];
@@ -126,8 +351,8 @@
         [view insertSubview: subview atIndex: [descriptions indexOfObject: viewDesc] + 1];
         
         // Adjust the finalsize
-        finalSize.width = MAX(finalSize.width, CGRectGetWidth(subview.frame));
-        finalSize.height = MAX(finalSize.height, CGRectGetHeight(subview.frame));
+        finalSize.width = MAX(finalSize.width, subviewSize.width);
+        finalSize.height = MAX(finalSize.height, subviewSize.height);
     }
     
     // Adjust the view so that it matches the contents
@@ -138,24 +363,36 @@
     return view;
 }
 
+- (UIView *)subviewForDescription: (NSDictionary *)description layoutSize: (CGSize *)layoutSize bindings: (NSMutableDictionary *)bindings {
+    UIView *subview;
+    CGSize subviewSize;
+    
+    if (_flattensStaticSubtrees && [self canFlattenDescription: description]) {
+        // The layout is still the one of the separate views, the flattened view may be larger than that
+        TKRenderNode *node = [_renderer nodeForDescription: description];
+        subview = [self flattenedViewForNode: node];
+        subviewSize = node.frame.size;
+        TKViewSetFlattenedLayoutSize(subview, subviewSize);
+    } else {
+        subview = [self viewForDescription: description bindings: bindings];
+        subviewSize = subview.frame.size;
+    }
+    
+    if (subview)
+        TKViewSetDescription(subview, description);
+    
+    if (layoutSize != NULL)
+        *layoutSize = subviewSize;
+    
+    return subview;
+}
+
 - (UIView *)viewForDescription: (NSDictionary *)description bindings: (NSMutableDictionary *)bindings {
     // First start by identifying the type of the view
     NSString *type = [description objectForKey: TypeParameterKey];
     
-    // Get the frame of the view, they all need to have it = it's type independent (line is an exception)
-    CGPoint origin = CGPointZero;
-    if ([description objectForKey: OriginParameterKey]) {
-        origin.x = [[[description objectForKey: OriginParameterKey] objectForKey: XCoordinateParameterKey] floatValue];
-        origin.y = [[[description objectForKey: OriginParameterKey] objectForKey: YCoordinateParameterKey] floatValue];
-    }
-    
-    CGRect frame = CGRectZero;
-    // Size will be determined for views, paths don't need to have size specified (will be calculated)
-    if (![type isEqualToString: PathTypeKey]) {
-        frame = CGRectMake(origin.x, origin.y,
-                           [[[description objectForKey: SizeParameterKey] objectForKey: WidthParameterKey] floatValue],
-                           [[[description objectForKey: SizeParameterKey] objectForKey: HeightParameterKey] floatValue]);
-    }
+    // Get the frame of the view, they all need to have it = it's type independent (paths are an exception)
+    CGRect frame = TKFrameForDescription(description);
     
     // Resulting view
     UIView *result = nil;
@@ -176,7 +413,11 @@
     } else if ([type isEqualToString: PathTypeKey]) {
         result = [self pathForOptions: description];
     } else if ([type isEqualToString: LabelTypeKey]) {
-        result = [self labelInFrame: frame forOptions: description];
+        // Only bound labels are live, the text of the rest never changes
+        if ([description objectForKey: BindingVariableName])
+            result = [self labelInFrame: frame forOptions: description];
+        else
+            result = [self staticLabelInFrame: frame forOptions: description];
     } else if ([type isEqualToString: ButtonTypeKey]) {
         result = [self buttonInFrame: frame forOptions: description];
     } else {
@@ -198,6 +439,202 @@
     return result;
 }
 
+// Bound views have to stay separate, the caller will want to get at them
+static BOOL TKDescriptionContainsBinding(NSDictionary *description) {
+    if ([description objectForKey: BindingVariableName])
+        return YES;
+    
+    for (NSDictionary *subview in [description objectForKey: SubviewSectionKey]) {
+        if (TKDescriptionContainsBinding(subview))
+            return YES;
+    }
+    
+    return NO;
+}
+
+- (BOOL)canFlattenDescription: (NSDictionary *)description {
+    // A single primitive is a single view anyway
+    if ([[description objectForKey: SubviewSectionKey] count] == 0 || ![description objectForKey: TypeParameterKey])
+        return NO;
+    
+    return [TKRenderer canRenderDescription: description] && !TKDescriptionContainsBinding(description);
+}
+
+- (UIView *)flattenedViewForNode: (TKRenderNode *)node {
+    // Everything the subtree draws, children reaching outside of their parents included, as nothing may be clipped
+    CGRect bounds = [node drawingBounds];
+    if (CGRectIsNull(bounds))
+        bounds = CGRectMake(0.0, 0.0, CGRectGetWidth(node.frame), CGRectGetHeight(node.frame));
+    
+    bounds = CGRectIntegral(bounds);
+    
+    TKView *view = [TKView viewWithFrame: CGRectOffset(bounds, node.frame.origin.x, node.frame.origin.y) andDrawingBlock: ^(CGContextRef context, CGRect rect) {
+        CGContextSaveGState(context);
+        CGContextTranslateCTM(context, -bounds.origin.x, -bounds.origin.y);
+        [node drawInContext: context dirtyRect: CGContextGetClipBoundingBox(context)];
+        CGContextRestoreGState(context);
+    }];
+    
+    // What the separate views would have cost
+    CGFloat scale = [self screenScale];
+    long long flattenedBytes = (long long)ceil(CGRectGetWidth(bounds) * scale) * (long long)ceil(CGRectGetHeight(bounds) * scale) * 4;
+    
+    _flattenedSubtrees++;
+    _flattenedViews += [node nodeCount] - 1;
+    _flattenedBytes += (long long)[node backingStoreBytesForScale: scale] - flattenedBytes;
+    
+    return view;
+}
+
+#pragma mark - Patching
+
+- (TKThemeDiff *)updateViewHierarchy: (UIView *)view withJSONDictionary: (NSDictionary *)JSON bindings: (NSDictionary **)bindings {
+    // Only views built by ThemeKit know what they were built from
+    NSDictionary *previousJSON = TKViewGetDescription(view);
+    if (!previousJSON || !JSON)
+        return nil;
+    
+    TKThemeDiff *diff = [TKThemeDiff diffFromDescription: previousJSON toDescription: JSON];
+    if (diff.type == TKThemeDiffReplace)
+        return nil;
+    
+    if (diff.type == TKThemeDiffUpdate) {
+        view.frame = [self baseFrameOfView: view forDescription: JSON];
+        
+        if ([JSON objectForKey: ColorParameterKey])
+            view.backgroundColor = [UIColor colorForWebColor: [JSON objectForKey: ColorParameterKey]];
+        else
+            view.backgroundColor = [UIColor clearColor];
+    }
+    
+    if (![diff isEmpty]) {
+        TKViewSetDescription(view, JSON);
+        [self patchSubviewsOfView: view withDiff: diff];
+    }
+    
+    // Bound views may have been built again, collect them from the patched hierarchy
+    if (bindings != NULL) {
+        NSMutableDictionary *bindDictionary = [NSMutableDictionary dictionary];
+        [self collectBindingsOfView: view intoDictionary: bindDictionary];
+        
+        *bindings = [bindDictionary count] > 0 ? [NSDictionary dictionaryWithDictionary: bindDictionary] : nil;
+    }
+    
+    return diff;
+}
+
+- (UIView *)patchView: (UIView *)view withDiff: (TKThemeDiff *)diff {
+    NSDictionary *description = diff.toDescription;
+    
+    // Flattened subtrees are drawn as a whole, there is nothing inside of them to patch
+    BOOL rebuild = diff.type == TKThemeDiffInsert || diff.type == TKThemeDiffReplace || TKViewIsFlattened(view);
+    if (!rebuild && _flattensStaticSubtrees && [self canFlattenDescription: description])
+        rebuild = YES;
+    
+    if (diff.type == TKThemeDiffNone) {
+        return view;
+    } else if (rebuild) {
+        return [self subviewForDescription: description layoutSize: NULL bindings: nil];
+    }
+    
+    if (diff.type == TKThemeDiffUpdate) {
+        // Only the drawing of the view itself changes, it keeps its subviews
+        if ([view isKindOfClass: [TKView class]] && [(TKView *)view displayList])
+            [(TKView *)view setDisplayList: [self displayListForDescription: description frame: TKFrameForDescription(description)]];
+        
+        view.frame = [self baseFrameOfView: view forDescription: description];
+    }
+    
+    TKViewSetDescription(view, description);
+    [self patchSubviewsOfView: view withDiff: diff];
+    
+    return view;
+}
+
+- (void)patchSubviewsOfView: (UIView *)view withDiff: (TKThemeDiff *)diff {
+    // Subviews built from the old description, in the same order as it lists them
+    NSMutableArray *previousSubviews = [NSMutableArray array];
+    for (UIView *subview in view.subviews) {
+        if (TKViewGetDescription(subview))
+            [previousSubviews addObject: subview];
+    }
+    
+    CGSize finalSize = [self baseFrameOfView: view forDescription: diff.toDescription].size;
+    
+    if ([previousSubviews count] != [[diff.fromDescription objectForKey: SubviewSectionKey] count]) {
+        // Not what the description says (some were skipped or removed since), start over with the subviews
+        [previousSubviews makeObjectsPerformSelector: @selector(removeFromSuperview)];
+        
+        for (NSDictionary *subviewDescription in [diff.toDescription objectForKey: SubviewSectionKey]) {
+            CGSize subviewSize;
+            UIView *subview = [self subviewForDescription: subviewDescription layoutSize: &subviewSize bindings: nil];
+            if (!subview)
+                continue;
+            
+            [view addSubview: subview];
+            finalSize.width = MAX(finalSize.width, subviewSize.width);
+            finalSize.height = MAX(finalSize.height, subviewSize.height);
+        }
+    } else {
+        [[previousSubviews objectsAtIndexes: diff.removedIndexes] makeObjectsPerformSelector: @selector(removeFromSuperview)];
+        
+        UIView *previous = nil;
+        NSUInteger lastIndex = NSNotFound;
+        
+        for (TKThemeDiff *child in diff.children) {
+            UIView *subview = child.fromIndex != NSNotFound ? [previousSubviews objectAtIndex: child.fromIndex] : nil;
+            UIView *patched = [self patchView: subview withDiff: child];
+            
+            // Views that stay in the same order are not touched
+            BOOL inPlace = patched == subview && (lastIndex == NSNotFound || child.fromIndex > lastIndex);
+            if (patched != subview)
+                [subview removeFromSuperview];
+            
+            if (!patched)
+                continue;
+            
+            if (!inPlace) {
+                if (previous)
+                    [view insertSubview: patched aboveSubview: previous];
+                else
+                    [view insertSubview: patched atIndex: 0];
+            }
+            
+            if (patched == subview)
+                lastIndex = child.fromIndex;
+            
+            CGSize subviewSize = TKViewLayoutSize(patched);
+            finalSize.width = MAX(finalSize.width, subviewSize.width);
+            finalSize.height = MAX(finalSize.height, subviewSize.height);
+            
+            previous = patched;
+        }
+    }
+    
+    // Same as when building, the view grows to fit the subviews
+    CGRect frame = view.frame;
+    frame.size = finalSize;
+    view.frame = frame;
+}
+
+- (CGRect)baseFrameOfView: (UIView *)view forDescription: (NSDictionary *)description {
+    // Frame of the view before it grew to fit its subviews, primitives include their shadows and strokes
+    if ([view isKindOfClass: [TKView class]] && [(TKView *)view displayList])
+        return [[(TKView *)view displayList] frameForDescription: description];
+    
+    return TKFrameForDescription(description);
+}
+
+- (void)collectBindingsOfView: (UIView *)view intoDictionary: (NSMutableDictionary *)bindings {
+    NSString *name = [TKViewGetDescription(view) objectForKey: BindingVariableName];
+    if (name)
+        [bindings setObject: view forKey: name];
+    
+    for (UIView *subview in view.subviews) {
+        [self collectBindingsOfView: subview intoDictionary: bindings];
+    }
+}
+
 #pragma mark - Quick images
 
 - (UIImage *)patternGradientForGradientProperties: (NSDictionary *)properties height: (NSInteger)height { 
@@ -209,7 +646,7 @@
                           properties, GradientFillOptionKey, nil];
     
     // Create the image
-    UIImage *image = [self compressedImageForDescription: view];
+    UIImage *image = [self atlasImageForDescription: view];
     
     // Make it stretchable
     image = [image stretchableImageWithLeftCapWidth: 1.0 topCapHeight: height - 1.0];
@@ -220,813 +657,268 @@
 - (UIImage *)compressedImageForDescription: (NSDictionary *)description {
     UIImage *image;
     
-#if kCachingEnabled
-    // Check the cache
-    if ([_imageCache objectForKey: description]) {
-        return [_imageCache objectForKey: description];
+    if (!description)
+        return nil;
+    
+    // Check the caches, the key is the structural hash of the description
+    image = [self cachedImageForDescription: description];
+    if (image)
+        return image;
+        
+    if ([TKRenderer canRenderDescription: description]) {
+        // Primitives are drawn straight into a bitmap, without creating any views
+        image = [_renderer imageForDescription: description scale: [self screenScale]];
+    } else if (![description objectForKey: TypeParameterKey]) {
+        // Outermost view of a theme
+        image = [self compressedImageForView: [self viewHierarchyForJSONDictionary: description bindings: NULL]];
+    } else {
+        image = [self compressedImageForView: [self viewForDescription: description bindings: NULL]];
     }
-#endif
-        
-    image = [self compressedImageForView: [self viewForDescription: description bindings: NULL]];
     
+    // Store the image to the caches
+    [self cacheImage: image forDescription: description];
+    
+    return image;
+}
+
+- (UIImage *)cachedImageForDescription: (NSDictionary *)description {
 #if kCachingEnabled
-    // Store the image to the cache
+    UIImage *image = [_imageCache objectForKey: description];
+    if (image || !_diskImageCache)
+        return image;
+    
+    // Mapped from disk, kept in memory from then on
+    image = [_diskImageCache imageForHash: TKStructuralHashForObject(description) scale: [self screenScale]];
     if (image)
-        [_imageCache setObject: image forKey: description];
-#endif
+        [_imageCache setObject: image forKey: description cost: TKImageCost(image)];
     
     return image;
+#else
+    return nil;
+#endif
 }
 
-#pragma mark - Primitives
+- (void)cacheImage: (UIImage *)image forDescription: (NSDictionary *)description {
+#if kCachingEnabled
+    if (!image)
+        return;
+    
+    [_imageCache setObject: image forKey: description cost: TKImageCost(image)];
+    [_diskImageCache setImage: image forHash: TKStructuralHashForObject(description)];
+#endif
+}
 
-- (TKView *)rectangleInFrame: (CGRect)frame options: (NSDictionary *)options {
-    // Keep note of any changes to the offset of drawing, this points to where, the main view should begin and how big it should be
-    CGPoint origin = CGPointMake(0.0, 0.0);
+- (UIImage *)atlasImageForDescription: (NSDictionary *)description {
+    UIImage *image = [self compressedImageForDescription: description];
+    if (!_packsImagesIntoAtlas || !_imageAtlas || !image || [_imageAtlas containsImage: image])
+        return image;
     
-    // Additionally keep track of the canvasrect
-    CGRect canvasRect = frame;
+    UIImage *packed = [_imageAtlas imageByPackingImage: image];
     
-    // If outer stroke, enlarge the frame
-    if ([options objectForKey: OuterStrokeOptionKey]) {
-        CGFloat strokeWidth = [[[options objectForKey: OuterStrokeOptionKey] objectForKey: WidthParameterKey] floatValue];
-        
-        // Create a stroke rect
-        CGRect strokeRect = TKStrokeRectForRectAndWidth(frame, strokeWidth);
+#if kCachingEnabled
+    // The memory tier hands out the packed image from now on, the disk tier keeps an image of its own
+    if (packed != image)
+        [_imageCache setObject: packed forKey: description cost: TKImageCost(packed)];
+#endif
+    
+    return packed;
+}
+
+- (UIImage *)stretchableImageForDescription: (NSDictionary *)description {
+    // Descriptions from outside may be mutable, the copy remembers its hash for the lookups below
+    description = TKImmutableDescription(description);
+    
+    TKNineSlice slice;
+    if (!TKNineSliceMake(&slice, description))
+        return nil;
+    
+    UIImage *image = [self atlasImageForDescription: TKNineSliceDescription(description, &slice)];
+    return [image stretchableImageWithLeftCapWidth: slice.leftCapWidth topCapHeight: slice.topCapHeight];
+}
+
+- (UIImage *)backgroundImageForButtonState: (NSDictionary *)state {
+    UIImage *image = [self stretchableImageForDescription: state];
+    if (image)
+        return image;
+    
+    image = [self atlasImageForDescription: state];
+    if ([state objectForKey: ButtonViewStretchable]) {
+        // The stretchable property contains 2 values, the left and top cap widths
+        NSArray *values = [state objectForKey: ButtonViewStretchable];
+        CGFloat top = [[values objectAtIndex: 1] floatValue];
+        CGFloat left = [[values objectAtIndex: 0] floatValue];
         
-        // Find a union between the canvas and stroke rect
-        canvasRect = CGRectUnion(canvasRect, strokeRect);
+        image = [image stretchableImageWithLeftCapWidth: left topCapHeight: top];
     }
     
-    // If drop shadow is present adjust the size
-    if ([options objectForKey: DropShadowOptionKey]) {
-        // Create a special frame for the shadow
-        NSDictionary *dictionary = [options objectForKey: DropShadowOptionKey];
-        CGRect shadowRect = TKShadowRectForRectAndOptions(frame, dictionary);
+    return image;
+}
+
+- (void)prerenderDescriptions: (NSArray *)descriptions {
+#if kCachingEnabled
+    // Only what the workers can draw and is not in the cache yet, each description once
+    NSMutableArray *pending = [NSMutableArray arrayWithCapacity: [descriptions count]];
+    NSMutableSet *hashes = [NSMutableSet setWithCapacity: [descriptions count]];
+    
+    for (NSDictionary *description in descriptions) {
+        NSNumber *hash = [NSNumber numberWithUnsignedLongLong: TKStructuralHashForObject(description).value];
+        if ([hashes containsObject: hash] || ![TKRenderer canRenderDescription: description] || [self cachedImageForDescription: description])
+            continue;
         
-        // Find the union between canvas and shadow
-        canvasRect = CGRectUnion(canvasRect, shadowRect);
+        [hashes addObject: hash];
+        [pending addObject: description];
     }
     
-    // Adjust the inner origin, this is where the actual view is located
-    origin.x = frame.origin.x - canvasRect.origin.x;
-    origin.y = frame.origin.y - canvasRect.origin.y;
+    // A single image is quicker to draw right here, when it is asked for
+    if ([pending count] > 1)
+        [_renderer renderDescriptionsAndWait: pending scale: [self screenScale]];
+#endif
+}
+
+- (CGFloat)screenScale {
+    // Same scale as -compressedImageForView: uses
+    if (UIGraphicsBeginImageContextWithOptions != NULL)
+        return [[UIScreen mainScreen] scale];
     
+    return 1.0;
+}
+
+- (void)renderer: (TKRenderer *)renderer didRenderImage: (UIImage *)image forDescription: (NSDictionary *)description {
 #if kCachingEnabled
-    // Now as we have the frame, check cache for a view with same properties
-    // As a key use the NSDictionary
-    if ([_cache objectForKey: options]) {
-        TKDrawingBlock drawBlock = [_cache objectForKey: options];
-        TKView *result = [TKView viewWithFrame: CGRectMake(frame.origin.x - origin.x, frame.origin.y - origin.y, 
-                                                           canvasRect.size.width, canvasRect.size.height)
-                               andDrawingBlock: drawBlock];
-        
-        return result;
-    }
+    // Called on the workers, the caches are thread-safe
+    [self cacheImage: image forDescription: description];
 #endif
+}
+
+#pragma mark - Prewarming
+
+- (BOOL)prewarmThemeAtPath: (NSString *)path scale: (CGFloat)scale {
+    // Parse the JSON (or map the compiled archive) into the JSON cache
+    NSDictionary *JSONDictionary = [self cachedJSONDictionaryAtPath: path];
+    if (!JSONDictionary)
+        return NO;
     
-    // Also follow the size difference of the canvas vs object
-    CGSize sizeOffset = CGSizeMake(canvasRect.size.width - frame.size.width, canvasRect.size.height - frame.size.height);
+    // The image of the whole theme, if it can be drawn off the main thread, compiles the primitives on the way
+    [self prewarmImageForDescription: JSONDictionary scale: scale];
     
-    // Create the drawing block
-    TKDrawingBlock block = ^(CGContextRef context, CGRect rect) {
-        // Adjust the size of the object
-        CGSize size = CGSizeMake(rect.size.width - sizeOffset.width, rect.size.height - sizeOffset.height);
-        
-        // Now if there are corner-radii defined, make sure all 4 have a value and balance
-        NSObject *corners = [options valueForKey: CornerRadiusParameterKey];
-        
-        // Create an array into which well add the values
-        CGFloat radii[4];
-        
-        // Few variables for rounded corners
-        BOOL rounded = NO;
-        CGMutablePathRef roundedPath;
-        
-        if (corners) {
-            // Set the flag
-            rounded = YES;
-            
-            // First check if it's an array or a simple value
-            if ([corners respondsToSelector: @selector(objectAtIndex:)]) {
-                // Mutate it
-                NSMutableArray *adjustedCorners = [NSMutableArray arrayWithArray: (NSArray *)corners];
-                
-                // Array, make sure it's 4 long
-                int count = 4 - [adjustedCorners count];
-                if ([adjustedCorners count] < 4) {
-                    for (int i = 0; i < count; i++) {
-                        // i refers to the index were copying the value from
-                        [adjustedCorners addObject: [adjustedCorners objectAtIndex: i]];
-                    }
-                }
-                
-                // Adjust the radii
-                radii[0] = [[adjustedCorners objectAtIndex: 0] floatValue];
-                radii[1] = [[adjustedCorners objectAtIndex: 1] floatValue];
-                radii[2] = [[adjustedCorners objectAtIndex: 2] floatValue];
-                radii[3] = [[adjustedCorners objectAtIndex: 3] floatValue];
-                
-                adjustedCorners = nil;  // Hurry up the memory cleaning
-            } else {
-                // Means it's one single value
-                CGFloat radius = [(NSNumber *)corners floatValue];
-                radii[0] = radius;
-                radii[1] = radius;
-                radii[2] = radius;
-                radii[3] = radius;
+    // Whatever is left (i.e themes with labels), along with the images of the buttons
+    [self prewarmDescriptions: [JSONDictionary objectForKey: SubviewSectionKey] scale: scale];
+    
+    return YES;
+}
+
+- (void)prewarmDescriptions: (NSArray *)descriptions scale: (CGFloat)scale {
+    for (NSDictionary *description in descriptions) {
+        NSString *type = [description objectForKey: TypeParameterKey];
+        
+        if ([type isEqualToString: ButtonTypeKey]) {
+            // Buttons are built from the images of their states
+            for (NSDictionary *imageDescription in [self imageDescriptionsForButton: description]) {
+                [self prewarmImageForDescription: imageDescription scale: scale];
             }
-            
-            // Balance the corners
-            TKBalanceCornerRadiiIntoSize(radii, size);
-        }
-        
-        // Create the path incase the rectangle is rounded
-        if (rounded)
-            roundedPath = TKRoundedPathInRectForRadii(radii, CGRectMake(origin.x, origin.y, size.width, size.height));
-        
-        // Drawing code
-        // Start with the main inner view
-        CGContextSaveGState(context);
-        
-        // Alpha
-        if ([options objectForKey: AlphaParameterKey]) {
-            CGContextSetAlpha(context, [[options objectForKey: AlphaParameterKey] floatValue]);
-        }
-        
-        // If shadow needed, add it to the context
-        if ([options objectForKey: DropShadowOptionKey]) {
-            TKContextAddShadowWithOptions(context, [options objectForKey: DropShadowOptionKey]);
+        } else if ([type isEqualToString: EllipseTypeKey] || [type isEqualToString: PathTypeKey] ||
+                   ([type isEqualToString: RectangleTypeKey] && ![[description objectForKey: ContainerParameterKey] boolValue])) {
+            // Into the display list cache
+            [self displayListForDescription: description frame: TKFrameForDescription(description)];
         }
         
-        // Apply the blend mode to the context if one is present
-        if ([options objectForKey: BlendModeParameterKey]) {
-            TKContextSetBlendModeForString(context, [options objectForKey: BlendModeParameterKey]);
-        }
+        [self prewarmDescriptions: [description objectForKey: SubviewSectionKey] scale: scale];
+    }
+}
+
+- (void)prewarmImageForDescription: (NSDictionary *)description scale: (CGFloat)scale {
+#if kCachingEnabled
+    // Without the image cache there is nowhere to keep the result
+    if (![TKRenderer canRenderDescription: description] || [self cachedImageForDescription: description])
+        return;
+    
+    [self cacheImage: [_renderer imageForDescription: description scale: scale] forDescription: description];
+#endif
+}
+
+#pragma mark - Primitives
+
+// Lists are compiled at the origin, so every copy of a description (instances of a component) shares one list
+// wherever it is placed. The frame of the view is the frame of the list moved to the origin of the description,
+// see -[TKDisplayList frameForDescription:]
+- (TKDisplayList *)displayListForDescription: (NSDictionary *)description frame: (CGRect)frame {
+    TKDisplayList *displayList = nil;
+    frame.origin = CGPointZero;
+    
+#if kCachingEnabled
+    // Check cache for an already compiled description, the key is the hash of the description without its origin
+    TKStructuralHash hash = TKStructuralHashExcludingKey(description, OriginParameterKey);
+    displayList = [_cache objectForHash: hash];
+#endif
+    
+    if (!displayList) {
+        TKInstrumentBegin(timer);
         
-        // Load in the fill color
-        if ([options objectForKey: ColorParameterKey])
-            CGContextSetFillColorWithColor(context, [UIColor colorForWebColor: [options objectForKey: ColorParameterKey]].CGColor);
-        else
-            CGContextSetFillColorWithColor(context, [UIColor whiteColor].CGColor);
+        // Compile the description, this resolves all of the options once
+        NSString *type = [description objectForKey: TypeParameterKey];
+        displayList = [[[TKDisplayList alloc] init] autorelease];
         
-        // If rounded use the path, else just fill the rect
-        if (rounded) {        
-            // Add path to context and fill it
-            CGContextAddPath(context, roundedPath);
-            CGContextFillPath(context);
+        if ([type isEqualToString: EllipseTypeKey]) {
+            [displayList addEllipseInFrame: frame options: description];
+        } else if ([type isEqualToString: PathTypeKey]) {
+            // Paths determine their own size, the view is placed by -[TKDisplayList frameForDescription:]
+            [displayList addPath: [self pathForSVGSyntax: [description objectForKey: PathDescriptionKey]] options: description];
         } else {
-            CGContextFillRect(context, CGRectMake(origin.x, origin.y, size.width, size.height));
+            [displayList addRectangleInFrame: frame options: description];
         }
         
-        CGContextRestoreGState(context);
+        TKInstrumentEnd(TKInstrumentationPhaseCompile, timer);
         
-        // Check if gradient is present, if so draw it over the fill
-        if ([options objectForKey: GradientFillOptionKey]) {        
-            CGContextSaveGState(context);
-            
-            // Gradient is present, first clip the context, either to a rect or to a path
-            if (rounded) {            
-                // Add path to context and fill it
-                CGContextAddPath(context, roundedPath);
-                CGContextClip(context);
-            } else {
-                CGContextClipToRect(context, CGRectMake(origin.x, origin.y, size.width, size.height));
-            }
-            
-            NSDictionary *dictionary = [options objectForKey: GradientFillOptionKey];
-            
-            TKContextDrawGradientForOptions(context, dictionary, CGPointMake(origin.x, origin.y), CGPointMake(origin.x, origin.y + size.height));
-            
-            CGContextRestoreGState(context);
-        }
-        
-        // Inner shadow
-        if ([options objectForKey: InnerShadowOptionKey]) {
-            CGContextSaveGState(context);
-            
-            NSDictionary *dictionary = [options objectForKey: InnerShadowOptionKey];
-            
-            // Offset 
-            CGSize offset = CGSizeMake([[[dictionary objectForKey: OffsetParameterKey] objectForKey: XCoordinateParameterKey] floatValue],
-                                       [[[dictionary objectForKey: OffsetParameterKey] objectForKey: YCoordinateParameterKey] floatValue]);
-            
-            // Start by adding the main path into the context
-            if (rounded) {            
-                // Add path to context and fill it
-                CGContextAddPath(context, roundedPath);            
-            } else {
-                CGContextAddRect(context, CGRectMake(origin.x, origin.y, size.width, size.height));
-            }
-            
-            // Create the inverse path
-            CGPathRef currentPath = CGContextCopyPath(context);
-            CGMutablePathRef inversePath = CGPathCreateMutableCopy(currentPath);
-            CGPathAddRect(inversePath, NULL, CGRectInfinite);
-            CGPathRelease(currentPath);
-            
-            // Clip to the main path
-            CGContextClip(context);
-            
-            // Set the shadow settings
-            CGFloat blur = 0.0;
-            if ([dictionary objectForKey: BlurParameterKey])
-                blur = [[dictionary objectForKey: BlurParameterKey] floatValue];
-            
-            UIColor *color = [UIColor blackColor];
-            if ([dictionary objectForKey: ColorParameterKey])
-                color = [UIColor colorForWebColor: [dictionary objectForKey: ColorParameterKey]];
-            
-            if ([dictionary objectForKey: AlphaParameterKey])
-                color = [color colorWithAlphaComponent: [[dictionary objectForKey: AlphaParameterKey] floatValue]];
-            
-            CGContextSetShadowWithColor(context, offset, blur, color.CGColor);
-            
-            if ([dictionary objectForKey: BlendModeParameterKey]) {
-                TKContextSetBlendModeForString(context, [dictionary objectForKey: BlendModeParameterKey]);
-            }
-            
-            CGContextAddPath(context, inversePath);
-            
-            // Fill the inverse path
-            CGContextEOFillPath(context);
-            CGPathRelease(inversePath);
-            
-            CGContextRestoreGState(context);
-        }
-        
-        // Strokes
-        // Outer
-        if ([options objectForKey: OuterStrokeOptionKey]) {
-            CGContextSaveGState(context);
-            
-            // Parameters
-            NSDictionary *dictionary = [options objectForKey: OuterStrokeOptionKey];
-            
-            // Width
-            CGFloat strokeWidth = [[dictionary objectForKey: WidthParameterKey] floatValue];
-            
-            // There is a stroke, either create a path or enlarge the rect slightly
-            CGFloat halfStroke = strokeWidth / 2.0;
-            if (rounded) {
-                // Use the radii to draw a path, but adjust the radii, to be correct for the center of the stroke
-                CGFloat strokeRadii[4] = { radii[0] + halfStroke, radii[1] + halfStroke, radii[2] + halfStroke, radii[3] + halfStroke };
-                
-                CGRect strokerect = CGRectMake(origin.x - strokeWidth / 2.0, origin.y - strokeWidth / 2.0,
-                                               size.width + strokeWidth, size.height + strokeWidth);
-                CGMutablePathRef strokeRoundedPath = TKRoundedPathInRectForRadii(strokeRadii, strokerect);
-                
-                // Add path to context and fill it
-                CGContextAddPath(context, strokeRoundedPath);            
-            } else {
-                // Not rounded, add the rect
-                CGContextAddRect(context, CGRectMake(origin.x - halfStroke, origin.y - halfStroke, size.width + strokeWidth, size.height + strokeWidth));
-            }
-            
-            TKContextStrokePathWithOptions(context, dictionary);
-            
-            CGContextRestoreGState(context);
-        }
-        
-        // Inner
-        if ([options objectForKey: InnerStrokeOptionKey]) {
-            CGContextSaveGState(context);
-            
-            // Parameters
-            NSDictionary *dictionary = [options objectForKey: InnerStrokeOptionKey];
-            
-            // Width
-            CGFloat strokeWidth = [[dictionary objectForKey: WidthParameterKey] floatValue];
-            
-            // There is a stroke, either create a path or enlarge the rect slightly
-            CGFloat halfStroke = strokeWidth / 2.0;
-            if (rounded) {
-                // Use the radii to draw a path, but adjust the radii, to be correct for the center of the stroke
-                CGFloat strokeRadii[4] = { MAX(0.0, radii[0] - halfStroke), MAX(radii[1] - halfStroke, 0.0), MAX(0.0, radii[2] - halfStroke), MAX(0.0, radii[3] - halfStroke) };
-                
-                CGRect strokerect = CGRectMake(origin.x + strokeWidth / 2.0, origin.y + strokeWidth / 2.0,
-                                               size.width - strokeWidth, size.height - strokeWidth);
-                CGMutablePathRef strokeRoundedPath = TKRoundedPathInRectForRadii(strokeRadii, strokerect);
-                
-                // Add path to context and fill it
-                CGContextAddPath(context, strokeRoundedPath);            
-            } else {
-                // Not rounded, add the rect
-                CGContextAddRect(context, CGRectMake(origin.x + halfStroke, origin.y + halfStroke, size.width - strokeWidth, size.height - strokeWidth));
-            }
-            
-            // Stroke the path
-            TKContextStrokePathWithOptions(context, dictionary);
-            
-            CGContextRestoreGState(context);
-        }
-    };
-    
 #if kCachingEnabled
-    // Store into cache, if needed. Use the same key created before
-    [_cache setObject: Block_copy(block) forKey: options];
+        [_cache setObject: displayList forHash: hash cost: TKDisplayListCost(displayList)];
 #endif
+    }
     
-    // Wrap up and create the resulting view
-    TKView *view = [TKView viewWithFrame: CGRectMake(frame.origin.x - origin.x, frame.origin.y - origin.y, 
-                                                     canvasRect.size.width, canvasRect.size.height)
-                         andDrawingBlock: block];
+    return displayList;
+}
+
+- (TKView *)rectangleInFrame: (CGRect)frame options: (NSDictionary *)options {
+    TKDisplayList *displayList = [self displayListForDescription: options frame: frame];
     
-    return view;
+    // The frame of the list includes the shadows and strokes
+    return [TKView viewWithFrame: CGRectOffset([displayList frame], frame.origin.x, frame.origin.y) andDisplayList: displayList];
 }
 
 - (TKView *)circleInFrame:(CGRect)frame options:(NSDictionary *)options {
-    // Keep note of any changes to the offset of drawing, this points to where, the main view should begin and how big it should be
-    CGPoint origin = CGPointMake(0.0, 0.0);
-    
-    // Additionally keep track of the canvasrect
-    CGRect canvasRect = frame;
-    
-    // Check if there is a need for a outer stroke
-    if ([options objectForKey: OuterStrokeOptionKey]) {
-        // Adjust the canvasrect
-        CGFloat strokeWidth = [[[options objectForKey: OuterStrokeOptionKey] objectForKey: WidthParameterKey] floatValue];
-        
-        CGRect strokeRect = TKStrokeRectForRectAndWidth(frame, strokeWidth);
-        
-        // Union to the canvasrect
-        canvasRect = CGRectUnion(canvasRect, strokeRect);
-    }
-    
-    // Check if there is a need for a drop shadow
-    if ([options objectForKey: DropShadowOptionKey]) {
-        // Adjust the canvasrect, first get the property dictionary
-        NSDictionary *shadow = [options objectForKey: DropShadowOptionKey];
-        
-        CGRect shadowRect = TKShadowRectForRectAndOptions(frame, shadow);
-        
-        // Union into the canvas
-        canvasRect = CGRectUnion(canvasRect, shadowRect);
-    }
-    
-    // Adjust the inner origin, this is where the actual view is located
-    origin.x = frame.origin.x - canvasRect.origin.x;
-    origin.y = frame.origin.y - canvasRect.origin.y;
-    
-#if kCachingEnabled
-    // Check cache
-    if ([_cache objectForKey: options]) {
-        TKDrawingBlock block = [_cache objectForKey: options];
-        
-        TKView *view = [TKView viewWithFrame: CGRectMake(frame.origin.x - origin.x, frame.origin.y - origin.x, 
-                                                         canvasRect.size.width, canvasRect.size.height)
-                             andDrawingBlock: block];
-        
-        return view;
-    }
-#endif
-    
-    // Also follow the size difference of the canvas vs object
-    CGSize sizeOffset = CGSizeMake(canvasRect.size.width - frame.size.width, canvasRect.size.height - frame.size.height);
+    TKDisplayList *displayList = [self displayListForDescription: options frame: frame];
     
-    // Create the drawing block
-    TKDrawingBlock block = ^(CGContextRef context, CGRect rect) {
-        // Adjust the size of the object
-        CGSize size = CGSizeMake(rect.size.width - sizeOffset.width, rect.size.height - sizeOffset.height);
-        
-        // Alpha
-        if ([options objectForKey: AlphaParameterKey]) {
-            CGContextSetAlpha(context, [[options objectForKey: AlphaParameterKey] floatValue]);
-        }
-        
-        // Start by drawing the main shape
-        // Start with the main inner view
-        CGContextSaveGState(context);
-        
-        // If shadow needed, draw it
-        if ([options objectForKey: DropShadowOptionKey]) {
-            NSDictionary *dictionary = [options objectForKey: DropShadowOptionKey];
-            TKContextAddShadowWithOptions(context, dictionary);
-        }
-        
-        // Get the blend mode and apply it to the context
-        if ([options objectForKey: BlendModeParameterKey]) {
-            TKContextSetBlendModeForString(context, [options objectForKey: BlendModeParameterKey]);
-        }
-        
-        // Load in the fill color
-        if ([options objectForKey: ColorParameterKey])
-            CGContextSetFillColorWithColor(context, [UIColor colorForWebColor: [options objectForKey: ColorParameterKey]].CGColor);
-        else
-            CGContextSetFillColorWithColor(context, [UIColor whiteColor].CGColor);
-        
-        // Fill in the ellipse
-        CGContextFillEllipseInRect(context, CGRectMake(origin.x, origin.y, size.width, size.height));
-        
-        CGContextRestoreGState(context);
-        
-        // Check if gradient is present, if so draw it over the fill
-        if ([options objectForKey: GradientFillOptionKey]) {        
-            CGContextSaveGState(context);
-            
-            // Gradient is present, clip to the ellipse
-            CGContextAddEllipseInRect(context, CGRectMake(origin.x, origin.y, size.width, size.height));
-            CGContextClip(context);
-            
-            // Draw the gradient
-            NSDictionary *dictionary = [options objectForKey: GradientFillOptionKey];
-            
-            TKContextDrawGradientForOptions(context, dictionary, CGPointMake(origin.x, origin.y), CGPointMake(origin.x, origin.y + size.height));
-            
-            CGContextRestoreGState(context);
-        }
-        
-        // Inner shadow
-        if ([options objectForKey: InnerShadowOptionKey]) {
-            CGContextSaveGState(context);
-            
-            NSDictionary *dictionary = [options objectForKey: InnerShadowOptionKey];
-            
-            
-            // Offset 
-            CGSize offset = CGSizeMake([[[dictionary objectForKey: OffsetParameterKey] objectForKey: XCoordinateParameterKey] floatValue],
-                                       [[[dictionary objectForKey: OffsetParameterKey] objectForKey: YCoordinateParameterKey] floatValue]);
-            
-            // Start by adding the main path into the context
-            CGContextAddEllipseInRect(context, CGRectMake(origin.x, origin.y, size.width, size.height));
-            
-            // Create the inverse path
-            CGPathRef currentPath = CGContextCopyPath(context);
-            CGMutablePathRef inversePath = CGPathCreateMutableCopy(currentPath);
-            CGPathAddRect(inversePath, NULL, CGRectInfinite);
-            CGPathRelease(currentPath);
-            
-            // Clip to the main path
-            CGContextClip(context);
-            
-            // Set the shadow settings
-            CGFloat blur = 0.0;
-            if ([dictionary objectForKey: BlurParameterKey])
-                blur = [[dictionary objectForKey: BlurParameterKey] floatValue];
-            
-            UIColor *color = [UIColor blackColor];
-            if ([dictionary objectForKey: ColorParameterKey])
-                color = [UIColor colorForWebColor: [dictionary objectForKey: ColorParameterKey]];
-            
-            if ([dictionary objectForKey: AlphaParameterKey])
-                color = [color colorWithAlphaComponent: [[dictionary objectForKey: AlphaParameterKey] floatValue]];
-            
-            CGContextSetShadowWithColor(context, offset, blur, color.CGColor);
-            
-            if ([dictionary objectForKey: BlendModeParameterKey]) {
-                TKContextSetBlendModeForString(context, [dictionary objectForKey: BlendModeParameterKey]);
-            }
-            
-            CGContextAddPath(context, inversePath);
-            
-            // Fill the inverse path
-            CGContextEOFillPath(context);
-            CGPathRelease(inversePath);
-                
-            CGContextRestoreGState(context);
-        }
-        
-        // Strokes
-        // Outer
-        if ([options objectForKey: OuterStrokeOptionKey]) {
-            CGContextSaveGState(context);
-            
-            // Parameters
-            NSDictionary *dictionary = [options objectForKey: OuterStrokeOptionKey];
-            
-            // Stroke width
-            CGFloat strokeWidth = [[dictionary objectForKey: WidthParameterKey] floatValue];
-            
-            // There is a stroke, add the ellipse to stroke
-            CGContextAddEllipseInRect(context, CGRectMake(origin.x - strokeWidth / 2.0, origin.y - strokeWidth / 2.0, size.width + strokeWidth, size.height + strokeWidth));
-            
-            if ([dictionary objectForKey: AlphaParameterKey])
-                CGContextSetAlpha(context, [[dictionary objectForKey: AlphaParameterKey] floatValue]);
-            
-            if ([dictionary objectForKey: ColorParameterKey])
-                CGContextSetStrokeColorWithColor(context, [UIColor colorForWebColor: [dictionary objectForKey: ColorParameterKey]].CGColor);
-            else
-                CGContextSetStrokeColorWithColor(context, [UIColor blackColor].CGColor);
-            
-            // Stroke
-            TKContextStrokePathWithOptions(context, dictionary);
-            
-            CGContextRestoreGState(context);
-        }
-        
-        // Inner
-        if ([options objectForKey: InnerStrokeOptionKey]) {
-            CGContextSaveGState(context);
-            
-            // Parameters
-            NSDictionary *dictionary = [options objectForKey: InnerStrokeOptionKey];
-            
-            // Stroke width
-            CGFloat strokeWidth = [[dictionary objectForKey: WidthParameterKey] floatValue];
-            
-            // Add the ellipse
-            CGContextAddEllipseInRect(context, CGRectMake(origin.x + strokeWidth / 2.0, origin.y + strokeWidth / 2.0, size.width - strokeWidth, size.height - strokeWidth));
-            
-            if ([dictionary objectForKey: AlphaParameterKey])
-                CGContextSetAlpha(context, [[dictionary objectForKey: AlphaParameterKey] floatValue]);
-            
-            if ([dictionary objectForKey: ColorParameterKey])
-                CGContextSetStrokeColorWithColor(context, [UIColor colorForWebColor: [dictionary objectForKey: ColorParameterKey]].CGColor);
-            else
-                CGContextSetStrokeColorWithColor(context, [UIColor blackColor].CGColor);
-            
-            // Stroke the path
-            TKContextStrokePathWithOptions(context, dictionary);
-            
-            CGContextRestoreGState(context);
-        }
-    };
-    
-    // Store the block into cache
-#if kCachingEnabled
-    [_cache setObject: Block_copy(block) forKey: options];
-#endif
-    
-    // Wrap up and create the view
-    TKView *view = [TKView viewWithFrame: CGRectMake(frame.origin.x - origin.x, frame.origin.y - origin.y, 
-                                                     canvasRect.size.width, canvasRect.size.height) 
-                         andDrawingBlock: block];
-    
-    return view;
+    return [TKView viewWithFrame: CGRectOffset([displayList frame], frame.origin.x, frame.origin.y) andDisplayList: displayList];
 }
 
 - (TKView *)pathForOptions: (NSDictionary *)options {
-    CGMutablePathRef mainPath = [self pathForSVGSyntax: [options objectForKey: PathDescriptionKey]];
+    TKDisplayList *displayList = [self displayListForDescription: options frame: CGRectZero];
     
-    // Keep note of any changes to the offset of drawing, this points to where, the main view should begin and how big it should be
-    CGPoint origin = CGPointMake(0.0, 0.0);
+    return [TKView viewWithFrame: [displayList frameForDescription: options] andDisplayList: displayList];
+}
 
-    // Calculate the needed size for the rect
-    CGRect bounding = CGPathGetBoundingBox(mainPath);
-    
-    // Additionally keep track of the canvasrect, starts being the main frame
-    CGRect canvasRect = bounding;
-    
-    // If outer stroke, enlarge the frame
-    if ([options objectForKey: OuterStrokeOptionKey]) {
-        CGFloat strokeWidth = [[[options objectForKey: OuterStrokeOptionKey] objectForKey: WidthParameterKey] floatValue];
-        
-        // Create a stroke rect
-        CGRect strokeRect = TKStrokeRectForRectAndWidth(bounding, strokeWidth);
-        
-        // Find a union between the canvas and stroke rect
-        canvasRect = CGRectUnion(canvasRect, strokeRect);
-    }
+- (UIView *)staticLabelInFrame: (CGRect)frame forOptions: (NSDictionary *)description {
+    // Labels that draw the same share the image, wherever they are
+    NSDictionary *run = TKTextRunDescription(description);
+    UIImage *image = [self cachedImageForDescription: run];
     
-    // If drop shadow is present adjust the size
-    if ([options objectForKey: DropShadowOptionKey]) {
-        // Create a special frame for the shadow
-        NSDictionary *dictionary = [options objectForKey: DropShadowOptionKey];
-        CGRect shadowRect = TKShadowRectForRectAndOptions(bounding, dictionary);
+    if (image) {
+        TKInstrumentCount(TKInstrumentationCounterTextRunsReused, 1);
+    } else {
+        TKInstrumentBegin(timer);
+        image = TKTextRunImageForLabel([self labelInFrame: frame forOptions: run], [self screenScale]);
+        TKInstrumentEnd(TKInstrumentationPhaseRasterize, timer);
         
-        // Find the union between canvas and shadow
-        canvasRect = CGRectUnion(canvasRect, shadowRect);
-    }
-    
-    // Adjust the inner origin, this is where the actual view is located
-    origin.x = bounding.origin.x - canvasRect.origin.x;
-    origin.y = bounding.origin.y - canvasRect.origin.y;
-    
-    // And the outer origin, the one for the view itself
-    // Check if the view itself has origin set
-    CGPoint viewOrigin = canvasRect.origin;
-    if ([options objectForKey: OriginParameterKey])
-        viewOrigin = CGPointMake([[[options objectForKey: OriginParameterKey] objectForKey: XCoordinateParameterKey] floatValue],
-                                 [[[options objectForKey: OriginParameterKey] objectForKey: YCoordinateParameterKey] floatValue]);
-    
-    canvasRect.origin = viewOrigin;
-    
-#if kCachingEnabled
-    // Now as we have the frame, check cache for a view with same properties
-    // As a key use the NSDictionary of the description
-    if ([_cache objectForKey: options]) {
-        TKDrawingBlock drawBlock = [_cache objectForKey: options];
-        TKView *view = [TKView viewWithFrame: canvasRect
-                             andDrawingBlock: drawBlock];
-        return view;
+        TKInstrumentCount(TKInstrumentationCounterTextRunsDrawn, 1);
+        [self cacheImage: image forDescription: run];
     }
-#endif
-    
-    // Transform the path to the new origin
-    CGAffineTransform transform = CGAffineTransformMakeTranslation(origin.x - bounding.origin.x, origin.y - bounding.origin.y);
-	
-	// Use a temp path via which to apply the transformation (for pre iOS 5 compatibility)
-	__block CGPathRef adjustedPath;
-	CGMutablePathRef temp = CGPathCreateMutable();
-    
-    CGPathAddPath(temp, &transform, mainPath);
-    adjustedPath = CGPathCreateCopy(temp);
-    
-    CGPathRelease(temp);
-    
-    // Also follow the size difference of the canvas vs object
-    CGSize sizeOffset = CGSizeMake(canvasRect.size.width - bounding.size.width, canvasRect.size.height - bounding.size.height);
-    
-    // Create the drawing block
-    TKDrawingBlock block = ^(CGContextRef context, CGRect rect) {
-        // Adjust the size of the object
-        CGSize size = CGSizeMake(rect.size.width - sizeOffset.width, rect.size.height - sizeOffset.height);
-        
-        // Drawing code
-        // Start with the main inner view
-        CGContextSaveGState(context);
-        
-        // Adjust the path according to the rect
-        CGRect pathBounding = CGPathGetBoundingBox(adjustedPath);
-        CGFloat xRatio = CGRectGetWidth(rect) /  CGRectGetWidth(pathBounding);
-        CGFloat yRatio = CGRectGetHeight(rect) / CGRectGetHeight(pathBounding);
-                
-        // Transform the path one more time
-        // This will ensure the path is always within the given rect
-        if (xRatio > yRatio && yRatio < 1.0) {
-            // Resize in terms of Y axis (as that is bigger)
-            CGMutablePathRef temp = CGPathCreateMutable();
-            CGAffineTransform transform = CGAffineTransformMakeScale(yRatio, yRatio);
-            CGPathAddPath(temp, &transform, adjustedPath);
-
-            CGPathRelease(adjustedPath);
-            adjustedPath = CGPathCreateCopy(temp);
-            
-            CGPathRelease(temp);
-        } else if (xRatio < yRatio && xRatio < 1.0) {            
-            // Resize in terms of X axis
-            CGMutablePathRef temp = CGPathCreateMutable();
-            CGAffineTransform transform = CGAffineTransformMakeScale(xRatio, xRatio);
-            CGPathAddPath(temp, &transform, adjustedPath);
-            
-            CGPathRelease(adjustedPath);
-            adjustedPath = CGPathCreateCopy(temp);
-            
-            CGPathRelease(temp);
-        }
-        
-        // Add the path to the context for filling
-        CGContextAddPath(context, adjustedPath);
-        
-        // If shadow needed, draw it
-        if ([options objectForKey: DropShadowOptionKey]) {
-            NSDictionary *dictionary = [options objectForKey: DropShadowOptionKey];        
-            TKContextAddShadowWithOptions(context, dictionary);
-        }
-        
-        // Alpha
-        if ([options objectForKey: AlphaParameterKey]) {
-            CGContextSetAlpha(context, [[options objectForKey: AlphaParameterKey] floatValue]);
-        }
-        
-        // Check if blend mode is present
-        if ([options objectForKey: BlendModeParameterKey]) {
-            // Get the blend mode and apply it to the context
-            TKContextSetBlendModeForString(context, [options objectForKey: BlendModeParameterKey]);
-        }
-        
-        // Load in the fill color
-        if ([options objectForKey: ColorParameterKey])
-            CGContextSetFillColorWithColor(context, [UIColor colorForWebColor: [options objectForKey: ColorParameterKey]].CGColor);
-        else
-            CGContextSetFillColorWithColor(context, [UIColor whiteColor].CGColor);
-        
-        // Fill the path
-        CGContextFillPath(context);
-        
-        CGContextRestoreGState(context);
-        
-        // Check if gradient is present, if so draw it over the fill
-        if ([options objectForKey: GradientFillOptionKey]) {        
-            CGContextSaveGState(context);
-            
-            // Gradient is present, first clip the context
-            CGContextAddPath(context, adjustedPath);
-            CGContextClip(context);
-            
-            // Draw the gradient
-            NSDictionary *dictionary = [options objectForKey: GradientFillOptionKey];
-            
-            TKContextDrawGradientForOptions(context, dictionary, CGPointMake(origin.x, origin.y), CGPointMake(origin.x, origin.y + size.height));
-            
-            CGContextRestoreGState(context);
-        }
-        
-        // Inner shadow
-        if ([options objectForKey: InnerShadowOptionKey]) {
-            CGContextSaveGState(context);
-            
-            NSDictionary *dictionary = [options objectForKey: InnerShadowOptionKey];
-            
-            
-            // Offset 
-            CGSize offset = CGSizeMake([[[dictionary objectForKey: OffsetParameterKey] objectForKey: XCoordinateParameterKey] floatValue],
-                                       [[[dictionary objectForKey: OffsetParameterKey] objectForKey: YCoordinateParameterKey] floatValue]);
-            
-            // Start by adding the main path into the context
-            CGContextAddPath(context, adjustedPath);            
-            
-            // Create the inverse path
-            CGPathRef currentPath = CGContextCopyPath(context);
-            CGMutablePathRef inversePath = CGPathCreateMutableCopy(currentPath);
-            CGPathAddRect(inversePath, NULL, CGRectInfinite);
-            CGPathRelease(currentPath);
-            
-            // Clip to the main path
-            CGContextClip(context);
-            
-            // Set the shadow settings
-            CGFloat blur = 0.0;
-            if ([dictionary objectForKey: BlurParameterKey])
-                blur = [[dictionary objectForKey: BlurParameterKey] floatValue];
-            
-            UIColor *color = [UIColor blackColor];
-            if ([dictionary objectForKey: ColorParameterKey])
-                color = [UIColor colorForWebColor: [dictionary objectForKey: ColorParameterKey]];
-            
-            if ([dictionary objectForKey: AlphaParameterKey])
-                color = [color colorWithAlphaComponent: [[dictionary objectForKey: AlphaParameterKey] floatValue]];
-            
-            CGContextSetShadowWithColor(context, offset, blur, color.CGColor);
-            
-            if ([dictionary objectForKey: BlendModeParameterKey]) {
-                TKContextSetBlendModeForString(context, [dictionary objectForKey: BlendModeParameterKey]);
-            }
-            
-            CGContextAddPath(context, inversePath);
-            
-            // Fill the inverse path
-            CGContextEOFillPath(context);
-            CGPathRelease(inversePath);
-            
-            CGContextRestoreGState(context);
-        }
-        
-        // Strokes
-        // Outer
-        if ([options objectForKey: OuterStrokeOptionKey]) {
-            CGContextSaveGState(context);
-            
-            // Parameters
-            NSDictionary *dictionary = [options objectForKey: OuterStrokeOptionKey];
-            
-            // There is a stroke, add the path to stroke
-            CGContextAddPath(context, adjustedPath);
-            
-            if ([dictionary objectForKey: AlphaParameterKey])
-                CGContextSetAlpha(context, [[dictionary objectForKey: AlphaParameterKey] floatValue]);
-            
-            if ([dictionary objectForKey: ColorParameterKey])
-                CGContextSetStrokeColorWithColor(context, [UIColor colorForWebColor: [dictionary objectForKey: ColorParameterKey]].CGColor);
-            
-            // Stroke
-            TKContextStrokePathWithOptions(context, dictionary);
-            
-            CGContextRestoreGState(context);
-        }
-        
-        // Inner (iOS 5+ only)
-        if (CGPathCreateCopyByStrokingPath != NULL) {
-            // The dictionary
-            NSDictionary *dictionary = [options objectForKey: InnerStrokeOptionKey];
-            
-            // The necessary function exists, proceed with creating the inner stroke
-            CGContextSaveGState(context);
-            
-            // Start by clipping the context
-            CGContextAddPath(context, adjustedPath);
-            CGContextClip(context);
-            
-            // Stroke the existing path
-            CGFloat width = 2 * [[dictionary objectForKey: WidthParameterKey] floatValue];
-            CGPathRef strokePath = CGPathCreateCopyByStrokingPath(adjustedPath, NULL, width, kCGLineCapButt, kCGLineJoinRound, 4.0);
-            
-            CGContextAddPath(context, strokePath);
-            
-            if ([dictionary objectForKey: ColorParameterKey]) {
-                CGContextSetFillColorWithColor(context, [UIColor colorForWebColor: [dictionary objectForKey: ColorParameterKey]].CGColor);
-            }
-            
-            if ([dictionary objectForKey: AlphaParameterKey]) {
-                CGContextSetAlpha(context, [[dictionary objectForKey: AlphaParameterKey] floatValue]);
-            }
-            
-            CGContextFillPath(context);
-            
-            CGPathRelease(strokePath);
-            
-            CGContextRestoreGState(context);
-        }
-    };   
     
-    // Cache the block if needed
-#if kCachingEnabled
-    [_cache setObject: Block_copy(block) forKey: options];
-#endif
+    // Nothing to draw into (an empty frame), the live label is just as good
+    if (!image)
+        return [self labelInFrame: frame forOptions: description];
     
-    // Create and return the view
-    TKView *view = [TKView viewWithFrame: canvasRect
-                         andDrawingBlock: block];
+    UIView *view = TKTextRunViewWithImage(image, frame, [description objectForKey: ContentStringParameterKey]);
+    if ([description objectForKey: AlphaParameterKey])
+        view.alpha = [[description objectForKey: AlphaParameterKey] floatValue];
     
     return view;
 }
@@ -1139,6 +1031,9 @@
     NSMutableDictionary *states = [NSMutableDictionary dictionaryWithCapacity: 4]; // 4 is the max size
     NSMutableDictionary *stateImages = [NSMutableDictionary dictionaryWithCapacity: 4];
     
+    // The states do not depend on each other, draw all of their images at once on the background workers
+    [self prerenderDescriptions: [self imageDescriptionsForButton: description]];
+    
     // Normal state
     if ([description objectForKey: ButtonNormalStateView]) {
         custom = YES;
@@ -1149,22 +1044,12 @@
         if ([button objectForKey: SizeParameterKey]) {
             
             // Generate the view for the button and compress it into an image
-            UIImage *image = [self compressedImageForDescription: button];
-            
-            if ([button objectForKey: ButtonViewStretchable]) {
-                // It is, the stretchable property contains 2 values, the left and top cap widths
-                NSArray *values = [button objectForKey: ButtonViewStretchable];
-                CGFloat top = [[values objectAtIndex: 1] floatValue];
-                CGFloat left = [[values objectAtIndex: 0] floatValue];
-                
-                // Make the image stretchable
-                image = [image stretchableImageWithLeftCapWidth: left topCapHeight: top];
-            }
+            UIImage *image = [self backgroundImageForButtonState: button];
             
             // Check if an image is present
             if ([button objectForKey: ButtonContentImage]) {
                 // There's an image, render and compress it
-                UIImage *contentImage = [self compressedImageForDescription: [button objectForKey: ButtonContentImage]];
+                UIImage *contentImage = [self atlasImageForDescription: [button objectForKey: ButtonContentImage]];
                 [stateImages setObject: contentImage forKey: ButtonNormalStateView];
             }
             
@@ -1181,23 +1066,12 @@
         
         // Grab the view and compress it to an image
         if ([button objectForKey: SizeParameterKey]) {
-            UIImage *image = [self compressedImageForDescription: button];
-            
-            // Check if it's stretchable
-            if ([button objectForKey: ButtonViewStretchable]) {
-                // It is, the stretchable property contains 2 values, the left and top cap widths
-                NSArray *values = [button objectForKey: ButtonViewStretchable];
-                CGFloat top = [[values objectAtIndex: 1] floatValue];
-                CGFloat left = [[values objectAtIndex: 0] floatValue];
-                
-                // Make the image stretchable
-                image = [image stretchableImageWithLeftCapWidth: left topCapHeight: top];
-            }
+            UIImage *image = [self backgroundImageForButtonState: button];
             
             // Check if an image is present
             if ([button objectForKey: ButtonContentImage]) {
                 // There's an image, render and compress it
-                UIImage *image = [self compressedImageForDescription: [button objectForKey: ButtonContentImage]];
+                UIImage *image = [self atlasImageForDescription: [button objectForKey: ButtonContentImage]];
                 [stateImages setObject: image forKey: ButtonHighlightedStateView];
             }
             
@@ -1214,23 +1088,12 @@
         
         // Grab the view and compress it to an image
         if ([button objectForKey: SizeParameterKey]) {
-            UIImage *image = [self compressedImageForDescription: button];
-            
-            // Check if it's stretchable
-            if ([button objectForKey: ButtonViewStretchable]) {
-                // It is, the stretchable property contains 2 values, the left and top cap widths
-                NSArray *values = [button objectForKey: ButtonViewStretchable];
-                CGFloat top = [[values objectAtIndex: 1] floatValue];
-                CGFloat left = [[values objectAtIndex: 0] floatValue];
-                
-                // Make the image stretchable
-                image = [image stretchableImageWithLeftCapWidth: left topCapHeight: top];
-            }
+            UIImage *image = [self backgroundImageForButtonState: button];
             
             // Check if an image is present
             if ([button objectForKey: ButtonContentImage]) {
                 // There's an image, render and compress it
-                UIImage *image = [self compressedImageForDescription: [button objectForKey: ButtonContentImage]];
+                UIImage *image = [self atlasImageForDescription: [button objectForKey: ButtonContentImage]];
                 [stateImages setObject: image forKey: ButtonSelectedStateView];
             }
             
@@ -1247,23 +1110,12 @@
         
         // Grab the view and compress it to an image
         if ([button objectForKey: SizeParameterKey]) {
-            UIImage *image = [self compressedImageForDescription: button];
-            
-            // Check if it's stretchable
-            if ([button objectForKey: ButtonViewStretchable]) {
-                // It is, the stretchable property contains 2 values, the left and top cap widths
-                NSArray *values = [button objectForKey: ButtonViewStretchable];
-                CGFloat top = [[values objectAtIndex: 1] floatValue];
-                CGFloat left = [[values objectAtIndex: 0] floatValue];
-                
-                // Make the image stretchable
-                image = [image stretchableImageWithLeftCapWidth: left topCapHeight: top];
-            }
+            UIImage *image = [self backgroundImageForButtonState: button];
             
             // Check if an image is present
             if ([button objectForKey: ButtonContentImage]) {
                 // There's an image, render and compress it
-                UIImage *image = [self compressedImageForDescription: [button objectForKey: ButtonContentImage]];
+                UIImage *image = [self atlasImageForDescription: [button objectForKey: ButtonContentImage]];
                 [stateImages setObject: image forKey: ButtonHighlightedSelectedStateView];
             }
             
@@ -1281,23 +1133,12 @@
         // Grab the view and compress it to an image
         if ([button objectForKey: SizeParameterKey]) {
             // There is a size, means there is a view to draw
-            UIImage *image = [self compressedImageForDescription: button]; 
-            
-            // Check if it's stretchable
-            if ([button objectForKey: ButtonViewStretchable]) {
-                // It is, the stretchable property contains 2 values, the left and top cap widths
-                NSArray *values = [button objectForKey: ButtonViewStretchable];
-                CGFloat top = [[values objectAtIndex: 1] floatValue];
-                CGFloat left = [[values objectAtIndex: 0] floatValue];
-                
-                // Make the image stretchable
-                image = [image stretchableImageWithLeftCapWidth: left topCapHeight: top];
-            }
+            UIImage *image = [self backgroundImageForButtonState: button];
             
             // Check if an image is present
             if ([button objectForKey: ButtonContentImage]) {
                 // There's an image, render and compress it
-                UIImage *image = [self compressedImageForDescription: [button objectForKey: ButtonContentImage]];
+                UIImage *image = [self atlasImageForDescription: [button objectForKey: ButtonContentImage]];
                 [stateImages setObject: image forKey: ButtonDisabledStateView];
             }
             
@@ -1628,463 +1469,135 @@
     return button;
 }
 
+- (NSArray *)imageDescriptionsForButton: (NSDictionary *)description {
+    NSMutableArray *descriptions = [NSMutableArray arrayWithCapacity: 10];
+    
+    for (NSString *state in [NSArray arrayWithObjects: ButtonNormalStateView, ButtonHighlightedStateView, ButtonSelectedStateView,
+                             ButtonHighlightedSelectedStateView, ButtonDisabledStateView, nil]) {
+        // Only states with a size are drawn as images
+        NSDictionary *button = [description objectForKey: state];
+        if (![button objectForKey: SizeParameterKey])
+            continue;
+        
+        // Stretchable states are drawn at their minimal size
+        TKNineSlice slice;
+        if (TKNineSliceMake(&slice, button))
+            [descriptions addObject: TKNineSliceDescription(button, &slice)];
+        else
+            [descriptions addObject: button];
+        
+        if ([button objectForKey: ButtonContentImage])
+            [descriptions addObject: [button objectForKey: ButtonContentImage]];
+    }
+    
+    return descriptions;
+}
+
 #pragma mark - Path related
 
 - (CGMutablePathRef)pathForSVGSyntax:(NSString *)description {
-    // First convert the string into commands
-    NSArray *commands = [self arrayOfPathCommandsFromSVGDescription: description];
+    // First parse the string into operations and absolute coordinates
+    TKPathBuffer buffer;
+    TKPathBufferInit(&buffer);
+    [self parseSVGDescription: description intoBuffer: &buffer];
     
     // Create the path
     CGMutablePathRef path = CGPathCreateMutable();
     
-    // Now iterate over the commands
-    CGPoint endPoint;
-    CGPoint controlPoint1;
-    CGPoint controlPoint2;
-    for (TKPathCommand *command in commands) {
-        switch ([command command]) {
-            case TKMoveTo:
-                endPoint = [command endPoint]; 
-                CGPathMoveToPoint(path, NULL, endPoint.x, endPoint.y);
+    // Now iterate over the operations, consuming the coordinates as we go
+    const double *coordinates = buffer.coordinates;
+    for (size_t i = 0; i < buffer.operationCount; i++) {
+        switch (buffer.operations[i]) {
+            case TKPathOperationMoveTo:
+                CGPathMoveToPoint(path, NULL, coordinates[0], coordinates[1]);
                 break;
-            case TKLineTo:
-                endPoint = [command endPoint];
-                CGPathAddLineToPoint(path, NULL, endPoint.x, endPoint.y);
+            case TKPathOperationLineTo:
+                CGPathAddLineToPoint(path, NULL, coordinates[0], coordinates[1]);
                 break;
-            case TKCubicBezier:
-                endPoint = [command endPoint];
-                controlPoint1 = [command controlPoint1];
-                controlPoint2 = [command controlPoint2];
-                CGPathAddCurveToPoint(path, NULL, controlPoint1.x, controlPoint1.y, controlPoint2.x, controlPoint2.y, endPoint.x, endPoint.y);
+            case TKPathOperationCubicTo:
+                CGPathAddCurveToPoint(path, NULL, coordinates[0], coordinates[1], coordinates[2], coordinates[3], coordinates[4], coordinates[5]);
                 break;
-            case TKQuadBezier:
-                endPoint = [command endPoint];
-                controlPoint1 = [command controlPoint1];
-                CGPathAddQuadCurveToPoint(path, NULL, controlPoint1.x, controlPoint1.y, endPoint.x, endPoint.y);
+            case TKPathOperationQuadTo:
+                CGPathAddQuadCurveToPoint(path, NULL, coordinates[0], coordinates[1], coordinates[2], coordinates[3]);
                 break;
-            case TKClosePath:
+            case TKPathOperationClose:
                 CGPathCloseSubpath(path);
                 break;
             default:
                 break;
         }
+        
+        coordinates += TKPathOperationCoordinateCount[buffer.operations[i]];
     }
     
+    TKPathBufferFree(&buffer);
+    
     [(id)path autorelease];
     return path;
 }
 
-- (NSArray *)arrayOfPathCommandsFromSVGDescription: (NSString *)description {
-    // Create a scanner for scanning the description
-    NSScanner *scanner = [NSScanner scannerWithString: description];
-    
-    // The array of commands
-    NSMutableArray *commands = [NSMutableArray array];
-    
-    // The character set that represents any non-relevant character in the SVG syntax
-    NSCharacterSet *relevant = [NSCharacterSet characterSetWithCharactersInString: @"+-0123456789MmZzLlHhVvCcSsQqTt"];
-    NSCharacterSet *nonrelevant = [relevant invertedSet];
-    
-    // Make the scanner scan over everything irrelevant
-    [scanner setCharactersToBeSkipped: nonrelevant];
-    
-    // Keep pointers to the latest used values, 
-    CGPoint currentLocation = CGPointMake(0.0, 0.0);
-    
-    // Create an empty pointer to a string
-    NSString *temp;
+- (BOOL)parseSVGDescription: (NSString *)description intoBuffer: (TKPathBuffer *)buffer {
+    const char *bytes = [description UTF8String];
+    if (!bytes)
+        return NO;
+    
+    // On errors the buffer keeps everything up to the error, which is drawn as is
+    size_t errorOffset = 0;
+    if (!TKPathParse(bytes, strlen(bytes), buffer, &errorOffset)) {
+        NSLog(@"Syntax error in path description at byte %lu: \"%s\"", (unsigned long)errorOffset, bytes + errorOffset);
+        return NO;
+    }
     
-    // Scan the string until we reach the end of it
-    while (![scanner isAtEnd]) {
-        // First grab the starting letter
-        [scanner scanCharactersFromSet: [NSCharacterSet letterCharacterSet] intoString: &temp];
+    return YES;
+}
+
+- (NSArray *)arrayOfPathCommandsFromSVGDescription: (NSString *)description {
+    TKPathBuffer buffer;
+    TKPathBufferInit(&buffer);
+    [self parseSVGDescription: description intoBuffer: &buffer];
+    
+    // Wrap the operations into commands
+    NSMutableArray *commands = [NSMutableArray arrayWithCapacity: buffer.operationCount];
+    const double *coordinates = buffer.coordinates;
+    for (size_t i = 0; i < buffer.operationCount; i++) {
+        TKPathCommand *command = [[TKPathCommand alloc] init];
+        
+        switch (buffer.operations[i]) {
+            case TKPathOperationMoveTo:
+                [command setCommand: TKMoveTo];
+                [command setEndPoint: CGPointMake(coordinates[0], coordinates[1])];
+                break;
+            case TKPathOperationLineTo:
+                [command setCommand: TKLineTo];
+                [command setEndPoint: CGPointMake(coordinates[0], coordinates[1])];
+                break;
+            case TKPathOperationCubicTo:
+                [command setCommand: TKCubicBezier];
+                [command setControlPoint1: CGPointMake(coordinates[0], coordinates[1])];
+                [command setControlPoint2: CGPointMake(coordinates[2], coordinates[3])];
+                [command setEndPoint: CGPointMake(coordinates[4], coordinates[5])];
+                break;
+            case TKPathOperationQuadTo:
+                [command setCommand: TKQuadBezier];
+                [command setControlPoint1: CGPointMake(coordinates[0], coordinates[1])];
+                [command setEndPoint: CGPointMake(coordinates[2], coordinates[3])];
+                break;
+            case TKPathOperationClose:
+                [command setCommand: TKClosePath];
+                break;
+            default:
+                break;
+        }
         
-        // Depending on the letter decide whether the command is relative or absolute
-        NSString *uppercase = [temp uppercaseString];
-        BOOL relative = ![uppercase isEqualToString: temp];    // If it's uppercase, then it's not relative
+        [commands addObject: command];
+        [command release];
         
-        // Assign the command, based on the letter
-        TKPathCommand *command = [[[TKPathCommand alloc] init] autorelease];
-        if ([uppercase isEqualToString: @"M"]) {
-            [command setCommand: TKMoveTo];
-            
-            // Scan in the numbers
-            CGPoint pointHolder = relative ? [self pointFromScanner: scanner relativeToPoint: currentLocation] : [self pointFromScanner: scanner relativeToPoint: CGPointZero];
-            
-            // Adjust the command and store it in the array
-            [command setEndPoint: pointHolder];
-            [commands addObject: command];
-            
-            // Move the current absolute location
-            currentLocation = pointHolder;
-            
-            // Now check if any numbers follow, if so, additional commands are required
-            NSUInteger location = [scanner scanLocation];
-            while ([scanner scanFloat: NULL]) {
-                [scanner setScanLocation: location];
-                
-                pointHolder = relative ? [self pointFromScanner: scanner relativeToPoint: currentLocation] : [self pointFromScanner: scanner relativeToPoint: CGPointZero];
-                
-                TKPathCommand *additionalCommand = [[[TKPathCommand alloc] initWithCommand: TKLineTo] autorelease];
-                [additionalCommand setEndPoint: pointHolder];
-                [commands addObject: additionalCommand];
-                
-                // Move the current location
-                currentLocation = pointHolder;
-                
-                // Store the location
-                location = [scanner scanLocation];
-            }
-        } else if ([uppercase isEqualToString: @"Z"]) {
-            [command setCommand: TKClosePath];
-            
-            // Closepath has nothing else to it, add it to the commands
-            [commands addObject: command];
-        } else if ([uppercase isEqualToString: @"L"]) {
-            [command setCommand: TKLineTo];
-            
-            // Find out the line point
-            CGPoint pointHolder = relative ? [self pointFromScanner: scanner relativeToPoint: currentLocation] : [self pointFromScanner: scanner relativeToPoint: CGPointZero];
-            
-            // Adjust the command and store it in the array
-            [command setEndPoint: pointHolder];
-            [commands addObject: command];
-            
-            // Move current position
-            currentLocation = pointHolder;
-            
-            // Now check if any numbers follow, if so, additional commands are required
-            NSUInteger location = [scanner scanLocation];
-            while ([scanner scanFloat: NULL]) {
-                [scanner setScanLocation: location];
-                
-                pointHolder = relative ? [self pointFromScanner: scanner relativeToPoint: currentLocation] : [self pointFromScanner: scanner relativeToPoint: CGPointZero];
-                
-                TKPathCommand *additionalCommand = [[[TKPathCommand alloc] initWithCommand: TKLineTo] autorelease];
-                [additionalCommand setEndPoint: pointHolder];
-                [commands addObject: additionalCommand];
-                
-                // Move the current location
-                currentLocation = pointHolder;
-                
-                // Store the location
-                location = [scanner scanLocation];
-            }
-        } else if ([uppercase isEqualToString: @"H"]) {
-            [command setCommand: TKLineTo];
-            
-            // Only a single number follows
-            float nextFloat;
-            [scanner scanFloat: &nextFloat];
-            
-            // Put together the point
-            CGPoint pointHolder = relative ? CGPointMake(currentLocation.x + nextFloat, currentLocation.y) : CGPointMake(nextFloat, currentLocation.y);
-            
-            // Adjust the command and the current location
-            [command setEndPoint: pointHolder];
-            currentLocation = pointHolder;
-            
-            // Store the command
-            [commands addObject: command];
-            
-            // Now check if any numbers follow, if so, additional commands are required
-            while ([scanner scanFloat: &nextFloat]) {
-                // Get the Y coordinate and create the command
-                pointHolder.x = relative ? currentLocation.x + nextFloat : nextFloat;
-                
-                TKPathCommand *additionalCommand = [[[TKPathCommand alloc] initWithCommand: TKLineTo] autorelease];
-                [additionalCommand setEndPoint: pointHolder];
-                [commands addObject: additionalCommand];
-                
-                // Move the current location
-                currentLocation = pointHolder;
-            }
-        } else if ([uppercase isEqualToString: @"V"]) {
-            [command setCommand: TKLineTo];
-            
-            // Only a single number follows
-            float nextFloat;
-            [scanner scanFloat: &nextFloat];
-            
-            // Put together the point
-            CGPoint pointHolder = relative ? CGPointMake(currentLocation.x, currentLocation.y + nextFloat) : CGPointMake(currentLocation.x, nextFloat);
-            
-            // Adjust the command and the current location
-            [command setEndPoint: pointHolder];
-            currentLocation = pointHolder;
-            
-            // Store the command
-            [commands addObject: command];
-            
-            // Now check if any numbers follow, if so, additional commands are required
-            while ([scanner scanFloat: &nextFloat]) {
-                // Get the Y coordinate and create the command
-                pointHolder.y = relative ? currentLocation.y + nextFloat : nextFloat;
-                
-                TKPathCommand *additionalCommand = [[[TKPathCommand alloc] initWithCommand: TKLineTo] autorelease];
-                [additionalCommand setEndPoint: pointHolder];
-                [commands addObject: additionalCommand];
-                
-                // Move the current location
-                currentLocation = pointHolder;
-            }
-        } else if ([uppercase isEqualToString: @"C"]) {
-            [command setCommand: TKCubicBezier];
-            
-            // First control point
-            CGPoint pointHolder = relative ? [self pointFromScanner: scanner relativeToPoint: currentLocation] : [self pointFromScanner: scanner relativeToPoint: CGPointZero];
-            [command setControlPoint1: pointHolder];
-            
-            // Second control point
-            pointHolder = relative ? [self pointFromScanner: scanner relativeToPoint: currentLocation] : [self pointFromScanner: scanner relativeToPoint: CGPointZero];
-            [command setControlPoint2: pointHolder];
-            
-            // End point
-            pointHolder = relative ? [self pointFromScanner: scanner relativeToPoint: currentLocation] : [self pointFromScanner: scanner relativeToPoint: CGPointZero];
-            [command setEndPoint: pointHolder];
-            
-            // Move the current location
-            currentLocation = pointHolder;
-            
-            // Store the command
-            [commands addObject: command];
-            
-            // Loop around if more are present
-            NSUInteger location = [scanner scanLocation];
-            while ([scanner scanFloat: NULL]) {
-                // There are more curves present, at least one is here
-                // Back up the scanner
-                [scanner setScanLocation: location];
-                
-                // Additional command
-                TKPathCommand *additionalCommand = [[[TKPathCommand alloc] initWithCommand: TKCubicBezier] autorelease];
-                
-                // First control point
-                CGPoint pointHolder = relative ? [self pointFromScanner: scanner relativeToPoint: currentLocation] : [self pointFromScanner: scanner relativeToPoint: CGPointZero];
-                [additionalCommand setControlPoint1: pointHolder];
-                
-                // Second control point
-                pointHolder = relative ? [self pointFromScanner: scanner relativeToPoint: currentLocation] : [self pointFromScanner: scanner relativeToPoint: CGPointZero];
-                [additionalCommand setControlPoint2: pointHolder];
-                
-                // End point
-                pointHolder = relative ? [self pointFromScanner: scanner relativeToPoint: currentLocation] : [self pointFromScanner: scanner relativeToPoint: CGPointZero];
-                [additionalCommand setEndPoint: pointHolder];
-                
-                // Move the current location
-                currentLocation = pointHolder;
-                
-                // Store the command
-                [commands addObject: additionalCommand];
-                
-                // Store the location
-                location = [scanner scanLocation];
-            }
-        } else if ([uppercase isEqualToString: @"S"]) {
-            [command setCommand: TKCubicBezier];
-            
-            // As this is a "smooth" version, we need to see whether the previous command was a Cubic Bezier or not
-            TKPathCommand *lastCommand = [commands lastObject];
-            
-            // Check if smoothing is available
-            if ([lastCommand command] == TKCubicBezier) {
-                // We can make it smooth, means we need to find out the last control point and reflect it
-                CGPoint previousControlPoint = [lastCommand controlPoint2];
-                
-                CGSize offset = CGSizeMake(currentLocation.x - previousControlPoint.x, currentLocation.y - previousControlPoint.y);
-                
-                CGPoint nextControlPoint = CGPointMake(currentLocation.x + offset.width, currentLocation.y + offset.height);
-                [command setControlPoint1: nextControlPoint];
-            } else {
-                [command setControlPoint1: currentLocation];
-            }
-            
-            // Second control point
-            CGPoint pointHolder = relative ? [self pointFromScanner: scanner relativeToPoint: currentLocation] : [self pointFromScanner: scanner relativeToPoint: CGPointZero];
-            [command setControlPoint2: pointHolder];
-            
-            // End point
-            pointHolder = relative ? [self pointFromScanner: scanner relativeToPoint: currentLocation] : [self pointFromScanner: scanner relativeToPoint: CGPointZero];
-            [command setEndPoint: pointHolder];
-            
-            // Store the command
-            [commands addObject: command];
-            
-            // Move the current point
-            currentLocation = pointHolder;
-            
-            // Loop around if more are present
-            NSUInteger location = [scanner scanLocation];
-            
-            // Adjust the controlpoint to be reflective of the second controlPoint
-            CGPoint previousControlPoint = [command controlPoint2];
-            while ([scanner scanFloat: NULL]) {
-                // There are more curves present, at least one is here
-                // Back up the scanner
-                [scanner setScanLocation: location];
-                
-                // Additional command
-                TKPathCommand *additionalCommand = [[[TKPathCommand alloc] initWithCommand: TKCubicBezier] autorelease];
-                
-                // First control point, as this is supposed to be smooth, it has to be relative to the second control point of the previous curve
-                CGSize offset = CGSizeMake(currentLocation.x - previousControlPoint.x, currentLocation.y - previousControlPoint.y);
-                
-                CGPoint nextControlPoint = CGPointMake(currentLocation.x + offset.width, currentLocation.y + offset.height);
-                [additionalCommand setControlPoint1: nextControlPoint];
-                
-                // Second control point
-                pointHolder = relative ? [self pointFromScanner: scanner relativeToPoint: currentLocation] : [self pointFromScanner: scanner relativeToPoint: CGPointZero];
-                [additionalCommand setControlPoint2: pointHolder];
-                previousControlPoint = pointHolder;
-                
-                // End point
-                pointHolder = relative ? [self pointFromScanner: scanner relativeToPoint: currentLocation] : [self pointFromScanner: scanner relativeToPoint: CGPointZero];
-                [additionalCommand setEndPoint: pointHolder];
-                
-                // Move the current location
-                currentLocation = pointHolder;
-                
-                // Store the command
-                [commands addObject: additionalCommand];
-                
-                // Store the location
-                location = [scanner scanLocation];
-            }
-        } else if ([uppercase isEqualToString: @"Q"]) {
-            [command setCommand: TKQuadBezier];
-            
-            // Control point
-            CGPoint pointHolder = relative ? [self pointFromScanner: scanner relativeToPoint: currentLocation] : [self pointFromScanner: scanner relativeToPoint: CGPointZero];
-            [command setControlPoint1: pointHolder];
-            
-            // End point
-            pointHolder = relative ? [self pointFromScanner: scanner relativeToPoint: currentLocation] : [self pointFromScanner: scanner relativeToPoint: CGPointZero];
-            [command setEndPoint: pointHolder];
-            
-            // Move the current location
-            currentLocation = pointHolder;
-            
-            // Store the command
-            [commands addObject: command];
-            
-            // Loop around if more are present
-            NSUInteger location = [scanner scanLocation];
-            while ([scanner scanFloat: NULL]) {
-                // There are more curves present, at least one is here
-                // Back up the scanner
-                [scanner setScanLocation: location];
-                
-                // Additional command
-                TKPathCommand *additionalCommand = [[[TKPathCommand alloc] initWithCommand: TKQuadBezier] autorelease];
-                
-                // Control point
-                CGPoint pointHolder = relative ? [self pointFromScanner: scanner relativeToPoint: currentLocation] : [self pointFromScanner: scanner relativeToPoint: CGPointZero];
-                [additionalCommand setControlPoint1: pointHolder];
-                
-                // End point
-                pointHolder = relative ? [self pointFromScanner: scanner relativeToPoint: currentLocation] : [self pointFromScanner: scanner relativeToPoint: CGPointZero];
-                [additionalCommand setEndPoint: pointHolder];
-                
-                // Move the current location
-                currentLocation = pointHolder;
-                
-                // Store the command
-                [commands addObject: additionalCommand];
-                
-                // Store the location
-                location = [scanner scanLocation];
-            }
-        } else if ([uppercase isEqualToString: @"T"]) {
-            [command setCommand: TKQuadBezier];
-            
-            // As this is a "smooth" version, we need to see whether the previous command was a Cubic Bezier or not
-            TKPathCommand *lastCommand = [commands lastObject];
-            
-            // Check if smoothing is available
-            if ([lastCommand command] == TKQuadBezier) {
-                // We can make it smooth, means we need to find out the last control point
-                CGPoint previousControlPoint = [lastCommand controlPoint2];
-                
-                CGSize offset = CGSizeMake(currentLocation.x - previousControlPoint.x, currentLocation.y - previousControlPoint.y);
-                
-                CGPoint nextControlPoint = CGPointMake(currentLocation.x + offset.width, currentLocation.y + offset.height);
-                [command setControlPoint1: nextControlPoint];
-            } else {
-                [command setControlPoint1: currentLocation];
-            }
-            
-            // End point
-            CGPoint pointHolder = relative ? [self pointFromScanner: scanner relativeToPoint: currentLocation] : [self pointFromScanner: scanner relativeToPoint: CGPointZero];
-            [command setEndPoint: pointHolder];
-            
-            // Store the command
-            [commands addObject: command];
-            
-            // Move the current point
-            currentLocation = pointHolder;
-            
-            // Loop around if more are present
-            NSUInteger location = [scanner scanLocation];
-            
-            // Adjust the controlpoint to be reflective of the second controlPoint
-            CGPoint previousControlPoint = [command controlPoint1];
-            while ([scanner scanFloat: NULL]) {
-                // There are more curves present, at least one is here
-                // Back up the scanner
-                [scanner setScanLocation: location];
-                
-                // Additional command
-                TKPathCommand *additionalCommand = [[[TKPathCommand alloc] initWithCommand: TKQuadBezier] autorelease];
-                
-                // Control point, as this is supposed to be smooth, it has to be relative to the second control point of the previous curve
-                CGSize offset = CGSizeMake(currentLocation.x - previousControlPoint.x, currentLocation.y - previousControlPoint.y);
-                
-                CGPoint nextControlPoint = CGPointMake(currentLocation.x + offset.width, currentLocation.y + offset.height);
-                [additionalCommand setControlPoint1: nextControlPoint];
-                previousControlPoint = nextControlPoint;
-                
-                // End point
-                pointHolder = relative ? [self pointFromScanner: scanner relativeToPoint: currentLocation] : [self pointFromScanner: scanner relativeToPoint: CGPointZero];
-                [additionalCommand setEndPoint: pointHolder];
-                
-                // Move the current location
-                currentLocation = pointHolder;
-                
-                // Store the command
-                [commands addObject: additionalCommand];
-                
-                // Store the location
-                location = [scanner scanLocation];
-            }
-        } else {
-            // Error, unknown command
-            NSLog(@"Syntax error, path drawing command \"%@\" does not exist", temp);
-            return [NSArray array];
-        }
+        coordinates += TKPathOperationCoordinateCount[buffer.operations[i]];
     }
     
-    return [NSArray arrayWithArray: commands];
-}
-
-- (CGPoint)pointFromScanner: (NSScanner *)scanner relativeToPoint: (CGPoint)currentPoint {
-    // If not relative just pass in CGPointZero as the relativeToPoint, making it absolute
-    NSCharacterSet *numerical = [NSCharacterSet characterSetWithCharactersInString: @"+-0123456789."];
-    
-    // Scan in the numbers, ignoring anything in the middle
-    CGPoint pointHolder = CGPointZero;
-    float nextFloat;
-    [scanner scanFloat: &nextFloat];
-    pointHolder.x = nextFloat;
-    
-    // Skip anything not numerical and or not numerical signs, because there has to be a next float in there
-    [scanner scanUpToCharactersFromSet: numerical intoString: NULL];
+    TKPathBufferFree(&buffer);
     
-    // Scan the second part of the coordinate and form it
-    [scanner scanFloat: &nextFloat];
-    pointHolder.y = nextFloat;
-    pointHolder = CGPointMake(currentPoint.x + pointHolder.x, currentPoint.y + pointHolder.y);
-    
-    return pointHolder;
+    return [NSArray arrayWithArray: commands];
 }
 
 @end
@@ -2110,18 +1623,22 @@
     
     if (self) {
 #if kCachingEnabled
-        _cache = [[NSCache alloc] init];
-        [_cache setName: @"BlockCache"];
-        
-        _JSONCache = [[NSCache alloc] init];
-        [_JSONCache setName: @"JSONCache"];
-        
-        _imageCache = [[NSCache alloc] init];
-        [_imageCache setName: @"ImageCache"];
+        _cache = [[TKCache alloc] initWithName: @"DisplayListCache" byteLimit: kDisplayListCacheDefaultByteLimit];
+        _JSONCache = [[TKCache alloc] initWithName: @"JSONCache" byteLimit: kJSONCacheDefaultByteLimit];
+        _imageCache = [[TKCache alloc] initWithName: @"ImageCache" byteLimit: kImageCacheDefaultByteLimit];
+        _imageAtlas = [[TKImageAtlas alloc] init];
                 
-        // Observe notification about memory warning
-        [[NSNotificationCenter defaultCenter] addObserver: self selector: @selector(flushCache) name: UIApplicationDidReceiveMemoryWarningNotification object: nil];
+        // Observe notification about memory warning, the caches are trimmed more with every warning that follows
+        [[NSNotificationCenter defaultCenter] addObserver: self selector: @selector(didReceiveMemoryWarning:) name: UIApplicationDidReceiveMemoryWarningNotification object: nil];
 #endif
+        
+        _renderer = [[TKRenderer alloc] initWithDataSource: self];
+        
+        // Prewarming leaves a core for the main thread (and the renders it asks for)
+        _prewarmOperations = [[NSMutableDictionary alloc] init];
+        _prewarmQueue = [[NSOperationQueue alloc] init];
+        [_prewarmQueue setName: @"ThemeKit.Prewarm"];
+        [_prewarmQueue setMaxConcurrentOperationCount: MAX((NSInteger)[[NSProcessInfo processInfo] activeProcessorCount] - 1, 1)];
     }
     
     return self;
@@ -2129,45 +1646,130 @@
 
 #pragma mark - Cache
 
+@synthesize diskImageCache = _diskImageCache;
+@synthesize flattensStaticSubtrees = _flattensStaticSubtrees;
+@synthesize packsImagesIntoAtlas = _packsImagesIntoAtlas;
+
+- (size_t)imageCacheByteLimit {
+    return [_imageCache byteLimit];
+}
+
+- (void)setImageCacheByteLimit: (size_t)imageCacheByteLimit {
+    [_imageCache setByteLimit: imageCacheByteLimit];
+}
+
+- (size_t)displayListCacheByteLimit {
+    return [_cache byteLimit];
+}
+
+- (void)setDisplayListCacheByteLimit: (size_t)displayListCacheByteLimit {
+    [_cache setByteLimit: displayListCacheByteLimit];
+}
+
+- (size_t)JSONCacheByteLimit {
+    return [_JSONCache byteLimit];
+}
+
+- (void)setJSONCacheByteLimit: (size_t)JSONCacheByteLimit {
+    [_JSONCache setByteLimit: JSONCacheByteLimit];
+}
+
+- (void)didReceiveMemoryWarning: (NSNotification *)notification {
+    CFAbsoluteTime now = CFAbsoluteTimeGetCurrent();
+    
+    // Warnings in quick succession mean trimming did not help enough, go a level further
+    TKMemoryPressure pressure = TKMemoryPressureModerate;
+    if (_lastMemoryWarning > 0.0 && now - _lastMemoryWarning < kMemoryWarningInterval)
+        pressure = MIN(_memoryPressure + 1, TKMemoryPressureCritical);
+    
+    _lastMemoryWarning = now;
+    _memoryPressure = pressure;
+    
+    [self trimCachesForMemoryPressure: pressure];
+}
+
+- (void)trimCachesForMemoryPressure: (TKMemoryPressure)pressure {
+    if (pressure >= TKMemoryPressureCritical) {
+        [self flushCache];
+        return;
+    }
+    
+    // Descriptions are the cheapest to get back, the file only has to be read again
+    [_JSONCache removeAllObjects];
+    
+    // The least recently used images and display lists are the ones no longer on screen
+    size_t divisor = pressure == TKMemoryPressureHigh ? 4 : 2;
+    [_imageCache trimToBytes: [_imageCache byteLimit] / divisor];
+    [_cache trimToBytes: [_cache byteLimit] / divisor];
+    
+    if (pressure == TKMemoryPressureHigh) {
+        [_imageAtlas removeAllPages];
+        [[TKResourcePool sharedPool] removeAllResources];
+    }
+}
+
 - (void)flushCache {    
     // Simply empty out the cache dictionaries
     [_cache removeAllObjects];
     [_JSONCache removeAllObjects];
     [_imageCache removeAllObjects];
+    
+    // Images already handed out keep their pages, new ones start over in pages of their own
+    [_imageAtlas removeAllPages];
+    
+    // Compiled display lists hold on to what they use, the rest can go
+    [[TKResourcePool sharedPool] removeAllResources];
 }
 
-#pragma mark - Main work methods
+- (NSDictionary *)flatteningStatistics {
+    return [NSDictionary dictionaryWithObjectsAndKeys:
+            [NSNumber numberWithUnsignedInteger: _flattenedSubtrees], @"subtrees",
+            [NSNumber numberWithUnsignedInteger: _flattenedViews], @"viewsSaved",
+            [NSNumber numberWithLongLong: _flattenedBytes], @"backingStoreBytesSaved", nil];
+}
 
-- (UIView *)viewHierarchyForJSONAtPath:(NSString *)path bindings: (NSDictionary **)bindings {  
-#if kCachingEnabled
-    // Check the cache first for JSON
-    if ([_JSONCache objectForKey: path]) {
-        return [self viewHierarchyForJSONDictionary: [_JSONCache objectForKey: path] bindings: bindings];
-    }
-#endif
+- (BOOL)instrumentationEnabled {
+    return TKInstrumentationIsEnabled();
+}
+
+- (void)setInstrumentationEnabled: (BOOL)instrumentationEnabled {
+    TKInstrumentationSetEnabled(instrumentationEnabled);
+}
+
+- (NSDictionary *)instrumentationSnapshot {
+    NSMutableDictionary *snapshot = [NSMutableDictionary dictionaryWithDictionary: TKInstrumentationSnapshot()];
+    [snapshot setObject: [self cacheStatistics] forKey: @"caches"];
+    [snapshot setObject: [self flatteningStatistics] forKey: @"flattening"];
     
-    // Convert the JSON into a NSDictionary
-    // If NSJSONSerialization is available, prefer that, if not, fall back to JSONKit
-    // NSJSONSerialization has benefits, such as speed, but also future support in iOS
-    NSDictionary *JSONDictionary;
-    NSData *JSONData = [NSData dataWithContentsOfFile: path];
+    return snapshot;
+}
+
+- (NSDictionary *)cacheStatistics {
+    NSMutableDictionary *statistics = [NSMutableDictionary dictionary];
     
-    if (NSClassFromString(@"NSJSONSerialization")) {
-        NSError *error = nil;
-        JSONDictionary = [NSJSONSerialization JSONObjectWithData: JSONData options: 0 error: &error];
-        
-        if (error) {
-            NSLog(@"NSJSONSerialization error while parsing JSON: %@", [error description]);
-            return nil;
-        }
-    } else {
-        JSONDictionary = [[JSONDecoder decoder] objectWithData: JSONData];
+#if kCachingEnabled
+    for (TKCache *cache in [NSArray arrayWithObjects: _cache, _JSONCache, _imageCache, nil]) {
+        [statistics setObject: [cache statistics] forKey: [cache name]];
     }
     
-    // Cache the JSON
-#if kCachingEnabled
-    [_JSONCache setObject: JSONDictionary forKey: path];
+    if (_diskImageCache)
+        [statistics setObject: [_diskImageCache statistics] forKey: @"DiskImageCache"];
+    
+    [statistics setObject: [_imageAtlas statistics] forKey: @"ImageAtlas"];
 #endif
+    
+    [statistics setObject: [[TKResourcePool sharedPool] statistics] forKey: @"ResourcePool"];
+    
+    return statistics;
+}
+
+#pragma mark - Main work methods
+
+- (UIView *)viewHierarchyForJSONAtPath:(NSString *)path bindings: (NSDictionary **)bindings {  
+    // Load the description, either from the cache, the compiled archive or the JSON itself
+    NSDictionary *JSONDictionary = [self cachedJSONDictionaryAtPath: path];
+    if (!JSONDictionary)
+        return nil;
         
     // And return a brand new view with the JSON
     // - this is to avoid returning a view that is already in use
@@ -2177,31 +1779,67 @@
 // View creation
 - (UIView *)viewHierarchyFromJSON: (NSData *)JSONData bindings: (NSDictionary **)bindings {
     // First deserialize the JSON, this method does not cache the resulting JSON dictionary
-    // If NSJSONSerialization is available, prefer that, if not, fall back to JSONKit
-    // NSJSONSerialization has benefits, such as speed, but also future support in iOS
-    NSDictionary *JSONDictionary;
-    if (NSClassFromString(@"NSJSONSerialization")) {
-        NSError *error = nil;
-        JSONDictionary = [NSJSONSerialization JSONObjectWithData: JSONData options: 0 error: &error];
-        
-        if (error) {
-            NSLog(@"NSJSONSerialization error while parsing JSON: %@", [error description]);
-            return nil;
-        }
-    } else {
-        JSONDictionary = [[JSONDecoder decoder] objectWithData: JSONData];
-    }
+    NSDictionary *JSONDictionary = [self JSONDictionaryFromData: JSONData];
+    if (!JSONDictionary)
+        return nil;
     
     return [self viewHierarchyForJSONDictionary: JSONDictionary bindings: bindings];
 }
 
+#pragma mark - Incremental updates
+
+- (TKThemeDiff *)updateViewHierarchy: (UIView *)view withJSON: (NSData *)JSONData bindings: (NSDictionary **)bindings {
+    return [self updateViewHierarchy: view withJSONDictionary: [self JSONDictionaryFromData: JSONData] bindings: bindings];
+}
+
+- (TKThemeDiff *)updateViewHierarchy: (UIView *)view withJSONAtPath: (NSString *)path bindings: (NSDictionary **)bindings {
+    // Skip the cache, the file has most likely changed since it was loaded
+    NSDictionary *JSONDictionary = [self JSONDictionaryAtPath: path];
+    
+#if kCachingEnabled
+    if (JSONDictionary)
+        [_JSONCache setObject: JSONDictionary forKey: path cost: TKJSONCostForPath(path)];
+#endif
+    
+    return [self updateViewHierarchy: view withJSONDictionary: JSONDictionary bindings: bindings];
+}
+
+- (TKThemeWatcher *)watchJSONAtPath: (NSString *)path forViewHierarchy: (UIView *)view handler: (TKThemeUpdateHandler)handler {
+    TKThemeWatcher *watcher = [[TKThemeWatcher alloc] initWithPath: path handler: ^(TKThemeWatcher *changed) {
+        NSDictionary *bindings = nil;
+        TKThemeDiff *diff = [self updateViewHierarchy: view withJSONAtPath: [changed path] bindings: &bindings];
+        
+        if (handler)
+            handler(diff, bindings);
+    }];
+    
+    return [watcher autorelease];
+}
+
+- (BOOL)compileJSONAtPath: (NSString *)path toPath: (NSString *)archivePath {
+    NSData *JSONData = [NSData dataWithContentsOfFile: path];
+    if (!JSONData)
+        return NO;
+    
+    // Straight from the bytes, with the same compiler as the tkc tool
+    size_t length = 0, errorOffset = 0;
+    uint8_t *bytes = TKThemeCompile((const char *)[JSONData bytes], [JSONData length], &length, &errorOffset);
+    if (!bytes) {
+        NSLog(@"Error! Theme at %@ not compiled, invalid JSON at byte %lu", path, (unsigned long)errorOffset);
+        return NO;
+    }
+    
+    NSData *archive = [NSData dataWithBytesNoCopy: bytes length: length freeWhenDone: YES];
+    return [archive writeToFile: archivePath atomically: YES];
+}
+
 - (CGContextRef)newBitmapContextOfSize:(CGSize) size {
     CGContextRef    context = NULL;
     CGColorSpaceRef colorSpace;
     int             bitmapBytesPerRow;
     
     bitmapBytesPerRow   = (size.width * 4);    
-    colorSpace = CGColorSpaceCreateDeviceRGB();
+    colorSpace = [[TKResourcePool sharedPool] colorSpace];
         
     context = CGBitmapContextCreate (NULL,
                                      size.width,
@@ -2211,65 +1849,24 @@
                                      colorSpace,
                                      kCGImageAlphaPremultipliedLast);
     
-    CGContextSetAllowsAntialiasing (context,NO);
-    
-    if (context== NULL) {
-        CGColorSpaceRelease(colorSpace);
-        fprintf (stderr, "Context not created!");
+    if (context == NULL) {
+        NSLog(@"Error! Bitmap context of size %@ not created", NSStringFromCGSize(size));
         return NULL;
     }
     
-    CGColorSpaceRelease(colorSpace);
+    CGContextSetAllowsAntialiasing(context, NO);
+    
     return context;
 }
 
 - (UIImage *)compressedImageForJSONAtPath: (NSString *)path {    
-#if kCachingEnabled
-    // Check the cache first for JSON
-    if ([_JSONCache objectForKey: path]) {
-        return [self compressedImageForDescription: [_JSONCache objectForKey: path]];
-    }
-#endif
-    
-    // Convert the JSON into a NSDictionary
-    // If NSJSONSerialization is available, prefer that, if not, fall back to JSONKit
-    // NSJSONSerialization has benefits, such as speed, but also future support in iOS
-    NSDictionary *JSONDictionary;
-    NSData *JSONData = [NSData dataWithContentsOfFile: path];
-    
-    if (NSClassFromString(@"NSJSONSerialization")) {
-        NSError *error = nil;
-        JSONDictionary = [NSJSONSerialization JSONObjectWithData: JSONData options: 0 error: &error];
-        
-        if (error) {
-            NSLog(@"NSJSONSerialization error while parsing JSON: %@", [error description]);
-            return nil;
-        }
-    } else {
-        JSONDictionary = [[JSONDecoder decoder] objectWithData: JSONData];
-    }
-    
-    // Cache the JSON
-#if kCachingEnabled
-    [_JSONCache setObject: JSONDictionary forKey: path];
-    
-    // Check the cache for the image
-    if ([_imageCache objectForKey: JSONDictionary])
-        return [_imageCache objectForKey: JSONDictionary];
-#endif
-
-    // Not cached, render the view as an image
-    UIImage *image = [self compressedImageForView: [self viewHierarchyForJSONDictionary: JSONDictionary bindings: NULL]];
-    
-#if kCachingEnabled
-    // Cache the resulting image
-    [_imageCache setObject: image forKey: JSONDictionary];
-#endif
-    
-    return image;
+    // The outermost dictionary is treated like any other description, including the image cache
+    return [self compressedImageForDescription: [self cachedJSONDictionaryAtPath: path]];
 }
 
 - (UIImage *)compressedImageForView: (UIView *)view {
+    TKInstrumentBegin(timer);
+    
     // Weird bug that exists on iPhone 3G, has something do to with CGContext stacks, due to this push a 
     // small context on the stack to avoid the main context being ruined
     CGContextRef bitmap = [self newBitmapContextOfSize: CGSizeMake(1.0, 1.0)];
@@ -2302,10 +1899,157 @@
     // The weird CG stack bug, pop the small buffer stack we pushed earlier
     UIGraphicsPopContext();
     CGContextRelease(bitmap);
-        
+    
+    TKInstrumentEnd(TKInstrumentationPhaseRasterize, timer);
     return image;
 }
 
+#pragma mark - Background rendering
+
+- (NSInteger)maxConcurrentRenders {
+    return [_renderer maxConcurrentRenders];
+}
+
+- (void)setMaxConcurrentRenders: (NSInteger)count {
+    [_renderer setMaxConcurrentRenders: count];
+}
+
+- (TKRenderRequest *)compressedImageForDescription: (NSDictionary *)description completion: (TKRenderCompletion)completion {
+    TKRenderRequest *request;
+    description = TKImmutableDescription(description);
+    
+#if kCachingEnabled
+    // Already there, still complete asynchronously so callers see the same behaviour every time
+    UIImage *cachedImage = description ? [self cachedImageForDescription: description] : nil;
+    if (cachedImage) {
+        request = [[[TKRenderRequest alloc] initWithCompletion: completion] autorelease];
+        [request completeWithImage: cachedImage];
+        return request;
+    }
+#endif
+    
+    if ([TKRenderer canRenderDescription: description])
+        return [_renderer renderDescription: description scale: [self screenScale] completion: completion];
+    
+    // Needs UIKit, so it is drawn on the main thread
+    request = [[[TKRenderRequest alloc] initWithCompletion: completion] autorelease];
+    dispatch_async(dispatch_get_main_queue(), ^{
+        if (![request isCancelled])
+            [request completeWithImage: [self compressedImageForDescription: description]];
+    });
+    
+    return request;
+}
+
+- (TKRenderRequest *)compressedImageForJSONAtPath: (NSString *)path completion: (TKRenderCompletion)completion {
+    // Loading is cheap next to drawing (and usually cached), only the drawing is moved off the main thread
+    return [self compressedImageForDescription: [self cachedJSONDictionaryAtPath: path] completion: completion];
+}
+
+#pragma mark - Prewarming
+
+static NSOperationQueuePriority TKQueuePriorityForPrewarmPriority(TKPrewarmPriority priority) {
+    switch (priority) {
+        case TKPrewarmPriorityBackground:
+            return NSOperationQueuePriorityVeryLow;
+        case TKPrewarmPriorityVisible:
+            return NSOperationQueuePriorityVeryHigh;
+        default:
+            return NSOperationQueuePriorityNormal;
+    }
+}
+
+- (TKPrewarmTask *)prewarmThemesInDirectory: (NSString *)directory priority: (TKPrewarmPriority)priority {
+    NSError *error = nil;
+    NSArray *contents = [[NSFileManager defaultManager] contentsOfDirectoryAtPath: directory error: &error];
+    if (!contents)
+        NSLog(@"Failed to list themes for prewarming in %@: %@", directory, [error description]);
+    
+    NSMutableArray *paths = [NSMutableArray arrayWithCapacity: [contents count]];
+    for (NSString *file in [contents sortedArrayUsingSelector: @selector(compare:)]) {
+        NSString *extension = [[file pathExtension] lowercaseString];
+        
+        // Compiled themes are picked up through their JSON, if it's there (that's the path they are loaded by)
+        if ([extension isEqualToString: TKThemeArchivePathExtension]) {
+            NSString *JSONFile = [[file stringByDeletingPathExtension] stringByAppendingPathExtension: @"json"];
+            if ([contents containsObject: JSONFile])
+                continue;
+        } else if (![extension isEqualToString: @"json"]) {
+            continue;
+        }
+        
+        [paths addObject: [directory stringByAppendingPathComponent: file]];
+    }
+    
+    return [self prewarmThemesAtPaths: paths priority: priority];
+}
+
+- (TKPrewarmTask *)prewarmThemesAtPaths: (NSArray *)paths priority: (TKPrewarmPriority)priority {
+    TKPrewarmTask *task = [[[TKPrewarmTask alloc] initWithPaths: paths] autorelease];
+    NSMutableArray *operations = [NSMutableArray arrayWithCapacity: [paths count]];
+    
+    // The scale is read here, UIScreen belongs to the main thread
+    CGFloat scale = [self screenScale];
+    
+    for (NSString *path in paths) {
+        __block BOOL started = NO;
+        __block NSBlockOperation *operation = [NSBlockOperation blockOperationWithBlock: ^{
+            NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+            started = YES;
+            
+            CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+            BOOL success = [self prewarmThemeAtPath: path scale: scale];
+            
+            if (!success)
+                NSLog(@"Failed to prewarm the theme at %@", path);
+            
+            [task themeDidFinishWithSuccess: success duration: CFAbsoluteTimeGetCurrent() - start];
+            
+            [pool drain];
+        }];
+        
+        // Also called for operations cancelled before they started, which never run the block above
+        [operation setCompletionBlock: ^{
+            @synchronized (_prewarmOperations) {
+                if ([_prewarmOperations objectForKey: path] == operation)
+                    [_prewarmOperations removeObjectForKey: path];
+            }
+            
+            if (!started)
+                [task themeWasSkipped];
+        }];
+        
+        [operation setQueuePriority: TKQueuePriorityForPrewarmPriority(priority)];
+        
+        // Background work also yields the CPU to everything else
+        if (priority == TKPrewarmPriorityBackground && [operation respondsToSelector: @selector(setThreadPriority:)])
+            [operation setThreadPriority: 0.1];
+        
+        [operations addObject: operation];
+    }
+    
+    @synchronized (_prewarmOperations) {
+        for (NSUInteger i = 0; i < [paths count]; i++) {
+            [_prewarmOperations setObject: [operations objectAtIndex: i] forKey: [paths objectAtIndex: i]];
+        }
+    }
+    
+    [task setOperations: operations];
+    [_prewarmQueue addOperations: operations waitUntilFinished: NO];
+    
+    return task;
+}
+
+- (void)prioritizeThemeAtPath: (NSString *)path {
+    @synchronized (_prewarmOperations) {
+        NSOperation *operation = [_prewarmOperations objectForKey: path];
+        [operation setQueuePriority: NSOperationQueuePriorityVeryHigh];
+        
+        if ([operation respondsToSelector: @selector(setThreadPriority:)])
+            [operation setThreadPriority: 0.5];
+    }
+}
+
 - (void)dealloc {
 #if kCachingEnabled
     // Remove observer for the memory warning
@@ -2315,8 +2059,16 @@
     [_cache release];
     [_JSONCache release];
     [_imageCache release];
+    [_diskImageCache release];
+    [_imageAtlas release];
 #endif
     
+    [_renderer release];
+    
+    [_prewarmQueue cancelAllOperations];
+    [_prewarmQueue release];
+    [_prewarmOperations release];
+    
     [super dealloc];
 }
 
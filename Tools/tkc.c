@@ -0,0 +1,137 @@
+//
+//  tkc.c
+//  ThemeEngine
+//
+//  Theme compiler for the build machine, writes the archive (.tkb) of a JSON theme that ThemeKit loads
+//  instead of the JSON next to it. The archives are the same as -[ThemeKit compileJSONAtPath:toPath:] writes
+//
+//      tkc theme.json [theme.tkb]
+//
+//  Without the output path the archive is written next to the JSON. Add it as a build phase of the app to
+//  ship the compiled themes along with (or instead of) the JSON
+//
+//  Copyright (c) 2012 __MyCompanyName__. All rights reserved.
+//
+
+#include "TKThemeCompiler.h"
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static char *TKReadFile(const char *path, size_t *length) {
+    FILE *file = fopen(path, "rb");
+    if (!file)
+        return NULL;
+
+    size_t capacity = 65536, used = 0;
+    char *bytes = (char *)malloc(capacity);
+    while (bytes) {
+        used += fread(bytes + used, 1, capacity - used, file);
+        if (used < capacity)
+            break;
+
+        capacity *= 2;
+        char *grown = (char *)realloc(bytes, capacity);
+        if (!grown)
+            free(bytes);
+        bytes = grown;
+    }
+
+    if (ferror(file)) {
+        free(bytes);
+        bytes = NULL;
+    }
+
+    fclose(file);
+    *length = used;
+    return bytes;
+}
+
+// Same name with the .tkb extension
+static char *TKArchivePath(const char *path) {
+    const char *slash = strrchr(path, '/');
+    const char *dot = strrchr(path, '.');
+    size_t stem = (dot && (!slash || dot > slash)) ? (size_t)(dot - path) : strlen(path);
+
+    char *archivePath = (char *)malloc(stem + 5);
+    if (archivePath) {
+        memcpy(archivePath, path, stem);
+        memcpy(archivePath + stem, ".tkb", 5);
+    }
+
+    return archivePath;
+}
+
+// Into a temporary file first, so that the engine never maps a half written archive
+static int TKWriteFile(const char *path, const uint8_t *bytes, size_t length) {
+    size_t pathLength = strlen(path);
+    char *temporaryPath = (char *)malloc(pathLength + 5);
+    if (!temporaryPath)
+        return -1;
+
+    memcpy(temporaryPath, path, pathLength);
+    memcpy(temporaryPath + pathLength, ".tmp", 5);
+
+    FILE *file = fopen(temporaryPath, "wb");
+    int result = -1;
+    if (file) {
+        bool written = fwrite(bytes, 1, length, file) == length;
+        if (fclose(file) == 0 && written && rename(temporaryPath, path) == 0)
+            result = 0;
+        else
+            remove(temporaryPath);
+    }
+
+    free(temporaryPath);
+    return result;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2 || argc > 3) {
+        fprintf(stderr, "usage: tkc theme.json [theme.tkb]\n");
+        return EXIT_FAILURE;
+    }
+
+    const char *path = argv[1];
+    size_t length = 0;
+    char *JSON = TKReadFile(path, &length);
+    if (!JSON) {
+        fprintf(stderr, "tkc: %s: %s\n", path, strerror(errno));
+        return EXIT_FAILURE;
+    }
+
+    size_t archiveLength = 0, errorOffset = 0;
+    uint8_t *archive = TKThemeCompile(JSON, length, &archiveLength, &errorOffset);
+    if (!archive) {
+        if (errorOffset < length) {
+            // Lines and columns from 1, like the editors show them
+            size_t line = 1, column = 1;
+            for (size_t i = 0; i < errorOffset; i++) {
+                column = JSON[i] == '\n' ? 1 : column + 1;
+                line += JSON[i] == '\n';
+            }
+
+            fprintf(stderr, "tkc: %s:%zu:%zu: invalid JSON (byte %zu)\n", path, line, column, errorOffset);
+        } else {
+            fprintf(stderr, "tkc: %s: truncated JSON, or too large to compile\n", path);
+        }
+
+        free(JSON);
+        return EXIT_FAILURE;
+    }
+
+    char *archivePath = argc == 3 ? argv[2] : TKArchivePath(path);
+    int result = archivePath ? TKWriteFile(archivePath, archive, archiveLength) : -1;
+    if (result != 0)
+        fprintf(stderr, "tkc: %s: %s\n", archivePath ? archivePath : path, strerror(errno));
+
+    if (archivePath != argv[2])
+        free(archivePath);
+    free(archive);
+    free(JSON);
+
+    return result == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}